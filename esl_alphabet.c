@@ -18,10 +18,15 @@
 #endif
 
 #include "easel.h"
+#include "esl_cpu.h"
 #include "esl_mem.h"
 
 #include "esl_alphabet.h"
 
+static int64_t digitize_run_dispatcher(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
+static int64_t digitize_run_none      (const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
+static int64_t (*digitize_run)        (const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq) = digitize_run_dispatcher;
+
 
 
 /*****************************************************************
@@ -679,13 +684,21 @@ esl_abc_Digitize(const ESL_ALPHABET *a, const char *seq, ESL_DSQ *dsq)
   int     status;
   int64_t i;			/* position in seq */
   int64_t j;			/* position in dsq */
+  int64_t L;			/* length of seq */
+  int64_t k;			/* length of a run of residues */
   ESL_DSQ x;
 
   status = eslOK;
   dsq[0] = eslDSQ_SENTINEL;
-  for (i = 0, j = 1; seq[i] != '\0'; i++) 
+  L      = strlen(seq);
+  for (i = 0, j = 1; i < L; i++) 
     { 
-      x = a->inmap[(int) seq[i]];
+      k  = esl_abc_DigitizeRun(a->inmap, seq+i, L-i, dsq+j);
+      i += k;
+      j += k;
+      if (i == L) break;
+
+      x = isascii(seq[i]) ? a->inmap[(int) seq[i]] : eslDSQ_ILLEGAL;
       if      (esl_abc_XIsValid(a, x)) dsq[j] = x;
       else if (x == eslDSQ_IGNORED) continue; 
       else {
@@ -698,6 +711,87 @@ esl_abc_Digitize(const ESL_ALPHABET *a, const char *seq, ESL_DSQ *dsq)
   return status;
 }
 
+/* Function:  esl_abc_DigitizeRun()
+ * Synopsis:  Digitize a run of residues, with vector code.
+ *
+ * Purpose:   Map bytes of text <s> through input map <inmap>, for as
+ *            long as they map to residues (codes <= 127), and store
+ *            the residues in <dsq[0..]>. Stop at the first byte that
+ *            doesn't map to a residue (that is, a byte that maps to
+ *            <eslDSQ_IGNORED>, <eslDSQ_ILLEGAL>, <eslDSQ_EOL> or
+ *            another special code, or a non-ASCII byte), or after
+ *            <n> bytes. If <dsq> is <NULL>, only scan.
+ *
+ *            This is the inner loop of digitizing sequence text,
+ *            such as a line of sequence from a file. Caller deals
+ *            with whatever stopped the run, then calls again.
+ *
+ *            Most of the work is done by vectorized kernels, in
+ *            esl_alphabet_{sse,avx,avx512,neon}.c, chosen at runtime
+ *            for the processor; scalar code finishes the run.
+ *
+ *            Caller provides <dsq> with room for <n> residues. The
+ *            kernels store whole vectors, so <dsq[k..n-1]> may be
+ *            overwritten with garbage.
+ *
+ * Args:      inmap - an Easel input map, inmap[0..127]
+ *            s     - text to digitize
+ *            n     - number of bytes in <s> that can be read
+ *            dsq   - RETURN: residues, in <dsq[0..k-1]>; or <NULL>
+ *
+ * Returns:   the length of the run, <k>: <s[0..k-1]> are residues,
+ *            and either <k == n> or <s[k]> is not a residue.
+ */
+int64_t
+esl_abc_DigitizeRun(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq)
+{
+  int64_t k = (*digitize_run)(inmap, s, n, dsq);
+  ESL_DSQ x;
+
+  for ( ; k < n && isascii(s[k]); k++)
+    {
+      if ((x = inmap[(int) s[k]]) > 127) break;
+      if (dsq) dsq[k] = x;
+    }
+  return k;
+}
+
+/* digitize_run_dispatcher()
+ *
+ * The first call to esl_abc_DigitizeRun() comes here, and we set its
+ * kernel to the fastest one that's compiled in and that the processor
+ * supports, following our standard runtime dispatch pattern. If there
+ * are none, digitize_run_none() leaves all the work to the scalar
+ * code.
+ */
+static int64_t
+digitize_run_dispatcher(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq)
+{
+  int64_t (*kernel)(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq) = digitize_run_none;
+
+#ifdef eslENABLE_AVX512
+  if (kernel == digitize_run_none && esl_cpu_has_avx512()) kernel = esl_abc_digitize_run_avx512;
+#endif
+#ifdef eslENABLE_AVX
+  if (kernel == digitize_run_none && esl_cpu_has_avx())    kernel = esl_abc_digitize_run_avx;
+#endif
+#ifdef eslENABLE_SSE4
+  if (kernel == digitize_run_none && esl_cpu_has_sse4())   kernel = esl_abc_digitize_run_sse;
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  if (kernel == digitize_run_none)                         kernel = esl_abc_digitize_run_neon;
+#endif
+  digitize_run = kernel;
+  return (*digitize_run)(inmap, s, n, dsq);
+}
+
+static int64_t
+digitize_run_none(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq)
+{
+  return 0;
+}
+
+
 /* Function:  esl_abc_Textize()
  * Synopsis:  Convert digital sequence to text.
  *
@@ -962,6 +1056,7 @@ esl_abc_dsqcat_noalloc(const ESL_DSQ *inmap, ESL_DSQ *dsq, int64_t *L, const cha
 {
   int64_t   xpos;
   esl_pos_t cpos;
+  esl_pos_t k;
   ESL_DSQ   x;
   int       status = eslOK;
 
@@ -971,6 +1066,11 @@ esl_abc_dsqcat_noalloc(const ESL_DSQ *inmap, ESL_DSQ *dsq, int64_t *L, const cha
    */
   for (xpos = *L+1, cpos = 0; cpos < n; cpos++)
     {
+      k     = esl_abc_DigitizeRun(inmap, s+cpos, n-cpos, dsq+xpos);
+      cpos += k;
+      xpos += k;
+      if (cpos == n) break;
+
       if (! isascii(s[cpos])) { dsq[xpos++] = inmap[0]; status = eslEINVAL; continue; }
 
       x = inmap[(int) s[cpos]];
@@ -1786,6 +1886,7 @@ esl_abc_ValidateSeq(const ESL_ALPHABET *a, const char *seq, int64_t L, char *err
  * 4. Unit tests.
  *****************************************************************/
 #ifdef eslALPHABET_TESTDRIVE
+#include "esl_random.h"
 #include "esl_vectorops.h"
 
 static int
@@ -2048,6 +2149,92 @@ utest_Digitize(void)
   return status;
 }
 
+/* utest_DigitizeRun()
+ * Compares esl_abc_DigitizeRun(), each vector kernel the processor
+ * supports, and esl_abc_Digitize() to scalar code, on text that's
+ * mostly residues with other bytes mixed in (ignored, illegal,
+ * non-ASCII, and NUL). Kernels must never store past the <n> bytes
+ * they're given.
+ */
+static void
+utest_DigitizeRun(void)
+{
+  char            msg[]   = "esl_abc_DigitizeRun() unit test failed";
+  ESL_RANDOMNESS *rng     = esl_randomness_Create(42);
+  int             types[] = { eslDNA, eslAMINO };
+  int64_t       (*kernel[4])(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
+  int             nk      = 0;
+  ESL_ALPHABET   *a;
+  char            s[512];
+  ESL_DSQ         ref[512], dsq[512+64], dsq2[512+2];
+  int64_t         n, i, j, k, kref;
+  int             t, q, iter;
+  ESL_DSQ         x;
+  int             status;
+
+#ifdef eslENABLE_AVX512
+  if (esl_cpu_has_avx512()) kernel[nk++] = esl_abc_digitize_run_avx512;
+#endif
+#ifdef eslENABLE_AVX
+  if (esl_cpu_has_avx())    kernel[nk++] = esl_abc_digitize_run_avx;
+#endif
+#ifdef eslENABLE_SSE4
+  if (esl_cpu_has_sse4())   kernel[nk++] = esl_abc_digitize_run_sse;
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  kernel[nk++] = esl_abc_digitize_run_neon;
+#endif
+
+  for (t = 0; t < 2; t++)
+    {
+      if ((a = esl_alphabet_Create(types[t])) == NULL) esl_fatal(msg);
+      if (esl_alphabet_SetIgnored(a, " \t\n")  != eslOK) esl_fatal(msg);
+
+      for (iter = 0; iter < 2000; iter++)
+        {
+          n = esl_rnd_Roll(rng, 500);
+          for (i = 0; i < n; i++)
+            {
+              if      (esl_rnd_Roll(rng, 100) < 97) s[i] = a->sym[esl_rnd_Roll(rng, a->Kp)];
+              else if (esl_rnd_Roll(rng, 2))        s[i] = " \t\n"[esl_rnd_Roll(rng, 3)];
+              else                                  s[i] = (char) esl_rnd_Roll(rng, 256);
+              if (isupper(s[i]) && esl_rnd_Roll(rng, 2)) s[i] = tolower(s[i]);
+            }
+          s[n] = '\0';
+
+          for (kref = 0; kref < n && isascii(s[kref]) && (x = a->inmap[(int) s[kref]]) <= 127; kref++) ref[kref] = x;
+
+          if (esl_abc_DigitizeRun(a->inmap, s, n, dsq)  != kref) esl_fatal(msg);
+          if (memcmp(dsq, ref, kref)                    != 0)    esl_fatal(msg);
+          if (esl_abc_DigitizeRun(a->inmap, s, n, NULL) != kref) esl_fatal(msg);
+
+          for (q = 0; q < nk; q++)
+            {
+              memset(dsq, 0xaa, n+64);
+              k = (*kernel[q])(a->inmap, s, n, dsq);
+              if (k > kref || (k < kref && n - k >= 16))        esl_fatal(msg);  // kernels leave < 16 bytes to scalar code
+              if (memcmp(dsq, ref, k) != 0)                     esl_fatal(msg);
+              for (i = n; i < n+64; i++) if (dsq[i] != 0xaa)    esl_fatal(msg);
+              if ((*kernel[q])(a->inmap, s, n, NULL) != k)      esl_fatal(msg);
+            }
+
+          /* esl_abc_Digitize() stops at a NUL, ignores IGNORED chars, and makes anything else illegal an unknown residue */
+          status = eslOK;
+          for (i = 0, j = 1; s[i] != '\0'; i++)
+            {
+              x = isascii(s[i]) ? a->inmap[(int) s[i]] : eslDSQ_ILLEGAL;
+              if      (x <= 127)            ref[j++] = x;
+              else if (x != eslDSQ_IGNORED) { ref[j++] = esl_abc_XGetUnknown(a); status = eslEINVAL; }
+            }
+          if (esl_abc_Digitize(a, s, dsq2) != status) esl_fatal(msg);
+          if (memcmp(dsq2+1, ref+1, j-1)   != 0)      esl_fatal(msg);
+          if (dsq2[0] != eslDSQ_SENTINEL || dsq2[j] != eslDSQ_SENTINEL) esl_fatal(msg);
+        }
+      esl_alphabet_Destroy(a);
+    }
+  esl_randomness_Destroy(rng);
+}
+
 static int
 utest_Textize(void) 
 {
@@ -2387,6 +2574,7 @@ main(void)
 
   utest_CreateDsq();
   utest_Digitize();
+  utest_DigitizeRun();
   utest_Textize();
   utest_TextizeN();
   utest_dsqdup();
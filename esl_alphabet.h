@@ -53,6 +53,7 @@ extern void          esl_alphabet_Destroy(ESL_ALPHABET *a);
  */
 extern int     esl_abc_CreateDsq(const ESL_ALPHABET *a, const char    *seq,        ESL_DSQ **ret_dsq);
 extern int     esl_abc_Digitize (const ESL_ALPHABET *a, const char    *seq,        ESL_DSQ *dsq);
+extern int64_t esl_abc_DigitizeRun(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
 extern int     esl_abc_Textize  (const ESL_ALPHABET *a, const ESL_DSQ *dsq,  int64_t L, char   *seq);
 extern int     esl_abc_TextizeN (const ESL_ALPHABET *a, const ESL_DSQ *dptr, int64_t L, char   *buf);
 extern int     esl_abc_dsqcpy(const ESL_DSQ *dsq, int64_t L, ESL_DSQ *dcopy);
@@ -126,6 +127,22 @@ extern int    esl_abc_ValidateSeq(const ESL_ALPHABET *a, const char *seq, int64_
 #define esl_abc_CGetUnknown(a)       ((a)->sym[(a)->Kp-3])
 #define esl_abc_CGetNonresidue(a)    ((a)->sym[(a)->Kp-2])
 #define esl_abc_CGetMissing(a)       ((a)->sym[(a)->Kp-1])
+
+/* Vectorized digitization kernels, in esl_alphabet_{sse,avx,avx512,neon}.c
+ */
+#ifdef eslENABLE_SSE4
+extern int64_t esl_abc_digitize_run_sse   (const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
+#endif
+#ifdef eslENABLE_AVX
+extern int64_t esl_abc_digitize_run_avx   (const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
+#endif
+#ifdef eslENABLE_AVX512
+extern int64_t esl_abc_digitize_run_avx512(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+extern int64_t esl_abc_digitize_run_neon  (const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq);
+#endif
+
 #ifdef __cplusplus // magic to make C++ compilers happy
 }
 #endif
@@ -0,0 +1,71 @@
+/* Vectorized digitization of residue runs: x86 AVX2 implementation.
+ *
+ * Same as the SSE4 kernel in esl_alphabet_sse.c (see there for how
+ * the 128-entry input map is looked up), 32 bytes at a time. AVX2
+ * byte shuffles work within each 128-bit lane, so each lane gets its
+ * own copy of the eight 16-entry tables.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_AVX> was
+ * set in <esl_config.h> by the configure script. When it is not set,
+ * we include some dummy code to silence compiler and ranlib warnings
+ * about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_AVX
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+
+
+/* Function:  esl_abc_digitize_run_avx()
+ * Synopsis:  Digitize a run of residues, AVX2 version.
+ *
+ * Purpose:   As <esl_abc_digitize_run_sse()>, but 32 bytes at a time.
+ *
+ *            Where it stops for lack of input, the narrower SSE4
+ *            kernel takes over.
+ *
+ * Returns:   the number of leading bytes of <s> that are residues,
+ *            <i>, as <esl_abc_digitize_run_sse()>.
+ */
+int64_t
+esl_abc_digitize_run_avx(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq)
+{
+  const __m256i sat = _mm256_set1_epi8(0x70);
+  const __m256i s16 = _mm256_set1_epi8(0x10);
+  __m256i  t[8];
+  __m256i  c, idx, x;
+  int64_t  i;
+  int      h;
+  uint32_t m;
+
+  for (h = 0; h < 8; h++) t[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (inmap + 16*h)));
+
+  for (i = 0; i+32 <= n; i += 32)
+    {
+      c   = _mm256_loadu_si256((const __m256i *) (s + i));
+      x   = _mm256_shuffle_epi8(t[0], _mm256_adds_epu8(c, sat));
+      idx = c;
+      for (h = 1; h < 8; h++)
+        {
+          idx = _mm256_sub_epi8(idx, s16);
+          x   = _mm256_or_si256(x, _mm256_shuffle_epi8(t[h], _mm256_adds_epu8(idx, sat)));
+        }
+      if (dsq) _mm256_storeu_si256((__m256i *) (dsq + i), x);
+
+      m = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(x, c));
+      if (m) return i + __builtin_ctz(m);
+    }
+
+#ifdef eslENABLE_SSE4
+  i += esl_abc_digitize_run_sse(inmap, s + i, n - i, dsq ? dsq + i : NULL);
+#endif
+  return i;
+}
+
+#else // ! eslENABLE_AVX
+void esl_alphabet_avx_silence_hack(void) { return; }
+#endif // eslENABLE_AVX
@@ -0,0 +1,73 @@
+/* Vectorized digitization of residue runs: x86 AVX-512 implementation.
+ *
+ * Same as the SSE4 kernel in esl_alphabet_sse.c (see there for how
+ * the 128-entry input map is looked up), 64 bytes at a time. Byte
+ * shuffles work within each 128-bit lane, so each lane gets its own
+ * copy of the eight 16-entry tables.
+ *
+ * Requires AVX-512F and AVX-512BW, as <esl_cpu_has_avx512()> checks.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_AVX512>
+ * was set in <esl_config.h> by the configure script. When it is not
+ * set, we include some dummy code to silence compiler and ranlib
+ * warnings about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_AVX512
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+
+
+/* Function:  esl_abc_digitize_run_avx512()
+ * Synopsis:  Digitize a run of residues, AVX-512 version.
+ *
+ * Purpose:   As <esl_abc_digitize_run_sse()>, but 64 bytes at a time.
+ *
+ *            Where it stops for lack of input, the narrower AVX2
+ *            kernel takes over.
+ *
+ * Returns:   the number of leading bytes of <s> that are residues,
+ *            <i>, as <esl_abc_digitize_run_sse()>.
+ */
+int64_t
+esl_abc_digitize_run_avx512(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq)
+{
+  const __m512i sat = _mm512_set1_epi8(0x70);
+  const __m512i s16 = _mm512_set1_epi8(0x10);
+  __m512i   t[8];
+  __m512i   c, idx, x;
+  int64_t   i;
+  int       h;
+  __mmask64 m;
+
+  for (h = 0; h < 8; h++) t[h] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) (inmap + 16*h)));
+
+  for (i = 0; i+64 <= n; i += 64)
+    {
+      c   = _mm512_loadu_si512((const void *) (s + i));
+      x   = _mm512_shuffle_epi8(t[0], _mm512_adds_epu8(c, sat));
+      idx = c;
+      for (h = 1; h < 8; h++)
+        {
+          idx = _mm512_sub_epi8(idx, s16);
+          x   = _mm512_or_si512(x, _mm512_shuffle_epi8(t[h], _mm512_adds_epu8(idx, sat)));
+        }
+      if (dsq) _mm512_storeu_si512((void *) (dsq + i), x);
+
+      m = _mm512_movepi8_mask(_mm512_or_si512(x, c));
+      if (m) return i + __builtin_ctzll(m);
+    }
+
+#ifdef eslENABLE_AVX
+  i += esl_abc_digitize_run_avx(inmap, s + i, n - i, dsq ? dsq + i : NULL);
+#endif
+  return i;
+}
+
+#else // ! eslENABLE_AVX512
+void esl_alphabet_avx512_silence_hack(void) { return; }
+#endif // eslENABLE_AVX512
@@ -0,0 +1,68 @@
+/* Vectorized digitization of residue runs: ARM NEON implementation.
+ *
+ * Same as the SSE4 kernel in esl_alphabet_sse.c, sixteen bytes at a
+ * time, but simpler: AArch64's four-register table lookup
+ * (vqtbl4q_u8) covers 64 entries and returns 0 for any index past
+ * them, so two lookups cover the 128-entry input map. Also uses
+ * across-vector reductions (vmaxvq_u8), so it's only compiled for
+ * ARMv8.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_NEON>
+ * and <eslHAVE_NEON_AARCH64> were set in <esl_config.h> by the
+ * configure script. Otherwise we include some dummy code to silence
+ * compiler and ranlib warnings about empty translation units and no
+ * symbols.
+ */
+#include "esl_config.h"
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+
+
+/* Function:  esl_abc_digitize_run_neon()
+ * Synopsis:  Digitize a run of residues, NEON version.
+ *
+ * Purpose:   As <esl_abc_digitize_run_sse()>.
+ *
+ * Returns:   the number of leading bytes of <s> that are residues,
+ *            <i>, as <esl_abc_digitize_run_sse()>.
+ */
+int64_t
+esl_abc_digitize_run_neon(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq)
+{
+  const uint8x16_t s64 = vdupq_n_u8(64);
+  uint8x16x4_t     tlo, thi;
+  uint8x16_t       c, x, e;
+  uint8_t          ebuf[16];
+  int64_t          i;
+  int              h, k;
+
+  for (h = 0; h < 4; h++) {
+    tlo.val[h] = vld1q_u8(inmap + 16*h);
+    thi.val[h] = vld1q_u8(inmap + 64 + 16*h);
+  }
+
+  for (i = 0; i+16 <= n; i += 16)
+    {
+      c = vld1q_u8((const uint8_t *) (s + i));
+      x = vorrq_u8(vqtbl4q_u8(tlo, c), vqtbl4q_u8(thi, vsubq_u8(c, s64)));
+      if (dsq) vst1q_u8(dsq + i, x);
+
+      e = vorrq_u8(x, c);
+      if (vmaxvq_u8(e) & 0x80)       // a special code, or non-ASCII input, is in this group
+        {
+          vst1q_u8(ebuf, e);
+          for (k = 0; ! (ebuf[k] & 0x80); k++) ;
+          return i + k;
+        }
+    }
+  return i;
+}
+
+#else // ! (eslENABLE_NEON && eslHAVE_NEON_AARCH64)
+void esl_alphabet_neon_silence_hack(void) { return; }
+#endif
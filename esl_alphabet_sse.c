@@ -0,0 +1,83 @@
+/* Vectorized digitization of residue runs: x86 SSE4 implementation.
+ *
+ * esl_alphabet.c documents esl_abc_DigitizeRun(), which calls these
+ * kernels through a runtime dispatcher and finishes each run with
+ * scalar code.
+ *
+ * An input map is a 128-entry table, too big for one byte shuffle.
+ * We split it into eight 16-entry tables, one per high nibble of the
+ * input byte, and look each byte up in all eight. The index for table
+ * <h> is the input byte minus 16h, with a saturating add of 0x70 that
+ * sets the high bit (which makes the shuffle return 0) unless the byte
+ * is in table <h>'s range. Exactly one of the eight lookups is nonzero
+ * for an ASCII byte, and all of them are zero for a non-ASCII one, so
+ * ORing them gives the map value.
+ *
+ * Residue codes are <= 127 and the special codes (<eslDSQ_IGNORED>,
+ * <eslDSQ_EOL> and so on) are >= 128, so the high bit of the mapped
+ * byte, or of the input byte, marks where a run of residues ends.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_SSE4> was
+ * set in <esl_config.h> by the configure script. When it is not set,
+ * we include some dummy code to silence compiler and ranlib warnings
+ * about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_SSE4
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+
+
+/* Function:  esl_abc_digitize_run_sse()
+ * Synopsis:  Digitize a run of residues, SSE4 version.
+ *
+ * Purpose:   Map text <s> through input map <inmap>, sixteen bytes
+ *            at a time, storing the results in <dsq> (unless <dsq>
+ *            is <NULL>, to only scan). Stop at the first group that
+ *            contains a byte that doesn't map to a residue, or that
+ *            would read past the <n> bytes available in <s>.
+ *
+ *            Stores whole groups, so <dsq[0..n-1]> must be writable.
+ *            Values stored past the returned position are garbage.
+ *
+ * Returns:   the number of leading bytes of <s> that are residues,
+ *            <i>. Either <s[i]> is not a residue, or fewer than 16
+ *            bytes remained and the caller continues from <s[i]>.
+ */
+int64_t
+esl_abc_digitize_run_sse(const ESL_DSQ *inmap, const char *s, int64_t n, ESL_DSQ *dsq)
+{
+  const __m128i sat = _mm_set1_epi8(0x70);
+  const __m128i s16 = _mm_set1_epi8(0x10);
+  __m128i t[8];
+  __m128i c, idx, x;
+  int64_t i;
+  int     h, m;
+
+  for (h = 0; h < 8; h++) t[h] = _mm_loadu_si128((const __m128i *) (inmap + 16*h));
+
+  for (i = 0; i+16 <= n; i += 16)
+    {
+      c   = _mm_loadu_si128((const __m128i *) (s + i));
+      x   = _mm_shuffle_epi8(t[0], _mm_adds_epu8(c, sat));
+      idx = c;
+      for (h = 1; h < 8; h++)
+        {
+          idx = _mm_sub_epi8(idx, s16);
+          x   = _mm_or_si128(x, _mm_shuffle_epi8(t[h], _mm_adds_epu8(idx, sat)));
+        }
+      if (dsq) _mm_storeu_si128((__m128i *) (dsq + i), x);
+
+      m = _mm_movemask_epi8(_mm_or_si128(x, c));     // high bit: special code, or non-ASCII input
+      if (m) return i + __builtin_ctz(m);
+    }
+  return i;
+}
+
+#else // ! eslENABLE_SSE4
+void esl_alphabet_sse_silence_hack(void) { return; }
+#endif // eslENABLE_SSE4
@@ -163,6 +163,17 @@ esl_avx_leftshiftz_float(__m256 v)
  * 4. Inlined functions: any_gt
  ******************************************************************/
 
+/* Function:  esl_avx_any_gt_epu8()
+ * Synopsis:  Returns TRUE if any a[z] > b[z].
+ * See:       esl_sse.h::esl_sse_any_gt_epu8()
+ */
+static inline int 
+esl_avx_any_gt_epu8(__m256i a, __m256i b)
+{
+  __m256i mask = _mm256_cmpeq_epi8(_mm256_max_epu8(a,b), b); /* anywhere a>b, mask[z] = 0x0; elsewhere 0xff */
+  return ((unsigned int) _mm256_movemask_epi8(mask) != 0xffffffffu);
+}
+
 /* Function:  esl_avx_any_gt_epi16()
  * Synopsis:  Return >0 if any a[z] > b[z]
  */
@@ -7,6 +7,7 @@
  *    1. Function declarations for esl_avx512.c
  *    2. Inlined functions: horizontal max, sum
  *    3. Inlined functions: left, right shift
+ *    4. Inlined functions: any_gt
  */
 #ifndef eslAVX512_INCLUDED
 #define eslAVX512_INCLUDED
@@ -160,5 +161,29 @@ esl_avx512_leftshiftz_float(__m512 v)
 {
   return ((__m512) _mm512_alignr_epi8( _mm512_maskz_shuffle_i32x4(0x0fff, (__m512i) v, (__m512i) v, 0x39), (__m512i) v, 4));
 }
+
+
+/*****************************************************************
+ * 4. Inlined functions: any_gt
+ *****************************************************************/
+
+/* Function:  esl_avx512_any_gt_epu8()
+ * Synopsis:  Returns TRUE if any a[z] > b[z].
+ * See:       esl_sse.h::esl_sse_any_gt_epu8()
+ */
+static inline int 
+esl_avx512_any_gt_epu8(__m512i a, __m512i b)
+{
+  return (_mm512_cmpgt_epu8_mask(a,b) != 0);
+}
+
+/* Function:  esl_avx512_any_gt_epi16()
+ * Synopsis:  Returns TRUE if any a[z] > b[z].
+ */
+static inline int 
+esl_avx512_any_gt_epi16(__m512i a, __m512i b)
+{
+  return (_mm512_cmpgt_epi16_mask(a,b) != 0);
+}
 #endif //eslAVX512_INCLUDED
 #endif //eslENABLE_AVX512
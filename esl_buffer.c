@@ -34,6 +34,7 @@
 #endif /* _POSIX_VERSION */
 
 #include "easel.h"
+#include "esl_gzfile.h"
 #include "esl_mem.h"
 
 #include "esl_buffer.h"
@@ -69,7 +70,7 @@ static int buffer_counttok (ESL_BUFFER *bf, const char *sep, esl_pos_t *ret_nc);
  *            The standard Easel idiom allows reading from standard
  *            input (pass <filename> as '-'), allows reading gzip'ed
  *            files automatically (any <filename> ending in <.gz> is
- *            opened as a pipe from <gzip -dc>), and allows using an
+ *            opened with <esl_buffer_OpenGzip()>), and allows using an
  *            environment variable to specify a colon-delimited list
  *            of directories in which <filename> may be found. Normal
  *            files are memory mapped (if <mmap()> is available) when
@@ -90,10 +91,10 @@ static int buffer_counttok (ESL_BUFFER *bf, const char *sep, esl_pos_t *ret_nc);
  *            <d/filename>. Use the first <d> that succeeds. If
  *            none succeed, return <eslENOTFOUND>.
  *            
- *            Now open the file. If <filename> ends in <.gz>, 'open'
- *            it by running <gzip -dc d/filename 2>/dev/null>,
- *            capturing the standard output from gunzip decompression
- *            in the <ESL_BUFFER>. Otherwise, open <d/filename> as a
+ *            Now open the file. If <filename> ends in <.gz>, open it
+ *            with <esl_buffer_OpenGzip()>, which decompresses it with
+ *            zlib if Easel was built with it, or else reads it through
+ *            a <gzip -dc d/filename 2>/dev/null> pipe. Otherwise, open <d/filename> as a
  *            normal file. If its size is not more than
  *            <eslBUFFER_SLURPSIZE> (default 4 MB), it is slurped into
  *            memory; else, if <mmap()> is available, it is memory
@@ -109,8 +110,9 @@ static int buffer_counttok (ESL_BUFFER *bf, const char *sep, esl_pos_t *ret_nc);
  * Returns:   <eslOK> on success; <*ret_bf> is the new <ESL_BUFFER>.
  * 
  *            <eslENOTFOUND> if file isn't found or isn't readable.
- *            <eslFAIL> if gzip -dc fails on a .gz file, probably 
- *            because a gzip executable isn't found in PATH. 
+ *            <eslFAIL> if a .gz file can't be decompressed: it isn't
+ *            in gzip format, or (without zlib) gzip -dc fails,
+ *            probably because a gzip executable isn't found in PATH.
  *            
  *            On any normal error, <*ret_bf> is still returned,
  *            in an unset state, with a user-directed error message
@@ -147,8 +149,8 @@ esl_buffer_Open(const char *filename, const char *envvar, ESL_BUFFER **ret_bf)
   }
 
   n = strlen(path);
-  if (n > 3 && strcmp(filename+n-3, ".gz") == 0)   /* if .gz => gzip -dc */
-    { if ( (status = esl_buffer_OpenPipe(path, "gzip -dc %s 2>/dev/null", ret_bf)) != eslOK) goto ERROR; }
+  if (n > 3 && strcmp(filename+n-3, ".gz") == 0)   /* if .gz => zlib, or gzip -dc */
+    { if ( (status = esl_buffer_OpenGzip(path, ret_bf)) != eslOK) goto ERROR; }
   else
     { if ( (status = esl_buffer_OpenFile(path, ret_bf)) != eslOK) goto ERROR; }
 
@@ -398,6 +400,99 @@ esl_buffer_OpenPipe(const char *filename, const char *cmdfmt, ESL_BUFFER **ret_b
   
 }
 
+
+/* Function:  esl_buffer_OpenGzip()
+ * Synopsis:  Open a gzip-compressed file.
+ *
+ * Purpose:   Open gzip-compressed file <filename> for reading, and
+ *            return an open <ESL_BUFFER> of its decompressed data in
+ *            <*ret_bf>. Offsets (<esl_buffer_GetOffset()>,
+ *            <esl_buffer_SetOffset()>) are in uncompressed bytes.
+ *
+ *            If Easel was built with zlib, the file is decompressed
+ *            in-process, with <ESL_GZFILE>. The buffer can be
+ *            repositioned, which is fast for a BGZF file (see
+ *            esl_gzfile.c), so SSI indexes work. Its <bf->gz> is the
+ *            open <ESL_GZFILE>, for a caller that wants to use
+ *            <esl_gzfile_SetThreads()>.
+ *
+ *            Without zlib, this is <esl_buffer_OpenPipe(filename,
+ *            "gzip -dc %s 2>/dev/null")>.
+ *
+ *            Either way, a small file is read into memory in its
+ *            entirety at open time.
+ *
+ * Args:      filename  - name of (or path to) gzip file to open
+ *           *ret_bf    - RETURN: new ESL_BUFFER
+ *
+ * Returns:   <eslOK> on success; <*ret_bf> is new <ESL_BUFFER>.
+ *
+ *            <eslENOTFOUND> if <filename> isn't found or isn't readable.
+ *            <eslFAIL> if it isn't in gzip format, or its start is
+ *            corrupt, or (without zlib) gzip -dc fails.
+ *
+ *            On normal errors, a new <*ret_bf> is still returned, in
+ *            an unset state, with a user-directed error message in
+ *            <*ret_bf->errmsg>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslESYS> on a system call failure.
+ *            Now <*ret_bf> is <NULL>.
+ */
+int
+esl_buffer_OpenGzip(const char *filename, ESL_BUFFER **ret_bf)
+{
+#ifdef HAVE_ZLIB
+  ESL_BUFFER *bf = NULL;
+  int         status;
+
+  if ((status = buffer_create(&bf)) != eslOK) goto ERROR;
+
+  status = esl_gzfile_Open(filename, &(bf->gz));
+  if      (status == eslENOTFOUND) ESL_XFAIL(eslENOTFOUND, bf->errmsg, "couldn't open %s for reading", filename);
+  else if (status == eslEFORMAT)   ESL_XFAIL(eslFAIL,      bf->errmsg, "%s is not in gzip format, or has a corrupt .gzi index", filename);
+  else if (status != eslOK)        goto ERROR;
+
+  if ((status = esl_strdup(filename, -1, &(bf->filename))) != eslOK) goto ERROR;
+
+  bf->pagesize = eslBUFFER_GZPAGESIZE;
+  ESL_ALLOC(bf->mem, sizeof(char) * bf->pagesize);
+  bf->balloc  = bf->pagesize;
+
+  status = esl_gzfile_Read(bf->gz, bf->mem, bf->pagesize, &(bf->n));
+  if      (status == eslEFORMAT) ESL_XFAIL(eslFAIL, bf->errmsg, "%s", bf->gz->errmsg);
+  else if (status != eslOK && status != eslEOF) goto ERROR;
+
+  if (bf->n < bf->pagesize)	/* short read: we have the whole file */
+    {
+      esl_gzfile_Close(bf->gz);
+      bf->gz      = NULL;
+      bf->balloc  = 0;
+      bf->mode_is = eslBUFFER_ALLFILE;
+    }
+  else
+    bf->mode_is = eslBUFFER_GZIP;
+
+  *ret_bf = bf;
+  return eslOK;
+
+ ERROR:
+  if (status != eslENOTFOUND && status != eslFAIL) { esl_buffer_Close(bf); bf = NULL; }
+  if (bf) {	/* restore state to UNSET; w/ error message in errmsg */
+    if (bf->mem)      { free(bf->mem);            bf->mem      = NULL; }
+    if (bf->gz)       { esl_gzfile_Close(bf->gz); bf->gz       = NULL; }
+    if (bf->filename) { free(bf->filename);       bf->filename = NULL; }
+    bf->n        = 0;
+    bf->balloc   = 0;
+    bf->pagesize = eslBUFFER_PAGESIZE;
+  }
+  *ret_bf = bf;
+  return status;
+#else
+  return esl_buffer_OpenPipe(filename, "gzip -dc %s 2>/dev/null", ret_bf);
+#endif
+}
+
 /* Function:  esl_buffer_OpenMem()
  * Synopsis:  "Open" an existing string for parsing.
  *
@@ -535,6 +630,9 @@ esl_buffer_Close(ESL_BUFFER *bf)
 	  }
 	}
 
+#ifdef HAVE_ZLIB
+      if (bf->gz) esl_gzfile_Close(bf->gz);
+#endif
       if (bf->filename) free(bf->filename);
       if (bf->cmdline)  free(bf->cmdline);
       free(bf);
@@ -598,6 +696,9 @@ esl_buffer_GetOffset(ESL_BUFFER *bf)
  *                 
  * Returns:   <eslOK> on success.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEINVAL> if <offset> is invalid, either because it 
  *               would require rewinding the (nonrewindable) stream, 
  *               or because it's beyond the end.
@@ -629,6 +730,8 @@ esl_buffer_SetOffset(ESL_BUFFER *bf, esl_pos_t offset)
    *       and there's no anchor set -- then we can fseeko() to the
    *       desired offset (no matter where it is) and 
    *       reinitialize the buffer; or
+   *     - likewise if we're a GZIP file with no anchor set, with
+   *       esl_gzfile_Seek(); or
    *     - otherwise rewinding a stream is not possible, generating
    *       an <eslEINVAL> error; or
    *     - finally, the remaining possibility is that the offset is
@@ -641,13 +744,21 @@ esl_buffer_SetOffset(ESL_BUFFER *bf, esl_pos_t offset)
    */
   else if (bf->mode_is == eslBUFFER_STREAM  ||
 	   bf->mode_is == eslBUFFER_CMDPIPE ||
-	   bf->mode_is == eslBUFFER_FILE)
+	   bf->mode_is == eslBUFFER_FILE    ||
+	   bf->mode_is == eslBUFFER_GZIP)
     {
       if (offset >= bf->baseoffset && offset < bf->baseoffset + bf->pos) /* offset is in our current window and behind our current pos; rewind is trivial */
 	{
 	  bf->pos = offset-bf->baseoffset;
 	}
 
+      else if (offset >= bf->baseoffset + bf->pos && offset < bf->baseoffset + bf->n) /* ahead of pos, but already in our window; no need to seek */
+	{
+	  bf->pos = offset - bf->baseoffset;
+	  status  = buffer_refill(bf, 0);
+	  if (status != eslEOF && status != eslOK) return status;
+	}
+
 #ifdef _POSIX_VERSION
       else if (bf->mode_is == eslBUFFER_FILE && bf->anchor == -1)
 	{			/* a posix-compliant system can always fseeko() on a file */
@@ -661,6 +772,22 @@ esl_buffer_SetOffset(ESL_BUFFER *bf, esl_pos_t offset)
 	}
 #endif /*_POSIX_VERSION*/
 
+#ifdef HAVE_ZLIB
+      else if (bf->mode_is == eslBUFFER_GZIP && bf->anchor == -1)
+	{			/* a gzip file can be repositioned too, though it may have to decompress forward */
+	  status = esl_gzfile_Seek(bf->gz, offset);
+	  if      (status == eslEOF)     ESL_EXCEPTION(eslEINVAL,  "requested offset is beyond end of file");
+	  else if (status == eslEFORMAT) ESL_FAIL(eslEFORMAT, bf->errmsg, "%s", bf->gz->errmsg);
+	  else if (status != eslOK)      return status;
+	  bf->baseoffset = offset;
+	  bf->n          = 0;
+	  bf->pos        = 0;
+	  status = buffer_refill(bf, 0);
+	  if      (status == eslEOF) ESL_EXCEPTION(eslEINVAL, "requested offset is beyond end of file");
+	  else if (status != eslOK)  return status;
+	}
+#endif /*HAVE_ZLIB*/
+
       else if (offset < bf->baseoffset)                /* we've already streamed past the requested offset. */
 	ESL_EXCEPTION(eslEINVAL, "can't rewind stream past base offset"); 
 
@@ -720,7 +847,7 @@ esl_buffer_SetOffset(ESL_BUFFER *bf, esl_pos_t offset)
 int
 esl_buffer_SetAnchor(ESL_BUFFER *bf, esl_pos_t offset)
 {
-  if (! bf->fp) return eslOK;	/* without an open stream, no-op */
+  if (! bf->fp && ! bf->gz) return eslOK;	/* without an open stream, no-op */
   if (offset < bf->baseoffset || offset > bf->baseoffset + bf->n)
     ESL_EXCEPTION(eslEINVAL, "can't set an anchor outside current buffer");
 
@@ -770,7 +897,7 @@ esl_buffer_SetStableAnchor(ESL_BUFFER *bf, esl_pos_t offset)
   esl_pos_t ndel;
   int       status;
 
-  if (! bf->fp) return eslOK;	/* without an open stream, no-op: everything is available */
+  if (! bf->fp && ! bf->gz) return eslOK;	/* without an open stream, no-op: everything is available */
 
   if ( (status = esl_buffer_SetAnchor(bf, offset)) != eslOK) return status;
 
@@ -858,6 +985,9 @@ esl_buffer_RaiseAnchor(ESL_BUFFER *bf, esl_pos_t offset)
  *            <eslEOF> if no valid bytes remain in the input, or if
  *               <*ret_n> is less than <nrequest>. 
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> on allocation failure. 
  *            <eslESYS> if fread() fails mysteriously.
  *            <eslEINCONCEIVABLE> if internal state of <bf> is corrupt.
@@ -925,6 +1055,9 @@ esl_buffer_Get(ESL_BUFFER *bf, char **ret_p, esl_pos_t *ret_n)
  *
  * Returns:   <eslOK> on success.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> on allocation failure. 
  *            <eslESYS> if fread() fails mysteriously.
  *            <eslEINCONCEIVABLE> if internal state of <bf> is corrupt.
@@ -980,6 +1113,9 @@ esl_buffer_Set(ESL_BUFFER *bf, char *p, esl_pos_t nused)
  *            <eslEOF> if there's no line (even blank).
  *            On EOF, <*opt_p> is NULL and <*opt_n> is 0.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> if allocation fails.
  *            <eslESYS> if a system call such as fread() fails unexpectedly
  *            <eslEINCONCEIVABLE> if <bf> internal state is corrupt.
@@ -1054,6 +1190,9 @@ esl_buffer_GetLine(ESL_BUFFER *bf, char **opt_p, esl_pos_t *opt_n)
  *            <eslEOF> if there's no line (even blank).
  *            On EOF, <*opt_p> is NULL and <*opt_n> is 0.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> if allocation fails.
  *            <eslESYS> if a system call such as fread() fails unexpectedly
  *            <eslEINCONCEIVABLE> if <bf> internal state is corrupt.
@@ -1120,6 +1259,9 @@ esl_buffer_FetchLine(ESL_BUFFER *bf, char **opt_p, esl_pos_t *opt_n)
  *            <eslEOF> if there's no line (even blank).
  *            On EOF, <*opt_p> is NULL and <*opt_n> is 0.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> if allocation fails.
  *            <eslEINVAL> if an anchoring attempt is invalid
  *            <eslESYS> if a system call such as fread() fails unexpectedly
@@ -1231,6 +1373,9 @@ esl_buffer_FetchLineAsStr(ESL_BUFFER *bf, char **opt_s, esl_pos_t *opt_n)
  *            <bf->mem> may be modified and/or reallocated, if new
  *            input reads are required to find the entire token.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> if an allocation fails.
  *            Now <*ret_p> is <NULL> and <*opt_n> is 0. The
  *            current point is undefined.
@@ -1311,6 +1456,9 @@ esl_buffer_GetToken(ESL_BUFFER *bf, const char *sep, char **opt_tok, esl_pos_t *
  *            <bf->mem> may be modified and/or reallocated, if new
  *            input reads are required to find the entire token.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> if an allocation fails.
  *            Now <*ret_p> is <NULL> and <*opt_n> is 0. The
  *            current point is undefined.
@@ -1394,6 +1542,9 @@ esl_buffer_FetchToken(ESL_BUFFER *bf, const char *sep, char **opt_tok, esl_pos_t
  *            <bf->mem> may be modified and/or reallocated, if new
  *            input reads are required to find the entire token.
  *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
+ *
  * Throws:    <eslEMEM> if an allocation fails.
  *            Now <*ret_p> is <NULL> and <*opt_n> is 0. The
  *            current point is undefined.
@@ -1481,6 +1632,9 @@ esl_buffer_FetchTokenAsStr(ESL_BUFFER *bf, const char *sep, char **opt_tok, esl_
  *
  *            <eslEOF> if less than <nbytes> characters remain 
  *            in <bf>. Point is unchanged.
+ *
+ *            <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *            truncated; <bf->errmsg> says why.
  * 
  * Throws:    <eslEMEM> if an allocation fails.
  *            <eslESYS> if an fread() fails mysteriously.
@@ -1535,6 +1689,7 @@ buffer_create(ESL_BUFFER **ret_bf)
   bf->baseoffset = 0;
   bf->anchor     = -1;
   bf->fp         = NULL;
+  bf->gz         = NULL;
   bf->filename   = NULL;
   bf->cmdline    = NULL;
   bf->pagesize   = eslBUFFER_PAGESIZE;
@@ -1671,6 +1826,8 @@ buffer_init_file_basic(ESL_BUFFER *bf)
  *
  * Returns: <eslOK> on success.
  *          <eslEOF> if no data remain in buffer nor to be read. Now pos == n.
+ *          <eslEFORMAT> if a gzip file turns out to be corrupt or
+ *          truncated; <bf->errmsg> says why.
  *          
  * Throws:  <eslEMEM> if an allocation fails. 
  *          <eslESYS> if fread() fails mysteriously.
@@ -1683,7 +1840,7 @@ buffer_refill(ESL_BUFFER *bf, esl_pos_t nmin)
   esl_pos_t nread;
   int       status;
 
-  if (! bf->fp || feof(bf->fp)) return ( (bf->pos < bf->n) ? eslOK : eslEOF); /* without an active fp, we have whole buffer in memory; either no-op OK, or EOF */
+  if ((! bf->fp && ! bf->gz) || (bf->fp && feof(bf->fp))) return ( (bf->pos < bf->n) ? eslOK : eslEOF); /* without an active fp or gz, we have whole buffer in memory; either no-op OK, or EOF */
   if (bf->n - bf->pos >= nmin + bf->pagesize) return eslOK;                   /* if we already have enough data in buffer window, no-op       w  */
 
   if (bf->pos > bf->n) ESL_EXCEPTION(eslEINCONCEIVABLE, "impossible position for buffer <pos>"); 
@@ -1708,8 +1865,19 @@ buffer_refill(ESL_BUFFER *bf, esl_pos_t nmin)
       bf->balloc = bf->n + bf->pagesize;
     }
 
-  nread = fread(bf->mem+bf->n, sizeof(char), bf->pagesize, bf->fp);
-  if (nread == 0 && !feof(bf->fp) && ferror(bf->fp)) ESL_EXCEPTION(eslESYS, "fread() failure");
+#ifdef HAVE_ZLIB
+  if (bf->gz)
+    {
+      status = esl_gzfile_Read(bf->gz, bf->mem+bf->n, bf->pagesize, &nread);
+      if      (status == eslEFORMAT) ESL_FAIL(eslEFORMAT, bf->errmsg, "%s", bf->gz->errmsg);
+      else if (status != eslOK && status != eslEOF) return status;
+    }
+  else
+#endif
+    {
+      nread = fread(bf->mem+bf->n, sizeof(char), bf->pagesize, bf->fp);
+      if (nread == 0 && !feof(bf->fp) && ferror(bf->fp)) ESL_EXCEPTION(eslESYS, "fread() failure");
+    }
 
   bf->n += nread;
   if (nread == 0 && bf->pos == bf->n) return eslEOF; else return eslOK;
@@ -2175,6 +2343,9 @@ main(int argc, char **argv)
 
 #include "esl_random.h"
 #include <ctype.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 /* A variant of esl_buffer_OpenFile() that lets us specify
  * whether we want to slurp, mmap, or basic, using
@@ -2266,6 +2437,28 @@ create_testfile_lines(ESL_RANDOMNESS *r, char *tmpfile, int nlines)
   fclose(fp);
 }
 
+#ifdef HAVE_ZLIB
+/* create_testfile_gzip()
+ * Gzip a copy of <tmpfile> to <gzfile>, with zlib.
+ */
+static void
+create_testfile_gzip(const char *tmpfile, const char *gzfile)
+{
+  char   msg[] = "create_testfile_gzip() failed";
+  char   buf[4096];
+  FILE  *fp;
+  gzFile gzfp;
+  size_t n;
+
+  if ((fp   = fopen(tmpfile, "rb")) == NULL) esl_fatal(msg);
+  if ((gzfp = gzopen(gzfile, "wb")) == NULL) esl_fatal(msg);
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    if (gzwrite(gzfp, buf, n) != (int) n) esl_fatal(msg);
+  if (gzclose(gzfp) != Z_OK) esl_fatal(msg);
+  fclose(fp);
+}
+#endif /*HAVE_ZLIB*/
+
 static void
 utest_compare_line(char *p, esl_pos_t n, int nline_expected)
 {
@@ -2325,6 +2518,9 @@ utest_SetOffset(const char *tmpfile, int nlines_expected)
   char        gzipfile[32];
   char        cmd[256];     
 #endif
+#ifdef HAVE_ZLIB
+  char        zfile[40];
+#endif
 
   /* Find offsets of lines ~2000 and ~5000; we'll use these positions as tests. */
   if (nlines_expected <= 8000) return; /* require at least 8000 lines to do this test */
@@ -2413,6 +2609,29 @@ utest_SetOffset(const char *tmpfile, int nlines_expected)
   utest_compare_line(p, n, testline1);
   esl_buffer_Close(bf);
 #endif /*_POSIX_VERSION*/
+
+  /* test 4. A gzip file read with zlib can be repositioned anywhere
+   *         too, when no anchor is set.
+   */
+#ifdef HAVE_ZLIB
+  snprintf(zfile, 40, "%s.z.gz", tmpfile);
+  create_testfile_gzip(tmpfile, zfile);
+  if (esl_buffer_OpenGzip(zfile, &bf)       != eslOK) esl_fatal(msg);
+  if (bf->mode_is != eslBUFFER_GZIP)                  esl_fatal(msg);
+  if (esl_buffer_SetOffset(bf, testoffset2) != eslOK) esl_fatal(msg);
+  if (esl_buffer_GetLine(bf, &p, &n)        != eslOK) esl_fatal(msg);
+  utest_compare_line(p, n, testline2);
+
+  if (esl_buffer_SetOffset(bf, testoffset1) != eslOK) esl_fatal(msg);
+  if (esl_buffer_GetLine(bf, &p, &n)        != eslOK) esl_fatal(msg);
+  utest_compare_line(p, n, testline1);
+
+  if (esl_buffer_SetOffset(bf, testoffset2) != eslOK) esl_fatal(msg);
+  if (esl_buffer_GetLine(bf, &p, &n)        != eslOK) esl_fatal(msg);
+  utest_compare_line(p, n, testline2);
+  esl_buffer_Close(bf);
+  remove(zfile);
+#endif /*HAVE_ZLIB*/
   
 #if defined HAVE_GZIP
   remove(gzipfile);
@@ -2774,6 +2993,61 @@ utest_halfnewline(void)
 
 #endif /* eslBUFFER_TESTDRIVE */
 
+#ifdef HAVE_ZLIB
+/* utest_truncated_gzip()
+ * A gzip file cut off partway is a normal error, not an exception:
+ * reading through it, or seeking past where it's cut off, returns
+ * <eslEFORMAT> with a message in <bf->errmsg>. <tmpfile> is the
+ * uncompressed file that <gzfile> is a gzip'ed copy of.
+ */
+static void
+utest_truncated_gzip(const char *tmpfile, const char *gzfile)
+{
+  char        msg[]    = "truncated gzip test failed";
+  char        tfile[48];
+  char        buf[4096];
+  ESL_BUFFER *bf       = NULL;
+  FILE       *ifp, *ofp;
+  off_t       fsize, gzsize;
+  size_t      n;
+  int         status;
+
+  if ((ifp = fopen(tmpfile, "rb")) == NULL)        esl_fatal(msg);
+  if (fseeko(ifp, 0, SEEK_END) != 0)               esl_fatal(msg);
+  fsize = ftello(ifp);
+  fclose(ifp);
+
+  snprintf(tfile, 48, "%st.gz", tmpfile);
+  if ((ifp = fopen(gzfile, "rb")) == NULL)         esl_fatal(msg);
+  if (fseeko(ifp, 0, SEEK_END) != 0)               esl_fatal(msg);
+  gzsize = ftello(ifp) / 2;
+  rewind(ifp);
+  if ((ofp = fopen(tfile, "wb")) == NULL)          esl_fatal(msg);
+  while (gzsize > 0 && (n = fread(buf, 1, ESL_MIN(sizeof(buf), (size_t) gzsize), ifp)) > 0)
+    {
+      if (fwrite(buf, 1, n, ofp) != n) esl_fatal(msg);
+      gzsize -= n;
+    }
+  fclose(ifp);
+  fclose(ofp);
+
+  /* read through it */
+  if (esl_buffer_OpenGzip(tfile, &bf) != eslOK)   esl_fatal(msg);
+  while ((status = esl_buffer_GetLine(bf, NULL, NULL)) == eslOK) ;
+  if (status != eslEFORMAT)                        esl_fatal(msg);
+  if (bf->errmsg[0] == '\0')                       esl_fatal(msg);
+  esl_buffer_Close(bf);
+
+  /* seek past the cut */
+  if (esl_buffer_OpenGzip(tfile, &bf) != eslOK)   esl_fatal(msg);
+  if (esl_buffer_SetOffset(bf, fsize-1) != eslEFORMAT) esl_fatal(msg);
+  if (bf->errmsg[0] == '\0')                       esl_fatal(msg);
+  esl_buffer_Close(bf);
+
+  remove(tfile);
+}
+#endif /*HAVE_ZLIB*/
+
 /*****************************************************************
  * 10. Test driver
  *****************************************************************/
@@ -2816,6 +3090,7 @@ main(int argc, char **argv)
   int             nlines      = esl_opt_GetInteger(go, "-n");
   char            tmpfile[32] = "esltmpXXXXXX";
   char            cmdfmt[]    = "cat %s 2>/dev/null";
+  char            gzfile[40]  = "";
   int             bufidx,  nbuftypes;
   int             testidx, ntesttypes;
   int             status;
@@ -2833,6 +3108,12 @@ main(int argc, char **argv)
   utest_halfnewline();
 
   nbuftypes  = 7;
+#ifdef HAVE_ZLIB
+  snprintf(gzfile, 40, "%s.gz", tmpfile);
+  create_testfile_gzip(tmpfile, gzfile);
+  utest_truncated_gzip(tmpfile, gzfile);
+  nbuftypes  = 8;
+#endif
   ntesttypes = 8;
   for (bufidx = 0; bufidx < nbuftypes; bufidx++)
     for (testidx = 0; testidx < ntesttypes; testidx++)
@@ -2857,6 +3138,9 @@ main(int argc, char **argv)
 	  /* now bftmp->mem is a slurped file */
 	  if (esl_buffer_OpenMem(bftmp->mem, bftmp->n, &bf) != eslOK) esl_fatal(msg);
 	  break;
+	case 7:
+	  if (esl_buffer_OpenGzip(gzfile, &bf) != eslOK) esl_fatal(msg);
+	  break;
 	default: esl_fatal(msg);
 	}
 	
@@ -2882,6 +3166,7 @@ main(int argc, char **argv)
   esl_randomness_Destroy(r);
   esl_getopts_Destroy(go);
   remove(tmpfile);
+  if (*gzfile) remove(gzfile);
   return 0;
 }
 #endif /* eslBUFFER_TESTDRIVE */
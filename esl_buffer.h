@@ -8,6 +8,7 @@
 
 #define eslBUFFER_PAGESIZE      4096    /* default for b->pagesize                       */
 #define eslBUFFER_SLURPSIZE  4194304	/* switchover from slurping whole file to mmap() */
+#define eslBUFFER_GZPAGESIZE   65536    /* b->pagesize for gzip files read with zlib     */
 
 enum esl_buffer_mode_e {
   eslBUFFER_UNSET   = 0,
@@ -16,9 +17,13 @@ enum esl_buffer_mode_e {
   eslBUFFER_FILE    = 3,  /* chunk in mem[0..n-1] = input[baseoffset..baseoffset-n-1];  balloc>0; offset>=0; fp open  */
   eslBUFFER_ALLFILE = 4,  /* whole file in mem[0..n-1];  balloc=0; offset=0;  fp=NULL  */
   eslBUFFER_MMAP    = 5,  /* whole file in mem[0..n-1];  balloc=0; offset=0;  fp=NULL  */
-  eslBUFFER_STRING  = 6   /* whole str in mem[0..n-1];   balloc=0; offset=0;  fp=NULL  */
+  eslBUFFER_STRING  = 6,  /* whole str in mem[0..n-1];   balloc=0; offset=0;  fp=NULL  */
+  eslBUFFER_GZIP    = 7   /* chunk in mem[0..n-1] = input[baseoffset..baseoffset-n-1];  balloc>0; offset>=0; gz open, fp=NULL */
 };
 
+/* forward declaration; see esl_gzfile.h */
+struct esl_gzfile_s;
+
 typedef struct {
   char      *mem;	          /* the buffer                                            */
   esl_pos_t  n;		          /* curr buf length; mem[0..n-1] contains valid bytes     */
@@ -30,6 +35,7 @@ typedef struct {
   int        nanchor;		  /* number of anchors set at <anchor>                     */
 
   FILE      *fp;	          /* open stream; NULL if already entirely in memory       */
+  struct esl_gzfile_s *gz;        /* open gzip file, read with zlib (GZIP mode); or NULL   */
   char      *filename;	          /* for diagnostics. filename; or NULL (stdin, string)    */
   char      *cmdline;		  /* for diagnostics. NULL, or cmd for CMDPIPE             */
 
@@ -44,6 +50,7 @@ typedef struct {
 extern int esl_buffer_Open      (const char *filename, const char *envvar, ESL_BUFFER **ret_bf);
 extern int esl_buffer_OpenFile  (const char *filename,                     ESL_BUFFER **ret_bf);
 extern int esl_buffer_OpenPipe  (const char *filename, const char *cmdfmt, ESL_BUFFER **ret_bf);
+extern int esl_buffer_OpenGzip  (const char *filename,                     ESL_BUFFER **ret_bf);
 extern int esl_buffer_OpenMem   (const char *p,         esl_pos_t  n,      ESL_BUFFER **ret_bf);
 extern int esl_buffer_OpenStream(FILE *fp,                                 ESL_BUFFER **ret_bf);
 extern int esl_buffer_Close(ESL_BUFFER *bf);
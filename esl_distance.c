@@ -6,27 +6,49 @@
  *    3. Distance matrices for aligned text sequences.     
  *    4. Distance matrices for aligned digital sequences.  
  *    5. Average pairwise identity for multiple alignments.
- *    6. Private (static) functions.
- *    7. Unit tests.
- *    8. Test driver.
- *    9. Example.
+ *    6. Bit-parallel pairwise identity for digital alignments.
+ *    7. Private (static) functions.
+ *    8. Unit tests.
+ *    9. Test driver.
+ *   10. Example.
  */
 #include "esl_config.h"
 
 #include <ctype.h>
 #include <string.h>
 #include <math.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
+#include "esl_cpu.h"
 #include "esl_dmatrix.h"
 #include "esl_random.h"
 
 #include "esl_distance.h"
 
+/* A share of the tiles of an identity matrix, for one thread. 
+ * Results go to one of <S> (square identities) or <P> (packed differences).
+ */
+typedef struct {
+  const ESL_DST_BITS *db;
+  ESL_DMATRIX        *S;
+  double             *P;
+  int                 t0;       /* first tile: job number                 */
+  int                 tstep;    /* then every tstep'th: number of jobs    */
+} DST_TILEJOB;
+
 /* Forward declaration of our static functions.
  */
 static int jukescantor(int n1, int n2, int alphabet_size, double *opt_distance, double *opt_variance);
+static int     dst_tile_run(const ESL_DST_BITS *db, int nthreads, ESL_DMATRIX *S, double *P);
+static void   *dst_tile_job(void *arg);
+static int64_t (*dst_idcount_dispatch(void))(const uint64_t *, const uint64_t *, int, int64_t);
+static int64_t dst_idcount_none(const uint64_t *x, const uint64_t *y, int np, int64_t nw);
+static int     dst_popcount64(uint64_t v);
+static int     dst_xpairid(const ESL_ALPHABET *abc, ESL_DSQ **ax, const ESL_DST_BITS *db, int i, int j, double *ret_pid);
 
 
 /*****************************************************************
@@ -539,6 +561,49 @@ esl_dst_CDiffMx(char **as, int N, ESL_DMATRIX **ret_D)
 
 }
 
+/* Function:  esl_dst_CDiffPacked()
+ * Synopsis:  Packed difference matrix for N aligned text sequences.
+ *
+ * Purpose:   Same as <esl_dst_CDiffMx()>, but return only the strict
+ *            upper triangle of the matrix: an array of <N(N-1)/2>
+ *            doubles in <*ret_D>, with the difference between seqs
+ *            $i<j$ in <(*ret_D)[esl_dmx_PackedIdx(N,i,j)]>.
+ *
+ * Args:      as      - aligned seqs (all same length), [0..N-1]
+ *            N       - # of aligned sequences
+ *            ret_D   - RETURN: packed fractional difference matrix
+ *
+ * Returns:   <eslOK> on success. Caller frees <*ret_D> with <free()>.
+ *
+ * Throws:    <eslEINVAL> if any seq has a different length than
+ *            others. <eslEMEM> on allocation failure. On failure,
+ *            <*ret_D> is returned <NULL>.
+ */
+int
+esl_dst_CDiffPacked(char **as, int N, double **ret_D)
+{
+  double *D = NULL;
+  double  pid;
+  int     i,j;
+  int     status;
+
+  ESL_ALLOC(D, sizeof(double) * ESL_MAX(1, (int64_t) N * (N-1) / 2));
+  for (i = 0; i < N; i++)
+    for (j = i+1; j < N; j++)
+      {
+	if ((status = esl_dst_CPairId(as[i], as[j], &pid, NULL, NULL)) != eslOK)
+	  ESL_XEXCEPTION(status, "Pairwise identity calculation failed at seqs %d,%d\n", i,j);
+	D[esl_dmx_PackedIdx(N, i, j)] = 1. - pid;
+      }
+  *ret_D = D;
+  return eslOK;
+
+ ERROR:
+  free(D);
+  *ret_D = NULL;
+  return status;
+}
+
 /* Function:  esl_dst_CJukesCantorMx()
  * Synopsis:  NxN Jukes/Cantor distance matrix for N aligned text seqs.
  * Incept:    SRE, Tue Apr 18 16:00:16 2006 [St. Louis]
@@ -627,8 +692,14 @@ esl_dst_CJukesCantorMx(int K, char **aseq, int nseq,
  *
  * Purpose:   Given a digitized multiple sequence alignment <ax>, consisting
  *            of <N> aligned digital sequences in alphabet <abc>; calculate
- *            a symmetric pairwise fractional identity matrix by $N(N-1)/2$
- *            calls to <esl_dst_XPairId()>, and return it in <ret_S>.
+ *            a symmetric pairwise fractional identity matrix, the same
+ *            as $N(N-1)/2$ calls to <esl_dst_XPairId()> would, and
+ *            return it in <ret_S>.
+ *
+ *            Packs the alignment into bit planes with
+ *            <esl_dst_bits_Create()> and uses
+ *            <esl_dst_bits_PairIdMx()>, in one thread; to use more,
+ *            call those directly.
  *            
  * Args:      abc   - digital alphabet in use
  *            ax    - aligned dsq's, [0..N-1][1..alen]                  
@@ -649,27 +720,18 @@ int
 esl_dst_XPairIdMx(const ESL_ALPHABET *abc,  ESL_DSQ **ax, int N, ESL_DMATRIX **ret_S)
 {
   int status;
-  ESL_DMATRIX *S = NULL;
-  int i,j;
+  ESL_DST_BITS *db = NULL;
+  ESL_DMATRIX  *S  = NULL;
 
-  if (( S = esl_dmatrix_Create(N,N) ) == NULL) { status = eslEMEM; goto ERROR; }
-  
-  for (i = 0; i < N; i++)
-    {
-      S->mx[i][i] = 1.;
-      for (j = i+1; j < N; j++)
-	{
-	  status = esl_dst_XPairId(abc, ax[i], ax[j], &(S->mx[i][j]), NULL, NULL);
-	  if (status != eslOK)
-	    ESL_XEXCEPTION(status, "Pairwise identity calculation failed at seqs %d,%d\n", i,j);
-	  S->mx[j][i] =  S->mx[i][j];
-	}
-    }
+  if ((status = esl_dst_bits_Create(abc, ax, N, &db)) != eslOK) goto ERROR;
+  if ((status = esl_dst_bits_PairIdMx(db, 0, &S))     != eslOK) goto ERROR;
+
+  esl_dst_bits_Destroy(db);
   if (ret_S != NULL) *ret_S = S; else esl_dmatrix_Destroy(S);
   return eslOK;
 
  ERROR:
-  if (S     != NULL)  esl_dmatrix_Destroy(S);
+  esl_dst_bits_Destroy(db);
   if (ret_S != NULL) *ret_S = NULL;
   return status;
 }
@@ -724,6 +786,47 @@ esl_dst_XDiffMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DMATRIX **ret_
   return status;
 }
 
+/* Function:  esl_dst_XDiffPacked()
+ * Synopsis:  Packed difference matrix for N aligned digital seqs.
+ *
+ * Purpose:   Same as <esl_dst_XDiffMx()>, but return only the strict
+ *            upper triangle of the matrix: an array of <N(N-1)/2>
+ *            doubles in <*ret_D>, with the difference between seqs
+ *            $i<j$ in <(*ret_D)[esl_dmx_PackedIdx(N,i,j)]>. That's
+ *            half the memory of the square matrix, for deep
+ *            alignments.
+ *
+ *            Uses <esl_dst_bits_DiffPacked()> in one thread; to use
+ *            more, call it directly.
+ *
+ * Args:      abc   - digital alphabet in use
+ *            ax    - aligned dsq's, [0..N-1][1..alen]                  
+ *            N     - number of aligned sequences
+ *            ret_D - RETURN: packed fractional difference matrix
+ *
+ * Returns:   <eslOK> on success. Caller frees <*ret_D> with <free()>.
+ *
+ * Throws:    <eslEINVAL> if a seq has a different length than
+ *            others. <eslEMEM> on allocation failure. On failure,
+ *            <*ret_D> is returned <NULL>.
+ */
+int
+esl_dst_XDiffPacked(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, double **ret_D)
+{
+  ESL_DST_BITS *db = NULL;
+  int           status;
+
+  if ((status = esl_dst_bits_Create(abc, ax, N, &db)) != eslOK) goto ERROR;
+  if ((status = esl_dst_bits_DiffPacked(db, 0, ret_D)) != eslOK) goto ERROR;
+  esl_dst_bits_Destroy(db);
+  return eslOK;
+
+ ERROR:
+  esl_dst_bits_Destroy(db);
+  *ret_D = NULL;
+  return status;
+}
+
 /* Function:  esl_dst_XJukesCantorMx()
  * Synopsis:  NxN Jukes/Cantor distance matrix for N aligned digital seqs.
  * Incept:    SRE, Thu Apr 27 08:38:08 2006 [New York City]
@@ -954,7 +1057,9 @@ esl_dst_CAverageMatch(char **as, int N, int max_comparisons, double *ret_match)
  *            deep MSAs.
  *            
  *            Each fractional pairwise identity (range $[0..$ pid $..1]$
- *            is calculated using <esl_dst_XPairId()>.
+ *            is calculated as <esl_dst_XPairId()> does, using the
+ *            bit-parallel <esl_dst_bits_PairId()> unless there are
+ *            more sequences than comparisons.
  *
  * Returns:   <eslOK> on success, and <*ret_id> contains the average
  *            fractional identity.
@@ -967,6 +1072,7 @@ esl_dst_CAverageMatch(char **as, int N, int max_comparisons, double *ret_match)
 int
 esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_comparisons, double *ret_id)
 {
+  ESL_DST_BITS *db = NULL;
   int    status;
   double id;
   double sum = 0.;
@@ -975,6 +1081,11 @@ esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_compari
   if (N <= 1) { *ret_id = 1.; return eslOK; }
   *ret_id = 0.;
 
+  /* Unless there are more seqs than comparisons, packing them once
+   * into bit planes is cheap, and makes each comparison much faster.
+   */
+  if (N <= max_comparisons && (status = esl_dst_bits_Create(abc, ax, N, &db)) != eslOK) return status;
+
   /* Is N small enough that we can average over all pairwise comparisons? 
      watch out for numerical overflow in this: Pfam N's easily overflow when squared
    */
@@ -985,7 +1096,7 @@ esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_compari
       for (i = 0; i < N; i++)
 	for (j = i+1; j < N; j++)
 	  {
-	    if ((status = esl_dst_XPairId(abc, ax[i], ax[j], &id, NULL, NULL)) != eslOK) return status;
+	    if ((status = dst_xpairid(abc, ax, db, i, j, &id)) != eslOK) goto ERROR;
 	    sum += id;
 	  }
       sum /= (double) (N * (N-1) / 2);
@@ -998,15 +1109,20 @@ esl_dst_XAverageId(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_compari
       for (n = 0; n < max_comparisons; n++)
 	{
 	  do { i = esl_rnd_Roll(r, N); j = esl_rnd_Roll(r, N); } while (j == i); /* make sure j != i */
-	  if ((status = esl_dst_XPairId(abc, ax[i], ax[j], &id, NULL, NULL)) != eslOK) return status;
+	  if ((status = dst_xpairid(abc, ax, db, i, j, &id)) != eslOK) { esl_randomness_Destroy(r); goto ERROR; }
 	  sum += id;
 	}
       sum /= (double) max_comparisons;
       esl_randomness_Destroy(r);
     }
 
+  esl_dst_bits_Destroy(db);
   *ret_id = sum;
   return eslOK;
+
+ ERROR:
+  esl_dst_bits_Destroy(db);
+  return status;
 }
 
 /* Function:  esl_dst_XAverageMatch()
@@ -1086,7 +1202,444 @@ esl_dst_XAverageMatch(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_comp
 
 
 /*****************************************************************
- * 6. Private (static) functions
+ * 6. Bit-parallel pairwise identity for digital alignments.
+ *****************************************************************/
+
+/* Function:  esl_dst_bits_Create()
+ * Synopsis:  Pack a digital alignment into bit planes.
+ *
+ * Purpose:   Pack the <N> aligned digital sequences <ax> in alphabet
+ *            <abc> into a new <ESL_DST_BITS>, for fast pairwise
+ *            identity calculations, and return it in <*ret_db>.
+ *
+ *            Each sequence becomes a bit vector with one bit per
+ *            column marking its canonical residues, plus
+ *            $\lceil \log_2 K \rceil$ bit vectors holding the bits
+ *            of those residues' codes. The identities of two
+ *            sequences are then the columns where both are
+ *            canonical and no code bit differs: for each 64
+ *            columns, a few ANDs and XORs and one popcount,
+ *            instead of 64 column comparisons. Packing costs one
+ *            pass over the alignment, so it pays off as soon as
+ *            each sequence takes part in more than a few
+ *            comparisons.
+ *
+ *            Identities computed from <*ret_db> are exactly those
+ *            of <esl_dst_XPairId()>.
+ *
+ * Args:      abc    - digital alphabet
+ *            ax     - aligned digital seqs, [0..N-1][1..L]
+ *            N      - number of seqs
+ *            ret_db - RETURN: new packed alignment
+ *
+ * Returns:   <eslOK> on success, and <*ret_db> is the new object.
+ *            Caller frees it with <esl_dst_bits_Destroy()>.
+ *
+ * Throws:    <eslEINVAL> if the seqs aren't all the same length.
+ *            <eslEMEM> on allocation failure.
+ *            On error, <*ret_db> is <NULL>.
+ */
+int
+esl_dst_bits_Create(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DST_BITS **ret_db)
+{
+  ESL_DST_BITS *db = NULL;
+  uint64_t     *x;
+  int64_t       L, pos, w;
+  uint64_t      bit;
+  int           nb, i, p;
+  int           status;
+
+  ESL_ALLOC(db, sizeof(ESL_DST_BITS));
+  db->bits   = NULL;
+  db->ncanon = NULL;
+
+  for (L = 0; N > 0 && ax[0][L+1] != eslDSQ_SENTINEL; L++) ;
+  for (nb = 1; (1 << nb) < abc->K; nb++) ;
+
+  db->N       = N;
+  db->L       = L;
+  db->np      = 1 + nb;
+  db->nw      = ESL_MAX(1, (L + 64*eslDST_BITS_PAD - 1) / (64*eslDST_BITS_PAD)) * eslDST_BITS_PAD;
+  db->idcount = dst_idcount_dispatch();
+
+  ESL_ALLOC(db->bits,   sizeof(uint64_t) * db->nw * db->np * ESL_MAX(1, N));
+  ESL_ALLOC(db->ncanon, sizeof(int)      * ESL_MAX(1, N));
+  memset(db->bits, 0, sizeof(uint64_t) * db->nw * db->np * ESL_MAX(1, N));
+
+  for (i = 0; i < N; i++)
+    {
+      x = db->bits + (int64_t) i * db->np * db->nw;
+      db->ncanon[i] = 0;
+      for (pos = 0; pos < L; pos++)
+	{
+	  if (ax[i][pos+1] == eslDSQ_SENTINEL) ESL_XEXCEPTION(eslEINVAL, "seq %d is shorter than the others, not aligned", i);
+	  if (! esl_abc_XIsCanonical(abc, ax[i][pos+1])) continue;
+
+	  w   = pos / 64;
+	  bit = (uint64_t) 1 << (pos % 64);
+	  x[w] |= bit;
+	  for (p = 0; p < nb; p++)
+	    if (ax[i][pos+1] & (1 << p)) x[(p+1)*db->nw + w] |= bit;
+	  db->ncanon[i]++;
+	}
+      if (ax[i][L+1] != eslDSQ_SENTINEL) ESL_XEXCEPTION(eslEINVAL, "seq %d is longer than the others, not aligned", i);
+    }
+
+  *ret_db = db;
+  return eslOK;
+
+ ERROR:
+  esl_dst_bits_Destroy(db);
+  *ret_db = NULL;
+  return status;
+}
+
+
+/* Function:  esl_dst_bits_PairId()
+ * Synopsis:  Pairwise identity of two seqs in a packed alignment.
+ *
+ * Purpose:   Same as <esl_dst_XPairId()>, for sequences <i> and <j>
+ *            (<0..db->N-1>) of packed alignment <db>: return the
+ *            fractional identity in <*opt_pid>, the number of
+ *            identities in <*opt_nid>, and the denominator (the
+ *            smaller of the two seqs' numbers of canonical residues)
+ *            in <*opt_n>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_dst_bits_PairId(const ESL_DST_BITS *db, int i, int j, double *opt_pid, int *opt_nid, int *opt_n)
+{
+  int64_t stride = (int64_t) db->np * db->nw;
+  int     nid    = (int) (*db->idcount)(db->bits + i*stride, db->bits + j*stride, db->np, db->nw);
+  int     n      = ESL_MIN(db->ncanon[i], db->ncanon[j]);
+
+  if (opt_pid != NULL) *opt_pid = ( n==0 ? 0. : (double) nid / (double) n );
+  if (opt_nid != NULL) *opt_nid = nid;
+  if (opt_n   != NULL) *opt_n   = n;
+  return eslOK;
+}
+
+
+/* Function:  esl_dst_bits_PairIdMx()
+ * Synopsis:  NxN identity matrix from a packed alignment, in parallel.
+ *
+ * Purpose:   Calculate the symmetric pairwise fractional identity
+ *            matrix of the <db->N> sequences in packed alignment <db>,
+ *            as <esl_dst_XPairIdMx()>, and return it in <*ret_S>.
+ *
+ *            The upper triangle is computed in square tiles of
+ *            <eslDST_BITS_TILE> sequences, so each tile's planes stay
+ *            in cache, and the tiles are divided among <nthreads>
+ *            threads. With <nthreads> 0 or 1 (or without POSIX
+ *            threads), all the work is done in the caller.
+ *
+ * Returns:   <eslOK> on success, and <*ret_S> is the identity matrix.
+ *            Caller frees it with <esl_dmatrix_Destroy()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure. Now <*ret_S> is <NULL>.
+ */
+int
+esl_dst_bits_PairIdMx(const ESL_DST_BITS *db, int nthreads, ESL_DMATRIX **ret_S)
+{
+  ESL_DMATRIX *S = NULL;
+  int          i;
+  int          status;
+
+  if (( S = esl_dmatrix_Create(db->N, db->N) ) == NULL) { status = eslEMEM; goto ERROR; }
+  for (i = 0; i < db->N; i++) S->mx[i][i] = 1.;
+
+  if ((status = dst_tile_run(db, nthreads, S, NULL)) != eslOK) goto ERROR;
+  *ret_S = S;
+  return eslOK;
+
+ ERROR:
+  esl_dmatrix_Destroy(S);
+  *ret_S = NULL;
+  return status;
+}
+
+
+/* Function:  esl_dst_bits_DiffPacked()
+ * Synopsis:  Packed difference matrix from a packed alignment.
+ *
+ * Purpose:   Same as <esl_dst_bits_PairIdMx()>, but calculate fractional
+ *            differences <1-s>, and return only the strict upper
+ *            triangle of the matrix: an array of <N(N-1)/2> doubles
+ *            in <*ret_D>, with the difference between seqs $i<j$ in
+ *            <(*ret_D)[esl_dmx_PackedIdx(N,i,j)]>. That's half the
+ *            memory of the square matrix, for deep alignments; see
+ *            <esl_tree_ClusterPacked()>.
+ *
+ * Returns:   <eslOK> on success, and <*ret_D> is the matrix.
+ *            Caller frees it with <free()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure. Now <*ret_D> is <NULL>.
+ */
+int
+esl_dst_bits_DiffPacked(const ESL_DST_BITS *db, int nthreads, double **ret_D)
+{
+  double *D = NULL;
+  int     status;
+
+  ESL_ALLOC(D, sizeof(double) * ESL_MAX(1, (int64_t) db->N * (db->N-1) / 2));
+  if ((status = dst_tile_run(db, nthreads, NULL, D)) != eslOK) goto ERROR;
+  *ret_D = D;
+  return eslOK;
+
+ ERROR:
+  free(D);
+  *ret_D = NULL;
+  return status;
+}
+
+
+/* Function:  esl_dst_bits_MinIdents()
+ * Synopsis:  Integer identity thresholds for a fractional one.
+ *
+ * Purpose:   For each possible identity denominator <n> of a pair of
+ *            seqs in <db> (0 up to the most canonical residues of any
+ *            seq), find the fewest identities <need[n]> such that
+ *            the fractional identity, as calculated by
+ *            <esl_dst_bits_PairId()> and <esl_dst_XPairId()>, is
+ *            $\geq$ <minid>; or <n+1> if there are none. Then
+ *            <nid >= need[n]> decides exactly the same as
+ *            <pid >= minid>, without any floating point division per
+ *            pair.
+ *
+ *            The table is returned in <*ret_need>, <[0..maxn]>.
+ *
+ * Returns:   <eslOK> on success. Caller frees <*ret_need>.
+ *
+ * Throws:    <eslEMEM> on allocation failure. Now <*ret_need> is <NULL>.
+ */
+int
+esl_dst_bits_MinIdents(const ESL_DST_BITS *db, double minid, int **ret_need)
+{
+  int *need = NULL;
+  int  maxn = 0;
+  int  i, n, m;
+  int  status;
+
+  for (i = 0; i < db->N; i++) maxn = ESL_MAX(maxn, db->ncanon[i]);
+  ESL_ALLOC(need, sizeof(int) * (maxn+1));
+
+  need[0] = (0. >= minid ? 0 : 1);    // pid is 0 when n is 0
+  for (n = 1; n <= maxn; n++)
+    {
+      m = (int) ceil(minid * (double) n);
+      if (m < 0) m = 0;
+      if (m > n) m = n+1;
+      while (m > 0  && (double) (m-1) / (double) n >= minid) m--;   // guard against roundoff in the product, either way
+      while (m <= n && (double) m     / (double) n <  minid) m++;
+      need[n] = m;
+    }
+  *ret_need = need;
+  return eslOK;
+
+ ERROR:
+  *ret_need = NULL;
+  return status;
+}
+
+
+/* Function:  esl_dst_bits_Destroy()
+ * Synopsis:  Free an <ESL_DST_BITS>.
+ */
+void
+esl_dst_bits_Destroy(ESL_DST_BITS *db)
+{
+  if (db)
+    {
+      free(db->bits);
+      free(db->ncanon);
+      free(db);
+    }
+}
+
+
+/* dst_tile_run()
+ * Fill the off-diagonal cells of identity matrix <S>, or of packed
+ * difference matrix <P> (one of them is NULL), from packed alignment
+ * <db>, dividing the tiles among <nthreads> threads. A thread that
+ * can't be started does its share in the caller.
+ */
+static int
+dst_tile_run(const ESL_DST_BITS *db, int nthreads, ESL_DMATRIX *S, double *P)
+{
+  DST_TILEJOB *job   = NULL;
+#ifdef HAVE_PTHREAD
+  pthread_t   *tid   = NULL;
+  int         *alive = NULL;
+#endif
+  int          nblk  = (db->N + eslDST_BITS_TILE - 1) / eslDST_BITS_TILE;
+  int64_t      ntile = (int64_t) nblk * (nblk+1) / 2;
+  int          njobs = (int) ESL_MAX(1, ESL_MIN(nthreads, ntile));
+  int          t;
+  int          status;
+
+  ESL_ALLOC(job, sizeof(DST_TILEJOB) * njobs);
+  for (t = 0; t < njobs; t++)
+    {
+      job[t].db    = db;
+      job[t].S     = S;
+      job[t].P     = P;
+      job[t].t0    = t;
+      job[t].tstep = njobs;
+    }
+
+#ifdef HAVE_PTHREAD
+  if (njobs > 1)
+    {
+      ESL_ALLOC(tid,   sizeof(pthread_t) * njobs);
+      ESL_ALLOC(alive, sizeof(int)       * njobs);
+      for (t = 1; t < njobs; t++)
+        alive[t] = (pthread_create(&(tid[t]), NULL, dst_tile_job, &(job[t])) == 0);
+      dst_tile_job(&(job[0]));
+      for (t = 1; t < njobs; t++)
+        {
+          if (alive[t]) pthread_join(tid[t], NULL);
+          else          dst_tile_job(&(job[t]));
+        }
+      free(tid);
+      free(alive);
+    }
+  else
+#endif
+    {
+      dst_tile_job(&(job[0]));
+    }
+
+  free(job);
+  return eslOK;
+
+ ERROR:
+#ifdef HAVE_PTHREAD
+  free(tid);
+  free(alive);
+#endif
+  free(job);
+  return status;
+}
+
+
+/* dst_tile_job()
+ * Compute the tiles <t0>, <t0+tstep>, <t0+2*tstep>... of the upper
+ * triangle of <S> (or <P>), numbering tiles row by row; interleaving
+ * them like this balances the work, since the diagonal tiles are half
+ * the size of the others. Each tile sets both S(i,j) and S(j,i), and
+ * no two tiles share a cell.
+ */
+static void *
+dst_tile_job(void *arg)
+{
+  DST_TILEJOB        *job  = (DST_TILEJOB *) arg;
+  const ESL_DST_BITS *db   = job->db;
+  int                 nblk = (db->N + eslDST_BITS_TILE - 1) / eslDST_BITS_TILE;
+  int64_t             t    = 0;
+  double              pid;
+  int                 bi, bj, i, j, jstart;
+
+  for (bi = 0; bi < nblk; bi++)
+    for (bj = bi; bj < nblk; bj++, t++)
+      {
+	if (t % job->tstep != job->t0) continue;
+	for (i = bi*eslDST_BITS_TILE; i < ESL_MIN(db->N, (bi+1)*eslDST_BITS_TILE); i++)
+	  {
+	    jstart = (bi == bj ? i+1 : bj*eslDST_BITS_TILE);
+	    for (j = jstart; j < ESL_MIN(db->N, (bj+1)*eslDST_BITS_TILE); j++)
+	      {
+		esl_dst_bits_PairId(db, i, j, &pid, NULL, NULL);
+		if (job->S) job->S->mx[i][j] = job->S->mx[j][i] = pid;
+		else        job->P[esl_dmx_PackedIdx(db->N, i, j)]  = 1. - pid;
+	      }
+	  }
+      }
+  return NULL;
+}
+
+
+/* dst_idcount_dispatch()
+ * Choose the fastest identity counting kernel that's compiled in and
+ * that the processor supports, following our standard runtime
+ * dispatch pattern; <dst_idcount_none()> is the portable one.
+ * Packed alignments remember the choice, so threads don't race to
+ * make it.
+ */
+static int64_t (*dst_idcount_dispatch(void))(const uint64_t *, const uint64_t *, int, int64_t)
+{
+#ifdef eslENABLE_AVX512
+  if (esl_cpu_has_avx512()) return esl_dst_idcount_avx512;
+#endif
+#ifdef eslENABLE_AVX
+  if (esl_cpu_has_avx())    return esl_dst_idcount_avx;
+#endif
+#ifdef eslENABLE_SSE4
+  if (esl_cpu_has_sse4())   return esl_dst_idcount_sse;
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  return esl_dst_idcount_neon;
+#endif
+  return dst_idcount_none;
+}
+
+
+/* dst_idcount_none()
+ * Portable identity count: the number of columns where packed seqs
+ * <x> and <y> (of <np> planes, <nw> words each) are both canonical
+ * and have the same residue code.
+ */
+static int64_t
+dst_idcount_none(const uint64_t *x, const uint64_t *y, int np, int64_t nw)
+{
+  int64_t  n = 0;
+  int64_t  w;
+  uint64_t m;
+  int      p;
+
+  for (w = 0; w < nw; w++)
+    {
+      m = x[w] & y[w];
+      for (p = 1; p < np; p++)
+	m &= ~(x[p*nw+w] ^ y[p*nw+w]);
+      n += dst_popcount64(m);
+    }
+  return n;
+}
+
+
+/* dst_xpairid()
+ * Pairwise identity of seqs <i>,<j>: from packed alignment <db> if
+ * we have one, else from <ax>.
+ */
+static int
+dst_xpairid(const ESL_ALPHABET *abc, ESL_DSQ **ax, const ESL_DST_BITS *db, int i, int j, double *ret_pid)
+{
+  if (db) return esl_dst_bits_PairId(db, i, j, ret_pid, NULL, NULL);
+  else    return esl_dst_XPairId(abc, ax[i], ax[j], ret_pid, NULL, NULL);
+}
+
+
+/* dst_popcount64()
+ * Number of set bits in <v>.
+ */
+static int
+dst_popcount64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(v);
+#else
+  v = v - ((v >> 1) & 0x5555555555555555ULL);
+  v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+  v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+
+
+/*****************************************************************
+ * 7. Private (static) functions
  *****************************************************************/
 
 /* jukescantor()
@@ -1142,7 +1695,7 @@ jukescantor(int n1, int n2, int alphabet_size, double *opt_distance, double *opt
 
 
 /*****************************************************************
- * 7. Unit tests.
+ * 8. Unit tests.
  *****************************************************************/ 
 #ifdef eslDISTANCE_TESTDRIVE
 
@@ -1402,13 +1955,159 @@ utest_XJukesCantorMx(ESL_ALPHABET *abc, char **as, ESL_DSQ **ax, int N)
   esl_dmatrix_Destroy(V2);
   return eslOK;
 }
+
+/* utest_bits()
+ * Identities from packed alignments must be exactly those of
+ * esl_dst_XPairId(), for random digital alignments of DNA and
+ * protein that include gaps and noncanonical residues, with lengths
+ * around the 64-column word and 512-column padding boundaries; for
+ * each vector kernel that's compiled in and supported, and with
+ * threaded identity matrices.
+ */
+static void
+utest_bits(ESL_RANDOMNESS *rng)
+{
+  char           msg[]    = "esl_distance bits unit test failed";
+  int            types[]  = { eslDNA, eslAMINO };
+  int            lens[]   = { 0, 1, 63, 64, 65, 511, 512, 513, 1000 };
+  int            nthr[]   = { 0, 1, 3 };
+  int64_t      (*kernel[4])(const uint64_t *x, const uint64_t *y, int np, int64_t nw);
+  int            nk       = 0;
+  int            N        = 2 + esl_rnd_Roll(rng, 150);   // > 2 tiles sometimes
+  ESL_ALPHABET  *abc      = NULL;
+  ESL_DSQ      **ax       = NULL;
+  ESL_DST_BITS  *db       = NULL;
+  ESL_DMATRIX   *S        = NULL;
+  ESL_DMATRIX   *S2       = NULL;
+  double        *P        = NULL;
+  double         pid, pid2;
+  int            nid, nid2, n, n2;
+  int64_t        stride;
+  int            t, l, i, j, k, pos;
+
+#ifdef eslENABLE_AVX512
+  if (esl_cpu_has_avx512()) kernel[nk++] = esl_dst_idcount_avx512;
+#endif
+#ifdef eslENABLE_AVX
+  if (esl_cpu_has_avx())    kernel[nk++] = esl_dst_idcount_avx;
+#endif
+#ifdef eslENABLE_SSE4
+  if (esl_cpu_has_sse4())   kernel[nk++] = esl_dst_idcount_sse;
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  kernel[nk++] = esl_dst_idcount_neon;
+#endif
+
+  if ((ax = malloc(sizeof(ESL_DSQ *) * N)) == NULL) esl_fatal(msg);
+  for (t = 0; t < 2; t++)
+    {
+      if ((abc = esl_alphabet_Create(types[t])) == NULL) esl_fatal(msg);
+      for (l = 0; l < sizeof(lens) / sizeof(int); l++)
+	{
+	  /* Mostly canonical residues; seqs related to seq 0, so identities aren't rare */
+	  for (i = 0; i < N; i++)
+	    {
+	      if ((ax[i] = malloc(sizeof(ESL_DSQ) * (lens[l]+2))) == NULL) esl_fatal(msg);
+	      ax[i][0] = ax[i][lens[l]+1] = eslDSQ_SENTINEL;
+	      for (pos = 1; pos <= lens[l]; pos++)
+		{
+		  if      (i > 0 && esl_rnd_Roll(rng, 2)) ax[i][pos] = ax[0][pos];
+		  else if (esl_rnd_Roll(rng, 10) < 8)     ax[i][pos] = esl_rnd_Roll(rng, abc->K);
+		  else                                    ax[i][pos] = esl_rnd_Roll(rng, abc->Kp);
+		}
+	    }
+
+	  if (esl_dst_bits_Create(abc, ax, N, &db) != eslOK) esl_fatal(msg);
+	  stride = (int64_t) db->np * db->nw;
+	  for (i = 0; i < N; i++)
+	    for (j = i; j < N; j++)
+	      {
+		if (esl_dst_XPairId(abc, ax[i], ax[j], &pid, &nid, &n)         != eslOK) esl_fatal(msg);
+		if (esl_dst_bits_PairId(db, i, j, &pid2, &nid2, &n2)            != eslOK) esl_fatal(msg);
+		if (pid != pid2 || nid != nid2 || n != n2)                               esl_fatal(msg);
+		if (dst_idcount_none(db->bits + i*stride, db->bits + j*stride, db->np, db->nw) != nid) esl_fatal(msg);
+		for (k = 0; k < nk; k++)
+		  if ((*kernel[k])(db->bits + i*stride, db->bits + j*stride, db->np, db->nw) != nid) esl_fatal(msg);
+	      }
+
+	  if (esl_dst_XPairIdMx(abc, ax, N, &S) != eslOK) esl_fatal(msg);
+	  for (k = 0; k < sizeof(nthr) / sizeof(int); k++)
+	    {
+	      if (esl_dst_bits_PairIdMx(db, nthr[k], &S2)           != eslOK) esl_fatal(msg);
+	      for (i = 0; i < N; i++)
+		for (j = 0; j < N; j++)
+		  {
+		    if (i == j) pid = 1.;
+		    else if (esl_dst_XPairId(abc, ax[i], ax[j], &pid, NULL, NULL) != eslOK) esl_fatal(msg);
+		    if (S2->mx[i][j] != pid || S->mx[i][j] != pid) esl_fatal(msg);
+		  }
+	      esl_dmatrix_Destroy(S2);
+
+	      if (esl_dst_bits_DiffPacked(db, nthr[k], &P) != eslOK) esl_fatal(msg);
+	      for (i = 0; i < N; i++)
+		for (j = i+1; j < N; j++)
+		  if (P[esl_dmx_PackedIdx(N, i, j)] != 1. - S->mx[i][j]) esl_fatal(msg);
+	      free(P);
+	    }
+
+	  esl_dmatrix_Destroy(S);
+	  esl_dst_bits_Destroy(db);
+	  for (i = 0; i < N; i++) free(ax[i]);
+	}
+      esl_alphabet_Destroy(abc);
+    }
+  free(ax);
+}
+
+
+/* utest_minidents()
+ * Integer thresholds from esl_dst_bits_MinIdents() must decide
+ * exactly as the fractional identity test, for every number of
+ * identities and every denominator, at thresholds that include ones
+ * where the product minid*n has roundoff error.
+ */
+static void
+utest_minidents(ESL_RANDOMNESS *rng)
+{
+  char          msg[]    = "esl_distance minidents unit test failed";
+  double        minids[] = { 0.0, 0.1, 1./3., 0.62, 0.7, 0.9, 1.0, 0.0 };
+  int           L        = 1 + esl_rnd_Roll(rng, 1000);
+  ESL_ALPHABET *abc      = esl_alphabet_Create(eslAMINO);
+  ESL_DSQ      *ax[1];
+  ESL_DST_BITS *db       = NULL;
+  int          *need     = NULL;
+  double        pid;
+  int           k, n, m, pos;
+
+  minids[7] = esl_random(rng);
+  if ((ax[0] = malloc(sizeof(ESL_DSQ) * (L+2))) == NULL) esl_fatal(msg);
+  ax[0][0] = ax[0][L+1] = eslDSQ_SENTINEL;
+  for (pos = 1; pos <= L; pos++) ax[0][pos] = esl_rnd_Roll(rng, abc->K);
+  if (esl_dst_bits_Create(abc, ax, 1, &db) != eslOK) esl_fatal(msg);
+
+  for (k = 0; k < sizeof(minids) / sizeof(double); k++)
+    {
+      if (esl_dst_bits_MinIdents(db, minids[k], &need) != eslOK) esl_fatal(msg);
+      for (n = 0; n <= L; n++)
+	for (m = 0; m <= n; m++)
+	  {
+	    pid = (n == 0 ? 0. : (double) m / (double) n);
+	    if ((m >= need[n]) != (pid >= minids[k])) esl_fatal(msg);
+	  }
+      free(need);
+    }
+
+  esl_dst_bits_Destroy(db);
+  esl_alphabet_Destroy(abc);
+  free(ax[0]);
+}
 #endif /* eslDISTANCE_TESTDRIVE */
 /*------------------ end of unit tests --------------------------*/
 
 
 
 /*****************************************************************
- * 8. Test driver.
+ * 9. Test driver.
  *****************************************************************/ 
 
 #ifdef eslDISTANCE_TESTDRIVE
@@ -1503,6 +2202,8 @@ main(int argc, char **argv)
   if (utest_XPairIdMx(abc, as, ax, N)       != eslOK) return eslFAIL;
   if (utest_XDiffMx(abc, as, ax, N)         != eslOK) return eslFAIL;
   if (utest_XJukesCantorMx(abc, as, ax, N)  != eslOK) return eslFAIL;
+  utest_bits(r);
+  utest_minidents(r);
 
 
   esl_randomness_Destroy(r);
@@ -1520,7 +2221,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 9. Example.
+ * 10. Example.
  *****************************************************************/ 
 
 #ifdef eslDISTANCE_EXAMPLE
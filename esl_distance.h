@@ -12,6 +12,25 @@
 #include "esl_dmatrix.h"	
 #include "esl_random.h"  
 
+/* ESL_DST_BITS
+ * A digital alignment packed into bit planes, for fast pairwise
+ * identities: for each sequence, a mask of its canonical residues,
+ * and the bits of its residue codes, one bit per column per plane.
+ */
+#define eslDST_BITS_PAD  8      /* planes are padded to a multiple of this many 64-bit words (512 bits) */
+#define eslDST_BITS_TILE 64     /* identity matrices are computed in tiles of this many seqs squared    */
+
+typedef struct {
+  int       N;          /* number of sequences                                                  */
+  int64_t   L;          /* number of aligned columns                                            */
+  int       np;         /* planes per seq: canonical mask, then ceil(log2 K) residue code bits  */
+  int64_t   nw;         /* 64-bit words per plane: L/64 rounded up to a multiple of eslDST_BITS_PAD */
+  uint64_t *bits;       /* seq i's plane p starts at bits + (i*np + p) * nw                     */
+  int      *ncanon;     /* number of canonical residues in each seq, [0..N-1]                   */
+
+  int64_t (*idcount)(const uint64_t *x, const uint64_t *y, int np, int64_t nw); /* kernel, chosen for this cpu */
+} ESL_DST_BITS;
+
 /* 1. Pairwise distances for aligned text sequences.
  */
 extern int esl_dst_CPairId(const char *asq1, const char *asq2, 
@@ -34,12 +53,14 @@ extern int esl_dst_XJukesCantor(const ESL_ALPHABET *abc, const ESL_DSQ *ax, cons
  */
 extern int esl_dst_CPairIdMx     (char **as, int N, ESL_DMATRIX **ret_S);
 extern int esl_dst_CDiffMx       (char **as, int N, ESL_DMATRIX **ret_D);
+extern int esl_dst_CDiffPacked   (char **as, int N, double **ret_D);
 extern int esl_dst_CJukesCantorMx(int K, char **as, int N, ESL_DMATRIX **opt_D, ESL_DMATRIX **opt_V);
 
 /* 4. Distance matrices for aligned digital sequences. 
  */
 extern int esl_dst_XPairIdMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DMATRIX **ret_S);
 extern int esl_dst_XDiffMx  (const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DMATRIX **ret_D);
+extern int esl_dst_XDiffPacked(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, double **ret_D);
 
 extern int esl_dst_XJukesCantorMx(const ESL_ALPHABET *abc, ESL_DSQ **ax, int nseq, 
 				  ESL_DMATRIX **opt_D, ESL_DMATRIX **opt_V);
@@ -52,5 +73,29 @@ extern int esl_dst_CAverageMatch(char **as, int N, int max_comparisons, double *
 extern int esl_dst_XAverageId   (const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_comparisons, double *ret_id);
 extern int esl_dst_XAverageMatch(const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, int max_comparisons, double *ret_match);
 
+/* 6. Bit-parallel pairwise identity for digital alignments.
+ */
+extern int  esl_dst_bits_Create  (const ESL_ALPHABET *abc, ESL_DSQ **ax, int N, ESL_DST_BITS **ret_db);
+extern int  esl_dst_bits_PairId  (const ESL_DST_BITS *db, int i, int j, double *opt_pid, int *opt_nid, int *opt_n);
+extern int  esl_dst_bits_PairIdMx(const ESL_DST_BITS *db, int nthreads, ESL_DMATRIX **ret_S);
+extern int  esl_dst_bits_DiffPacked(const ESL_DST_BITS *db, int nthreads, double **ret_D);
+extern int  esl_dst_bits_MinIdents(const ESL_DST_BITS *db, double minid, int **ret_need);
+extern void esl_dst_bits_Destroy (ESL_DST_BITS *db);
+
+/* Vectorized identity counting kernels, in esl_distance_{sse,avx,avx512,neon}.c
+ */
+#ifdef eslENABLE_SSE4
+extern int64_t esl_dst_idcount_sse   (const uint64_t *x, const uint64_t *y, int np, int64_t nw);
+#endif
+#ifdef eslENABLE_AVX
+extern int64_t esl_dst_idcount_avx   (const uint64_t *x, const uint64_t *y, int np, int64_t nw);
+#endif
+#ifdef eslENABLE_AVX512
+extern int64_t esl_dst_idcount_avx512(const uint64_t *x, const uint64_t *y, int np, int64_t nw);
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+extern int64_t esl_dst_idcount_neon  (const uint64_t *x, const uint64_t *y, int np, int64_t nw);
+#endif
+
 #endif /*eslDISTANCE_INCLUDED*/
 
@@ -0,0 +1,56 @@
+/* Bit-parallel identity counting: x86 AVX2 implementation.
+ *
+ * Same as the SSE4 kernel in esl_distance_sse.c (see there for notes),
+ * 256 columns at a time.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_AVX> was
+ * set in <esl_config.h> by the configure script. When it is not set,
+ * we include some dummy code to silence compiler and ranlib warnings
+ * about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_AVX
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_distance.h"
+
+
+/* Function:  esl_dst_idcount_avx()
+ * Synopsis:  Count identities of two packed seqs, AVX2 version.
+ *
+ * Purpose:   As <esl_dst_idcount_sse()>, but 256 columns at a time.
+ *
+ * Returns:   the number of identities.
+ */
+int64_t
+esl_dst_idcount_avx(const uint64_t *x, const uint64_t *y, int np, int64_t nw)
+{
+  const __m256i lut   = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low4  = _mm256_set1_epi8(0x0f);
+  const __m256i zero  = _mm256_setzero_si256();
+  __m256i       acc   = _mm256_setzero_si256();
+  __m256i       m, cnt;
+  int64_t       w;
+  int           p;
+
+  for (w = 0; w < nw; w += 4)
+    {
+      m = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (x + w)), _mm256_loadu_si256((const __m256i *) (y + w)));
+      for (p = 1; p < np; p++)
+	m = _mm256_andnot_si256(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (x + p*nw + w)),
+						 _mm256_loadu_si256((const __m256i *) (y + p*nw + w))), m);
+
+      cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(m, low4)),
+			    _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(m, 4), low4)));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, zero));
+    }
+  return _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+}
+
+#else // ! eslENABLE_AVX
+void esl_distance_avx_silence_hack(void) { return; }
+#endif // eslENABLE_AVX
@@ -0,0 +1,58 @@
+/* Bit-parallel identity counting: x86 AVX-512 implementation.
+ *
+ * Same as the SSE4 kernel in esl_distance_sse.c (see there for notes),
+ * 512 columns at a time. Uses AVX-512BW byte shuffles for the
+ * popcount, rather than the VPOPCNTDQ extension, which fewer
+ * processors have.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_AVX512>
+ * was set in <esl_config.h> by the configure script. When it is not
+ * set, we include some dummy code to silence compiler and ranlib
+ * warnings about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_AVX512
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_distance.h"
+
+
+/* Function:  esl_dst_idcount_avx512()
+ * Synopsis:  Count identities of two packed seqs, AVX-512 version.
+ *
+ * Purpose:   As <esl_dst_idcount_sse()>, but 512 columns at a time.
+ *            That's why <eslDST_BITS_PAD> is 8 words.
+ *
+ * Returns:   the number of identities.
+ */
+int64_t
+esl_dst_idcount_avx512(const uint64_t *x, const uint64_t *y, int np, int64_t nw)
+{
+  const __m512i lut   = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+  const __m512i low4  = _mm512_set1_epi8(0x0f);
+  const __m512i zero  = _mm512_setzero_si512();
+  __m512i       acc   = _mm512_setzero_si512();
+  __m512i       m, cnt;
+  int64_t       w;
+  int           p;
+
+  for (w = 0; w < nw; w += 8)
+    {
+      m = _mm512_and_si512(_mm512_loadu_si512((const void *) (x + w)), _mm512_loadu_si512((const void *) (y + w)));
+      for (p = 1; p < np; p++)
+	m = _mm512_andnot_si512(_mm512_xor_si512(_mm512_loadu_si512((const void *) (x + p*nw + w)),
+						 _mm512_loadu_si512((const void *) (y + p*nw + w))), m);
+
+      cnt = _mm512_add_epi8(_mm512_shuffle_epi8(lut, _mm512_and_si512(m, low4)),
+			    _mm512_shuffle_epi8(lut, _mm512_and_si512(_mm512_srli_epi16(m, 4), low4)));
+      acc = _mm512_add_epi64(acc, _mm512_sad_epu8(cnt, zero));
+    }
+  return _mm512_reduce_add_epi64(acc);
+}
+
+#else // ! eslENABLE_AVX512
+void esl_distance_avx512_silence_hack(void) { return; }
+#endif // eslENABLE_AVX512
@@ -0,0 +1,50 @@
+/* Bit-parallel identity counting: ARM NEON implementation.
+ *
+ * Same as the SSE4 kernel in esl_distance_sse.c (see there for notes),
+ * 128 columns at a time, but simpler: NEON has a byte popcount
+ * (vcntq_u8), and pairwise widening adds sum the bytes.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_NEON>
+ * and <eslHAVE_NEON_AARCH64> were set in <esl_config.h> by the
+ * configure script. Otherwise we include some dummy code to silence
+ * compiler and ranlib warnings about empty translation units and no
+ * symbols.
+ */
+#include "esl_config.h"
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#include "easel.h"
+#include "esl_distance.h"
+
+
+/* Function:  esl_dst_idcount_neon()
+ * Synopsis:  Count identities of two packed seqs, NEON version.
+ *
+ * Purpose:   As <esl_dst_idcount_sse()>.
+ *
+ * Returns:   the number of identities.
+ */
+int64_t
+esl_dst_idcount_neon(const uint64_t *x, const uint64_t *y, int np, int64_t nw)
+{
+  uint64x2_t acc = vdupq_n_u64(0);
+  uint64x2_t m;
+  int64_t    w;
+  int        p;
+
+  for (w = 0; w < nw; w += 2)
+    {
+      m = vandq_u64(vld1q_u64(x + w), vld1q_u64(y + w));
+      for (p = 1; p < np; p++)
+	m = vbicq_u64(m, veorq_u64(vld1q_u64(x + p*nw + w), vld1q_u64(y + p*nw + w)));
+      acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(vcntq_u8(vreinterpretq_u8_u64(m)))));
+    }
+  return (int64_t) vaddvq_u64(acc);
+}
+
+#else // ! (eslENABLE_NEON && eslHAVE_NEON_AARCH64)
+void esl_distance_neon_silence_hack(void) { return; }
+#endif
@@ -0,0 +1,69 @@
+/* Bit-parallel identity counting: x86 SSE4 implementation.
+ *
+ * esl_distance.c documents the packed alignments (<ESL_DST_BITS>)
+ * that these kernels work on, and calls them through a runtime
+ * dispatcher.
+ *
+ * For each 128 columns, a column is an identity if it's canonical in
+ * both seqs and no residue code bit differs, which takes an AND and
+ * an XOR/ANDNOT per code bit plane. Counting the identities is a
+ * popcount, which SSE4.1 doesn't have for vectors: we look up the
+ * bit counts of each nibble with a byte shuffle, and sum bytes into
+ * two 64-bit counts with <_mm_sad_epu8()>.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_SSE4> was
+ * set in <esl_config.h> by the configure script. When it is not set,
+ * we include some dummy code to silence compiler and ranlib warnings
+ * about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_SSE4
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_distance.h"
+
+
+/* Function:  esl_dst_idcount_sse()
+ * Synopsis:  Count identities of two packed seqs, SSE4 version.
+ *
+ * Purpose:   Count the columns where packed seqs <x> and <y>, each
+ *            <np> planes of <nw> 64-bit words (canonical residue mask
+ *            first, then residue code bits), are both canonical and
+ *            have the same residue code.
+ *
+ *            <nw> must be a multiple of <eslDST_BITS_PAD>, as it is in
+ *            an <ESL_DST_BITS>.
+ *
+ * Returns:   the number of identities.
+ */
+int64_t
+esl_dst_idcount_sse(const uint64_t *x, const uint64_t *y, int np, int64_t nw)
+{
+  const __m128i lut   = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m128i low4  = _mm_set1_epi8(0x0f);
+  const __m128i zero  = _mm_setzero_si128();
+  __m128i       acc   = _mm_setzero_si128();
+  __m128i       m, cnt;
+  int64_t       w;
+  int           p;
+
+  for (w = 0; w < nw; w += 2)
+    {
+      m = _mm_and_si128(_mm_loadu_si128((const __m128i *) (x + w)), _mm_loadu_si128((const __m128i *) (y + w)));
+      for (p = 1; p < np; p++)
+	m = _mm_andnot_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (x + p*nw + w)),
+					   _mm_loadu_si128((const __m128i *) (y + p*nw + w))), m);
+
+      cnt = _mm_add_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(m, low4)),
+			 _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(m, 4), low4)));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(cnt, zero));
+    }
+  return _mm_cvtsi128_si64(acc) + _mm_extract_epi64(acc, 1);
+}
+
+#else // ! eslENABLE_SSE4
+void esl_distance_sse_silence_hack(void) { return; }
+#endif // eslENABLE_SSE4
@@ -7,6 +7,7 @@
 #include "esl_config.h"
 
 #include <stdio.h>
+#include <stdint.h>
 
 typedef struct {
   /*mx, mx[0] are allocated. */
@@ -24,6 +25,14 @@ typedef struct {
   int      n;
 } ESL_PERMUTATION;
 
+/* A symmetric NxN distance matrix with a zero diagonal can also be
+ * kept as a bare array of its strict upper triangle, row by row: the
+ * N(N-1)/2 cells i<j, with cell (i,j) at esl_dmx_PackedIdx(N,i,j).
+ * Used by esl_dst_*DiffPacked() and esl_tree_ClusterPacked(), for
+ * alignments too deep for a square matrix.
+ */
+static inline int64_t esl_dmx_PackedIdx(int N, int i, int j) { return (int64_t) i * (2 * (int64_t) N - i - 1) / 2 + (j - i - 1); }
+
 /* 1. The ESL_DMATRIX object. */
 extern ESL_DMATRIX *esl_dmatrix_Create(int n, int m);
 extern ESL_DMATRIX *esl_dmatrix_CreateUpper(int n);
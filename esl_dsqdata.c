@@ -10,6 +10,10 @@
  * which may allow further input acceleration by deferring
  * metadata accesses until they're actually needed.
  * 
+ * Alternatively, a reader can memory-map the data files, with no
+ * loader or unpacker threads; consumer threads unpack their own
+ * chunks (esl_dsqdata_OpenMapped()).
+ *
  * All thread synchronization is handled internally. A caller does not
  * need to worry about the internal parallelism; it just calls
  * <esl_dsqdata_Read()>. Caller can create multiple threads, each
@@ -23,14 +27,15 @@
  * 
  * Contents:
  *   1. ESL_DSQDATA: reading dsqdata format
- *   2. Creating dsqdata format from a sequence file
+ *   2. Creating dsqdata format: ESL_DSQDATA_WRITER
  *   3. ESL_DSQDATA_CHUNK, a chunk of input sequence data
  *   4. Loader and unpacker, the input threads
  *   5. Packing sequences and unpacking chunks
  *   6. Notes and references
- *   7. Unit tests
- *   8. Test driver
- *   9. Examples
+ *   7. Benchmark
+ *   8. Unit tests
+ *   9. Test driver
+ *  10. Examples
  */
 #include "esl_config.h"
 
@@ -38,26 +43,61 @@
 #include <string.h>
 #include <stdint.h>
 #include <pthread.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef _POSIX_VERSION
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
+#include "esl_cpu.h"
+#include "esl_huffman.h"
 #include "esl_random.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
+#include "esl_stopwatch.h"
+#include "esl_varint.h"
 
 #include "esl_dsqdata.h"
 
+static int   dsqdata_open_files(ESL_ALPHABET **byp_abc, char *basename, ESL_DSQDATA **ret_dd);
+static int   dsqdata_read_mapped(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK **ret_chu);
+static int   dsqdata_set_range(ESL_DSQDATA *dd, const ESL_DSQDATA_CFG *cfg);
+static int   dsqdata_fetch(ESL_DSQDATA *dd, int64_t i, int do_seq, ESL_SQ *sq);
+static int   dsqdata_pread(FILE *fp, const unsigned char *map, size_t mapsize, off_t offset, size_t n, void *buf);
+
+static int   dsqdata_writer_index_header(ESL_DSQDATA_WRITER *w);
+static int   dsqdata_writer_submit (ESL_DSQDATA_WRITER *w);
+static int   dsqdata_writer_huffman(ESL_DSQDATA_WRITER *w, const ESL_DSQDATA_WCHUNK *wc);
+static void  dsqdata_writer_stop   (ESL_DSQDATA_WRITER *w);
+static void  dsqdata_writer_destroy(ESL_DSQDATA_WRITER *w, int do_remove);
+static void *dsqdata_packer_thread (void *p);
+static void *dsqdata_writer_thread (void *p);
+
+static ESL_DSQDATA_WCHUNK *dsqdata_wchunk_Create (void);
+static void                dsqdata_wchunk_Reuse  (ESL_DSQDATA_WCHUNK *wc);
+static void                dsqdata_wchunk_Destroy(ESL_DSQDATA_WCHUNK *wc);
+static void                dsqdata_wchunk_Pack   (ESL_DSQDATA_WRITER *w, ESL_DSQDATA_WCHUNK *wc);
+static int                 dsqdata_wchunk_Write  (ESL_DSQDATA_WRITER *w, ESL_DSQDATA_WCHUNK *wc);
+
 static ESL_DSQDATA_CHUNK *dsqdata_chunk_Create (ESL_DSQDATA *dd);
 static void               dsqdata_chunk_Destroy(ESL_DSQDATA_CHUNK *chu);
 
 static void *dsqdata_loader_thread  (void *p);
 static void *dsqdata_unpacker_thread(void *p);
 
-static int   dsqdata_unpack_chunk(ESL_DSQDATA_CHUNK *chu, int do_pack5);
-static int   dsqdata_unpack5(uint32_t *psq, ESL_DSQ *dsq, int *ret_L, int *ret_P);
-static int   dsqdata_unpack2(uint32_t *psq, ESL_DSQ *dsq, int *ret_L, int *ret_P);
+static void  dsqdata_select_unpackers(ESL_DSQDATA *dd);
+static int   dsqdata_unpack_chunk(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK *chu);
+static int   dsqdata_unpack5(uint32_t *psq, int np, ESL_DSQ *dsq, int (*vecf)(const uint32_t *, int, ESL_DSQ *), int *ret_L, int *ret_P);
+static int   dsqdata_unpack2(uint32_t *psq, int np, ESL_DSQ *dsq, int (*vecf)(const uint32_t *, int, ESL_DSQ *), int *ret_L, int *ret_P);
 static int   dsqdata_pack5  (ESL_DSQ *dsq, int L, uint32_t *psq, int *ret_P);
 static int   dsqdata_pack2  (ESL_DSQ *dsq, int L, uint32_t *psq, int *ret_P);
+static int   dsqdata_huffman_build(const uint32_t *hcount, int K, ESL_HUFFMAN **ret_hc, uint32_t **opt_lut);
+static int   dsqdata_unpackh(const ESL_DSQDATA *dd, const uint32_t *psq, int np, ESL_DSQ *dsq, int *ret_L, int *ret_P);
+static int   dsqdata_packh  (const ESL_HUFFMAN *hc, const ESL_DSQ *dsq, int n, uint32_t *psq, int *ret_P);
 
 
 /* Embedded magic numbers allow us to validate the correct binary
@@ -67,6 +107,23 @@ static int   dsqdata_pack2  (ESL_DSQ *dsq, int L, uint32_t *psq, int *ret_P);
 static uint32_t eslDSQDATA_MAGIC_V1     = 0xc4d3d1b1; // "dsq1" + 0x80808080             
 static uint32_t eslDSQDATA_MAGIC_V1SWAP = 0xb1d1d3c4; //  ... as above, but byteswapped. 
 
+/* Header sizes, in bytes, of the three binary files: the index file
+ * has 7 uint32's and 3 uint64's; metadata and sequence files have 2
+ * uint32's (magic, uniquetag). A Huffman coded sequence file's header
+ * is followed by the code's table, eslDSQDATA_HUFFMAN_K uint32's.
+ */
+#define eslDSQDATA_IHDRSIZE  (7 * sizeof(uint32_t) + 3 * sizeof(uint64_t))
+#define eslDSQDATA_HDRSIZE   (2 * sizeof(uint32_t))
+#define eslDSQDATA_HHDRSIZE  (eslDSQDATA_HDRSIZE + eslDSQDATA_HUFFMAN_K * sizeof(uint32_t))
+
+/* Huffman coding of protein residues (see note [4]): the writer scales
+ * residue counts to sum to about <SCALE>, which bounds code lengths
+ * well under 32 bits; the reader decodes up to three codes in the
+ * next <LUTBITS> bits with one table lookup.
+ */
+#define eslDSQDATA_HUFFMAN_SCALE    65536
+#define eslDSQDATA_HUFFMAN_LUTBITS  12
+
 /*****************************************************************
  *# 1. <ESL_DSQDATA>: reading dsqdata format
  *****************************************************************/
@@ -154,127 +211,68 @@ static uint32_t eslDSQDATA_MAGIC_V1SWAP = 0xb1d1d3c4; //  ... as above, but byte
  */
 int
 esl_dsqdata_Open(ESL_ALPHABET **byp_abc, char *basename, int nconsumers, ESL_DSQDATA **ret_dd)
+{
+  return esl_dsqdata_Open_adv(NULL, byp_abc, basename, nconsumers, ret_dd);
+}
+
+
+/* Function:  esl_dsqdata_Open_adv()
+ * Synopsis:  Open a digital sequence database, with custom configuration
+ *
+ * Purpose:   Same as <esl_dsqdata_Open()>, but with configuration
+ *            options <cfg>, such as the number of unpacker threads
+ *            <cfg->n_unpackers>. Caller creates <cfg> with
+ *            <esl_dsqdata_cfg_Create()>, sets what it needs to, and
+ *            can free it as soon as we return. Passing <cfg>
+ *            <NULL> means using defaults, and is the same as calling
+ *            <esl_dsqdata_Open()>.
+ *
+ *            There's no compile-time cap on the number of unpackers.
+ *            Unpacking is the CPU-bound half of the input pipeline,
+ *            so on many cores, with fast storage and light consumers,
+ *            more unpackers than the default of 4 may be needed to keep
+ *            up. <esl_dsqdata_GetStats()> helps decide.
+ *
+ *            Setting <cfg->i0> and <cfg->i1> limits the reader to
+ *            sequences <i0..i1-1> (0-offset), so several processes
+ *            can split one database by sequence index, each reading
+ *            only its own part. Chunks still number their sequences
+ *            by their index in the whole database: the first chunk's
+ *            <i0> is <cfg->i0>.
+ *
+ * Returns:   (as <esl_dsqdata_Open()>)
+ *
+ * Throws:    (as <esl_dsqdata_Open()>), and
+ *            <eslEINVAL> if <cfg->n_unpackers> is < 1, or if the 
+ *            range <cfg->i0..cfg->i1-1> isn't within the database.
+ */
+int
+esl_dsqdata_Open_adv(const ESL_DSQDATA_CFG *cfg, ESL_ALPHABET **byp_abc, char *basename, int nconsumers, ESL_DSQDATA **ret_dd)
 {
   ESL_DSQDATA *dd        = NULL;
-  int          bufsize   = 4096;
-  uint32_t     magic     = 0;
-  uint32_t     tag       = 0;
-  uint32_t     alphatype = eslUNKNOWN;
-  char        *p;                       // used for strtok() parsing of fields on a line
-  char         buf[4096];
   int          u;
   int          status;
   
   ESL_DASSERT1(( nconsumers > 0   ));
   ESL_DASSERT1(( byp_abc  != NULL ));  // either *byp_abc == NULL or *byp_abc = the caller's expected alphabet.
-  
-  ESL_ALLOC(dd, sizeof(ESL_DSQDATA));
-  dd->stubfp          = NULL;
-  dd->ifp             = NULL;
-  dd->sfp             = NULL;
-  dd->mfp             = NULL;
-  dd->abc_r           = *byp_abc;        // This may be NULL; if so, we create it later.
-
-  dd->magic           = 0;
-  dd->uniquetag       = 0;
-  dd->flags           = 0;
-  dd->max_namelen     = 0;
-  dd->max_acclen      = 0;
-  dd->max_desclen     = 0;
-  dd->max_seqlen      = 0;
-  dd->nseq            = 0;
-  dd->nres            = 0;
-
-  dd->chunk_maxseq    = eslDSQDATA_CHUNK_MAXSEQ;    // someday we may want to allow tuning these
-  dd->chunk_maxpacket = eslDSQDATA_CHUNK_MAXPACKET;
-  dd->do_byteswap     = FALSE;
-  dd->pack5           = FALSE;  
-
-  dd->nconsumers      = nconsumers;
-  dd->n_unpackers     = eslDSQDATA_UNPACKERS;      // we'll want to allow tuning this too
-  dd->errbuf[0]       = '\0';
-
-  /* Open the four files.
-   */
-  ESL_ALLOC( dd->basename, sizeof(char) * (strlen(basename) + 6)); // +5 for .dsqx; +1 for \0
-  if ( sprintf(dd->basename, "%s.dsqi", basename) <= 0)   ESL_XEXCEPTION_SYS(eslESYS, "sprintf() failure");
-  if (( dd->ifp = fopen(dd->basename, "rb"))   == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open index file %s\n", dd->basename);
-
-  if ( sprintf(dd->basename, "%s.dsqm", basename) <= 0)   ESL_XEXCEPTION_SYS(eslESYS, "sprintf() failure");
-  if (( dd->mfp = fopen(dd->basename, "rb"))   == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open metadata file %s\n", dd->basename);
-
-  if ( sprintf(dd->basename, "%s.dsqs", basename) <= 0)   ESL_XEXCEPTION_SYS(eslESYS, "sprintf() failure");
-  if (( dd->sfp = fopen(dd->basename, "rb"))   == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open sequence file %s\n", dd->basename);
-
-  strcpy(dd->basename, basename);
-  if (( dd->stubfp = fopen(dd->basename, "r")) == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open stub file %s\n", dd->basename);
-
-  /* The stub file is unparsed, intended to be human readable, with one exception:
-   * The first line contains the unique tag that we use to validate linkage of the 4 files.
-   * The format of that first line is:
-   *     Easel dsqdata v123 x0000000000 
-   */
-  if ( fgets(buf, bufsize, dd->stubfp) == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file is empty - no tag line found");
-  if (( p = strtok(buf,  " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format: tag line has no data");
-  if (  strcmp(p, "Easel") != 0)                          ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
-  if (( p = strtok(NULL, " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
-  if (  strcmp(p, "dsqdata") != 0)                        ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
-  if (( p = strtok(NULL, " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
-  if ( *p != 'v')                                         ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format: no v on version");                        
-  if ( ! esl_str_IsInteger(p+1))                          ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file had bad format: no version number");
-  // version number is currently unused: there's only 1
-  if (( p = strtok(NULL, " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
-  if ( *p != 'x')                                         ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format: no x on tag");                        
-  if ( ! esl_str_IsInteger(p+1))                          ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file had bad format: no integer tag");
-  dd->uniquetag = strtoul(p+1, NULL, 10);
-    
-  /* Index file has a header of 7 uint32's, 3 uint64's */
-  if ( fread(&(dd->magic),       sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has no header - is empty?");
-  if ( fread(&tag,               sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no tag");
-  if ( fread(&alphatype,         sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no alphatype");
-  if ( fread(&(dd->flags),       sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no flags");
-  if ( fread(&(dd->max_namelen), sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max name len");
-  if ( fread(&(dd->max_acclen),  sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max accession len");
-  if ( fread(&(dd->max_desclen), sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max description len");
-
-  if ( fread(&(dd->max_seqlen),  sizeof(uint64_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max seq len");
-  if ( fread(&(dd->nseq),        sizeof(uint64_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no nseq");
-  if ( fread(&(dd->nres),        sizeof(uint64_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no nres");
-
-  /* Check the magic and the tag */
-  if      (tag != dd->uniquetag)                 ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has bad tag, doesn't go with stub file");
-  // Eventually we would set dd->do_byteswap = TRUE; below.
-  if      (dd->magic == eslDSQDATA_MAGIC_V1SWAP) ESL_XEXCEPTION(eslEUNIMPLEMENTED, "dsqdata cannot yet read data in different byte orders");
-  else if (dd->magic != eslDSQDATA_MAGIC_V1)     ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has bad magic");
-
-  /* Either validate, or create the alphabet */
-  if  (dd->abc_r)
-    {
-      if (alphatype != dd->abc_r->type) 
-	ESL_XFAIL(eslEFORMAT, dd->errbuf, "data files use %s alphabet; expected %s alphabet", 
-		  esl_abc_DecodeType(alphatype), 
-		  esl_abc_DecodeType(dd->abc_r->type));
-    }
-  else
-    {
-      if ( esl_abc_ValidateType(alphatype)             != eslOK) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has invalid alphabet type %d", alphatype);
-      if (( dd->abc_r = esl_alphabet_Create(alphatype)) == NULL) ESL_XEXCEPTION(eslEMEM, "alphabet creation failed");
-    }
-
-  /* If it's protein, flip the switch to expect all 5-bit packing */
-  if (dd->abc_r->type == eslAMINO) dd->pack5 = TRUE;
-
-  /* Metadata file has a header of 2 uint32's, magic and uniquetag */
-  if (( fread(&magic, sizeof(uint32_t), 1, dd->mfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file has no header - is empty?");
-  if (( fread(&tag,   sizeof(uint32_t), 1, dd->mfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file header truncated - no tag?");
-  if ( magic != dd->magic)                                 ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file has bad magic");
-  if ( tag   != dd->uniquetag)                             ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file has bad tag, doesn't match stub");
 
-  /* Sequence file also has a header of 2 uint32's, magic and uniquetag */
-  if (( fread(&magic, sizeof(uint32_t), 1, dd->sfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file has no header - is empty?");
-  if (( fread(&tag,   sizeof(uint32_t), 1, dd->sfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file header truncated - no tag?");
-  if ( magic != dd->magic)                                 ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file has bad magic");
-  if ( tag   != dd->uniquetag)                             ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file has bad tag, doesn't match stub");
+  if (( status = dsqdata_open_files(byp_abc, basename, &dd)) != eslOK) goto ERROR;
+  if (( status = dsqdata_set_range(dd, cfg))                  != eslOK) goto ERROR;
+  dd->nconsumers  = nconsumers;
+  dd->n_unpackers = (cfg ? cfg->n_unpackers : eslDSQDATA_UNPACKERS);
+  if (dd->n_unpackers < 1) ESL_XEXCEPTION(eslEINVAL, "dsqdata reader needs at least one unpacker");
+
+  ESL_ALLOC(dd->inbox,        sizeof(ESL_DSQDATA_CHUNK *) * dd->n_unpackers);
+  ESL_ALLOC(dd->inbox_mutex,  sizeof(pthread_mutex_t)     * dd->n_unpackers);
+  ESL_ALLOC(dd->inbox_cv,     sizeof(pthread_cond_t)      * dd->n_unpackers);
+  ESL_ALLOC(dd->inbox_eod,    sizeof(int)                 * dd->n_unpackers);
+  ESL_ALLOC(dd->outbox,       sizeof(ESL_DSQDATA_CHUNK *) * dd->n_unpackers);
+  ESL_ALLOC(dd->outbox_mutex, sizeof(pthread_mutex_t)     * dd->n_unpackers);
+  ESL_ALLOC(dd->outbox_cv,    sizeof(pthread_cond_t)      * dd->n_unpackers);
+  ESL_ALLOC(dd->outbox_eod,   sizeof(int)                 * dd->n_unpackers);
+  ESL_ALLOC(dd->unpacker_t,   sizeof(pthread_t)           * dd->n_unpackers);
+  ESL_ALLOC(dd->unpack_nres,  sizeof(int64_t)             * dd->n_unpackers);
+  ESL_ALLOC(dd->unpack_time,  sizeof(double)              * dd->n_unpackers);
 
   /* unpacker inboxes and outboxes */
   for (u = 0; u < dd->n_unpackers; u++)
@@ -288,6 +286,9 @@ esl_dsqdata_Open(ESL_ALPHABET **byp_abc, char *basename, int nconsumers, ESL_DSQ
       if ( pthread_mutex_init(&(dd->outbox_mutex[u]),  NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init() failed");
       if ( pthread_cond_init (&(dd->outbox_cv[u]),     NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init() failed");     
       dd->outbox_eod[u] = FALSE;
+
+      dd->unpack_nres[u] = 0;
+      dd->unpack_time[u] = 0.;
     }
 
   /* consumers share access to <nchunk> counter */
@@ -336,21 +337,174 @@ esl_dsqdata_Open(ESL_ALPHABET **byp_abc, char *basename, int nconsumers, ESL_DSQ
     }
   else if (status != eslESYS)
     {   /* on most exceptions, we free <dd>, return it NULL, don't change *byp_abc */
+      if (dd && *byp_abc == NULL && dd->abc_r) esl_alphabet_Destroy(dd->abc_r);
       esl_dsqdata_Close(dd);
       *ret_dd = NULL;
-      if (*byp_abc == NULL && dd->abc_r) esl_alphabet_Destroy(dd->abc_r);
       return status;
     }
   else
     { /* on eslESYS exceptions - pthread initializations failing - we can't assume we can _Close() correctly. */
       *ret_dd = NULL;
-      if (*byp_abc == NULL && dd->abc_r) esl_alphabet_Destroy(dd->abc_r);
+      if (dd && *byp_abc == NULL && dd->abc_r) esl_alphabet_Destroy(dd->abc_r);
       return status;
     }
 }
 
 
 
+/* Function:  esl_dsqdata_OpenMapped()
+ * Synopsis:  Open a digital sequence database as a memory-mapped reader
+ *
+ * Purpose:   Open dsqdata database <basename> for reading, like
+ *            <esl_dsqdata_Open()>, but memory-map the index, metadata,
+ *            and sequence files instead of starting a loader thread to
+ *            <fread()> them. Chunks returned by <esl_dsqdata_Read()>
+ *            have their packed sequence <psq> and their <metadata>
+ *            (and thus the <name>, <acc>, <desc> pointers) pointing
+ *            straight into the mapped pages; only the unpacked <dsq>
+ *            data are written, by the consumer thread that calls
+ *            <esl_dsqdata_Read()>.
+ *
+ *            This is advantageous when the database is already (or
+ *            will be) resident in the page cache: it saves a copy of
+ *            every byte, and several processes reading the same
+ *            database share one copy of it in memory. Caller can use
+ *            any number of consumer threads; each one does its own
+ *            unpacking, so unpacking parallelizes with the consumers.
+ *            Chunks are the same as in the threaded reader.
+ *
+ *            <byp_abc> follows the same partial bypass idiom as
+ *            <esl_dsqdata_Open()>.
+ *
+ * Args:      byp_abc  : expected or created alphabet; pass &abc, abc=NULL or abc=expected alphabet
+ *            basename : data are in files <basename> and <basename.dsq[ism]>
+ *            ret_dd   : RETURN : the new ESL_DSQDATA object.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if one or more of the expected datafiles
+ *            aren't there or can't be opened.
+ *
+ *            <eslEFORMAT> if something looks wrong in parsing file
+ *            formats, including data files that are truncated
+ *            relative to what the index says they contain.
+ *
+ *            On these normal errors, <*ret_dd> is returned in an
+ *            error state with a user-directed message in
+ *            <dd->errbuf>, as in <esl_dsqdata_Open()>.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslESYS> on system call failure, including <mmap()>.
+ *            <eslEUNIMPLEMENTED> if data are byteswapped, or if
+ *              this system doesn't have POSIX <mmap()>.
+ *
+ *            On any thrown exception, <*ret_dd> is returned NULL.
+ */
+int
+esl_dsqdata_OpenMapped(ESL_ALPHABET **byp_abc, char *basename, ESL_DSQDATA **ret_dd)
+{
+  return esl_dsqdata_OpenMapped_adv(NULL, byp_abc, basename, ret_dd);
+}
+
+
+/* Function:  esl_dsqdata_OpenMapped_adv()
+ * Synopsis:  Open a memory-mapped reader, with custom configuration
+ *
+ * Purpose:   Same as <esl_dsqdata_OpenMapped()>, but with
+ *            configuration options <cfg>, as in
+ *            <esl_dsqdata_Open_adv()>. The mapped reader has no
+ *            unpacker threads, so <cfg->n_unpackers> is ignored;
+ *            the sequence range <cfg->i0..cfg->i1-1> is honored.
+ *
+ * Returns:   (as <esl_dsqdata_OpenMapped()>)
+ *
+ * Throws:    (as <esl_dsqdata_OpenMapped()>), and <eslEINVAL> if
+ *            the range <cfg->i0..cfg->i1-1> isn't within the database.
+ */
+int
+esl_dsqdata_OpenMapped_adv(const ESL_DSQDATA_CFG *cfg, ESL_ALPHABET **byp_abc, char *basename, ESL_DSQDATA **ret_dd)
+{
+#ifdef _POSIX_VERSION
+  ESL_DSQDATA        *dd = NULL;
+  struct stat         fileinfo;
+  ESL_DSQDATA_RECORD  last;
+  int                 status;
+
+  ESL_DASSERT1(( byp_abc  != NULL ));
+
+  if (( status = dsqdata_open_files(byp_abc, basename, &dd)) != eslOK) goto ERROR;
+  if (( status = dsqdata_set_range(dd, cfg))                  != eslOK) goto ERROR;
+  dd->is_mapped = TRUE;
+
+  if ( fstat(fileno(dd->ifp), &fileinfo) == -1) ESL_XEXCEPTION_SYS(eslESYS, "fstat() failed on index file");
+  dd->isize  = fileinfo.st_size;
+  if ( fstat(fileno(dd->sfp), &fileinfo) == -1) ESL_XEXCEPTION_SYS(eslESYS, "fstat() failed on sequence file");
+  dd->ssize  = fileinfo.st_size;
+  if ( fstat(fileno(dd->mfp), &fileinfo) == -1) ESL_XEXCEPTION_SYS(eslESYS, "fstat() failed on metadata file");
+  dd->mdsize = fileinfo.st_size;
+
+  /* We index directly into the maps, so make sure they're as big as
+   * the index says they are; a truncated file would otherwise be a
+   * SIGBUS when we touch a missing page.
+   */
+  if (dd->isize != eslDSQDATA_IHDRSIZE + dd->nseq * sizeof(ESL_DSQDATA_RECORD))
+    ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has wrong size for %" PRIu64 " sequences", dd->nseq);
+
+  /*       mmap(addr, len,        prot,      flags,       fd,              offset */
+  dd->imap  = mmap(0,  dd->isize,  PROT_READ, MAP_SHARED, fileno(dd->ifp), 0);
+  if (dd->imap  == MAP_FAILED) { dd->imap  = NULL; ESL_XEXCEPTION_SYS(eslESYS, "mmap() failed on index file");    }
+  dd->smap  = mmap(0,  dd->ssize,  PROT_READ, MAP_SHARED, fileno(dd->sfp), 0);
+  if (dd->smap  == MAP_FAILED) { dd->smap  = NULL; ESL_XEXCEPTION_SYS(eslESYS, "mmap() failed on sequence file"); }
+  dd->mdmap = mmap(0,  dd->mdsize, PROT_READ, MAP_SHARED, fileno(dd->mfp), 0);
+  if (dd->mdmap == MAP_FAILED) { dd->mdmap = NULL; ESL_XEXCEPTION_SYS(eslESYS, "mmap() failed on metadata file"); }
+
+  /* Hint that we're going to sweep the data files front to back. Just advice; ignore failure. */
+  (void) posix_madvise(dd->smap,  dd->ssize,  POSIX_MADV_SEQUENTIAL);
+  (void) posix_madvise(dd->mdmap, dd->mdsize, POSIX_MADV_SEQUENTIAL);
+
+  if (dd->nseq > 0)
+    {
+      memcpy(&last, dd->imap + eslDSQDATA_IHDRSIZE + (dd->nseq-1) * sizeof(ESL_DSQDATA_RECORD), sizeof(ESL_DSQDATA_RECORD));
+      if (dd->ssize  < dd->shdrsize       + (last.psq_end + 1) * sizeof(uint32_t)) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file is truncated");
+      if (dd->mdsize < eslDSQDATA_HDRSIZE + (last.metadata_end + 1))               ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file is truncated");
+    }
+
+  /* Consumers share the <next_i>, <nchunk> cursor; Recycle() and Close() use the recycling stack. 
+   * No threads to start, so we're immediately good to go.
+   */
+  dd->nchunk    = 0;
+  dd->recycling = NULL;
+  if ( pthread_mutex_init(&dd->nchunk_mutex,    NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init() failed");      
+  if ( pthread_mutex_init(&dd->recycling_mutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init() failed");      
+  if ( pthread_cond_init(&dd->recycling_cv,     NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init() failed");     
+  if ( pthread_mutex_init(&dd->go_mutex,        NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init() failed on go_mutex");    
+  if ( pthread_cond_init( &dd->go_cv,           NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init() failed on go_cv");    
+  dd->go = TRUE;
+
+  *ret_dd  = dd;
+  *byp_abc = dd->abc_r;
+  return eslOK;
+
+ ERROR:
+  if (status == eslENOTFOUND || status == eslEFORMAT || status == eslEINCOMPAT)
+    {  
+      *ret_dd  = dd;
+      if (*byp_abc == NULL && dd->abc_r) esl_alphabet_Destroy(dd->abc_r);
+      return status;
+    }
+  else
+    { 
+      if (dd && *byp_abc == NULL && dd->abc_r) esl_alphabet_Destroy(dd->abc_r);
+      if (status != eslESYS) esl_dsqdata_Close(dd);
+      *ret_dd = NULL;
+      return status;
+    }
+#else
+  ESL_EXCEPTION(eslEUNIMPLEMENTED, "esl_dsqdata_OpenMapped() requires POSIX mmap()");
+#endif /*_POSIX_VERSION*/
+}
+
+
 /* Function:  esl_dsqdata_Read()
  * Synopsis:  Read next chunk of sequence data.
  * Incept:    SRE, Thu Jan 21 11:21:38 2016 [Harvard]
@@ -389,9 +543,13 @@ int
 esl_dsqdata_Read(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK **ret_chu)
 {
   ESL_DSQDATA_CHUNK *chu    = NULL;
+  ESL_STOPWATCH      w;
   int                u;
 
+  if (dd->is_mapped) return dsqdata_read_mapped(dd, ret_chu);
+
   /* First, determine which slot the next chunk is in, using the consumer-shared <nchunk> counter */
+  esl_stopwatch_Start(&w);
   if ( pthread_mutex_lock(&dd->nchunk_mutex) != 0) ESL_EXCEPTION(eslESYS, "failed to lock reader mutex");
   u = (int) (dd->nchunk % dd->n_unpackers);
 
@@ -400,6 +558,8 @@ esl_dsqdata_Read(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK **ret_chu)
   while (! dd->outbox_eod[u]  && dd->outbox[u] == NULL)  {                                                  
     if ( pthread_cond_wait(&(dd->outbox_cv[u]), &(dd->outbox_mutex[u])) != 0) ESL_EXCEPTION(eslESYS, "failed to wait on outbox[u] signal");
   }
+  esl_stopwatch_Stop(&w);
+  dd->consumer_wait += w.elapsed;   // we hold <nchunk_mutex>
 
   /* Get the chunk from outbox. */
   chu           = dd->outbox[u]; 
@@ -410,7 +570,7 @@ esl_dsqdata_Read(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK **ret_chu)
   if (        pthread_mutex_unlock(&(dd->outbox_mutex[u])) != 0) ESL_EXCEPTION(eslESYS, "failed to unlock outbox[u] mutex");
   if ( chu && pthread_cond_signal (&(dd->outbox_cv[u]))    != 0) ESL_EXCEPTION(eslESYS, "failed to signal outbox[u] is empty");
 
-  /* Release the reader lock that protects dd->nchunk counter */
+  /* Release the reader lock that protects dd->nchunk counter (and consumer_wait) */
   if ( pthread_mutex_unlock(&dd->nchunk_mutex) != 0) ESL_EXCEPTION(eslESYS, "failed to unlock reader mutex");
   
   *ret_chu = chu;
@@ -489,250 +649,1554 @@ esl_dsqdata_Recycle(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK *chu)
 int
 esl_dsqdata_Close(ESL_DSQDATA *dd)
 {
-  int u;
+  ESL_DSQDATA_CHUNK *chu;
+  int                u;
 
   if (dd)
     {
       /* out of abundance of caution - wait for threads to join before breaking down <dd> */
-      if ( pthread_join(dd->loader_t,   NULL)      != 0)  ESL_EXCEPTION(eslESYS, "pthread join failed");          
-      for (u = 0; u < dd->n_unpackers; u++)
-	if ( pthread_join(dd->unpacker_t[u], NULL) != 0)  ESL_EXCEPTION(eslESYS, "pthread join failed");          
+      if (dd->go && ! dd->is_mapped)
+	{
+	  if ( pthread_join(dd->loader_t,   NULL)      != 0)  ESL_EXCEPTION(eslESYS, "pthread join failed");          
+	  for (u = 0; u < dd->n_unpackers; u++)
+	    if ( pthread_join(dd->unpacker_t[u], NULL) != 0)  ESL_EXCEPTION(eslESYS, "pthread join failed");          
+	}
+
+      /* In the mapped reader, there's no loader to free the chunks;
+       * they've all been recycled (if the caller played by the rules),
+       * and we free them here. Their <metadata> is a ptr into <mdmap>, not
+       * an allocation.
+       */
+      if (dd->is_mapped)
+	{
+	  while ((chu = dd->recycling) != NULL)
+	    {
+	      dd->recycling = chu->nxt;
+	      chu->metadata = NULL;
+	      dsqdata_chunk_Destroy(chu);
+	    }
+	}
 
+#ifdef _POSIX_VERSION
+      if (dd->imap)  { if ( munmap(dd->imap,  dd->isize)  != 0) ESL_EXCEPTION(eslESYS, "munmap failed"); }
+      if (dd->smap)  { if ( munmap(dd->smap,  dd->ssize)  != 0) ESL_EXCEPTION(eslESYS, "munmap failed"); }
+      if (dd->mdmap) { if ( munmap(dd->mdmap, dd->mdsize) != 0) ESL_EXCEPTION(eslESYS, "munmap failed"); }
+#endif
       if (dd->basename) free(dd->basename);
+      if (dd->hlut)     free(dd->hlut);
+      esl_huffman_Destroy(dd->hc);
       if (dd->stubfp) { if ( fclose(dd->stubfp) != 0) ESL_EXCEPTION(eslESYS, "fclose failed"); }
       if (dd->ifp)    { if ( fclose(dd->ifp)    != 0) ESL_EXCEPTION(eslESYS, "fclose failed"); }
       if (dd->sfp)    { if ( fclose(dd->sfp)    != 0) ESL_EXCEPTION(eslESYS, "fclose failed"); }
       if (dd->mfp)    { if ( fclose(dd->mfp)    != 0) ESL_EXCEPTION(eslESYS, "fclose failed"); }
 
-      for (u = 0; u < dd->n_unpackers; u++)
+      /* If <go> isn't up, Open() failed before it initialized the pthreads machinery. */
+      if (dd->go)
 	{
-	  if ( pthread_mutex_destroy(&(dd->inbox_mutex[u]))  != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
-	  if ( pthread_cond_destroy(&(dd->inbox_cv[u]))      != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed");  
-	  if ( pthread_mutex_destroy(&(dd->outbox_mutex[u])) != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
-	  if ( pthread_cond_destroy(&(dd->outbox_cv[u]))     != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed"); 
+	  for (u = 0; u < dd->n_unpackers; u++)
+	    {
+	      if ( pthread_mutex_destroy(&(dd->inbox_mutex[u]))  != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
+	      if ( pthread_cond_destroy(&(dd->inbox_cv[u]))      != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed");  
+	      if ( pthread_mutex_destroy(&(dd->outbox_mutex[u])) != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
+	      if ( pthread_cond_destroy(&(dd->outbox_cv[u]))     != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed"); 
+	    }
+	  if ( pthread_mutex_destroy(&dd->nchunk_mutex)          != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
+	  if ( pthread_mutex_destroy(&dd->recycling_mutex)       != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
+	  if ( pthread_cond_destroy(&dd->recycling_cv)           != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed");  
+	  if ( pthread_mutex_destroy(&dd->go_mutex)              != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
+	  if ( pthread_cond_destroy(&dd->go_cv)                  != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed");  
 	}
-      if ( pthread_mutex_destroy(&dd->nchunk_mutex)          != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
-      if ( pthread_mutex_destroy(&dd->recycling_mutex)       != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
-      if ( pthread_cond_destroy(&dd->recycling_cv)           != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed");  
-      if ( pthread_mutex_destroy(&dd->go_mutex)              != 0)  ESL_EXCEPTION(eslESYS, "pthread mutex destroy failed"); 
-      if ( pthread_cond_destroy(&dd->go_cv)                  != 0)  ESL_EXCEPTION(eslESYS, "pthread cond destroy failed");  
 
       /* Loader thread is responsible for freeing all chunks it created, even on error. */
 #if (eslDEBUGLEVEL >= 1)
-      for (u = 0; u < dd->n_unpackers; u++) {
-	assert( dd->inbox[u]  == NULL );
-	assert( dd->outbox[u] == NULL );
+      if (dd->go) {
+	for (u = 0; u < dd->n_unpackers; u++) {
+	  assert( dd->inbox[u]  == NULL );
+	  assert( dd->outbox[u] == NULL );
+	}
+	assert(dd->recycling == NULL );
       }
-      assert(dd->recycling == NULL );
 #endif
+      if (dd->inbox)        free(dd->inbox);
+      if (dd->inbox_mutex)  free(dd->inbox_mutex);
+      if (dd->inbox_cv)     free(dd->inbox_cv);
+      if (dd->inbox_eod)    free(dd->inbox_eod);
+      if (dd->outbox)       free(dd->outbox);
+      if (dd->outbox_mutex) free(dd->outbox_mutex);
+      if (dd->outbox_cv)    free(dd->outbox_cv);
+      if (dd->outbox_eod)   free(dd->outbox_eod);
+      if (dd->unpacker_t)   free(dd->unpacker_t);
+      if (dd->unpack_nres)  free(dd->unpack_nres);
+      if (dd->unpack_time)  free(dd->unpack_time);
       free(dd);
     }
   return eslOK;
 }
 
 
-/*****************************************************************
- *# 2. Creating dsqdata format from a sequence file
- *****************************************************************/
 
-/* Function:  esl_dsqdata_Write()
- * Synopsis:  Create a dsqdata database
- * Incept:    SRE, Sat Feb 13 07:33:30 2016 [AGBT 2016, Orlando]
- *
- * Purpose:   Caller has just opened <sqfp>, in digital mode.
- *            Create a dsqdata database <basename> from the sequence
- *            data in <sqfp>.
+/* Function:  esl_dsqdata_Fetch()
+ * Synopsis:  Fetch one sequence by its index.
  *
- *            <sqfp> must be protein, DNA, or RNA sequence data.  It
- *            must be rewindable (i.e. a file), because we have to
- *            read it twice. It must be newly opened (i.e. positioned
- *            at the start).
+ * Purpose:   Fetch sequence number <i> (0..nseq-1) of the database
+ *            that <dd> is open on, into <sq>: its name, accession,
+ *            description, taxonomy id, and digital sequence. <sq> is
+ *            a digital sequence object, new or <esl_sq_Reuse()>'d,
+ *            created with the reader's alphabet. <sq->idx> is set
+ *            to <i>.
  *
- * Args:      sqfp     - newly opened sequence data file
- *            basename - base name of dsqdata files to create
- *            errbuf   - user-directed error message on normal errors
+ *            Random access uses the index's per-sequence offsets to
+ *            read only the one sequence's data. It works with either
+ *            kind of reader, regardless of the range that the reader
+ *            was opened on, and doesn't disturb chunk reading with
+ *            <esl_dsqdata_Read()>: for example, consumers can
+ *            fetch sequences (or their metadata, with
+ *            <esl_dsqdata_FetchInfo()>) while reading continues.
+ *            Fetches are threadsafe, except that they share
+ *            <dd->errbuf> for error messages.
  *
  * Returns:   <eslOK> on success.
- *           
- *            <eslEWRITE> if an output file can't be opened. <errbuf>
- *            contains user-directed error message.
  *
- *            <eslEFORMAT> if a parse error is encountered while
- *            reading <sqfp>.
- * 
+ *            <eslENOTFOUND> if <i> is not a sequence index in the
+ *            database. <eslEFORMAT> if the data files are corrupt
+ *            or truncated. On these normal errors, <dd->errbuf>
+ *            has a user-directed message, and <sq> may have been
+ *            partially altered.
  *
- * Throws:    <eslESYS>   A system call failed, such as fwrite().
- *            <eslEINVAL> Sequence handle <sqfp> isn't digital and rewindable.
- *            <eslEMEM>   Allocation failure
- *            <eslEUNIMPLEMENTED> Sequence is too long to be encoded.
- *                               (TODO: chromosome-scale DNA sequences)
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslESYS> if a <pread()> fails.
+ *            <eslEINVAL> if <sq> isn't digital.
+ *            <eslEUNIMPLEMENTED> if this system doesn't have POSIX <pread()>.
  */
 int
-esl_dsqdata_Write(ESL_SQFILE *sqfp, char *basename, char *errbuf)
+esl_dsqdata_Fetch(ESL_DSQDATA *dd, int64_t i, ESL_SQ *sq)
 {
-  ESL_RANDOMNESS *rng         = NULL;
-  ESL_SQ         *sq          = NULL;
-  FILE           *stubfp      = NULL;
-  FILE           *ifp         = NULL;
-  FILE           *mfp         = NULL;
-  FILE           *sfp         = NULL;
-  char           *outfile     = NULL;
-  uint32_t        magic       = eslDSQDATA_MAGIC_V1;
-  uint32_t        uniquetag;
-  uint32_t        alphatype;
-  uint32_t        flags       = 0;
-  uint32_t        max_namelen = 0;
-  uint32_t        max_acclen  = 0;
-  uint32_t        max_desclen = 0;
-  uint64_t        max_seqlen  = 0;
-  uint64_t        nseq        = 0;
-  uint64_t        nres        = 0;
-  int             do_pack5    = FALSE;
-  uint32_t       *psq;
-  ESL_DSQDATA_RECORD idx;                    // one index record to write
-  int             plen;
-  int64_t         spos        = 0;
-  int64_t         mpos        = 0;
-  int             n;
-  int             status;
-
-  if (! esl_sqfile_IsRewindable(sqfp))  ESL_EXCEPTION(eslEINVAL, "sqfp must be rewindable (e.g. an open file)");
-  if (! sqfp->abc)                      ESL_EXCEPTION(eslEINVAL, "sqfp must be digital");
-  // Could also check that it's positioned at the start.
-  if ( (sq = esl_sq_CreateDigital(sqfp->abc)) == NULL) { status = eslEMEM; goto ERROR; }
-
-  /* First pass over the sequence file, to get statistics.
-   * Read it now, before opening any files, in case we find any parse errors.
-   */
-  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
-    {
-      if (sq->n >= 6 * eslDSQDATA_CHUNK_MAXPACKET)  // guaranteed limit
-	ESL_EXCEPTION(eslEUNIMPLEMENTED, "dsqdata cannot currently deal with large sequences");
-
-      nseq++;
-      nres += sq->n;
-      if (sq->n > max_seqlen) max_seqlen = sq->n;
-      n = strlen(sq->name); if (n > max_namelen) max_namelen = n;
-      n = strlen(sq->acc);  if (n > max_acclen)  max_acclen  = n;
-      n = strlen(sq->desc); if (n > max_desclen) max_desclen = n;
-      esl_sq_Reuse(sq);
-    }
-  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, sqfp->get_error(sqfp));
-  else if (status != eslEOF)     return status;
-
-  if ((status = esl_sqfile_Position(sqfp, 0)) != eslOK) return status;
+  return dsqdata_fetch(dd, i, TRUE, sq);
+}
 
 
-  if ((    rng = esl_randomness_Create(0) )        == NULL)  { status = eslEMEM; goto ERROR; }
-  uniquetag = esl_random_uint32(rng);
-  alphatype = sqfp->abc->type;
+/* Function:  esl_dsqdata_FetchInfo()
+ * Synopsis:  Fetch one sequence's metadata by its index.
+ *
+ * Purpose:   Same as <esl_dsqdata_Fetch()>, but only fetch the
+ *            metadata for sequence <i>: name, accession, description,
+ *            and taxonomy id. No sequence data are read: <sq->n> is
+ *            0 and the sequence length <sq->L> is -1 (unknown).
+ *
+ *            This is the deferred metadata read that the dsqdata
+ *            format is designed for: process sequences by index first,
+ *            and look up names and descriptions only for the few that
+ *            turn out to be of interest.
+ *
+ * Returns:   (as <esl_dsqdata_Fetch()>)
+ *
+ * Throws:    (as <esl_dsqdata_Fetch()>)
+ */
+int
+esl_dsqdata_FetchInfo(ESL_DSQDATA *dd, int64_t i, ESL_SQ *sq)
+{
+  return dsqdata_fetch(dd, i, FALSE, sq);
+}
 
-  if      (alphatype == eslAMINO)                      do_pack5 = TRUE;
-  else if (alphatype != eslDNA && alphatype != eslRNA) ESL_EXCEPTION(eslEINVAL, "alphabet must be protein or nucleic");
 
 
-  if (( status = esl_sprintf(&outfile, "%s.dsqi", basename)) != eslOK) goto ERROR;
-  if ((    ifp = fopen(outfile, "wb"))             == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata index file %s for writing", outfile);
-  sprintf(outfile, "%s.dsqm", basename);
-  if ((    mfp = fopen(outfile, "wb"))             == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata metadata file %s for writing", outfile);
-  sprintf(outfile, "%s.dsqs", basename);
-  if ((    sfp = fopen(outfile, "wb"))             == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata sequence file %s for writing", outfile);
-  if (( stubfp = fopen(basename, "w"))             == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata stub file %s for writing", basename);
+/* Function:  esl_dsqdata_cfg_Create()
+ * Synopsis:  Create configuration options for esl_dsqdata_Open_adv()
+ *
+ * Purpose:   Create and return a new <ESL_DSQDATA_CFG>, with all
+ *            options set to their defaults. Caller changes what it
+ *            wants to and passes it to <esl_dsqdata_Open_adv()>.
+ *
+ * Returns:   ptr to the new <ESL_DSQDATA_CFG>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+ESL_DSQDATA_CFG *
+esl_dsqdata_cfg_Create(void)
+{
+  ESL_DSQDATA_CFG *cfg = NULL;
+  int              status;
 
+  ESL_ALLOC(cfg, sizeof(ESL_DSQDATA_CFG));
+  cfg->n_unpackers = eslDSQDATA_UNPACKERS;
+  cfg->i0          = 0;
+  cfg->i1          = -1;
 
-  
+ ERROR:
+  return cfg;
+}
 
-  /* Header: index file */
-  if (fwrite(&magic,       sizeof(uint32_t), 1, ifp) != 1 ||
-      fwrite(&uniquetag,   sizeof(uint32_t), 1, ifp) != 1 ||
-      fwrite(&alphatype,   sizeof(uint32_t), 1, ifp) != 1 ||
-      fwrite(&flags,       sizeof(uint32_t), 1, ifp) != 1 ||
-      fwrite(&max_namelen, sizeof(uint32_t), 1, ifp) != 1 ||
-      fwrite(&max_acclen,  sizeof(uint32_t), 1, ifp) != 1 ||
-      fwrite(&max_desclen, sizeof(uint32_t), 1, ifp) != 1 ||
-      fwrite(&max_seqlen,  sizeof(uint64_t), 1, ifp) != 1 ||
-      fwrite(&nseq,        sizeof(uint64_t), 1, ifp) != 1 ||
-      fwrite(&nres,        sizeof(uint64_t), 1, ifp) != 1) 
-    ESL_XEXCEPTION_SYS(eslESYS, "fwrite() failed, index file header");
-
-  /* Header: metadata file */
-  if (fwrite(&magic,       sizeof(uint32_t), 1, mfp) != 1 ||
-      fwrite(&uniquetag,   sizeof(uint32_t), 1, mfp) != 1)
-    ESL_XEXCEPTION_SYS(eslESYS, "fwrite() failed, metadata file header");
+/* Function:  esl_dsqdata_cfg_Destroy()
+ * Synopsis:  Destroy an <ESL_DSQDATA_CFG>
+ */
+void
+esl_dsqdata_cfg_Destroy(ESL_DSQDATA_CFG *cfg)
+{
+  free(cfg);
+}
 
-  /* Header: sequence file */
-  if (fwrite(&magic,       sizeof(uint32_t), 1, sfp) != 1 ||
-      fwrite(&uniquetag,   sizeof(uint32_t), 1, sfp) != 1)
-    ESL_XEXCEPTION_SYS(eslESYS, "fwrite() failed, metadata file header");
 
-  /* Second pass: index, metadata, and sequence files */
-  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+/* Function:  esl_dsqdata_GetStats()
+ * Synopsis:  Get per-stage accounting of the input pipeline.
+ *
+ * Purpose:   Collect the reader's accounting of its loader, unpacker,
+ *            and consumer stages in <ret_stats>: how many bytes the
+ *            loader read and how long it spent reading them, how long
+ *            it waited for consumers to recycle chunks, how many
+ *            residues the unpackers unpacked and how long they spent
+ *            doing it, and how long consumers waited in
+ *            <esl_dsqdata_Read()> for chunks to arrive.
+ *
+ *            If the loader waits on the consumers, the consumers are
+ *            rate-limiting, and reading is as fast as it needs to be.
+ *            If consumers wait, input is rate-limiting; compare
+ *            loader MB/sec to disk bandwidth, and unpacker
+ *            residues/sec (times <n_unpackers>) to what the consumers
+ *            can process, to see whether more unpackers will help.
+ *
+ *            In a memory-mapped reader, there's no loader; data are
+ *            paged in while consumers unpack, so the unpacking time
+ *            includes disk time, and <load_time> and <load_wait> are 0.
+ *
+ *            Call this after the last <esl_dsqdata_Read()> has
+ *            returned <eslEOF>. While the reader is active, the
+ *            counts are a snapshot that may be inconsistent.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_dsqdata_GetStats(ESL_DSQDATA *dd, ESL_DSQDATA_STATS *ret_stats)
+{
+  int u;
+
+  ret_stats->nchunk        = dd->nchunk;
+  ret_stats->load_bytes    = dd->load_bytes;
+  ret_stats->load_time     = dd->load_time;
+  ret_stats->load_wait     = dd->load_wait;
+  ret_stats->unpack_nres   = dd->mapped_nres;
+  ret_stats->unpack_time   = dd->mapped_time;
+  ret_stats->consumer_wait = dd->consumer_wait;
+  for (u = 0; u < dd->n_unpackers; u++)
+    {
+      ret_stats->unpack_nres += dd->unpack_nres[u];
+      ret_stats->unpack_time += dd->unpack_time[u];
+    }
+  return eslOK;
+}
+
+
+/* Function:  esl_dsqdata_DumpStats()
+ * Synopsis:  Print per-stage accounting of the input pipeline.
+ *
+ * Purpose:   Print a summary of <esl_dsqdata_GetStats()> for reader
+ *            <dd> to stream <fp>, including per-stage throughput:
+ *            loader MB/sec, and unpacker Mres/sec per thread.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on a write failure, such as a full disk.
+ */
+int
+esl_dsqdata_DumpStats(FILE *fp, ESL_DSQDATA *dd)
+{
+  ESL_DSQDATA_STATS st;
+
+  esl_dsqdata_GetStats(dd, &st);
+
+  if (fprintf(fp, "# reader:           %s (%s)\n", dd->basename, dd->is_mapped ? "memory-mapped" : "threaded") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed");
+  if (fprintf(fp, "# unpackers:        %d\n", dd->n_unpackers)                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed");
+  if (fprintf(fp, "# chunks:           %" PRId64 "\n", st.nchunk)                                               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed");
+  if (fprintf(fp, "# loaded:           %.1f MB in %.3f sec",  (double) st.load_bytes / 1e6, st.load_time)      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed");
+  if (st.load_time > 0.) 
+    { if (fprintf(fp, " (%.1f MB/sec)", (double) st.load_bytes / 1e6 / st.load_time)                         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed"); }
+  if (fprintf(fp, "\n# loader waited:    %.3f sec for recycled chunks\n", st.load_wait)                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed");
+  if (fprintf(fp, "# unpacked:         %" PRId64 " residues in %.3f thread-sec", st.unpack_nres, st.unpack_time) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed");
+  if (st.unpack_time > 0.) 
+    { if (fprintf(fp, " (%.1f Mres/sec/thread)", (double) st.unpack_nres / 1e6 / st.unpack_time)             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed"); }
+  if (fprintf(fp, "\n# consumers waited: %.3f thread-sec in Read()\n", st.consumer_wait)                       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "dsqdata stats write failed");
+  return eslOK;
+}
+
+
+/* dsqdata_set_range()
+ * 
+ * Set the range of sequences [range_i0, range_i1) that reader <dd>
+ * will read, from <cfg>, or the whole database if <cfg> is NULL.
+ * Must be called after the index header is read (we need <nseq>)
+ * and before any reading starts.
+ *
+ * Throws <eslEINVAL> if the range isn't within 0..nseq.
+ */
+static int
+dsqdata_set_range(ESL_DSQDATA *dd, const ESL_DSQDATA_CFG *cfg)
+{
+  dd->range_i0 = (cfg ? cfg->i0 : 0);
+  dd->range_i1 = ((cfg && cfg->i1 >= 0) ? cfg->i1 : (int64_t) dd->nseq);
+  if (dd->range_i0 < 0 || dd->range_i0 > dd->range_i1 || dd->range_i1 > (int64_t) dd->nseq)
+    ESL_EXCEPTION(eslEINVAL, "sequence range %" PRId64 "..%" PRId64 " isn't within database's 0..%" PRIu64, dd->range_i0, dd->range_i1, dd->nseq);
+  dd->next_i = dd->range_i0;
+  return eslOK;
+}
+
+
+/* dsqdata_fetch()
+ * 
+ * esl_dsqdata_Fetch() (<do_seq> TRUE) and esl_dsqdata_FetchInfo()
+ * (<do_seq> FALSE). Reads index records i-1 and i for the offsets of
+ * sequence <i>'s metadata and packets; reads its metadata into a
+ * temporary buffer, and its packets into the end of <sq->dsq>, to
+ * be unpacked in place just as the unpackers do in a chunk.
+ */
+static int
+dsqdata_fetch(ESL_DSQDATA *dd, int64_t i, int do_seq, ESL_SQ *sq)
+{
+#ifdef _POSIX_VERSION
+  ESL_DSQDATA_RECORD rec[2];                // records for i-1, i
+  int64_t            psq_last  = -1;        // psq_end for record i-1
+  int64_t            meta_last = -1;        // metadata_end for record i-1
+  char              *meta      = NULL;
+  int64_t            nmeta;
+  int64_t            np;
+  uint32_t          *psq;
+  char              *ptr, *end;
+  char              *name, *acc, *desc;
+  int32_t            taxid;
+  int                L, P;
+  int                status;
+
+  if (! esl_sq_IsDigital(sq)) ESL_EXCEPTION(eslEINVAL, "dsqdata fetch requires a digital sequence object");
+  if (i < 0 || i >= (int64_t) dd->nseq) ESL_FAIL(eslENOTFOUND, dd->errbuf, "no sequence %" PRId64 " in database (0..%" PRIu64 ")", i, dd->nseq);
+
+  if (i > 0) 
+    {
+      status = dsqdata_pread(dd->ifp, dd->imap, dd->isize, eslDSQDATA_IHDRSIZE + (i-1) * sizeof(ESL_DSQDATA_RECORD), 2 * sizeof(ESL_DSQDATA_RECORD), rec);
+      psq_last  = rec[0].psq_end;
+      meta_last = rec[0].metadata_end;
+    }
+  else
+    status = dsqdata_pread(dd->ifp, dd->imap, dd->isize, eslDSQDATA_IHDRSIZE, sizeof(ESL_DSQDATA_RECORD), rec+1);
+  if (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file is truncated");
+  else if (status != eslOK) goto ERROR;
+
+  /* Metadata: name, acc, desc \0-terminated; then int32 taxid. Like all user input, don't trust the \0's. */
+  nmeta = rec[1].metadata_end - meta_last;
+  if (nmeta < 3 + (int64_t) sizeof(int32_t)) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata format error");
+  ESL_ALLOC(meta, sizeof(char) * nmeta);
+  status = dsqdata_pread(dd->mfp, dd->mdmap, dd->mdsize, eslDSQDATA_HDRSIZE + meta_last + 1, nmeta, meta);
+  if (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file is truncated");
+  else if (status != eslOK) goto ERROR;
+
+  end  = meta + nmeta - sizeof(int32_t);
+  name = ptr = meta;  if ((ptr = memchr(ptr, '\0', end - ptr)) == NULL) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata format error");
+  acc  = ++ptr;       if ((ptr = memchr(ptr, '\0', end - ptr)) == NULL) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata format error");
+  desc = ++ptr;       if ((ptr = memchr(ptr, '\0', end - ptr)) == NULL) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata format error");
+  memcpy(&taxid, end, sizeof(int32_t));
+
+  if (( status = esl_sq_SetName     (sq, name)) != eslOK) goto ERROR;
+  if (( status = esl_sq_SetAccession(sq, acc))  != eslOK) goto ERROR;
+  if (( status = esl_sq_SetDesc     (sq, desc)) != eslOK) goto ERROR;
+  sq->tax_id = taxid;
+  sq->idx    = i;
+
+  if (do_seq)
+    {
+      /* Packets go at the end of <dsq>, sized the same way as a chunk's <smem>, so we can unpack in place */
+      np = rec[1].psq_end - psq_last;
+      if (np < 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file format error");
+      if (( status = esl_sq_GrowTo(sq, dd->unpack_max * np + 2)) != eslOK) goto ERROR;  // +2: Huffman decoder's slack
+      psq    = (uint32_t *) (sq->dsq + sq->salloc - 4*np);
+      status = dsqdata_pread(dd->sfp, dd->smap, dd->ssize, dd->shdrsize + (psq_last + 1) * sizeof(uint32_t), np * sizeof(uint32_t), psq);
+      if (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file is truncated");
+      else if (status != eslOK) goto ERROR;
+
+      sq->dsq[0] = eslDSQ_SENTINEL;
+      if (dd->hc)
+	{
+	  if (dsqdata_unpackh(dd, psq, np, sq->dsq, &L, &P) != eslOK || P != np) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file format error");
+	}
+      else
+	{
+	  if (! ESL_DSQDATA_EOD(psq[np-1])) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file format error");
+	  if (dd->pack5) dsqdata_unpack5(psq, np, sq->dsq, dd->unpack5_vec, &L, &P);
+	  else           dsqdata_unpack2(psq, np, sq->dsq, dd->unpack2_vec, &L, &P);
+	}
+      sq->n = L;
+      esl_sq_SetCoordComplete(sq, L);
+    }
+  else
+    {
+      sq->n = 0;
+      sq->L = -1;
+    }
+
+  free(meta);
+  return eslOK;
+
+ ERROR:
+  free(meta);
+  return status;
+#else
+  ESL_EXCEPTION(eslEUNIMPLEMENTED, "dsqdata random access requires POSIX pread()");
+#endif /*_POSIX_VERSION*/
+}
+
+
+/* dsqdata_pread()
+ *
+ * Read <n> bytes at <offset> in one of the data files into <buf>:
+ * from the file's map <map> of <mapsize> bytes if the reader is
+ * memory-mapped, else with <pread()> on the descriptor of <fp>. The
+ * <pread()> doesn't move the file position, so it doesn't interfere
+ * with the loader thread's <fread()>'s.
+ *
+ * Returns <eslOK> on success, <eslEFORMAT> if the file is too short.
+ * Throws <eslESYS> if <pread()> fails.
+ */
+static int
+dsqdata_pread(FILE *fp, const unsigned char *map, size_t mapsize, off_t offset, size_t n, void *buf)
+{
+#ifdef _POSIX_VERSION
+  unsigned char *p = (unsigned char *) buf;
+  ssize_t        nr;
+
+  if (map)
+    {
+      if (offset < 0 || (size_t) offset + n > mapsize) return eslEFORMAT;
+      memcpy(buf, map + offset, n);
+      return eslOK;
+    }
+
+  while (n > 0)
+    {
+      if ((nr = pread(fileno(fp), p, n, offset)) < 0) ESL_EXCEPTION_SYS(eslESYS, "pread() failed");
+      if (nr == 0) return eslEFORMAT;
+      p      += nr;
+      offset += nr;
+      n      -= nr;
+    }
+  return eslOK;
+#else
+  ESL_EXCEPTION(eslEUNIMPLEMENTED, "dsqdata random access requires POSIX pread()");
+#endif
+}
+
+
+/* dsqdata_read_mapped()
+ * 
+ * esl_dsqdata_Read() for a memory-mapped reader. Under the
+ * <nchunk_mutex>, claim the next run of sequences that fits in a
+ * chunk, using the same rule as the loader thread (at most
+ * <chunk_maxseq> sequences and <chunk_maxpacket> packets). Then,
+ * outside the lock, point the chunk at its packed sequence and
+ * metadata in the maps, and unpack it in the caller's thread.
+ *
+ * Index records are <memcpy()>'d out of <imap> because the index
+ * header is 52 bytes, so records aren't 8-byte aligned.
+ */
+static int
+dsqdata_read_mapped(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK **ret_chu)
+{
+  ESL_DSQDATA_CHUNK  *chu      = NULL;
+  unsigned char      *idx      = dd->imap + eslDSQDATA_IHDRSIZE;
+  ESL_DSQDATA_RECORD  rec;
+  int64_t             i0;                 // first sequence in this chunk, 0..nseq-1
+  int64_t             nidx;               // max # of seqs that could go in the chunk
+  int64_t             nload;              // # of seqs we put in it
+  int64_t             righti, mid;        // binary search for <nload>
+  int64_t             psq_last  = -1;     // psq_end for record i0-1
+  int64_t             meta_last = -1;     // metadata_end for record i0-1
+  ESL_STOPWATCH       w;
+  int                 i;
+  int                 status;
+
+  if ( pthread_mutex_lock(&dd->nchunk_mutex) != 0) ESL_EXCEPTION(eslESYS, "failed to lock reader mutex");
+  i0 = dd->next_i;
+  if (i0 >= dd->range_i1)
+    {
+      if ( pthread_mutex_unlock(&dd->nchunk_mutex) != 0) ESL_EXCEPTION(eslESYS, "failed to unlock reader mutex");
+      *ret_chu = NULL;
+      return eslEOF;
+    }
+  if (i0 > 0) {
+    memcpy(&rec, idx + (i0-1) * sizeof(ESL_DSQDATA_RECORD), sizeof(ESL_DSQDATA_RECORD));
+    psq_last  = rec.psq_end;
+    meta_last = rec.metadata_end;
+  }
+
+  /* nload = max i : i <= MAXSEQ && idx[i0+i-1].psq_end - psq_last <= MAXPACKET  */
+  nidx = ESL_MIN(dd->chunk_maxseq, dd->range_i1 - i0);
+  memcpy(&rec, idx + (i0+nidx-1) * sizeof(ESL_DSQDATA_RECORD), sizeof(ESL_DSQDATA_RECORD));
+  if (rec.psq_end - psq_last <= dd->chunk_maxpacket)
+    nload = nidx;
+  else
+    {
+      righti = nidx;
+      nload  = 1;
+      while (righti - nload > 1)
+	{
+	  mid = nload + (righti - nload) / 2;
+	  memcpy(&rec, idx + (i0+mid-1) * sizeof(ESL_DSQDATA_RECORD), sizeof(ESL_DSQDATA_RECORD));
+	  if (rec.psq_end - psq_last <= dd->chunk_maxpacket) nload = mid;
+	  else righti = mid;
+	}
+      memcpy(&rec, idx + (i0+nload-1) * sizeof(ESL_DSQDATA_RECORD), sizeof(ESL_DSQDATA_RECORD));
+    }
+  ESL_DASSERT1(( rec.psq_end - psq_last <= dd->chunk_maxpacket ));
+  dd->next_i += nload;
+  dd->nchunk++;
+  if ( pthread_mutex_unlock(&dd->nchunk_mutex) != 0) ESL_EXCEPTION(eslESYS, "failed to unlock reader mutex");
+
+  /* Get a chunk: off the recycling stack if we can, else a new one. */
+  if ( pthread_mutex_lock(&dd->recycling_mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread mutex lock failed");
+  if (( chu = dd->recycling) != NULL) dd->recycling = chu->nxt;
+  if ( pthread_mutex_unlock(&dd->recycling_mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread mutex unlock failed");
+  if (! chu && (chu = dsqdata_chunk_Create(dd)) == NULL) return eslEMEM;
+
+  chu->i0       = i0;
+  chu->N        = nload;
+  chu->pn       = rec.psq_end - psq_last;
+  chu->psq      = (uint32_t *) (dd->smap + dd->shdrsize + (psq_last + 1) * sizeof(uint32_t));
+  chu->metadata = (char *)     (dd->mdmap + eslDSQDATA_HDRSIZE + (meta_last + 1));
+  chu->mdalloc  = rec.metadata_end - meta_last;
+
+  esl_stopwatch_Start(&w);
+  if (( status = dsqdata_unpack_chunk(dd, chu)) != eslOK) { esl_dsqdata_Recycle(dd, chu); return status; }
+  esl_stopwatch_Stop(&w);
+
+  if ( pthread_mutex_lock(&dd->nchunk_mutex) != 0) ESL_EXCEPTION(eslESYS, "failed to lock reader mutex");
+  dd->load_bytes  += (int64_t) chu->pn * sizeof(uint32_t) + chu->mdalloc;
+  dd->mapped_time += w.elapsed;
+  for (i = 0; i < chu->N; i++) dd->mapped_nres += chu->L[i];
+  if ( pthread_mutex_unlock(&dd->nchunk_mutex) != 0) ESL_EXCEPTION(eslESYS, "failed to unlock reader mutex");
+
+  *ret_chu = chu;
+  return eslOK;
+}
+
+
+/* dsqdata_open_files()
+ * 
+ * Allocate a new <ESL_DSQDATA>, open the four files of database
+ * <basename>, and parse and validate their headers. Leaves the
+ * index, metadata, and sequence files positioned at their first
+ * record. Shared by <esl_dsqdata_Open()> and
+ * <esl_dsqdata_OpenMapped()>, which go on to set up their own
+ * input machinery.
+ *
+ * Returns <eslOK> on success; <eslENOTFOUND> or <eslEFORMAT> on
+ * normal errors, with <dd->errbuf> set. Throws <eslEMEM>, <eslESYS>,
+ * <eslEUNIMPLEMENTED>. On any error, <*ret_dd> is returned (if it was
+ * allocated) for the caller to clean up.
+ */
+static int
+dsqdata_open_files(ESL_ALPHABET **byp_abc, char *basename, ESL_DSQDATA **ret_dd)
+{
+  ESL_DSQDATA *dd        = NULL;
+  int          bufsize   = 4096;
+  uint32_t     magic     = 0;
+  uint32_t     tag       = 0;
+  uint32_t     alphatype = eslUNKNOWN;
+  uint32_t     hcount[eslDSQDATA_HUFFMAN_K];
+  char        *p;                       // used for strtok() parsing of fields on a line
+  char         buf[4096];
+  int          status;
+  
+  ESL_ALLOC(dd, sizeof(ESL_DSQDATA));
+  dd->stubfp          = NULL;
+  dd->ifp             = NULL;
+  dd->sfp             = NULL;
+  dd->mfp             = NULL;
+  dd->abc_r           = *byp_abc;        // This may be NULL; if so, we create it later.
+
+  dd->magic           = 0;
+  dd->uniquetag       = 0;
+  dd->flags           = 0;
+  dd->max_namelen     = 0;
+  dd->max_acclen      = 0;
+  dd->max_desclen     = 0;
+  dd->max_seqlen      = 0;
+  dd->nseq            = 0;
+  dd->nres            = 0;
+
+  dd->chunk_maxseq    = eslDSQDATA_CHUNK_MAXSEQ;    // someday we may want to allow tuning these
+  dd->chunk_maxpacket = eslDSQDATA_CHUNK_MAXPACKET;
+  dd->do_byteswap     = FALSE;
+  dd->pack5           = FALSE;  
+  dd->unpack_max      = 15;
+  dd->shdrsize        = eslDSQDATA_HDRSIZE;
+  dd->hc              = NULL;
+  dd->hlut            = NULL;
+  dd->unpack5_vec     = NULL;
+  dd->unpack2_vec     = NULL;
+
+  dd->nconsumers      = 0;
+  dd->n_unpackers     = 0;
+  dd->go              = FALSE;
+
+  dd->is_mapped       = FALSE;
+  dd->imap            = NULL;
+  dd->smap            = NULL;
+  dd->mdmap           = NULL;
+  dd->isize           = 0;
+  dd->ssize           = 0;
+  dd->mdsize          = 0;
+  dd->next_i          = 0;
+  dd->range_i0        = 0;
+  dd->range_i1        = 0;
+
+  dd->inbox           = NULL;
+  dd->inbox_mutex     = NULL;
+  dd->inbox_cv        = NULL;
+  dd->inbox_eod       = NULL;
+  dd->outbox          = NULL;
+  dd->outbox_mutex    = NULL;
+  dd->outbox_cv       = NULL;
+  dd->outbox_eod      = NULL;
+  dd->unpacker_t      = NULL;
+
+  dd->load_bytes      = 0;
+  dd->load_time       = 0.;
+  dd->load_wait       = 0.;
+  dd->unpack_nres     = NULL;
+  dd->unpack_time     = NULL;
+  dd->mapped_nres     = 0;
+  dd->mapped_time     = 0.;
+  dd->consumer_wait   = 0.;
+  dd->errbuf[0]       = '\0';
+
+  /* Open the four files.
+   */
+  ESL_ALLOC( dd->basename, sizeof(char) * (strlen(basename) + 6)); // +5 for .dsqx; +1 for \0
+  if ( sprintf(dd->basename, "%s.dsqi", basename) <= 0)   ESL_XEXCEPTION_SYS(eslESYS, "sprintf() failure");
+  if (( dd->ifp = fopen(dd->basename, "rb"))   == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open index file %s\n", dd->basename);
+
+  if ( sprintf(dd->basename, "%s.dsqm", basename) <= 0)   ESL_XEXCEPTION_SYS(eslESYS, "sprintf() failure");
+  if (( dd->mfp = fopen(dd->basename, "rb"))   == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open metadata file %s\n", dd->basename);
+
+  if ( sprintf(dd->basename, "%s.dsqs", basename) <= 0)   ESL_XEXCEPTION_SYS(eslESYS, "sprintf() failure");
+  if (( dd->sfp = fopen(dd->basename, "rb"))   == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open sequence file %s\n", dd->basename);
+
+  strcpy(dd->basename, basename);
+  if (( dd->stubfp = fopen(dd->basename, "r")) == NULL)   ESL_XFAIL(eslENOTFOUND, dd->errbuf, "Failed to find or open stub file %s\n", dd->basename);
+
+  /* The stub file is unparsed, intended to be human readable, with one exception:
+   * The first line contains the unique tag that we use to validate linkage of the 4 files.
+   * The format of that first line is:
+   *     Easel dsqdata v123 x0000000000 
+   */
+  if ( fgets(buf, bufsize, dd->stubfp) == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file is empty - no tag line found");
+  if (( p = strtok(buf,  " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format: tag line has no data");
+  if (  strcmp(p, "Easel") != 0)                          ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
+  if (( p = strtok(NULL, " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
+  if (  strcmp(p, "dsqdata") != 0)                        ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
+  if (( p = strtok(NULL, " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
+  if ( *p != 'v')                                         ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format: no v on version");                        
+  if ( ! esl_str_IsInteger(p+1))                          ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file had bad format: no version number");
+  // version number is currently unused: there's only 1
+  if (( p = strtok(NULL, " \t\n\r"))   == NULL)           ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format in tag line");
+  if ( *p != 'x')                                         ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file has bad format: no x on tag");                        
+  if ( ! esl_str_IsInteger(p+1))                          ESL_XFAIL(eslEFORMAT, dd->errbuf, "stub file had bad format: no integer tag");
+  dd->uniquetag = strtoul(p+1, NULL, 10);
+    
+  /* Index file has a header of 7 uint32's, 3 uint64's */
+  if ( fread(&(dd->magic),       sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has no header - is empty?");
+  if ( fread(&tag,               sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no tag");
+  if ( fread(&alphatype,         sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no alphatype");
+  if ( fread(&(dd->flags),       sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no flags");
+  if ( fread(&(dd->max_namelen), sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max name len");
+  if ( fread(&(dd->max_acclen),  sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max accession len");
+  if ( fread(&(dd->max_desclen), sizeof(uint32_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max description len");
+
+  if ( fread(&(dd->max_seqlen),  sizeof(uint64_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no max seq len");
+  if ( fread(&(dd->nseq),        sizeof(uint64_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no nseq");
+  if ( fread(&(dd->nres),        sizeof(uint64_t), 1, dd->ifp) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file header truncated, no nres");
+
+  /* Check the magic and the tag */
+  if      (tag != dd->uniquetag)                 ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has bad tag, doesn't go with stub file");
+  // Eventually we would set dd->do_byteswap = TRUE; below.
+  if      (dd->magic == eslDSQDATA_MAGIC_V1SWAP) ESL_XEXCEPTION(eslEUNIMPLEMENTED, "dsqdata cannot yet read data in different byte orders");
+  else if (dd->magic != eslDSQDATA_MAGIC_V1)     ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has bad magic");
+  if (dd->flags & ~eslDSQDATA_FLAGS_HUFFMAN)     ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has unknown format flags %" PRIu32 " (written by a newer Easel?)", dd->flags);
+
+  /* Either validate, or create the alphabet */
+  if  (dd->abc_r)
+    {
+      if (alphatype != dd->abc_r->type) 
+	ESL_XFAIL(eslEFORMAT, dd->errbuf, "data files use %s alphabet; expected %s alphabet", 
+		  esl_abc_DecodeType(alphatype), 
+		  esl_abc_DecodeType(dd->abc_r->type));
+    }
+  else
+    {
+      if ( esl_abc_ValidateType(alphatype)             != eslOK) ESL_XFAIL(eslEFORMAT, dd->errbuf, "index file has invalid alphabet type %d", alphatype);
+      if (( dd->abc_r = esl_alphabet_Create(alphatype)) == NULL) ESL_XEXCEPTION(eslEMEM, "alphabet creation failed");
+    }
+
+  /* If it's protein, flip the switch to expect all 5-bit packing */
+  if (dd->abc_r->type == eslAMINO) dd->pack5 = TRUE;
+  dd->unpack_max = (dd->pack5 ? 6 : 15);
+  dsqdata_select_unpackers(dd);
+
+  /* Metadata file has a header of 2 uint32's, magic and uniquetag */
+  if (( fread(&magic, sizeof(uint32_t), 1, dd->mfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file has no header - is empty?");
+  if (( fread(&tag,   sizeof(uint32_t), 1, dd->mfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file header truncated - no tag?");
+  if ( magic != dd->magic)                                 ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file has bad magic");
+  if ( tag   != dd->uniquetag)                             ESL_XFAIL(eslEFORMAT, dd->errbuf, "metadata file has bad tag, doesn't match stub");
+
+  /* Sequence file also has a header of 2 uint32's, magic and uniquetag */
+  if (( fread(&magic, sizeof(uint32_t), 1, dd->sfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file has no header - is empty?");
+  if (( fread(&tag,   sizeof(uint32_t), 1, dd->sfp)) != 1) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file header truncated - no tag?");
+  if ( magic != dd->magic)                                 ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file has bad magic");
+  if ( tag   != dd->uniquetag)                             ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file has bad tag, doesn't match stub");
+
+  /* A Huffman coded sequence file follows that with the code's table of residue counts.
+   * Each packet of Huffman code unpacks to at most 32/(shortest code length) residues.
+   */
+  if (dd->flags & eslDSQDATA_FLAGS_HUFFMAN)
+    {
+      if (! dd->pack5)                                                         ESL_XFAIL(eslEFORMAT, dd->errbuf, "only protein dsqdata can be Huffman coded");
+      if ( fread(hcount, sizeof(uint32_t), eslDSQDATA_HUFFMAN_K, dd->sfp) != eslDSQDATA_HUFFMAN_K) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file header truncated - no Huffman table?");
+      if (( status = dsqdata_huffman_build(hcount, dd->abc_r->Kp, &(dd->hc), &(dd->hlut))) == eslEFORMAT) ESL_XFAIL(eslEFORMAT, dd->errbuf, "sequence file has bad Huffman table");
+      else if (status != eslOK) goto ERROR;
+      dd->shdrsize   = eslDSQDATA_HHDRSIZE;
+      dd->unpack_max = ESL_MAX(6, (32 + dd->hc->dt_len[0] - 1) / dd->hc->dt_len[0]);
+    }
+
+  *ret_dd = dd;
+  return eslOK;
+
+ ERROR:
+  *ret_dd = dd;
+  return status;
+}
+
+
+/*****************************************************************
+ *# 2. Creating dsqdata format: ESL_DSQDATA_WRITER
+ *****************************************************************/
+
+/* Function:  esl_dsqdata_Write()
+ * Synopsis:  Create a dsqdata database
+ * Incept:    SRE, Sat Feb 13 07:33:30 2016 [AGBT 2016, Orlando]
+ *
+ * Purpose:   Caller has just opened <sqfp>, in digital mode.
+ *            Create a dsqdata database <basename> from the sequence
+ *            data in <sqfp>.
+ *
+ *            <sqfp> must be protein, DNA, or RNA sequence data.
+ *            It is read once, start to finish, so it doesn't need
+ *            to be rewindable; it may be a stream.
+ *
+ *            Uses <eslDSQDATA_PACKERS> packer threads; see
+ *            <esl_dsqdata_Write_adv()>.
+ *
+ * Args:      sqfp     - newly opened sequence data file
+ *            basename - base name of dsqdata files to create
+ *            errbuf   - user-directed error message on normal errors
+ *
+ * Returns:   <eslOK> on success.
+ *           
+ *            <eslEWRITE> if an output file can't be opened. <errbuf>
+ *            contains user-directed error message.
+ *
+ *            <eslEFORMAT> if a parse error is encountered while
+ *            reading <sqfp>. The partial database is removed.
+ * 
+ *
+ * Throws:    <eslESYS>   A system call failed, such as fwrite().
+ *            <eslEINVAL> Sequence handle <sqfp> isn't digital.
+ *            <eslEMEM>   Allocation failure
+ *            <eslEUNIMPLEMENTED> Sequence is too long to be encoded.
+ *                               (TODO: chromosome-scale DNA sequences)
+ */
+int
+esl_dsqdata_Write(ESL_SQFILE *sqfp, char *basename, char *errbuf)
+{
+  return esl_dsqdata_Write_adv(sqfp, basename, eslDSQDATA_PACKERS, 0, errbuf);
+}
+
+
+/* Function:  esl_dsqdata_Write_adv()
+ * Synopsis:  Create a dsqdata database, with <n_packers> threads.
+ *
+ * Purpose:   Same as <esl_dsqdata_Write()>, but using <n_packers>
+ *            packer threads (plus one writer thread) to pack and
+ *            write the database, while the caller's thread parses
+ *            <sqfp>. <n_packers> = 0 means no threads: parse, pack,
+ *            and write in the caller's thread.
+ *
+ *            <flags> selects format options, as in
+ *            <esl_dsqdata_writer_Open()>: <eslDSQDATA_FLAGS_HUFFMAN>
+ *            to Huffman code a protein database, or 0.
+ *
+ *            This is a simple application of the
+ *            <ESL_DSQDATA_WRITER> appender.
+ *
+ * Returns:   (as <esl_dsqdata_Write()>)
+ *
+ * Throws:    (as <esl_dsqdata_Write()>)
+ */
+int
+esl_dsqdata_Write_adv(ESL_SQFILE *sqfp, char *basename, int n_packers, uint32_t flags, char *errbuf)
+{
+  ESL_DSQDATA_WRITER *w  = NULL;
+  ESL_SQ             *sq = NULL;
+  int                 status;
+
+  if (! sqfp->abc) ESL_EXCEPTION(eslEINVAL, "sqfp must be digital");
+
+  if (( status = esl_dsqdata_writer_Open(sqfp->abc, basename, n_packers, flags, errbuf, &w)) != eslOK) goto ERROR;
+  if (( status = esl_strdup(sqfp->filename, -1, &(w->srcfile)))                            != eslOK) goto ERROR;
+  w->srcformat = sqfp->format;
+  if (( sq = esl_sq_CreateDigital(sqfp->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+    {
+      if (( status = esl_dsqdata_writer_Append(w, sq)) != eslOK) goto ERROR;
+      esl_sq_Reuse(sq);
+    }
+  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, "%s", sqfp->get_error(sqfp));
+  else if (status != eslEOF)     goto ERROR;
+
+  status = esl_dsqdata_writer_Close(w);  // Close() frees <w> even on failure
+  w      = NULL;
+  if (status != eslOK) goto ERROR;
+
+  esl_sq_Destroy(sq);
+  return eslOK;
+
+ ERROR:
+  esl_dsqdata_writer_Abort(w);
+  esl_sq_Destroy(sq);
+  return status;
+}
+
+
+/* Function:  esl_dsqdata_writer_Open()
+ * Synopsis:  Start creating a dsqdata database, with an appender.
+ *
+ * Purpose:   Create dsqdata database <basename>, for sequences in
+ *            alphabet <abc> (protein, DNA, or RNA), which the caller
+ *            will append one at a time with
+ *            <esl_dsqdata_writer_Append()>; then finish it with
+ *            <esl_dsqdata_writer_Close()>. This lets a program
+ *            produce a dsqdata database directly, without an
+ *            intermediate sequence file.
+ *
+ *            Appended sequences are collected in chunks, which
+ *            <n_packers> packer threads pack, and a writer thread
+ *            writes to the database files in order. Appending is
+ *            cheap (a copy), so the caller's thread is free to
+ *            do the work of producing the sequences. <n_packers>
+ *            = 0 means no threads: the caller's thread packs and
+ *            writes each chunk when it fills.
+ *
+ *            The writer isn't threadsafe: only one thread should
+ *            append to it.
+ *
+ *            If <flags> includes <eslDSQDATA_FLAGS_HUFFMAN>, and
+ *            <abc> is protein, residues are Huffman coded instead of
+ *            5-bit packed, with a code built from the residue
+ *            composition of the first chunk of sequences. This
+ *            makes the sequence file about 15% smaller, which helps
+ *            when reading it is disk-bound. Nucleic acid databases
+ *            are already packed close to 2 bits per residue, and
+ *            ignore the flag.
+ *
+ * Args:      abc       - digital alphabet of the sequences
+ *            basename  - base name of dsqdata files to create
+ *            n_packers - number of packer threads (>= 0)
+ *            flags     - format options: <eslDSQDATA_FLAGS_HUFFMAN>, or 0
+ *            errbuf    - optional: user-directed error message on normal errors
+ *            ret_w     - RETURN: new writer
+ *
+ * Returns:   <eslOK> on success, and <*ret_w> is the new writer.
+ *
+ *            <eslEWRITE> if an output file can't be opened; <errbuf>
+ *            contains a user-directed error message, and <*ret_w> is
+ *            NULL.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslESYS> if a system call fails, such as fwrite() or
+ *            pthread_create().
+ *            <eslEINVAL> if <abc> isn't protein, DNA, or RNA, or
+ *            <flags> has an unknown flag.
+ *            On exceptions, <*ret_w> is NULL.
+ */
+int
+esl_dsqdata_writer_Open(const ESL_ALPHABET *abc, char *basename, int n_packers, uint32_t flags, char *errbuf, ESL_DSQDATA_WRITER **ret_w)
+{
+  ESL_DSQDATA_WRITER *w       = NULL;
+  ESL_RANDOMNESS     *rng     = NULL;
+  char               *outfile = NULL;
+  uint32_t            magic   = eslDSQDATA_MAGIC_V1;
+  int                 u;
+  int                 status;
+
+  if (abc->type != eslAMINO && abc->type != eslDNA && abc->type != eslRNA) ESL_EXCEPTION(eslEINVAL, "alphabet must be protein or nucleic");
+  if (flags & ~eslDSQDATA_FLAGS_HUFFMAN)                                    ESL_EXCEPTION(eslEINVAL, "unknown dsqdata format flag");
+  ESL_DASSERT1(( n_packers >= 0 ));
+
+  ESL_ALLOC(w, sizeof(ESL_DSQDATA_WRITER));
+  w->basename     = NULL;
+  w->stubfp       = NULL;
+  w->ifp          = NULL;
+  w->mfp          = NULL;
+  w->sfp          = NULL;
+  w->abc          = abc;
+  w->srcfile      = NULL;
+  w->srcformat    = eslSQFILE_UNKNOWN;
+
+  w->uniquetag    = 0;
+  w->pack5        = (abc->type == eslAMINO ? TRUE : FALSE);
+  w->flags        = (w->pack5 ? flags : 0);
+  w->hc           = NULL;
+  for (u = 0; u < eslDSQDATA_HUFFMAN_K; u++) w->hcount[u] = 0;
+  w->max_namelen  = 0;
+  w->max_acclen   = 0;
+  w->max_desclen  = 0;
+  w->max_seqlen   = 0;
+  w->nseq         = 0;
+  w->nres         = 0;
+  w->spos         = 0;
+  w->mpos         = 0;
+
+  w->chunk_maxseq = eslDSQDATA_CHUNK_MAXSEQ;
+  w->chunk_maxres = eslDSQDATA_WCHUNK_MAXRES;
+  w->cur          = NULL;
+
+  w->n_packers    = n_packers;
+  w->nchunk_max   = 2 * n_packers + 2;   // enough for every packer, the writer, and the appender to have one, plus one queued
+  w->nchunk_alloc = 0;
+  w->nsubmitted   = 0;
+  w->nwritten     = 0;
+  w->todo         = NULL;
+  w->todo_tail    = NULL;
+  w->done         = NULL;
+  w->recycling    = NULL;
+  w->eod          = FALSE;
+  w->wstatus      = eslOK;
+  w->packer_t     = NULL;
+
+  if (( rng = esl_randomness_Create(0) ) == NULL) { status = eslEMEM; goto ERROR; }
+  w->uniquetag = esl_random_uint32(rng);
+
+  if (( status = esl_strdup(basename, -1, &(w->basename)))   != eslOK) goto ERROR;
+  if (( status = esl_sprintf(&outfile, "%s.dsqi", basename)) != eslOK) goto ERROR;
+  if ((  w->ifp = fopen(outfile, "wb"))  == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata index file %s for writing", outfile);
+  sprintf(outfile, "%s.dsqm", basename);
+  if ((  w->mfp = fopen(outfile, "wb"))  == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata metadata file %s for writing", outfile);
+  sprintf(outfile, "%s.dsqs", basename);
+  if ((  w->sfp = fopen(outfile, "wb"))  == NULL)  ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata sequence file %s for writing", outfile);
+  if (( w->stubfp = fopen(basename, "w")) == NULL) ESL_XFAIL(eslEWRITE, errbuf, "failed to open dsqdata stub file %s for writing", basename);
+
+  /* Headers. The index file header's counts aren't known yet; it's written again by Close(). */
+  if (( status = dsqdata_writer_index_header(w)) != eslOK) goto ERROR;
+
+  if (fwrite(&magic,         sizeof(uint32_t), 1, w->mfp) != 1 ||
+      fwrite(&(w->uniquetag), sizeof(uint32_t), 1, w->mfp) != 1)
+    ESL_XEXCEPTION_SYS(eslESYS, "fwrite() failed, metadata file header");
+
+  if (fwrite(&magic,         sizeof(uint32_t), 1, w->sfp) != 1 ||
+      fwrite(&(w->uniquetag), sizeof(uint32_t), 1, w->sfp) != 1)
+    ESL_XEXCEPTION_SYS(eslESYS, "fwrite() failed, sequence file header");
+  if ((w->flags & eslDSQDATA_FLAGS_HUFFMAN) &&   // Huffman table isn't known yet either
+      fwrite(w->hcount, sizeof(uint32_t), eslDSQDATA_HUFFMAN_K, w->sfp) != eslDSQDATA_HUFFMAN_K)
+    ESL_XEXCEPTION_SYS(eslESYS, "fwrite() failed, sequence file header");
+
+  if (( w->cur = dsqdata_wchunk_Create()) == NULL) { status = eslEMEM; goto ERROR; }
+  w->nchunk_alloc++;
+
+  /* Start the packer and writer threads, last, after <w> is completely initialized */
+  if (n_packers > 0)
+    {
+      if ( pthread_mutex_init(&w->mutex,   NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init failed");
+      if ( pthread_cond_init (&w->todo_cv, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init failed");
+      if ( pthread_cond_init (&w->done_cv, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init failed");
+      if ( pthread_cond_init (&w->free_cv, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init failed");
+
+      ESL_ALLOC(w->packer_t, sizeof(pthread_t) * n_packers);
+      for (u = 0; u < n_packers; u++)
+	if ( pthread_create(&(w->packer_t[u]), NULL, dsqdata_packer_thread, w) != 0) ESL_XEXCEPTION(eslESYS, "pthread_create failed");
+      if ( pthread_create(&(w->writer_t), NULL, dsqdata_writer_thread, w) != 0) ESL_XEXCEPTION(eslESYS, "pthread_create failed");
+    }
+
+  esl_randomness_Destroy(rng);
+  free(outfile);
+  *ret_w = w;
+  return eslOK;
+
+ ERROR:
+  if (w) w->n_packers = 0;  // a failed Open() hasn't started threads, except in weird pthread failures we don't try to recover from
+  dsqdata_writer_destroy(w, TRUE);
+  esl_randomness_Destroy(rng);
+  free(outfile);
+  *ret_w = NULL;
+  return status;
+}
+
+
+/* Function:  esl_dsqdata_writer_Append()
+ * Synopsis:  Append one sequence to a new dsqdata database.
+ *
+ * Purpose:   Append digital sequence <sq> (name, accession,
+ *            description, taxonomy id, and sequence) to the
+ *            database that <w> is creating. <sq> is copied, and the
+ *            caller can reuse it right away.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <sq> isn't digital.
+ *            <eslEUNIMPLEMENTED> if <sq> is too long to be encoded:
+ *            about 1.5M residues, or 262K in a Huffman coded database.
+ *            <eslEMEM> on allocation failure.
+ *            <eslESYS> if the writer thread failed to write a chunk.
+ *            On exceptions, caller should <esl_dsqdata_writer_Abort()>.
+ */
+int
+esl_dsqdata_writer_Append(ESL_DSQDATA_WRITER *w, const ESL_SQ *sq)
+{
+  ESL_DSQDATA_WCHUNK *wc = w->cur;
+  int64_t  r0;              // <sq>'s leading sentinel goes at wc->dsq[r0]
+  int64_t  nmeta;           // bytes of metadata for <sq>
+  size_t   nn, na, nd;      // lengths of name, acc, desc
+  char    *mp;
+  int      status;
+
+  if (! esl_sq_IsDigital(sq))                   ESL_EXCEPTION(eslEINVAL, "dsqdata writer requires digital sequences");
+  if (sq->n >= 6 * eslDSQDATA_CHUNK_MAXPACKET)  ESL_EXCEPTION(eslEUNIMPLEMENTED, "dsqdata cannot currently deal with large sequences");  // guaranteed limit
+  if ((w->flags & eslDSQDATA_FLAGS_HUFFMAN) && sq->n > eslDSQDATA_CHUNK_MAXPACKET - 2)
+    ESL_EXCEPTION(eslEUNIMPLEMENTED, "Huffman coded dsqdata cannot currently deal with large sequences");  // codes <= 32 bits, plus delta coded length
+
+  /* Sequence: concatenate, with shared sentinels */
+  r0 = wc->nres + wc->N;
+  if (r0 + sq->n + 2 > wc->dalloc)
+    {
+      wc->dalloc = ESL_MAX(2 * wc->dalloc, r0 + sq->n + 2);
+      ESL_REALLOC(wc->dsq, sizeof(ESL_DSQ) * wc->dalloc);
+    }
+  memcpy(wc->dsq + r0 + 1, sq->dsq + 1, sizeof(ESL_DSQ) * sq->n);
+  wc->dsq[r0 + sq->n + 1] = eslDSQ_SENTINEL;
+  wc->L[wc->N] = sq->n;
+  wc->nres    += sq->n;
+
+  /* Metadata: name\0 acc\0 desc\0 taxid */
+  nn    = strlen(sq->name);
+  na    = strlen(sq->acc);
+  nd    = strlen(sq->desc);
+  nmeta = nn + na + nd + 3 + sizeof(int32_t);
+  if (wc->mn + nmeta > wc->mdalloc)
+    {
+      wc->mdalloc = ESL_MAX(2 * wc->mdalloc, wc->mn + nmeta);
+      ESL_REALLOC(wc->metadata, sizeof(char) * wc->mdalloc);
+    }
+  mp = wc->metadata + wc->mn;
+  memcpy(mp, sq->name, nn+1);  mp += nn+1;
+  memcpy(mp, sq->acc,  na+1);  mp += na+1;
+  memcpy(mp, sq->desc, nd+1);  mp += nd+1;
+  memcpy(mp, &(sq->tax_id), sizeof(int32_t));
+  wc->mn += nmeta;
+  wc->rec[wc->N].metadata_end = wc->mn - 1;
+  wc->N++;
+
+  /* Index header information */
+  w->nseq++;
+  w->nres += sq->n;
+  if (sq->n > w->max_seqlen)  w->max_seqlen  = sq->n;
+  if (nn    > w->max_namelen) w->max_namelen = nn;
+  if (na    > w->max_acclen)  w->max_acclen  = na;
+  if (nd    > w->max_desclen) w->max_desclen = nd;
+
+  if (wc->N == w->chunk_maxseq || wc->nres >= w->chunk_maxres)
+    return dsqdata_writer_submit(w);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  esl_dsqdata_writer_Close()
+ * Synopsis:  Finish creating a dsqdata database.
+ *
+ * Purpose:   Write the last sequences appended to <w>, wait for the
+ *            packer and writer threads to finish, finish the
+ *            database's index and stub files, and close them. Free
+ *            <w>, whether or not it succeeds.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslESYS> if a write or a pthread call fails.
+ *            <eslEMEM> on allocation failure.
+ *            On exceptions, the partial database is removed.
+ */
+int
+esl_dsqdata_writer_Close(ESL_DSQDATA_WRITER *w)
+{
+  int status = eslOK;
+
+  if (w->cur->N > 0) status = dsqdata_writer_submit(w);
+  dsqdata_writer_stop(w);
+  if (status == eslOK) status = w->wstatus;
+  if (status != eslOK) goto ERROR;
+
+  /* Now we know the index header information */
+  if ( fseeko(w->ifp, 0, SEEK_SET) != 0)                 ESL_XEXCEPTION_SYS(eslESYS, "fseeko() failed on index file");
+  if (( status = dsqdata_writer_index_header(w)) != eslOK) goto ERROR;
+
+  /* ... and the Huffman table. (An empty database never built one; its counts are all 1.) */
+  if (w->flags & eslDSQDATA_FLAGS_HUFFMAN)
+    {
+      if (! w->hc && (status = dsqdata_writer_huffman(w, w->cur)) != eslOK) goto ERROR;
+      if ( fseeko(w->sfp, eslDSQDATA_HDRSIZE, SEEK_SET) != 0)  ESL_XEXCEPTION_SYS(eslESYS, "fseeko() failed on sequence file");
+      if ( fwrite(w->hcount, sizeof(uint32_t), eslDSQDATA_HUFFMAN_K, w->sfp) != eslDSQDATA_HUFFMAN_K) ESL_XEXCEPTION_SYS(eslESYS, "fwrite() failed, sequence file header");
+    }
+
+  /* Stub file */
+  fprintf(w->stubfp, "Easel dsqdata v1 x%" PRIu32 "\n", w->uniquetag);
+  fprintf(w->stubfp, "\n");
+  if (w->srcfile) {
+    fprintf(w->stubfp, "Original file:   %s\n",        w->srcfile);
+    fprintf(w->stubfp, "Original format: %s\n",        esl_sqio_DecodeFormat(w->srcformat));
+  }
+  fprintf(w->stubfp, "Type:            %s\n",          esl_abc_DecodeType(w->abc->type));
+  fprintf(w->stubfp, "Sequences:       %" PRIu64 "\n", w->nseq);
+  fprintf(w->stubfp, "Residues:        %" PRIu64 "\n", w->nres);
+
+  /* Close the files here, not in _destroy(), to catch errors in flushing buffered writes */
+  status = eslOK;
+  if (fclose(w->stubfp) != 0) status = eslESYS;
+  if (fclose(w->ifp)    != 0) status = eslESYS;
+  if (fclose(w->mfp)    != 0) status = eslESYS;
+  if (fclose(w->sfp)    != 0) status = eslESYS;
+  w->stubfp = w->ifp = w->mfp = w->sfp = NULL;
+  if (status != eslOK) ESL_XEXCEPTION_SYS(eslESYS, "fclose() failed, dsqdata files");
+
+  dsqdata_writer_destroy(w, FALSE);
+  return eslOK;
+
+ ERROR:
+  dsqdata_writer_destroy(w, TRUE);
+  return status;
+}
+
+
+/* Function:  esl_dsqdata_writer_Abort()
+ * Synopsis:  Abandon creating a dsqdata database.
+ *
+ * Purpose:   Stop the threads of writer <w>, remove the partial
+ *            database files, and free <w>. For when the caller has
+ *            an error while appending sequences. If <w> is NULL, do
+ *            nothing.
+ */
+void
+esl_dsqdata_writer_Abort(ESL_DSQDATA_WRITER *w)
+{
+  if (w)
+    {
+      dsqdata_writer_stop(w);
+      dsqdata_writer_destroy(w, TRUE);
+    }
+}
+
+
+/* dsqdata_writer_index_header()
+ *
+ * Write the index file header, at the current position of <w->ifp>:
+ * once when the writer is opened, and again with the final counts
+ * when it's closed. <eslDSQDATA_IHDRSIZE> bytes.
+ */
+static int
+dsqdata_writer_index_header(ESL_DSQDATA_WRITER *w)
+{
+  uint32_t magic     = eslDSQDATA_MAGIC_V1;
+  uint32_t alphatype = w->abc->type;
+
+  if (fwrite(&magic,           sizeof(uint32_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->uniquetag),   sizeof(uint32_t), 1, w->ifp) != 1 ||
+      fwrite(&alphatype,       sizeof(uint32_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->flags),       sizeof(uint32_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->max_namelen), sizeof(uint32_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->max_acclen),  sizeof(uint32_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->max_desclen), sizeof(uint32_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->max_seqlen),  sizeof(uint64_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->nseq),        sizeof(uint64_t), 1, w->ifp) != 1 ||
+      fwrite(&(w->nres),        sizeof(uint64_t), 1, w->ifp) != 1) 
+    ESL_EXCEPTION_SYS(eslESYS, "fwrite() failed, index file header");
+  return eslOK;
+}
+
+
+/* dsqdata_writer_submit()
+ *
+ * The appender's current chunk <w->cur> is ready: pass it to the
+ * packers, and get a new current chunk, either by creating it or by
+ * waiting for the writer to recycle one. With no threads, pack and
+ * write it right here instead.
+ */
+static int
+dsqdata_writer_submit(ESL_DSQDATA_WRITER *w)
+{
+  ESL_DSQDATA_WCHUNK *wc   = w->cur;
+  int64_t             need = wc->nres / 6 + wc->N + 1;   // max number of packets for N seqs, nres residues: each packs into <= L/6+1
+  int                 status;
+
+  /* A Huffman code is built from the first chunk, before any packer needs it */
+  if (w->flags & eslDSQDATA_FLAGS_HUFFMAN)
+    {
+      if (! w->hc && (status = dsqdata_writer_huffman(w, wc)) != eslOK) return status;
+      need = (wc->nres * w->hc->Lmax + 63 * wc->N) / 32 + 2 * wc->N + 1;  // each packs into <= (L*Lmax + 63)/32 + 1
+    }
+
+  if (need > wc->palloc)
+    {
+      ESL_REALLOC(wc->psq, sizeof(uint32_t) * need);
+      wc->palloc = need;
+    }
+
+  if (w->n_packers == 0)
+    {
+      wc->idx = w->nsubmitted++;
+      dsqdata_wchunk_Pack(w, wc);
+      if (( status = dsqdata_wchunk_Write(w, wc)) != eslOK) return status;
+      w->nwritten++;
+      dsqdata_wchunk_Reuse(wc);
+      return eslOK;
+    }
+
+  if ( pthread_mutex_lock(&w->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+  if ( w->wstatus != eslOK) { status = w->wstatus; pthread_mutex_unlock(&w->mutex); return status; }
+
+  wc->idx = w->nsubmitted++;
+  wc->nxt = NULL;
+  if (w->todo_tail) w->todo_tail->nxt = wc;
+  else              w->todo           = wc;
+  w->todo_tail = wc;
+  if ( pthread_cond_signal(&w->todo_cv) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_signal failed");
+
+  if (w->nchunk_alloc < w->nchunk_max)
+    {
+      w->cur = dsqdata_wchunk_Create();
+      w->nchunk_alloc++;
+    }
+  else
+    {
+      while (w->recycling == NULL) {
+	if ( pthread_cond_wait(&w->free_cv, &w->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_wait failed");
+      }
+      w->cur       = w->recycling;
+      w->recycling = w->cur->nxt;
+    }
+  if ( pthread_mutex_unlock(&w->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+
+  if (w->cur == NULL) ESL_EXCEPTION(eslEMEM, "allocation failed");
+  dsqdata_wchunk_Reuse(w->cur);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* dsqdata_writer_huffman()
+ *
+ * Build the writer's Huffman code, from the residue composition of
+ * chunk <wc> (normally the first one). Counts are scaled to sum to
+ * about <eslDSQDATA_HUFFMAN_SCALE>, with a minimum of 1, so that
+ * every residue has a code and no code is longer than 32 bits.
+ * These scaled counts are what the sequence file header stores.
+ */
+static int
+dsqdata_writer_huffman(ESL_DSQDATA_WRITER *w, const ESL_DSQDATA_WCHUNK *wc)
+{
+  int64_t ct[eslDSQDATA_HUFFMAN_K];
+  int64_t r;
+  int     x;
+  int     status;
+
+  for (x = 0; x < eslDSQDATA_HUFFMAN_K; x++) ct[x] = 0;
+  for (r = 0; r < wc->nres + wc->N; r++)        // residues, and the sentinels between them
+    if (wc->dsq[r+1] < w->abc->Kp) ct[wc->dsq[r+1]]++;
+
+  for (x = 0; x < w->abc->Kp; x++)
+    w->hcount[x] = (uint32_t) ESL_MAX(1, (ct[x] * eslDSQDATA_HUFFMAN_SCALE) / ESL_MAX(1, wc->nres));
+
+  status = dsqdata_huffman_build(w->hcount, w->abc->Kp, &(w->hc), NULL);
+  if (status == eslEFORMAT) ESL_EXCEPTION(eslEINCONCEIVABLE, "bad dsqdata Huffman table");  // we just made sure it's valid
+  return status;
+}
+
+
+/* dsqdata_writer_stop()
+ *
+ * Tell the packer and writer threads that no more chunks are
+ * coming; wait for them to finish the ones they have.
+ */
+static void
+dsqdata_writer_stop(ESL_DSQDATA_WRITER *w)
+{
+  int u;
+
+  if (w->n_packers == 0) return;
+
+  pthread_mutex_lock(&w->mutex);
+  w->eod = TRUE;
+  pthread_cond_broadcast(&w->todo_cv);
+  pthread_cond_broadcast(&w->done_cv);
+  pthread_mutex_unlock(&w->mutex);
+
+  for (u = 0; u < w->n_packers; u++)
+    pthread_join(w->packer_t[u], NULL);
+  pthread_join(w->writer_t, NULL);
+
+  pthread_mutex_destroy(&w->mutex);
+  pthread_cond_destroy(&w->todo_cv);
+  pthread_cond_destroy(&w->done_cv);
+  pthread_cond_destroy(&w->free_cv);
+  w->n_packers = 0;    // threads are gone; _stop() is idempotent
+}
+
+
+/* dsqdata_writer_destroy()
+ *
+ * Free writer <w>, after its threads are stopped. Close any files
+ * that are still open, and if <do_remove> is TRUE, remove the
+ * (partial) database.
+ */
+static void
+dsqdata_writer_destroy(ESL_DSQDATA_WRITER *w, int do_remove)
+{
+  ESL_DSQDATA_WCHUNK *wc;
+  char               *outfile = NULL;
+
+  if (! w) return;
+
+  if (w->stubfp) fclose(w->stubfp);
+  if (w->ifp)    fclose(w->ifp);
+  if (w->mfp)    fclose(w->mfp);
+  if (w->sfp)    fclose(w->sfp);
+
+  if (do_remove && w->basename && esl_sprintf(&outfile, "%s.dsqi", w->basename) == eslOK)
     {
-      /* Packed sequence */
-      psq = (uint32_t *) sq->dsq;        // pack-in-place
-      ESL_DASSERT1(( sq->salloc >= 4 )); // required min space for pack-in-place
-      if (do_pack5) dsqdata_pack5(sq->dsq, sq->n, psq, &plen);
-      else          dsqdata_pack2(sq->dsq, sq->n, psq, &plen);
-      if ( fwrite(psq, sizeof(uint32_t), plen, sfp) != plen) 
-	ESL_XEXCEPTION(eslESYS, "fwrite() failed, packed seq");
-      spos += plen;
-
-      /* Metadata */
-      n = strlen(sq->name); 
-      if ( fwrite(sq->name, sizeof(char), n+1, mfp) != n+1) 
-	ESL_XEXCEPTION(eslESYS, "fwrite () failed, metadata, name");
-      mpos += n+1;
-
-      n = strlen(sq->acc);  
-      if ( fwrite(sq->acc,  sizeof(char), n+1, mfp) != n+1) 
-	ESL_XEXCEPTION(eslESYS, "fwrite () failed, metadata, accession");
-      mpos += n+1;
-
-      n = strlen(sq->desc); 
-      if ( fwrite(sq->desc, sizeof(char), n+1, mfp) != n+1)
-	ESL_XEXCEPTION(eslESYS, "fwrite () failed, metadata, description");
-      mpos += n+1;
-
-      if ( fwrite( &(sq->tax_id), sizeof(int32_t), 1, mfp) != 1)                  
-	ESL_XEXCEPTION(eslESYS, "fwrite () failed, metadata, taxonomy id");
-      mpos += sizeof(int32_t); 
-      
-      /* Index file */
-      idx.psq_end      = spos-1;  // could be -1, on 1st seq, if 1st seq L=0.
-      idx.metadata_end = mpos-1; 
-      if ( fwrite(&idx, sizeof(ESL_DSQDATA_RECORD), 1, ifp) != 1) 
-	ESL_XEXCEPTION(eslESYS, "fwrite () failed, index file");
+      remove(outfile);
+      sprintf(outfile, "%s.dsqm", w->basename);  remove(outfile);
+      sprintf(outfile, "%s.dsqs", w->basename);  remove(outfile);
+      remove(w->basename);
+      free(outfile);
+    }
 
-      esl_sq_Reuse(sq);
+  while ((wc = w->todo)      != NULL) { w->todo      = wc->nxt; dsqdata_wchunk_Destroy(wc); }
+  while ((wc = w->done)      != NULL) { w->done      = wc->nxt; dsqdata_wchunk_Destroy(wc); }
+  while ((wc = w->recycling) != NULL) { w->recycling = wc->nxt; dsqdata_wchunk_Destroy(wc); }
+  dsqdata_wchunk_Destroy(w->cur);
+
+  esl_huffman_Destroy(w->hc);
+  free(w->packer_t);
+  free(w->srcfile);
+  free(w->basename);
+  free(w);
+}
+
+
+/* dsqdata_packer_thread()
+ *
+ * Take chunks from the <todo> queue, pack them, and put them in the
+ * <done> list, in order, for the writer. 
+ */
+static void *
+dsqdata_packer_thread(void *p)
+{
+  ESL_DSQDATA_WRITER  *w = (ESL_DSQDATA_WRITER *) p;
+  ESL_DSQDATA_WCHUNK  *wc;
+  ESL_DSQDATA_WCHUNK **ptr;
+  int                  status;
+
+  while (1)
+    {
+      if ( pthread_mutex_lock(&w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_lock failed");
+      while (w->todo == NULL && ! w->eod) {
+	if ( pthread_cond_wait(&w->todo_cv, &w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_wait failed");
+      }
+      if (w->todo == NULL) { pthread_mutex_unlock(&w->mutex); break; }  // EOD: the only way out
+      wc      = w->todo;
+      w->todo = wc->nxt;
+      if (w->todo == NULL) w->todo_tail = NULL;
+      if ( pthread_mutex_unlock(&w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+
+      dsqdata_wchunk_Pack(w, wc);
+
+      if ( pthread_mutex_lock(&w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_lock failed");
+      for (ptr = &(w->done); *ptr && (*ptr)->idx < wc->idx; ptr = &((*ptr)->nxt)) ;
+      wc->nxt = *ptr;
+      *ptr    = wc;
+      if ( pthread_cond_signal(&w->done_cv) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_signal failed");
+      if ( pthread_mutex_unlock(&w->mutex)  != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_unlock failed");
     }
+  pthread_exit(NULL);
 
-  /* Stub file */
-  fprintf(stubfp, "Easel dsqdata v1 x%" PRIu32 "\n", uniquetag);
-  fprintf(stubfp, "\n");
-  fprintf(stubfp, "Original file:   %s\n",          sqfp->filename);
-  fprintf(stubfp, "Original format: %s\n",          esl_sqio_DecodeFormat(sqfp->format));
-  fprintf(stubfp, "Type:            %s\n",          esl_abc_DecodeType(sqfp->abc->type));
-  fprintf(stubfp, "Sequences:       %" PRIu64 "\n", nseq);
-  fprintf(stubfp, "Residues:        %" PRIu64 "\n", nres);
-  
-  esl_sq_Destroy(sq);
-  esl_randomness_Destroy(rng);
-  free(outfile);
-  fclose(stubfp);
-  fclose(ifp);
-  fclose(mfp);
-  fclose(sfp);
-  return eslOK;
+ ERROR:
+  w->wstatus = status;   // a failed pthread call; we don't try to recover
+  pthread_exit(NULL);
+}
+
+
+/* dsqdata_writer_thread()
+ *
+ * Write packed chunks from the <done> list, in order, and recycle
+ * them. After a write error, record it in <wstatus>, and keep
+ * recycling chunks without writing them, so the appender doesn't
+ * block; it sees the error at its next submission.
+ */
+static void *
+dsqdata_writer_thread(void *p)
+{
+  ESL_DSQDATA_WRITER *w = (ESL_DSQDATA_WRITER *) p;
+  ESL_DSQDATA_WCHUNK *wc;
+  int                 wstatus = eslOK;
+  int                 status;
+
+  while (1)
+    {
+      if ( pthread_mutex_lock(&w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_lock failed");
+      while ((w->done == NULL || w->done->idx != w->nwritten) && ! (w->eod && w->nwritten == w->nsubmitted)) {
+	if ( pthread_cond_wait(&w->done_cv, &w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_wait failed");
+      }
+      if (w->done == NULL || w->done->idx != w->nwritten) { pthread_mutex_unlock(&w->mutex); break; }  // EOD, and everything is written
+      wc      = w->done;
+      w->done = wc->nxt;
+      if ( pthread_mutex_unlock(&w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+
+      if (wstatus == eslOK) wstatus = dsqdata_wchunk_Write(w, wc);
+
+      if ( pthread_mutex_lock(&w->mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_lock failed");
+      w->wstatus   = wstatus;
+      w->nwritten++;
+      wc->nxt      = w->recycling;
+      w->recycling = wc;
+      if ( pthread_cond_signal(&w->free_cv) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_signal failed");
+      if ( pthread_mutex_unlock(&w->mutex)  != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+    }
+  pthread_exit(NULL);
 
  ERROR:
-  if (sq)      esl_sq_Destroy(sq);
-  if (rng)     esl_randomness_Destroy(rng);
-  if (outfile) free(outfile);
-  if (stubfp)  fclose(stubfp);
-  if (ifp)     fclose(ifp);
-  if (mfp)     fclose(mfp);
-  if (sfp)     fclose(sfp);
-  return status;
+  w->wstatus = status;   // a failed pthread call; we don't try to recover
+  pthread_exit(NULL);
+}
+
+
+
+/* dsqdata_wchunk_Create(), _Reuse(), _Destroy()
+ *
+ * A writer's chunk. Its allocations start at a size for typical
+ * protein sequences and grow as needed; <rec> is always allocated
+ * for the maximum number of sequences in a chunk. <psq> is allocated
+ * when the chunk is submitted, when its size is known.
+ */
+static ESL_DSQDATA_WCHUNK *
+dsqdata_wchunk_Create(void)
+{
+  ESL_DSQDATA_WCHUNK *wc = NULL;
+  int                 status;
+
+  ESL_ALLOC(wc, sizeof(ESL_DSQDATA_WCHUNK));
+  wc->dsq      = NULL;
+  wc->L        = NULL;
+  wc->metadata = NULL;
+  wc->psq      = NULL;
+  wc->rec      = NULL;
+  wc->dalloc   = 512 * eslDSQDATA_CHUNK_MAXSEQ;
+  wc->mdalloc  = 64  * eslDSQDATA_CHUNK_MAXSEQ;
+  wc->palloc   = 0;
+
+  ESL_ALLOC(wc->dsq,      sizeof(ESL_DSQ) * wc->dalloc);
+  ESL_ALLOC(wc->L,        sizeof(int64_t) * eslDSQDATA_CHUNK_MAXSEQ);
+  ESL_ALLOC(wc->metadata, sizeof(char)    * wc->mdalloc);
+  ESL_ALLOC(wc->rec,      sizeof(ESL_DSQDATA_RECORD) * eslDSQDATA_CHUNK_MAXSEQ);
+  dsqdata_wchunk_Reuse(wc);
+  return wc;
+
+ ERROR:
+  dsqdata_wchunk_Destroy(wc);
+  return NULL;
+}
+
+static void
+dsqdata_wchunk_Reuse(ESL_DSQDATA_WCHUNK *wc)
+{
+  wc->idx    = -1;
+  wc->N      = 0;
+  wc->nres   = 0;
+  wc->mn     = 0;
+  wc->pn     = 0;
+  wc->nxt    = NULL;
+  wc->dsq[0] = eslDSQ_SENTINEL;
+}
+
+static void
+dsqdata_wchunk_Destroy(ESL_DSQDATA_WCHUNK *wc)
+{
+  if (wc)
+    {
+      free(wc->dsq);
+      free(wc->L);
+      free(wc->metadata);
+      free(wc->psq);
+      free(wc->rec);
+      free(wc);
+    }
+}
+
+
+/* dsqdata_wchunk_Pack()
+ *
+ * Pack the sequences in chunk <wc> into <wc->psq>, and set the
+ * chunk-relative <psq_end> of their index records. <wc->psq> is
+ * already allocated for the worst case.
+ */
+static void
+dsqdata_wchunk_Pack(ESL_DSQDATA_WRITER *w, ESL_DSQDATA_WCHUNK *wc)
+{
+  ESL_DSQ *dsq = wc->dsq;    // leading sentinel of seq i
+  int      plen;
+  int      i;
+
+  wc->pn = 0;
+  for (i = 0; i < wc->N; i++)
+    {
+      if      (w->hc)    dsqdata_packh(w->hc, dsq, wc->L[i], wc->psq + wc->pn, &plen);
+      else if (w->pack5) dsqdata_pack5(dsq, wc->L[i], wc->psq + wc->pn, &plen);
+      else               dsqdata_pack2(dsq, wc->L[i], wc->psq + wc->pn, &plen);
+      wc->pn += plen;
+      wc->rec[i].psq_end = wc->pn - 1;
+      dsq += wc->L[i] + 1;
+    }
+  ESL_DASSERT1(( wc->pn <= wc->palloc ));
+}
+
+
+/* dsqdata_wchunk_Write()
+ *
+ * Write packed chunk <wc> to the sequence, metadata, and index
+ * files, converting its index records from chunk-relative to file
+ * offsets. Only one thread (the writer, or the appender if there
+ * are no threads) calls this, in chunk order.
+ */
+static int
+dsqdata_wchunk_Write(ESL_DSQDATA_WRITER *w, ESL_DSQDATA_WCHUNK *wc)
+{
+  int i;
+
+  for (i = 0; i < wc->N; i++)
+    {
+      wc->rec[i].psq_end      += w->spos;
+      wc->rec[i].metadata_end += w->mpos;
+    }
+  if ( fwrite(wc->psq,      sizeof(uint32_t),           wc->pn, w->sfp) != wc->pn) ESL_EXCEPTION_SYS(eslESYS, "fwrite() failed, packed seq");
+  if ( fwrite(wc->metadata, sizeof(char),               wc->mn, w->mfp) != wc->mn) ESL_EXCEPTION_SYS(eslESYS, "fwrite() failed, metadata");
+  if ( fwrite(wc->rec,      sizeof(ESL_DSQDATA_RECORD), wc->N,  w->ifp) != wc->N)  ESL_EXCEPTION_SYS(eslESYS, "fwrite() failed, index file");
+  w->spos += wc->pn;
+  w->mpos += wc->mn;
+  return eslOK;
 }
 
 
@@ -780,7 +2244,10 @@ dsqdata_chunk_Create(ESL_DSQDATA *dd)
    * one load of a new chunk of packed sequence, up to maxpacket*4
    * bytes. <smem> needs to be able to hold both that and the fully
    * unpacked sequence, because we unpack in place.  Each packet
-   * unpacks to at most 6 or 15 residues (5-bit or 2-bit packing) We
+   * unpacks to at most 6 or 15 residues (5-bit or 2-bit packing), or
+   * 32/(shortest code) residues (Huffman coding): <unpack_max>. (The
+   * Huffman decoder also needs two bytes of slack; see
+   * dsqdata_unpackh().) We
    * don't pack sentinels, so the maximum unpacked size includes
    * <maxseq>+1 sentinels... because we concat the digital seqs so
    * that the trailing sentinel of seq i is the leading sentinel of
@@ -799,11 +2266,20 @@ dsqdata_chunk_Create(ESL_DSQDATA *dd)
    * to smem - we're guaranteed that the unpacking works without
    * overwriting any unpacked data.
    */
-  U  = (dd->pack5 ? 6 * dd->chunk_maxpacket : 15 * dd->chunk_maxpacket);
-  U += dd->chunk_maxseq + 1;
+  U  = dd->unpack_max * dd->chunk_maxpacket;
+  U += dd->chunk_maxseq + 1 + 2;
   ESL_ALLOC(chu->smem, sizeof(ESL_DSQ) * U);
   chu->psq = (uint32_t *) (chu->smem + U - 4*dd->chunk_maxpacket);
 
+  /* In a memory-mapped reader, <psq> and <metadata> are set to point
+   * into the maps by each Read(); <smem> only receives unpacked data.
+   */
+  if (dd->is_mapped) {
+    chu->psq     = NULL;
+    chu->mdalloc = 0;
+    return chu;
+  }
+
   /* We don't have any guarantees about the amount of metadata
    * associated with the N sequences, so <metadata> has to be a
    * reallocatable space. We make a lowball guess for the initial
@@ -857,10 +2333,13 @@ dsqdata_loader_thread(void *p)
   int                  ncarried  = 0;             // how many records carry over to next iteration: nidx-nload
   int                  nread     = 0;             // fread()'s return value
   int                  nmeta     = 0;             // how many bytes of metadata we want to read for this chunk
-  int                  i0        = 0;             // absolute index of first record in <idx>, 0-offset
+  int64_t              i0        = dd->range_i0;  // absolute index of first record in <idx>, 0-offset
+  int64_t              nremain   = dd->range_i1 - dd->range_i0; // how many index records remain to be read
   int64_t              psq_last  = -1;            // psq_end for record i0-1
   int64_t              meta_last = -1;            // metadata_end for record i0-1
+  ESL_DSQDATA_RECORD   rec;                       // record i0-1, when we start partway into the data
   int                  u;                         // which unpacker outbox we put this chunk in 
+  ESL_STOPWATCH        w;                         // timing for <load_time>, <load_wait> stats
   int                  status;
 
   /* Don't use <dd> until we get the structure-is-ready signal */
@@ -870,7 +2349,18 @@ dsqdata_loader_thread(void *p)
   }
   if ( pthread_mutex_unlock(&dd->go_mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_lock failed on go_mutex");
 
-  /* We can begin. */
+  /* We can begin. If we're reading a range that doesn't start at
+   * the first sequence, position the three files at sequence <i0>.
+   */
+  if (dd->range_i0 > 0)
+    {
+      if ( fseeko(dd->ifp, eslDSQDATA_IHDRSIZE + (dd->range_i0 - 1) * sizeof(ESL_DSQDATA_RECORD), SEEK_SET) != 0) ESL_XEXCEPTION(eslESYS, "fseeko() failed on index file");
+      if ( fread(&rec, sizeof(ESL_DSQDATA_RECORD), 1, dd->ifp) != 1) ESL_XEXCEPTION(eslEOD, "dsqdata loader: index file truncated");
+      psq_last  = rec.psq_end;
+      meta_last = rec.metadata_end;
+      if ( fseeko(dd->sfp, dd->shdrsize       + (psq_last + 1) * sizeof(uint32_t), SEEK_SET) != 0) ESL_XEXCEPTION(eslESYS, "fseeko() failed on sequence file");
+      if ( fseeko(dd->mfp, eslDSQDATA_HDRSIZE + (meta_last + 1),                    SEEK_SET) != 0) ESL_XEXCEPTION(eslESYS, "fseeko() failed on metadata file");
+    }
   ESL_ALLOC(idx, sizeof(ESL_DSQDATA_RECORD) * dd->chunk_maxseq);
   while (1)
     {
@@ -896,6 +2386,7 @@ dsqdata_loader_thread(void *p)
 	{
 	  //printf("loader: getting a new chunk from recycling...\n");
 
+	  esl_stopwatch_Start(&w);
 	  if ( pthread_mutex_lock(&dd->recycling_mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread mutex lock failed");
 	  while (dd->recycling == NULL) {
 	    if ( pthread_cond_wait(&dd->recycling_cv, &dd->recycling_mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread cond wait failed");
@@ -904,6 +2395,8 @@ dsqdata_loader_thread(void *p)
 	  dd->recycling = chu->nxt;    
 	  if ( pthread_mutex_unlock(&dd->recycling_mutex) != 0) ESL_XEXCEPTION(eslESYS, "pthread mutex unlock failed");
 	  if ( pthread_cond_signal(&dd->recycling_cv)     != 0) ESL_XEXCEPTION(eslESYS, "pthread cond signal failed"); 	  // signal *after* unlocking mutex
+	  esl_stopwatch_Stop(&w);
+	  dd->load_wait += w.elapsed;
 
 	  //printf("loader: ... done, have new chunk from recycling.\n");
 	}
@@ -925,8 +2418,9 @@ dsqdata_loader_thread(void *p)
       i0      += nload;               // this chunk starts with seq #<i0>
       ncarried = (nidx - nload);
       memmove(idx, idx + nload, sizeof(ESL_DSQDATA_RECORD) * ncarried);
-      nidx  = fread(idx + ncarried, sizeof(ESL_DSQDATA_RECORD), dd->chunk_maxseq - ncarried, dd->ifp);
-      nidx += ncarried;               // usually, this'll be MAXSEQ, unless we're near EOF.
+      nidx     = fread(idx + ncarried, sizeof(ESL_DSQDATA_RECORD), ESL_MIN(dd->chunk_maxseq - ncarried, nremain), dd->ifp);
+      nremain -= nidx;
+      nidx    += ncarried;            // usually, this'll be MAXSEQ, unless we're near EOF (or end of range)
       
       if (nidx == 0)  // then we're EOD.
 	{ 
@@ -959,6 +2453,7 @@ dsqdata_loader_thread(void *p)
       /* Read packed sequence. */
       //printf("loader: loading chunk %d from disk.\n", (int) nchunk+1);
 
+      esl_stopwatch_Start(&w);
       chu->pn = idx[nload-1].psq_end - psq_last;
       nread   = fread(chu->psq, sizeof(uint32_t), chu->pn, dd->sfp);
       //printf("Read %d packed ints from seq file\n", nread);
@@ -973,6 +2468,9 @@ dsqdata_loader_thread(void *p)
       }
       nread  = fread(chu->metadata, sizeof(char), nmeta, dd->mfp);
       if ( nread != nmeta ) ESL_XEXCEPTION(eslEOD, "dsqdata metadata loader: expected %d, got %d", nmeta, nread); 
+      esl_stopwatch_Stop(&w);
+      dd->load_time  += w.elapsed;
+      dd->load_bytes += (int64_t) chu->pn * sizeof(uint32_t) + nmeta;
 
       chu->i0   = i0;
       chu->N    = nload;
@@ -1059,7 +2557,9 @@ dsqdata_unpacker_thread(void *p)
   ESL_DSQDATA          *dd    = (ESL_DSQDATA *) p;
   ESL_DSQDATA_CHUNK    *chu   = NULL;
   pthread_t             my_id = pthread_self();
+  ESL_STOPWATCH         w;
   int                   u;
+  int                   i;
   int                   status;
 
   /* Don't use <dd> until we get the structure-is-ready signal */
@@ -1100,7 +2600,11 @@ dsqdata_unpacker_thread(void *p)
       /* only need to signal inbox change to the loader if we're not EOD */
       if ( pthread_cond_signal(&(dd->inbox_cv[u])) != 0) ESL_XEXCEPTION(eslESYS, "pthread cond signal failed");
       /* unpack it */
-      if (( status = dsqdata_unpack_chunk(chu, dd->pack5)) != eslOK) goto ERROR;
+      esl_stopwatch_Start(&w);
+      if (( status = dsqdata_unpack_chunk(dd, chu)) != eslOK) goto ERROR;
+      esl_stopwatch_Stop(&w);
+      dd->unpack_time[u] += w.elapsed;
+      for (i = 0; i < chu->N; i++) dd->unpack_nres[u] += chu->L[i];
     }
     
     /* Put unpacked chunk into the unpacker's outbox, or set EOD status.
@@ -1133,19 +2637,47 @@ dsqdata_unpacker_thread(void *p)
  * 5. Packing sequences and unpacking chunks
  *****************************************************************/
 
+/* dsqdata_select_unpackers()
+ *
+ * Choose the fastest vectorized unpacking kernels that are compiled
+ * in and that the processor supports, fastest first, following our
+ * standard runtime dispatch pattern. If there are none, leave
+ * <dd->unpack5_vec> and <dd->unpack2_vec> NULL, and the scalar code
+ * does all the unpacking.
+ */
+static void
+dsqdata_select_unpackers(ESL_DSQDATA *dd)
+{
+#ifdef eslENABLE_AVX512
+  if (esl_cpu_has_avx512()) { dd->unpack5_vec = esl_dsqdata_unpack5_avx512; dd->unpack2_vec = esl_dsqdata_unpack2_avx512; return; }
+#endif
+#ifdef eslENABLE_AVX
+  if (esl_cpu_has_avx())    { dd->unpack5_vec = esl_dsqdata_unpack5_avx;    dd->unpack2_vec = esl_dsqdata_unpack2_avx;    return; }
+#endif
+#ifdef eslENABLE_SSE4
+  if (esl_cpu_has_sse4())   { dd->unpack5_vec = esl_dsqdata_unpack5_sse;    dd->unpack2_vec = esl_dsqdata_unpack2_sse;    return; }
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  dd->unpack5_vec = esl_dsqdata_unpack5_neon;  dd->unpack2_vec = esl_dsqdata_unpack2_neon;  return;
+#endif
+  dd->unpack5_vec = NULL;
+  dd->unpack2_vec = NULL;
+}
+
+
 /* dsqdata_unpack_chunk()
  * 
- * <do_pack5> is a hint: if caller knows that all the packets in the
- * chunk are 5-bit encoded (i.e. amino acid sequence), it can pass
- * <TRUE>, enabling a small optimization. Otherwise the packed
- * sequences will be treated as mixed 2- and 5-bit encoding, as is
- * needed for DNA/RNA sequences; protein sequences also unpack fine
- * that way, but the 5-bit flag on every packet needs to be checked.
+ * If <dd->pack5> is TRUE, all the packets in the chunk are 5-bit
+ * encoded (i.e. amino acid sequence), enabling a small
+ * optimization. Otherwise the packed sequences are treated as mixed
+ * 2- and 5-bit encoding, as is needed for DNA/RNA sequences.
+ * If <dd->hc> is set, the (protein) sequences are Huffman coded
+ * instead.
  *
  * Throws:    <eslEFORMAT> if a problem is seen in the binary format 
  */
 static int
-dsqdata_unpack_chunk(ESL_DSQDATA_CHUNK *chu, int do_pack5)
+dsqdata_unpack_chunk(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK *chu)
 {
   char     *ptr = chu->metadata;           // ptr will walk through metadata
   int       r;                             // position in unpacked dsq array
@@ -1173,8 +2705,13 @@ dsqdata_unpack_chunk(ESL_DSQDATA_CHUNK *chu, int do_pack5)
   while (pos < chu->pn)
     {
       chu->dsq[i] = (ESL_DSQ *) chu->smem + r;
-      if (do_pack5) dsqdata_unpack5(chu->psq + pos, chu->dsq[i], &L, &P);
-      else          dsqdata_unpack2(chu->psq + pos, chu->dsq[i], &L, &P);
+      if (dd->hc) 
+	{ // Huffman decoding can't trust the index to have packed whole sequences; check
+	  if (i == chu->N || dsqdata_unpackh(dd, chu->psq + pos, chu->pn - pos, chu->dsq[i], &L, &P) != eslOK)
+	    ESL_EXCEPTION(eslEFORMAT, "sequence format error");
+	}
+      else if (dd->pack5) dsqdata_unpack5(chu->psq + pos, chu->pn - pos, chu->dsq[i], dd->unpack5_vec, &L, &P);
+      else                dsqdata_unpack2(chu->psq + pos, chu->pn - pos, chu->dsq[i], dd->unpack2_vec, &L, &P);
 
       r   += L+1;     // L+1, not L+2, because we overlap start/end sentinels
       pos += P;
@@ -1192,12 +2729,18 @@ dsqdata_unpack_chunk(ESL_DSQDATA_CHUNK *chu, int do_pack5)
  * Important: dsq[0] is already initialized to eslDSQ_SENTINEL,
  * as a nitpicky optimization (the sequence data in a chunk are
  * concatenated so that they share end/start sentinels).
+ *
+ * <np> is the number of packets available at <psq>, which may extend
+ * past this sequence's EOD packet; a vector kernel <vecf> must not
+ * read beyond it. If <vecf> is non-NULL, it unpacks the bulk of the
+ * full packets, and the scalar code here does the rest. With <vecf>
+ * NULL, this is the scalar reference implementation.
  */
 static int
-dsqdata_unpack5(uint32_t *psq, ESL_DSQ *dsq, int *ret_L, int *ret_P)
+dsqdata_unpack5(uint32_t *psq, int np, ESL_DSQ *dsq, int (*vecf)(const uint32_t *, int, ESL_DSQ *), int *ret_L, int *ret_P)
 {
-  int      pos = 0;          // position in psq[]
-  int      r   = 1;          // position in dsq[]. caller set dsq[0] to eslDSQ_SENTINEL.
+  int      pos = (vecf ? (*vecf)(psq, np, dsq+1) : 0);  // position in psq[]
+  int      r   = 1 + 6*pos;  // position in dsq[]. caller set dsq[0] to eslDSQ_SENTINEL.
   uint32_t v   = psq[pos++];
   int      b;                // bit shift counter
 
@@ -1229,14 +2772,22 @@ dsqdata_unpack5(uint32_t *psq, ESL_DSQ *dsq, int *ret_L, int *ret_P)
  * This will work for protein sequences just fine; just a little
  * slower than calling dsqdata_unpack5(), because here we have
  * to check the 5-bit encoding bit on every packet.
+ *
+ * <np> and <vecf> are as in dsqdata_unpack5(). The 2-bit kernel
+ * stops at a group of packets that has a 5-bit packet in it. We then
+ * unpack 16 packets (the widest kernel's group) here before calling
+ * the kernel again, so that runs of noncanonical residues don't
+ * cost a failed kernel call per packet.
  */
 static int
-dsqdata_unpack2(uint32_t *psq, ESL_DSQ *dsq, int *ret_L, int *ret_P)
+dsqdata_unpack2(uint32_t *psq, int np, ESL_DSQ *dsq, int (*vecf)(const uint32_t *, int, ESL_DSQ *), int *ret_L, int *ret_P)
 {
-  int      pos = 0;
-  int      r   = 1;
+  int      pos = (vecf ? (*vecf)(psq, np, dsq+1) : 0);
+  int      r   = 1 + 15*pos;
   uint32_t v   = psq[pos++];
   int      b;                  // bit shift counter
+  int      nscalar = 0;        // packets unpacked here since the last kernel call
+  int      n;
 
   while (! ESL_DSQDATA_EOD(v))
     {
@@ -1253,6 +2804,14 @@ dsqdata_unpack2(uint32_t *psq, ESL_DSQ *dsq, int *ret_L, int *ret_P)
 	  dsq[r++] = (v >> 10) & 3;  dsq[r++] = (v >>  8) & 3;  dsq[r++] = (v >>  6) & 3;
 	  dsq[r++] = (v >>  4) & 3;  dsq[r++] = (v >>  2) & 3;  dsq[r++] = (v >>  0) & 3;
 	}
+
+      if (vecf && ++nscalar == 16) 
+	{ 
+	  n = (*vecf)(psq + pos, np - pos, dsq + r); 
+	  pos    += n; 
+	  r      += 15*n; 
+	  nscalar = 0; 
+	}
       v = psq[pos++];
     }
 
@@ -1375,6 +2934,229 @@ dsqdata_pack2(ESL_DSQ *dsq, int n, uint32_t *psq, int *ret_P)
   return eslOK;
 }
 
+/* dsqdata_huffman_build()
+ *
+ * Build the Huffman code for residue codes 0..K-1 from the residue
+ * counts <hcount[0..K-1]> that a Huffman coded .dsqs header stores.
+ * The writer and the reader both build the code from the same
+ * integer counts, so they get the same canonical code. Optionally,
+ * also build the decoder's lookup table. For each possible next
+ * <eslDSQDATA_HUFFMAN_LUTBITS> bits of input, it has the residues of
+ * the (up to) three whole codes in them: 5 bits each for residues
+ * <x0,x1,x2> in bits 0..14; the first code's length in bits 16..19;
+ * the total length of the codes in bits 20..23; and their number in
+ * bits 24..25. If the first code is longer than LUTBITS, the entry
+ * is 0.
+ *
+ * Every residue has to have a count of at least 1, so that any
+ * digital sequence can be encoded; and they can't sum to much more
+ * than <eslDSQDATA_HUFFMAN_SCALE>, so codes are guaranteed to fit
+ * in 32 bits.
+ *
+ * Returns <eslOK> on success. Returns <eslEFORMAT> if the counts
+ * don't meet those conditions, and <*ret_hc>, <*opt_lut> are NULL.
+ * Throws <eslEMEM> on allocation failure.
+ */
+static int
+dsqdata_huffman_build(const uint32_t *hcount, int K, ESL_HUFFMAN **ret_hc, uint32_t **opt_lut)
+{
+  ESL_HUFFMAN *hc    = NULL;
+  uint32_t    *one   = NULL;
+  uint32_t    *lut   = NULL;
+  float        fq[eslDSQDATA_HUFFMAN_K];
+  uint64_t     total = 0;
+  int          nlut  = 1 << eslDSQDATA_HUFFMAN_LUTBITS;
+  int          x, j, k, len, b;
+  uint32_t     e;
+  int          status;
+
+  ESL_DASSERT1(( K <= eslDSQDATA_HUFFMAN_K ));
+
+  for (x = 0; x < K; x++)
+    {
+      if (hcount[x] == 0) { status = eslEFORMAT; goto ERROR; }
+      total += hcount[x];
+      fq[x]  = (float) hcount[x];
+    }
+  for ( ; x < eslDSQDATA_HUFFMAN_K; x++)
+    if (hcount[x] != 0) { status = eslEFORMAT; goto ERROR; }
+  if (total > 16 * eslDSQDATA_HUFFMAN_SCALE) { status = eslEFORMAT; goto ERROR; }
+
+  if (( status = esl_huffman_Build(fq, K, &hc)) != eslOK) goto ERROR;
+
+  if (opt_lut)
+    {
+      /* First, the one-code entries, <x0 | len << 16>, in <one> */
+      ESL_ALLOC(one, sizeof(uint32_t) * nlut);
+      ESL_ALLOC(lut, sizeof(uint32_t) * nlut);
+      for (j = 0; j < nlut; j++) one[j] = 0;
+      for (x = 0; x < K; x++)
+	if ((len = hc->len[x]) <= eslDSQDATA_HUFFMAN_LUTBITS)
+	  for (j = 0; j < (1 << (eslDSQDATA_HUFFMAN_LUTBITS - len)); j++)
+	    one[ (hc->code[x] << (eslDSQDATA_HUFFMAN_LUTBITS - len)) | j ] = (uint32_t) x | ((uint32_t) len << 16);
+
+      /* Then add second and third codes, if they fit in the remaining <LUTBITS - b> bits of <j> */
+      for (j = 0; j < nlut; j++)
+	{
+	  if ((e = one[j]) == 0) { lut[j] = 0; continue; }
+	  b = len = (e >> 16) & 0xf;
+	  for (k = 1; k < 3; k++)
+	    {
+	      x   =  one[(j << b) & (nlut-1)]        & 0x1f;
+	      len = (one[(j << b) & (nlut-1)] >> 16) & 0xf;
+	      if (len == 0 || b + len > eslDSQDATA_HUFFMAN_LUTBITS) break;
+	      e |= (uint32_t) x << (5*k);
+	      b += len;
+	    }
+	  lut[j] = e | ((uint32_t) b << 20) | ((uint32_t) k << 24);
+	}
+      free(one);
+      *opt_lut = lut;
+    }
+  *ret_hc = hc;
+  return eslOK;
+
+ ERROR:
+  esl_huffman_Destroy(hc);
+  free(one);
+  free(lut);
+  *ret_hc = NULL;
+  if (opt_lut) *opt_lut = NULL;
+  return status;
+}
+
+
+/* dsqdata_unpackh()
+ *
+ * Unpack one Huffman coded protein sequence, starting at <psq>, into
+ * <dsq>. As in dsqdata_unpack5(), dsq[0] is already initialized to
+ * eslDSQ_SENTINEL. <np> is the number of packets available at <psq>,
+ * which may extend past this sequence's packets. Return the sequence
+ * length in <*ret_L> and the number of packets it used in <*ret_P>.
+ *
+ * The coded sequence is an Elias delta code for L+1, then L residue
+ * codes, left to right from the high bit of psq[0], zero-padded to a
+ * whole number of packets (note [4]). We read it through a 64-bit
+ * buffer, refilled a packet at a time whenever it has less than 32
+ * bits, so it always holds a whole code. Most residues are decoded
+ * by table lookups on the buffer's high bits, up to three at a time;
+ * the rare residues with longer codes, with the canonical code's
+ * decoding table.
+ *
+ * Packets are read before the residues decoded from them are stored,
+ * and each residue decodes from at least one code's worth of bits,
+ * so this can unpack in place, in the same way the 5-bit and 2-bit
+ * unpackers do: see dsqdata_chunk_Create(). The exception is that
+ * a three-residue store may write up to two residues ahead of what
+ * was decoded (never past dsq[L]); <smem> has two bytes of slack for
+ * that.
+ *
+ * Unlike the other unpackers, this one validates its input. The
+ * lengths of Huffman coded sequences aren't bounded by the number
+ * of packets the way packed ones are, and caller relies on
+ * <L <= dd->unpack_max * P>.
+ *
+ * Returns <eslOK> on success; <eslEFORMAT> if the data are corrupt
+ * or run past the <np> available packets.
+ */
+static int
+dsqdata_unpackh(const ESL_DSQDATA *dd, const uint32_t *psq, int np, ESL_DSQ *dsq, int *ret_L, int *ret_P)
+{
+  const ESL_HUFFMAN *hc   = dd->hc;
+  const uint32_t    *lut  = dd->hlut;
+  uint64_t           buf  = 0;   // bit buffer; next bit to decode is its high bit
+  int                nb   = 0;   // number of unread bits in <buf>
+  int                pos  = 0;   // next packet to load into <buf>
+  int64_t            used;       // total number of bits decoded
+  uint32_t           v, e;
+  int                len, d;
+  int                L, r;
+
+  while (nb <= 32 && pos < np) { buf |= (uint64_t) psq[pos++] << (32 - nb); nb += 32; }
+
+  /* Length. A valid L+1 < 2^31 has <= 4 leading 0's in its delta code */
+  if ((buf >> 59) == 0)                               return eslEFORMAT;
+  if (esl_varint_delta_decode(buf, &L, &len) != eslOK) return eslEFORMAT;
+  if (len > nb)                                       return eslEFORMAT;
+  L   -= 1;
+  used = len;
+  if ((int64_t) L * hc->dt_len[0] > 32 * (int64_t) np - used) return eslEFORMAT;
+  buf <<= len;
+  nb   -= len;
+
+  r = 1;
+  while (r <= L)
+    {
+      if (nb < 32 && pos < np) { buf |= (uint64_t) psq[pos++] << (32 - nb); nb += 32; }
+
+      e = lut[buf >> (64 - eslDSQDATA_HUFFMAN_LUTBITS)];
+      if (e && r+2 <= L)   // up to three residues; store all three, and advance past those we have
+	{
+	  dsq[r]   =  e        & 0x1f;
+	  dsq[r+1] = (e >>  5) & 0x1f;
+	  dsq[r+2] = (e >> 10) & 0x1f;
+	  r       += (e >> 24);
+	  len      = (e >> 20) & 0xf;
+	}
+      else if (e)          // near the end of the sequence: one at a time
+	{
+	  dsq[r++] = e & 0x1f;
+	  len      = (e >> 16) & 0xf;
+	}
+      else                 // a long code
+	{
+	  v = (uint32_t) (buf >> 32);
+	  for (d = 0; d < hc->D-1; d++)
+	    if (v < hc->dt_lcode[d+1]) break;
+	  len      = hc->dt_len[d];
+	  dsq[r++] = hc->sorted_at[ hc->dt_rank[d] + ((v - hc->dt_lcode[d]) >> (32 - len)) ];
+	}
+      buf  <<= len;
+      nb    -= len;
+      used  += len;
+    }
+  dsq[r] = eslDSQ_SENTINEL;
+
+  /* A code that ran off the end of the available packets decoded zeros */
+  if (used > 32 * (int64_t) np) return eslEFORMAT;
+  *ret_L = L;
+  *ret_P = (int) ((used + 31) / 32);
+  return eslOK;
+}
+
+
+/* dsqdata_packh()
+ *
+ * Huffman code a digital protein sequence <dsq> of length <n> with
+ * code <hc>, into <psq>; return the number of packets <*ret_P>.
+ * The format is described in dsqdata_unpackh() and note [4].
+ *
+ * <psq> must be allocated for at least $(n * hc->Lmax + 63) / 32 + 1$
+ * packets. This doesn't pack in place.
+ */
+static int
+dsqdata_packh(const ESL_HUFFMAN *hc, const ESL_DSQ *dsq, int n, uint32_t *psq, int *ret_P)
+{
+  uint64_t buf = 0;   // bit buffer; its low <nb> bits are pending output
+  int      nb  = 0;
+  int      pos = 0;
+  int      r;
+
+  esl_varint_delta(n+1, &buf, &nb);
+  for (r = 1; r <= n; r++)
+    {
+      while (nb >= 32) { nb -= 32; psq[pos++] = (uint32_t) (buf >> nb); }
+      buf = (buf << hc->len[dsq[r]]) | hc->code[dsq[r]];
+      nb += hc->len[dsq[r]];
+    }
+  while (nb >= 32) { nb -= 32; psq[pos++] = (uint32_t) (buf >> nb); }
+  if (nb > 0) psq[pos++] = (uint32_t) (buf << (32 - nb));
+
+  *ret_P = pos;
+  return eslOK;
+}
+
+
 
 /*****************************************************************
  * 6. Notes
@@ -1442,52 +3224,391 @@ dsqdata_pack2(ESL_DSQ *dsq, int n, uint32_t *psq, int *ret_P)
  *       
  * [2] Compression: relative incompressibility of biological sequences.
  *
- *      Considered using fast (de)compression algorithms that are fast
- *      enough to keep up with disk read speed, including LZ4 and
- *      Google's Snappy. However, lz4 only achieves 1.0-1.9x global
- *      compression of protein sequence (compared to 1.5x for
- *      packing), and 2.0x for DNA (compared to 3.75x for packing).
- *      With local, blockwise compression, which we need for random
- *      access and indexing, it gets worse. Packing is superior.
- *      
- *      Metadata compression is more feasible, but I still opted
- *      against it. Although metadata are globally quite compressible
- *      (3.2-6.9x in trials with lz4), locally in 64K blocks lz4 only
- *      achieves 2x.  [xref SRE:2016/0201-seqfile-compression]
- *      
- * [3] Maybe getting more packing using run-length encoding.
- * 
- *      Genome assemblies typically have long runs of N's (human
- *      GRCh38.p2 is about 5% N), and it's excruciating to have to
- *      pack it into bulky 5-bit degenerate packets. I considered
- *      run-length encoding (RLE). One possibility is to use a special
- *      packet format akin to the 5-bit packet format:
- *      
- *        [0] [?] [11111] [.....] [....................]
- *        ^        ^       ^       20b number, <=2^20-1
- *        |        |       5-bit residue code       
- *        |        sentinel residue 31 set
- *        sentinel bit unset
- *        
- *      This is a uniquely detectable packet structure because a full
- *      packet (with unset sentinel bit) would otherwise never contain
- *      a sentinel residue (code 31).
- *      
- *      However, using RLE would make our unpacked data sizes too
- *      unpredictable; we wouldn't have the <=6P or <=15P guarantee,
- *      so we couldn't rely on fixed-length allocation of <smem> in
- *      our chunk. Consumers wouldn't be getting predictable chunk
- *      sizes, which could complicate load balancing. I decided
- *      against it.
+ *      Considered using fast (de)compression algorithms that are fast
+ *      enough to keep up with disk read speed, including LZ4 and
+ *      Google's Snappy. However, lz4 only achieves 1.0-1.9x global
+ *      compression of protein sequence (compared to 1.5x for
+ *      packing), and 2.0x for DNA (compared to 3.75x for packing).
+ *      With local, blockwise compression, which we need for random
+ *      access and indexing, it gets worse. Packing is superior.
+ *      
+ *      Metadata compression is more feasible, but I still opted
+ *      against it. Although metadata are globally quite compressible
+ *      (3.2-6.9x in trials with lz4), locally in 64K blocks lz4 only
+ *      achieves 2x.  [xref SRE:2016/0201-seqfile-compression]
+ *      
+ * [3] Maybe getting more packing using run-length encoding.
+ * 
+ *      Genome assemblies typically have long runs of N's (human
+ *      GRCh38.p2 is about 5% N), and it's excruciating to have to
+ *      pack it into bulky 5-bit degenerate packets. I considered
+ *      run-length encoding (RLE). One possibility is to use a special
+ *      packet format akin to the 5-bit packet format:
+ *      
+ *        [0] [?] [11111] [.....] [....................]
+ *        ^        ^       ^       20b number, <=2^20-1
+ *        |        |       5-bit residue code       
+ *        |        sentinel residue 31 set
+ *        sentinel bit unset
+ *        
+ *      This is a uniquely detectable packet structure because a full
+ *      packet (with unset sentinel bit) would otherwise never contain
+ *      a sentinel residue (code 31).
+ *      
+ *      However, using RLE would make our unpacked data sizes too
+ *      unpredictable; we wouldn't have the <=6P or <=15P guarantee,
+ *      so we couldn't rely on fixed-length allocation of <smem> in
+ *      our chunk. Consumers wouldn't be getting predictable chunk
+ *      sizes, which could complicate load balancing. I decided
+ *      against it.
+ *
+ * [4] Huffman-coded protein sequence (eslDSQDATA_FLAGS_HUFFMAN).
+ *
+ *      Protein residues aren't equiprobable, so a canonical Huffman
+ *      code gets to about 4.3 bits/residue, compared to 5.3 for 5-bit
+ *      packing (including EOD padding). When the .dsqi header has the
+ *      HUFFMAN flag set, the .dsqs header is followed by a table of
+ *      32 uint32_t residue counts, from which the reader rebuilds the
+ *      same code the writer used (esl_huffman). The writer takes the
+ *      counts from the first chunk it packs.
+ *
+ *      Each sequence is then stored as its length L+1, Elias delta
+ *      coded (esl_varint), followed by the L residue codes, MSB
+ *      first, zero-padded to a whole number of 32-bit words. There's
+ *      no EOD bit, because the length is known up front. Index
+ *      records are unchanged: <psq_end> still counts 32-bit words, so
+ *      random access, ranges, and the mapped reader work as before.
+ *
+ *      Unpacking in place still works if we know the longest code
+ *      Lmax and the shortest Lmin: P words hold at most 32P/Lmin
+ *      residues, which sets <unpack_max>. Length is limited to a
+ *      little less than MAXPACKET, so a sequence still fits in one
+ *      chunk. Nucleic data aren't Huffman coded; 2-bit packing is
+ *      already close to their entropy.
+ */
+
+
+/*****************************************************************
+ * 7. Benchmark
+ *****************************************************************/
+#ifdef eslDSQDATA_BENCHMARK
+
+/* compile: gcc -O3 -Wall -I. -L. -o esl_dsqdata_benchmark -DeslDSQDATA_BENCHMARK esl_dsqdata.c -leasel -lm
+ * run:     ./esl_dsqdata_benchmark [--amino]
+ *
+ * Times unpacking of a chunk of random packed sequences, with the
+ * scalar reference code and with the vector kernels that runtime
+ * dispatch chooses on this processor.
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_cpu.h"
+#include "esl_dsqdata.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+#include "esl_vectorops.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,      "0",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400",  NULL, "n>0", NULL,  NULL, NULL, "sample sequence lengths uniformly on 0..<n>",      0 },
+  { "-N",        eslARG_INT,    "200",  NULL, "n>0", NULL,  NULL, NULL, "unpack the chunk <n> times",                       0 },
+  { "-f",        eslARG_REAL,   "0.1",  NULL, "0<=x<=1", NULL, NULL, NULL, "fraction of seqs with noncanonical residues",    0 },
+  { "--amino",   eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "protein (5-bit packing), not DNA",                 0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for dsqdata unpacking";
+
+static double
+benchmark_unpacking(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK *chu, uint32_t *psq, int N)
+{
+  ESL_STOPWATCH *w = esl_stopwatch_Create();
+  double         t;
+  int            iter;
+
+  esl_stopwatch_Start(w);
+  for (iter = 0; iter < N; iter++)
+    {
+      memcpy(chu->psq, psq, sizeof(uint32_t) * chu->pn);  // unpacking is in place, so reload each time
+      dsqdata_unpack_chunk(dd, chu);
+    }
+  esl_stopwatch_Stop(w);
+  t = w->elapsed;
+  esl_stopwatch_Destroy(w);
+  return t;
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS       *go     = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS    *rng    = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET      *abc    = esl_alphabet_Create(esl_opt_GetBoolean(go, "--amino") ? eslAMINO : eslDNA);
+  int                L_max  = esl_opt_GetInteger(go, "-L");
+  int                N      = esl_opt_GetInteger(go, "-N");
+  double             fdirty = esl_opt_GetReal   (go, "-f");
+  double            *fq     = malloc(sizeof(double) * abc->K);
+  ESL_DSQDATA        dd;
+  ESL_DSQDATA_CHUNK *chu    = NULL;
+  ESL_DSQ           *dsq    = malloc(sizeof(ESL_DSQ) * (L_max + 2));
+  uint32_t          *psq    = NULL;
+  char              *ptr;
+  int64_t            nres   = 0;
+  int                L, P, i;
+  double             t_scalar, t_vector;
+
+  /* A minimal reader object, enough for chunk creation and unpacking */
+  memset(&dd, 0, sizeof(ESL_DSQDATA));
+  dd.abc_r           = abc;
+  dd.pack5           = (abc->type == eslAMINO);
+  dd.unpack_max      = (dd.pack5 ? 6 : 15);
+  dd.chunk_maxseq    = eslDSQDATA_CHUNK_MAXSEQ;
+  dd.chunk_maxpacket = eslDSQDATA_CHUNK_MAXPACKET;
+  chu = dsqdata_chunk_Create(&dd);
+  psq = malloc(sizeof(uint32_t) * dd.chunk_maxpacket);
+
+  /* Fill a chunk with random sequences. Metadata: empty name/acc/desc, taxid -1. */
+  esl_vec_DSet(fq, abc->K, 1.0 / (double) abc->K);
+  for (i = 0; i < dd.chunk_maxseq; i++)
+    {
+      L = esl_rnd_Roll(rng, L_max+1);
+      if (chu->pn + ESL_MAX(1, (L+5)/6) > dd.chunk_maxpacket) break;  // worst case is all 5-bit packets
+      if (esl_random(rng) < fdirty) esl_rsq_SampleDirty(rng, abc, NULL, L, dsq);
+      else                          esl_rsq_xIID(rng, fq, abc->K, L, dsq);
+      if (dd.pack5) dsqdata_pack5(dsq, L, psq + chu->pn, &P);
+      else          dsqdata_pack2(dsq, L, psq + chu->pn, &P);
+      chu->pn += P;
+      nres    += L;
+    }
+  chu->N = i;
+  for (i = 0, ptr = chu->metadata; i < chu->N; i++)
+    {
+      memset(ptr, 0, 3);                 ptr += 3;
+      *((int32_t *) ptr) = -1;           ptr += sizeof(int32_t);
+    }
+
+  dd.unpack5_vec = dd.unpack2_vec = NULL;
+  t_scalar = benchmark_unpacking(&dd, chu, psq, N);
+  dsqdata_select_unpackers(&dd);
+  t_vector = benchmark_unpacking(&dd, chu, psq, N);
+
+  printf("# %d sequences, %" PRId64 " residues, %d packets per chunk\n", chu->N, nres, chu->pn);
+  printf("scalar:       %8.1f Mres/s\n", (double) nres * N / t_scalar / 1e6);
+  printf("vector (%-6s) %8.1f Mres/s\n", (dd.unpack5_vec ? esl_cpu_Get() : "none"), (double) nres * N / t_vector / 1e6);
+
+  free(fq);
+  free(psq);
+  free(dsq);
+  dsqdata_chunk_Destroy(chu);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslDSQDATA_BENCHMARK*/
+
+#ifdef eslDSQDATA_BENCHMARK2
+
+/* compile: make esl_dsqdata_benchmark2
+ * run:     ./esl_dsqdata_benchmark2 [options] [<seqfile>]
+ *
+ * Compares the standard (5-bit packed) and Huffman coded formats of
+ * a protein database: file sizes, single-threaded unpacking rate,
+ * and the time for a threaded reader to scan the whole database.
+ * Sequences come from protein <seqfile>, or by default are sampled
+ * i.i.d. from BLOSUM62 background frequencies.
+ *
+ * Both databases are freshly written, so the scans read them from
+ * the page cache, and measure the CPU cost of each format. The
+ * "disk" line projects what a scan costs when the reader is limited
+ * by reading the files at <--mbps> MB/s, which is where the smaller
+ * format is meant to pay off: projected time is the larger of the
+ * cached scan time and the time to read the bytes the reader loads.
  */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_composition.h"
+#include "esl_dsqdata.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+#include "esl_stopwatch.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default   env  range toggles reqs incomp  help                                                 docgroup*/
+  { "-h",        eslARG_NONE,   FALSE,   NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",                     0 },
+  { "-s",        eslARG_INT,      "0",   NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                            0 },
+  { "-L",        eslARG_INT,    "700",   NULL, "n>0", NULL,  NULL, NULL, "sample sequence lengths uniformly on 0..<n>",              0 },
+  { "-N",        eslARG_INT, "200000",   NULL, "n>0", NULL,  NULL, NULL, "sample <n> sequences",                                     0 },
+  { "-n",        eslARG_INT,      "4",   NULL, "n>0", NULL,  NULL, NULL, "number of unpacker threads in the scan",                   0 },
+  { "--mbps",    eslARG_REAL,   "200",   NULL, "x>0", NULL,  NULL, NULL, "projected disk read speed, MB/s",                          0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] [<protein seqfile>]";
+static char banner[] = "benchmark driver comparing dsqdata formats";
+
+static int64_t
+file_size(const char *basename, const char *sfx)
+{
+  char    *fname = NULL;
+  FILE    *fp;
+  int64_t  n     = 0;
+
+  esl_sprintf(&fname, "%s%s", basename, sfx);
+  if ((fp = fopen(fname, "rb")) != NULL) { fseeko(fp, 0, SEEK_END); n = ftello(fp); fclose(fp); }
+  free(fname);
+  return n;
+}
+
+static void
+remove_db(const char *basename)
+{
+  char *fname = NULL;
+
+  esl_sprintf(&fname, "%s.dsqi", basename); remove(fname);
+  sprintf(fname, "%s.dsqm", basename);      remove(fname);
+  sprintf(fname, "%s.dsqs", basename);      remove(fname);
+  remove(basename);
+  free(fname);
+}
+
+static void
+benchmark_format(ESL_GETOPTS *go, ESL_ALPHABET *abc, char *basename, const char *fmtname)
+{
+  ESL_DSQDATA       *dd    = NULL;
+  ESL_DSQDATA_CHUNK *chu   = NULL;
+  ESL_DSQDATA_CFG   *cfg   = esl_dsqdata_cfg_Create();
+  ESL_DSQDATA_STATS  stats;
+  ESL_STOPWATCH     *w     = esl_stopwatch_Create();
+  double             mbps  = esl_opt_GetReal(go, "--mbps");
+  int64_t            ssize = file_size(basename, ".dsqs");
+  int64_t            total = ssize + file_size(basename, ".dsqm") + file_size(basename, ".dsqi");
+  int64_t            nres  = 0;
+  double             t_unpack, t_scan;
+  int                i;
+
+  /* Single-threaded unpacking rate: the mapped reader unpacks in the consumer */
+  if (esl_dsqdata_OpenMapped(&abc, basename, &dd) != eslOK) esl_fatal("failed to open %s", basename);
+  while (esl_dsqdata_Read(dd, &chu) == eslOK) esl_dsqdata_Recycle(dd, chu);
+  esl_dsqdata_GetStats(dd, &stats);
+  t_unpack = stats.unpack_time;
+  esl_dsqdata_Close(dd);
+
+  /* Threaded scan, touching every residue */
+  esl_stopwatch_Start(w);
+  cfg->n_unpackers = esl_opt_GetInteger(go, "-n");
+  if (esl_dsqdata_Open_adv(cfg, &abc, basename, 1, &dd) != eslOK) esl_fatal("failed to open %s", basename);
+  while (esl_dsqdata_Read(dd, &chu) == eslOK)
+    {
+      for (i = 0; i < chu->N; i++) nres += chu->L[i];
+      esl_dsqdata_Recycle(dd, chu);
+    }
+  esl_dsqdata_GetStats(dd, &stats);
+  esl_dsqdata_Close(dd);
+  esl_stopwatch_Stop(w);
+  t_scan = w->elapsed;
+
+  printf("%-10s %12" PRId64 " %12" PRId64 " %8.3f %10.1f %10.3f %10.3f\n",
+	 fmtname, ssize, total, (double) ssize * 8. / (double) ESL_MAX(1, nres),
+	 (double) nres / t_unpack / 1e6, t_scan,
+	 ESL_MAX(t_scan, (double) stats.load_bytes / (mbps * 1e6)));
+  esl_dsqdata_cfg_Destroy(cfg);
+  esl_stopwatch_Destroy(w);
+}
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS        *go      = esl_getopts_CreateDefaultApp(options, -1, argc, argv, banner, usage);
+  ESL_RANDOMNESS     *rng     = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET       *abc     = esl_alphabet_Create(eslAMINO);
+  ESL_SQ             *sq      = esl_sq_CreateDigital(abc);
+  ESL_SQFILE         *sqfp    = NULL;
+  ESL_DSQDATA_WRITER *w5      = NULL;
+  ESL_DSQDATA_WRITER *wh      = NULL;
+  char               *seqfile = esl_opt_ArgNumber(go) ? esl_opt_GetArg(go, 1) : NULL;
+  char                tmpfile[16] = "esltmpXXXXXX";
+  char                base5[32], baseh[32];
+  FILE               *tmpfp   = NULL;
+  double              fq[20];
+  int                 L_max   = esl_opt_GetInteger(go, "-L");
+  int                 N       = esl_opt_GetInteger(go, "-N");
+  int                 i;
+  int                 status;
+
+  if (esl_opt_ArgNumber(go) > 1)                   esl_fatal("Incorrect number of command line arguments.\nUsage: %s %s\n", argv[0], usage);
+  if (esl_tmpfile_named(tmpfile, &tmpfp) != eslOK) esl_fatal("failed to create tmpfile");
+  fclose(tmpfp);
+  snprintf(base5, 32, "%s-5bit", tmpfile);
+  snprintf(baseh, 32, "%s-huff", tmpfile);
+
+  /* Write both databases in one pass */
+  if (esl_dsqdata_writer_Open(abc, base5, 0, 0,                        NULL, &w5) != eslOK) esl_fatal("failed to open writer");
+  if (esl_dsqdata_writer_Open(abc, baseh, 0, eslDSQDATA_FLAGS_HUFFMAN, NULL, &wh) != eslOK) esl_fatal("failed to open writer");
+  if (seqfile)
+    {
+      if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) esl_fatal("failed to open protein sequence file %s", seqfile);
+      while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+	{
+	  if (esl_dsqdata_writer_Append(w5, sq) != eslOK || esl_dsqdata_writer_Append(wh, sq) != eslOK) esl_fatal("append failed");
+	  esl_sq_Reuse(sq);
+	}
+      if (status != eslEOF) esl_fatal("failed to parse %s", seqfile);
+      esl_sqfile_Close(sqfp);
+    }
+  else
+    {
+      esl_composition_BL62(fq);
+      esl_sq_SetName(sq, "seq");
+      for (i = 0; i < N; i++)
+	{
+	  sq->n = esl_rnd_Roll(rng, L_max+1);
+	  esl_sq_GrowTo(sq, sq->n);
+	  esl_rsq_xIID(rng, fq, 20, sq->n, sq->dsq);
+	  if (esl_dsqdata_writer_Append(w5, sq) != eslOK || esl_dsqdata_writer_Append(wh, sq) != eslOK) esl_fatal("append failed");
+	}
+    }
+  if (esl_dsqdata_writer_Close(w5) != eslOK || esl_dsqdata_writer_Close(wh) != eslOK) esl_fatal("failed to write databases");
+
+  printf("# %-8s %12s %12s %8s %10s %10s %10s\n", "format", ".dsqs bytes", "total bytes", "bits/res", "unpack", "scan (s)", "disk (s)");
+  printf("# %-8s %12s %12s %8s %10s %10s %10s\n", "",       "",            "",            "",         "Mres/s", "cached",   "");
+  benchmark_format(go, abc, base5, "5-bit");
+  benchmark_format(go, abc, baseh, "Huffman");
+
+  remove_db(base5);
+  remove_db(baseh);
+  remove(tmpfile);
+  esl_sq_Destroy(sq);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslDSQDATA_BENCHMARK2*/
+/*------------------- end, benchmark ----------------------------*/
 
 
 /*****************************************************************
- * 7. Unit tests
+ * 8. Unit tests
  *****************************************************************/
 #ifdef eslDSQDATA_TESTDRIVE
 
 #include "esl_randomseq.h"
+#include "esl_vectorops.h"
 
 /* Exercise the packing and unpacking routines:
  *    dsqdata_pack2, dsqdata_pack5, and dsqdata_unpack
@@ -1518,8 +3639,8 @@ utest_packing(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nsamples)
       else                       { if ( dsqdata_pack2(dsq, L, psq, &P) != eslOK) esl_fatal(msg); }
 
       dsq2[0] = eslDSQ_SENTINEL;  // interface to _unpack functions requires caller to do this
-      if (abc->type == eslAMINO) { if ( dsqdata_unpack5(psq, dsq2, &L2, &P2) != eslOK) esl_fatal(msg); }
-      else                       { if ( dsqdata_unpack2(psq, dsq2, &L2, &P2) != eslOK) esl_fatal(msg); }
+      if (abc->type == eslAMINO) { if ( dsqdata_unpack5(psq, P, dsq2, NULL, &L2, &P2) != eslOK) esl_fatal(msg); }
+      else                       { if ( dsqdata_unpack2(psq, P, dsq2, NULL, &L2, &P2) != eslOK) esl_fatal(msg); }
 
       if (L2 != L)                                       esl_fatal(msg);
       if (P2 != P)                                       esl_fatal(msg);
@@ -1537,8 +3658,98 @@ utest_packing(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nsamples)
 }
 
 
+/* Compare each vectorized unpacking kernel that this processor
+ * supports to the scalar reference implementation, on a chunk's worth
+ * of <nseq> random sequences that's unpacked in place the way the
+ * threaded reader does it, with the packed data at the end of the
+ * unpacked data's allocation. Every other sequence is dirty, so DNA
+ * gets a mix of 2-bit and 5-bit packets.
+ */
+static void
+utest_vector_unpacking(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nseq)
+{
+  char      msg[]   = "esl_dsqdata :: vector unpacking unit test failed";
+  int     (*vecf[4])(const uint32_t *, int, ESL_DSQ *);
+  int       nvec    = 0;
+  int       L_max   = 1000;
+  double   *fq      = NULL;
+  ESL_DSQ  *dsq     = NULL;
+  uint32_t *psq     = NULL;  // packed sequences, concatenated
+  ESL_DSQ  *ref     = NULL;  // scalar unpacking of <psq>
+  ESL_DSQ  *smem    = NULL;  // in-place vector unpacking of <psq>
+  int       pn      = 0;
+  int       U, r, pos, i, k, L, P, L2, P2;
+
+#ifdef eslENABLE_AVX512
+  if (esl_cpu_has_avx512()) vecf[nvec++] = (abc->type == eslAMINO ? esl_dsqdata_unpack5_avx512 : esl_dsqdata_unpack2_avx512);
+#endif
+#ifdef eslENABLE_AVX
+  if (esl_cpu_has_avx())    vecf[nvec++] = (abc->type == eslAMINO ? esl_dsqdata_unpack5_avx    : esl_dsqdata_unpack2_avx);
+#endif
+#ifdef eslENABLE_SSE4
+  if (esl_cpu_has_sse4())   vecf[nvec++] = (abc->type == eslAMINO ? esl_dsqdata_unpack5_sse    : esl_dsqdata_unpack2_sse);
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  vecf[nvec++] = (abc->type == eslAMINO ? esl_dsqdata_unpack5_neon : esl_dsqdata_unpack2_neon);
+#endif
+
+  if ((fq   = malloc(sizeof(double)   * abc->K))                          == NULL) esl_fatal(msg);
+  if ((dsq  = malloc(sizeof(ESL_DSQ)  * (L_max + 2)))                     == NULL) esl_fatal(msg);
+  if ((psq  = malloc(sizeof(uint32_t) * nseq * ESL_MAX(1, (L_max+5)/6)))  == NULL) esl_fatal(msg);
+  esl_vec_DSet(fq, abc->K, 1.0 / (double) abc->K);
+
+  for (i = 0; i < nseq; i++)
+    {
+      L = esl_rnd_Roll(rng, L_max+1);
+      if (i % 2) esl_rsq_SampleDirty(rng, abc, NULL, L, dsq);
+      else       esl_rsq_xIID(rng, fq, abc->K, L, dsq);
+      if (abc->type == eslAMINO) dsqdata_pack5(dsq, L, psq + pn, &P);
+      else                       dsqdata_pack2(dsq, L, psq + pn, &P);
+      pn += P;
+    }
+
+  /* Same size calculation as dsqdata_chunk_Create(), with pn packets */
+  U = (abc->type == eslAMINO ? 6 * pn : 15 * pn) + nseq + 1;
+  if ((ref  = malloc(sizeof(ESL_DSQ) * U)) == NULL) esl_fatal(msg);
+  if ((smem = malloc(sizeof(ESL_DSQ) * U)) == NULL) esl_fatal(msg);
+
+  ref[0] = eslDSQ_SENTINEL;
+  for (i = 0, r = 0, pos = 0; i < nseq; i++)
+    {
+      if (abc->type == eslAMINO) dsqdata_unpack5(psq + pos, pn - pos, ref + r, NULL, &L, &P);
+      else                       dsqdata_unpack2(psq + pos, pn - pos, ref + r, NULL, &L, &P);
+      r += L+1; pos += P;
+    }
+  if (pos != pn) esl_fatal(msg);
+
+  for (k = 0; k < nvec; k++)
+    {
+      memcpy(smem + U - 4*pn, psq, sizeof(uint32_t) * pn);
+      smem[0] = eslDSQ_SENTINEL;
+      for (i = 0, r = 0, pos = 0; i < nseq; i++)
+	{
+	  if (abc->type == eslAMINO) dsqdata_unpack5((uint32_t *) (smem + U - 4*pn) + pos, pn - pos, smem + r, vecf[k], &L2, &P2);
+	  else                       dsqdata_unpack2((uint32_t *) (smem + U - 4*pn) + pos, pn - pos, smem + r, vecf[k], &L2, &P2);
+	  r += L2+1; pos += P2;
+	}
+      if (pos != pn)                  esl_fatal(msg);
+      if (memcmp(ref, smem, r+1) != 0) esl_fatal(msg);
+    }
+
+  free(fq);
+  free(dsq);
+  free(psq);
+  free(ref);
+  free(smem);
+}
+
+
+/* Write a random database and read it back, either with the
+ * threaded reader using <n_unpackers> unpacker threads, or 
+ * (<do_mapped> TRUE) the memory-mapped one.
+ */
 static void
-utest_readwrite(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc)
+utest_readwrite(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int do_mapped, int n_unpackers)
 {
   char               msg[]         = "esl_dsqdata :: readwrite unit test failed";
   char               tmpfile[16]   = "esltmpXXXXXX";
@@ -1548,8 +3759,11 @@ utest_readwrite(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc)
   ESL_SQFILE        *sqfp          = NULL;
   ESL_DSQDATA       *dd            = NULL;
   ESL_DSQDATA_CHUNK *chu           = NULL;
+  ESL_DSQDATA_CFG   *cfg           = esl_dsqdata_cfg_Create();
+  ESL_DSQDATA_STATS  stats;
   int               nseq           = 1 + esl_rnd_Roll(rng, 20000);  // 1..20000
   int               maxL           = 100;
+  int64_t           nres           = 0;
   int               i;
   int               status;
 
@@ -1566,6 +3780,7 @@ utest_readwrite(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc)
       if (( status = esl_sq_Sample(rng, abc, maxL, &(sqarr[i])))              != eslOK) esl_fatal(msg);
       if (( status = esl_sq_SetAccession(sqarr[i], ""))                       != eslOK) esl_fatal(msg);
       if (( status = esl_sqio_Write(tmpfp, sqarr[i], eslSQFILE_FASTA, FALSE)) != eslOK) esl_fatal(msg);
+      nres += sqarr[i]->n;
     }
   fclose(tmpfp);
 
@@ -1578,7 +3793,9 @@ utest_readwrite(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc)
 
   /* 3.  Open and read the dsqdata; compare to the original sequences.
    */
-  if    (( status = esl_dsqdata_Open(&abc, basename, 1, &dd)) != eslOK)  esl_fatal(msg);
+  cfg->n_unpackers = n_unpackers;
+  if (do_mapped) { if (( status = esl_dsqdata_OpenMapped(&abc, basename, &dd))       != eslOK) esl_fatal(msg); }
+  else           { if (( status = esl_dsqdata_Open_adv(cfg, &abc, basename, 1, &dd)) != eslOK) esl_fatal(msg); }
   while (( status = esl_dsqdata_Read(dd, &chu)) == eslOK)
     {
       for (i = 0; i < chu->N; i++) 
@@ -1593,8 +3810,207 @@ utest_readwrite(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc)
       esl_dsqdata_Recycle(dd, chu);
     }
   if (status != eslEOF) esl_fatal(msg);
+
+  /* 4.  The unpackers account for every residue.
+   */
+  if ( esl_dsqdata_GetStats(dd, &stats) != eslOK) esl_fatal(msg);
+  if ( stats.unpack_nres != nres)                 esl_fatal(msg);
+  esl_dsqdata_Close(dd);
+  esl_dsqdata_cfg_Destroy(cfg);
+
+  remove(tmpfile);
+  remove(basename);
+  snprintf(basename, 32, "%s-db.dsqi", tmpfile); remove(basename);
+  snprintf(basename, 32, "%s-db.dsqm", tmpfile); remove(basename);
+  snprintf(basename, 32, "%s-db.dsqs", tmpfile); remove(basename);
+  for (i = 0; i < nseq; i++) esl_sq_Destroy(sqarr[i]);
+  free(sqarr);
+}
+
+
+/* Create a random database with the appender, using <n_packers>
+ * packer threads, format <flags>, and small random chunk sizes, so
+ * there are many chunks in flight; read it back. Unlike FASTA, this
+ * round trip preserves accessions and taxids, so check them too.
+ * Also, an aborted writer leaves no files behind.
+ */
+static void
+utest_writer(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int n_packers, uint32_t flags)
+{
+  char                msg[]         = "esl_dsqdata :: writer unit test failed";
+  char                tmpfile[16]   = "esltmpXXXXXX";
+  char                basename[32];
+  char                dsqfile[40];
+  ESL_SQ            **sqarr         = NULL;
+  FILE               *tmpfp         = NULL;
+  ESL_DSQDATA_WRITER *w             = NULL;
+  ESL_DSQDATA        *dd            = NULL;
+  ESL_DSQDATA_CHUNK  *chu           = NULL;
+  int                 nseq          = 1 + esl_rnd_Roll(rng, 20000);  // 1..20000
+  int                 maxL          = 100;
+  int64_t             nres          = 0;
+  int64_t             nread         = 0;
+  uint64_t            max_seqlen    = 0;
+  int                 i;
+  int                 status;
+
+  /* We only need the tmpfile for a unique basename */
+  if (( status = esl_tmpfile_named(tmpfile, &tmpfp)) != eslOK) esl_fatal(msg);
+  fclose(tmpfp);
+  if ( snprintf(basename, 32, "%s-db", tmpfile) <= 0)   esl_fatal(msg);
+
+  if (( sqarr = malloc(sizeof(ESL_SQ *) * nseq)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      sqarr[i] = NULL;
+      if (( status = esl_sq_Sample(rng, abc, maxL, &(sqarr[i])))     != eslOK) esl_fatal(msg);
+      if (( status = esl_sq_FormatAccession(sqarr[i], "ACC%d", i))   != eslOK) esl_fatal(msg);
+      sqarr[i]->tax_id = (esl_rnd_Roll(rng, 2) ? -1 : esl_rnd_Roll(rng, 1000000));
+      nres       += sqarr[i]->n;
+      max_seqlen  = ESL_MAX(max_seqlen, sqarr[i]->n);
+    }
+
+  if (( status = esl_dsqdata_writer_Open(abc, basename, n_packers, flags, NULL, &w)) != eslOK) esl_fatal(msg);
+  w->chunk_maxres = 1 + esl_rnd_Roll(rng, 10000);
+  for (i = 0; i < nseq; i++)
+    if (( status = esl_dsqdata_writer_Append(w, sqarr[i])) != eslOK) esl_fatal(msg);
+  if (( status = esl_dsqdata_writer_Close(w)) != eslOK) esl_fatal(msg);
+
+  if (( status = esl_dsqdata_Open(&abc, basename, 1, &dd)) != eslOK) esl_fatal(msg);
+  if ( dd->nseq != nseq || dd->nres != nres || dd->max_seqlen != max_seqlen) esl_fatal(msg);
+  if ( dd->flags != (abc->type == eslAMINO ? flags : 0))                    esl_fatal(msg);
+  while (( status = esl_dsqdata_Read(dd, &chu)) == eslOK)
+    {
+      for (i = 0; i < chu->N; i++) 
+	{
+	  if ( chu->L[i]          != sqarr[i+chu->i0]->n )                   esl_fatal(msg);
+	  if ( memcmp( chu->dsq[i],  sqarr[i+chu->i0]->dsq, chu->L[i]) != 0) esl_fatal(msg);
+	  if ( strcmp( chu->name[i], sqarr[i+chu->i0]->name)           != 0) esl_fatal(msg);
+	  if ( strcmp( chu->acc[i],  sqarr[i+chu->i0]->acc)            != 0) esl_fatal(msg);
+	  if ( strcmp( chu->desc[i], sqarr[i+chu->i0]->desc)           != 0) esl_fatal(msg);
+	  if ( chu->taxid[i]      != sqarr[i+chu->i0]->tax_id)               esl_fatal(msg);
+	}
+      nread += chu->N;
+      esl_dsqdata_Recycle(dd, chu);
+    }
+  if (status != eslEOF) esl_fatal(msg);
+  if (nread  != nseq)   esl_fatal(msg);
   esl_dsqdata_Close(dd);
 
+  /* Abort() removes the partial database */
+  if (( status = esl_dsqdata_writer_Open(abc, basename, n_packers, flags, NULL, &w)) != eslOK) esl_fatal(msg);
+  w->chunk_maxres = 1 + esl_rnd_Roll(rng, 10000);
+  for (i = 0; i < nseq/2; i++)
+    if (( status = esl_dsqdata_writer_Append(w, sqarr[i])) != eslOK) esl_fatal(msg);
+  esl_dsqdata_writer_Abort(w);
+  if ( esl_FileExists(basename)) esl_fatal(msg);
+  snprintf(dsqfile, 40, "%s.dsqi", basename); if (esl_FileExists(dsqfile)) esl_fatal(msg);
+  snprintf(dsqfile, 40, "%s.dsqm", basename); if (esl_FileExists(dsqfile)) esl_fatal(msg);
+  snprintf(dsqfile, 40, "%s.dsqs", basename); if (esl_FileExists(dsqfile)) esl_fatal(msg);
+
+  remove(tmpfile);
+  for (i = 0; i < nseq; i++) esl_sq_Destroy(sqarr[i]);
+  free(sqarr);
+}
+
+/* Write a random database; read random ranges of it back, including
+ * empty ones and the whole thing; fetch random sequences and metadata
+ * by index. With the threaded reader, or (<do_mapped> TRUE) the 
+ * memory-mapped one.
+ */
+static void
+utest_range_fetch(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int do_mapped)
+{
+  char               msg[]         = "esl_dsqdata :: range/fetch unit test failed";
+  char               tmpfile[16]   = "esltmpXXXXXX";
+  char               basename[32];
+  ESL_SQ           **sqarr         = NULL;
+  ESL_SQ            *sq            = esl_sq_CreateDigital(abc);
+  FILE              *tmpfp         = NULL;
+  ESL_SQFILE        *sqfp          = NULL;
+  ESL_DSQDATA       *dd            = NULL;
+  ESL_DSQDATA_CHUNK *chu           = NULL;
+  ESL_DSQDATA_CFG   *cfg           = esl_dsqdata_cfg_Create();
+  int                nseq          = 1 + esl_rnd_Roll(rng, 10000);  // 1..10000
+  int                maxL          = 100;
+  int                ntrials       = 10;
+  int64_t            i0, i1, next;
+  int                trial;
+  int                i;
+  int                status;
+
+  /* Same database as utest_readwrite(): random FASTA, without accessions (which FASTA doesn't read) */
+  if (( status = esl_tmpfile_named(tmpfile, &tmpfp)) != eslOK) esl_fatal(msg);
+  if (( sqarr = malloc(sizeof(ESL_SQ *) * nseq))      == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)   
+    {
+      sqarr[i] = NULL;
+      if (( status = esl_sq_Sample(rng, abc, maxL, &(sqarr[i])))              != eslOK) esl_fatal(msg);
+      if (( status = esl_sq_SetAccession(sqarr[i], ""))                       != eslOK) esl_fatal(msg);
+      if (( status = esl_sqio_Write(tmpfp, sqarr[i], eslSQFILE_FASTA, FALSE)) != eslOK) esl_fatal(msg);
+    }
+  fclose(tmpfp);
+
+  if (( status = esl_sqfile_OpenDigital(abc, tmpfile, eslSQFILE_FASTA, NULL, &sqfp)) != eslOK) esl_fatal(msg);
+  if ((          snprintf(basename, 32, "%s-db", tmpfile))                           <= 0)     esl_fatal(msg);
+  if (( status = esl_dsqdata_Write(sqfp, basename, NULL))                            != eslOK) esl_fatal(msg);
+  esl_sqfile_Close(sqfp);
+
+  /* Ranges: trial 0 reads everything; trial 1 an empty range; the rest are random */
+  for (trial = 0; trial < ntrials; trial++)
+    {
+      if      (trial == 0) { i0 = 0; i1 = -1; }
+      else if (trial == 1) { i0 = i1 = esl_rnd_Roll(rng, nseq+1); }
+      else                 { i0 = esl_rnd_Roll(rng, nseq+1); i1 = i0 + esl_rnd_Roll(rng, nseq-i0+1); }
+      cfg->i0 = i0;
+      cfg->i1 = i1;
+      if (i1 == -1) i1 = nseq;
+
+      if (do_mapped) { if (( status = esl_dsqdata_OpenMapped_adv(cfg, &abc, basename, &dd))  != eslOK) esl_fatal(msg); }
+      else           { if (( status = esl_dsqdata_Open_adv      (cfg, &abc, basename, 1, &dd)) != eslOK) esl_fatal(msg); }
+      next = i0;
+      while (( status = esl_dsqdata_Read(dd, &chu)) == eslOK)
+	{
+	  if (chu->i0 != next) esl_fatal(msg);
+	  for (i = 0; i < chu->N; i++) 
+	    {
+	      if ( chu->L[i]          != sqarr[i+chu->i0]->n )                   esl_fatal(msg);
+	      if ( memcmp( chu->dsq[i],  sqarr[i+chu->i0]->dsq, chu->L[i]) != 0) esl_fatal(msg);
+	      if ( strcmp( chu->name[i], sqarr[i+chu->i0]->name)           != 0) esl_fatal(msg);
+	      if ( strcmp( chu->desc[i], sqarr[i+chu->i0]->desc)           != 0) esl_fatal(msg);
+	    }
+	  next += chu->N;
+	  esl_dsqdata_Recycle(dd, chu);
+	}
+      if (status != eslEOF) esl_fatal(msg);
+      if (next   != i1)     esl_fatal(msg);
+
+      /* Random access, to any sequence, whatever range the reader was opened on */
+      for (i = 0; i < 10; i++)
+	{
+	  next = esl_rnd_Roll(rng, nseq);
+	  if ( esl_dsqdata_Fetch(dd, next, sq)                            != eslOK) esl_fatal(msg);
+	  if ( sq->idx != next || sq->n != sqarr[next]->n || sq->L != sq->n)        esl_fatal(msg);
+	  if ( memcmp(sq->dsq+1, sqarr[next]->dsq+1, sq->n)               != 0)     esl_fatal(msg);
+	  if ( sq->dsq[0] != eslDSQ_SENTINEL || sq->dsq[sq->n+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+	  if ( strcmp(sq->name, sqarr[next]->name)                        != 0)     esl_fatal(msg);
+	  if ( strcmp(sq->desc, sqarr[next]->desc)                        != 0)     esl_fatal(msg);
+	  esl_sq_Reuse(sq);
+
+	  if ( esl_dsqdata_FetchInfo(dd, next, sq)                        != eslOK) esl_fatal(msg);
+	  if ( sq->idx != next || sq->n != 0 || sq->L != -1)                        esl_fatal(msg);
+	  if ( strcmp(sq->name, sqarr[next]->name)                        != 0)     esl_fatal(msg);
+	  if ( strcmp(sq->desc, sqarr[next]->desc)                        != 0)     esl_fatal(msg);
+	  esl_sq_Reuse(sq);
+	}
+      if ( esl_dsqdata_Fetch(dd, nseq, sq) != eslENOTFOUND) esl_fatal(msg);
+      if ( esl_dsqdata_Fetch(dd, -1,   sq) != eslENOTFOUND) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+      esl_dsqdata_Close(dd);
+    }
+
+  esl_dsqdata_cfg_Destroy(cfg);
+  esl_sq_Destroy(sq);
   remove(tmpfile);
   remove(basename);
   snprintf(basename, 32, "%s-db.dsqi", tmpfile); remove(basename);
@@ -1603,12 +4019,103 @@ utest_readwrite(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc)
   for (i = 0; i < nseq; i++) esl_sq_Destroy(sqarr[i]);
   free(sqarr);
 }
+
+/* Huffman coding of protein databases. Residue frequencies fall off
+ * geometrically, so that rare residues get codes too long for the
+ * decoder's lookup table, and some residues don't appear in the first
+ * chunk that the code is built from. Some sequences have length 0.
+ * Read the database back with the threaded reader or (<do_mapped>)
+ * the mapped one, and fetch random sequences.
+ */
+static void
+utest_huffman(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int do_mapped)
+{
+  char                msg[]         = "esl_dsqdata :: Huffman unit test failed";
+  char                tmpfile[16]   = "esltmpXXXXXX";
+  char                basename[32];
+  char                dsqfile[40];
+  double              p[eslDSQDATA_HUFFMAN_K];
+  ESL_SQ            **sqarr         = NULL;
+  ESL_SQ             *sq            = esl_sq_CreateDigital(abc);
+  FILE               *tmpfp         = NULL;
+  ESL_DSQDATA_WRITER *w             = NULL;
+  ESL_DSQDATA        *dd            = NULL;
+  ESL_DSQDATA_CHUNK  *chu           = NULL;
+  int                 nseq          = 1 + esl_rnd_Roll(rng, 5000);  // 1..5000
+  int                 maxL          = 200;
+  int64_t             nread         = 0;
+  int64_t             i;
+  int                 x, r;
+  int                 status;
+
+  if (( status = esl_tmpfile_named(tmpfile, &tmpfp)) != eslOK) esl_fatal(msg);
+  fclose(tmpfp);
+  if ( snprintf(basename, 32, "%s-db", tmpfile) <= 0)   esl_fatal(msg);
+
+  for (x = 0; x < abc->Kp; x++) p[x] = (x == 0 ? 0.5 : p[x-1] * 0.5);
+  esl_vec_DNorm(p, abc->Kp);
+
+  if (( sqarr = malloc(sizeof(ESL_SQ *) * nseq)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (( sqarr[i] = esl_sq_CreateDigital(abc)) == NULL)         esl_fatal(msg);
+      if (( status   = esl_sq_FormatName(sqarr[i], "seq%d", (int) i)) != eslOK) esl_fatal(msg);
+      if (( status   = esl_sq_GrowTo(sqarr[i], maxL))    != eslOK) esl_fatal(msg);
+      sqarr[i]->n = esl_rnd_Roll(rng, maxL+1);  // 0..maxL
+      sqarr[i]->dsq[0] = eslDSQ_SENTINEL;
+      for (r = 1; r <= sqarr[i]->n; r++) sqarr[i]->dsq[r] = esl_rnd_DChoose(rng, p, abc->Kp);
+      sqarr[i]->dsq[r] = eslDSQ_SENTINEL;
+      esl_sq_SetCoordComplete(sqarr[i], sqarr[i]->n);
+    }
+
+  if (( status = esl_dsqdata_writer_Open(abc, basename, esl_rnd_Roll(rng, 3), eslDSQDATA_FLAGS_HUFFMAN, NULL, &w)) != eslOK) esl_fatal(msg);
+  w->chunk_maxres = 1 + esl_rnd_Roll(rng, 10000);
+  for (i = 0; i < nseq; i++)
+    if (( status = esl_dsqdata_writer_Append(w, sqarr[i])) != eslOK) esl_fatal(msg);
+  if (( status = esl_dsqdata_writer_Close(w)) != eslOK) esl_fatal(msg);
+
+  if (do_mapped) { if (( status = esl_dsqdata_OpenMapped(&abc, basename, &dd))  != eslOK) esl_fatal(msg); }
+  else           { if (( status = esl_dsqdata_Open      (&abc, basename, 1, &dd)) != eslOK) esl_fatal(msg); }
+  if (! (dd->flags & eslDSQDATA_FLAGS_HUFFMAN) || dd->hc == NULL) esl_fatal(msg);
+  while (( status = esl_dsqdata_Read(dd, &chu)) == eslOK)
+    {
+      for (i = 0; i < chu->N; i++) 
+	{
+	  if ( chu->L[i]          != sqarr[i+chu->i0]->n )                     esl_fatal(msg);
+	  if ( memcmp( chu->dsq[i],  sqarr[i+chu->i0]->dsq, chu->L[i]+2) != 0) esl_fatal(msg);
+	  if ( strcmp( chu->name[i], sqarr[i+chu->i0]->name)             != 0) esl_fatal(msg);
+	}
+      nread += chu->N;
+      esl_dsqdata_Recycle(dd, chu);
+    }
+  if (status != eslEOF) esl_fatal(msg);
+  if (nread  != nseq)   esl_fatal(msg);
+
+  for (x = 0; x < 10; x++)
+    {
+      i = esl_rnd_Roll(rng, nseq);
+      if ( esl_dsqdata_Fetch(dd, i, sq)                  != eslOK) esl_fatal(msg);
+      if ( sq->n != sqarr[i]->n)                                   esl_fatal(msg);
+      if ( memcmp(sq->dsq, sqarr[i]->dsq, sq->n+2)       != 0)     esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  esl_dsqdata_Close(dd);
+
+  remove(tmpfile);
+  remove(basename);
+  snprintf(dsqfile, 40, "%s.dsqi", basename); remove(dsqfile);
+  snprintf(dsqfile, 40, "%s.dsqm", basename); remove(dsqfile);
+  snprintf(dsqfile, 40, "%s.dsqs", basename); remove(dsqfile);
+  for (i = 0; i < nseq; i++) esl_sq_Destroy(sqarr[i]);
+  free(sqarr);
+  esl_sq_Destroy(sq);
+}
 #endif /*eslDSQDATA_TESTDRIVE*/
 
 
 
 /*****************************************************************
- * 8. Test driver
+ * 9. Test driver
  *****************************************************************/
 #ifdef eslDSQDATA_TESTDRIVE
 
@@ -1641,9 +4148,31 @@ main(int argc, char **argv)
 
   utest_packing(rng, nucleic, nsamples);
   utest_packing(rng, amino,   nsamples);
+
+  utest_vector_unpacking(rng, nucleic, nsamples);
+  utest_vector_unpacking(rng, amino,   nsamples);
   
-  utest_readwrite(rng, nucleic);
-  utest_readwrite(rng, amino);
+  utest_readwrite(rng, nucleic, FALSE, eslDSQDATA_UNPACKERS);
+  utest_readwrite(rng, amino,   FALSE, eslDSQDATA_UNPACKERS);
+  utest_readwrite(rng, nucleic, FALSE, 1);
+  utest_readwrite(rng, amino,   FALSE, 2*eslDSQDATA_UNPACKERS+1);
+  utest_readwrite(rng, nucleic, TRUE,  0);
+  utest_readwrite(rng, amino,   TRUE,  0);
+
+  utest_writer(rng, nucleic, 0,                  0);
+  utest_writer(rng, amino,   0,                  0);
+  utest_writer(rng, nucleic, 1,                  0);
+  utest_writer(rng, amino,   eslDSQDATA_PACKERS, 0);
+  utest_writer(rng, nucleic, 1,                  eslDSQDATA_FLAGS_HUFFMAN);  // ignored for nucleic
+  utest_writer(rng, amino,   eslDSQDATA_PACKERS, eslDSQDATA_FLAGS_HUFFMAN);
+
+  utest_range_fetch(rng, nucleic, FALSE);
+  utest_range_fetch(rng, amino,   FALSE);
+  utest_range_fetch(rng, nucleic, TRUE);
+  utest_range_fetch(rng, amino,   TRUE);
+
+  utest_huffman(rng, amino, FALSE);
+  utest_huffman(rng, amino, TRUE);
 
   fprintf(stderr, "#  status = ok\n");
 
@@ -1656,7 +4185,7 @@ main(int argc, char **argv)
 #endif /*eslDSQDATA_TESTDRIVE*/
 
 /*****************************************************************
- * 9. Examples
+ * 10. Examples
  *****************************************************************/
 
 /* esl_dsqdata_example2
@@ -1674,6 +4203,8 @@ static ESL_OPTIONS options[] = {
   { "--dna",     eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "use DNA alphabet",                        0 },
   { "--rna",     eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "use RNA alphabet",                        0 },
   { "--amino",   eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "use protein alphabet",                    0 },
+  { "-p",        eslARG_INT,      "4",  NULL, "n>=0",NULL,  NULL, NULL, "use <n> packer threads",                  0 },
+  { "--huffman", eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "Huffman code protein residues",           0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <seqfile_in> <binary seqfile_out>";
@@ -1710,7 +4241,8 @@ main(int argc, char **argv)
   abc = esl_alphabet_Create(alphatype);
   esl_sqfile_SetDigital(sqfp, abc);
 
-  status = esl_dsqdata_Write(sqfp, basename, errbuf);
+  status = esl_dsqdata_Write_adv(sqfp, basename, esl_opt_GetInteger(go, "-p"),
+				 (esl_opt_GetBoolean(go, "--huffman") ? eslDSQDATA_FLAGS_HUFFMAN : 0), errbuf);
   if      (status == eslEWRITE)  esl_fatal("Failed to open dsqdata output files:\n  %s", errbuf);
   else if (status == eslEFORMAT) esl_fatal("Parse failed (sequence file %s)\n  %s", infile, sqfp->get_error(sqfp));
   else if (status != eslOK)      esl_fatal("Unexpected error while creating dsqdata file (code %d)\n", status);
@@ -1737,6 +4269,11 @@ static ESL_OPTIONS options[] = {
   /* name             type          default  env  range toggles reqs incomp  help                                       docgroup*/
   { "-h",          eslARG_NONE,       FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",        0 },
   { "-c",          eslARG_NONE,       FALSE,  NULL, NULL,  NULL,  NULL, NULL, "report summary of chunk contents",            0 },
+  { "-m",          eslARG_NONE,       FALSE,  NULL, NULL,  NULL,  NULL, NULL, "use memory-mapped reader",                    0 },
+  { "-u",          eslARG_INT,          "4",  NULL, "n>0", NULL,  NULL, NULL, "use <n> unpacker threads",                    0 },
+  { "--stats",     eslARG_NONE,       FALSE,  NULL, NULL,  NULL,  NULL, NULL, "report per-stage pipeline accounting",        0 },
+  { "--i0",        eslARG_INT,          "0",  NULL, "n>=0",NULL,  NULL, NULL, "read sequences starting at index <n>",        0 },
+  { "--i1",        eslARG_INT,         "-1",  NULL, NULL,  NULL,  NULL, NULL, "...up to but not including index <n>",        0 },
   { "-r",          eslARG_NONE,       FALSE,  NULL, NULL,  NULL,  NULL, NULL, "report summary of residue counts",            0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -1753,6 +4290,7 @@ main(int argc, char **argv)
   int                do_summary = esl_opt_GetBoolean(go, "-c");
   int                do_resct   = esl_opt_GetBoolean(go, "-r");
   int                ncpu       = 1;
+  ESL_DSQDATA_CFG   *cfg        = esl_dsqdata_cfg_Create();
   ESL_DSQDATA       *dd         = NULL;
   ESL_DSQDATA_CHUNK *chu        = NULL;
   int                nchunk     = 0;
@@ -1762,7 +4300,11 @@ main(int argc, char **argv)
   int                x;
   int                status;
   
-  status = esl_dsqdata_Open(&abc, basename, ncpu, &dd);
+  cfg->n_unpackers = esl_opt_GetInteger(go, "-u");
+  cfg->i0          = esl_opt_GetInteger(go, "--i0");
+  cfg->i1          = esl_opt_GetInteger(go, "--i1");
+  if (esl_opt_GetBoolean(go, "-m")) status = esl_dsqdata_OpenMapped_adv(cfg, &abc, basename, &dd);
+  else                              status = esl_dsqdata_Open_adv(cfg, &abc, basename, ncpu, &dd);
   if      (status == eslENOTFOUND) esl_fatal("Failed to open dsqdata files:\n  %s",    dd->errbuf);
   else if (status == eslEFORMAT)   esl_fatal("Format problem in dsqdata files:\n  %s", dd->errbuf);
   else if (status != eslOK)        esl_fatal("Unexpected error in opening dsqdata (code %d)", status);
@@ -1798,7 +4340,10 @@ main(int argc, char **argv)
       printf("Total = %" PRId64 "\n", total);
     }
 
+  if (esl_opt_GetBoolean(go, "--stats")) esl_dsqdata_DumpStats(stdout, dd);
+
   esl_alphabet_Destroy(abc);
+  esl_dsqdata_cfg_Destroy(cfg);
   esl_dsqdata_Close(dd);
   esl_getopts_Destroy(go);
   return 0;
@@ -10,6 +10,7 @@
 
 #include "easel.h"
 #include "esl_alphabet.h"
+#include "esl_huffman.h"
 #include "esl_sqio.h"
 #ifdef __cplusplus // magic to make C++ compilers happy
 extern "C" {
@@ -19,7 +20,40 @@ extern "C" {
 #define eslDSQDATA_CHUNK_MAXSEQ       4096      // max number of sequences in a chunk
 #define eslDSQDATA_CHUNK_MAXPACKET  262144      // max number of uint32 sequence packets in a chunk (1MiB chunks)
 #define eslDSQDATA_UNPACKERS             4      // default number of unpacker threads
-#define eslDSQDATA_UMAX                  4      // max number of unpacker threads (compile-time)
+#define eslDSQDATA_PACKERS               4      // default number of packer threads, in esl_dsqdata_Write()
+#define eslDSQDATA_WCHUNK_MAXRES   1048576      // max number of residues in a writer's chunk (sequences of any length are ok)
+
+/* Format flags, in the <flags> field of the index file header
+ */
+#define eslDSQDATA_FLAGS_HUFFMAN    (1 << 0)    // protein residues are Huffman coded, not 5-bit packed
+#define eslDSQDATA_HUFFMAN_K        32          // Huffman table in .dsqs header: symbol counts for up to 32 residue codes
+
+
+/* ESL_DSQDATA_CFG
+ * Optional configuration of a reader, for esl_dsqdata_Open_adv()
+ * and esl_dsqdata_OpenMapped_adv().
+ */
+typedef struct {
+  int      n_unpackers;   // number of unpacker threads (>= 1); default eslDSQDATA_UNPACKERS
+  int64_t  i0;            // read only sequences i0..i1-1 (0-offset); default 0
+  int64_t  i1;            //  .. and i1 = -1 means through the last sequence; default -1
+} ESL_DSQDATA_CFG;
+
+
+/* ESL_DSQDATA_STATS
+ * Per-stage accounting of the reader's pipeline, from esl_dsqdata_GetStats(),
+ * for figuring out which stage (disk, unpacking, or consumers) is rate-limiting.
+ * Times are wall clock seconds, summed over all threads in a stage.
+ */
+typedef struct {
+  int64_t  nchunk;         // number of chunks delivered to consumers
+  int64_t  load_bytes;     // bytes of packed sequence and metadata loaded
+  double   load_time;      // time the loader spent in fread()
+  double   load_wait;      // time the loader spent waiting for chunks to be recycled (consumers are behind)
+  int64_t  unpack_nres;    // residues unpacked
+  double   unpack_time;    // time the unpackers spent unpacking
+  double   consumer_wait;  // time consumers spent waiting in esl_dsqdata_Read() (input is behind)
+} ESL_DSQDATA_STATS;
 
 
 /* ESL_DSQDATA_CHUNK
@@ -76,7 +110,7 @@ typedef struct esl_dsqdata_s {
    */
   uint32_t     magic;       // Binary magic format code, for detecting byteswapping
   uint32_t     uniquetag;   // Random number tag that links the four files
-  uint32_t     flags;       // Currently unused (0); reserved for future bitflags
+  uint32_t     flags;       // Format flags: eslDSQDATA_FLAGS_HUFFMAN, or 0
   uint32_t     max_namelen; // Max name length in the dataset
   uint32_t     max_acclen;  //  .. and max accession length
   uint32_t     max_desclen; //  .. and max description length 
@@ -89,6 +123,21 @@ typedef struct esl_dsqdata_s {
   int          chunk_maxpacket; // default = eslDSQDATA_CHUNK_MAXPACKET
   int          do_byteswap;     // TRUE if we need to byteswap (bigendian <=> littleendian)
   int          pack5;           // TRUE if we're using all 5bit packing; FALSE for mixed 2+5bit
+  int          unpack_max;      // max number of residues one packet unpacks to: 6, 15, or (Huffman) 32/(shortest code)
+  int          shdrsize;        // size of .dsqs header in bytes: 8, or more with a Huffman table
+
+  /* Huffman coded protein residues (eslDSQDATA_FLAGS_HUFFMAN): the
+   * database's code, and a decoding lookup table indexed by the next
+   * few bits of input.
+   */
+  ESL_HUFFMAN *hc;
+  uint32_t    *hlut;
+
+  /* Vectorized unpacking kernels, chosen by runtime CPU dispatch when
+   * <dd> is opened; NULL if none is available, and scalar code is used.
+   */
+  int (*unpack5_vec)(const uint32_t *psq, int np, ESL_DSQ *dsq);
+  int (*unpack2_vec)(const uint32_t *psq, int np, ESL_DSQ *dsq);
 
   /* Managing the reader's threaded producer/consumer pipeline:
    * consisting of 1 loader thread and <n_unpackers> unpacker threads
@@ -98,15 +147,15 @@ typedef struct esl_dsqdata_s {
   int                nconsumers;                     // caller told us the reader is being used by this many consumer threads
   int                n_unpackers;                    // number of unpacker threads
 
-  ESL_DSQDATA_CHUNK *inbox[eslDSQDATA_UMAX];         // unpacker input slots
-  pthread_mutex_t    inbox_mutex[eslDSQDATA_UMAX];   // mutexes protecting the inboxes
-  pthread_cond_t     inbox_cv[eslDSQDATA_UMAX];      // signal that state of inbox[u] has changed
-  int                inbox_eod[eslDSQDATA_UMAX];     // flag that inbox[u] is in EOD state
+  ESL_DSQDATA_CHUNK **inbox;                         // unpacker input slots [0..n_unpackers-1]
+  pthread_mutex_t    *inbox_mutex;                   // mutexes protecting the inboxes
+  pthread_cond_t     *inbox_cv;                      // signal that state of inbox[u] has changed
+  int                *inbox_eod;                     // flag that inbox[u] is in EOD state
 
-  ESL_DSQDATA_CHUNK *outbox[eslDSQDATA_UMAX];        // unpacker output slots
-  pthread_mutex_t    outbox_mutex[eslDSQDATA_UMAX];  // mutexes protecting the outboxes
-  pthread_cond_t     outbox_cv[eslDSQDATA_UMAX];     // signal that state of outbox[u] has changed
-  int                outbox_eod[eslDSQDATA_UMAX];    // flag that outbox[u] is in EOD state
+  ESL_DSQDATA_CHUNK **outbox;                        // unpacker output slots [0..n_unpackers-1]
+  pthread_mutex_t    *outbox_mutex;                  // mutexes protecting the outboxes
+  pthread_cond_t     *outbox_cv;                     // signal that state of outbox[u] has changed
+  int                *outbox_eod;                    // flag that outbox[u] is in EOD state
 
   int64_t            nchunk;                         // # of chunks read so far; shared across consumers
   pthread_mutex_t    nchunk_mutex;                   // mutex protecting access to <nchunk> from other consumers
@@ -124,7 +173,38 @@ typedef struct esl_dsqdata_s {
   pthread_cond_t     go_cv;         // Used to signal worker threads that DSQDATA structure is ready.
 
   pthread_t          loader_t;                       // loader thread id
-  pthread_t          unpacker_t[eslDSQDATA_UMAX];    // unpacker thread ids
+  pthread_t         *unpacker_t;                     // unpacker thread ids [0..n_unpackers-1]
+
+  /* Stage accounting, for esl_dsqdata_GetStats(). Each field is
+   * written by only one thread, or under a mutex: loader's by the
+   * loader; unpacker u's in [u]; consumers' under <nchunk_mutex>.
+   */
+  int64_t            load_bytes;
+  double             load_time;
+  double             load_wait;
+  int64_t           *unpack_nres;                    // [0..n_unpackers-1]
+  double            *unpack_time;                    // [0..n_unpackers-1]
+  int64_t            mapped_nres;                    // mapped reader: consumers unpack, under <nchunk_mutex>
+  double             mapped_time;
+  double             consumer_wait;
+
+  /* Memory-mapped reader, opened by esl_dsqdata_OpenMapped(). There
+   * are no loader or unpacker threads; each chunk's <psq> and
+   * <metadata> point straight into the mapped files, and consumers
+   * unpack their own chunks in esl_dsqdata_Read().
+   */
+  int                is_mapped;     // TRUE if <dd> was opened with esl_dsqdata_OpenMapped()
+  unsigned char     *imap;          // mmap()'ed .dsqi index file
+  unsigned char     *smap;          //  .. .dsqs sequence file
+  unsigned char     *mdmap;         //  .. .dsqm metadata file
+  size_t             isize;         // size of <imap> in bytes
+  size_t             ssize;         //  .. <smap>
+  size_t             mdsize;        //  .. <mdmap>
+  int64_t            next_i;        // index of next sequence to be claimed by a Read(); protected by <nchunk_mutex>
+
+  /* Readers can be limited to a range of sequences [range_i0, range_i1); default is [0, nseq) */
+  int64_t            range_i0;
+  int64_t            range_i1;
 
   char errbuf[eslERRBUFSIZE];   // User-directed error message in case of a failed open or read.
 } ESL_DSQDATA;  
@@ -133,6 +213,92 @@ typedef struct esl_dsqdata_s {
 
 
 
+/* ESL_DSQDATA_WCHUNK
+ * A chunk of sequences being written by an ESL_DSQDATA_WRITER: filled
+ * by esl_dsqdata_writer_Append(), packed by a packer thread, written
+ * by the writer thread.
+ */
+typedef struct esl_dsqdata_wchunk_s {
+  int64_t   idx;                // chunk number, 0..; chunks are written in this order
+  int       N;                  // chunk contains N sequences
+  ESL_DSQ  *dsq;                // the N digital seqs, concatenated with shared sentinels; dsq[0] is the first one's leading sentinel
+  int64_t  *L;                  // sequence lengths [0..N-1]
+  int64_t   nres;               // total residues in <dsq>
+  int64_t   dalloc;             // current allocation of <dsq>, in bytes
+  char     *metadata;           // N name\0 acc\0 desc\0 taxid records, concatenated
+  int64_t   mn;                 // bytes used in <metadata>
+  int64_t   mdalloc;            // current allocation of <metadata>, in bytes
+  uint32_t *psq;                // packed sequences, filled in by a packer
+  int64_t   pn;                 // number of packets in <psq>
+  int64_t   palloc;             // current allocation of <psq>, in packets
+  ESL_DSQDATA_RECORD *rec;      // index records [0..N-1], relative to the chunk until the writer adds file offsets
+  struct esl_dsqdata_wchunk_s *nxt;
+} ESL_DSQDATA_WCHUNK;
+
+
+/* ESL_DSQDATA_WRITER
+ * Creates a dsqdata database from sequences that the caller appends
+ * one at a time: esl_dsqdata_writer_Open(), _Append(), _Close().
+ * 
+ * The caller's thread fills chunks of sequences; <n_packers> packer
+ * threads pack them; one writer thread writes them, in order. With
+ * <n_packers> = 0, there are no threads: the caller's thread packs
+ * and writes each chunk when it fills up.
+ */
+typedef struct esl_dsqdata_writer_s {
+  char               *basename;     // base name of the four dsqdata files
+  FILE               *stubfp;       // open <basename> stub file
+  FILE               *ifp;          //  .. basename.dsqi index file
+  FILE               *mfp;          //  .. basename.dsqm metadata file
+  FILE               *sfp;          //  .. basename.dsqs sequence file
+  const ESL_ALPHABET *abc;          // alphabet of the sequences
+  char               *srcfile;      // optional name of the original sequence file, for the stub; or NULL
+  int                 srcformat;    //  .. and its format; or eslSQFILE_UNKNOWN
+
+  /* Index header information, accumulated as sequences are appended,
+   * and written when the writer is closed.
+   */
+  uint32_t            uniquetag;    // random number tag that links the four files
+  uint32_t            flags;        // format flags: eslDSQDATA_FLAGS_HUFFMAN, or 0
+  int                 pack5;        // TRUE for all 5-bit packing (protein); FALSE for mixed 2+5bit (nucleic)
+  ESL_HUFFMAN        *hc;           // Huffman code for residues, built from the first chunk; or NULL
+  uint32_t            hcount[eslDSQDATA_HUFFMAN_K]; // residue counts that <hc> was built from, saved in the .dsqs header
+  uint32_t            max_namelen;
+  uint32_t            max_acclen;
+  uint32_t            max_desclen;
+  uint64_t            max_seqlen;
+  uint64_t            nseq;
+  uint64_t            nres;
+  int64_t             spos;         // number of packets written to .dsqs so far
+  int64_t             mpos;         //  .. and bytes of metadata written to .dsqm
+
+  int                 chunk_maxseq; // a chunk is submitted when it has this many sequences
+  int64_t             chunk_maxres; //  .. or at least this many residues
+  ESL_DSQDATA_WCHUNK *cur;          // chunk being filled by esl_dsqdata_writer_Append()
+
+  /* The packer/writer pipeline. Everything below <n_packers> is
+   * protected by <mutex>.
+   */
+  int                 n_packers;    // number of packer threads (0 = no threads)
+  int                 nchunk_max;   // max number of chunks in the pipeline
+  int                 nchunk_alloc; //  .. and number allocated so far
+  int64_t             nsubmitted;   // number of chunks submitted for packing
+  int64_t             nwritten;     // number of chunks written; also, the index of the next chunk to write
+  ESL_DSQDATA_WCHUNK *todo;         // FIFO queue of chunks for packers
+  ESL_DSQDATA_WCHUNK *todo_tail;    //  .. its tail, where chunks are added
+  ESL_DSQDATA_WCHUNK *done;         // packed chunks, in order of <idx>, for the writer
+  ESL_DSQDATA_WCHUNK *recycling;    // written chunks, free for reuse
+  int                 eod;          // TRUE when no more chunks will be submitted
+  int                 wstatus;      // eslOK, or the first error the writer thread got
+  pthread_mutex_t     mutex;
+  pthread_cond_t      todo_cv;      // signal to packers that <todo> has a chunk (or <eod>)
+  pthread_cond_t      done_cv;      // signal to writer that <done> has a chunk (or <eod>)
+  pthread_cond_t      free_cv;      // signal to appender that <recycling> has a chunk
+  pthread_t           writer_t;     // writer thread id
+  pthread_t          *packer_t;     // packer thread ids [0..n_packers-1]
+} ESL_DSQDATA_WRITER;
+
+
 /* Reading the control bits on a packet v
  */
 #define eslDSQDATA_EOD   (1 << 31)
@@ -143,11 +309,49 @@ typedef struct esl_dsqdata_s {
 /* Functions in the API
  */
 extern int  esl_dsqdata_Open   (ESL_ALPHABET **byp_abc, char *basename, int nconsumers, ESL_DSQDATA **ret_dd);
+extern int  esl_dsqdata_Open_adv(const ESL_DSQDATA_CFG *cfg, ESL_ALPHABET **byp_abc, char *basename, int nconsumers, ESL_DSQDATA **ret_dd);
+extern int  esl_dsqdata_OpenMapped(ESL_ALPHABET **byp_abc, char *basename, ESL_DSQDATA **ret_dd);
+extern int  esl_dsqdata_OpenMapped_adv(const ESL_DSQDATA_CFG *cfg, ESL_ALPHABET **byp_abc, char *basename, ESL_DSQDATA **ret_dd);
 extern int  esl_dsqdata_Read   (ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK **ret_chu);
 extern int  esl_dsqdata_Recycle(ESL_DSQDATA *dd, ESL_DSQDATA_CHUNK *chu);
 extern int  esl_dsqdata_Close  (ESL_DSQDATA *dd);
 
-extern int  esl_dsqdata_Write  (ESL_SQFILE *sqfp, char *basename, char *errbuf);
+extern int  esl_dsqdata_Fetch    (ESL_DSQDATA *dd, int64_t i, ESL_SQ *sq);
+extern int  esl_dsqdata_FetchInfo(ESL_DSQDATA *dd, int64_t i, ESL_SQ *sq);
+
+extern ESL_DSQDATA_CFG *esl_dsqdata_cfg_Create(void);
+extern void             esl_dsqdata_cfg_Destroy(ESL_DSQDATA_CFG *cfg);
+
+extern int  esl_dsqdata_GetStats (ESL_DSQDATA *dd, ESL_DSQDATA_STATS *ret_stats);
+extern int  esl_dsqdata_DumpStats(FILE *fp, ESL_DSQDATA *dd);
+
+extern int  esl_dsqdata_Write    (ESL_SQFILE *sqfp, char *basename, char *errbuf);
+extern int  esl_dsqdata_Write_adv(ESL_SQFILE *sqfp, char *basename, int n_packers, uint32_t flags, char *errbuf);
+
+extern int  esl_dsqdata_writer_Open  (const ESL_ALPHABET *abc, char *basename, int n_packers, uint32_t flags, char *errbuf, ESL_DSQDATA_WRITER **ret_w);
+extern int  esl_dsqdata_writer_Append(ESL_DSQDATA_WRITER *w, const ESL_SQ *sq);
+extern int  esl_dsqdata_writer_Close (ESL_DSQDATA_WRITER *w);
+extern void esl_dsqdata_writer_Abort (ESL_DSQDATA_WRITER *w);
+
+/* Vectorized unpacking kernels, in esl_dsqdata_{sse,avx,avx512,neon}.c
+ */
+#ifdef eslENABLE_SSE4
+extern int  esl_dsqdata_unpack5_sse   (const uint32_t *psq, int np, ESL_DSQ *dsq);
+extern int  esl_dsqdata_unpack2_sse   (const uint32_t *psq, int np, ESL_DSQ *dsq);
+#endif
+#ifdef eslENABLE_AVX
+extern int  esl_dsqdata_unpack5_avx   (const uint32_t *psq, int np, ESL_DSQ *dsq);
+extern int  esl_dsqdata_unpack2_avx   (const uint32_t *psq, int np, ESL_DSQ *dsq);
+#endif
+#ifdef eslENABLE_AVX512
+extern int  esl_dsqdata_unpack5_avx512(const uint32_t *psq, int np, ESL_DSQ *dsq);
+extern int  esl_dsqdata_unpack2_avx512(const uint32_t *psq, int np, ESL_DSQ *dsq);
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+extern int  esl_dsqdata_unpack5_neon  (const uint32_t *psq, int np, ESL_DSQ *dsq);
+extern int  esl_dsqdata_unpack2_neon  (const uint32_t *psq, int np, ESL_DSQ *dsq);
+#endif
+
 #ifdef __cplusplus // magic to make C++ compilers happy
 }
 #endif
@@ -0,0 +1,131 @@
+/* Vectorized unpacking of dsqdata packets: x86 AVX2 implementation.
+ *
+ * Same as the SSE4 kernels in esl_dsqdata_sse.c (see there for notes,
+ * including why stores must be exact), eight packets at a time. AVX2
+ * byte shuffles work within each 128-bit lane, so each lane unpacks
+ * four packets exactly as the SSE4 code does, and the two lanes are
+ * stored one after the other.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_AVX> was
+ * set in <esl_config.h> by the configure script. When it is not set,
+ * we include some dummy code to silence compiler and ranlib warnings
+ * about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_AVX
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_dsqdata.h"
+
+
+/* Function:  esl_dsqdata_unpack5_avx()
+ * Synopsis:  Unpack a run of full 5-bit packets, AVX2 version.
+ *
+ * Purpose:   As <esl_dsqdata_unpack5_sse()>, but eight packets
+ *            (48 residues) at a time.
+ *
+ *            Where it stops, the narrower SSE4 kernel takes over,
+ *            so short sequences and tails of long ones still get
+ *            some vector unpacking.
+ *
+ * Returns:   the number of packets unpacked, <P>, possibly 0.
+ */
+int
+esl_dsqdata_unpack5_avx(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  const __m256i shuf_u_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8( 0,  1,  2,  3, -1, -1,  4,  5,  6,  7, -1, -1,  8,  9, 10, 11));
+  const __m256i shuf_w_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1,  0,  1, -1, -1, -1, -1,  4,  5, -1, -1, -1, -1));
+  const __m256i shuf_u_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+  const __m256i shuf_w_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8( 8,  9, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1));
+  __m256i v, u, w, lo, hi;
+  int     P;
+
+  for (P = 0; P+8 <= np; P += 8)
+    {
+      v = _mm256_loadu_si256((const __m256i *) (psq + P));
+      if (_mm256_movemask_ps(_mm256_castsi256_ps(v))) break;   // an EOD packet is in this group
+
+      u = _mm256_or_si256( _mm256_or_si256( _mm256_and_si256(_mm256_srli_epi32(v, 25), _mm256_set1_epi32(0x0000001f)),
+                                            _mm256_and_si256(_mm256_srli_epi32(v, 12), _mm256_set1_epi32(0x00001f00))),
+                           _mm256_or_si256( _mm256_and_si256(_mm256_slli_epi32(v,  1), _mm256_set1_epi32(0x001f0000)),
+                                            _mm256_and_si256(_mm256_slli_epi32(v, 14), _mm256_set1_epi32(0x1f000000))));
+      w = _mm256_or_si256(   _mm256_and_si256(_mm256_srli_epi32(v,  5), _mm256_set1_epi32(0x0000001f)),
+                             _mm256_and_si256(_mm256_slli_epi32(v,  8), _mm256_set1_epi32(0x00001f00)));
+
+      lo = _mm256_or_si256(_mm256_shuffle_epi8(u, shuf_u_lo), _mm256_shuffle_epi8(w, shuf_w_lo));
+      hi = _mm256_or_si256(_mm256_shuffle_epi8(u, shuf_u_hi), _mm256_shuffle_epi8(w, shuf_w_hi));
+      _mm_storeu_si128((__m128i *) (dsq + 6*P),      _mm256_castsi256_si128(lo));
+      _mm_storel_epi64((__m128i *) (dsq + 6*P + 16), _mm256_castsi256_si128(hi));
+      _mm_storeu_si128((__m128i *) (dsq + 6*P + 24), _mm256_extracti128_si256(lo, 1));
+      _mm_storel_epi64((__m128i *) (dsq + 6*P + 40), _mm256_extracti128_si256(hi, 1));
+    }
+
+#ifdef eslENABLE_SSE4
+  P += esl_dsqdata_unpack5_sse(psq + P, np - P, dsq + 6*P);
+#endif
+  return P;
+}
+
+
+/* Function:  esl_dsqdata_unpack2_avx()
+ * Synopsis:  Unpack a run of full 2-bit packets, AVX2 version.
+ *
+ * Purpose:   As <esl_dsqdata_unpack2_sse()>, but eight packets
+ *            (120 residues) at a time.
+ *
+ *            Where it stops, the narrower SSE4 kernel takes over,
+ *            so short sequences and tails of long ones still get
+ *            some vector unpacking.
+ *
+ * Returns:   the number of packets unpacked, <P>, possibly 0.
+ */
+int
+esl_dsqdata_unpack2_avx(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  const __m256i rev = _mm256_broadcastsi128_si256(_mm_setr_epi8(14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0));
+  const __m256i m3  = _mm256_set1_epi8(3);
+  __m256i v, x0, x2, x4, x6, a, b, c, d, p0, p1, p2, p3, p3s;
+  int     P;
+
+  for (P = 0; P+8 <= np; P += 8)
+    {
+      v = _mm256_loadu_si256((const __m256i *) (psq + P));
+      if (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(v, _mm256_slli_epi32(v, 1))))) break; // EOD or 5-bit packet in this group
+
+      x0 = _mm256_and_si256(v,                        m3);
+      x2 = _mm256_and_si256(_mm256_srli_epi32(v, 2),  m3);
+      x4 = _mm256_and_si256(_mm256_srli_epi32(v, 4),  m3);
+      x6 = _mm256_and_si256(_mm256_srli_epi32(v, 6),  m3);
+
+      a   = _mm256_unpacklo_epi8(x0, x2);   // packets 0,1 | 4,5
+      b   = _mm256_unpacklo_epi8(x4, x6);
+      c   = _mm256_unpackhi_epi8(x0, x2);   // packets 2,3 | 6,7
+      d   = _mm256_unpackhi_epi8(x4, x6);
+      p0  = _mm256_shuffle_epi8(_mm256_unpacklo_epi16(a, b), rev);
+      p1  = _mm256_shuffle_epi8(_mm256_unpackhi_epi16(a, b), rev);
+      p2  = _mm256_shuffle_epi8(_mm256_unpacklo_epi16(c, d), rev);
+      p3  = _mm256_shuffle_epi8(_mm256_unpackhi_epi16(c, d), rev);
+      p3s = _mm256_alignr_epi8(p3, p2, 15);
+
+      _mm_storeu_si128((__m128i *) (dsq + 15*P),       _mm256_castsi256_si128(p0));
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 15),  _mm256_castsi256_si128(p1));
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 30),  _mm256_castsi256_si128(p2));
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 44),  _mm256_castsi256_si128(p3s));
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 60),  _mm256_extracti128_si256(p0,  1));
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 75),  _mm256_extracti128_si256(p1,  1));
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 90),  _mm256_extracti128_si256(p2,  1));
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 104), _mm256_extracti128_si256(p3s, 1));
+    }
+
+#ifdef eslENABLE_SSE4
+  P += esl_dsqdata_unpack2_sse(psq + P, np - P, dsq + 15*P);
+#endif
+  return P;
+}
+
+#else // ! eslENABLE_AVX
+void esl_dsqdata_avx_silence_hack(void) { return; }
+#endif // eslENABLE_AVX
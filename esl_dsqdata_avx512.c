@@ -0,0 +1,146 @@
+/* Vectorized unpacking of dsqdata packets: x86 AVX-512 implementation.
+ *
+ * Same as the SSE4 kernels in esl_dsqdata_sse.c (see there for notes,
+ * including why stores must be exact), sixteen packets at a time.
+ * Byte shuffles work within each 128-bit lane, so each lane unpacks
+ * four packets exactly as the SSE4 code does. The 5-bit kernel then
+ * compacts the four lanes' residues with a quadword permute; the
+ * 2-bit kernel stores the lanes one after the other.
+ *
+ * Requires AVX-512F and AVX-512BW, as <esl_cpu_has_avx512()> checks.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_AVX512>
+ * was set in <esl_config.h> by the configure script. When it is not
+ * set, we include some dummy code to silence compiler and ranlib
+ * warnings about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_AVX512
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_dsqdata.h"
+
+
+/* Function:  esl_dsqdata_unpack5_avx512()
+ * Synopsis:  Unpack a run of full 5-bit packets, AVX-512 version.
+ *
+ * Purpose:   As <esl_dsqdata_unpack5_sse()>, but sixteen packets
+ *            (96 residues) at a time.
+ *
+ *            Where it stops, the narrower AVX2 kernel takes over,
+ *            so short sequences and tails of long ones still get
+ *            some vector unpacking.
+ *
+ * Returns:   the number of packets unpacked, <P>, possibly 0.
+ */
+int
+esl_dsqdata_unpack5_avx512(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  const __m512i shuf_u_lo = _mm512_broadcast_i32x4(_mm_setr_epi8( 0,  1,  2,  3, -1, -1,  4,  5,  6,  7, -1, -1,  8,  9, 10, 11));
+  const __m512i shuf_w_lo = _mm512_broadcast_i32x4(_mm_setr_epi8(-1, -1, -1, -1,  0,  1, -1, -1, -1, -1,  4,  5, -1, -1, -1, -1));
+  const __m512i shuf_u_hi = _mm512_broadcast_i32x4(_mm_setr_epi8(-1, -1, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+  const __m512i shuf_w_hi = _mm512_broadcast_i32x4(_mm_setr_epi8( 8,  9, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1));
+  /* Lane l holds 24 residues: quadwords 2l,2l+1 of <lo> and quadword 2l of <hi> (index 8+2l in the permute). */
+  const __m512i perm0     = _mm512_setr_epi64(0, 1,  8, 2, 3, 10, 4, 5);
+  const __m512i perm1     = _mm512_setr_epi64(12, 6, 7, 14, 0, 0, 0, 0);
+  const __m512i eod       = _mm512_set1_epi32(eslDSQDATA_EOD);
+  __m512i v, u, w, lo, hi;
+  int     P;
+
+  for (P = 0; P+16 <= np; P += 16)
+    {
+      v = _mm512_loadu_si512((const void *) (psq + P));
+      if (_mm512_test_epi32_mask(v, eod)) break;   // an EOD packet is in this group
+
+      u = _mm512_or_si512( _mm512_or_si512( _mm512_and_si512(_mm512_srli_epi32(v, 25), _mm512_set1_epi32(0x0000001f)),
+                                            _mm512_and_si512(_mm512_srli_epi32(v, 12), _mm512_set1_epi32(0x00001f00))),
+                           _mm512_or_si512( _mm512_and_si512(_mm512_slli_epi32(v,  1), _mm512_set1_epi32(0x001f0000)),
+                                            _mm512_and_si512(_mm512_slli_epi32(v, 14), _mm512_set1_epi32(0x1f000000))));
+      w = _mm512_or_si512(   _mm512_and_si512(_mm512_srli_epi32(v,  5), _mm512_set1_epi32(0x0000001f)),
+                             _mm512_and_si512(_mm512_slli_epi32(v,  8), _mm512_set1_epi32(0x00001f00)));
+
+      lo = _mm512_or_si512(_mm512_shuffle_epi8(u, shuf_u_lo), _mm512_shuffle_epi8(w, shuf_w_lo));
+      hi = _mm512_or_si512(_mm512_shuffle_epi8(u, shuf_u_hi), _mm512_shuffle_epi8(w, shuf_w_hi));
+      _mm512_storeu_si512((void *)    (dsq + 6*P),      _mm512_permutex2var_epi64(lo, perm0, hi));
+      _mm256_storeu_si256((__m256i *) (dsq + 6*P + 64), _mm512_castsi512_si256(_mm512_permutex2var_epi64(lo, perm1, hi)));
+    }
+
+#ifdef eslENABLE_AVX
+  P += esl_dsqdata_unpack5_avx(psq + P, np - P, dsq + 6*P);
+#endif
+  return P;
+}
+
+
+/* Function:  esl_dsqdata_unpack2_avx512()
+ * Synopsis:  Unpack a run of full 2-bit packets, AVX-512 version.
+ *
+ * Purpose:   As <esl_dsqdata_unpack2_sse()>, but sixteen packets
+ *            (240 residues) at a time.
+ *
+ *            Where it stops, the narrower AVX2 kernel takes over,
+ *            so short sequences and tails of long ones still get
+ *            some vector unpacking.
+ *
+ * Returns:   the number of packets unpacked, <P>, possibly 0.
+ */
+int
+esl_dsqdata_unpack2_avx512(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  const __m512i rev  = _mm512_broadcast_i32x4(_mm_setr_epi8(14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0));
+  const __m512i m3   = _mm512_set1_epi8(3);
+  const __m512i ctrl = _mm512_set1_epi32(eslDSQDATA_EOD | eslDSQDATA_5BIT);
+  __m512i v, x0, x2, x4, x6, a, b, c, d, p0, p1, p2, p3s;
+  ESL_DSQ *out;
+  int     P;
+
+  for (P = 0; P+16 <= np; P += 16)
+    {
+      v = _mm512_loadu_si512((const void *) (psq + P));
+      if (_mm512_test_epi32_mask(v, ctrl)) break;  // EOD or 5-bit packet in this group
+
+      x0 = _mm512_and_si512(v,                        m3);
+      x2 = _mm512_and_si512(_mm512_srli_epi32(v, 2),  m3);
+      x4 = _mm512_and_si512(_mm512_srli_epi32(v, 4),  m3);
+      x6 = _mm512_and_si512(_mm512_srli_epi32(v, 6),  m3);
+
+      a   = _mm512_unpacklo_epi8(x0, x2);   // packets 0,1 | 4,5 | 8,9 | 12,13
+      b   = _mm512_unpacklo_epi8(x4, x6);
+      c   = _mm512_unpackhi_epi8(x0, x2);   // packets 2,3 | 6,7 | ...
+      d   = _mm512_unpackhi_epi8(x4, x6);
+      p0  = _mm512_shuffle_epi8(_mm512_unpacklo_epi16(a, b), rev);
+      p1  = _mm512_shuffle_epi8(_mm512_unpackhi_epi16(a, b), rev);
+      p2  = _mm512_shuffle_epi8(_mm512_unpacklo_epi16(c, d), rev);
+      p3s = _mm512_alignr_epi8(_mm512_shuffle_epi8(_mm512_unpackhi_epi16(c, d), rev), p2, 15);
+
+      out = dsq + 15*P;
+      _mm_storeu_si128((__m128i *) (out),       _mm512_extracti32x4_epi32(p0,  0));
+      _mm_storeu_si128((__m128i *) (out + 15),  _mm512_extracti32x4_epi32(p1,  0));
+      _mm_storeu_si128((__m128i *) (out + 30),  _mm512_extracti32x4_epi32(p2,  0));
+      _mm_storeu_si128((__m128i *) (out + 44),  _mm512_extracti32x4_epi32(p3s, 0));
+      _mm_storeu_si128((__m128i *) (out + 60),  _mm512_extracti32x4_epi32(p0,  1));
+      _mm_storeu_si128((__m128i *) (out + 75),  _mm512_extracti32x4_epi32(p1,  1));
+      _mm_storeu_si128((__m128i *) (out + 90),  _mm512_extracti32x4_epi32(p2,  1));
+      _mm_storeu_si128((__m128i *) (out + 104), _mm512_extracti32x4_epi32(p3s, 1));
+      _mm_storeu_si128((__m128i *) (out + 120), _mm512_extracti32x4_epi32(p0,  2));
+      _mm_storeu_si128((__m128i *) (out + 135), _mm512_extracti32x4_epi32(p1,  2));
+      _mm_storeu_si128((__m128i *) (out + 150), _mm512_extracti32x4_epi32(p2,  2));
+      _mm_storeu_si128((__m128i *) (out + 164), _mm512_extracti32x4_epi32(p3s, 2));
+      _mm_storeu_si128((__m128i *) (out + 180), _mm512_extracti32x4_epi32(p0,  3));
+      _mm_storeu_si128((__m128i *) (out + 195), _mm512_extracti32x4_epi32(p1,  3));
+      _mm_storeu_si128((__m128i *) (out + 210), _mm512_extracti32x4_epi32(p2,  3));
+      _mm_storeu_si128((__m128i *) (out + 224), _mm512_extracti32x4_epi32(p3s, 3));
+    }
+
+#ifdef eslENABLE_AVX
+  P += esl_dsqdata_unpack2_avx(psq + P, np - P, dsq + 15*P);
+#endif
+  return P;
+}
+
+#else // ! eslENABLE_AVX512
+void esl_dsqdata_avx512_silence_hack(void) { return; }
+#endif // eslENABLE_AVX512
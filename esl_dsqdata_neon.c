@@ -0,0 +1,115 @@
+/* Vectorized unpacking of dsqdata packets: ARM NEON implementation.
+ *
+ * Same as the SSE4 kernels in esl_dsqdata_sse.c (see there for notes,
+ * including why stores must be exact), four packets at a time. Uses
+ * AArch64 table lookups (vqtbl1q_u8) and across-vector reductions
+ * (vmaxvq_u32), so it's only compiled for ARMv8.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_NEON>
+ * and <eslHAVE_NEON_AARCH64> were set in <esl_config.h> by the
+ * configure script. Otherwise we include some dummy code to silence
+ * compiler and ranlib warnings about empty translation units and no
+ * symbols.
+ */
+#include "esl_config.h"
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#include "easel.h"
+#include "esl_dsqdata.h"
+
+
+/* Function:  esl_dsqdata_unpack5_neon()
+ * Synopsis:  Unpack a run of full 5-bit packets, NEON version.
+ *
+ * Purpose:   As <esl_dsqdata_unpack5_sse()>.
+ *
+ * Returns:   the number of packets unpacked, <P>: a multiple of 4,
+ *            possibly 0.
+ */
+int
+esl_dsqdata_unpack5_neon(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  static const uint8_t su_lo[16] = {   0,   1,   2,   3, 255, 255,   4,   5,   6,   7, 255, 255,   8,   9,  10,  11 };
+  static const uint8_t sw_lo[16] = { 255, 255, 255, 255,   0,   1, 255, 255, 255, 255,   4,   5, 255, 255, 255, 255 };
+  static const uint8_t su_hi[16] = { 255, 255,  12,  13,  14,  15, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 };
+  static const uint8_t sw_hi[16] = {   8,   9, 255, 255, 255, 255,  12,  13, 255, 255, 255, 255, 255, 255, 255, 255 };
+  const uint8x16_t shuf_u_lo = vld1q_u8(su_lo);
+  const uint8x16_t shuf_w_lo = vld1q_u8(sw_lo);
+  const uint8x16_t shuf_u_hi = vld1q_u8(su_hi);
+  const uint8x16_t shuf_w_hi = vld1q_u8(sw_hi);
+  uint32x4_t v, u, w;
+  uint8x16_t lo, hi;
+  int        P;
+
+  for (P = 0; P+4 <= np; P += 4)
+    {
+      v = vld1q_u32(psq + P);
+      if (vmaxvq_u32(v) & eslDSQDATA_EOD) break;   // an EOD packet is in this group
+
+      u = vorrq_u32( vorrq_u32( vandq_u32(vshrq_n_u32(v, 25), vdupq_n_u32(0x0000001f)),
+                                vandq_u32(vshrq_n_u32(v, 12), vdupq_n_u32(0x00001f00))),
+                     vorrq_u32( vandq_u32(vshlq_n_u32(v,  1), vdupq_n_u32(0x001f0000)),
+                                vandq_u32(vshlq_n_u32(v, 14), vdupq_n_u32(0x1f000000))));
+      w = vorrq_u32(   vandq_u32(vshrq_n_u32(v,  5), vdupq_n_u32(0x0000001f)),
+                       vandq_u32(vshlq_n_u32(v,  8), vdupq_n_u32(0x00001f00)));
+
+      lo = vorrq_u8(vqtbl1q_u8(vreinterpretq_u8_u32(u), shuf_u_lo), vqtbl1q_u8(vreinterpretq_u8_u32(w), shuf_w_lo));
+      hi = vorrq_u8(vqtbl1q_u8(vreinterpretq_u8_u32(u), shuf_u_hi), vqtbl1q_u8(vreinterpretq_u8_u32(w), shuf_w_hi));
+      vst1q_u8(dsq + 6*P,      lo);
+      vst1_u8 (dsq + 6*P + 16, vget_low_u8(hi));
+    }
+  return P;
+}
+
+
+/* Function:  esl_dsqdata_unpack2_neon()
+ * Synopsis:  Unpack a run of full 2-bit packets, NEON version.
+ *
+ * Purpose:   As <esl_dsqdata_unpack2_sse()>.
+ *
+ * Returns:   the number of packets unpacked, <P>: a multiple of 4,
+ *            possibly 0.
+ */
+int
+esl_dsqdata_unpack2_neon(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  static const uint8_t revidx[16] = { 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0 };
+  const uint8x16_t rev = vld1q_u8(revidx);
+  const uint8x16_t m3  = vdupq_n_u8(3);
+  uint32x4_t v;
+  uint8x16_t x0, x2, x4, x6, a, b, c, d, p0, p1, p2, p3;
+  int        P;
+
+  for (P = 0; P+4 <= np; P += 4)
+    {
+      v = vld1q_u32(psq + P);
+      if (vmaxvq_u32(vorrq_u32(v, vshlq_n_u32(v, 1))) & eslDSQDATA_EOD) break;  // EOD or 5-bit packet in this group
+
+      x0 = vandq_u8(vreinterpretq_u8_u32(v),                  m3);
+      x2 = vandq_u8(vreinterpretq_u8_u32(vshrq_n_u32(v, 2)),  m3);
+      x4 = vandq_u8(vreinterpretq_u8_u32(vshrq_n_u32(v, 4)),  m3);
+      x6 = vandq_u8(vreinterpretq_u8_u32(vshrq_n_u32(v, 6)),  m3);
+
+      a  = vzip1q_u8(x0, x2);   // packets 0,1
+      b  = vzip1q_u8(x4, x6);
+      c  = vzip2q_u8(x0, x2);   // packets 2,3
+      d  = vzip2q_u8(x4, x6);
+      p0 = vqtbl1q_u8(vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))), rev);
+      p1 = vqtbl1q_u8(vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))), rev);
+      p2 = vqtbl1q_u8(vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(c), vreinterpretq_u16_u8(d))), rev);
+      p3 = vqtbl1q_u8(vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(c), vreinterpretq_u16_u8(d))), rev);
+
+      vst1q_u8(dsq + 15*P,      p0);
+      vst1q_u8(dsq + 15*P + 15, p1);
+      vst1q_u8(dsq + 15*P + 30, p2);
+      vst1q_u8(dsq + 15*P + 44, vextq_u8(p2, p3, 15));
+    }
+  return P;
+}
+
+#else // ! (eslENABLE_NEON && eslHAVE_NEON_AARCH64)
+void esl_dsqdata_neon_silence_hack(void) { return; }
+#endif
@@ -0,0 +1,144 @@
+/* Vectorized unpacking of dsqdata packets: x86 SSE4 implementation.
+ *
+ * esl_dsqdata.c documents the packet format. Its scalar
+ * dsqdata_unpack5() and dsqdata_unpack2() remain the reference
+ * implementation. The kernels here only do the bulk of the work:
+ * they unpack a run of full (non-EOD) packets, and the caller
+ * finishes each sequence with the scalar code.
+ *
+ * The threaded reader unpacks in place. The packed data sit at the
+ * end of the same allocation that the residues are unpacked into,
+ * and the unpacked residues may catch up to packets that haven't
+ * been read yet. A kernel therefore loads each group of packets
+ * before it stores anything. It also stores exactly the residues it
+ * unpacks and never writes past them.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_SSE4> was
+ * set in <esl_config.h> by the configure script. When it is not set,
+ * we include some dummy code to silence compiler and ranlib warnings
+ * about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_SSE4
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_dsqdata.h"
+
+
+/* Function:  esl_dsqdata_unpack5_sse()
+ * Synopsis:  Unpack a run of full 5-bit packets, SSE4 version.
+ *
+ * Purpose:   Unpack 5-bit encoded packets from <psq> into residues in
+ *            <dsq>, four packets (24 residues) at a time. Stop at the
+ *            first group of four that contains an EOD packet, or that
+ *            would read past the <np> packets available in <psq>.
+ *
+ *            Caller unpacks the rest of the sequence, starting from
+ *            packet <psq[P]> and residue <dsq[6P]>, where <P> is the
+ *            return value.
+ *
+ * Returns:   the number of packets unpacked, <P>: a multiple of 4,
+ *            possibly 0.
+ */
+int
+esl_dsqdata_unpack5_sse(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  /* Within each packet lane, <u> collects residues 0..3 as bytes, <w> residues 4,5;
+   * then byte shuffles interleave them into 6 residues per packet. -1 = zero.
+   */
+  const __m128i shuf_u_lo = _mm_setr_epi8( 0,  1,  2,  3, -1, -1,  4,  5,  6,  7, -1, -1,  8,  9, 10, 11);
+  const __m128i shuf_w_lo = _mm_setr_epi8(-1, -1, -1, -1,  0,  1, -1, -1, -1, -1,  4,  5, -1, -1, -1, -1);
+  const __m128i shuf_u_hi = _mm_setr_epi8(-1, -1, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i shuf_w_hi = _mm_setr_epi8( 8,  9, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+  __m128i v, u, w, lo, hi;
+  int     P;
+
+  for (P = 0; P+4 <= np; P += 4)
+    {
+      v = _mm_loadu_si128((const __m128i *) (psq + P));
+      if (_mm_movemask_ps(_mm_castsi128_ps(v))) break;     // bit 31 set: an EOD packet is in this group
+
+      u = _mm_or_si128( _mm_or_si128( _mm_and_si128(_mm_srli_epi32(v, 25), _mm_set1_epi32(0x0000001f)),
+                                      _mm_and_si128(_mm_srli_epi32(v, 12), _mm_set1_epi32(0x00001f00))),
+                        _mm_or_si128( _mm_and_si128(_mm_slli_epi32(v,  1), _mm_set1_epi32(0x001f0000)),
+                                      _mm_and_si128(_mm_slli_epi32(v, 14), _mm_set1_epi32(0x1f000000))));
+      w = _mm_or_si128(   _mm_and_si128(_mm_srli_epi32(v,  5), _mm_set1_epi32(0x0000001f)),
+                          _mm_and_si128(_mm_slli_epi32(v,  8), _mm_set1_epi32(0x00001f00)));
+
+      lo = _mm_or_si128(_mm_shuffle_epi8(u, shuf_u_lo), _mm_shuffle_epi8(w, shuf_w_lo));  // residues 0..15
+      hi = _mm_or_si128(_mm_shuffle_epi8(u, shuf_u_hi), _mm_shuffle_epi8(w, shuf_w_hi));  //      .. 16..23
+      _mm_storeu_si128((__m128i *) (dsq + 6*P),      lo);
+      _mm_storel_epi64((__m128i *) (dsq + 6*P + 16), hi);
+    }
+  return P;
+}
+
+
+/* Function:  esl_dsqdata_unpack2_sse()
+ * Synopsis:  Unpack a run of full 2-bit packets, SSE4 version.
+ *
+ * Purpose:   Unpack 2-bit encoded packets from <psq> into residues in
+ *            <dsq>, four packets (60 residues) at a time. Stop at the
+ *            first group of four that contains an EOD packet or a
+ *            5-bit packet, or that would read past the <np> packets
+ *            available in <psq>.
+ *
+ *            Caller unpacks the rest of the sequence, starting from
+ *            packet <psq[P]> and residue <dsq[15P]>, where <P> is the
+ *            return value. In mixed 2-bit/5-bit encoded data, a caller
+ *            unpacks one packet with scalar code and calls again.
+ *
+ * Returns:   the number of packets unpacked, <P>: a multiple of 4,
+ *            possibly 0.
+ */
+int
+esl_dsqdata_unpack2_sse(const uint32_t *psq, int np, ESL_DSQ *dsq)
+{
+  /* Residue k of a packet is (v >> (28-2k)) & 3. We build, for each
+   * packet, a 16-byte table t[i] = (v >> 2i) & 3, out of the packet
+   * bytes shifted by 0,2,4,6; then residue k is t[14-k]. The last byte
+   * repeats residue 14, which lets the last packet of a group be
+   * stored without writing past its end (see below).
+   */
+  const __m128i rev = _mm_setr_epi8(14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0);
+  const __m128i m3  = _mm_set1_epi8(3);
+  __m128i v, x0, x2, x4, x6, a, b, c, d, p0, p1, p2, p3;
+  int     P;
+
+  for (P = 0; P+4 <= np; P += 4)
+    {
+      v = _mm_loadu_si128((const __m128i *) (psq + P));
+      if (_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(v, _mm_slli_epi32(v, 1))))) break; // bit 31 or 30 set: EOD or 5-bit packet in this group
+
+      x0 = _mm_and_si128(v,                     m3);
+      x2 = _mm_and_si128(_mm_srli_epi32(v, 2),  m3);
+      x4 = _mm_and_si128(_mm_srli_epi32(v, 4),  m3);
+      x6 = _mm_and_si128(_mm_srli_epi32(v, 6),  m3);
+
+      a  = _mm_unpacklo_epi8(x0, x2);   // packets 0,1
+      b  = _mm_unpacklo_epi8(x4, x6);
+      c  = _mm_unpackhi_epi8(x0, x2);   // packets 2,3
+      d  = _mm_unpackhi_epi8(x4, x6);
+      p0 = _mm_shuffle_epi8(_mm_unpacklo_epi16(a, b), rev);
+      p1 = _mm_shuffle_epi8(_mm_unpackhi_epi16(a, b), rev);
+      p2 = _mm_shuffle_epi8(_mm_unpacklo_epi16(c, d), rev);
+      p3 = _mm_shuffle_epi8(_mm_unpackhi_epi16(c, d), rev);
+
+      /* Each 16-byte store writes one byte too many, which the next
+       * store overwrites. The last one is shifted back by a byte,
+       * so it ends exactly at residue 60.
+       */
+      _mm_storeu_si128((__m128i *) (dsq + 15*P),      p0);
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 15), p1);
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 30), p2);
+      _mm_storeu_si128((__m128i *) (dsq + 15*P + 44), _mm_alignr_epi8(p3, p2, 15));
+    }
+  return P;
+}
+
+#else // ! eslENABLE_SSE4
+void esl_dsqdata_sse_silence_hack(void) { return; }
+#endif // eslENABLE_SSE4
@@ -739,6 +739,14 @@ esl_gencode_WorkstateDestroy(ESL_GENCODE_WORKSTATE *wrk)
   if (wrk)
     {
       for (f = 0; f < 3; f++) esl_sq_Destroy(wrk->psq[f]);
+      for (f = 0; f < 2; f++)
+        {
+          free(wrk->codon_aa[f]);
+          free(wrk->codon_init[f]);
+          free(wrk->codon_stop[f]);
+          free(wrk->stopmask[f]);
+        }
+      free(wrk->cidx);
 
       if(wrk->orf_block != NULL)
       {
@@ -754,11 +762,18 @@ ESL_GENCODE_WORKSTATE *
 esl_gencode_WorkstateCreate(ESL_GETOPTS *go, ESL_GENCODE *gcode)
 {
   ESL_GENCODE_WORKSTATE *wrk = NULL;
+  const ESL_DSQ         *comp;
+  ESL_DSQ                codon[3];
+  int    Kp;
+  int    x, y, z, c;
   int    f;
   int    status;
 
   ESL_ALLOC(wrk, sizeof(ESL_GENCODE_WORKSTATE));
   for (f = 0; f < 3; f++) wrk->psq[f] = NULL;
+  for (f = 0; f < 2; f++) { wrk->codon_aa[f] = NULL; wrk->codon_init[f] = NULL; wrk->codon_stop[f] = NULL; wrk->stopmask[f] = NULL; }
+  wrk->cidx   = NULL;
+  wrk->nalloc = 0;
 
   for (f = 0; f < 3; f++)
     {
@@ -783,6 +798,34 @@ esl_gencode_WorkstateCreate(ESL_GETOPTS *go, ESL_GENCODE *gcode)
   wrk->outfp            = stdout;
   wrk->outformat        = eslSQFILE_FASTA;
 
+  /* Codon tables for esl_gencode_ProcessSequence(): every digital
+   * codon, degenerate or not, on both strands. The crick entry for
+   * xyz is for its reverse complement, the codon that xyz reads as
+   * on the other strand.
+   */
+  Kp       = gcode->nt_abc->Kp;
+  comp     = gcode->nt_abc->complement;
+  wrk->Kp  = Kp;
+  wrk->aa_M = esl_abc_DigitizeSymbol(gcode->aa_abc, 'M');
+  for (f = 0; f < 2; f++)
+    {
+      ESL_ALLOC(wrk->codon_aa[f],   sizeof(ESL_DSQ) * Kp * Kp * Kp);
+      ESL_ALLOC(wrk->codon_init[f], sizeof(int8_t)  * Kp * Kp * Kp);
+      ESL_ALLOC(wrk->codon_stop[f], sizeof(int8_t)  * Kp * Kp * Kp);
+    }
+  for (x = 0; x < Kp; x++)
+    for (y = 0; y < Kp; y++)
+      for (z = 0; z < Kp; z++)
+        for (f = 0; f < 2; f++)
+          {
+            c = (x * Kp + y) * Kp + z;
+            if (f == 0) { codon[0] = x;       codon[1] = y;       codon[2] = z;       }
+            else        { codon[0] = comp[z]; codon[1] = comp[y]; codon[2] = comp[x]; }
+            wrk->codon_aa[f][c]   = esl_gencode_GetTranslation(gcode, codon);
+            wrk->codon_init[f][c] = esl_gencode_IsInitiator(gcode, codon);
+            wrk->codon_stop[f][c] = esl_abc_XIsNonresidue(gcode->aa_abc, wrk->codon_aa[f][c]);
+          }
+
   return wrk;
 
  ERROR:
@@ -794,6 +837,9 @@ esl_gencode_WorkstateCreate(ESL_GETOPTS *go, ESL_GENCODE *gcode)
  *  6. Functions for processing ORFs
  *****************************************************************/
 
+static int process_orf_at(ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq, int s, int64_t *next, int64_t p);
+static int gencode_ctz64 (uint64_t v);
+
 int
 esl_gencode_ProcessOrf(ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq)
 {
@@ -945,6 +991,153 @@ esl_gencode_ProcessEnd(ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq)
 }
 
 
+/* Function:  esl_gencode_ProcessSequence()
+ * Synopsis:  Find and translate all ORFs in a complete sequence.
+ *
+ * Purpose:   Process the complete digital DNA/RNA sequence <sq>, in
+ *            one call, the same as <esl_gencode_ProcessStart()>,
+ *            <_ProcessPiece()> and <_ProcessEnd()> would on its
+ *            watson strand and then (after
+ *            <esl_sq_ReverseComplement()>) its crick strand: the same
+ *            ORFs, in the same order, with the same names and coords.
+ *            Strands are skipped if <wrk->do_watson> or
+ *            <wrk->do_crick> is FALSE. Sequences of length $<3$ have
+ *            no ORFs.
+ *
+ *            <sq> isn't changed. The crick strand is read directly,
+ *            using the reverse complement codon tables that
+ *            <esl_gencode_WorkstateCreate()> built.
+ *
+ *            One pass over <sq> looks up every codon index, on both
+ *            strands at once, and records stop codons as bits in a
+ *            mask. ORFs are then the stretches between consecutive
+ *            stops in each frame, so they're found by stepping from
+ *            one set bit to the next, and only the ORFs we output are
+ *            ever translated.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+esl_gencode_ProcessSequence(ESL_GENCODE *gcode, ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq)
+{
+  const ESL_DSQ *dsq = sq->dsq;
+  int64_t        L   = sq->n;
+  int            Kp  = wrk->Kp;
+  int64_t        nw  = (L-2) / 64 + 1;   // number of stopmask words: bits 1..L-2
+  int64_t        next[3];                // strand coord where we next look for an initiator, in each frame
+  int64_t        p, r, w;
+  uint64_t       bits;
+  int            c;
+  int            s, f;
+  int            status;
+
+  if (L < 3) return eslOK;
+
+  if (L > wrk->nalloc)
+    {
+      ESL_REALLOC(wrk->cidx,        sizeof(uint16_t) * (L+1));
+      ESL_REALLOC(wrk->stopmask[0], sizeof(uint64_t) * (L/64+1));
+      ESL_REALLOC(wrk->stopmask[1], sizeof(uint64_t) * (L/64+1));
+      wrk->nalloc = L;
+    }
+  memset(wrk->stopmask[0], 0, sizeof(uint64_t) * nw);
+  memset(wrk->stopmask[1], 0, sizeof(uint64_t) * nw);
+
+  /* Crick coord <r> of a codon is watson coord <p> = L-1-r. */
+  for (p = 1; p <= L-2; p++)
+    {
+      r = L-1-p;
+      c = (dsq[p] * Kp + dsq[p+1]) * Kp + dsq[p+2];
+      wrk->cidx[p] = c;
+      wrk->stopmask[0][p/64] |= (uint64_t) wrk->codon_stop[0][c] << (p%64);
+      wrk->stopmask[1][r/64] |= (uint64_t) wrk->codon_stop[1][c] << (r%64);
+    }
+
+  for (f = 0; f < 3; f++)
+    {
+      esl_sq_SetSource(wrk->psq[f], sq->name);
+      wrk->in_orf[f] = FALSE;
+    }
+
+  for (s = 0; s < 2; s++)
+    {
+      if (s == 0 && ! wrk->do_watson) continue;
+      if (s == 1 && ! wrk->do_crick)  continue;
+
+      for (f = 0; f < 3; f++) next[f] = f+1;
+      for (w = 0; w < nw; w++)
+        for (bits = wrk->stopmask[s][w]; bits; bits &= bits-1)
+          if ((status = process_orf_at(wrk, sq, s, next, w*64 + gencode_ctz64(bits))) != eslOK) return status;
+
+      /* end of the strand terminates all three frames */
+      for (p = L-1; p <= L+1; p++)
+        if ((status = process_orf_at(wrk, sq, s, next, p)) != eslOK) return status;
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* process_orf_at()
+ * On strand <s> (0=watson, 1=crick), the frame that strand coord <p>
+ * is in ends at <p>, either at a stop codon or at the end of the
+ * sequence. Look for an initiator from <next[f]> (in this frame <f>)
+ * up to the last codon before <p>; if there is one, and the ORF is
+ * long enough, translate it into <wrk->psq[f]> and hand it to
+ * <esl_gencode_ProcessOrf()> to output, as <_ProcessPiece()> would.
+ * Then the frame resumes at the codon after <p>.
+ */
+static int
+process_orf_at(ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq, int s, int64_t *next, int64_t p)
+{
+  int64_t        L    = sq->n;
+  int            f    = (p-1) % 3;
+  const ESL_DSQ *aa   = wrk->codon_aa[s];
+  const int8_t  *init = wrk->codon_init[s];
+  ESL_SQ        *psq  = wrk->psq[f];
+  int64_t        q, q0, i, n;
+  int            status;
+
+  for (q0 = next[f]; q0 <= p-3; q0 += 3)
+    if (init[ wrk->cidx[s ? L-1-q0 : q0] ]) break;
+  next[f] = p+3;
+
+  n = (p - q0) / 3;
+  if (q0 > p-3 || n < wrk->minlen) return eslOK;
+
+  if ((status = esl_sq_GrowTo(psq, n)) != eslOK) return status;
+  for (i = 1, q = q0; i <= n; i++, q += 3)
+    psq->dsq[i] = aa[ wrk->cidx[s ? L-1-q : q] ];
+  if (wrk->using_initiators) psq->dsq[1] = wrk->aa_M;
+  psq->n = n;
+
+  psq->start      = (s ? L-q0+1 : q0);
+  wrk->in_orf[f]  = TRUE;
+  wrk->frame      = f;
+  wrk->is_revcomp = s;
+  wrk->apos       = (s ? L-p+1 : p);
+  return esl_gencode_ProcessOrf(wrk, sq);
+}
+
+/* gencode_ctz64()
+ * Index of the lowest set bit in <v>, which must be nonzero.
+ */
+static int
+gencode_ctz64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  while (! (v & 1)) { v >>= 1; n++; }
+  return n;
+#endif
+}
+
+
 /*****************************************************************
  * 7. Debugging/development utilities
  *****************************************************************/ 
@@ -1031,6 +1224,8 @@ esl_gencode_Compare(const ESL_GENCODE *gc1, const ESL_GENCODE *gc2, int metadata
  *****************************************************************/
 #ifdef eslGENCODE_TESTDRIVE
 
+#include "esl_random.h"
+
 static void
 utest_ReadWrite(void)
 {
@@ -1068,6 +1263,112 @@ utest_ReadWrite(void)
   esl_alphabet_Destroy(aa_abc);
 }
 
+/* utest_ProcessSequence()
+ * esl_gencode_ProcessSequence() finds the same ORFs as the
+ * ProcessStart/Piece/End path (with a reverse complement for crick),
+ * on random sequences with some degenerate residues, for different
+ * codes, initiator rules, minimum lengths, and strands.
+ */
+static void
+utest_ProcessSequence(ESL_GETOPTS *go, ESL_RANDOMNESS *rng)
+{
+  char          msg[]  = "esl_gencode :: ProcessSequence unit test failed";
+  ESL_ALPHABET *nt_abc = esl_alphabet_Create(eslDNA);
+  ESL_ALPHABET *aa_abc = esl_alphabet_Create(eslAMINO);
+  ESL_GENCODE  *gcode  = NULL;
+  ESL_GENCODE_WORKSTATE *wrk = NULL;
+  ESL_SQ       *sq     = NULL;
+  ESL_SQ       *rsq    = NULL;
+  ESL_SQ_BLOCK *blk1   = NULL;
+  ESL_SQ_BLOCK *blk2   = NULL;
+  ESL_DSQ      *dsq    = NULL;
+  int           ntrials = 200;
+  int           maxL    = 500;
+  int           trial, i, L, mode;
+  int           status;
+
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (maxL+2));
+
+  for (trial = 0; trial < ntrials; trial++)
+    {
+      /* A new code, initiator rule, and workstate every 20 seqs */
+      if (trial % 20 == 0)
+	{
+	  esl_gencode_WorkstateDestroy(wrk);
+	  esl_gencode_Destroy(gcode);
+	  if ((gcode = esl_gencode_Create(nt_abc, aa_abc))                                        == NULL)  esl_fatal(msg);
+	  if (esl_gencode_Set(gcode, (esl_rnd_Roll(rng, 2) ? 1 : esl_transl_tables[esl_rnd_Roll(rng, sizeof(esl_transl_tables) / sizeof(ESL_GENCODE))].transl_table)) != eslOK) esl_fatal(msg);
+	  mode = esl_rnd_Roll(rng, 3);
+	  if      (mode == 0) esl_gencode_SetInitiatorAny(gcode);
+	  else if (mode == 1) esl_gencode_SetInitiatorOnlyAUG(gcode);
+	  if ((wrk = esl_gencode_WorkstateCreate(go, gcode)) == NULL) esl_fatal(msg);
+	  wrk->using_initiators = (mode == 0 ? FALSE : TRUE);
+	  wrk->minlen           = esl_rnd_Roll(rng, 20);
+	  wrk->do_watson        = (esl_rnd_Roll(rng, 4) == 0 ? FALSE : TRUE);
+	  wrk->do_crick         = (esl_rnd_Roll(rng, 4) == 0 ? FALSE : TRUE);
+	}
+
+      /* Mostly ACGT, with an occasional degenerate residue */
+      L      = esl_rnd_Roll(rng, maxL+1);
+      dsq[0] = dsq[L+1] = eslDSQ_SENTINEL;
+      for (i = 1; i <= L; i++)
+	dsq[i] = (esl_rnd_Roll(rng, 20) == 0 ? nt_abc->K + 1 + esl_rnd_Roll(rng, nt_abc->Kp - nt_abc->K - 3) : esl_rnd_Roll(rng, nt_abc->K));
+      if ((sq = esl_sq_CreateDigitalFrom(nt_abc, "seq", dsq, L, "test seq", NULL, NULL)) == NULL) esl_fatal(msg);
+
+      /* reference: the three-call path, on both strands */
+      if ((blk1 = esl_sq_CreateDigitalBlock(16, aa_abc)) == NULL) esl_fatal(msg);
+      wrk->orf_block = blk1;
+      wrk->orfcount  = 0;
+      if (L >= 3)
+	{
+	  if (esl_sq_Copy(sq, (rsq = esl_sq_CreateDigital(nt_abc))) != eslOK) esl_fatal(msg);
+	  if (wrk->do_watson) {
+	    esl_gencode_ProcessStart(gcode, wrk, rsq);
+	    if (esl_gencode_ProcessPiece(gcode, wrk, rsq) != eslOK) esl_fatal(msg);
+	    if (esl_gencode_ProcessEnd(wrk, rsq)          != eslOK) esl_fatal(msg);
+	  }
+	  if (wrk->do_crick) {
+	    if (esl_sq_ReverseComplement(rsq)             != eslOK) esl_fatal(msg);
+	    esl_gencode_ProcessStart(gcode, wrk, rsq);
+	    if (esl_gencode_ProcessPiece(gcode, wrk, rsq) != eslOK) esl_fatal(msg);
+	    if (esl_gencode_ProcessEnd(wrk, rsq)          != eslOK) esl_fatal(msg);
+	  }
+	  esl_sq_Destroy(rsq);
+	}
+
+      if ((blk2 = esl_sq_CreateDigitalBlock(16, aa_abc)) == NULL) esl_fatal(msg);
+      wrk->orf_block = blk2;
+      wrk->orfcount  = 0;
+      if (esl_gencode_ProcessSequence(gcode, wrk, sq) != eslOK) esl_fatal(msg);
+      wrk->orf_block = NULL;
+
+      if (blk1->count != blk2->count) esl_fatal(msg);
+      for (i = 0; i < blk1->count; i++)
+	{
+	  if (blk1->list[i].n     != blk2->list[i].n)                                          esl_fatal(msg);
+	  if (blk1->list[i].start != blk2->list[i].start)                                      esl_fatal(msg);
+	  if (blk1->list[i].end   != blk2->list[i].end)                                        esl_fatal(msg);
+	  if (strcmp(blk1->list[i].name, blk2->list[i].name) != 0)                             esl_fatal(msg);
+	  if (strcmp(blk1->list[i].desc, blk2->list[i].desc) != 0)                             esl_fatal(msg);
+	  if (memcmp(blk1->list[i].dsq, blk2->list[i].dsq, sizeof(ESL_DSQ) * (blk1->list[i].n+2)) != 0) esl_fatal(msg);
+	}
+
+      esl_sq_DestroyBlock(blk1);
+      esl_sq_DestroyBlock(blk2);
+      esl_sq_Destroy(sq);
+    }
+
+  free(dsq);
+  esl_gencode_WorkstateDestroy(wrk);
+  esl_gencode_Destroy(gcode);
+  esl_alphabet_Destroy(nt_abc);
+  esl_alphabet_Destroy(aa_abc);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
 #endif /*eslGENCODE_TESTDRIVE*/
 
 
@@ -1078,12 +1379,38 @@ utest_ReadWrite(void)
 
 #include "esl_config.h"
 
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
 #include "esl_gencode.h"
 
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,      "0",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  /* the options that esl_gencode_WorkstateCreate() reads: */
+  { "-l",        eslARG_INT,     "20",  NULL, NULL,  NULL,  NULL, NULL, "minimum ORF length",                               0 },
+  { "-m",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, "-M", "ORFs must initiate with AUG only",                 0 },
+  { "-M",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, "-m", "ORFs must start with allowed initiation codon",    0 },
+  { "--watson",  eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "only translate top strand",                        0 },
+  { "--crick",   eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "only translate bottom strand",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for gencode module";
+
 int 
 main(int argc, char **argv)
 {
+  ESL_GETOPTS    *go  = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+
   utest_ReadWrite();
+  utest_ProcessSequence(go, rng);
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
   return eslOK;
 }
 #endif /*eslGENCODE_TESTDRIVE*/
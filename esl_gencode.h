@@ -42,6 +42,16 @@ typedef struct esl_gencode_workstate_s {
 
   ESL_SQ_BLOCK  *orf_block; // block of sequences to which to write ORFs
 
+  /* codon tables and workspace for esl_gencode_ProcessSequence(); codons are indexed (x*Kp + y)*Kp + z over all digital nt codes, degenerate or not */
+  int       Kp;            // size of the nucleic digital alphabet
+  ESL_DSQ  *codon_aa[2];   // [0=watson,1=crick][0..Kp^3-1]: translation of codon (crick: of its reverse complement), as esl_gencode_GetTranslation()
+  int8_t   *codon_init[2]; //   ... TRUE if it's an initiator, as esl_gencode_IsInitiator()
+  int8_t   *codon_stop[2]; //   ... TRUE if it translates to a stop
+  ESL_DSQ   aa_M;          // digital Met, for initiators when <using_initiators>
+  uint16_t *cidx;          // [1..L-2]: codon index at each position of the current sequence
+  uint64_t *stopmask[2];   // [0=watson,1=crick]: bit p set if the codon at strand position p is a stop
+  int64_t   nalloc;        // current allocation of <cidx>, in positions
+
   /* one-time configuration information (from options) */
   int     do_watson;         // TRUE|FALSE:  TRUE if we translate the top strand
   int     do_crick;          // TRUE|FALSE:  TRUE if we translate the reverse complement strand
@@ -81,6 +91,7 @@ extern int esl_gencode_ProcessOrf(ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq);
 extern void esl_gencode_ProcessStart(ESL_GENCODE *gcode, ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq);
 extern int esl_gencode_ProcessPiece(ESL_GENCODE *gcode, ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq);
 extern int esl_gencode_ProcessEnd(ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq);
+extern int esl_gencode_ProcessSequence(ESL_GENCODE *gcode, ESL_GENCODE_WORKSTATE *wrk, ESL_SQ *sq);
 
 
 #endif	/*eslGENCODE_INCLUDED*/
@@ -0,0 +1,1196 @@
+/* Reading gzip-compressed files in-process, with zlib.
+ *
+ * Contents:
+ *    1. The ESL_GZFILE object.
+ *    2. Reading and positioning.
+ *    3. Internal functions: plain gzip, BGZF blocks, block index.
+ *    4. Unit tests.
+ *    5. Test driver.
+ *    6. Example.
+ *
+ * A gzip file, including one made of several concatenated gzip
+ * members, is decompressed as one stream with zlib's inflate(). This
+ * replaces piping through `gzip -dc`: no child process, and no
+ * pipe, so the file can be repositioned.
+ *
+ * A BGZF file (as written by `bgzip` from htslib) is also valid gzip,
+ * but made of independently compressed blocks of at most 64KB, each
+ * with its compressed size in a "BC" extra header field and its
+ * uncompressed size in its trailer. We detect BGZF from the first
+ * block's header, then read blocks in batches and decompress each
+ * batch's blocks independently, optionally with several threads.
+ *
+ * For BGZF we also keep an index of each block's compressed and
+ * uncompressed offset, so we can seek to any uncompressed offset by
+ * jumping to the block that contains it. If the file has a .gzi index
+ * (`bgzip -i`, or `bgzip -r`), we read it at open time and random
+ * access is immediate; otherwise the index is built as blocks are
+ * read, and a seek past what we've seen decompresses forward to it.
+ *
+ * Seeking in a plain gzip file rewinds to the start (if needed) and
+ * decompresses forward, which is correct but slow.
+ *
+ * This code is compiled only when <HAVE_ZLIB> was set in
+ * <esl_config.h> by the configure script. Otherwise we include some
+ * dummy code to silence compiler and ranlib warnings about empty
+ * translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef HAVE_ZLIB
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <zlib.h>
+
+#include "easel.h"
+#include "esl_gzfile.h"
+
+static int      gzip_inflate_chunk(ESL_GZFILE *gz);
+static int      bgzf_read_batch(ESL_GZFILE *gz);
+static int      bgzf_read_block(ESL_GZFILE *gz);
+static int      bgzf_inflate_block(z_stream *zs, const unsigned char *blk, char *out);
+static int      bgzf_index_add(ESL_GZFILE *gz, int64_t c, int64_t u);
+static int      gzfile_read_gzi(ESL_GZFILE *gz, const char *gzifile);
+static int      gzfile_refill(ESL_GZFILE *gz);
+static int      gzfile_jump(ESL_GZFILE *gz, int64_t c, int64_t u);
+static int      is_bgzf_header(const unsigned char *p, int64_t n);
+static uint32_t gzfile_le32(const unsigned char *p);
+static uint64_t gzfile_le64(const unsigned char *p);
+
+
+/*****************************************************************
+ *# 1. The ESL_GZFILE object.
+ *****************************************************************/
+
+/* Function:  esl_gzfile_Open()
+ * Synopsis:  Open a gzip file for reading.
+ *
+ * Purpose:   Open gzip-compressed file <filename> for reading, and
+ *            return the open <ESL_GZFILE> in <*ret_gz>.
+ *
+ *            If the file is BGZF, and a .gzi index <filename>.gzi
+ *            exists, the index is read too, for random access with
+ *            <esl_gzfile_Seek()>.
+ *
+ *            Decompression is serial by default; see
+ *            <esl_gzfile_SetThreads()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if <filename> can't be opened for reading.
+ *            <eslEFORMAT> if it isn't in gzip format, or if its .gzi
+ *            index is corrupt. On these normal errors, <*ret_gz> is
+ *            <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure, <eslESYS> if a system
+ *            call fails.
+ */
+int
+esl_gzfile_Open(const char *filename, ESL_GZFILE **ret_gz)
+{
+  ESL_GZFILE   *gz      = NULL;
+  char         *gzifile = NULL;
+  unsigned char hdr[18];
+  int64_t       n;
+  int           status;
+
+  ESL_ALLOC(gz, sizeof(ESL_GZFILE));
+  gz->fp        = NULL;
+  gz->filename  = NULL;
+  gz->is_bgzf   = FALSE;
+  gz->nthreads  = 0;
+  gz->out       = NULL;
+  gz->nout      = 0;
+  gz->opos      = 0;
+  gz->oalloc    = 0;
+  gz->uoff      = 0;
+  gz->at_eof    = FALSE;
+  gz->errstatus = eslOK;
+  gz->in        = NULL;
+  gz->nin       = 0;
+  gz->inalloc   = 0;
+  gz->zs        = NULL;
+  gz->in_member = FALSE;
+  gz->coff      = 0;
+  gz->nblk      = 0;
+  gz->blkalloc  = 0;
+  gz->blk_in    = NULL;
+  gz->blk_out   = NULL;
+  gz->nidx      = 0;
+  gz->idxalloc  = 0;
+  gz->idx_c     = NULL;
+  gz->idx_u     = NULL;
+  gz->has_gzi   = FALSE;
+  gz->errmsg[0] = '\0';
+
+  if ((gz->fp = fopen(filename, "rb")) == NULL) { status = eslENOTFOUND; goto ERROR; }
+  if ((status = esl_strdup(filename, -1, &(gz->filename))) != eslOK) goto ERROR;
+
+  n = fread(hdr, 1, 18, gz->fp);
+  if (n < 2 || hdr[0] != 0x1f || hdr[1] != 0x8b) { status = eslEFORMAT; goto ERROR; }
+  gz->is_bgzf = is_bgzf_header(hdr, n);
+  if (fseeko(gz->fp, 0, SEEK_SET) != 0) ESL_XEXCEPTION(eslESYS, "fseeko() failed on %s", filename);
+
+  /* Minimum allocation of <out>, so inflate always has a valid next_out */
+  gz->oalloc = (gz->is_bgzf ? eslGZFILE_MAXBLOCK : eslGZFILE_OUTSIZE);
+  ESL_ALLOC(gz->out, sizeof(char) * gz->oalloc);
+
+  if (gz->is_bgzf)
+    {
+      if ((status = bgzf_index_add(gz, 0, 0)) != eslOK) goto ERROR;
+
+      if ((status = esl_sprintf(&gzifile, "%s.gzi", filename)) != eslOK) goto ERROR;
+      status = gzfile_read_gzi(gz, gzifile);
+      if      (status == eslOK)        gz->has_gzi = TRUE;
+      else if (status != eslENOTFOUND) goto ERROR;
+    }
+  else
+    {
+      gz->inalloc = eslGZFILE_INSIZE;
+      ESL_ALLOC(gz->in, sizeof(unsigned char) * gz->inalloc);
+
+      ESL_ALLOC(gz->zs, sizeof(z_stream));
+      gz->zs->zalloc   = Z_NULL;
+      gz->zs->zfree    = Z_NULL;
+      gz->zs->opaque   = Z_NULL;
+      gz->zs->next_in  = Z_NULL;
+      gz->zs->avail_in = 0;
+      if (inflateInit2(gz->zs, 15+16) != Z_OK) { free(gz->zs); gz->zs = NULL; ESL_XEXCEPTION(eslEMEM, "inflateInit2() failed"); }
+    }
+
+  free(gzifile);
+  *ret_gz = gz;
+  return eslOK;
+
+ ERROR:
+  free(gzifile);
+  esl_gzfile_Close(gz);
+  *ret_gz = NULL;
+  return status;
+}
+
+
+/* Function:  esl_gzfile_SetThreads()
+ * Synopsis:  Set the number of threads for BGZF decompression.
+ *
+ * Purpose:   Decompress BGZF blocks with <nthreads> threads: the
+ *            caller's, and <nthreads-1> more. <nthreads> of 0 or 1
+ *            means serial decompression, the default.
+ *
+ *            Has no effect on plain gzip files, which can only be
+ *            decompressed serially, or if Easel was built without
+ *            POSIX threads.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <nthreads> is negative.
+ */
+int
+esl_gzfile_SetThreads(ESL_GZFILE *gz, int nthreads)
+{
+  if (nthreads < 0) ESL_EXCEPTION(eslEINVAL, "number of threads must be >= 0");
+  gz->nthreads = nthreads;
+  return eslOK;
+}
+
+
+/* Function:  esl_gzfile_Close()
+ * Synopsis:  Close an open gzip file.
+ */
+void
+esl_gzfile_Close(ESL_GZFILE *gz)
+{
+  if (gz)
+    {
+      if (gz->fp) fclose(gz->fp);
+      if (gz->zs) { inflateEnd(gz->zs); free(gz->zs); }
+      free(gz->filename);
+      free(gz->out);
+      free(gz->in);
+      free(gz->blk_in);
+      free(gz->blk_out);
+      free(gz->idx_c);
+      free(gz->idx_u);
+      free(gz);
+    }
+}
+
+
+/*****************************************************************
+ *# 2. Reading and positioning.
+ *****************************************************************/
+
+/* Function:  esl_gzfile_Read()
+ * Synopsis:  Read decompressed data.
+ *
+ * Purpose:   Read up to <n> bytes of decompressed data into <buf>,
+ *            and return the number of bytes read in <*ret_n>. Fewer
+ *            than <n> bytes are read only at the end of the data.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEOF> if no data remain; <*ret_n> is 0.
+ *
+ *            <eslEFORMAT> if the compressed data are corrupt or
+ *            truncated; <gz->errmsg> says why, and <*ret_n> is 0.
+ *            Data decoded before the bad spot are returned first
+ *            (with <eslOK>); the error is then returned on this and
+ *            every later call, until the stream is repositioned.
+ *
+ * Throws:    <eslEMEM> on allocation failure, <eslESYS> if a system
+ *            call fails.
+ */
+int
+esl_gzfile_Read(ESL_GZFILE *gz, char *buf, int64_t n, int64_t *ret_n)
+{
+  int64_t nread = 0;
+  int64_t m;
+  int     status;
+
+  while (nread < n)
+    {
+      if (gz->opos == gz->nout)
+        {
+          status = gzfile_refill(gz);
+          if      (status == eslEOF)                  break;
+          else if (status == eslEFORMAT && nread > 0) break;  // deliver what we have; the error comes again next call
+          else if (status != eslOK)                   goto ERROR;
+        }
+      m = ESL_MIN(n - nread, gz->nout - gz->opos);
+      memcpy(buf + nread, gz->out + gz->opos, m);
+      gz->opos += m;
+      nread    += m;
+    }
+
+  *ret_n = nread;
+  return ((nread == 0 && n > 0) ? eslEOF : eslOK);
+
+ ERROR:
+  *ret_n = 0;
+  return status;
+}
+
+
+/* Function:  esl_gzfile_Tell()
+ * Synopsis:  Return the current uncompressed offset.
+ *
+ * Purpose:   Return the uncompressed offset of the next byte that
+ *            <esl_gzfile_Read()> will return.
+ */
+int64_t
+esl_gzfile_Tell(const ESL_GZFILE *gz)
+{
+  return gz->uoff + gz->opos;
+}
+
+
+/* Function:  esl_gzfile_Seek()
+ * Synopsis:  Reposition to an uncompressed offset.
+ *
+ * Purpose:   Reposition <gz> so the next byte read is the one at
+ *            uncompressed offset <offset>.
+ *
+ *            Within the currently decompressed data, this is
+ *            immediate. In a BGZF file, we jump to the block that
+ *            contains <offset> if we know where it is, from a .gzi
+ *            index or from having read past it already. Otherwise
+ *            we decompress forward to <offset>, rewinding to the
+ *            start of the file first if <offset> is behind us.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEOF> if <offset> is past the end of the data.
+ *
+ *            <eslEFORMAT> if the compressed data are corrupt;
+ *            <gz->errmsg> says why.
+ *
+ * Throws:    <eslEINVAL> if <offset> is negative; <eslEMEM> on
+ *            allocation failure; <eslESYS> if a system call fails.
+ */
+int
+esl_gzfile_Seek(ESL_GZFILE *gz, int64_t offset)
+{
+  int64_t lo, hi, mid;
+  int     status;
+
+  if (offset < 0) ESL_EXCEPTION(eslEINVAL, "can't seek to a negative offset");
+
+  if (offset >= gz->uoff && offset <= gz->uoff + gz->nout)
+    {
+      gz->opos = offset - gz->uoff;
+      return eslOK;
+    }
+
+  if (gz->is_bgzf)
+    {   /* last known block starting at or before <offset>; idx_u[0] = 0 */
+      lo = 0;
+      hi = gz->nidx - 1;
+      while (lo < hi)
+        {
+          mid = lo + (hi - lo + 1) / 2;
+          if (gz->idx_u[mid] <= offset) lo = mid;
+          else                          hi = mid - 1;
+        }
+      if (offset < gz->uoff || gz->idx_u[lo] > gz->uoff + gz->nout)
+        {
+          if ((status = gzfile_jump(gz, gz->idx_c[lo], gz->idx_u[lo])) != eslOK) return status;
+        }
+    }
+  else if (offset < gz->uoff)
+    {
+      if ((status = gzfile_jump(gz, 0, 0)) != eslOK) return status;
+    }
+
+  while (offset > gz->uoff + gz->nout)
+    {
+      if ((status = gzfile_refill(gz)) != eslOK) return status;
+    }
+  gz->opos = offset - gz->uoff;
+  return eslOK;
+}
+
+
+/* Function:  esl_gzfile_IsIndexed()
+ * Synopsis:  Return TRUE if a .gzi index was read.
+ *
+ * Purpose:   Return <TRUE> if <gz> is a BGZF file with a .gzi index,
+ *            so <esl_gzfile_Seek()> can jump to any offset without
+ *            decompressing the data before it.
+ */
+int
+esl_gzfile_IsIndexed(const ESL_GZFILE *gz)
+{
+  return gz->has_gzi;
+}
+
+
+/*****************************************************************
+ * 3. Internal functions: plain gzip, BGZF blocks, block index.
+ *****************************************************************/
+
+/* gzfile_refill()
+ * Advance past the current decompressed data, and decompress some
+ * more into <gz->out>. Returns <eslOK>, <eslEOF> when there's no more,
+ * or <eslEFORMAT> on corrupt data.
+ */
+static int
+gzfile_refill(ESL_GZFILE *gz)
+{
+  int status;
+
+  gz->uoff += gz->nout;
+  gz->nout  = 0;
+  gz->opos  = 0;
+
+  if (gz->errstatus != eslOK) return gz->errstatus;  // corrupt data stays corrupt, until we reposition
+  while (gz->nout == 0)         // a batch can legitimately decompress to nothing (empty blocks or members)
+    {
+      if (gz->at_eof) return eslEOF;
+      status = (gz->is_bgzf ? bgzf_read_batch(gz) : gzip_inflate_chunk(gz));
+      if (status == eslEFORMAT) gz->errstatus = status;
+      if (status != eslOK) return status;
+    }
+  return eslOK;
+}
+
+
+/* gzfile_jump()
+ * Reposition to the start of a BGZF block, or of a plain gzip file,
+ * at compressed offset <c> and uncompressed offset <u>.
+ */
+static int
+gzfile_jump(ESL_GZFILE *gz, int64_t c, int64_t u)
+{
+  if (fseeko(gz->fp, c, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed on %s", gz->filename);
+  if (! gz->is_bgzf)
+    {
+      inflateReset(gz->zs);
+      gz->zs->avail_in = 0;
+      gz->in_member    = FALSE;
+    }
+  gz->coff   = c;
+  gz->uoff   = u;
+  gz->nout   = 0;
+  gz->opos   = 0;
+  gz->at_eof    = FALSE;
+  gz->errstatus = eslOK;
+  return eslOK;
+}
+
+
+/* gzip_inflate_chunk()
+ * Plain gzip: decompress up to <gz->oalloc> bytes into <gz->out>.
+ * At the end of a member, starts the next one, if any. Like gzip, we
+ * stop quietly at trailing garbage (such as zero padding) after a
+ * member, but a member that ends early is an error. Like gzip -dc,
+ * we first return the data we could decompress, and the error comes
+ * on the next call (which decompresses nothing).
+ */
+static int
+gzip_inflate_chunk(ESL_GZFILE *gz)
+{
+  z_stream *zs = gz->zs;
+  size_t    n;
+  int       zret;
+
+  zs->next_out  = (Bytef *) gz->out;
+  zs->avail_out = (uInt) gz->oalloc;
+  while (zs->avail_out > 0)
+    {
+      if (zs->avail_in == 0)
+        {
+          n = fread(gz->in, 1, gz->inalloc, gz->fp);
+          if (n == 0)
+            {
+              if (ferror(gz->fp)) ESL_EXCEPTION(eslESYS, "fread() failed on %s", gz->filename);
+              if (gz->in_member && zs->avail_out < gz->oalloc) break;
+              if (gz->in_member)  ESL_FAIL(eslEFORMAT, gz->errmsg, "%s: unexpected end of file (truncated gzip data?)", gz->filename);
+              gz->at_eof = TRUE;
+              break;
+            }
+          gz->nin      = n;
+          zs->next_in  = gz->in;
+          zs->avail_in = (uInt) n;
+        }
+
+      if (! gz->in_member)
+        {
+          if (zs->next_in[0] != 0x1f) { gz->at_eof = TRUE; break; }  // trailing garbage: ignore it
+          gz->in_member = TRUE;
+        }
+
+      zret = inflate(zs, Z_NO_FLUSH);
+      if (zret == Z_STREAM_END)
+        {
+          gz->in_member = FALSE;
+          inflateReset(zs);
+        }
+      else if (zret == Z_MEM_ERROR) ESL_EXCEPTION(eslEMEM, "inflate() ran out of memory");
+      else if (zret != Z_OK && zret != Z_BUF_ERROR && zs->avail_out < gz->oalloc) break;  // zlib repeats the error next time
+      else if (zret != Z_OK && zret != Z_BUF_ERROR)
+        ESL_FAIL(eslEFORMAT, gz->errmsg, "%s: gzip decompression failed: %s", gz->filename, zs->msg ? zs->msg : "corrupt data");
+    }
+  gz->nout = gz->oalloc - zs->avail_out;
+  return eslOK;
+}
+
+
+/* is_bgzf_header()
+ * Return TRUE if the <n> bytes <p> start with a BGZF block header:
+ * a gzip header with one extra field, a "BC" subfield of length 2.
+ */
+static int
+is_bgzf_header(const unsigned char *p, int64_t n)
+{
+  return (n >= 18 &&
+          p[0]  == 0x1f && p[1]  == 0x8b && p[2] == 8 && (p[3] & 4) &&
+          p[10] == 6    && p[11] == 0    &&
+          p[12] == 'B'  && p[13] == 'C'  && p[14] == 2 && p[15] == 0);
+}
+
+
+/* bgzf_read_block()
+ * Read the next BGZF block from <gz->fp>, appending it to <gz->in>,
+ * which must have room for it. Returns <eslOK>, <eslEOF> at the end of
+ * the file, or <eslEFORMAT> if it isn't a complete BGZF block.
+ */
+static int
+bgzf_read_block(ESL_GZFILE *gz)
+{
+  unsigned char *p = gz->in + gz->nin;
+  int64_t        n;
+  int64_t        bsize;
+
+  n = fread(p, 1, 18, gz->fp);
+  if (n == 0)
+    {
+      if (ferror(gz->fp)) ESL_EXCEPTION(eslESYS, "fread() failed on %s", gz->filename);
+      return eslEOF;
+    }
+  if (! is_bgzf_header(p, n))
+    ESL_FAIL(eslEFORMAT, gz->errmsg, "%s: bad BGZF block header at offset %" PRId64, gz->filename, gz->coff);
+
+  bsize = (int64_t) (p[16] | (p[17] << 8)) + 1;
+  if (bsize < 18 + 8)
+    ESL_FAIL(eslEFORMAT, gz->errmsg, "%s: bad BGZF block size at offset %" PRId64, gz->filename, gz->coff);
+  if ((int64_t) fread(p + 18, 1, bsize - 18, gz->fp) != bsize - 18)
+    ESL_FAIL(eslEFORMAT, gz->errmsg, "%s: unexpected end of file in BGZF block at offset %" PRId64, gz->filename, gz->coff);
+  if (gzfile_le32(p + bsize - 4) > eslGZFILE_MAXBLOCK)
+    ESL_FAIL(eslEFORMAT, gz->errmsg, "%s: bad BGZF block data size at offset %" PRId64, gz->filename, gz->coff);
+
+  gz->nin  += bsize;
+  gz->coff += bsize;
+  return eslOK;
+}
+
+
+/* bgzf_inflate_block()
+ * Decompress the BGZF block <blk> into <out>, which has room for its
+ * uncompressed size (from its trailer), using <zs>, an inflate state
+ * for raw deflate data. Checks the CRC32. Returns <eslOK>, or
+ * <eslEFORMAT> on corrupt data. Thread-safe, given distinct <zs>.
+ */
+static int
+bgzf_inflate_block(z_stream *zs, const unsigned char *blk, char *out)
+{
+  int64_t  bsize = (int64_t) (blk[16] | (blk[17] << 8)) + 1;
+  uint32_t crc   = gzfile_le32(blk + bsize - 8);
+  uint32_t isize = gzfile_le32(blk + bsize - 4);
+
+  if (isize == 0) return eslOK;   // the EOF marker, and any other empty block
+
+  inflateReset(zs);
+  zs->next_in   = (Bytef *) (blk + 18);
+  zs->avail_in  = (uInt) (bsize - 18 - 8);
+  zs->next_out  = (Bytef *) out;
+  zs->avail_out = isize;
+  if (inflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out != isize) return eslEFORMAT;
+  if (crc32(crc32(0L, Z_NULL, 0), (const Bytef *) out, isize) != crc)  return eslEFORMAT;
+  return eslOK;
+}
+
+
+/* One thread's share of a batch: blocks <b0..b1-1>.
+ * <failed> is set to the first block that failed to decompress, or
+ * -2 if the inflate state couldn't be initialized; else it's -1.
+ */
+typedef struct {
+  ESL_GZFILE *gz;
+  int         b0, b1;
+  int         failed;
+} BGZF_JOB;
+
+static void *
+bgzf_inflate_job(void *arg)
+{
+  BGZF_JOB   *job = (BGZF_JOB *) arg;
+  ESL_GZFILE *gz  = job->gz;
+  z_stream    zs;
+  int         b;
+
+  zs.zalloc   = Z_NULL;
+  zs.zfree    = Z_NULL;
+  zs.opaque   = Z_NULL;
+  zs.next_in  = Z_NULL;
+  zs.avail_in = 0;
+  if (inflateInit2(&zs, -15) != Z_OK) { job->failed = -2; return NULL; }
+
+  job->failed = -1;
+  for (b = job->b0; b < job->b1; b++)
+    if (bgzf_inflate_block(&zs, gz->in + gz->blk_in[b], gz->out + gz->blk_out[b]) != eslOK)
+      { job->failed = b; break; }
+  inflateEnd(&zs);
+  return NULL;
+}
+
+
+/* bgzf_read_batch()
+ * BGZF: read the next batch of blocks and decompress them into
+ * <gz->out>, splitting the blocks among <gz->nthreads> threads.
+ */
+static int
+bgzf_read_batch(ESL_GZFILE *gz)
+{
+  int       maxblk = eslGZFILE_BLKBATCH * ESL_MAX(1, gz->nthreads);
+  int64_t   coff0  = gz->coff;
+  BGZF_JOB *job    = NULL;
+#ifdef HAVE_PTHREAD
+  pthread_t *tid   = NULL;
+  int       *alive = NULL;
+#endif
+  int64_t   nout;
+  int       njobs;
+  int       b, j;
+  int       status;
+
+  if (gz->blkalloc < maxblk + 1)
+    {
+      ESL_REALLOC(gz->blk_in,  sizeof(int64_t) * (maxblk + 1));
+      ESL_REALLOC(gz->blk_out, sizeof(int64_t) * (maxblk + 1));
+      gz->blkalloc = maxblk + 1;
+    }
+  if (gz->inalloc < (int64_t) maxblk * eslGZFILE_MAXBLOCK)
+    {
+      ESL_REALLOC(gz->in, sizeof(unsigned char) * maxblk * eslGZFILE_MAXBLOCK);
+      gz->inalloc = (int64_t) maxblk * eslGZFILE_MAXBLOCK;
+    }
+
+  gz->nblk = 0;
+  gz->nin  = 0;
+  nout     = 0;
+  while (gz->nblk < maxblk)
+    {
+      gz->blk_in[gz->nblk]  = gz->nin;
+      gz->blk_out[gz->nblk] = nout;
+      status = bgzf_read_block(gz);
+      if      (status == eslEOF) { gz->at_eof = TRUE; break; }
+      else if (status != eslOK)  goto ERROR;
+
+      if (! gz->has_gzi && (status = bgzf_index_add(gz, coff0 + gz->blk_in[gz->nblk], gz->uoff + nout)) != eslOK) goto ERROR;
+      nout += gzfile_le32(gz->in + gz->nin - 4);
+      gz->nblk++;
+    }
+  gz->blk_out[gz->nblk] = nout;
+
+  if (gz->oalloc < nout)
+    {
+      ESL_REALLOC(gz->out, sizeof(char) * nout);
+      gz->oalloc = nout;
+    }
+
+  njobs = ESL_MAX(1, ESL_MIN(gz->nthreads, gz->nblk));
+  ESL_ALLOC(job, sizeof(BGZF_JOB) * njobs);
+  for (j = 0; j < njobs; j++)
+    {
+      job[j].gz     = gz;
+      job[j].b0     = (int) ((int64_t) gz->nblk * j     / njobs);
+      job[j].b1     = (int) ((int64_t) gz->nblk * (j+1) / njobs);
+      job[j].failed = -1;
+    }
+
+#ifdef HAVE_PTHREAD
+  if (njobs > 1)
+    {
+      ESL_ALLOC(tid,   sizeof(pthread_t) * njobs);
+      ESL_ALLOC(alive, sizeof(int)       * njobs);
+      for (j = 1; j < njobs; j++)  // a thread that can't be started does its share in the caller, below
+        alive[j] = (pthread_create(&(tid[j]), NULL, bgzf_inflate_job, &(job[j])) == 0);
+      bgzf_inflate_job(&(job[0]));
+      for (j = 1; j < njobs; j++)
+        {
+          if (alive[j]) pthread_join(tid[j], NULL);
+          else          bgzf_inflate_job(&(job[j]));
+        }
+    }
+  else
+#endif
+    {
+      for (j = 0; j < njobs; j++) bgzf_inflate_job(&(job[j]));
+    }
+
+  for (j = 0; j < njobs; j++)
+    {
+      if (job[j].failed == -2) ESL_XEXCEPTION(eslEMEM, "inflateInit2() failed");
+      if (job[j].failed >= 0)
+        {
+          b = job[j].failed;
+          ESL_XFAIL(eslEFORMAT, gz->errmsg, "%s: corrupt BGZF block at offset %" PRId64, gz->filename, coff0 + gz->blk_in[b]);
+        }
+    }
+
+  gz->nout = nout;
+#ifdef HAVE_PTHREAD
+  free(tid);
+  free(alive);
+#endif
+  free(job);
+  return eslOK;
+
+ ERROR:
+#ifdef HAVE_PTHREAD
+  free(tid);
+  free(alive);
+#endif
+  free(job);
+  gz->nout = 0;
+  return status;
+}
+
+
+/* bgzf_index_add()
+ * Record that a BGZF block starts at compressed offset <c> and
+ * uncompressed offset <u>, unless we already know about it. Blocks
+ * arrive in order, except after a jump back, when they're known.
+ */
+static int
+bgzf_index_add(ESL_GZFILE *gz, int64_t c, int64_t u)
+{
+  int status;
+
+  if (gz->nidx > 0 && c <= gz->idx_c[gz->nidx-1]) return eslOK;
+
+  if (gz->nidx == gz->idxalloc)
+    {
+      gz->idxalloc = (gz->idxalloc == 0 ? 256 : gz->idxalloc * 2);
+      ESL_REALLOC(gz->idx_c, sizeof(int64_t) * gz->idxalloc);
+      ESL_REALLOC(gz->idx_u, sizeof(int64_t) * gz->idxalloc);
+    }
+  gz->idx_c[gz->nidx] = c;
+  gz->idx_u[gz->nidx] = u;
+  gz->nidx++;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* gzfile_read_gzi()
+ * Read a .gzi index (as written by `bgzip -i`): a little-endian
+ * uint64 count, then that many pairs of uint64 compressed and
+ * uncompressed offsets of block starts. The first block at (0,0) is
+ * implicit, and already in our index. Returns <eslOK>, <eslENOTFOUND>
+ * if <gzifile> can't be opened, or <eslEFORMAT> if it's corrupt.
+ */
+static int
+gzfile_read_gzi(ESL_GZFILE *gz, const char *gzifile)
+{
+  FILE         *fp = NULL;
+  unsigned char buf[16];
+  uint64_t      n, i;
+  int64_t       c, u;
+  int           status;
+
+  if ((fp = fopen(gzifile, "rb")) == NULL) return eslENOTFOUND;
+
+  if (fread(buf, 1, 8, fp) != 8) ESL_XFAIL(eslEFORMAT, gz->errmsg, "%s: truncated .gzi index", gzifile);
+  n = gzfile_le64(buf);
+  for (i = 0; i < n; i++)
+    {
+      if (fread(buf, 1, 16, fp) != 16) ESL_XFAIL(eslEFORMAT, gz->errmsg, "%s: truncated .gzi index", gzifile);
+      c = (int64_t) gzfile_le64(buf);
+      u = (int64_t) gzfile_le64(buf + 8);
+      if (c <= gz->idx_c[gz->nidx-1] || u < gz->idx_u[gz->nidx-1])
+        ESL_XFAIL(eslEFORMAT, gz->errmsg, "%s: .gzi index entries out of order", gzifile);
+      if ((status = bgzf_index_add(gz, c, u)) != eslOK) goto ERROR;
+    }
+  fclose(fp);
+  return eslOK;
+
+ ERROR:
+  if (fp) fclose(fp);
+  gz->nidx = 1;
+  return status;
+}
+
+
+static uint32_t
+gzfile_le32(const unsigned char *p)
+{
+  return ((uint32_t) p[0]) | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t
+gzfile_le64(const unsigned char *p)
+{
+  return ((uint64_t) gzfile_le32(p)) | ((uint64_t) gzfile_le32(p + 4) << 32);
+}
+
+
+
+/*****************************************************************
+ * 4. Unit tests.
+ *****************************************************************/
+#ifdef eslGZFILE_TESTDRIVE
+
+#include "esl_random.h"
+
+/* make_testdata()
+ * Random text of length <n>: lines of up to 80 characters, from a
+ * small alphabet, so it compresses but not trivially.
+ */
+static char *
+make_testdata(ESL_RANDOMNESS *rng, int64_t n)
+{
+  char    msg[] = "esl_gzfile test data creation failed";
+  char   *data  = malloc(sizeof(char) * ESL_MAX(1, n));
+  int64_t i;
+
+  if (! data) esl_fatal(msg);
+  for (i = 0; i < n; i++)
+    data[i] = (esl_rnd_Roll(rng, 60) == 0 ? '\n' : "ACGTNacgt>"[esl_rnd_Roll(rng, 10)]);
+  return data;
+}
+
+/* write_gzip()
+ * Write <data> to <fp> in plain gzip format, as <nmembers>
+ * concatenated gzip members, optionally followed by zero padding.
+ */
+static void
+write_gzip(FILE *fp, const char *data, int64_t n, int nmembers, int do_padding)
+{
+  char           msg[] = "esl_gzfile write_gzip() failed";
+  unsigned char *buf   = NULL;
+  z_stream       zs;
+  int64_t        start, end;
+  uLong          bufsize;
+  int            m;
+
+  for (m = 0; m < nmembers; m++)
+    {
+      start = n * m     / nmembers;
+      end   = n * (m+1) / nmembers;
+
+      zs.zalloc = Z_NULL; zs.zfree = Z_NULL; zs.opaque = Z_NULL;
+      if (deflateInit2(&zs, 6, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) esl_fatal(msg);
+      bufsize = deflateBound(&zs, end - start);
+      if ((buf = malloc(bufsize)) == NULL) esl_fatal(msg);
+      zs.next_in   = (Bytef *) (data + start);
+      zs.avail_in  = (uInt) (end - start);
+      zs.next_out  = buf;
+      zs.avail_out = (uInt) bufsize;
+      if (deflate(&zs, Z_FINISH) != Z_STREAM_END) esl_fatal(msg);
+      if (fwrite(buf, 1, zs.total_out, fp) != zs.total_out) esl_fatal(msg);
+      deflateEnd(&zs);
+      free(buf);
+    }
+  if (do_padding)
+    for (m = 0; m < 100; m++) fputc(0, fp);
+}
+
+/* write_bgzf()
+ * Write <data> to <fp> as a BGZF file, in blocks of random size up to
+ * the 0xff00 bytes that bgzip uses, followed by the standard empty EOF
+ * marker block. If <gzifp> is non-NULL, write a .gzi index to it.
+ */
+static void
+write_bgzf(ESL_RANDOMNESS *rng, FILE *fp, FILE *gzifp, const char *data, int64_t n)
+{
+  char          msg[]  = "esl_gzfile write_bgzf() failed";
+  unsigned char eof[28] = { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+  unsigned char hdr[18]  = { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0 };
+  unsigned char buf[eslGZFILE_MAXBLOCK];
+  unsigned char tail[8];
+  int64_t      *gzi_c  = NULL;
+  int64_t      *gzi_u  = NULL;
+  int64_t       nblk   = 0;
+  int64_t       pos    = 0;
+  int64_t       coff   = 0;
+  int64_t       len, bsize, i;
+  uint64_t      v;
+  uint32_t      crc;
+  z_stream      zs;
+  int           k;
+
+  if ((gzi_c = malloc(sizeof(int64_t) * (n / 1000 + 2))) == NULL) esl_fatal(msg);
+  if ((gzi_u = malloc(sizeof(int64_t) * (n / 1000 + 2))) == NULL) esl_fatal(msg);
+  while (pos < n)
+    {
+      len = 1000 + esl_rnd_Roll(rng, 0xff00 - 999);
+      len = ESL_MIN(len, n - pos);
+
+      zs.zalloc = Z_NULL; zs.zfree = Z_NULL; zs.opaque = Z_NULL;
+      if (deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) esl_fatal(msg);
+      zs.next_in   = (Bytef *) (data + pos);
+      zs.avail_in  = (uInt) len;
+      zs.next_out  = buf;
+      zs.avail_out = sizeof(buf) - 26;
+      if (deflate(&zs, Z_FINISH) != Z_STREAM_END) esl_fatal(msg);
+      bsize = 18 + zs.total_out + 8;
+      deflateEnd(&zs);
+
+      hdr[16] = (bsize - 1) & 0xff;
+      hdr[17] = (bsize - 1) >> 8;
+      crc     = crc32(crc32(0L, Z_NULL, 0), (const Bytef *) (data + pos), (uInt) len);
+      for (k = 0; k < 4; k++) { tail[k] = (crc >> (8*k)) & 0xff; tail[4+k] = ((uint32_t) len >> (8*k)) & 0xff; }
+      if (fwrite(hdr, 1, 18, fp) != 18)                          esl_fatal(msg);
+      if (fwrite(buf, 1, bsize - 26, fp) != (size_t) bsize - 26) esl_fatal(msg);
+      if (fwrite(tail, 1, 8, fp) != 8)                           esl_fatal(msg);
+
+      if (pos > 0) { gzi_c[nblk] = coff; gzi_u[nblk] = pos; nblk++; }
+      coff += bsize;
+      pos  += len;
+    }
+  if (fwrite(eof, 1, 28, fp) != 28) esl_fatal(msg);
+
+  if (gzifp)
+    {
+      for (k = 0, v = nblk; k < 8; k++) fputc((v >> (8*k)) & 0xff, gzifp);
+      for (i = 0; i < nblk; i++)
+        {
+          for (k = 0, v = gzi_c[i]; k < 8; k++) fputc((v >> (8*k)) & 0xff, gzifp);
+          for (k = 0, v = gzi_u[i]; k < 8; k++) fputc((v >> (8*k)) & 0xff, gzifp);
+        }
+    }
+  free(gzi_c);
+  free(gzi_u);
+}
+
+/* check_reading()
+ * Read all of <gz> in random-sized pieces and compare to <data>; then
+ * seek to random offsets, forward and back, and compare what's there.
+ */
+static void
+check_reading(ESL_RANDOMNESS *rng, ESL_GZFILE *gz, const char *data, int64_t n, char *msg)
+{
+  char   *buf = malloc(sizeof(char) * 100000);
+  int64_t pos = 0;
+  int64_t want, nread, offset;
+  int     i;
+
+  if (! buf) esl_fatal(msg);
+  while (pos < n)
+    {
+      want = 1 + esl_rnd_Roll(rng, 100000);
+      if (esl_gzfile_Read(gz, buf, want, &nread) != eslOK) esl_fatal(msg);
+      if (nread != ESL_MIN(want, n - pos))                 esl_fatal(msg);
+      if (memcmp(buf, data + pos, nread) != 0)             esl_fatal(msg);
+      pos += nread;
+      if (esl_gzfile_Tell(gz) != pos)                      esl_fatal(msg);
+    }
+  if (esl_gzfile_Read(gz, buf, 10, &nread) != eslEOF || nread != 0) esl_fatal(msg);
+
+  for (i = 0; i < 50; i++)
+    {
+      offset = esl_rnd_Roll(rng, n);
+      want   = 1 + esl_rnd_Roll(rng, 1000);
+      if (esl_gzfile_Seek(gz, offset)                != eslOK) esl_fatal(msg);
+      if (esl_gzfile_Tell(gz)                        != offset) esl_fatal(msg);
+      if (esl_gzfile_Read(gz, buf, want, &nread)     != eslOK) esl_fatal(msg);
+      if (nread != ESL_MIN(want, n - offset))                  esl_fatal(msg);
+      if (memcmp(buf, data + offset, nread) != 0)              esl_fatal(msg);
+    }
+  if (esl_gzfile_Seek(gz, n)                 != eslOK)                esl_fatal(msg);
+  if (esl_gzfile_Read(gz, buf, 10, &nread)   != eslEOF || nread != 0) esl_fatal(msg);
+  if (esl_gzfile_Seek(gz, n+1)               != eslEOF)               esl_fatal(msg);
+  free(buf);
+}
+
+
+/* utest_plain()
+ * Plain gzip, as several members with trailing padding, read
+ * sequentially and with seeks.
+ */
+static void
+utest_plain(ESL_RANDOMNESS *rng)
+{
+  char        msg[]         = "esl_gzfile plain gzip unit test failed";
+  char        tmpfile[32]   = "esltmpXXXXXX";
+  int64_t     n             = 500000 + esl_rnd_Roll(rng, 2000000);
+  char       *data          = make_testdata(rng, n);
+  ESL_GZFILE *gz            = NULL;
+  FILE       *fp;
+
+  if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal(msg);
+  write_gzip(fp, data, n, 1 + esl_rnd_Roll(rng, 3), TRUE);
+  fclose(fp);
+
+  if (esl_gzfile_Open(tmpfile, &gz) != eslOK) esl_fatal(msg);
+  if (gz->is_bgzf || esl_gzfile_IsIndexed(gz))  esl_fatal(msg);
+  check_reading(rng, gz, data, n, msg);
+  esl_gzfile_Close(gz);
+
+  remove(tmpfile);
+  free(data);
+}
+
+
+/* utest_bgzf()
+ * BGZF, with or without a .gzi index, decompressed with <nthreads>.
+ */
+static void
+utest_bgzf(ESL_RANDOMNESS *rng, int nthreads, int do_gzi)
+{
+  char        msg[]       = "esl_gzfile BGZF unit test failed";
+  char        tmpfile[32] = "esltmpXXXXXX";
+  char       *gzifile     = NULL;
+  int64_t     n           = 500000 + esl_rnd_Roll(rng, 4000000);
+  char       *data        = make_testdata(rng, n);
+  ESL_GZFILE *gz          = NULL;
+  FILE       *fp;
+  FILE       *gzifp       = NULL;
+
+  if (esl_tmpfile_named(tmpfile, &fp)             != eslOK) esl_fatal(msg);
+  if (esl_sprintf(&gzifile, "%s.gzi", tmpfile)    != eslOK) esl_fatal(msg);
+  if (do_gzi && (gzifp = fopen(gzifile, "wb"))    == NULL)  esl_fatal(msg);
+  write_bgzf(rng, fp, gzifp, data, n);
+  fclose(fp);
+  if (gzifp) fclose(gzifp);
+
+  if (esl_gzfile_Open(tmpfile, &gz)        != eslOK) esl_fatal(msg);
+  if (esl_gzfile_SetThreads(gz, nthreads)  != eslOK) esl_fatal(msg);
+  if (! gz->is_bgzf)                                 esl_fatal(msg);
+  if (esl_gzfile_IsIndexed(gz) != do_gzi)            esl_fatal(msg);
+  check_reading(rng, gz, data, n, msg);
+  esl_gzfile_Close(gz);
+
+  remove(tmpfile);
+  if (do_gzi) remove(gzifile);
+  free(gzifile);
+  free(data);
+}
+
+
+/* utest_corrupt()
+ * Corrupt or truncated data are normal <eslEFORMAT> errors, for
+ * both plain gzip and BGZF; so is a file that isn't gzip at all.
+ */
+static void
+utest_corrupt(ESL_RANDOMNESS *rng)
+{
+  char        msg[]       = "esl_gzfile corrupt data unit test failed";
+  char        tmpfile[32] = "esltmpXXXXXX";
+  int64_t     n           = 200000;
+  char       *data        = make_testdata(rng, n);
+  char       *buf         = malloc(sizeof(char) * n);
+  ESL_GZFILE *gz          = NULL;
+  FILE       *fp;
+  int64_t     nread;
+  int         do_bgzf, do_truncate;
+  int         c;
+  int         status;
+
+  if (! buf) esl_fatal(msg);
+  for (do_bgzf = 0; do_bgzf <= 1; do_bgzf++)
+    for (do_truncate = 0; do_truncate <= 1; do_truncate++)
+      {
+        strcpy(tmpfile, "esltmpXXXXXX");
+        if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal(msg);
+        if (do_bgzf) write_bgzf(rng, fp, NULL, data, n);
+        else         write_gzip(fp, data, n, 1, FALSE);
+        fclose(fp);
+
+        if (do_truncate)
+          {  /* chop the file off in the middle: rewrite its first 1000 bytes */
+            if ((fp = fopen(tmpfile, "rb")) == NULL)      esl_fatal(msg);
+            if (fread(buf, 1, 1000, fp) != 1000)          esl_fatal(msg);
+            fclose(fp);
+            if ((fp = fopen(tmpfile, "wb")) == NULL)      esl_fatal(msg);
+            if (fwrite(buf, 1, 1000, fp) != 1000)         esl_fatal(msg);
+            fclose(fp);
+          }
+        else
+          {  /* flip a byte of compressed data after the first header */
+            if ((fp = fopen(tmpfile, "r+b")) == NULL)     esl_fatal(msg);
+            if (fseeko(fp, 100, SEEK_SET) != 0)           esl_fatal(msg);
+            c = fgetc(fp);
+            if (fseeko(fp, 100, SEEK_SET) != 0)           esl_fatal(msg);
+            fputc(c ^ 0x55, fp);
+            fclose(fp);
+          }
+
+        if (esl_gzfile_Open(tmpfile, &gz) != eslOK) esl_fatal(msg);
+        while ((status = esl_gzfile_Read(gz, buf, n, &nread)) == eslOK) ;
+        if (status != eslEFORMAT || nread != 0) esl_fatal(msg);
+        if (strlen(gz->errmsg) == 0)            esl_fatal(msg);
+        esl_gzfile_Close(gz);
+        remove(tmpfile);
+      }
+
+  strcpy(tmpfile, "esltmpXXXXXX");
+  if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal(msg);
+  fputs(">seq1\nACGT\n", fp);
+  fclose(fp);
+  if (esl_gzfile_Open(tmpfile, &gz) != eslEFORMAT || gz != NULL) esl_fatal(msg);
+  remove(tmpfile);
+
+  free(buf);
+  free(data);
+}
+#endif /*eslGZFILE_TESTDRIVE*/
+
+#else // ! HAVE_ZLIB
+void esl_gzfile_silence_hack(void) { return; }
+#endif // HAVE_ZLIB
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef eslGZFILE_TESTDRIVE
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_gzfile.h"
+#include "esl_random.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,      "0",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for gzfile module";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+#ifdef HAVE_ZLIB
+  utest_plain(rng);
+  utest_bgzf(rng, 0, FALSE);
+  utest_bgzf(rng, 0, TRUE);
+  utest_bgzf(rng, 1, TRUE);
+  utest_bgzf(rng, 3, FALSE);
+  utest_bgzf(rng, 4, TRUE);
+  utest_corrupt(rng);
+#endif
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+
+  fprintf(stderr, "#  status = ok\n");
+  return eslOK;
+}
+#endif /*eslGZFILE_TESTDRIVE*/
+
+
+
+/*****************************************************************
+ * 6. Example.
+ *****************************************************************/
+#ifdef eslGZFILE_EXAMPLE
+/* Decompress a gzip file to stdout, like `gzip -dc`.
+ *   ./esl_gzfile_example [--cpu <n>] <file.gz>
+ */
+#include "esl_config.h"
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_gzfile.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "--cpu",     eslARG_INT,      "0",  NULL, "n>=0",NULL,  NULL, NULL, "number of threads for BGZF decompression",         0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <file.gz>";
+static char banner[] = "example of decompressing a gzip file with esl_gzfile";
+
+int
+main(int argc, char **argv)
+{
+#ifdef HAVE_ZLIB
+  ESL_GETOPTS *go       = esl_getopts_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char        *filename = esl_opt_GetArg(go, 1);
+  ESL_GZFILE  *gz       = NULL;
+  char         buf[65536];
+  int64_t      n;
+  int          status;
+
+  status = esl_gzfile_Open(filename, &gz);
+  if      (status == eslENOTFOUND) esl_fatal("couldn't open %s", filename);
+  else if (status == eslEFORMAT)   esl_fatal("%s isn't in gzip format", filename);
+  else if (status != eslOK)        esl_fatal("open failed with error %d", status);
+  esl_gzfile_SetThreads(gz, esl_opt_GetInteger(go, "--cpu"));
+
+  while ((status = esl_gzfile_Read(gz, buf, sizeof(buf), &n)) == eslOK)
+    fwrite(buf, 1, n, stdout);
+  if (status != eslEOF) esl_fatal("decompression failed:\n%s", gz->errmsg);
+
+  esl_gzfile_Close(gz);
+  esl_getopts_Destroy(go);
+  return 0;
+#else
+  esl_fatal("Easel was built without zlib");
+#endif
+}
+#endif /*eslGZFILE_EXAMPLE*/
@@ -0,0 +1,82 @@
+/* Reading gzip-compressed files in-process, with zlib.
+ */
+#ifndef eslGZFILE_INCLUDED
+#define eslGZFILE_INCLUDED
+#include "esl_config.h"
+#ifdef HAVE_ZLIB
+
+#include <stdio.h>
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#include <stdint.h>
+
+#include "easel.h"
+
+#ifdef __cplusplus // magic to make C++ compilers happy
+extern "C" {
+#endif
+
+#define eslGZFILE_INSIZE   262144   /* compressed input chunk, plain gzip                  */
+#define eslGZFILE_OUTSIZE  1048576  /* decompressed output chunk, plain gzip               */
+#define eslGZFILE_BLKBATCH 16       /* BGZF blocks read per batch, per thread              */
+#define eslGZFILE_MAXBLOCK 65536    /* BGZF blocks are at most this big, in and out        */
+
+struct z_stream_s;                  /* from <zlib.h>, which only esl_gzfile.c needs        */
+
+/* ESL_GZFILE
+ * An open gzip file, read sequentially or by random access (quickly,
+ * for a BGZF file). Offsets are in uncompressed bytes.
+ */
+typedef struct esl_gzfile_s {
+  FILE     *fp;               /* open compressed file                                   */
+  char     *filename;         /* name of the file, for diagnostics                      */
+  int       is_bgzf;          /* TRUE if file is BGZF: independently compressed blocks  */
+  int       nthreads;         /* threads for BGZF block decompression; 0 = serial       */
+
+  char     *out;              /* decompressed data, out[0..nout-1]                      */
+  int64_t   nout;             /* number of bytes in <out>                               */
+  int64_t   opos;             /* next byte of <out> to deliver                          */
+  int64_t   oalloc;           /* allocated size of <out>                                */
+  int64_t   uoff;             /* uncompressed offset of out[0]                          */
+  int       at_eof;           /* TRUE when no more input remains to decompress          */
+  int       errstatus;        /* eslEFORMAT once decompression fails; else eslOK        */
+
+  unsigned char *in;          /* compressed input: a gzip chunk, or a batch of blocks   */
+  int64_t   nin;              /* number of bytes in <in>                                */
+  int64_t   inalloc;          /* allocated size of <in>                                 */
+
+  struct z_stream_s *zs;      /* plain gzip: inflate state for the current member       */
+  int       in_member;        /* plain gzip: TRUE if we're in the middle of a member    */
+
+  int64_t   coff;             /* BGZF: compressed offset of the next block to read      */
+  int       nblk;             /* BGZF: number of blocks in the current batch            */
+  int       blkalloc;         /* BGZF: allocated size of the block arrays               */
+  int64_t  *blk_in;           /* BGZF: offset of each block in <in>                     */
+  int64_t  *blk_out;          /* BGZF: offset of each block's data in <out>             */
+
+  int64_t   nidx;             /* BGZF block index: number of blocks known               */
+  int64_t   idxalloc;         /* BGZF block index: allocated size of <idx_c>, <idx_u>   */
+  int64_t  *idx_c;            /* BGZF block index: compressed offsets of block starts   */
+  int64_t  *idx_u;            /* BGZF block index: corresponding uncompressed offsets   */
+  int       has_gzi;          /* TRUE if the index was read from a .gzi file            */
+
+  char      errmsg[eslERRBUFSIZE]; /* error message for normal (user) errors            */
+} ESL_GZFILE;
+
+/* 1. The ESL_GZFILE object */
+extern int  esl_gzfile_Open(const char *filename, ESL_GZFILE **ret_gz);
+extern int  esl_gzfile_SetThreads(ESL_GZFILE *gz, int nthreads);
+extern void esl_gzfile_Close(ESL_GZFILE *gz);
+
+/* 2. Reading and positioning */
+extern int     esl_gzfile_Read(ESL_GZFILE *gz, char *buf, int64_t n, int64_t *ret_n);
+extern int64_t esl_gzfile_Tell(const ESL_GZFILE *gz);
+extern int     esl_gzfile_Seek(ESL_GZFILE *gz, int64_t offset);
+extern int     esl_gzfile_IsIndexed(const ESL_GZFILE *gz);
+
+#ifdef __cplusplus // magic to make C++ compilers happy
+}
+#endif
+#endif /*HAVE_ZLIB*/
+#endif /*eslGZFILE_INCLUDED*/
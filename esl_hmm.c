@@ -485,6 +485,598 @@ esl_hmm_PosteriorDecoding(const ESL_DSQ *dsq, int L, const ESL_HMM *hmm, ESL_HMX
 }
 
 
+/*****************************************************************
+ * x. Fast DP: sparse transitions, checkpointed posteriors, Viterbi
+ *****************************************************************/
+
+/* Nonzero transitions out of a state that are separated by fewer
+ * than this many zeros are stored as one run: a few wasted multiplies
+ * cost less than breaking up a vectorizable inner loop.
+ */
+#define eslHMM_RUNGAP 4
+
+static int   hmm_sparse_runend(const float *t, int M, int k);
+static float hmm_sparse_fwd_row(const ESL_HMM_SPARSE *sh, const float *prv, ESL_DSQ x, float *cur);
+static float hmm_sparse_bck_row(const ESL_HMM_SPARSE *sh, float *nxt, ESL_DSQ x, float *cur);
+static float hmm_sparse_vit_row(const ESL_HMM_SPARSE *sh, const float *prv, ESL_DSQ x, float *cur, int *bp);
+static float hmm_dot(const float *a, const float *b, int n);
+
+
+/* Function:  esl_hmm_sparse_Create()
+ * Synopsis:  Rearrange an HMM's parameters for fast DP.
+ *
+ * Purpose:   Create an <ESL_HMM_SPARSE> from a parameterized and
+ *            configured <hmm> (see <esl_hmm_Configure()>), for the
+ *            <esl_hmm_sparse_*()> DP routines: transitions out of
+ *            each state as runs of consecutive nonzero probabilities,
+ *            and log probabilities for Viterbi. Parameters are
+ *            copied; if <hmm> changes, make a new one.
+ *
+ * Returns:   a pointer to the new object.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+ESL_HMM_SPARSE *
+esl_hmm_sparse_Create(const ESL_HMM *hmm)
+{
+  ESL_HMM_SPARSE *sh    = NULL;
+  int             M     = hmm->M;
+  int             Kp    = hmm->abc->Kp;
+  int             nvals = 0;
+  int             m, k, k1, r, v, x;
+  int             status;
+
+  ESL_ALLOC(sh, sizeof(ESL_HMM_SPARSE));
+  sh->rbeg  = sh->rk  = sh->rlen = sh->roff = NULL;
+  sh->rt    = sh->rlt = NULL;
+  sh->pi    = sh->lpi = sh->tend = sh->ltend = NULL;
+  sh->eo    = sh->leo = NULL;
+  sh->M     = M;
+  sh->Kp    = Kp;
+  sh->nruns = 0;
+
+  for (m = 0; m < M; m++)
+    for (k = 0; k < M; k = k1)
+      {
+	if (hmm->t[m][k] <= 0.0f) { k1 = k+1; continue; }
+	k1     = hmm_sparse_runend(hmm->t[m], M, k);
+	nvals += k1 - k;
+	sh->nruns++;
+      }
+
+  ESL_ALLOC(sh->rbeg,  sizeof(int)     * (M+1));
+  ESL_ALLOC(sh->rk,    sizeof(int)     * ESL_MAX(1, sh->nruns));
+  ESL_ALLOC(sh->rlen,  sizeof(int)     * ESL_MAX(1, sh->nruns));
+  ESL_ALLOC(sh->roff,  sizeof(int)     * ESL_MAX(1, sh->nruns));
+  ESL_ALLOC(sh->rt,    sizeof(float)   * ESL_MAX(1, nvals));
+  ESL_ALLOC(sh->rlt,   sizeof(float)   * ESL_MAX(1, nvals));
+  ESL_ALLOC(sh->pi,    sizeof(float)   * (M+1));
+  ESL_ALLOC(sh->lpi,   sizeof(float)   * (M+1));
+  ESL_ALLOC(sh->tend,  sizeof(float)   * ESL_MAX(1, M));
+  ESL_ALLOC(sh->ltend, sizeof(float)   * ESL_MAX(1, M));
+  ESL_ALLOC(sh->eo,    sizeof(float *) * Kp);                sh->eo[0]  = NULL;
+  ESL_ALLOC(sh->leo,   sizeof(float *) * Kp);                sh->leo[0] = NULL;
+  ESL_ALLOC(sh->eo[0], sizeof(float)   * Kp * ESL_MAX(1, M));
+  ESL_ALLOC(sh->leo[0],sizeof(float)   * Kp * ESL_MAX(1, M));
+  for (x = 1; x < Kp; x++)
+    {
+      sh->eo[x]  = sh->eo[0]  + x*M;
+      sh->leo[x] = sh->leo[0] + x*M;
+    }
+
+  for (r = 0, v = 0, m = 0; m < M; m++)
+    {
+      sh->rbeg[m] = r;
+      for (k = 0; k < M; k = k1)
+	{
+	  if (hmm->t[m][k] <= 0.0f) { k1 = k+1; continue; }
+	  k1 = hmm_sparse_runend(hmm->t[m], M, k);
+	  sh->rk[r]   = k;
+	  sh->rlen[r] = k1 - k;
+	  sh->roff[r] = v;
+	  for (; k < k1; k++, v++)
+	    {
+	      sh->rt[v]  = hmm->t[m][k];
+	      sh->rlt[v] = (hmm->t[m][k] > 0.0f ? logf(hmm->t[m][k]) : -eslINFINITY);
+	    }
+	  r++;
+	}
+      sh->tend[m]  = hmm->t[m][M];
+      sh->ltend[m] = (hmm->t[m][M] > 0.0f ? logf(hmm->t[m][M]) : -eslINFINITY);
+    }
+  sh->rbeg[M] = r;
+
+  for (k = 0; k <= M; k++)
+    {
+      sh->pi[k]  = hmm->pi[k];
+      sh->lpi[k] = (hmm->pi[k] > 0.0f ? logf(hmm->pi[k]) : -eslINFINITY);
+    }
+  for (x = 0; x < Kp; x++)
+    for (k = 0; k < M; k++)
+      {
+	sh->eo[x][k]  = hmm->eo[x][k];
+	sh->leo[x][k] = (hmm->eo[x][k] > 0.0f ? logf(hmm->eo[x][k]) : -eslINFINITY);
+      }
+  return sh;
+
+ ERROR:
+  esl_hmm_sparse_Destroy(sh);
+  return NULL;
+}
+
+/* Function:  esl_hmm_sparse_Destroy()
+ * Synopsis:  Frees an <ESL_HMM_SPARSE>.
+ */
+void
+esl_hmm_sparse_Destroy(ESL_HMM_SPARSE *sh)
+{
+  if (sh == NULL) return;
+
+  if (sh->eo)  { free(sh->eo[0]);  free(sh->eo);  }
+  if (sh->leo) { free(sh->leo[0]); free(sh->leo); }
+  free(sh->rbeg);
+  free(sh->rk);
+  free(sh->rlen);
+  free(sh->roff);
+  free(sh->rt);
+  free(sh->rlt);
+  free(sh->pi);
+  free(sh->lpi);
+  free(sh->tend);
+  free(sh->ltend);
+  free(sh);
+}
+
+
+/* Function:  esl_hmm_ckpt_Create()
+ * Synopsis:  Allocates a checkpointed DP workspace.
+ *
+ * Purpose:   Allocate a workspace for sequences of up to <L>
+ *            residues and models of up to <M> states. The
+ *            <esl_hmm_sparse_*()> DP routines reallocate it as
+ *            needed, so the initial size is only a hint.
+ *
+ * Returns:   a pointer to the new workspace.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+ESL_HMM_CKPT *
+esl_hmm_ckpt_Create(int L, int M)
+{
+  ESL_HMM_CKPT *ck = NULL;
+  int           status;
+
+  ESL_ALLOC(ck, sizeof(ESL_HMM_CKPT));
+  ck->ckp      = NULL;
+  ck->seg      = NULL;
+  ck->bp       = NULL;
+  ck->row[0]   = ck->row[1] = NULL;
+  ck->ckpalloc = 0;
+  ck->segalloc = 0;
+  ck->rowalloc = 0;
+  ck->M = ck->L = ck->B = ck->nseg = 0;
+
+  if (esl_hmm_ckpt_GrowTo(ck, L, M) != eslOK) goto ERROR;
+  return ck;
+
+ ERROR:
+  esl_hmm_ckpt_Destroy(ck);
+  return NULL;
+}
+
+/* Function:  esl_hmm_ckpt_GrowTo()
+ * Synopsis:  Lay out a checkpointed DP workspace for a new problem.
+ *
+ * Purpose:   Lay out <ck> for a sequence of length <L> and a model
+ *            of <M> states: segments of <B = ceil(sqrt(L))> rows,
+ *            reallocating if needed.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; then <ck> is still
+ *            valid for its previous size.
+ */
+int
+esl_hmm_ckpt_GrowTo(ESL_HMM_CKPT *ck, int L, int M)
+{
+  int   B    = ESL_MAX(1, (int) ceil(sqrt((double) L)));
+  int   nseg = ESL_MAX(1, (L + B - 1) / B);
+  void *p;
+  int   status;
+
+  if ((int64_t) nseg * M > ck->ckpalloc)
+    {
+      ESL_RALLOC(ck->ckp, p, sizeof(float) * nseg * M);
+      ck->ckpalloc = (int64_t) nseg * M;
+    }
+  if ((int64_t) B * M > ck->segalloc)
+    {
+      ESL_RALLOC(ck->seg, p, sizeof(float) * B * M);
+      ESL_RALLOC(ck->bp,  p, sizeof(int)   * B * M);
+      ck->segalloc = (int64_t) B * M;
+    }
+  if (M > ck->rowalloc)
+    {
+      ESL_RALLOC(ck->row[0], p, sizeof(float) * M);
+      ESL_RALLOC(ck->row[1], p, sizeof(float) * M);
+      ck->rowalloc = M;
+    }
+  ck->M    = M;
+  ck->L    = L;
+  ck->B    = B;
+  ck->nseg = nseg;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* Function:  esl_hmm_ckpt_Destroy()
+ * Synopsis:  Frees a checkpointed DP workspace.
+ */
+void
+esl_hmm_ckpt_Destroy(ESL_HMM_CKPT *ck)
+{
+  if (ck == NULL) return;
+  free(ck->ckp);
+  free(ck->seg);
+  free(ck->bp);
+  free(ck->row[0]);
+  free(ck->row[1]);
+  free(ck);
+}
+
+
+/* Function:  esl_hmm_sparse_Forward()
+ * Synopsis:  Forward score, in O(M) memory.
+ *
+ * Purpose:   Calculate the Forward score of digital sequence <dsq>
+ *            (1..L) given model <sh>, using two rows of workspace
+ *            <ck>: the same score as <esl_hmm_Forward()> (up to
+ *            floating point roundoff), without a DP matrix. The
+ *            cost is proportional to L times the number of nonzero
+ *            transitions, not $LM^2$.
+ *
+ * Returns:   <eslOK> on success, and the score (in nats) is in
+ *            <*opt_sc>. The score is $-\infty$ if <dsq> has zero
+ *            probability.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+esl_hmm_sparse_Forward(const ESL_DSQ *dsq, int L, const ESL_HMM_SPARSE *sh, ESL_HMM_CKPT *ck, float *opt_sc)
+{
+  float  *prv, *cur, *tmp;
+  double  logsc;
+  int     i;
+  int     status;
+
+  if ((status = esl_hmm_ckpt_GrowTo(ck, 0, sh->M)) != eslOK) return status;
+  if (L == 0) { if (opt_sc) *opt_sc = sh->lpi[sh->M]; return eslOK; }
+
+  prv   = ck->row[0];
+  cur   = ck->row[1];
+  logsc = hmm_sparse_fwd_row(sh, NULL, dsq[1], cur);
+  for (i = 2; i <= L; i++)
+    {
+      tmp = prv; prv = cur; cur = tmp;
+      logsc += hmm_sparse_fwd_row(sh, prv, dsq[i], cur);
+    }
+  logsc += logf(hmm_dot(cur, sh->tend, sh->M));
+
+  if (opt_sc) *opt_sc = (float) logsc;
+  return eslOK;
+}
+
+
+/* Function:  esl_hmm_sparse_Posterior()
+ * Synopsis:  Posterior decoding by checkpointed Forward/Backward.
+ *
+ * Purpose:   Run Forward and Backward for digital sequence <dsq>
+ *            (1..L) given model <sh>, in $O(M \sqrt{L})$ memory in
+ *            workspace <ck>: Forward saves a checkpoint row every
+ *            <ck->B> rows, and Backward recomputes the Forward rows
+ *            of one segment at a time from them.
+ *
+ *            Optionally, return the Forward score in <*opt_sc>; the
+ *            posterior decoding in <opt_path[1..L]>, the state with
+ *            the highest posterior probability at each position; and
+ *            that probability in <opt_pp[1..L]>. Caller provides
+ *            <opt_path> and <opt_pp>, of at least <L+1> elements.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if <dsq> has zero probability; then the
+ *            score is $-\infty$, and <opt_path> and <opt_pp> are not
+ *            set.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+esl_hmm_sparse_Posterior(const ESL_DSQ *dsq, int L, const ESL_HMM_SPARSE *sh, ESL_HMM_CKPT *ck, float *opt_sc, int *opt_path, float *opt_pp)
+{
+  int     M = sh->M;
+  float  *prv, *cur, *b, *nb, *f, *tmp;
+  float   norm;
+  double  logsc;
+  int     B, s, i, i0, i1, k, kmax;
+  int     status;
+
+  if ((status = esl_hmm_ckpt_GrowTo(ck, L, M)) != eslOK) return status;
+  if (L == 0) { if (opt_sc) *opt_sc = sh->lpi[M]; return eslOK; }
+  B = ck->B;
+
+  /* Forward, checkpointing row s*B for each segment s > 0 */
+  prv   = ck->row[0];
+  cur   = ck->row[1];
+  logsc = 0.;
+  for (i = 1; i <= L; i++)
+    {
+      logsc += hmm_sparse_fwd_row(sh, (i > 1 ? prv : NULL), dsq[i], cur);
+      if (i % B == 0 && i < L) esl_vec_FCopy(cur, M, ck->ckp + (int64_t) (i / B) * M);
+      tmp = prv; prv = cur; cur = tmp;
+    }
+  logsc += logf(hmm_dot(prv, sh->tend, M));
+  if (opt_sc) *opt_sc = (float) logsc;
+  if (logsc == -eslINFINITY) return eslERANGE;
+  if (! opt_path && ! opt_pp) return eslOK;
+
+  /* Backward, segment by segment */
+  b  = ck->row[0];
+  nb = ck->row[1];
+  esl_vec_FCopy(sh->tend, M, b);
+  for (s = ck->nseg-1; s >= 0; s--)
+    {
+      i0 = s * B + 1;
+      i1 = ESL_MIN(L, (s+1) * B);
+      hmm_sparse_fwd_row(sh, (s > 0 ? ck->ckp + (int64_t) s * M : NULL), dsq[i0], ck->seg);
+      for (i = i0+1; i <= i1; i++)
+	hmm_sparse_fwd_row(sh, ck->seg + (int64_t) (i-i0-1) * M, dsq[i], ck->seg + (int64_t) (i-i0) * M);
+
+      for (i = i1; i >= i0; i--)
+	{
+	  f = ck->seg + (int64_t) (i-i0) * M;
+	  for (k = 0; k < M; k++) f[k] *= b[k];
+	  norm = esl_vec_FSum(f, M);
+	  kmax = esl_vec_FArgMax(f, M);
+	  if (opt_path) opt_path[i] = kmax;
+	  if (opt_pp)   opt_pp[i]   = (norm > 0.0f ? f[kmax] / norm : 0.0f);
+
+	  if (i > 1)
+	    {
+	      hmm_sparse_bck_row(sh, b, dsq[i], nb);
+	      tmp = b; b = nb; nb = tmp;
+	    }
+	}
+    }
+  return eslOK;
+}
+
+
+/* Function:  esl_hmm_sparse_Viterbi()
+ * Synopsis:  Viterbi score and optimal path, checkpointed.
+ *
+ * Purpose:   Find the most probable state path for digital sequence
+ *            <dsq> (1..L) given model <sh>, in $O(M \sqrt{L})$ memory
+ *            in workspace <ck>. Optionally return its score (in nats,
+ *            the log of the path's probability times its emission
+ *            odds ratios, on the same scale as the Forward score) in
+ *            <*opt_sc>; and the path itself in <opt_path[1..L]>,
+ *            which the caller provides, of at least <L+1> elements.
+ *
+ *            The path is traced back one segment at a time,
+ *            recomputing the segment's rows and backpointers from the
+ *            checkpoint before it. Rows are kept relative to their
+ *            maximum, so long sequences don't lose float precision.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if <dsq> has zero probability; then the
+ *            score is $-\infty$ and <opt_path> is not set.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+esl_hmm_sparse_Viterbi(const ESL_DSQ *dsq, int L, const ESL_HMM_SPARSE *sh, ESL_HMM_CKPT *ck, float *opt_sc, int *opt_path)
+{
+  int     M = sh->M;
+  float  *prv, *cur, *tmp;
+  float   sc, best;
+  double  vsc;
+  int     B, s, i, i0, i1, k, kend;
+  int     status;
+
+  if ((status = esl_hmm_ckpt_GrowTo(ck, L, M)) != eslOK) return status;
+  if (L == 0) { if (opt_sc) *opt_sc = sh->lpi[M]; return eslOK; }
+  B = ck->B;
+
+  prv = ck->row[0];
+  cur = ck->row[1];
+  vsc = 0.;
+  for (i = 1; i <= L; i++)
+    {
+      vsc += hmm_sparse_vit_row(sh, (i > 1 ? prv : NULL), dsq[i], cur, NULL);
+      if (i % B == 0 && i < L) esl_vec_FCopy(cur, M, ck->ckp + (int64_t) (i / B) * M);
+      tmp = prv; prv = cur; cur = tmp;
+    }
+  best = -eslINFINITY;
+  kend = -1;
+  for (k = 0; k < M; k++)
+    if ((sc = prv[k] + sh->ltend[k]) > best) { best = sc; kend = k; }
+  vsc += best;
+  if (opt_sc) *opt_sc = (float) vsc;
+  if (kend == -1 || vsc == -eslINFINITY) return eslERANGE;
+  if (! opt_path) return eslOK;
+
+  k = kend;
+  for (s = ck->nseg-1; s >= 0; s--)
+    {
+      i0 = s * B + 1;
+      i1 = ESL_MIN(L, (s+1) * B);
+      hmm_sparse_vit_row(sh, (s > 0 ? ck->ckp + (int64_t) s * M : NULL), dsq[i0], ck->seg, ck->bp);
+      for (i = i0+1; i <= i1; i++)
+	hmm_sparse_vit_row(sh, ck->seg + (int64_t) (i-i0-1) * M, dsq[i], ck->seg + (int64_t) (i-i0) * M, ck->bp + (int64_t) (i-i0) * M);
+
+      for (i = i1; i >= i0; i--)
+	{
+	  opt_path[i] = k;
+	  k = ck->bp[(int64_t) (i-i0) * M + k];
+	}
+    }
+  return eslOK;
+}
+
+
+/* hmm_sparse_runend()
+ * Given a nonzero transition t[k], return the end (one past the last
+ * state) of the run it starts.
+ */
+static int
+hmm_sparse_runend(const float *t, int M, int k)
+{
+  int end = k+1;
+  int j;
+
+  for (j = k+1; j < M && j < end + eslHMM_RUNGAP; j++)
+    if (t[j] > 0.0f) end = j+1;
+  return end;
+}
+
+/* hmm_sparse_fwd_row()
+ * One row of scaled Forward for residue <x>: <cur> = (<prv> T) .* eo[x],
+ * or pi .* eo[x] for the first row if <prv> is NULL, then divided
+ * by its maximum. Returns the log of that scale factor; -inf if the
+ * row is all zero.
+ */
+static float
+hmm_sparse_fwd_row(const ESL_HMM_SPARSE *sh, const float *prv, ESL_DSQ x, float *cur)
+{
+  const float *eo = sh->eo[x];
+  const float *tv;
+  float       *dst;
+  float        a, max;
+  int          M  = sh->M;
+  int          m, r, k, n;
+
+  if (prv)
+    {
+      esl_vec_FSet(cur, M, 0.0f);
+      for (m = 0; m < M; m++)
+	{
+	  if ((a = prv[m]) == 0.0f) continue;
+	  for (r = sh->rbeg[m]; r < sh->rbeg[m+1]; r++)
+	    {
+	      dst = cur   + sh->rk[r];
+	      tv  = sh->rt + sh->roff[r];
+	      n   = sh->rlen[r];
+	      for (k = 0; k < n; k++) dst[k] += a * tv[k];
+	    }
+	}
+      for (k = 0; k < M; k++) cur[k] *= eo[k];
+    }
+  else
+    for (k = 0; k < M; k++) cur[k] = sh->pi[k] * eo[k];
+
+  max = esl_vec_FMax(cur, M);
+  if (max == 0.0f) return -eslINFINITY;
+  for (k = 0; k < M; k++) cur[k] /= max;
+  return logf(max);
+}
+
+/* hmm_sparse_bck_row()
+ * One row of scaled Backward, where <x> is the next residue:
+ * <cur>[m] = sum_k t[m][k] eo[x][k] <nxt>[k], divided by its maximum.
+ * Overwrites <nxt>. Returns the log of the scale factor.
+ */
+static float
+hmm_sparse_bck_row(const ESL_HMM_SPARSE *sh, float *nxt, ESL_DSQ x, float *cur)
+{
+  const float *eo = sh->eo[x];
+  float        sum, max;
+  int          M  = sh->M;
+  int          m, r, k;
+
+  for (k = 0; k < M; k++) nxt[k] *= eo[k];
+  for (m = 0; m < M; m++)
+    {
+      for (sum = 0.0f, r = sh->rbeg[m]; r < sh->rbeg[m+1]; r++)
+	sum += hmm_dot(sh->rt + sh->roff[r], nxt + sh->rk[r], sh->rlen[r]);
+      cur[m] = sum;
+    }
+
+  max = esl_vec_FMax(cur, M);
+  if (max == 0.0f) return -eslINFINITY;
+  for (k = 0; k < M; k++) cur[k] /= max;
+  return logf(max);
+}
+
+/* hmm_sparse_vit_row()
+ * One row of log-space Viterbi for residue <x>:
+ * <cur>[k] = max_m (<prv>[m] + log t[m][k]) + log eo[x][k], or
+ * log pi[k] + log eo[x][k] if <prv> is NULL; if <bp> is non-NULL,
+ * the maximizing m in <bp>[k] (the smallest one, on ties; -1 for
+ * none). Then subtracts the row's maximum, and returns it; -inf if
+ * the whole row is -inf.
+ */
+static float
+hmm_sparse_vit_row(const ESL_HMM_SPARSE *sh, const float *prv, ESL_DSQ x, float *cur, int *bp)
+{
+  const float *leo = sh->leo[x];
+  const float *tv;
+  float       *dst;
+  int         *bpk;
+  float        a, sc, max;
+  int          M   = sh->M;
+  int          m, r, k, n;
+
+  if (bp) esl_vec_ISet(bp, M, -1);
+  if (prv)
+    {
+      esl_vec_FSet(cur, M, -eslINFINITY);
+      for (m = 0; m < M; m++)
+	{
+	  if ((a = prv[m]) == -eslINFINITY) continue;
+	  for (r = sh->rbeg[m]; r < sh->rbeg[m+1]; r++)
+	    {
+	      dst = cur    + sh->rk[r];
+	      tv  = sh->rlt + sh->roff[r];
+	      n   = sh->rlen[r];
+	      if (bp)
+		{
+		  bpk = bp + sh->rk[r];
+		  for (k = 0; k < n; k++)
+		    if ((sc = a + tv[k]) > dst[k]) { dst[k] = sc; bpk[k] = m; }
+		}
+	      else
+		for (k = 0; k < n; k++) dst[k] = ESL_MAX(dst[k], a + tv[k]);
+	    }
+	}
+      for (k = 0; k < M; k++) cur[k] += leo[k];
+    }
+  else
+    for (k = 0; k < M; k++) cur[k] = sh->lpi[k] + leo[k];
+
+  max = esl_vec_FMax(cur, M);
+  if (max == -eslINFINITY) return -eslINFINITY;
+  for (k = 0; k < M; k++) cur[k] -= max;
+  return max;
+}
+
+/* hmm_dot()
+ * Dot product, summed in 8 interleaved partial sums so the compiler
+ * can vectorize it without reassociating floating point math.
+ */
+static float
+hmm_dot(const float *a, const float *b, int n)
+{
+  float s[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+  int   k, j;
+
+  for (k = 0; k + 8 <= n; k += 8)
+    for (j = 0; j < 8; j++) s[j] += a[k+j] * b[k+j];
+  for (; k < n; k++) s[0] += a[k] * b[k];
+  return ((s[0] + s[4]) + (s[1] + s[5])) + ((s[2] + s[6]) + (s[3] + s[7]));
+}
+
+
 
 
 /*****************************************************************
@@ -526,6 +1118,302 @@ make_occasionally_dishonest_casino(ESL_HMM **ret_hmm, ESL_ALPHABET **ret_abc)
 }
 #endif /*eslHMM_TESTDRIVE*/
 
+/*****************************************************************
+ * x. Benchmark driver
+ *****************************************************************/
+#ifdef eslHMM_BENCHMARK
+/* gcc -O3 -I. -L. -o esl_hmm_benchmark -DeslHMM_BENCHMARK esl_hmm.c -leasel -lm
+ * ./esl_hmm_benchmark [-D]
+ */
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_dirichlet.h"
+#include "esl_getopts.h"
+#include "esl_hmm.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",     eslARG_NONE,     FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",     eslARG_INT,        "0",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",     eslARG_INT,   "100000",  NULL, "n>0", NULL,  NULL, NULL, "sequence length",                                  0 },
+  { "-M",     eslARG_INT,      "200",  NULL, "n>0", NULL,  NULL, NULL, "number of states",                                 0 },
+  { "-W",     eslARG_INT,        "2",  NULL, "n>=0",NULL,  NULL, NULL, "transitions to states up to <n> away from each",   0 },
+  { "-D",     eslARG_NONE,     FALSE,  NULL, NULL,  NULL,  NULL, NULL, "also time the dense esl_hmm_Forward()",            0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for HMM DP";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc = esl_alphabet_Create(eslDNA);
+  ESL_STOPWATCH  *w   = esl_stopwatch_Create();
+  int             L   = esl_opt_GetInteger(go, "-L");
+  int             M   = esl_opt_GetInteger(go, "-M");
+  int             W   = esl_opt_GetInteger(go, "-W");
+  ESL_HMM        *hmm = esl_hmm_Create(abc, M);
+  ESL_HMM_SPARSE *sh  = NULL;
+  ESL_HMM_CKPT   *ck  = NULL;
+  ESL_HMX        *mx  = NULL;
+  ESL_DSQ        *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  int            *path = malloc(sizeof(int)   * (L+1));
+  float          *pp   = malloc(sizeof(float) * (L+1));
+  double          fq[4] = { 0.25, 0.25, 0.25, 0.25 };
+  float           sc;
+  int             k, d;
+
+  /* A banded segmentation model: each state stays, or moves up to W states away */
+  esl_vec_FSet(hmm->pi, M+1, 1.0f / (float) M);
+  hmm->pi[M] = 0.0f;
+  for (k = 0; k < M; k++)
+    {
+      esl_vec_FSet(hmm->t[k], M+1, 0.0f);
+      for (d = -W; d <= W; d++)
+	if (k+d >= 0 && k+d < M) hmm->t[k][k+d] = (d == 0 ? 0.99f : 0.01f / (2*W));
+      esl_vec_FNorm(hmm->t[k], M);
+      esl_vec_FScale(hmm->t[k], M, 1.0f - 1.0f / (float) L);
+      hmm->t[k][M] = 1.0f / (float) L;
+      esl_dirichlet_FSampleUniform(rng, abc->K, hmm->e[k]);
+    }
+  esl_hmm_Configure(hmm, NULL);
+  sh = esl_hmm_sparse_Create(hmm);
+  ck = esl_hmm_ckpt_Create(L, M);
+  esl_rsq_xIID(rng, fq, abc->K, L, dsq);
+
+  esl_stopwatch_Start(w);
+  esl_hmm_sparse_Forward(dsq, L, sh, ck, &sc);
+  esl_stopwatch_Stop(w);
+  printf("# sparse Forward:   %12.2f nats; %8.1f Mcells/s\n", sc, (double) L * M / w->user / 1e6);
+
+  esl_stopwatch_Start(w);
+  esl_hmm_sparse_Posterior(dsq, L, sh, ck, &sc, path, pp);
+  esl_stopwatch_Stop(w);
+  printf("# sparse Posterior: %12.2f nats; %8.1f Mcells/s\n", sc, (double) L * M / w->user / 1e6);
+
+  esl_stopwatch_Start(w);
+  esl_hmm_sparse_Viterbi(dsq, L, sh, ck, &sc, path);
+  esl_stopwatch_Stop(w);
+  printf("# sparse Viterbi:   %12.2f nats; %8.1f Mcells/s\n", sc, (double) L * M / w->user / 1e6);
+
+  if (esl_opt_GetBoolean(go, "-D"))
+    {
+      mx = esl_hmx_Create(L, M);
+      esl_stopwatch_Start(w);
+      esl_hmm_Forward(dsq, L, hmm, mx, &sc);
+      esl_stopwatch_Stop(w);
+      printf("# dense Forward:    %12.2f nats; %8.1f Mcells/s\n", sc, (double) L * M / w->user / 1e6);
+      esl_hmx_Destroy(mx);
+    }
+
+  free(pp);
+  free(path);
+  free(dsq);
+  esl_hmm_ckpt_Destroy(ck);
+  esl_hmm_sparse_Destroy(sh);
+  esl_hmm_Destroy(hmm);
+  esl_stopwatch_Destroy(w);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslHMM_BENCHMARK*/
+
+
+/*****************************************************************
+ * x. Unit tests
+ *****************************************************************/
+#ifdef eslHMM_TESTDRIVE
+#include "esl_dirichlet.h"
+
+/* A random model with sparse transitions, like a segmentation
+ * model: a strong self transition, a few random ones, and mean
+ * sequence length ~300.
+ */
+static ESL_HMM *
+hmm_utest_sparse_model(ESL_RANDOMNESS *rng, const ESL_ALPHABET *abc, int M)
+{
+  ESL_HMM *hmm = esl_hmm_Create(abc, M);
+  int      k, m, n;
+
+  esl_vec_FSet(hmm->pi, M+1, 0.0f);
+  for (k = 0; k < M; k++)
+    if (k == 0 || esl_rnd_Roll(rng, 2)) hmm->pi[k] = esl_random(rng);
+  esl_vec_FNorm(hmm->pi, M+1);
+
+  for (m = 0; m < M; m++)
+    {
+      esl_vec_FSet(hmm->t[m], M+1, 0.0f);
+      hmm->t[m][m] = 20.0f;
+      for (n = 1 + esl_rnd_Roll(rng, 3); n > 0; n--)
+	hmm->t[m][esl_rnd_Roll(rng, M)] += esl_random(rng);
+      esl_vec_FNorm(hmm->t[m], M);
+      esl_vec_FScale(hmm->t[m], M, 1.0f - 1.0f/300.0f);
+      hmm->t[m][M] = 1.0f/300.0f;
+      esl_dirichlet_FSampleUniform(rng, abc->K, hmm->e[m]);
+    }
+  esl_hmm_Configure(hmm, NULL);
+  return hmm;
+}
+
+/* Reference Viterbi score, in a full matrix, in double precision. */
+static double
+hmm_utest_viterbi(const ESL_DSQ *dsq, int L, const ESL_HMM *hmm)
+{
+  int      M  = hmm->M;
+  double **v  = malloc(sizeof(double *) * (L+1));
+  double   best;
+  int      i, k, m;
+
+  if (L == 0) { free(v); return log(hmm->pi[M]); }
+  for (i = 1; i <= L; i++) v[i] = malloc(sizeof(double) * M);
+
+  for (k = 0; k < M; k++) v[1][k] = log(hmm->pi[k]) + log(hmm->eo[dsq[1]][k]);
+  for (i = 2; i <= L; i++)
+    for (k = 0; k < M; k++)
+      {
+	for (best = -eslINFINITY, m = 0; m < M; m++)
+	  best = ESL_MAX(best, v[i-1][m] + log(hmm->t[m][k]));
+	v[i][k] = best + log(hmm->eo[dsq[i]][k]);
+      }
+  for (best = -eslINFINITY, m = 0; m < M; m++)
+    best = ESL_MAX(best, v[L][m] + log(hmm->t[m][M]));
+
+  for (i = 1; i <= L; i++) free(v[i]);
+  free(v);
+  return best;
+}
+
+/* Score of state path <path[1..L]>, on the Viterbi scale */
+static double
+hmm_utest_pathscore(const ESL_DSQ *dsq, int L, const ESL_HMM *hmm, const int *path)
+{
+  double sc = log(hmm->pi[path[1]]);
+  int    i;
+
+  for (i = 1; i <= L; i++)
+    {
+      sc += log(hmm->eo[dsq[i]][path[i]]);
+      sc += log(hmm->t[path[i]][i < L ? path[i+1] : hmm->M]);
+    }
+  return sc;
+}
+
+
+/* utest_sparse()
+ * The sparse Forward score and posterior decoding agree with the
+ * dense <esl_hmm_Forward()>, <_Backward()>, <_PosteriorDecoding()>;
+ * the sparse Viterbi score agrees with a brute force one, and its
+ * path has that score. One workspace is reused for all sizes.
+ */
+static void
+utest_sparse(ESL_RANDOMNESS *rng, const ESL_ALPHABET *abc, int ntrials)
+{
+  char            msg[]  = "hmm sparse DP unit test failed";
+  ESL_HMM        *hmm    = NULL;
+  ESL_HMM_SPARSE *sh     = NULL;
+  ESL_HMM_CKPT   *ck     = esl_hmm_ckpt_Create(0, 0);
+  ESL_HMX        *fwd    = NULL;
+  ESL_HMX        *bck    = NULL;
+  ESL_HMX        *pp     = NULL;
+  ESL_DSQ        *dsq    = NULL;
+  int            *path   = NULL;
+  int            *spath  = NULL;
+  float          *spp    = NULL;
+  float           fsc, bsc, ssc, psc, vsc;
+  double          vref;
+  int             trial, L, M, i;
+
+  if (! ck) esl_fatal(msg);
+  for (trial = 0; trial < ntrials; trial++)
+    {
+      M   = 1 + esl_rnd_Roll(rng, 40);
+      hmm = hmm_utest_sparse_model(rng, abc, M);
+      if ((sh = esl_hmm_sparse_Create(hmm)) == NULL) esl_fatal(msg);
+      esl_hmm_Emit(rng, hmm, &dsq, &path, &L);
+
+      if ((spath = malloc(sizeof(int)   * (L+1))) == NULL) esl_fatal(msg);
+      if ((spp   = malloc(sizeof(float) * (L+1))) == NULL) esl_fatal(msg);
+      fwd = esl_hmx_Create(L, M);
+      bck = esl_hmx_Create(L, M);
+      pp  = esl_hmx_Create(L, M);
+
+      esl_hmm_Forward (dsq, L, hmm, fwd, &fsc);
+      esl_hmm_Backward(dsq, L, hmm, bck, &bsc);
+      esl_hmm_PosteriorDecoding(dsq, L, hmm, fwd, bck, pp);
+
+      if (esl_hmm_sparse_Forward(dsq, L, sh, ck, &ssc) != eslOK)                 esl_fatal(msg);
+      if (esl_FCompareNew(fsc, ssc, 1e-4, 1e-3) != eslOK)                         esl_fatal("%s: forward %f, expected %f", msg, ssc, fsc);
+      if (esl_hmm_sparse_Posterior(dsq, L, sh, ck, &psc, spath, spp) != eslOK)   esl_fatal(msg);
+      if (psc != ssc)                                                             esl_fatal(msg);
+      for (i = 1; i <= L; i++)
+	{
+	  if (spath[i] < 0 || spath[i] >= M)                                      esl_fatal(msg);
+	  if (esl_FCompareNew(pp->dp[i][spath[i]], spp[i], 1e-3, 1e-4) != eslOK)    esl_fatal(msg);
+	  if (esl_vec_FMax(pp->dp[i], M) > spp[i] + 1e-3)                         esl_fatal(msg);
+	}
+
+      vref = hmm_utest_viterbi(dsq, L, hmm);
+      if (esl_hmm_sparse_Viterbi(dsq, L, sh, ck, &vsc, spath) != eslOK)         esl_fatal(msg);
+      if (esl_DCompareNew(vref, vsc, 1e-4, 1e-3) != eslOK)                        esl_fatal("%s: viterbi %f, expected %f", msg, vsc, vref);
+      if (L > 0 && esl_DCompareNew(vref, hmm_utest_pathscore(dsq, L, hmm, spath), 1e-4, 1e-3) != eslOK) esl_fatal(msg);
+
+      esl_hmx_Destroy(pp);
+      esl_hmx_Destroy(bck);
+      esl_hmx_Destroy(fwd);
+      esl_hmm_sparse_Destroy(sh);
+      esl_hmm_Destroy(hmm);
+      free(spp);
+      free(spath);
+      free(path);
+      free(dsq);
+    }
+  esl_hmm_ckpt_Destroy(ck);
+}
+
+/* utest_impossible()
+ * A sequence with zero probability gives -inf scores and eslERANGE.
+ */
+static void
+utest_impossible(ESL_RANDOMNESS *rng, const ESL_ALPHABET *abc)
+{
+  char            msg[] = "hmm impossible sequence unit test failed";
+  ESL_HMM        *hmm   = hmm_utest_sparse_model(rng, abc, 5);
+  ESL_HMM_SPARSE *sh    = NULL;
+  ESL_HMM_CKPT   *ck    = esl_hmm_ckpt_Create(100, 5);
+  ESL_DSQ         dsq[102];
+  int             path[101];
+  float           pp[101];
+  float           sc;
+  int             i, k;
+
+  for (k = 0; k < hmm->M; k++) { hmm->e[k][0] = 0.0f; esl_vec_FNorm(hmm->e[k], abc->K); }
+  esl_hmm_Configure(hmm, NULL);
+  if ((sh = esl_hmm_sparse_Create(hmm)) == NULL) esl_fatal(msg);
+
+  dsq[0] = dsq[101] = eslDSQ_SENTINEL;
+  for (i = 1; i <= 100; i++) dsq[i] = 1 + esl_rnd_Roll(rng, abc->K - 1);
+  dsq[50] = 0;
+
+  if (esl_hmm_sparse_Forward  (dsq, 100, sh, ck, &sc)           != eslOK     || sc != -eslINFINITY) esl_fatal(msg);
+  if (esl_hmm_sparse_Posterior(dsq, 100, sh, ck, &sc, path, pp) != eslERANGE || sc != -eslINFINITY) esl_fatal(msg);
+  if (esl_hmm_sparse_Viterbi  (dsq, 100, sh, ck, &sc, path)     != eslERANGE || sc != -eslINFINITY) esl_fatal(msg);
+
+  esl_hmm_ckpt_Destroy(ck);
+  esl_hmm_sparse_Destroy(sh);
+  esl_hmm_Destroy(hmm);
+}
+#endif /*eslHMM_TESTDRIVE*/
+
+
   
 /*****************************************************************
  * x. Test driver.
@@ -581,6 +1469,9 @@ main(int argc, char **argv)
   esl_hmm_Backward(dsq, L, hmm, bck, &bsc);
   esl_hmm_PosteriorDecoding(dsq, L, hmm, fwd, bck, pp);
 
+  utest_sparse(r, abc, 50);
+  utest_impossible(r, abc);
+
   fsum = 0.0;
   bsum = bsc;
 
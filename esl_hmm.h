@@ -34,6 +34,52 @@ typedef struct {
   uint64_t  ncells;		/* total allocation of dp_mem; ncells >= (validR)(allocM)*/
 } ESL_HMX;
 
+/* ESL_HMM_SPARSE
+ * An ESL_HMM's parameters rearranged for fast DP. The transitions out
+ * of each state are stored as "runs" of consecutive target states
+ * (short gaps of zero probability are folded into a run), so that the
+ * inner loops of the DP are contiguous and vectorizable, and zero
+ * transitions mostly cost nothing.
+ */
+typedef struct {
+  int     M;			/* number of states                                          */
+  int     Kp;			/* size of digital alphabet, including degeneracies          */
+  int     nruns;		/* total number of transition runs                            */
+  int    *rbeg;			/* [0..M]: runs out of state m are rbeg[m]..rbeg[m+1]-1      */
+  int    *rk;			/* [0..nruns-1]: first target state of each run               */
+  int    *rlen;			/* [0..nruns-1]: number of target states in each run          */
+  int    *roff;			/* [0..nruns-1]: offset of the run's values in <rt>, <rlt>    */
+  float  *rt;			/* transition probabilities of all runs, concatenated         */
+  float  *rlt;			/* ... and their logs                                          */
+  float  *pi;			/* [0..M]: initial distribution; pi[M] is an L=0 sequence     */
+  float  *lpi;			/* [0..M]: log pi                                               */
+  float  *tend;			/* [0..M-1]: t[m][M], transition to the end                    */
+  float  *ltend;		/* [0..M-1]: log tend                                           */
+  float **eo;			/* [0..Kp-1][0..M-1]: emission odds ratios                     */
+  float **leo;			/* [0..Kp-1][0..M-1]: log eo                                    */
+} ESL_HMM_SPARSE;
+
+/* ESL_HMM_CKPT
+ * Checkpointed DP workspace for ESL_HMM_SPARSE. A sequence of length L
+ * is cut into <nseg> segments of <B> ~ sqrt(L) rows. The first pass
+ * saves only the last row of each segment; the second pass recomputes
+ * one segment at a time from the checkpoint before it. Memory is
+ * O(M sqrt(L)) instead of O(ML).
+ */
+typedef struct {
+  int      M;			/* row width of the current layout                 */
+  int      L;			/* sequence length of the current layout           */
+  int      B;			/* rows per segment                                 */
+  int      nseg;		/* number of segments                               */
+  float   *ckp;			/* [0..nseg-1][0..M-1] checkpoint rows; ckp[s] is row s*B (s > 0) */
+  float   *seg;			/* [0..B-1][0..M-1] the rows of one segment         */
+  int     *bp;			/* [0..B-1][0..M-1] Viterbi backpointers, same rows */
+  float   *row[2];		/* [0..M-1] two more rows                           */
+  int64_t  ckpalloc;		/* current allocation of <ckp>, in floats           */
+  int64_t  segalloc;		/* current allocation of <seg>, <bp>, in elements   */
+  int      rowalloc;		/* current allocation of each <row>                 */
+} ESL_HMM_CKPT;
+
 
 
 extern ESL_HMM *esl_hmm_Create(const ESL_ALPHABET *abc, int M);
@@ -49,6 +95,16 @@ extern void     esl_hmx_Destroy(ESL_HMX *mx);
 extern int      esl_hmm_Emit(ESL_RANDOMNESS *r, const ESL_HMM *hmm, ESL_DSQ **opt_dsq, int **opt_path, int *opt_L);
 extern int      esl_hmm_Forward(const ESL_DSQ *dsq, int L, const ESL_HMM *hmm, ESL_HMX *fwd, float *opt_sc);
 extern int      esl_hmm_Backward(const ESL_DSQ *dsq, int L, const ESL_HMM *hmm, ESL_HMX *bck, float *opt_sc);
+extern int      esl_hmm_PosteriorDecoding(const ESL_DSQ *dsq, int L, const ESL_HMM *hmm, ESL_HMX *fwd, ESL_HMX *bck, ESL_HMX *pp);
+
+extern ESL_HMM_SPARSE *esl_hmm_sparse_Create(const ESL_HMM *hmm);
+extern void            esl_hmm_sparse_Destroy(ESL_HMM_SPARSE *sh);
+extern ESL_HMM_CKPT   *esl_hmm_ckpt_Create(int L, int M);
+extern int             esl_hmm_ckpt_GrowTo(ESL_HMM_CKPT *ck, int L, int M);
+extern void            esl_hmm_ckpt_Destroy(ESL_HMM_CKPT *ck);
+extern int             esl_hmm_sparse_Forward  (const ESL_DSQ *dsq, int L, const ESL_HMM_SPARSE *sh, ESL_HMM_CKPT *ck, float *opt_sc);
+extern int             esl_hmm_sparse_Posterior(const ESL_DSQ *dsq, int L, const ESL_HMM_SPARSE *sh, ESL_HMM_CKPT *ck, float *opt_sc, int *opt_path, float *opt_pp);
+extern int             esl_hmm_sparse_Viterbi  (const ESL_DSQ *dsq, int L, const ESL_HMM_SPARSE *sh, ESL_HMM_CKPT *ck, float *opt_sc, int *opt_path);
 
 
 #endif /*eslHMM_INCLUDED*/
@@ -5,9 +5,11 @@
  *    2. Digital mode MSA's        
  *    3. Setting, checking data fields in an <ESL_MSA>
  *    4. Miscellaneous functions for manipulating MSAs
- *    5. Debugging, testing, development
- *    6. Unit tests
- *    7. Test driver
+ *    5. Column-major views of digital MSAs
+ *    6. Debugging, testing, development
+ *    7. Unit tests
+ *    8. Test driver
+ *    9. Benchmark
  */
 #include "esl_config.h"
 
@@ -3122,7 +3124,175 @@ esl_msa_FlushLeftInserts(ESL_MSA *msa)
 
 
 /*****************************************************************
- * 5. Debugging, testing, development
+ * 5. Column-major views of digital MSAs
+ *****************************************************************/
+
+/* Function:  esl_msa_cols_Create()
+ * Synopsis:  Make a column-major copy of a digital MSA.
+ *
+ * Purpose:   Transpose the residues of digital alignment <msa> into a
+ *            new <ESL_MSA_COLS> view, <*ret_cm>, in which column
+ *            <apos> (1..alen) is a contiguous array of <nseq> residue
+ *            codes, <cm->cx[apos][0..nseq-1]>.
+ *
+ *            <ESL_MSA> stores sequences row by row, which is right
+ *            for most things, but a kernel that needs whole columns
+ *            (counting residues, gap fractions, PB weight increments)
+ *            then strides across <nseq> separate rows for every
+ *            column, touching a new cache line for each residue on
+ *            deep alignments. The transpose is done once, in 8x8
+ *            byte blocks swapped within 64-bit words, working down
+ *            64 sequences at a time so that each column's writes fill
+ *            whole cache lines; it costs about as much as one
+ *            row-major pass over the alignment, so it pays off as
+ *            soon as the columns are used more than once, or whenever
+ *            the rows don't fit in cache.
+ *
+ *            The view takes as much memory as the <msa> residues
+ *            themselves. It is a snapshot: later changes to <msa>
+ *            aren't reflected in it.
+ *
+ * Args:      msa    - digital MSA
+ *            ret_cm - RETURN: new column-major view
+ *
+ * Returns:   <eslOK> on success. Caller frees <*ret_cm> with
+ *            <esl_msa_cols_Destroy()>.
+ *
+ * Throws:    <eslEINVAL> if <msa> isn't digital.
+ *            <eslEMEM> on allocation failure.
+ *            On error, <*ret_cm> is <NULL>.
+ */
+int
+esl_msa_cols_Create(const ESL_MSA *msa, ESL_MSA_COLS **ret_cm)
+{
+  ESL_MSA_COLS *cm  = NULL;
+  int64_t       ldc;                   // column stride: nseq, padded
+  int64_t       apos, j;
+  int           i0, i1, idx, k;
+  uint64_t      x[8], t;
+  int           status;
+
+  if (! (msa->flags & eslMSA_DIGITAL)) ESL_XEXCEPTION(eslEINVAL, "column-major view requires a digital MSA");
+
+  ESL_ALLOC(cm, sizeof(ESL_MSA_COLS));
+  cm->cx   = NULL;
+  cm->mem  = NULL;
+  cm->alen = msa->alen;
+  cm->nseq = msa->nseq;
+  cm->abc  = msa->abc;
+
+  ldc = ((int64_t) msa->nseq + eslMSA_COLS_ALIGN - 1) / eslMSA_COLS_ALIGN * eslMSA_COLS_ALIGN;
+  ESL_ALLOC(cm->cx,  sizeof(ESL_DSQ *) * (msa->alen+1));
+  ESL_ALLOC(cm->mem, sizeof(ESL_DSQ)   * ESL_MAX(1, ldc * msa->alen));
+  cm->cx[0] = NULL;
+  for (apos = 1; apos <= msa->alen; apos++)
+    cm->cx[apos] = cm->mem + (apos-1) * ldc;
+
+  /* Swap the off-diagonal bytes of the 8x8 byte block in x[0..7]
+   * (row k in x[k], column c in byte c, counting from the low end),
+   * in three rounds: 1x1, 2x2, then 4x4 sub-blocks. Big-endian
+   * machines load bytes from the high end, so they take the rows in
+   * reverse order, which makes the same swaps a transpose.
+   */
+#define eslMSA_COLS_SWAP(a, b, s, m) { t = ((x[a] >> s) ^ x[b]) & m; x[b] ^= t; x[a] ^= t << s; }
+#ifdef WORDS_BIGENDIAN
+#define eslMSA_COLS_W(k) (7-(k))
+#else
+#define eslMSA_COLS_W(k) (k)
+#endif
+
+  for (i0 = 0; i0 < msa->nseq; i0 += 64)
+    {
+      i1 = ESL_MIN(msa->nseq, i0 + 64);
+      for (j = 0; j + 8 <= msa->alen; j += 8)
+	{
+	  for (idx = i0; idx + 8 <= i1; idx += 8)
+	    {
+	      for (k = 0; k < 8; k++) memcpy(&(x[eslMSA_COLS_W(k)]), msa->ax[idx+k] + 1 + j, 8);
+	      eslMSA_COLS_SWAP(0, 1,  8, 0x00FF00FF00FF00FFULL); eslMSA_COLS_SWAP(2, 3,  8, 0x00FF00FF00FF00FFULL);
+	      eslMSA_COLS_SWAP(4, 5,  8, 0x00FF00FF00FF00FFULL); eslMSA_COLS_SWAP(6, 7,  8, 0x00FF00FF00FF00FFULL);
+	      eslMSA_COLS_SWAP(0, 2, 16, 0x0000FFFF0000FFFFULL); eslMSA_COLS_SWAP(1, 3, 16, 0x0000FFFF0000FFFFULL);
+	      eslMSA_COLS_SWAP(4, 6, 16, 0x0000FFFF0000FFFFULL); eslMSA_COLS_SWAP(5, 7, 16, 0x0000FFFF0000FFFFULL);
+	      eslMSA_COLS_SWAP(0, 4, 32, 0x00000000FFFFFFFFULL); eslMSA_COLS_SWAP(1, 5, 32, 0x00000000FFFFFFFFULL);
+	      eslMSA_COLS_SWAP(2, 6, 32, 0x00000000FFFFFFFFULL); eslMSA_COLS_SWAP(3, 7, 32, 0x00000000FFFFFFFFULL);
+	      for (k = 0; k < 8; k++) memcpy(cm->cx[j+1+k] + idx, &(x[eslMSA_COLS_W(k)]), 8);
+	    }
+	  for (; idx < i1; idx++)                       // leftover seqs, < 8
+	    for (k = 0; k < 8; k++) cm->cx[j+1+k][idx] = msa->ax[idx][j+1+k];
+	}
+      for (idx = i0; idx < i1; idx++)                   // leftover columns, < 8
+	for (apos = j+1; apos <= msa->alen; apos++) cm->cx[apos][idx] = msa->ax[idx][apos];
+    }
+#undef eslMSA_COLS_SWAP
+#undef eslMSA_COLS_W
+
+  *ret_cm = cm;
+  return eslOK;
+
+ ERROR:
+  esl_msa_cols_Destroy(cm);
+  *ret_cm = NULL;
+  return status;
+}
+
+
+/* Function:  esl_msa_cols_Count()
+ * Synopsis:  Count the symbols in one column.
+ *
+ * Purpose:   Count the occurrences of each digital symbol in column
+ *            <apos> (1..alen) of column-major view <cm>, and return
+ *            them in <ct[0..Kp-1]>, which the caller provides. Gap
+ *            fractions and the like follow directly: for instance
+ *            <ct[K]> gaps out of <esl_vec_ISum(ct, Kp-2)> residues
+ *            and gaps.
+ *
+ *            The column is run through four interleaved histograms,
+ *            summed at the end, so successive increments don't wait
+ *            on each other when the same symbol recurs.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_msa_cols_Count(const ESL_MSA_COLS *cm, int64_t apos, int *ct)
+{
+  const ESL_DSQ *c  = cm->cx[apos];
+  int            Kp = cm->abc->Kp;
+  int            h[4][256];
+  int            idx, a;
+
+  for (a = 0; a < Kp; a++) h[0][a] = h[1][a] = h[2][a] = h[3][a] = 0;
+  for (idx = 0; idx + 4 <= cm->nseq; idx += 4)
+    {
+      h[0][c[idx]]++;
+      h[1][c[idx+1]]++;
+      h[2][c[idx+2]]++;
+      h[3][c[idx+3]]++;
+    }
+  for (; idx < cm->nseq; idx++) h[0][c[idx]]++;
+  for (a = 0; a < Kp; a++) ct[a] = h[0][a] + h[1][a] + h[2][a] + h[3][a];
+  return eslOK;
+}
+
+
+/* Function:  esl_msa_cols_Destroy()
+ * Synopsis:  Free a column-major view.
+ */
+void
+esl_msa_cols_Destroy(ESL_MSA_COLS *cm)
+{
+  if (cm)
+    {
+      free(cm->cx);
+      free(cm->mem);
+      free(cm);
+    }
+}
+/*------------- end, column-major views of digital MSAs ---------*/
+
+
+
+/*****************************************************************
+ * 6. Debugging, testing, development
  *****************************************************************/
 
 /* Function:  esl_msa_Validate()
@@ -3387,7 +3557,7 @@ esl_msa_Sample(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int max_nseq, int max_ale
 
 
 /******************************************************************************
- * 15. Unit tests
+ * 7. Unit tests
  *****************************************************************************/
 #ifdef eslMSA_TESTDRIVE
 #include "esl_msafile.h"
@@ -3872,12 +4042,60 @@ utest_Sample(ESL_RANDOMNESS *rng)
 }
 
 
+/* utest_cols()
+ * Column-major views of random MSAs of assorted shapes (depths that
+ * cross the 8- and 64-seq transpose blocks or fall short of them,
+ * lengths that aren't multiples of 8) must match the rows exactly,
+ * and column counts must match a naive tally.
+ */
+static void
+utest_cols(ESL_RANDOMNESS *rng)
+{
+  char          msg[] = "esl_msa cols unit test failed";
+  ESL_ALPHABET *abc   = esl_alphabet_Create(eslAMINO);
+  ESL_MSA      *msa   = NULL;
+  ESL_MSA_COLS *cm    = NULL;
+  int          *ct    = malloc(sizeof(int) * abc->Kp);
+  int          *ct0   = malloc(sizeof(int) * abc->Kp);
+  int           ntrials = 20;
+  int64_t       apos;
+  int           idx, a, n;
+
+  if (ct == NULL || ct0 == NULL) esl_fatal(msg);
+  for (n = 0; n < ntrials; n++)
+    {
+      if (esl_msa_Sample(rng, abc, 200, 40, &msa) != eslOK) esl_fatal(msg);
+      if (esl_msa_cols_Create(msa, &cm)           != eslOK) esl_fatal(msg);
+      if (cm->nseq != msa->nseq || cm->alen != msa->alen)   esl_fatal(msg);
+
+      for (apos = 1; apos <= msa->alen; apos++)
+	{
+	  for (a = 0; a < abc->Kp; a++) ct0[a] = 0;
+	  for (idx = 0; idx < msa->nseq; idx++)
+	    {
+	      if (cm->cx[apos][idx] != msa->ax[idx][apos]) esl_fatal(msg);
+	      ct0[msa->ax[idx][apos]]++;
+	    }
+	  if (esl_msa_cols_Count(cm, apos, ct) != eslOK) esl_fatal(msg);
+	  for (a = 0; a < abc->Kp; a++)
+	    if (ct[a] != ct0[a]) esl_fatal(msg);
+	}
+      esl_msa_cols_Destroy(cm);
+      esl_msa_Destroy(msa);
+    }
+
+  free(ct);
+  free(ct0);
+  esl_alphabet_Destroy(abc);
+}
+
+
 #endif /*eslMSA_TESTDRIVE*/
 /*------------------------ end of unit tests --------------------------------*/
 
 
 /*****************************************************************************
- * 7. Test driver
+ * 8. Test driver
  *****************************************************************************/
 #ifdef eslMSA_TESTDRIVE
 #include <stdlib.h>
@@ -3944,6 +4162,7 @@ main(int argc, char **argv)
   utest_SymConvert(tmpfile);
   utest_ZeroLengthMSA(tmpfile);	
   utest_Sample(rng);
+  utest_cols(rng);
 
   esl_msa_Destroy(msa);
 
@@ -3968,3 +4187,95 @@ main(int argc, char **argv)
 #endif /*eslMSA_TESTDRIVE*/
 /*-------------------- end of test driver ---------------------*/
 
+
+
+/*****************************************************************************
+ * 9. Benchmark
+ *****************************************************************************/
+#ifdef eslMSA_BENCHMARK
+/* gcc -O3 -o benchmark -I. -L. -DeslMSA_BENCHMARK esl_msa.c -leasel -lm
+ * ./benchmark                  (random 20000 x 400 protein alignment)
+ * ./benchmark -N 100000 -L 1000
+ *
+ * Times residue counting over every column of a digital MSA, row by
+ * row in place versus through a column-major view, including the cost
+ * of making the view.
+ */
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_msa.h"
+#include "esl_random.h"
+#include "esl_stopwatch.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                             docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",              0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",    0},
+  {"-L",  eslARG_INT,     "400", NULL,"n>0", NULL, NULL, NULL, "alignment length",                 0},
+  {"-N",  eslARG_INT,   "20000", NULL,"n>0", NULL, NULL, NULL, "number of sequences",              0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for column-major MSA views";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng  = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = esl_alphabet_Create(eslAMINO);
+  ESL_STOPWATCH  *w    = esl_stopwatch_Create();
+  int             N    = esl_opt_GetInteger(go, "-N");
+  int64_t         L    = esl_opt_GetInteger(go, "-L");
+  ESL_MSA        *msa  = esl_msa_CreateDigital(abc, N, L);
+  ESL_MSA_COLS   *cm   = NULL;
+  int           **ct   = malloc(sizeof(int *) * (L+1));
+  int64_t         apos;
+  int             idx, a;
+  int64_t         chk1 = 0, chk2 = 0;
+
+  /* random residues, about one gap in five */
+  for (idx = 0; idx < N; idx++)
+    {
+      msa->ax[idx][0] = msa->ax[idx][L+1] = eslDSQ_SENTINEL;
+      for (apos = 1; apos <= L; apos++)
+	msa->ax[idx][apos] = (esl_random(rng) < 0.2 ? abc->K : esl_rnd_Roll(rng, abc->K));
+    }
+  for (apos = 0; apos <= L; apos++) ct[apos] = malloc(sizeof(int) * abc->Kp);
+
+  esl_stopwatch_Start(w);
+  for (apos = 1; apos <= L; apos++) for (a = 0; a < abc->Kp; a++) ct[apos][a] = 0;
+  for (idx = 0; idx < N; idx++)
+    for (apos = 1; apos <= L; apos++) ct[apos][msa->ax[idx][apos]]++;
+  esl_stopwatch_Stop(w);
+  for (apos = 1; apos <= L; apos++) chk1 += ct[apos][abc->K];
+  esl_stopwatch_Display(stdout, w, "# row-major counts:    ");
+
+  esl_stopwatch_Start(w);
+  esl_msa_cols_Create(msa, &cm);
+  esl_stopwatch_Stop(w);
+  esl_stopwatch_Display(stdout, w, "# transpose:           ");
+
+  esl_stopwatch_Start(w);
+  for (apos = 1; apos <= L; apos++) esl_msa_cols_Count(cm, apos, ct[apos]);
+  esl_stopwatch_Stop(w);
+  for (apos = 1; apos <= L; apos++) chk2 += ct[apos][abc->K];
+  esl_stopwatch_Display(stdout, w, "# column-major counts: ");
+
+  if (chk1 != chk2) esl_fatal("benchmark: gap counts disagree");
+
+  for (apos = 0; apos <= L; apos++) free(ct[apos]);
+  free(ct);
+  esl_msa_cols_Destroy(cm);
+  esl_msa_Destroy(msa);
+  esl_stopwatch_Destroy(w);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslMSA_BENCHMARK*/
+/*-------------------- end of benchmark ---------------------*/
@@ -124,6 +124,24 @@ typedef struct {
 } ESL_MSA;
 
 
+/* Object: ESL_MSA_COLS
+ * 
+ * An optional column-major copy of the residues of a digital MSA, for
+ * kernels that work a column at a time: <cx[apos][idx]> is the same
+ * residue as <msa->ax[idx][apos]>, so each column is one contiguous
+ * run of bytes. Made by <esl_msa_cols_Create()>; it's a snapshot, not
+ * updated if the MSA changes.
+ */
+typedef struct {
+  ESL_DSQ  **cx;                /* columns [(0) 1..alen][0..nseq-1]; cx[0] is NULL          */
+  ESL_DSQ   *mem;               /* storage for all columns, each padded to eslMSA_COLS_ALIGN */
+  int64_t    alen;
+  int        nseq;
+  const ESL_ALPHABET *abc;      /* ptr to alphabet of the MSA this was made from */
+} ESL_MSA_COLS;
+
+#define eslMSA_COLS_ALIGN 64    /* columns start on multiples of this many bytes (a cache line) */
+
 
 /* Flags for msa->flags */
 #define eslMSA_HASWGTS (1 << 0)  /* 1 if wgts were set, 0 if default 1.0's */
@@ -192,7 +210,12 @@ extern int esl_msa_ReverseComplement(ESL_MSA *msa);
 extern int esl_msa_Hash(ESL_MSA *msa);
 extern int esl_msa_FlushLeftInserts(ESL_MSA *msa);
 
-/* 5. Debugging, testing, development */
+/* 5. Column-major views of digital MSAs */
+extern int  esl_msa_cols_Create(const ESL_MSA *msa, ESL_MSA_COLS **ret_cm);
+extern int  esl_msa_cols_Count (const ESL_MSA_COLS *cm, int64_t apos, int *ct);
+extern void esl_msa_cols_Destroy(ESL_MSA_COLS *cm);
+
+/* 6. Debugging, testing, development */
 extern int      esl_msa_Validate(const ESL_MSA *msa, char *errmsg);
 extern ESL_MSA *esl_msa_CreateFromString(const char *s, int fmt);
 extern int      esl_msa_Compare         (ESL_MSA *a1, ESL_MSA *a2);
@@ -3,10 +3,11 @@
  * Table of contents:
  *    1. Single linkage clustering an MSA by %id
  *    2. Internal functions, interface to the clustering API
- *    3. Some internal functions needed for regression tests
- *    4. Unit tests
- *    5. Test driver
- *    6. Example
+ *    3. Internal functions, union-find engine for digital MSAs
+ *    4. Some internal functions needed for regression tests
+ *    5. Unit tests
+ *    6. Test driver
+ *    7. Example
  *  
  * (Wondering why isn't this just part of the cluster or MSA modules?
  * esl_cluster itself is a core module, dependent only on easel. MSA
@@ -16,11 +17,16 @@
  */
 #include "esl_config.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_cluster.h"
 #include "esl_distance.h"
 #include "esl_msa.h"
+#include "esl_vectorops.h"
 
 #include "esl_msacluster.h"
 
@@ -37,15 +43,44 @@ static double squid_xdistance(ESL_ALPHABET *a, ESL_DSQ *x1, ESL_DSQ *x2);
  *  digital aseq's: 
  */
 static int msacluster_clinkage(const void *v1, const void *v2, const void *p, int *ret_link);
+#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
 static int msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link);
 
 /* In digital mode, we'll need to pass the clustering routine two parameters -
  * %id threshold and alphabet ptr - so make a structure that bundles them.
+ * (Only when regression testing against squid; otherwise digital MSAs
+ * use the engine below.)
  */
 struct msa_param_s {
   double        maxid;
   ESL_ALPHABET *abc;
 };
+#endif
+
+/* Digital MSAs are clustered by a faster engine of our own: connected
+ * components of the linkage graph in a union-find forest, skipping
+ * pairs already known to be in the same component, with identities
+ * from the packed bit planes of <esl_dst_bits_Create()>. The pairwise
+ * scan goes in rounds of rows; within a round, each job scans its
+ * rows against all earlier seqs with the forest held fixed, and
+ * records the links it finds, which the caller then merges.
+ */
+typedef struct {
+  const ESL_DST_BITS *db;      // packed alignment
+  const int          *need;    // need[n]: pair with identity denominator n is linked if it has >= need[n] identities
+  const int          *parent;  // union-find forest; read-only while jobs run
+  int                 i0, i1;  // this job's rows i0..i1-1
+  int                *stamp;   // stamp[root] == i+1 if row i is already linked to component <root> in this round; [0..N-1]
+  int                *rootj;   // workspace: components of a block of <eslDST_BITS_TILE> earlier seqs
+  int                *edge;    // links found: pairs <edge[2e], edge[2e+1]> for e = 0..nedge-1
+  int                 nedge;
+  int                 ealloc;  // allocated number of pairs in <edge>
+  int                 status;  // eslOK, or eslEMEM if <edge> couldn't grow
+} MSACLUSTER_JOB;
+
+static int   msacluster_bits(const ESL_MSA *msa, double maxid, int nthreads, int *assignment, int *ret_nc);
+static int   msacluster_find(int *parent, int v);
+static void *msacluster_job (void *arg);
 
 
 /*****************************************************************
@@ -100,6 +135,9 @@ struct msa_param_s {
  *            <opt_nc> if it is only interested in one of the two
  *            results.
  *
+ *            For a digital <msa>, cluster indices are normalized;
+ *            see <esl_msacluster_SingleLinkage_adv()>.
+ *
  * Throws:    <eslEMEM> on allocation failure, and <eslEINVAL> if a pairwise
  *            comparison is invalid (which means the MSA is corrupted, so it
  *            shouldn't happen). In either case, <opt_c> and <opt_nin> are set to <NULL>
@@ -108,7 +146,58 @@ struct msa_param_s {
 int
 esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid, 
 			     int **opt_c, int **opt_nin, int *opt_nc)
+{
+  return esl_msacluster_SingleLinkage_adv(msa, maxid, 0, opt_c, opt_nin, opt_nc);
+}
+
 
+/* Function:  esl_msacluster_SingleLinkage_adv()
+ * Synopsis:  Single linkage clustering by percent identity, threaded.
+ *
+ * Purpose:   Same as <esl_msacluster_SingleLinkage()>, using up to
+ *            <nthreads> threads for the pairwise comparisons of a
+ *            digital <msa>. With <nthreads> 0 or 1 (or without POSIX
+ *            threads) all the work is done in the caller. The
+ *            clustering doesn't depend on <nthreads>.
+ *
+ *            For a digital <msa>, clusters are found as connected
+ *            components in a union-find forest. A pair of sequences
+ *            already known to be in the same component isn't
+ *            compared at all, and the rest are compared with the
+ *            bit-parallel identity kernel of <esl_dst_bits_Create()>.
+ *            Time is still worst case $O(LN^2)$, when nothing links,
+ *            but with a small constant; with large clusters, most
+ *            pairs are skipped. Memory is $O(LN)$ bits for the packed
+ *            alignment.
+ *
+ * Args:      msa      - multiple alignment to cluster
+ *            maxid    - pairwise identity threshold: cluster if $\geq$ <maxid>
+ *            nthreads - number of threads to use; 0 = none
+ *            opt_c    - optRETURN: cluster assignments for each sequence, [0..nseq-1]
+ *            opt_nin  - optRETURN: number of seqs in each cluster, [0..nc-1] 
+ *            opt_nc   - optRETURN: number of clusters        
+ *
+ * Returns:   <eslOK> on success, with results as for
+ *            <esl_msacluster_SingleLinkage()>.
+ *
+ *            For a digital <msa>, clusters are numbered in order of
+ *            their lowest-numbered sequence: sequence 0 is in cluster
+ *            0, the first sequence not linked to it starts cluster 1,
+ *            and so on. This is a change from earlier versions,
+ *            which numbered them in the order the generic
+ *            <esl_cluster_SingleLinkage()> happened to find them;
+ *            the clusters themselves (and <opt_nin>, <opt_nc>) are
+ *            the same, only their indices may differ. For a text
+ *            mode <msa>, numbering is unchanged.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <eslEINVAL> if a pairwise
+ *            comparison is invalid (the MSA is corrupted). In either case,
+ *            <opt_c> and <opt_nin> are set to <NULL> and <opt_nc> is set
+ *            to 0, and the <msa> is unmodified.
+ */
+int
+esl_msacluster_SingleLinkage_adv(const ESL_MSA *msa, double maxid, int nthreads,
+				 int **opt_c, int **opt_nin, int *opt_nc)
 {
   int   status;
   int  *workspace  = NULL;
@@ -116,27 +205,32 @@ esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid,
   int  *nin        = NULL;
   int   nc;
   int   i;
+#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
   struct msa_param_s param;
+#endif
 
   /* Allocations */
   ESL_ALLOC(workspace,  sizeof(int) * msa->nseq * 2);
   ESL_ALLOC(assignment, sizeof(int) * msa->nseq);
 
-  /* call to SLC API: */
+  /* call to SLC API, or our own engine for digital MSAs: */
   if (! (msa->flags & eslMSA_DIGITAL))
     status = esl_cluster_SingleLinkage((void *) msa->aseq, (size_t) msa->nseq, sizeof(char *),
 				       msacluster_clinkage, (void *) &maxid, 
 				       workspace, assignment, &nc);
   else {
+#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
     param.maxid = maxid;
     param.abc   = msa->abc;
     status = esl_cluster_SingleLinkage((void *) msa->ax, (size_t) msa->nseq, sizeof(ESL_DSQ *),
 				       msacluster_xlinkage, (void *) &param, 
 				       workspace, assignment, &nc);
+#else
+    status = msacluster_bits(msa, maxid, nthreads, assignment, &nc);
+#endif
   }
   if (status != eslOK) goto ERROR;
 
-
   if (opt_nin != NULL) 
     {
       ESL_ALLOC(nin, sizeof(int) * nc);
@@ -189,7 +283,8 @@ msacluster_clinkage(const void *v1, const void *v2, const void *p, int *ret_link
   return status;
 }
   
-/* Definition of % id linkage in digital aligned seqs (>= maxid) */
+#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
+/* Definition of % id linkage in digital aligned seqs (>= maxid), squid's way */
 static int
 msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link)
 {
@@ -199,19 +294,222 @@ msacluster_xlinkage(const void *v1, const void *v2, const void *p, int *ret_link
   double   pid;
   int      status = eslOK;
 
-#if defined(eslMSACLUSTER_REGRESSION) || defined(eslMSAWEIGHT_REGRESSION)
   pid = 1. - squid_xdistance(param->abc, ax1, ax2);
-#else  
-  if ( (status = esl_dst_XPairId(param->abc, ax1, ax2, &pid, NULL, NULL)) != eslOK) return status;
-#endif
 
   *ret_link = (pid >= param->maxid ? TRUE : FALSE); 
   return status;
 }
+#endif
+
+
+/*****************************************************************
+ * 3. Internal functions, union-find engine for digital MSAs
+ *****************************************************************/
+
+/* msacluster_bits()
+ * Single linkage clustering of digital <msa> at <maxid>: put cluster
+ * indices 0..nc-1 in <assignment[0..nseq-1]>, numbered in order of
+ * each cluster's lowest-numbered seq, and the number of clusters in
+ * <*ret_nc>.
+ *
+ * Rows are scanned in rounds of <eslMSACLUSTER_BATCH> rows per job.
+ * Links found in a round are merged into the forest before the next
+ * round starts, so later rows skip pairs in the same component.
+ * Which pairs get skipped depends on the number of jobs, but the
+ * components (and our numbering of them) don't.
+ */
+static int
+msacluster_bits(const ESL_MSA *msa, double maxid, int nthreads, int *assignment, int *ret_nc)
+{
+  int             N      = msa->nseq;
+  ESL_DST_BITS   *db     = NULL;
+  int            *need   = NULL;
+  int            *parent = NULL;   // union-find forest: parent[v], roots have parent[v] == v
+  int            *size   = NULL;   // size[root]: # of seqs in its component, for union by size
+  MSACLUSTER_JOB *job    = NULL;
+#ifdef HAVE_PTHREAD
+  pthread_t      *tid    = NULL;
+  int            *alive  = NULL;
+#endif
+  int             njobs  = ESL_MAX(1, nthreads);
+  int             nc     = 0;
+  int             r0, t, e, u, v;
+  int             status;
+
+  if ((status = esl_dst_bits_Create(msa->abc, msa->ax, N, &db)) != eslOK) goto ERROR;
+  if ((status = esl_dst_bits_MinIdents(db, maxid, &need))       != eslOK) goto ERROR;
+
+  ESL_ALLOC(parent, sizeof(int)            * N);
+  ESL_ALLOC(size,   sizeof(int)            * N);
+  ESL_ALLOC(job,    sizeof(MSACLUSTER_JOB) * njobs);
+  for (v = 0; v < N; v++) { parent[v] = v; size[v] = 1; }
+  for (t = 0; t < njobs; t++) { job[t].stamp = NULL; job[t].rootj = NULL; job[t].edge = NULL; }
+  for (t = 0; t < njobs; t++)
+    {
+      job[t].db     = db;
+      job[t].need   = need;
+      job[t].parent = parent;
+      job[t].ealloc = 256;
+      ESL_ALLOC(job[t].stamp, sizeof(int) * N);
+      ESL_ALLOC(job[t].rootj, sizeof(int) * eslDST_BITS_TILE);
+      ESL_ALLOC(job[t].edge,  sizeof(int) * 2 * job[t].ealloc);
+      esl_vec_ISet(job[t].stamp, N, 0);
+    }
+#ifdef HAVE_PTHREAD
+  if (njobs > 1) {
+    ESL_ALLOC(tid,   sizeof(pthread_t) * njobs);
+    ESL_ALLOC(alive, sizeof(int)       * njobs);
+  }
+#endif
+
+  for (r0 = 0; r0 < N; r0 += njobs * eslMSACLUSTER_BATCH)
+    {
+      for (t = 0; t < njobs; t++)
+	{
+	  job[t].i0     = ESL_MIN(N, r0 + t * eslMSACLUSTER_BATCH);
+	  job[t].i1     = ESL_MIN(N, job[t].i0 + eslMSACLUSTER_BATCH);
+	  job[t].nedge  = 0;
+	  job[t].status = eslOK;
+	}
+
+#ifdef HAVE_PTHREAD
+      if (njobs > 1)
+	{
+	  for (t = 1; t < njobs; t++)  // a thread that can't be started does its share in the caller, below
+	    alive[t] = (pthread_create(&(tid[t]), NULL, msacluster_job, &(job[t])) == 0);
+	  msacluster_job(&(job[0]));
+	  for (t = 1; t < njobs; t++)
+	    {
+	      if (alive[t]) pthread_join(tid[t], NULL);
+	      else          msacluster_job(&(job[t]));
+	    }
+	}
+      else
+#endif
+	{
+	  msacluster_job(&(job[0]));
+	}
+
+      for (t = 0; t < njobs; t++)
+	{
+	  if (job[t].status != eslOK) { status = job[t].status; goto ERROR; }
+	  for (e = 0; e < job[t].nedge; e++)
+	    {
+	      u = msacluster_find(parent, job[t].edge[2*e]);
+	      v = msacluster_find(parent, job[t].edge[2*e+1]);
+	      if (u == v) continue;
+	      if (size[u] < size[v]) ESL_SWAP(u, v, int);
+	      parent[v] = u;
+	      size[u]  += size[v];
+	    }
+	}
+    }
+
+  /* Number the components in order of their lowest-numbered seq; <size> is free to reuse as the map */
+  esl_vec_ISet(size, N, -1);
+  for (v = 0; v < N; v++)
+    {
+      u = msacluster_find(parent, v);
+      if (size[u] == -1) size[u] = nc++;
+      assignment[v] = size[u];
+    }
+  status = eslOK;
+
+ ERROR:
+#ifdef HAVE_PTHREAD
+  free(tid);
+  free(alive);
+#endif
+  if (job) {
+    for (t = 0; t < njobs; t++) { free(job[t].stamp); free(job[t].rootj); free(job[t].edge); }
+    free(job);
+  }
+  free(size);
+  free(parent);
+  free(need);
+  esl_dst_bits_Destroy(db);
+  *ret_nc = (status == eslOK ? nc : 0);
+  return status;
+}
+
+
+/* msacluster_find()
+ * Return the root of <v>'s tree in union-find forest <parent>,
+ * halving the path to it as we go.
+ */
+static int
+msacluster_find(int *parent, int v)
+{
+  while (parent[v] != v)
+    {
+      parent[v] = parent[parent[v]];
+      v         = parent[v];
+    }
+  return v;
+}
+
+
+/* msacluster_job()
+ * Scan one job's rows <i0..i1-1> against all lower-numbered seqs,
+ * recording each link found in <job->edge>. Pairs whose components
+ * (as of the start of the round) are the same aren't compared, nor
+ * are pairs whose component row <i> has already been linked to in
+ * this block. Earlier seqs are taken in blocks of <eslDST_BITS_TILE>,
+ * each scanned by all the job's rows before going on, so their
+ * packed planes stay in cache. The forest is only read here, without
+ * path halving, since other jobs are reading it at the same time.
+ * Runs in its own thread, or in the caller.
+ */
+static void *
+msacluster_job(void *arg)
+{
+  MSACLUSTER_JOB     *job    = (MSACLUSTER_JOB *) arg;
+  const ESL_DST_BITS *db     = job->db;
+  int64_t             stride = (int64_t) db->np * db->nw;
+  int                 i, j, j0, j1, ri, n, v;
+  int                 status;
+
+  for (j0 = 0; j0 < job->i1 - 1; j0 += eslDST_BITS_TILE)
+    {
+      j1 = ESL_MIN(j0 + eslDST_BITS_TILE, job->i1 - 1);
+      for (j = j0; j < j1; j++)
+	{
+	  for (v = j; job->parent[v] != v; v = job->parent[v]) ;
+	  job->rootj[j-j0] = v;
+	}
+
+      for (i = ESL_MAX(job->i0, j0+1); i < job->i1; i++)
+	{
+	  for (ri = i; job->parent[ri] != ri; ri = job->parent[ri]) ;
+	  for (j = j0; j < j1 && j < i; j++)
+	    {
+	      if (job->rootj[j-j0] == ri || job->stamp[job->rootj[j-j0]] == i+1) continue;
+
+	      n = ESL_MIN(db->ncanon[i], db->ncanon[j]);
+	      if ((*db->idcount)(db->bits + i*stride, db->bits + j*stride, db->np, db->nw) < job->need[n]) continue;
+
+	      if (job->nedge == job->ealloc)
+		{
+		  ESL_REALLOC(job->edge, sizeof(int) * 4 * job->ealloc);
+		  job->ealloc *= 2;
+		}
+	      job->edge[2*job->nedge]   = i;
+	      job->edge[2*job->nedge+1] = j;
+	      job->nedge++;
+	      job->stamp[job->rootj[j-j0]] = i+1;
+	    }
+	}
+    }
+  return NULL;
+
+ ERROR:
+  job->status = status;
+  return NULL;
+}
 
 
 /*****************************************************************
- * 3. Some internal functions needed for regression tests
+ * 4. Some internal functions needed for regression tests
  *****************************************************************/
 
 /* When regression testing against squid, we have to replace
@@ -251,10 +549,12 @@ squid_xdistance(ESL_ALPHABET *a, ESL_DSQ *x1, ESL_DSQ *x2)
 
 
 /*****************************************************************
- * 4. Unit tests
+ * 5. Unit tests
  *****************************************************************/
 #ifdef eslMSACLUSTER_TESTDRIVE
+#include <stdio.h>
 #include "esl_getopts.h"
+#include "esl_random.h"
 
 static void
 utest_SingleLinkage(ESL_GETOPTS *go, const ESL_MSA *msa, double maxid, int expected_nc, int last_assignment)
@@ -270,10 +570,119 @@ utest_SingleLinkage(ESL_GETOPTS *go, const ESL_MSA *msa, double maxid, int expec
   free(assignment);
   free(nin);
 }
+
+/* Reference linkage for utest_bits_engine(): esl_dst_XPairId() >= maxid */
+struct utest_param_s {
+  double              maxid;
+  const ESL_ALPHABET *abc;
+};
+
+static int
+utest_xpairid_linkage(const void *v1, const void *v2, const void *p, int *ret_link)
+{
+  const struct utest_param_s *param = (const struct utest_param_s *) p;
+  double pid;
+  int    status;
+
+  if ((status = esl_dst_XPairId(param->abc, *(ESL_DSQ **) v1, *(ESL_DSQ **) v2, &pid, NULL, NULL)) != eslOK) return status;
+  *ret_link = (pid >= param->maxid ? TRUE : FALSE);
+  return eslOK;
+}
+
+/* utest_bits_engine()
+ * On random digital alignments of families of related seqs, with
+ * fragments, gaps and degenerate residues, the union-find engine must
+ * find the same clusters as esl_cluster_SingleLinkage() with
+ * esl_dst_XPairId() linkage, with any number of threads.
+ */
+static void
+utest_bits_engine(ESL_RANDOMNESS *rng)
+{
+  char          msg[]      = "utest_bits_engine() failed";
+  ESL_ALPHABET *abc        = esl_alphabet_Create(eslAMINO);
+  int           nseq       = 1 + esl_rnd_Roll(rng, 400);
+  int           alen       = 1 + esl_rnd_Roll(rng, 200);
+  int           nfam       = 1 + esl_rnd_Roll(rng, 20);
+  double        maxids[]   = { 0.0, 0.5, 0.62, 0.8, 1.0 };
+  int           nthreads[] = { 0, 1, 3 };
+  ESL_MSA      *msa        = esl_msa_CreateDigital(abc, nseq, alen);
+  ESL_DSQ     **anc        = NULL;
+  int          *workspace  = NULL;
+  int          *expect     = NULL;
+  int          *c          = NULL;
+  int          *nin        = NULL;
+  struct utest_param_s param;
+  char          name[32];
+  double        pmut;
+  int           f, i, k, m, t, apos, lpos, rpos, nc, nc2;
+
+  if ((anc       = malloc(sizeof(ESL_DSQ *) * nfam))     == NULL) esl_fatal(msg);
+  if ((workspace = malloc(sizeof(int)       * nseq * 2)) == NULL) esl_fatal(msg);
+  if ((expect    = malloc(sizeof(int)       * nseq))     == NULL) esl_fatal(msg);
+  for (f = 0; f < nfam; f++)
+    {
+      if ((anc[f] = malloc(sizeof(ESL_DSQ) * (alen+2))) == NULL) esl_fatal(msg);
+      for (apos = 1; apos <= alen; apos++) anc[f][apos] = esl_rnd_Roll(rng, abc->K);
+    }
+
+  for (i = 0; i < nseq; i++)
+    {
+      f    = esl_rnd_Roll(rng, nfam);
+      pmut = 0.6 * esl_random(rng) * esl_random(rng);
+      lpos = 1;
+      rpos = alen;
+      if (esl_rnd_Roll(rng, 4) == 0) { lpos = 1 + esl_rnd_Roll(rng, alen); rpos = lpos + esl_rnd_Roll(rng, alen - lpos + 1); }
+      for (apos = 1; apos <= alen; apos++)
+	{
+	  if      (apos < lpos || apos > rpos) msa->ax[i][apos] = esl_abc_XGetGap(abc);
+	  else if (esl_random(rng) < 0.05)     msa->ax[i][apos] = esl_abc_XGetGap(abc);
+	  else if (esl_random(rng) < 0.01)     msa->ax[i][apos] = esl_abc_XGetUnknown(abc);
+	  else if (esl_random(rng) < pmut)     msa->ax[i][apos] = esl_rnd_Roll(rng, abc->K);
+	  else                                 msa->ax[i][apos] = anc[f][apos];
+	}
+      snprintf(name, 32, "seq%d", i);
+      if (esl_msa_SetSeqName(msa, i, name, -1) != eslOK) esl_fatal(msg);
+    }
+  msa->nseq = nseq;
+
+  param.abc = abc;
+  for (m = 0; m < sizeof(maxids) / sizeof(double); m++)
+    {
+      /* reference: generic clustering, renumbered in order of lowest-numbered seq */
+      param.maxid = maxids[m];
+      if (esl_cluster_SingleLinkage((void *) msa->ax, (size_t) nseq, sizeof(ESL_DSQ *), utest_xpairid_linkage, (void *) &param,
+				    workspace, expect, &nc) != eslOK) esl_fatal(msg);
+      for (k = 0; k < nc; k++) workspace[k] = -1;
+      for (i = 0, k = 0; i < nseq; i++)
+	{
+	  if (workspace[expect[i]] == -1) workspace[expect[i]] = k++;
+	  expect[i] = workspace[expect[i]];
+	}
+
+      for (t = 0; t < sizeof(nthreads) / sizeof(int); t++)
+	{
+	  if (esl_msacluster_SingleLinkage_adv(msa, maxids[m], nthreads[t], &c, &nin, &nc2) != eslOK) esl_fatal(msg);
+	  if (nc2 != nc) esl_fatal(msg);
+	  for (i = 0; i < nseq; i++) if (c[i] != expect[i]) esl_fatal(msg);
+	  for (k = 0; k < nc; k++) nin[k] = -nin[k];
+	  for (i = 0; i < nseq; i++) nin[c[i]]++;
+	  for (k = 0; k < nc; k++) if (nin[k] != 0) esl_fatal(msg);
+	  free(c);
+	  free(nin);
+	}
+    }
+
+  for (f = 0; f < nfam; f++) free(anc[f]);
+  free(anc);
+  free(workspace);
+  free(expect);
+  esl_msa_Destroy(msa);
+  esl_alphabet_Destroy(abc);
+}
 #endif /*eslMSACLUSTER_TESTDRIVE*/
 
 /*****************************************************************
- * 5. Test driver
+ * 6. Test driver
  *****************************************************************/
 #ifdef eslMSACLUSTER_TESTDRIVE
 /* gcc -g -Wall -o msacluster_utest -I. -L. -DeslMSACLUSTER_TESTDRIVE esl_msacluster.c -leasel -lm
@@ -293,6 +702,7 @@ utest_SingleLinkage(ESL_GETOPTS *go, const ESL_MSA *msa, double maxid, int expec
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
   { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,      "0",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options]";
@@ -302,6 +712,7 @@ int
 main(int argc, char **argv)
 {
   ESL_GETOPTS    *go      = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng     = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
   ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
   ESL_MSA        *msa     = esl_msa_CreateFromString("\
 # STOCKHOLM 1.0\n\
@@ -331,8 +742,11 @@ seq11 MMMMMMMMMM\n\
   utest_SingleLinkage(go, msa, 0.5,  6,  5);    /* at 50% id, seq0-seq6 cluster       */
   utest_SingleLinkage(go, msa, 0.0,  1,  0);    /* at 0% id, everything clusters      */
 
+  utest_bits_engine(rng);
+
   esl_msa_Destroy(msa);
   esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
   return 0;
 }
@@ -342,7 +756,7 @@ seq11 MMMMMMMMMM\n\
 
 
 /*****************************************************************
- * 6. Example
+ * 7. Example
  *****************************************************************/
 
 #ifdef eslMSACLUSTER_EXAMPLE
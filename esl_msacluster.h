@@ -5,7 +5,11 @@
 #include "esl_config.h"
 #include "esl_msa.h"
 
-extern int esl_msacluster_SingleLinkage(const ESL_MSA *msa, double maxid, 
-					int **opt_c, int **opt_nin, int *opt_nc);
+#define eslMSACLUSTER_BATCH 64   /* rows of the pairwise scan per job, per round */
+
+extern int esl_msacluster_SingleLinkage    (const ESL_MSA *msa, double maxid, 
+					    int **opt_c, int **opt_nin, int *opt_nc);
+extern int esl_msacluster_SingleLinkage_adv(const ESL_MSA *msa, double maxid, int nthreads,
+					    int **opt_c, int **opt_nin, int *opt_nc);
 
 #endif /*eslMSACLUSTER_INCLUDED*/
@@ -7,18 +7,22 @@
  *    4. Guessing alphabets.
  *    5. Random MSA flatfile access. 
  *    6. Reading an MSA from an ESL_MSAFILE.
- *    7. Writing an MSA to a stream.
- *    8. MSA functions that depend on MSAFILE
- *    9. Utilities used by specific format parsers.
- *   10. Unit tests.
- *   11. Test driver.
- *   12. Examples.
+ *    7. Reading MSAs in parallel: ESL_MSAFILE_READER.
+ *    8. Writing an MSA to a stream.
+ *    9. MSA functions that depend on MSAFILE
+ *   10. Utilities used by specific format parsers.
+ *   11. Unit tests.
+ *   12. Test driver.
+ *   13. Examples.
  */
 #include "esl_config.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -299,6 +303,7 @@ esl_msafile_OpenFailure(ESL_MSAFILE *afp, int status)
     case eslBUFFER_FILE:     
     case eslBUFFER_ALLFILE:
     case eslBUFFER_MMAP:     fprintf(stderr, "   while reading file %s\n", afp->bf->filename);          break;
+    case eslBUFFER_GZIP:     fprintf(stderr, "   while reading gzip file %s\n", afp->bf->filename);     break;
     case eslBUFFER_STRING:   fprintf(stderr, "   while reading from a provided string (not a file)\n"); break;
     default:                 break; 
     }
@@ -1056,6 +1061,7 @@ esl_msafile_ReadFailure(ESL_MSAFILE *afp, int status)
   case eslBUFFER_FILE:     
   case eslBUFFER_ALLFILE:
   case eslBUFFER_MMAP:     fprintf(stderr, "   while reading %s file %s\n", esl_msafile_DecodeFormat(afp->format), afp->bf->filename);          break;
+  case eslBUFFER_GZIP:     fprintf(stderr, "   while reading %s gzip file %s\n", esl_msafile_DecodeFormat(afp->format), afp->bf->filename);     break;
   case eslBUFFER_STRING:   fprintf(stderr, "   while reading %s from a provided string (not a file)\n", esl_msafile_DecodeFormat(afp->format)); break;
   default:                 break; 
   }
@@ -1069,10 +1075,382 @@ esl_msafile_ReadFailure(ESL_MSAFILE *afp, int status)
 /*------------ end, reading MSA from ESL_MSAFILE ---------------*/
 
 
+/*****************************************************************
+ *# 7. Reading MSAs in parallel: ESL_MSAFILE_READER
+ *****************************************************************/
+
+/* Parsing dominates the time it takes to run through a big
+ * multi-record Stockholm file like Pfam-A.full. Records are
+ * independent, and their // boundaries are cheap to find, so worker
+ * threads take turns cutting the next record's text out of the input
+ * (serialized), then parse it on their own (in parallel) into a ring
+ * of result slots. The caller takes results from the ring in file
+ * order. A worker can't take a new record until its slot is free, so
+ * at most <nslots> parsed alignments are held in memory at once.
+ */
+typedef struct {
+  ESL_MSA  *msa;                    /* parsed alignment, or NULL                       */
+  int       status;                 /* eslOK | eslEOF | eslEFORMAT | exception code    */
+  int64_t   linenumber;             /* on eslEFORMAT, line number of error in the file */
+  char      errmsg[eslERRBUFSIZE];  /* on eslEFORMAT, the parser's error message       */
+  int       full;                   /* TRUE when the result is ready for the caller    */
+} MSAFILE_READER_SLOT;
+
+struct esl_msafile_reader_s {
+  ESL_MSAFILE         *afp;         /* open input (not owned)                               */
+  int                  nthreads;    /* number of worker threads; 0 = serial esl_msafile_Read() */
+  int                  nslots;      /* max # of records in flight                            */
+  MSAFILE_READER_SLOT *slot;        /* record i goes to slot[i % nslots]                     */
+  int64_t              nscanned;    /* # of records cut from the input so far                */
+  int64_t              ndelivered;  /* # of results returned to the caller so far            */
+  int                  eof;         /* TRUE once the scan has reached end of input            */
+  int                  halt;        /* TRUE when workers must stop                           */
+  int                  joined;      /* TRUE once workers have been stopped and joined        */
+  int                  done;        /* TRUE once caller got EOF or an error: return it again */
+  int                  last_status; /*   ... that status                                     */
+#ifdef HAVE_PTHREAD
+  pthread_t           *tid;         /* worker threads [0..nthreads-1]                        */
+  pthread_mutex_t      scan_mutex;  /* protects <afp>, <nscanned>, <eof>                     */
+  pthread_mutex_t      slot_mutex;  /* protects <slot>, <ndelivered>, <halt>                 */
+  pthread_cond_t       slot_cv;     /* a slot has been filled or emptied                     */
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+static void *msafile_reader_thread(void *arg);
+static int   msafile_reader_scan (ESL_MSAFILE *afp, char **buf, esl_pos_t *balloc, esl_pos_t *ret_n);
+static void  msafile_reader_parse(const ESL_MSAFILE *afp, char *buf, esl_pos_t n, esl_pos_t offset, int64_t baseline, MSAFILE_READER_SLOT *r);
+static void  msafile_reader_halt (ESL_MSAFILE_READER *rdr);
+#endif
+
+
+/* Function:  esl_msafile_ReaderCreate()
+ * Synopsis:  Create a parallel reader for a multi-record MSA file.
+ *
+ * Purpose:   Create a reader that parses the alignments in open MSA
+ *            input <afp> on <nthreads> worker threads, and returns
+ *            them in file order, one at a time, with
+ *            <esl_msafile_ReaderNext()>. At most about <2*nthreads>
+ *            parsed alignments are held in memory at any one time.
+ *
+ *            Only Stockholm and Pfam inputs are parsed in parallel,
+ *            since their records have easily found // boundaries. For
+ *            other formats, or if <nthreads> is 0, or if Easel was
+ *            built without POSIX threads, the reader just calls
+ *            <esl_msafile_Read()> in the caller's thread; so it's
+ *            always safe to use a reader in place of a
+ *            <esl_msafile_Read()> loop.
+ *
+ *            While the reader exists, the caller must not use <afp>
+ *            directly, other than to report errors (see
+ *            <esl_msafile_ReaderNext()>).
+ *
+ * Args:      afp      - open MSA input
+ *            nthreads - number of worker threads; 0 = serial
+ *            ret_rdr  - RETURN: new reader
+ *
+ * Returns:   <eslOK> on success, and <*ret_rdr> is the reader.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslESYS> if a
+ *            pthreads call fails. <*ret_rdr> is <NULL>.
+ */
+int
+esl_msafile_ReaderCreate(ESL_MSAFILE *afp, int nthreads, ESL_MSAFILE_READER **ret_rdr)
+{
+  ESL_MSAFILE_READER *rdr = NULL;
+#ifdef HAVE_PTHREAD
+  int                 i;
+#endif
+  int                 status;
+
+  ESL_ALLOC(rdr, sizeof(ESL_MSAFILE_READER));
+  rdr->afp         = afp;
+  rdr->nthreads    = 0;
+  rdr->nslots      = 0;
+  rdr->slot        = NULL;
+  rdr->nscanned    = 0;
+  rdr->ndelivered  = 0;
+  rdr->eof         = FALSE;
+  rdr->halt        = FALSE;
+  rdr->joined      = FALSE;
+  rdr->done        = FALSE;
+  rdr->last_status = eslOK;
+
+#ifdef HAVE_PTHREAD
+  rdr->tid         = NULL;
+  if (nthreads > 0 && (afp->format == eslMSAFILE_STOCKHOLM || afp->format == eslMSAFILE_PFAM))
+    {
+      rdr->nslots = ESL_MAX(2, 2 * nthreads);
+      ESL_ALLOC(rdr->slot, sizeof(MSAFILE_READER_SLOT) * rdr->nslots);
+      for (i = 0; i < rdr->nslots; i++) { rdr->slot[i].msa = NULL; rdr->slot[i].full = FALSE; }
+      ESL_ALLOC(rdr->tid,  sizeof(pthread_t) * nthreads);
+
+      if (pthread_mutex_init(&(rdr->scan_mutex), NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init() failed");
+      if (pthread_mutex_init(&(rdr->slot_mutex), NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init() failed");
+      if (pthread_cond_init (&(rdr->slot_cv),    NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init() failed");
+
+      /* rdr->nthreads counts the threads we actually got; if we get none, we're serial */
+      for (i = 0; i < nthreads; i++)
+	{
+	  if (pthread_create(&(rdr->tid[rdr->nthreads]), NULL, msafile_reader_thread, rdr) != 0) break;
+	  rdr->nthreads++;
+	}
+    }
+#endif
+
+  *ret_rdr = rdr;
+  return eslOK;
+
+ ERROR:
+  if (rdr) { free(rdr->slot); free(rdr->tid); free(rdr); }
+  *ret_rdr = NULL;
+  return status;
+}
+
+
+/* Function:  esl_msafile_ReaderNext()
+ * Synopsis:  Get the next MSA from a parallel reader.
+ *
+ * Purpose:   Return the next alignment from reader <rdr> in <*ret_msa>,
+ *            in the same order they appear in the input. Caller frees
+ *            it with <esl_msa_Destroy()>.
+ *
+ *            Return values are the same as for <esl_msafile_Read()>,
+ *            including the parse error information left in the
+ *            reader's <afp> (<afp->errmsg>, <afp->linenumber>), so
+ *            <esl_msafile_ReadFailure(afp, status)> works as usual. An
+ *            error is reported only after all the good alignments
+ *            before it have been returned. After <eslEOF> or an error,
+ *            the reader is finished, and further calls return the same
+ *            status.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOF> if there are no more alignments.
+ *            <eslEFORMAT> on a parse error.
+ *            On any error, <*ret_msa> is <NULL>.
+ *
+ * Throws:    <eslEMEM>, <eslESYS>, <eslEINCONCEIVABLE> as for
+ *            <esl_msafile_Read()>.
+ */
+int
+esl_msafile_ReaderNext(ESL_MSAFILE_READER *rdr, ESL_MSA **ret_msa)
+{
+#ifdef HAVE_PTHREAD
+  MSAFILE_READER_SLOT *r;
+  ESL_MSA             *msa = NULL;
+  char                 errmsg[eslERRBUFSIZE];
+  int64_t              linenumber;
+  int                  status;
+
+  if (rdr->done)          { *ret_msa = NULL; return rdr->last_status; }
+  if (rdr->nthreads == 0) return esl_msafile_Read(rdr->afp, ret_msa);
+
+  if (pthread_mutex_lock(&(rdr->slot_mutex)) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock() failed");
+  r = &(rdr->slot[rdr->ndelivered % rdr->nslots]);
+  while (! r->full) 
+    if (pthread_cond_wait(&(rdr->slot_cv), &(rdr->slot_mutex)) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_wait() failed");
+  msa        = r->msa;
+  status     = r->status;
+  linenumber = r->linenumber;
+  if (status == eslEFORMAT) strcpy(errmsg, r->errmsg);
+  r->msa  = NULL;
+  r->full = FALSE;
+  rdr->ndelivered++;
+  pthread_cond_broadcast(&(rdr->slot_cv));
+  if (pthread_mutex_unlock(&(rdr->slot_mutex)) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock() failed");
+
+  if (status != eslOK)
+    { /* EOF or error: stop the workers before touching <afp> ourselves */
+      msafile_reader_halt(rdr);
+      if (status == eslEFORMAT) {
+	strcpy(rdr->afp->errmsg, errmsg);
+	rdr->afp->linenumber = linenumber;
+      } else if (status == eslEOF) rdr->afp->errmsg[0] = '\0';
+      rdr->done        = TRUE;
+      rdr->last_status = status;
+    }
+  *ret_msa = msa;
+  return status;
+#else
+  return esl_msafile_Read(rdr->afp, ret_msa);
+#endif
+}
+
+
+/* Function:  esl_msafile_ReaderDestroy()
+ * Synopsis:  Stop and free a parallel MSA reader.
+ *
+ * Purpose:   Stop the worker threads of reader <rdr>, discard any
+ *            alignments it parsed that the caller hasn't taken, and
+ *            free it. The caller can stop early, before <eslEOF>.
+ *            The <afp> isn't closed; the caller still does that.
+ */
+void
+esl_msafile_ReaderDestroy(ESL_MSAFILE_READER *rdr)
+{
+  int i;
+
+  if (rdr)
+    {
+#ifdef HAVE_PTHREAD
+      if (rdr->nthreads) 
+	{
+	  msafile_reader_halt(rdr);
+	  pthread_cond_destroy (&(rdr->slot_cv));
+	  pthread_mutex_destroy(&(rdr->slot_mutex));
+	  pthread_mutex_destroy(&(rdr->scan_mutex));
+	}
+      free(rdr->tid);
+#endif
+      for (i = 0; i < rdr->nslots; i++) esl_msa_Destroy(rdr->slot[i].msa);
+      free(rdr->slot);
+      free(rdr);
+    }
+}
+
+
+#ifdef HAVE_PTHREAD
+/* msafile_reader_thread()
+ * A worker: repeatedly cut the next record out of the input, and
+ * parse it into its slot, until the input ends or we're halted.
+ */
+static void *
+msafile_reader_thread(void *arg)
+{
+  ESL_MSAFILE_READER  *rdr    = (ESL_MSAFILE_READER *) arg;
+  ESL_MSAFILE         *afp    = rdr->afp;
+  MSAFILE_READER_SLOT  r;
+  char                *buf    = NULL;
+  esl_pos_t            balloc = 0;
+  esl_pos_t            n;
+  esl_pos_t            offset;
+  int64_t              baseline;
+  int64_t              idx;
+  int                  halted;
+  int                  status;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&(rdr->scan_mutex));
+
+      /* Wait until there's a free slot for the next record */
+      pthread_mutex_lock(&(rdr->slot_mutex));
+      while (! rdr->halt && rdr->nscanned - rdr->ndelivered >= rdr->nslots)
+	pthread_cond_wait(&(rdr->slot_cv), &(rdr->slot_mutex));
+      halted = rdr->halt;
+      pthread_mutex_unlock(&(rdr->slot_mutex));
+      if (halted || rdr->eof) { pthread_mutex_unlock(&(rdr->scan_mutex)); break; }
+
+      idx      = rdr->nscanned++;
+      offset   = esl_buffer_GetOffset(afp->bf);
+      baseline = afp->linenumber;
+      status   = msafile_reader_scan(afp, &buf, &balloc, &n);
+      if (status != eslOK) rdr->eof = TRUE; /* EOF, or an error: either way, no more records */
+      if (status == eslEFORMAT) { strcpy(r.errmsg, afp->errmsg); r.linenumber = afp->linenumber; } /* corrupt or truncated gzip */
+      pthread_mutex_unlock(&(rdr->scan_mutex));
+
+      r.msa = NULL;
+      if      (status == eslOK || (status == eslEOF && n > 0)) msafile_reader_parse(afp, buf, n, offset, baseline, &r);
+      else                                                    r.status = status;
+
+      pthread_mutex_lock(&(rdr->slot_mutex));
+      rdr->slot[idx % rdr->nslots]      = r;
+      rdr->slot[idx % rdr->nslots].full = TRUE;
+      pthread_cond_broadcast(&(rdr->slot_cv));
+      pthread_mutex_unlock(&(rdr->slot_mutex));
+    }
+
+  free(buf);
+  pthread_exit(NULL);
+}
+
+/* msafile_reader_scan()
+ * Copy the text of the next Stockholm record from <afp> into <*buf>,
+ * through its // line, reallocating as needed; return its length in
+ * <*ret_n>. Returns <eslOK>, or <eslEOF> if the input ended first, in
+ * which case there may still be a partial record, <*ret_n> > 0, for
+ * the parser to make sense of (or report an error on); or <eslEFORMAT>
+ * if gzip'ed input is corrupt, with the reason in <afp->errmsg>.
+ */
+static int
+msafile_reader_scan(ESL_MSAFILE *afp, char **buf, esl_pos_t *balloc, esl_pos_t *ret_n)
+{
+  char      *p;
+  esl_pos_t  n;
+  esl_pos_t  len = 0;
+  int        status;
+
+  while ((status = esl_msafile_GetLine(afp, &p, &n)) == eslOK)
+    {
+      if (len + n + 1 > *balloc) 
+	{
+	  ESL_REALLOC(*buf, sizeof(char) * 2 * (len + n + 1));
+	  *balloc = 2 * (len + n + 1);
+	}
+      memcpy(*buf + len, p, n);
+      len += n;
+      (*buf)[len++] = '\n';
+
+      while (n && (*p == ' ' || *p == '\t')) { p++; n--; }
+      if (esl_memstrpfx(p, n, "//")) break;
+    }
+
+ ERROR:
+  *ret_n = len;
+  return status;
+}
+
+/* msafile_reader_parse()
+ * Parse one record's text <buf>,<n> as <afp> would have, putting
+ * the result in <r>. The record started at byte <offset> of the
+ * input, after line <baseline>.
+ */
+static void
+msafile_reader_parse(const ESL_MSAFILE *afp, char *buf, esl_pos_t n, esl_pos_t offset, int64_t baseline, MSAFILE_READER_SLOT *r)
+{
+  ESL_MSAFILE         *wafp = NULL;
+  ESL_MSAFILE_FMTDATA  fmtd = afp->fmtd;
+
+  r->msa = NULL;
+  if ((r->status = esl_msafile_OpenMem(NULL, buf, n, afp->format, &fmtd, &wafp)) != eslOK) goto DONE;
+  if (afp->abc && (r->status = esl_msafile_SetDigital(wafp, afp->abc))    != eslOK) goto DONE;
+
+  r->status = esl_msafile_Read(wafp, &(r->msa));
+  if      (r->status == eslOK)      r->msa->offset = offset;
+  else if (r->status == eslEFORMAT) {
+    strcpy(r->errmsg, wafp->errmsg);
+    r->linenumber = baseline + wafp->linenumber;
+  }
+
+ DONE:
+  esl_msafile_Close(wafp);
+}
+
+/* msafile_reader_halt()
+ * Tell the workers to stop, and wait for them to finish.
+ */
+static void
+msafile_reader_halt(ESL_MSAFILE_READER *rdr)
+{
+  int t;
+
+  if (rdr->joined) return;
+  pthread_mutex_lock(&(rdr->slot_mutex));
+  rdr->halt = TRUE;
+  pthread_cond_broadcast(&(rdr->slot_cv));
+  pthread_mutex_unlock(&(rdr->slot_mutex));
+
+  for (t = 0; t < rdr->nthreads; t++) pthread_join(rdr->tid[t], NULL);
+  rdr->joined = TRUE;
+}
+#endif /*HAVE_PTHREAD*/
+/*------------- end, reading MSAs in parallel -------------------*/
+
+
 
 
 /*****************************************************************
- *# 7. Writing an MSA to a stream.
+ *# 8. Writing an MSA to a stream.
  *****************************************************************/
 
 /* Function:  esl_msafile_Write()
@@ -1121,7 +1499,7 @@ esl_msafile_Write(FILE *fp, ESL_MSA *msa, int fmt)
 
 
 /*****************************************************************
- *# 8. MSA functions that depend on MSAFILE
+ *# 9. MSA functions that depend on MSAFILE
  *****************************************************************/
 
 /* Function:  esl_msa_CreateFromString()
@@ -1169,7 +1547,7 @@ esl_msa_CreateFromString(const char *s, int fmt)
 }
 
 /*****************************************************************
- *# 9. Utilities used by specific format parsers.
+ *# 10. Utilities used by specific format parsers.
  *****************************************************************/
 
 /* Function:  esl_msafile_GetLine()
@@ -1198,6 +1576,9 @@ esl_msa_CreateFromString(const char *s, int fmt)
  *            <eslEOF> at EOF. Now <afp->line> is <NULL>, <afp->n>
  *            is <0>, and <afp->lineoffset> is <0>. <afp->linenumber>
  *            is the total number of lines in the input.
+ *
+ *            <eslEFORMAT> if a gzip'ed input turns out to be corrupt
+ *            or truncated; <afp->errmsg> says why.
  *            
  * Throws:    <eslEMEM> if an allocation fails.
  *            <eslESYS> if a system call fails, such as fread().
@@ -1209,7 +1590,9 @@ esl_msafile_GetLine(ESL_MSAFILE *afp, char **opt_p, esl_pos_t *opt_n)
   int status;
 
   afp->lineoffset = esl_buffer_GetOffset(afp->bf);
-  if ((status = esl_buffer_GetLine(afp->bf, &(afp->line), &(afp->n))) != eslOK) goto ERROR;
+  status = esl_buffer_GetLine(afp->bf, &(afp->line), &(afp->n));
+  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, afp->errmsg, "%s", afp->bf->errmsg); /* corrupt or truncated gzip */
+  else if (status != eslOK)      goto ERROR;
   if (afp->linenumber != -1) afp->linenumber++;
 
   if (opt_p) *opt_p = afp->line;
@@ -1269,10 +1652,13 @@ esl_msafile_PutLine(ESL_MSAFILE *afp)
 
 
 /*****************************************************************
- * 10. Unit tests
+ * 11. Unit tests
  *****************************************************************/
 #ifdef eslMSAFILE_TESTDRIVE
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 static void
 utest_format2format(int fmt1, int fmt2)
@@ -1382,12 +1768,180 @@ seq2    ACDEFGHIKLMNPQRSTVWYacdefghiklmnpqrstvwyACDEFGHIKLMNPQRSTVWYacdefghiklmn
   esl_alphabet_Destroy(abc);
   esl_alphabet_Destroy(abc2);
 }
+/* utest_reader()
+ * A parallel reader must return the same alignments, in the same order,
+ * as a serial esl_msafile_Read() loop; and the same error, after the
+ * same good alignments, when one record is bad.
+ */
+static void
+utest_reader(ESL_RANDOMNESS *rng, int nthreads)
+{
+  char                msg[]       = "esl_msafile: reader unit test failed";
+  char                tmpfile[32] = "esltmpXXXXXX";
+  char                errmsg[eslERRBUFSIZE];
+  ESL_ALPHABET       *abc         = esl_alphabet_Create(eslAMINO);
+  FILE               *ofp         = NULL;
+  ESL_MSAFILE        *afp         = NULL;
+  ESL_MSAFILE_READER *rdr         = NULL;
+  ESL_MSA           **msa         = NULL;
+  ESL_MSA           **msa1        = NULL;
+  ESL_MSA            *msa2        = NULL;
+  int                 nali        = 1 + esl_rnd_Roll(rng, 30);
+  int                 badidx      = esl_rnd_Roll(rng, nali);
+  int64_t             linenumber;
+  int                 do_bad, i, n;
+  int                 status;
+
+  if ((msa  = malloc(sizeof(ESL_MSA *) * nali)) == NULL) esl_fatal(msg);
+  if ((msa1 = malloc(sizeof(ESL_MSA *) * (nali+1))) == NULL) esl_fatal(msg);  /* +1: the failed read sets msa1[n] = NULL */
+  for (i = 0; i < nali; i++)
+    if (esl_msa_Sample(rng, abc, 20, 50, &(msa[i])) != eslOK) esl_fatal(msg);
+
+  for (do_bad = 0; do_bad <= 1; do_bad++)
+    {
+      strcpy(tmpfile, "esltmpXXXXXX");
+      if (esl_tmpfile_named(tmpfile, &ofp) != eslOK) esl_fatal(msg);
+      for (i = 0; i < nali; i++)
+	{
+	  if (do_bad && i == badidx) fputs("# STOCKHOLM 1.0\n\nseq1 ACDEF\nseq2 ACD\n//\n", ofp);
+	  else if (esl_msafile_Write(ofp, msa[i], eslMSAFILE_STOCKHOLM) != eslOK) esl_fatal(msg);
+	}
+      fclose(ofp);
+
+      /* the serial read: how many good alignments, then what error? */
+      if (esl_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+      for (n = 0; (status = esl_msafile_Read(afp, &(msa1[n]))) == eslOK; n++) ;
+      if (n != (do_bad ? badidx : nali))                  esl_fatal(msg);
+      if (status != (do_bad ? eslEFORMAT : eslEOF))      esl_fatal(msg);
+      strcpy(errmsg, afp->errmsg);
+      linenumber = afp->linenumber;
+      esl_msafile_Close(afp);
+
+      /* the parallel read */
+      if (esl_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (esl_msafile_ReaderCreate(afp, nthreads, &rdr)                           != eslOK) esl_fatal(msg);
+      for (n = 0; (status = esl_msafile_ReaderNext(rdr, &msa2)) == eslOK; n++)
+	{
+	  if (n >= nali)                          esl_fatal(msg);
+	  if (esl_msa_Compare(msa1[n], msa2) != eslOK) esl_fatal(msg);
+	  if (msa1[n]->offset != msa2->offset)         esl_fatal(msg);
+	  esl_msa_Destroy(msa2);
+	}
+      if (n != (do_bad ? badidx : nali))             esl_fatal(msg);
+      if (status != (do_bad ? eslEFORMAT : eslEOF)) esl_fatal(msg);
+      if (strcmp(errmsg, afp->errmsg) != 0)         esl_fatal(msg);
+      if (do_bad && afp->linenumber != linenumber)  esl_fatal(msg);
+      if (esl_msafile_ReaderNext(rdr, &msa2) != status || msa2 != NULL) esl_fatal(msg);
+      esl_msafile_ReaderDestroy(rdr);
+      esl_msafile_Close(afp);
+      for (i = 0; i < n; i++) esl_msa_Destroy(msa1[i]);
+
+      /* stopping early is fine too */
+      if (esl_msafile_Open(&abc, tmpfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+      if (esl_msafile_ReaderCreate(afp, nthreads, &rdr)                           != eslOK) esl_fatal(msg);
+      if (esl_msafile_ReaderNext(rdr, &msa2) == eslOK) esl_msa_Destroy(msa2);
+      esl_msafile_ReaderDestroy(rdr);
+      esl_msafile_Close(afp);
+
+      remove(tmpfile);
+    }
+
+  for (i = 0; i < nali; i++) esl_msa_Destroy(msa[i]);
+  free(msa);
+  free(msa1);
+  esl_alphabet_Destroy(abc);
+}
+
+#ifdef HAVE_ZLIB
+/* utest_reader_gzip()
+ * A truncated gzip file is a normal parse error, eslEFORMAT with the
+ * reason in <afp->errmsg>, for a serial esl_msafile_Read() loop and
+ * for a parallel reader alike; and both get the same good alignments
+ * before it.
+ */
+static void
+utest_reader_gzip(ESL_RANDOMNESS *rng, int nthreads)
+{
+  char                msg[]       = "esl_msafile: reader_gzip unit test failed";
+  char                tmpfile[32] = "esltmpXXXXXX";
+  char                gzfile[40];
+  char                truncfile[48];
+  char                errmsg[eslERRBUFSIZE];
+  char                buf[4096];
+  ESL_ALPHABET       *abc         = esl_alphabet_Create(eslAMINO);
+  FILE               *ifp         = NULL;
+  FILE               *ofp         = NULL;
+  gzFile              gzfp;
+  ESL_MSAFILE        *afp         = NULL;
+  ESL_MSAFILE_READER *rdr         = NULL;
+  ESL_MSA            *msa         = NULL;
+  int                 nali        = 20;
+  int                 nread, i, n;
+  long                half;
+  int                 status;
+
+  /* A Stockholm file; gzip it; then cut that off halfway */
+  if (esl_tmpfile_named(tmpfile, &ifp) != eslOK) esl_fatal(msg);
+  for (i = 0; i < nali; i++)
+    {
+      if (esl_msa_Sample(rng, abc, 20, 200, &msa)           != eslOK) esl_fatal(msg);
+      if (esl_msafile_Write(ifp, msa, eslMSAFILE_STOCKHOLM) != eslOK) esl_fatal(msg);
+      esl_msa_Destroy(msa);
+    }
+  rewind(ifp);
+  snprintf(gzfile, 40, "%s.gz", tmpfile);
+  if ((gzfp = gzopen(gzfile, "wb")) == NULL) esl_fatal(msg);
+  while ((n = fread(buf, 1, sizeof(buf), ifp)) > 0)
+    if (gzwrite(gzfp, buf, n) != n) esl_fatal(msg);
+  if (gzclose(gzfp) != Z_OK) esl_fatal(msg);
+  fclose(ifp);
+
+  if ((ifp = fopen(gzfile,  "rb")) == NULL) esl_fatal(msg);
+  if ((ofp = fopen(tmpfile, "wb")) == NULL) esl_fatal(msg);
+  fseek(ifp, 0, SEEK_END);
+  half = ftell(ifp) / 2;
+  rewind(ifp);
+  while (half > 0 && (n = fread(buf, 1, ESL_MIN((long) sizeof(buf), half), ifp)) > 0)
+    {
+      if (fwrite(buf, 1, n, ofp) != (size_t) n) esl_fatal(msg);
+      half -= n;
+    }
+  fclose(ifp);
+  fclose(ofp);
+  remove(gzfile);
+  snprintf(truncfile, 48, "%st.gz", tmpfile);
+  if (rename(tmpfile, truncfile) != 0) esl_fatal(msg);
+
+  /* serial */
+  if (esl_msafile_Open(&abc, truncfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+  for (nread = 0; (status = esl_msafile_Read(afp, &msa)) == eslOK; nread++) esl_msa_Destroy(msa);
+  if (status != eslEFORMAT)    esl_fatal(msg);
+  if (afp->errmsg[0] == '\0')  esl_fatal(msg);
+  if (nread == 0 || nread >= nali) esl_fatal(msg);
+  strcpy(errmsg, afp->errmsg);
+  esl_msafile_Close(afp);
+
+  /* parallel */
+  if (esl_msafile_Open(&abc, truncfile, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (esl_msafile_ReaderCreate(afp, nthreads, &rdr)                          != eslOK) esl_fatal(msg);
+  for (n = 0; (status = esl_msafile_ReaderNext(rdr, &msa)) == eslOK; n++) esl_msa_Destroy(msa);
+  if (status != eslEFORMAT)             esl_fatal(msg);
+  if (n != nread)                       esl_fatal(msg);
+  if (strcmp(errmsg, afp->errmsg) != 0) esl_fatal(msg);
+  esl_msafile_ReaderDestroy(rdr);
+  esl_msafile_Close(afp);
+
+  remove(truncfile);
+  esl_alphabet_Destroy(abc);
+}
+#endif /*HAVE_ZLIB*/
+
 #endif /*eslMSAFILE_TESTDRIVE*/
 /*----------------- end, unit tests -----------------------------*/
 
 
 /*****************************************************************
- * 11. Test driver
+ * 12. Test driver
  *****************************************************************/
 #ifdef eslMSAFILE_TESTDRIVE
 
@@ -1402,10 +1956,12 @@ seq2    ACDEFGHIKLMNPQRSTVWYacdefghiklmnpqrstvwyACDEFGHIKLMNPQRSTVWYacdefghiklmn
 #include "easel.h"
 #include "esl_getopts.h"
 #include "esl_msafile.h"
+#include "esl_random.h"
 
 static ESL_OPTIONS options[] = {
    /* name  type         default  env   range togs  reqs  incomp  help                docgrp */
   {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                            0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",                  0},
   { 0,0,0,0,0,0,0,0,0,0},
 };
 static char usage[]  = "[-options]";
@@ -1415,12 +1971,26 @@ int
 main(int argc, char **argv)
 {
   ESL_GETOPTS    *go          = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng         = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
   int fmt1, fmt2;
   
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
   for (fmt1 = eslMSAFILE_STOCKHOLM; fmt1 <= eslMSAFILE_PHYLIPS; fmt1++)
     for (fmt2 = eslMSAFILE_STOCKHOLM; fmt2 <= eslMSAFILE_PHYLIPS; fmt2++)
       utest_format2format(fmt1, fmt2);
 
+  utest_reader(rng, 0);
+  utest_reader(rng, 1);
+  utest_reader(rng, 4);
+#ifdef HAVE_ZLIB
+  utest_reader_gzip(rng, 0);
+  utest_reader_gzip(rng, 4);
+#endif
+
+  fprintf(stderr, "#  status = ok\n");
+  esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
   exit(0);
 }
@@ -1431,7 +2001,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 12. Examples.
+ * 13. Examples.
  *****************************************************************/
 
 #ifdef eslMSAFILE_EXAMPLE
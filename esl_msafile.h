@@ -71,6 +71,14 @@ typedef struct {
 } ESL_MSAFILE;
 
 
+/* Object: ESL_MSAFILE_READER
+ * 
+ * Parses the records of a multi-record MSA file on worker threads,
+ * and returns them in order. Opaque; see esl_msafile.c.
+ */
+typedef struct esl_msafile_reader_s ESL_MSAFILE_READER;
+
+
 /* Alignment file format codes.
  * Must coexist with sqio unaligned file format codes.
  * Rules:
@@ -119,10 +127,15 @@ extern int esl_msafile_PositionByKey(ESL_MSAFILE *afp, const char *key);
 extern int  esl_msafile_Read(ESL_MSAFILE *afp, ESL_MSA **ret_msa);
 extern void esl_msafile_ReadFailure(ESL_MSAFILE *afp, int status);
 
-/* 7. Writing an MSA to a stream */
+/* 7. Reading MSAs in parallel */
+extern int  esl_msafile_ReaderCreate (ESL_MSAFILE *afp, int nthreads, ESL_MSAFILE_READER **ret_rdr);
+extern int  esl_msafile_ReaderNext   (ESL_MSAFILE_READER *rdr, ESL_MSA **ret_msa);
+extern void esl_msafile_ReaderDestroy(ESL_MSAFILE_READER *rdr);
+
+/* 8. Writing an MSA to a stream */
 extern int esl_msafile_Write(FILE *fp, ESL_MSA *msa, int fmt);
 
-/* 8. Utilities for specific parsers */
+/* 10. Utilities for specific parsers */
 extern int esl_msafile_GetLine(ESL_MSAFILE *afp, char **opt_p, esl_pos_t *opt_n);
 extern int esl_msafile_PutLine(ESL_MSAFILE *afp);
 
@@ -37,7 +37,7 @@
 #define eslSTOCKHOLM_LINE_GR_OTHER  10
 #define eslSTOCKHOLM_LINE_GC_MM     11
 
-typedef struct {
+typedef struct esl_stockholm_parsedata_s {
   /* information about the size of the growing alignment parse */
   int       nseq;		/* # of sqnames currently stored, sqname[0..nseq-1]. Copy of msa->nseq */
   int64_t   alen;		/* alignment length not including current block being parsed. Becomes msa->alen when done */
@@ -70,6 +70,9 @@ typedef struct {
   int64_t   *ogc_len;		/* current lengths of unparsed gc[0..ngc-1]  */
   int64_t  **ogr_len;		/* current lengths of unparsed gr[0..ngr-1][0..nseq-1] */
   int        salloc;		/* # of sqnames currently allocated for (synced to msa->sqalloc) */
+
+  /* When streaming, aligned seq and GR lines are handed to the stream, not stored in <msa> */
+  ESL_STOCKHOLM_STREAM *sst;    /* stream we're parsing for, or NULL for a normal read */
 } ESL_STOCKHOLM_PARSEDATA;
 
 static ESL_STOCKHOLM_PARSEDATA *stockholm_parsedata_Create(ESL_MSA *msa);
@@ -77,6 +80,11 @@ static int                      stockholm_parsedata_ExpandSeq  (ESL_STOCKHOLM_PA
 static int                      stockholm_parsedata_ExpandBlock(ESL_STOCKHOLM_PARSEDATA *pd);
 static void                     stockholm_parsedata_Destroy    (ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa);
 
+static int stockholm_begin     (ESL_MSAFILE *afp, ESL_MSA **ret_msa, ESL_STOCKHOLM_PARSEDATA **ret_pd);
+static int stockholm_end_block (ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa);
+static int stockholm_end_record(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa);
+static int stockholm_stream_set(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, int linetype, int idx, const char *tag, char *p, esl_pos_t n);
+
 static int stockholm_parse_gf(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
 static int stockholm_parse_gs(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
 static int stockholm_parse_gc(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa, char *p, esl_pos_t n);
@@ -248,27 +256,13 @@ esl_msafile_stockholm_Read(ESL_MSAFILE *afp, ESL_MSA **ret_msa)
   ESL_STOCKHOLM_PARSEDATA *pd       = NULL;
   char                    *p;
   esl_pos_t                n;
-  int                      idx;
   int                      status;
 
   ESL_DASSERT1( (afp->format == eslMSAFILE_PFAM || afp->format == eslMSAFILE_STOCKHOLM) );
 
   afp->errmsg[0] = '\0';
 
-  /* Allocate a growable MSA, and auxiliary parse data coupled to the MSA allocation */
-  if (afp->abc   &&  (msa = esl_msa_CreateDigital(afp->abc, 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
-  if (! afp->abc &&  (msa = esl_msa_Create(                 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
-  if ( (pd = stockholm_parsedata_Create(msa))                        == NULL) { status = eslEMEM; goto ERROR; }
-
-  /* Skip leading blank lines in file. EOF here is a normal EOF return. */
-  do { 
-    if ( ( status = esl_msafile_GetLine(afp, &p, &n)) != eslOK) goto ERROR;  /* eslEOF is OK here - end of input (eslEOF) [eslEMEM|eslESYS] */
-  } while (esl_memspn(afp->line, afp->n, " \t") == afp->n ||                  /* skip blank lines             */
-	   (esl_memstrpfx(afp->line, afp->n, "#")                             /* and skip comment lines       */
-	    && ! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM")));           /* but stop on Stockholm header */
-
-  /* Check for the magic Stockholm header */
-  if (! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM 1."))  ESL_XFAIL(eslEFORMAT, afp->errmsg, "missing Stockholm header");
+  if ((status = stockholm_begin(afp, &msa, &pd)) != eslOK) goto ERROR;  /* eslEOF is OK here - end of input (eslEOF) [eslEMEM|eslESYS] */
 
   while ( (status = esl_msafile_GetLine(afp, &p, &n)) == eslOK) /* (eslEOF) [eslEMEM|eslESYS] */
     {
@@ -276,21 +270,7 @@ esl_msafile_stockholm_Read(ESL_MSAFILE *afp, ESL_MSA **ret_msa)
 
       if (!n || esl_memstrpfx(p, n, "//"))
 	{ /* blank lines and the Stockholm end-of-record // trigger end-of-block logic */
-	  if (pd->in_block) {
-	    if (pd->nblock) { if (pd->nseq_b != pd->nseq) ESL_XFAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number in earlier block(s)");     }
-	    else            { if (pd->nseq_b < pd->nseq)  ESL_XFAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number annotated by #=GS lines"); };
-	    if (pd->nblock) { if (pd->bi != pd->npb)      ESL_XFAIL(eslEFORMAT, afp->errmsg, "unexpected number of lines in alignment block"); }
-
-	    pd->nseq     = msa->nseq = pd->nseq_b;
-	    pd->alen    += pd->alen_b;
-	    pd->in_block = FALSE;
-	    pd->npb      = pd->bi;
-	    pd->bi       = 0;
-	    pd->si       = 0;
-	    pd->nblock  += 1;
-	    pd->nseq_b   = 0;
-	    pd->alen_b   = 0;
-	  }
+	  if (pd->in_block && (status = stockholm_end_block(afp, pd, msa)) != eslOK) goto ERROR;
 	  if   (esl_memstrpfx(p, n, "//"))   break; /* Stockholm end-of-record marker */
 	  else continue;			    /* else, on to next block */
 	}
@@ -308,17 +288,8 @@ esl_msafile_stockholm_Read(ESL_MSAFILE *afp, ESL_MSA **ret_msa)
     }
   if      (status == eslEOF) ESL_XFAIL(eslEFORMAT, afp->errmsg, "missing // terminator after MSA");
   else if (status != eslOK)  goto ERROR;
-  if (pd->nblock == 0)       ESL_XFAIL(eslEFORMAT, afp->errmsg, "no alignment data followed Stockholm header");
 
-  msa->alen = pd->alen;
-
-  /* Stockholm file can set weights. If eslMSA_HASWGTS flag is up, at least one was set: then all must be. */
-  if (msa->flags & eslMSA_HASWGTS)
-    {
-      for (idx = 0; idx < msa->nseq; idx++)
-	if (msa->wgt[idx] == -1.0) ESL_XFAIL(eslEFORMAT, afp->errmsg, "stockholm record ended without a weight for %s", msa->sqname[idx]);
-    }
-  else if (( status = esl_msa_SetDefaultWeights(msa)) != eslOK) goto ERROR;
+  if ((status = stockholm_end_record(afp, pd, msa)) != eslOK) goto ERROR;
 
   stockholm_parsedata_Destroy(pd, msa);
   *ret_msa  = msa;
@@ -332,6 +303,198 @@ esl_msafile_stockholm_Read(ESL_MSAFILE *afp, ESL_MSA **ret_msa)
 }
 
 
+/* Function:  esl_msafile_stockholm_StreamCreate()
+ * Synopsis:  Create a line-by-line reader for Stockholm alignments.
+ *
+ * Purpose:   Create a new <ESL_STOCKHOLM_STREAM> for reading the
+ *            Stockholm or Pfam format alignment(s) in open <afp> one
+ *            aligned line at a time, with
+ *            <esl_msafile_stockholm_StreamNext()>, instead of
+ *            building each whole <ESL_MSA> in memory.
+ *
+ *            The stream keeps a small <ESL_MSA>, <sst->msa>, for the
+ *            current record: sequence names and weights, GF
+ *            annotation and comments, but no aligned sequence. What
+ *            else is kept is up to the caller. <keep> is a bitwise OR
+ *            of any of:
+ *            | <eslSTOCKHOLM_KEEP_GS> | store #=GS annotation in <sst->msa>  |
+ *            | <eslSTOCKHOLM_KEEP_GC> | store #=GC annotation in <sst->msa>  |
+ *            | <eslSTOCKHOLM_KEEP_GR> | return #=GR lines as well as seqs    |
+ *            or 0. Lines of annotation that aren't kept are skipped
+ *            without being parsed or stored. (#=GS WT weights are
+ *            always kept.) Memory use is then independent of
+ *            alignment length, other than for any #=GC lines kept.
+ *
+ * Args:      afp     - open Stockholm or Pfam format MSA file
+ *            keep    - what to keep: <eslSTOCKHOLM_KEEP_*> flags, or 0
+ *            ret_sst - RETURN: new stream
+ *
+ * Returns:   <eslOK> on success, and <*ret_sst> is the new stream.
+ *            Caller frees it with <esl_msafile_stockholm_StreamDestroy()>,
+ *            before closing <afp>.
+ *
+ * Throws:    <eslEINVAL> if <afp> isn't Stockholm or Pfam format.
+ *            <eslEMEM> on allocation error.
+ *            On error, <*ret_sst> is <NULL>.
+ */
+int
+esl_msafile_stockholm_StreamCreate(ESL_MSAFILE *afp, int keep, ESL_STOCKHOLM_STREAM **ret_sst)
+{
+  ESL_STOCKHOLM_STREAM *sst = NULL;
+  int                   status;
+
+  if (afp->format != eslMSAFILE_PFAM && afp->format != eslMSAFILE_STOCKHOLM)
+    ESL_XEXCEPTION(eslEINVAL, "Stockholm stream needs a Stockholm or Pfam format file");
+
+  ESL_ALLOC(sst, sizeof(ESL_STOCKHOLM_STREAM));
+  sst->afp      = afp;
+  sst->keep     = keep;
+  sst->msa      = NULL;
+  sst->linetype = 0;
+  sst->idx      = -1;
+  sst->tag      = NULL;
+  sst->block    = 0;
+  sst->apos     = 0;
+  sst->n        = 0;
+  sst->dsq      = NULL;
+  sst->text     = NULL;
+  sst->nalloc   = 0;
+  sst->pd       = NULL;
+
+  *ret_sst = sst;
+  return eslOK;
+
+ ERROR:
+  *ret_sst = NULL;
+  return status;
+}
+
+
+/* Function:  esl_msafile_stockholm_StreamNext()
+ * Synopsis:  Read the next aligned line of a Stockholm alignment.
+ *
+ * Purpose:   Read on in the stream <sst> to the next aligned sequence
+ *            line (or #=GR line, if they're kept), and return it in
+ *            <sst>:
+ *            | <sst->linetype> | <eslSTOCKHOLM_STREAM_SQ> or <eslSTOCKHOLM_STREAM_GR> |
+ *            | <sst->idx>      | which seq, 0..nseq-1, in order of first appearance  |
+ *            | <sst->tag>      | GR tag, such as "PP"; <NULL> for a seq line          |
+ *            | <sst->block>    | which block of the alignment, 0..                    |
+ *            | <sst->apos>     | the line's first column, 1..alen                     |
+ *            | <sst->n>        | the number of columns on the line                    |
+ *            | <sst->dsq>      | seq line, digital mode: <dsq[1..n]>                  |
+ *            | <sst->text>     | seq line in text mode, or GR annotation: <text[0..n-1]> |
+ *            
+ *            Lines of the same block cover the same columns. In Pfam
+ *            format there's only one block, and each seq line is an
+ *            entire aligned row; in multiblock Stockholm, a caller
+ *            that wants whole columns gets one block of them at a
+ *            time.
+ *
+ *            At the end of each alignment record, return <eslEOD>.
+ *            <sst->msa> is then complete: <nseq>, <alen>, names,
+ *            weights, and whatever annotation was kept. The caller
+ *            can take it over by setting <sst->msa> to <NULL>;
+ *            otherwise it's freed when the next record starts. The
+ *            next call starts on the next alignment in the file.
+ *
+ *            The same format checks are made as in
+ *            <esl_msafile_stockholm_Read()>, except on annotation
+ *            that isn't kept.
+ *
+ * Returns:   <eslOK> on success: the next line is in <sst>.
+ *
+ *            <eslEOD> at the end of an alignment record.
+ *
+ *            <eslEOF> if there are no more alignment records in the file.
+ *
+ *            <eslEFORMAT> on a parse error, with diagnostic
+ *            information in <afp> as for <esl_msafile_stockholm_Read()>.
+ *            The rest of that record can't be read.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslESYS> if a system call fails, such as fread().
+ */
+int
+esl_msafile_stockholm_StreamNext(ESL_STOCKHOLM_STREAM *sst)
+{
+  ESL_MSAFILE *afp = sst->afp;
+  char        *p;
+  esl_pos_t    n;
+  int          status;
+
+  if (! sst->pd)   /* starting a new record */
+    {
+      afp->errmsg[0] = '\0';
+      esl_msa_Destroy(sst->msa);
+      sst->msa = NULL;
+      if ((status = stockholm_begin(afp, &(sst->msa), &(sst->pd))) != eslOK) goto ERROR; /* (eslEOF) */
+      sst->pd->sst = sst;
+    }
+
+  while ( (status = esl_msafile_GetLine(afp, &p, &n)) == eslOK) /* (eslEOF) [eslEMEM|eslESYS] */
+    {
+      while (n && ( *p == ' ' || *p == '\t')) { p++; n--; } /* skip leading whitespace */
+
+      if (!n || esl_memstrpfx(p, n, "//"))
+	{
+	  if (sst->pd->in_block && (status = stockholm_end_block(afp, sst->pd, sst->msa)) != eslOK) goto ERROR;
+	  if (esl_memstrpfx(p, n, "//"))
+	    {
+	      if ((status = stockholm_end_record(afp, sst->pd, sst->msa)) != eslOK) goto ERROR;
+	      stockholm_parsedata_Destroy(sst->pd, sst->msa);
+	      sst->pd = NULL;
+	      return eslEOD;
+	    }
+	  continue;
+	}
+
+      if (*p == '#') 
+	{
+	  if      (esl_memstrpfx(p, n, "#=GF")) { if ((status = stockholm_parse_gf(afp, sst->pd, sst->msa, p, n)) != eslOK) goto ERROR; }
+	  else if (esl_memstrpfx(p, n, "#=GS")) { if ((status = stockholm_parse_gs(afp, sst->pd, sst->msa, p, n)) != eslOK) goto ERROR; }
+	  else if (esl_memstrpfx(p, n, "#=GC")) { if ((sst->keep & eslSTOCKHOLM_KEEP_GC) && (status = stockholm_parse_gc(afp, sst->pd, sst->msa, p, n)) != eslOK) goto ERROR; }
+	  else if (esl_memstrpfx(p, n, "#=GR")) {
+	    if (sst->keep & eslSTOCKHOLM_KEEP_GR) {
+	      if ((status = stockholm_parse_gr(afp, sst->pd, sst->msa, p, n)) != eslOK) goto ERROR;
+	      return eslOK;
+	    }
+	  }
+	  else if (esl_memstrcmp(p, n, "# STOCKHOLM 1.0")) ESL_XFAIL(eslEFORMAT, afp->errmsg, "two # STOCKHOLM 1.0 headers in a row?");
+	  else                                  { if ((status = stockholm_parse_comment(sst->msa, p, n)) != eslOK) goto ERROR; }
+	}
+      else
+	{
+	  if ((status = stockholm_parse_sq(afp, sst->pd, sst->msa, p, n)) != eslOK) goto ERROR;
+	  return eslOK;
+	}
+    }
+  if (status == eslEOF) ESL_XFAIL(eslEFORMAT, afp->errmsg, "missing // terminator after MSA");
+
+ ERROR:
+  stockholm_parsedata_Destroy(sst->pd, sst->msa);
+  sst->pd = NULL;
+  return status;
+}
+
+
+/* Function:  esl_msafile_stockholm_StreamDestroy()
+ * Synopsis:  Free a Stockholm stream.
+ */
+void
+esl_msafile_stockholm_StreamDestroy(ESL_STOCKHOLM_STREAM *sst)
+{
+  if (sst)
+    {
+      stockholm_parsedata_Destroy(sst->pd, sst->msa);
+      esl_msa_Destroy(sst->msa);
+      free(sst->dsq);
+      free(sst->text);
+      free(sst);
+    }
+}
+
+
 /* Function:  esl_msafile_stockholm_Write()
  * Synopsis:  Write a Stockholm format alignment to a stream.
  *
@@ -409,6 +572,7 @@ stockholm_parsedata_Create(ESL_MSA *msa)
   pd->ogc_len       = NULL;
   pd->ogr_len       = NULL;
   pd->salloc        = 0;
+  pd->sst           = NULL;
 
   ESL_ALLOC(pd->blinetype, sizeof(char) * 16);
   ESL_ALLOC(pd->bidx,      sizeof(int)  * 16);
@@ -514,6 +678,142 @@ stockholm_parsedata_Destroy(ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa)
  * 3. Internal: parsing Stockholm line types
  *****************************************************************/ 
 
+/* stockholm_begin()
+ * Start reading a new alignment record: create a growable <msa>, and
+ * its parse data, and read past any blank lines and comments to the
+ * # STOCKHOLM header. Returns <eslEOF> if there's no more data,
+ * <eslEFORMAT> if the header is missing; on any error, <*ret_msa>
+ * and <*ret_pd> are NULL.
+ */
+static int
+stockholm_begin(ESL_MSAFILE *afp, ESL_MSA **ret_msa, ESL_STOCKHOLM_PARSEDATA **ret_pd)
+{
+  ESL_MSA                 *msa = NULL;
+  ESL_STOCKHOLM_PARSEDATA *pd  = NULL;
+  char                    *p;
+  esl_pos_t                n;
+  int                      status;
+
+  /* Allocate a growable MSA, and auxiliary parse data coupled to the MSA allocation */
+  if (afp->abc   &&  (msa = esl_msa_CreateDigital(afp->abc, 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+  if (! afp->abc &&  (msa = esl_msa_Create(                 16, -1)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ( (pd = stockholm_parsedata_Create(msa))                        == NULL) { status = eslEMEM; goto ERROR; }
+
+  /* Skip leading blank lines in file. EOF here is a normal EOF return. */
+  do { 
+    if ( ( status = esl_msafile_GetLine(afp, &p, &n)) != eslOK) goto ERROR;  /* eslEOF is OK here - end of input (eslEOF) [eslEMEM|eslESYS] */
+  } while (esl_memspn(afp->line, afp->n, " \t") == afp->n ||                  /* skip blank lines             */
+	   (esl_memstrpfx(afp->line, afp->n, "#")                             /* and skip comment lines       */
+	    && ! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM")));           /* but stop on Stockholm header */
+
+  /* Check for the magic Stockholm header */
+  if (! esl_memstrpfx(afp->line, afp->n, "# STOCKHOLM 1."))  ESL_XFAIL(eslEFORMAT, afp->errmsg, "missing Stockholm header");
+
+  *ret_msa = msa;
+  *ret_pd  = pd;
+  return eslOK;
+
+ ERROR:
+  if (pd)  stockholm_parsedata_Destroy(pd, msa);
+  if (msa) esl_msa_Destroy(msa);
+  *ret_msa = NULL;
+  *ret_pd  = NULL;
+  return status;
+}
+
+/* stockholm_end_block()
+ * A blank line or // ends the current block: check that it has the
+ * expected numbers of seqs and lines, and add its width to the
+ * alignment length.
+ */
+static int
+stockholm_end_block(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa)
+{
+  if (pd->nblock) { if (pd->nseq_b != pd->nseq) ESL_FAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number in earlier block(s)");     }
+  else            { if (pd->nseq_b < pd->nseq)  ESL_FAIL(eslEFORMAT, afp->errmsg, "number of seqs in block did not match number annotated by #=GS lines"); };
+  if (pd->nblock) { if (pd->bi != pd->npb)      ESL_FAIL(eslEFORMAT, afp->errmsg, "unexpected number of lines in alignment block"); }
+
+  pd->nseq     = msa->nseq = pd->nseq_b;
+  pd->alen    += pd->alen_b;
+  pd->in_block = FALSE;
+  pd->npb      = pd->bi;
+  pd->bi       = 0;
+  pd->si       = 0;
+  pd->nblock  += 1;
+  pd->nseq_b   = 0;
+  pd->alen_b   = 0;
+  return eslOK;
+}
+
+/* stockholm_end_record()
+ * At the // that ends a record, set the alignment length, and the
+ * weights: if any #=GS WT weights were set, all must be.
+ */
+static int
+stockholm_end_record(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa)
+{
+  int idx;
+  int status;
+
+  if (pd->nblock == 0)       ESL_FAIL(eslEFORMAT, afp->errmsg, "no alignment data followed Stockholm header");
+
+  msa->alen = pd->alen;
+
+  /* Stockholm file can set weights. If eslMSA_HASWGTS flag is up, at least one was set: then all must be. */
+  if (msa->flags & eslMSA_HASWGTS)
+    {
+      for (idx = 0; idx < msa->nseq; idx++)
+	if (msa->wgt[idx] == -1.0) ESL_FAIL(eslEFORMAT, afp->errmsg, "stockholm record ended without a weight for %s", msa->sqname[idx]);
+    }
+  else if (( status = esl_msa_SetDefaultWeights(msa)) != eslOK) return status;
+  return eslOK;
+}
+
+/* stockholm_stream_set()
+ * When streaming, put aligned seq or GR line <p>,<n> in the stream,
+ * instead of appending it to the <msa>: digitized (or mapped) if it's
+ * a seq, copied verbatim if it's annotation.
+ */
+static int
+stockholm_stream_set(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, int linetype, int idx, const char *tag, char *p, esl_pos_t n)
+{
+  ESL_STOCKHOLM_STREAM *sst = pd->sst;
+  int64_t               L   = 0;
+  int                   status;
+
+  if (n + 2 > sst->nalloc)
+    {
+      ESL_REALLOC(sst->text,  sizeof(char)    * (n+2));
+      if (afp->abc) ESL_REALLOC(sst->dsq, sizeof(ESL_DSQ) * (n+2));
+      sst->nalloc = n+2;
+    }
+
+  if (linetype == eslSTOCKHOLM_STREAM_GR) 
+    {
+      memcpy(sst->text, p, n);
+      sst->text[n] = '\0';
+    }
+  else 
+    {
+      if (afp->abc) { sst->dsq[0] = eslDSQ_SENTINEL; status = esl_abc_dsqcat_noalloc(afp->inmap, sst->dsq,  &L, p, n); }
+      else          {                                status = esl_strmapcat_noalloc (afp->inmap, sst->text, &L, p, n); }
+      if      (status == eslEINVAL) ESL_FAIL(eslEFORMAT, afp->errmsg, "invalid sequence character(s) on line");
+      else if (status != eslOK)     return status;
+    }
+
+  sst->linetype = linetype;
+  sst->idx      = idx;
+  sst->tag      = tag;
+  sst->block    = pd->nblock;
+  sst->apos     = pd->alen + 1;
+  sst->n        = (linetype == eslSTOCKHOLM_STREAM_GR ? n : L);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
 /* stockholm_parse_gf()
  * Line format is:
  *   #=GF <tag> <text>
@@ -624,6 +924,12 @@ stockholm_parse_gs(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
     stockholm_get_seqidx(msa, pd, seqname, seqnamelen, &seqidx);
   }
 
+  if (pd->sst && ! (pd->sst->keep & eslSTOCKHOLM_KEEP_GS) && ! esl_memstrcmp(tag, taglen, "WT"))
+    { /* streaming, and not keeping GS annotation; but we still need weights */
+      pd->si = seqidx+1;
+      return eslOK;
+    }
+
   if (esl_memstrcmp(tag, taglen, "WT")) 
     {
       if (esl_memtok(&p, &n, " \t", &tok, &toklen) != eslOK) ESL_FAIL(eslEFORMAT, afp->errmsg, "no weight value found on #=GS <seqname> WT line");
@@ -753,6 +1059,7 @@ stockholm_parse_gr(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
   char      *gr,   *name,    *tag;
   esl_pos_t  grlen, namelen,  taglen;
   int        seqidx, tagidx;
+  const char *grtag = NULL;
   int        z;
   int        status;
 
@@ -797,47 +1104,52 @@ stockholm_parse_gr(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
   /* Append the annotation where it belongs  */
   if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GR_SS)
     {
-      if (! msa->ss) {
-	ESL_ALLOC(msa->ss,   sizeof(char *)  * msa->sqalloc);
+      if (! pd->sslen) {   /* when streaming, we need the lengths but not the annotation */
+	if (! pd->sst) ESL_ALLOC(msa->ss, sizeof(char *)  * msa->sqalloc);
 	ESL_ALLOC(pd->sslen, sizeof(int64_t) * msa->sqalloc);
-	for (z = 0; z < msa->sqalloc; z++) { msa->ss[z] = NULL; pd->sslen[z] = 0; }
+	for (z = 0; z < msa->sqalloc; z++) { if (msa->ss) msa->ss[z] = NULL; pd->sslen[z] = 0; }
       }
       if (pd->sslen[seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s SS line in block", (int) namelen, name);
-      if (( status = esl_strcat(&(msa->ss[seqidx]), pd->sslen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! pd->sst && (status = esl_strcat(&(msa->ss[seqidx]), pd->sslen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->sslen[seqidx] += n;
+      grtag = "SS";
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GR_PP)
     {
-      if (! msa->pp) {
-	ESL_ALLOC(msa->pp,   sizeof(char *)  * msa->sqalloc);
+      if (! pd->pplen) {   /* when streaming, we need the lengths but not the annotation */
+	if (! pd->sst) ESL_ALLOC(msa->pp, sizeof(char *)  * msa->sqalloc);
 	ESL_ALLOC(pd->pplen, sizeof(int64_t) * msa->sqalloc);
-	for (z = 0; z < msa->sqalloc; z++) { msa->pp[z] = NULL; pd->pplen[z] = 0; }
+	for (z = 0; z < msa->sqalloc; z++) { if (msa->pp) msa->pp[z] = NULL; pd->pplen[z] = 0; }
       }
       if (pd->pplen[seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s PP line in block", (int) namelen, name);
-      if ((status = esl_strcat(&(msa->pp[seqidx]), pd->pplen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
+      if (! pd->sst && (status = esl_strcat(&(msa->pp[seqidx]), pd->pplen[seqidx], p, n)) != eslOK) return status; /* [eslEMEM] */
       pd->pplen[seqidx] += n;
+      grtag = "PP";
     }
   else if (pd->blinetype[pd->bi] == eslSTOCKHOLM_LINE_GR_SA)
     {
-      if (! msa->sa) {
-	ESL_ALLOC(msa->sa,   sizeof(char *)  * msa->sqalloc);
+      if (! pd->salen) {   /* when streaming, we need the lengths but not the annotation */
+	if (! pd->sst) ESL_ALLOC(msa->sa, sizeof(char *)  * msa->sqalloc);
 	ESL_ALLOC(pd->salen, sizeof(int64_t) * msa->sqalloc);
-	for (z = 0; z < msa->sqalloc; z++) { msa->sa[z] = NULL; pd->salen[z] = 0; }
+	for (z = 0; z < msa->sqalloc; z++) { if (msa->sa) msa->sa[z] = NULL; pd->salen[z] = 0; }
       }
       if (pd->salen[seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s SA line in block", (int) namelen, name);
-      if ((status = esl_strcat(&(msa->sa[seqidx]), pd->salen[seqidx], p, n)) != eslOK) return status;
+      if (! pd->sst && (status = esl_strcat(&(msa->sa[seqidx]), pd->salen[seqidx], p, n)) != eslOK) return status;
       pd->salen[seqidx] += n;
+      grtag = "SA";
     }
   else
     {
       if ((status = stockholm_get_gr_tagidx(msa, pd, tag, taglen, &tagidx)) != eslOK) return status; /* [eslEMEM] */
 
       if (pd->ogr_len[tagidx][seqidx] != pd->alen) ESL_FAIL(eslEFORMAT, afp->errmsg, "more than one #=GR %.*s %.*s line in block", (int) namelen, name, (int) taglen, tag);
-      if ((status = esl_strcat(&(msa->gr[tagidx][seqidx]), pd->ogr_len[tagidx][seqidx], p, n)) != eslOK) return status;
+      if (! pd->sst && (status = esl_strcat(&(msa->gr[tagidx][seqidx]), pd->ogr_len[tagidx][seqidx], p, n)) != eslOK) return status;
       pd->ogr_len[tagidx][seqidx] += n;
+      grtag = msa->gr_tag[tagidx];
     }
 
   if (pd->bi && n != pd->alen_b) ESL_FAIL(eslEFORMAT, afp->errmsg, "unexpected # of aligned annotation in #=GR %.*s %.*s line", (int) namelen, name, (int) taglen, tag); 
+  if (pd->sst && (status = stockholm_stream_set(afp, pd, eslSTOCKHOLM_STREAM_GR, seqidx, grtag, p, n)) != eslOK) return status;
   pd->alen_b   = n;
   pd->in_block = TRUE;
   pd->bi++;
@@ -894,13 +1206,18 @@ stockholm_parse_sq(ESL_MSAFILE *afp, ESL_STOCKHOLM_PARSEDATA *pd, ESL_MSA *msa,
 
   if ( pd->bi > 0 && pd->sqlen[seqidx] == pd->alen + pd->alen_b) ESL_FAIL(eslEFORMAT, afp->errmsg, "duplicate seq name %.*s", (int) seqnamelen, seqname);
 
-  if (  afp->abc ) {
+  if ( pd->sst ) {		/* streaming: the line goes to the stream, not the msa */
+    if ((status = stockholm_stream_set(afp, pd, eslSTOCKHOLM_STREAM_SQ, seqidx, NULL, p, n)) != eslOK) return status;
+    pd->sqlen[seqidx] += pd->sst->n;
+  }
+
+  if (  afp->abc && ! pd->sst ) {
     status = esl_abc_dsqcat(afp->inmap, &(msa->ax[seqidx]),   &(pd->sqlen[seqidx]), p, n);
     if      (status == eslEINVAL) ESL_FAIL(eslEFORMAT, afp->errmsg, "invalid sequence character(s) on line");
     else if (status != eslOK)     return status;
   }
 
-  if (! afp->abc) {
+  if (! afp->abc && ! pd->sst) {
     status = esl_strmapcat (afp->inmap, &(msa->aseq[seqidx]), &(pd->sqlen[seqidx]), p, n);
     if      (status == eslEINVAL) ESL_FAIL(eslEFORMAT, afp->errmsg, "invalid sequence character(s) on line");
     else if (status != eslOK)     return status;
@@ -2437,6 +2754,145 @@ utest_bad_read(ESL_ALPHABET **byp_abc, int fmt, char *expected_errmsg, int expec
   esl_msa_Destroy(msa);
   esl_msafile_Close(afp);
 }
+/* Streaming a good file, keeping all annotation, must give the same
+ * alignment as reading it whole; and without keeping annotation, the
+ * same names and weights.
+ */
+static void
+utest_stream_goodfile(char *filename, int testnumber)
+{
+  ESL_ALPHABET         *abc  = NULL;
+  ESL_MSAFILE          *afp  = NULL;
+  ESL_STOCKHOLM_STREAM *sst  = NULL;
+  ESL_MSA              *msa1 = NULL;
+  ESL_MSA              *msa2 = NULL;
+  char                 *ann;
+  int                   idx, t;
+  int                   nline;
+  int                   status;
+
+  if (esl_msafile_Open(&abc, filename, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal("stockholm stream test %d failed: open",  testnumber);
+  if (esl_msafile_stockholm_Read(afp, &msa1)                                   != eslOK) esl_fatal("stockholm stream test %d failed: read",  testnumber);
+  esl_msafile_Close(afp);
+
+  /* Stream it, keeping everything; rebuild the aligned seqs in <msa2> */
+  if (esl_msafile_Open(&abc, filename, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal("stockholm stream test %d failed: open",  testnumber);
+  if (esl_msafile_stockholm_StreamCreate(afp, eslSTOCKHOLM_KEEP_GS | eslSTOCKHOLM_KEEP_GC | eslSTOCKHOLM_KEEP_GR, &sst) != eslOK) esl_fatal("stockholm stream test %d failed: create", testnumber);
+  if ((msa2 = esl_msa_CreateDigital(abc, msa1->nseq, msa1->alen)) == NULL) esl_fatal("stockholm stream test %d failed: msa create", testnumber);
+  while ((status = esl_msafile_stockholm_StreamNext(sst)) == eslOK)
+    {
+      if (sst->idx < 0 || sst->idx >= msa1->nseq || sst->apos + sst->n - 1 > msa1->alen) esl_fatal("stockholm stream test %d failed: bad coords", testnumber);
+      if (sst->linetype == eslSTOCKHOLM_STREAM_SQ)
+	{
+	  if (sst->tag != NULL) esl_fatal("stockholm stream test %d failed: seq line with tag", testnumber);
+	  memcpy(msa2->ax[sst->idx] + sst->apos, sst->dsq + 1, sst->n);
+	}
+      else
+	{
+	  if      (strcmp(sst->tag, "SS") == 0) ann = msa1->ss[sst->idx];
+	  else if (strcmp(sst->tag, "SA") == 0) ann = msa1->sa[sst->idx];
+	  else if (strcmp(sst->tag, "PP") == 0) ann = msa1->pp[sst->idx];
+	  else {
+	    for (t = 0; t < msa1->ngr; t++) if (strcmp(sst->tag, msa1->gr_tag[t]) == 0) break;
+	    if (t == msa1->ngr) esl_fatal("stockholm stream test %d failed: unknown GR tag", testnumber);
+	    ann = msa1->gr[t][sst->idx];
+	  }
+	  if (ann == NULL || strncmp(ann + sst->apos - 1, sst->text, sst->n) != 0) esl_fatal("stockholm stream test %d failed: GR line", testnumber);
+	}
+    }
+  if (status != eslEOD) esl_fatal("stockholm stream test %d failed: expected EOD", testnumber);
+
+  if (sst->msa->nseq != msa1->nseq || sst->msa->alen != msa1->alen)   esl_fatal("stockholm stream test %d failed: nseq/alen",  testnumber);
+  for (idx = 0; idx < msa1->nseq; idx++)
+    {
+      if (strcmp(sst->msa->sqname[idx], msa1->sqname[idx]) != 0)      esl_fatal("stockholm stream test %d failed: names",      testnumber);
+      if (esl_DCompare(sst->msa->wgt[idx], msa1->wgt[idx], 1e-6) != eslOK) esl_fatal("stockholm stream test %d failed: weights", testnumber);
+      if (memcmp(msa2->ax[idx] + 1, msa1->ax[idx] + 1, msa1->alen) != 0) esl_fatal("stockholm stream test %d failed: seqs", testnumber);
+    }
+  if (esl_CCompare(sst->msa->ss_cons, msa1->ss_cons) != eslOK)        esl_fatal("stockholm stream test %d failed: GC",         testnumber);
+  if (sst->msa->ngc != msa1->ngc || sst->msa->ngs != msa1->ngs)       esl_fatal("stockholm stream test %d failed: GC/GS tags", testnumber);
+  if (esl_msafile_stockholm_StreamNext(sst) != eslEOF)                esl_fatal("stockholm stream test %d failed: expected EOF", testnumber);
+  esl_msafile_stockholm_StreamDestroy(sst);
+  esl_msafile_Close(afp);
+
+  /* Stream it again, keeping nothing. */
+  if (esl_msafile_Open(&abc, filename, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal("stockholm stream test %d failed: open",  testnumber);
+  if (esl_msafile_stockholm_StreamCreate(afp, 0, &sst) != eslOK) esl_fatal("stockholm stream test %d failed: create", testnumber);
+  nline = 0;
+  while ((status = esl_msafile_stockholm_StreamNext(sst)) == eslOK)
+    {
+      if (sst->linetype != eslSTOCKHOLM_STREAM_SQ) esl_fatal("stockholm stream test %d failed: unkept GR returned", testnumber);
+      nline++;
+    }
+  if (status != eslEOD || nline == 0)                                 esl_fatal("stockholm stream test %d failed: expected EOD", testnumber);
+  if (sst->msa->nseq != msa1->nseq || sst->msa->alen != msa1->alen)   esl_fatal("stockholm stream test %d failed: nseq/alen",  testnumber);
+  for (idx = 0; idx < msa1->nseq; idx++)
+    if (esl_DCompare(sst->msa->wgt[idx], msa1->wgt[idx], 1e-6) != eslOK) esl_fatal("stockholm stream test %d failed: weights", testnumber);
+  if (sst->msa->ss_cons || sst->msa->ngc || sst->msa->ngs || sst->msa->ss)  esl_fatal("stockholm stream test %d failed: kept unkept annotation", testnumber);
+  esl_msafile_stockholm_StreamDestroy(sst);
+  esl_msafile_Close(afp);
+
+  esl_msa_Destroy(msa1);
+  esl_msa_Destroy(msa2);
+  esl_alphabet_Destroy(abc);
+}
+
+/* Streaming a bad file, keeping all annotation, must fail the same way as reading it. */
+static void
+utest_stream_bad_format(char *filename, int testnumber, int expected_linenumber, char *expected_errmsg)
+{
+  ESL_ALPHABET         *abc = esl_alphabet_Create(eslAMINO);
+  ESL_MSAFILE          *afp = NULL;
+  ESL_STOCKHOLM_STREAM *sst = NULL;
+  int                   status;
+  
+  if ( (status = esl_msafile_Open(&abc, filename, NULL, eslMSAFILE_STOCKHOLM, NULL, &afp)) != eslOK)  esl_fatal("stockholm stream bad format test %d failed: unexpected open failure", testnumber);
+  if ( esl_msafile_stockholm_StreamCreate(afp, eslSTOCKHOLM_KEEP_GS | eslSTOCKHOLM_KEEP_GC | eslSTOCKHOLM_KEEP_GR, &sst) != eslOK) esl_fatal("stockholm stream bad format test %d failed: create", testnumber);
+  while ((status = esl_msafile_stockholm_StreamNext(sst)) == eslOK || status == eslEOD) ;
+  if (status != eslEFORMAT)                                                          esl_fatal("stockholm stream bad format test %d failed: unexpected error code",   testnumber);
+  if (strstr(afp->errmsg, expected_errmsg) == NULL)                                  esl_fatal("stockholm stream bad format test %d failed: unexpected errmsg",       testnumber);
+  if (afp->linenumber != expected_linenumber)                                        esl_fatal("stockholm stream bad format test %d failed: unexpected linenumber",   testnumber);
+  esl_msafile_stockholm_StreamDestroy(sst);
+  esl_msafile_Close(afp);
+  esl_alphabet_Destroy(abc);
+}
+
+/* A stream of two records, in text mode; only SQ lines, two blocks in the second */
+static void
+utest_stream_records(void)
+{
+  char                  msg[] = "stockholm stream records test failed";
+  char                  buf[] = "# STOCKHOLM 1.0\n\nseq1 ACDEFGHIKL\nseq2 ACDEF-HIKL\n//\n# STOCKHOLM 1.0\n\nx AC\ny A-\nz AC\n\nx GH\ny GH\nz G.\n//\n";
+  ESL_MSAFILE          *afp   = NULL;
+  ESL_STOCKHOLM_STREAM *sst   = NULL;
+  int                   nline = 0;
+  int                   status;
+
+  if (esl_msafile_OpenMem(NULL, buf, strlen(buf), eslMSAFILE_STOCKHOLM, NULL, &afp) != eslOK) esl_fatal(msg);
+  if (esl_msafile_stockholm_StreamCreate(afp, 0, &sst)                             != eslOK) esl_fatal(msg);
+
+  while ((status = esl_msafile_stockholm_StreamNext(sst)) == eslOK) 
+    {
+      if (sst->block != 0 || sst->apos != 1 || sst->n != 10) esl_fatal(msg);
+      if (sst->idx == 1 && strcmp(sst->text, "ACDEF-HIKL") != 0) esl_fatal(msg);
+      nline++;
+    }
+  if (status != eslEOD || nline != 2 || sst->msa->nseq != 2 || sst->msa->alen != 10) esl_fatal(msg);
+
+  nline = 0;
+  while ((status = esl_msafile_stockholm_StreamNext(sst)) == eslOK) 
+    {
+      if (sst->n != 2 || sst->apos != 1 + 2*sst->block) esl_fatal(msg);
+      if (sst->idx == 2 && sst->block == 1 && strcmp(sst->text, "G.") != 0) esl_fatal(msg);
+      nline++;
+    }
+  if (status != eslEOD || nline != 6 || sst->msa->nseq != 3 || sst->msa->alen != 4)  esl_fatal(msg);
+  if (strcmp(sst->msa->sqname[2], "z") != 0)                                          esl_fatal(msg);
+  if (esl_msafile_stockholm_StreamNext(sst) != eslEOF)                                esl_fatal(msg);
+
+  esl_msafile_stockholm_StreamDestroy(sst);
+  esl_msafile_Close(afp);
+}
 #endif /*eslMSAFILE_STOCKHOLM_TESTDRIVE*/
 /*----------------- end, unit tests -----------------------------*/
 
@@ -2493,6 +2949,8 @@ main(int argc, char **argv)
 
   utest_identical_io(NULL, eslMSAFILE_UNKNOWN, "# STOCKHOLM 1.0\n\nseq1 ACDEFGHIKL\nseq2 ACDEFGHIKL\n//\n");
 
+  utest_stream_records();
+
   /* Various "good" files, that should be parsed correctly. */
   for (testnumber = 1; testnumber <= ngoodtests; testnumber++)
     {
@@ -2503,6 +2961,7 @@ main(int argc, char **argv)
       }
       fclose(ofp);
       utest_goodfile(tmpfile, testnumber, expected_alphatype, expected_nseq, expected_alen);
+      utest_stream_goodfile(tmpfile, testnumber);
       remove(tmpfile);
     }
 
@@ -2582,6 +3041,7 @@ main(int argc, char **argv)
       fclose(ofp);
       
       utest_bad_format(tmpfile, testnumber, expected_linenumber, expected_errmsg);
+      utest_stream_bad_format(tmpfile, testnumber, expected_linenumber, expected_errmsg);
       remove(tmpfile);
     }
 
@@ -8,10 +8,41 @@
 
 #include <esl_msafile.h>
 
+/* Reading a Stockholm file one aligned line at a time */
+#define eslSTOCKHOLM_KEEP_GS   (1<<0)   /* store #=GS annotation in the stream's msa    */
+#define eslSTOCKHOLM_KEEP_GC   (1<<1)   /* store #=GC annotation in the stream's msa    */
+#define eslSTOCKHOLM_KEEP_GR   (1<<2)   /* return #=GR lines, as well as sequence lines */
+
+#define eslSTOCKHOLM_STREAM_SQ 1        /* line is an aligned sequence  */
+#define eslSTOCKHOLM_STREAM_GR 2        /* line is #=GR annotation      */
+
+typedef struct {
+  ESL_MSAFILE *afp;             /* open Stockholm or Pfam file (not owned)                  */
+  int          keep;            /* eslSTOCKHOLM_KEEP_* flags                                 */
+  ESL_MSA     *msa;             /* current record: names, weights, GF, comments, kept GS/GC; */
+                                /*   no aligned seqs. Caller may take it at eslEOD.          */
+
+  int          linetype;        /* eslSTOCKHOLM_STREAM_SQ | eslSTOCKHOLM_STREAM_GR           */
+  int          idx;             /* which seq, 0..nseq-1                                      */
+  const char  *tag;             /* GR tag; NULL for a seq line                               */
+  int          block;           /* which Stockholm block, 0..                                */
+  int64_t      apos;            /* line covers columns apos..apos+n-1                        */
+  int64_t      n;               /* number of columns on the line                             */
+  ESL_DSQ     *dsq;             /* digital seq line: dsq[1..n]                               */
+  char        *text;            /* text mode seq line, or GR annotation: text[0..n-1]        */
+  int64_t      nalloc;          /* current allocation of dsq, text                           */
+
+  struct esl_stockholm_parsedata_s *pd;   /* parser state; NULL between records              */
+} ESL_STOCKHOLM_STREAM;
+
 extern int esl_msafile_stockholm_SetInmap     (ESL_MSAFILE *afp);
 extern int esl_msafile_stockholm_GuessAlphabet(ESL_MSAFILE *afp, int *ret_type);
 extern int esl_msafile_stockholm_Read         (ESL_MSAFILE *afp, ESL_MSA **ret_msa);
 extern int esl_msafile_stockholm_Write        (FILE *fp, const ESL_MSA *msa, int fmt);
 
+extern int  esl_msafile_stockholm_StreamCreate (ESL_MSAFILE *afp, int keep, ESL_STOCKHOLM_STREAM **ret_sst);
+extern int  esl_msafile_stockholm_StreamNext   (ESL_STOCKHOLM_STREAM *sst);
+extern void esl_msafile_stockholm_StreamDestroy(ESL_STOCKHOLM_STREAM *sst);
+
 #endif /*eslMSAFILE_STOCKHOLM_INCLUDED*/
 
@@ -30,6 +30,9 @@
 #include <math.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -56,11 +59,33 @@
  *   mode alignments; text mode PB algorithm remains as it was.
  */
 
+/* PB_JOB
+ * One thread's share of a pass over the column-major view: either
+ * count columns cols[c0..c1-1] (all of 1..alen if <cols> is NULL,
+ * c0..c1-1 then being 0-offset apos-1) into <ct>, or accumulate PB
+ * weight increments for seqs i0..i1-1 over the <ncons> consensus
+ * columns, from reciprocal tables <pbt>.
+ */
+typedef struct {
+  const ESL_MSA_COLS *cm;
+  const int          *cols;   // consensus column list, or NULL
+  int                 c0, c1;
+  int               **ct;     // counting: RESULT ct[apos][a]
+  int                 ncons;  // accumulation: # of consensus cols in <cols>
+  const double       *pbt;    //   pbt[j*Kp+a]: increment for symbol a in consensus col j
+  int                 i0, i1;
+  double             *wgt;    //   RESULT: wgt[i0..i1-1], summed increments
+  int                *rlen;   //   RESULT: rlen[i0..i1-1], # canonical residues in consensus cols
+} PB_JOB;
+
 static int  consensus_by_rf    (const ESL_MSA *msa, int *conscols, int *ret_ncons, ESL_MSAWEIGHT_DAT *dat);
 static int  consensus_by_sample(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, int **ct, int *conscols, int *ret_ncons, ESL_MSAWEIGHT_DAT *dat);
 static int  consensus_by_all   (const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, int **ct, int *conscols, int *ret_ncons, ESL_MSAWEIGHT_DAT *dat);
-static int  collect_counts     (const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, const int *conscols, int ncons, int **ct, ESL_MSAWEIGHT_DAT *dat);
+static int  collect_counts     (const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, const ESL_MSA_COLS *cm, const int *conscols, int ncons, int **ct, ESL_MSAWEIGHT_DAT *dat);
 static int  msaweight_PB_txt(ESL_MSA *msa);
+static void *pb_count_job(void *arg);
+static void *pb_wgt_job  (void *arg);
+static void  pb_run      (void *(*func)(void *), PB_JOB *job, int njobs);
 
 /* Function:  esl_msaweight_PB()
  * Synopsis:  PB (position-based) weights.
@@ -156,6 +181,14 @@ esl_msaweight_PB(ESL_MSA *msa)
  *            MSAs, and can optionally take customized parameters
  *            <cfg>, and optionally collect data about the computation
  *            in <dat>.
+ *
+ *            <cfg->nthreads> sets the number of threads used for the
+ *            two passes over the alignment: columns are divided among
+ *            threads to count residues, then sequences are divided
+ *            among them to sum up weight increments. The weights
+ *            don't depend on it. With threads, it's affordable to
+ *            turn off <cfg->allow_samp> and define consensus columns
+ *            from every sequence of a very deep alignment.
  *            
  * Args:      cfg - optional customized parameters, or NULL to use defaults.
  *            msa - MSA to weight; weights stored in msa->wgt[]
@@ -174,12 +207,18 @@ esl_msaweight_PB_adv(const ESL_MSAWEIGHT_CFG *cfg, ESL_MSA *msa, ESL_MSAWEIGHT_D
   int   ignore_rf   = (cfg? cfg->ignore_rf  : eslMSAWEIGHT_IGNORE_RF);      // default is FALSE: use RF annotation as consensus definition, if RF is present
   int   allow_samp  = (cfg? cfg->allow_samp : eslMSAWEIGHT_ALLOW_SAMP);     // default is TRUE: allow subsampling speed optimization
   int   sampthresh  = (cfg? cfg->sampthresh : eslMSAWEIGHT_SAMPTHRESH);     // if nseq > sampthresh, try to determine consensus on a subsample of seqs
+  int   nthreads    = (cfg? cfg->nthreads   : eslMSAWEIGHT_NTHREADS);       // default is 0: both passes in the caller
+  ESL_MSA_COLS *cm  = NULL;     // column-major view of the MSA: both count and weight passes go column by column
   int **ct          = NULL;     // matrix of symbol counts in each column. ct[apos=(0).1..alen][a=0..Kp-1]
   int  *r           = NULL;     // number of different canonical residues used in each consensus column. r[j=0..ncons-1]
   int  *conscols    = NULL;     // list of consensus column indices [0..ncons-1]
   int   ncons       = 0;        // number of consensus column indices in <conscols> list
-  int   idx, apos, j, a;        // indices over sequences, original columns, consensus columns, symbols
-  int   rlen;                   // number of canonical residues in a seq; used for first PB normalization
+  int  *rlen        = NULL;     // number of canonical residues in each seq, in consensus columns; used for first PB normalization
+  double *pbt       = NULL;     // PB weight increment for each symbol in each consensus column: pbt[j*Kp+a]
+  PB_JOB *job       = NULL;     // each thread's share of the sequences
+  int   njobs       = ESL_MAX(1, nthreads);
+  int   Kp          = msa->abc->Kp;
+  int   idx, apos, j, a, t;     // indices over sequences, original columns, consensus columns, symbols, jobs
   int   status = eslOK;
 
   /* Contract checks & bailouts */
@@ -190,13 +229,15 @@ esl_msaweight_PB_adv(const ESL_MSAWEIGHT_CFG *cfg, ESL_MSA *msa, ESL_MSAWEIGHT_D
   /* Allocations */
   ct = esl_mat_ICreate( msa->alen+1, msa->abc->Kp );      // (0).1..alen; 0..Kp-1
   ESL_ALLOC(conscols, sizeof(int) * msa->alen);
+  ESL_ALLOC(rlen,     sizeof(int) * msa->nseq);
+  if ((status = esl_msa_cols_Create(msa, &cm)) != eslOK) goto ERROR;
 
   /* Determine consensus columns early if we can. (ncons stays = 0 if neither way gets used.) */
   if      (! ignore_rf && msa->rf)                consensus_by_rf(msa, conscols, &ncons, dat);
   else if (allow_samp  && msa->nseq > sampthresh) consensus_by_sample(cfg, msa, ct, conscols, &ncons, dat);
 
   /* Collect count matrix ct[apos][a]  (either all columns, or if we have consensus already, only consensus columns) */
-  collect_counts(cfg, msa, conscols, ncons, ct, dat);
+  collect_counts(cfg, msa, cm, conscols, ncons, ct, dat);
 
   /* If we still haven't determined consensus columns yet, do it now, using <ct> */
   if (! ncons) consensus_by_all(cfg, msa, ct, conscols, &ncons, dat);
@@ -219,20 +260,37 @@ esl_msaweight_PB_adv(const ESL_MSAWEIGHT_CFG *cfg, ESL_MSA *msa, ESL_MSAWEIGHT_D
 	if (ct[apos][a] > 0) r[j]++;
     }
 
-  /* Bump sequence weights using PB weighting rule */
+  /* Bump sequence weights using PB weighting rule, one consensus
+   * column at a time: the increment for each symbol is a table
+   * lookup, so there's no division per residue. Sequences are divided
+   * among threads in blocks of whole cache lines. Each seq's weight
+   * still sums its increments in column order, as a row-by-row pass
+   * would.
+   */
+  ESL_ALLOC(pbt, sizeof(double) * ncons * Kp);
+  for (j = 0; j < ncons; j++)
+    {
+      apos = conscols[j];
+      for (a = 0; a < Kp; a++)
+	pbt[j*Kp+a] = (a < msa->abc->K && ct[apos][a] > 0 ? 1. / (double) (r[j] * ct[apos][a]) : 0.);  // <= This is the PB weight rule.
+    }
   esl_vec_DSet(msa->wgt, msa->nseq, 0.0);
-  for (idx = 0; idx < msa->nseq; idx++)
+  esl_vec_ISet(rlen,     msa->nseq, 0);
+  ESL_ALLOC(job, sizeof(PB_JOB) * njobs);
+  for (t = 0; t < njobs; t++)
     {
-      rlen = 0;
-      for (j = 0; j < ncons; j++)
-	{
-	  apos = conscols[j];
-	  a    = msa->ax[idx][apos];
-	  msa->wgt[idx] += (a >= msa->abc->K ? 0. : 1. / (double) (r[j] * ct[apos][a])); // <= This is the PB weight rule.
-	  rlen          += (a >= msa->abc->K ? 0  : 1);                                  //    (ternary is faster than an if)
-	}
-      if (rlen > 0) msa->wgt[idx] /= (double) rlen;  // first normalization, by unaligned seq length
+      job[t].cm    = cm;
+      job[t].cols  = conscols;
+      job[t].ncons = ncons;
+      job[t].pbt   = pbt;
+      job[t].i0    = ESL_MIN(msa->nseq, (int) ((int64_t) msa->nseq * t     / njobs / 64 * 64));
+      job[t].i1    = (t == njobs-1 ? msa->nseq : ESL_MIN(msa->nseq, (int) ((int64_t) msa->nseq * (t+1) / njobs / 64 * 64)));
+      job[t].wgt   = msa->wgt;
+      job[t].rlen  = rlen;
     }
+  pb_run(pb_wgt_job, job, njobs);
+  for (idx = 0; idx < msa->nseq; idx++)
+    if (rlen[idx] > 0) msa->wgt[idx] /= (double) rlen[idx];  // first normalization, by unaligned seq length
 
   /* Normalize weights to sum to N */
   esl_vec_DNorm(msa->wgt, msa->nseq);
@@ -241,7 +299,11 @@ esl_msaweight_PB_adv(const ESL_MSAWEIGHT_CFG *cfg, ESL_MSA *msa, ESL_MSAWEIGHT_D
 
  ERROR: 
   esl_mat_IDestroy(ct);
+  esl_msa_cols_Destroy(cm);
   free(r);
+  free(rlen);
+  free(pbt);
+  free(job);
   if (dat) dat->ncons    = ncons;
   if (dat) dat->conscols = conscols; else free(conscols);
   return status;
@@ -419,41 +481,149 @@ consensus_by_all(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, int **ct, int
   *     need to run the lpos and rpos loops to find its start/end.
   *   - If we already know what the consensus columns are, only collect counts in them,
   *     leaving counts in nonconsensus columns zero. This is a time optimization.
+  *   - Columns are counted whole, from the column-major view <cm> if the caller
+  *     has one (else row by row); then the external gaps of fragments, which are
+  *     all there is outside lpos..rpos, are taken back out.
   */
 static int
-collect_counts(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, const int *conscols, int ncons, int **ct, ESL_MSAWEIGHT_DAT *dat)
+collect_counts(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, const ESL_MSA_COLS *cm, const int *conscols, int ncons, int **ct, ESL_MSAWEIGHT_DAT *dat)
 {
   float fragthresh  = (cfg? cfg->fragthresh : eslMSAWEIGHT_FRAGTHRESH);     // seq is fragment if (length from 1st to last aligned residue)/alen < fragthresh (i.e. span < minspan)
   int   minspan     = (int) ceil( fragthresh * (float) msa->alen );         // precalculated span length threshold using <fragthresh>
+  int   nthreads    = (cfg? cfg->nthreads   : eslMSAWEIGHT_NTHREADS);
+  int   njobs       = ESL_MAX(1, nthreads);
+  int   ncols       = (ncons ? ncons : msa->alen);
+  PB_JOB *job       = NULL;
   int   lpos, rpos;     // leftmost, rightmost aligned residue (1..alen)
-  int   idx, apos, j;        
-
+  int   idx, apos, j, t;        
+  int   status;
 
   esl_mat_ISet(ct, msa->alen+1, msa->abc->Kp, 0);
+  if (cm)   // count whole columns; if we have consensus columns already, only those (faster). Columns are divided among threads.
+    {
+      ESL_ALLOC(job, sizeof(PB_JOB) * njobs);
+      for (t = 0; t < njobs; t++)
+	{
+	  job[t].cm   = cm;
+	  job[t].cols = (ncons ? conscols : NULL);
+	  job[t].c0   = (int) ((int64_t) ncols * t     / njobs);
+	  job[t].c1   = (int) ((int64_t) ncols * (t+1) / njobs);
+	  job[t].ct   = ct;
+	}
+      pb_run(pb_count_job, job, njobs);
+      free(job);
+    }
+  else      // no column-major view: same counts, row by row            // no column-major view: same counts, row by row
+    {
+      for (idx = 0; idx < msa->nseq; idx++)
+	if (ncons) { for (j = 0; j < ncons; j++) ct[conscols[j]][msa->ax[idx][conscols[j]]]++; }
+	else       { for (apos = 1; apos <= msa->alen; apos++) ct[apos][msa->ax[idx][apos]]++; }
+    }
+
   for (idx = 0; idx < msa->nseq; idx++)
     {
       // HMMER mark_fragments() rule. Count "span" from first to last aligned residue. If alispan/alen < fragthresh, it's a fragment.
       for (lpos = 1;         lpos <= msa->alen; lpos++) if (esl_abc_XIsResidue(msa->abc, msa->ax[idx][lpos])) break;
       for (rpos = msa->alen; rpos >= 1;         rpos--) if (esl_abc_XIsResidue(msa->abc, msa->ax[idx][rpos])) break;
       // L=0 seq or alen=0? then lpos == msa->alen+1, rpos == 0 => lpos > rpos. rpos-lpos-1 <= 0 but test below still works.
-      if (rpos - lpos + 1 >= minspan) { lpos = 1; rpos = msa->alen; } else if (dat) dat->all_nfrag++;   // full len seqs count cols 1..alen; fragments only count lpos..rpos.
+      if (rpos - lpos + 1 >= minspan) continue;   // full len seqs count cols 1..alen; fragments only count lpos..rpos.
+      if (dat) dat->all_nfrag++;
+      if (rpos < lpos) rpos = lpos - 1;           // no residues at all: every column is external
 
-      if (ncons) // if we have consensus columns already, only count symbols in those columns (faster)...
+      if (ncons)
 	{
-	  for (j = 0; j < ncons && conscols[j] <= rpos; j++)
+	  for (j = 0; j < ncons; j++)
 	    {
 	      apos = conscols[j];
-	      if (apos < lpos) continue;
-	      ct[apos][msa->ax[idx][apos]]++;
+	      if (apos < lpos || apos > rpos) ct[apos][msa->ax[idx][apos]]--;
 	    }
 	}
-      else      // ... else, count symbols in all columns.
+      else
 	{
-	  for (apos = lpos; apos <= rpos; apos++)
-	    ct[apos][msa->ax[idx][apos]]++;
+	  for (apos = 1;      apos < lpos;       apos++) ct[apos][msa->ax[idx][apos]]--;
+	  for (apos = rpos+1; apos <= msa->alen; apos++) ct[apos][msa->ax[idx][apos]]--;
 	}
     }
   return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* pb_count_job()
+ * Count residues in a range of columns of the column-major view.
+ */
+static void *
+pb_count_job(void *arg)
+{
+  PB_JOB *job = (PB_JOB *) arg;
+  int     c, apos;
+
+  for (c = job->c0; c < job->c1; c++)
+    {
+      apos = (job->cols ? job->cols[c] : c+1);
+      esl_msa_cols_Count(job->cm, apos, job->ct[apos]);
+    }
+  return NULL;
+}
+
+/* pb_wgt_job()
+ * Sum PB weight increments and canonical residue counts for a range
+ * of seqs, one consensus column at a time.
+ */
+static void *
+pb_wgt_job(void *arg)
+{
+  PB_JOB        *job = (PB_JOB *) arg;
+  int            K   = job->cm->abc->K;
+  int            Kp  = job->cm->abc->Kp;
+  const double  *tbl;
+  const ESL_DSQ *col;
+  int            j, idx;
+
+  for (j = 0; j < job->ncons; j++)
+    {
+      col = job->cm->cx[job->cols[j]];
+      tbl = job->pbt + (int64_t) j * Kp;
+      for (idx = job->i0; idx < job->i1; idx++)
+	{
+	  job->wgt[idx]  += tbl[col[idx]];
+	  job->rlen[idx] += (col[idx] < K);
+	}
+    }
+  return NULL;
+}
+
+/* pb_run()
+ * Run <njobs> jobs of a PB pass, jobs 1.. in their own threads if we
+ * can; a job whose thread can't be started runs in the caller.
+ */
+static void
+pb_run(void *(*func)(void *), PB_JOB *job, int njobs)
+{
+  int        t;
+#ifdef HAVE_PTHREAD
+  pthread_t *tid   = NULL;
+  int       *alive = NULL;
+
+  if (njobs > 1 && (tid = malloc(sizeof(pthread_t) * njobs)) != NULL && (alive = malloc(sizeof(int) * njobs)) != NULL)
+    {
+      for (t = 1; t < njobs; t++)
+	alive[t] = (pthread_create(&(tid[t]), NULL, func, &(job[t])) == 0);
+      (*func)(&(job[0]));
+      for (t = 1; t < njobs; t++)
+	{
+	  if (alive[t]) pthread_join(tid[t], NULL);
+	  else          (*func)(&(job[t]));
+	}
+      free(tid);
+      free(alive);
+      return;
+    }
+  free(tid);
+#endif
+  for (t = 0; t < njobs; t++) (*func)(&(job[t]));
 }
 
 
@@ -558,6 +728,7 @@ esl_msaweight_cfg_Create(void)
   cfg->maxfrag    = eslMSAWEIGHT_MAXFRAG;
   cfg->seed       = eslMSAWEIGHT_RNGSEED;          
   cfg->filterpref = eslMSAWEIGHT_FILT_CONSCOVER;
+  cfg->nthreads   = eslMSAWEIGHT_NTHREADS;
 
  ERROR:
   return cfg;
@@ -663,29 +834,13 @@ esl_msaweight_dat_Destroy(ESL_MSAWEIGHT_DAT *dat)
  *            representation", JMB 236:1067-1078, 1994.
  *            
  *            The algorithm is $O(N^2)$ memory (it requires a pairwise
- *            distance matrix) and $O(N^3 + LN^2)$ time ($N^3$ for a UPGMA
- *            tree building step, $LN^2$ for distance matrix construction)
- *            for an alignment of N sequences and L columns. 
- *            
- *            In the current implementation, the actual memory
- *            requirement is dominated by two full NxN distance
- *            matrices (one tmp copy in UPGMA, and one here): for
- *            8-byte doubles, that's $16N^2$ bytes. To keep the
- *            calculation under memory limits, don't process large
- *            alignments: max 1400 sequences for 32 MB, max 4000
- *            sequences for 256 MB, max 8000 seqs for 1 GB. Watch
- *            out, because Pfam alignments can easily blow this up.
- *            
- * Note:      Memory usage could be improved. UPGMA consumes a distance
- *            matrix, but that can be D itself, not a copy, if the
- *            caller doesn't mind the destruction of D. Also, D is
- *            symmetrical, so we could use upper or lower triangular
- *            matrices if we rewrote dmatrix to allow them.
- *            
- *            I also think UPGMA can be reduced to O(N^2) time, by
- *            being more tricky about rapidly identifying the minimum
- *            element: could keep min of each row, and update that,
- *            I think.
+ *            distance matrix) and $O(N^2 + LN^2)$ time ($N^2$ for a
+ *            UPGMA tree building step, typically, and $N^3$ at worst;
+ *            $LN^2$ for distance matrix construction) for an
+ *            alignment of N sequences and L columns. The distance
+ *            matrix is kept as a packed upper triangle of doubles,
+ *            $4N^2$ bytes, which UPGMA consumes in place: about 1.6 GB
+ *            for 20000 sequences.
  *
  * Returns:   <eslOK> on success, and the weights inside <msa> have been
  *            modified.  
@@ -700,7 +855,7 @@ esl_msaweight_dat_Destroy(ESL_MSAWEIGHT_DAT *dat)
 int
 esl_msaweight_GSC(ESL_MSA *msa)
 {
-  ESL_DMATRIX *D = NULL;     /* distance matrix */
+  double      *D = NULL;     /* packed distance matrix */
   ESL_TREE    *T = NULL;     /* UPGMA tree */
   double      *x = NULL;     /* storage per node, 0..N-2 */
   double       lw, rw;       /* total branchlen on left, right subtrees */
@@ -721,21 +876,23 @@ esl_msaweight_GSC(ESL_MSA *msa)
    */
   if (! (msa->flags & eslMSA_DIGITAL)) 
     {
-      if ((status = esl_dst_CDiffMx(msa->aseq, msa->nseq, &D))         != eslOK) goto ERROR;
+      if ((status = esl_dst_CDiffPacked(msa->aseq, msa->nseq, &D))         != eslOK) goto ERROR;
     } 
   else 
     {
-      if ((status = esl_dst_XDiffMx(msa->abc, msa->ax, msa->nseq, &D)) != eslOK) goto ERROR;
+      if ((status = esl_dst_XDiffPacked(msa->abc, msa->ax, msa->nseq, &D)) != eslOK) goto ERROR;
     }
 
   /* oi, look out here.  UPGMA is correct, but old squid library uses
    * single linkage, so for regression tests ONLY, we use single link. 
    */
 #ifdef  eslMSAWEIGHT_REGRESSION
-  if ((status = esl_tree_SingleLinkage(D, &T)) != eslOK) goto ERROR; 
+  if ((status = esl_tree_ClusterPacked(D, msa->nseq, eslSINGLE_LINKAGE, &T)) != eslOK) goto ERROR; 
 #else
-  if ((status = esl_tree_UPGMA(D, &T)) != eslOK) goto ERROR; 
+  if ((status = esl_tree_ClusterPacked(D, msa->nseq, eslUPGMA, &T))          != eslOK) goto ERROR; 
 #endif
+  free(D);
+  D = NULL;
   esl_tree_SetCladesizes(T);	
 
   ESL_ALLOC(x, sizeof(double) * (T->N-1));
@@ -800,13 +957,12 @@ esl_msaweight_GSC(ESL_MSA *msa)
 
   free(x);
   esl_tree_Destroy(T);
-  esl_dmatrix_Destroy(D);
   return eslOK;
 
  ERROR:
   if (x != NULL) free(x);
   if (T != NULL) esl_tree_Destroy(T);
-  if (D != NULL) esl_dmatrix_Destroy(D);
+  if (D != NULL) free(D);
   return status;
 }
 
@@ -849,6 +1005,30 @@ esl_msaweight_GSC(ESL_MSA *msa)
 int
 esl_msaweight_BLOSUM(ESL_MSA *msa, double maxid)
 {
+  return esl_msaweight_BLOSUM_adv(NULL, msa, maxid);
+}
+
+
+/* Function:  esl_msaweight_BLOSUM_adv()
+ * Synopsis:  BLOSUM weights, with optional config.
+ *
+ * Purpose:   Same as <esl_msaweight_BLOSUM()>, customized by optional
+ *            <cfg>: <cfg->nthreads> sets the number of threads used
+ *            to cluster a digital <msa> (see
+ *            <esl_msacluster_SingleLinkage_adv()>). The weights
+ *            don't depend on it.
+ *
+ * Returns:   <eslOK> on success, and the weights inside <msa> have been
+ *            modified. 
+ *            
+ * Throws:    <eslEMEM> on allocation error. <eslEINVAL> if a pairwise
+ *            identity calculation fails because of corrupted sequence 
+ *            data. In either case, the <msa> is unmodified.
+ */
+int
+esl_msaweight_BLOSUM_adv(const ESL_MSAWEIGHT_CFG *cfg, ESL_MSA *msa, double maxid)
+{
+  int   nthreads = (cfg? cfg->nthreads : eslMSAWEIGHT_NTHREADS);
   int  *c    = NULL; /* cluster assignments for each sequence */
   int  *nmem = NULL; /* number of seqs in each cluster */
   int   nc;	     /* number of clusters  */
@@ -862,7 +1042,7 @@ esl_msaweight_BLOSUM(ESL_MSA *msa, double maxid)
   ESL_DASSERT1( (msa->alen >= 1) );
   if (msa->nseq == 1) { msa->wgt[0] = 1.0; return eslOK; }
 
-  if ((status = esl_msacluster_SingleLinkage(msa, maxid, &c, NULL, &nc)) != eslOK) goto ERROR;
+  if ((status = esl_msacluster_SingleLinkage_adv(msa, maxid, nthreads, &c, NULL, &nc)) != eslOK) goto ERROR;
   ESL_ALLOC(nmem, sizeof(int) * nc);
   esl_vec_ISet(nmem, nc, 0);
   for (i = 0; i < msa->nseq; i++) nmem[c[i]]++;
@@ -902,6 +1082,43 @@ static int set_preference_randomly(const ESL_MSAWEIGHT_CFG *cfg, int nseq, doubl
 static int set_preference_origorder(int nseq, double *sortwgt);
 static int msaweight_IDFilter_txt(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa);
 
+/* IDFILTER_DATA
+ * What the digital %id filter's comparisons share: the alignment
+ * packed into bit planes for exact identities, and a sketch of each
+ * seq: the same bit planes for a sample of the most occupied
+ * columns, and how many of its canonical residues fall in the
+ * sample. A sketch comparison bounds two seqs' identity, at a
+ * fraction of the cost of computing it.
+ */
+typedef struct {
+  const ESL_DST_BITS *db;     // packed alignment
+  int                *need;   // need[n]: seqs with identity denominator n are redundant if they have >= need[n] identities
+  int                 np;     // bit planes per seq: canonical mask, then residue code bits; same as <db->np>
+  int                 skw;    // 64-bit words per sketch plane
+  uint64_t           *sk;     // seq i's sketch plane p is sk + (i*np + p) * skw; NULL if no sketches
+  int                *skcan;  // skcan[i]: # canonical residues of seq i in the sampled columns
+} IDFILTER_DATA;
+
+/* IDFILTER_JOB
+ * One thread's share of a batch of candidates: test cand[c] against
+ * list[0..nlist-1] for c = t0, t0+tstep, ...
+ */
+typedef struct {
+  const IDFILTER_DATA *fd;
+  const int           *list;      // seqs kept so far
+  int                  nlist;
+  const int           *cand;      // candidate seqs in this batch, in rank order
+  int                  ncand;
+  int                 *redundant; // RESULT: redundant[c] TRUE if cand[c] is >= maxid to a seq in <list>
+  int                  t0;
+  int                  tstep;
+} IDFILTER_JOB;
+
+static int   idfilter_sketch   (const ESL_MSA *msa, IDFILTER_DATA *fd);
+static int   idfilter_popcount (uint64_t v);
+static int   idfilter_redundant(const IDFILTER_DATA *fd, int r, const int *list, int nlist);
+static void *idfilter_job      (void *arg);
+
 /* Function:  esl_msaweight_IDFilter()
  * Synopsis:  Filter by %ID.
  * Incept:    ER, Wed Oct 29 10:06:43 2008 [Janelia]
@@ -970,6 +1187,20 @@ esl_msaweight_IDFilter(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa)
  *            
  *            For the "conscover" rule, consensus column determination
  *            can be customized the same way as in PB weighting.
+ *
+ *            <cfg->nthreads> sets the number of threads used for
+ *            pairwise identity comparisons. The result doesn't depend
+ *            on it.
+ *
+ *            The alignment is packed into bit planes with
+ *            <esl_dst_bits_Create()> so each identity takes a few
+ *            vector instructions per 64 columns, and each seq gets a
+ *            small sketch on a sample of well-occupied columns that
+ *            bounds its identity to another seq, so that most pairs
+ *            that can't reach <maxid> are never compared in full.
+ *            The greedy rank-order result is exactly the same as
+ *            testing each seq against the kept ones one at a time
+ *            with <esl_dst_XPairId()>.
  */
 int
 esl_msaweight_IDFilter_adv(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa)
@@ -978,6 +1209,7 @@ esl_msaweight_IDFilter_adv(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, dou
   int     allow_samp  = (cfg? cfg->allow_samp : eslMSAWEIGHT_ALLOW_SAMP);     // default is TRUE: allow subsampling speed optimization
   int     sampthresh  = (cfg? cfg->sampthresh : eslMSAWEIGHT_SAMPTHRESH);     // if nseq > sampthresh, try to determine consensus on a subsample of seqs
   int     filterpref  = (cfg? cfg->filterpref : eslMSAWEIGHT_FILT_CONSCOVER); // default preference rule is "conscover"
+  int     nthreads    = (cfg? cfg->nthreads   : eslMSAWEIGHT_NTHREADS);       // default is 0: do all comparisons in the caller
   int   **ct          = NULL;     // matrix of symbol counts in each column. ct[apos=(0).1..alen][a=0..Kp-1]
   int    *conscols    = NULL;     // list of consensus column indices [0..ncons-1]
   double *sortwgt     = NULL;     // when pair of seqs is >= maxid, retain seq w/ higher <sortwgt>
@@ -986,8 +1218,18 @@ esl_msaweight_IDFilter_adv(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, dou
   int    *useme       = NULL;     // useme[i] is TRUE if seq[i] is kept in new msa 
   int     ncons       = 0;        // number of consensus column indices in <conscols> list
   int     nnew        = 0;        // how many seqs have been added to <list> and <useme> so far
-  int     apos, r, i;             // index over columns, ranked seq indices, seqs in <list>
-  double  ident;                  // pairwise fractional id (0..1)
+  ESL_DST_BITS  *db        = NULL;                     // alignment packed into bit planes, for fast identities
+  IDFILTER_DATA  fd        = { NULL, NULL, 0, 0, NULL, NULL }; // what comparisons of candidates to kept seqs share
+  IDFILTER_JOB  *job       = NULL;     // each thread's share of a batch of candidates
+  int           *redundant = NULL;     // redundant[c] is TRUE if candidate c of a batch matched an earlier kept seq
+#ifdef HAVE_PTHREAD
+  pthread_t     *tid       = NULL;
+  int           *alive     = NULL;
+#endif
+  int     njobs;                  // number of jobs each batch is divided into
+  int     nb;                     // number of ranked seqs per batch
+  int     nprev;                  // number of seqs kept before the current batch
+  int     apos, r, c, t;          // index over columns, ranked seqs, candidates in a batch, jobs
   int     status      = eslOK;
 
   ESL_DASSERT1(( msa->nseq >= 1 && msa->alen >= 1));
@@ -1021,7 +1263,7 @@ esl_msaweight_IDFilter_adv(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, dou
       if      (! ignore_rf && msa->rf)                consensus_by_rf(msa, conscols, &ncons, NULL);
       else if (allow_samp  && msa->nseq > sampthresh) consensus_by_sample(cfg, msa, ct, conscols, &ncons, NULL);
       else {
-	collect_counts(cfg, msa, conscols, ncons, ct, NULL);
+	collect_counts(cfg, msa, NULL, conscols, ncons, ct, NULL);
 	consensus_by_all(cfg, msa, ct, conscols, &ncons, NULL);
       }
       if (!ncons) {
@@ -1043,21 +1285,70 @@ esl_msaweight_IDFilter_adv(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, dou
    */
   esl_quicksort(sortwgt, msa->nseq, sort_doubles_decreasing, ranked_at);
 
-  /* Determine which seqs will be kept, favoring highest ranked ones.
+  /* Determine which seqs will be kept, favoring highest ranked ones:
+   * each seq in rank order is kept unless it's >= maxid identical to
+   * a seq already kept. Ranked seqs are taken in batches. First each
+   * candidate in a batch is tested against the seqs kept from earlier
+   * batches, with the candidates divided among threads; then the
+   * survivors are tested in rank order against the ones kept from
+   * this batch. That's exactly the one-at-a-time greedy result.
    */
-  for (r = 0; r < msa->nseq; r++)  // Try to include each sequence, starting with highest ranked ones
+  if ((status = esl_dst_bits_Create(msa->abc, msa->ax, msa->nseq, &db)) != eslOK) goto ERROR;
+  fd.db = db;
+  fd.np = db->np;
+  if ((status = esl_dst_bits_MinIdents(db, maxid, &fd.need)) != eslOK) goto ERROR;
+  if ((status = idfilter_sketch(msa, &fd))                     != eslOK) goto ERROR;
+
+  njobs = ESL_MAX(1, nthreads);
+  nb    = eslMSAWEIGHT_FILT_BATCH * njobs;
+  ESL_ALLOC(redundant, sizeof(int)          * nb);
+  ESL_ALLOC(job,       sizeof(IDFILTER_JOB) * njobs);
+#ifdef HAVE_PTHREAD
+  if (njobs > 1) {
+    ESL_ALLOC(tid,   sizeof(pthread_t) * njobs);
+    ESL_ALLOC(alive, sizeof(int)       * njobs);
+  }
+#endif
+
+  for (r = 0; r < msa->nseq; r += nb)
     {
-      for (i = 0; i < nnew; i++)   // Test it against all the seqs we've already put in the list.
+      for (t = 0; t < njobs; t++)
 	{
-	  if ((status = esl_dst_XPairId(msa->abc, msa->ax[ranked_at[r]], msa->ax[list[i]], &ident, NULL, NULL)) != eslOK) goto ERROR;
-	  if (ident >= maxid) break;
+	  job[t].fd        = &fd;
+	  job[t].list      = list;
+	  job[t].nlist     = nnew;
+	  job[t].cand      = ranked_at + r;
+	  job[t].ncand     = ESL_MIN(nb, msa->nseq - r);
+	  job[t].redundant = redundant;
+	  job[t].t0        = t;
+	  job[t].tstep     = njobs;
 	}
 
-      if (i == nnew)  // if the seq made it past comparisons with all <nnew> current seqs in the list...
+#ifdef HAVE_PTHREAD
+      if (njobs > 1)
+	{
+	  for (t = 1; t < njobs; t++)  // a thread that can't be started does its share in the caller, below
+	    alive[t] = (pthread_create(&(tid[t]), NULL, idfilter_job, &(job[t])) == 0);
+	  idfilter_job(&(job[0]));
+	  for (t = 1; t < njobs; t++)
+	    {
+	      if (alive[t]) pthread_join(tid[t], NULL);
+	      else          idfilter_job(&(job[t]));
+	    }
+	}
+      else
+#endif
 	{
-	  list[nnew++]        = ranked_at[r];  // ... add it to the growing list.
-	  useme[ranked_at[r]] = TRUE;
+	  idfilter_job(&(job[0]));
 	}
+
+      nprev = nnew;
+      for (c = 0; c < job[0].ncand; c++)
+	if (! redundant[c] && ! idfilter_redundant(&fd, ranked_at[r+c], list + nprev, nnew - nprev))
+	  {
+	    list[nnew++]          = ranked_at[r+c];
+	    useme[ranked_at[r+c]] = TRUE;
+	  }
     }
 
   /* Filter the input MSA.
@@ -1065,6 +1356,16 @@ esl_msaweight_IDFilter_adv(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, dou
   if ((status = esl_msa_SequenceSubset(msa, useme, ret_newmsa)) != eslOK) goto ERROR;
   
  ERROR:
+#ifdef HAVE_PTHREAD
+  free(tid);
+  free(alive);
+#endif
+  free(job);
+  free(redundant);
+  free(fd.need);
+  free(fd.sk);
+  free(fd.skcan);
+  esl_dst_bits_Destroy(db);
   free(useme);
   free(list);
   free(ranked_at);
@@ -1213,6 +1514,162 @@ msaweight_IDFilter_txt(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa)
 }
 
 
+/* idfilter_sketch()
+ * Sketch each seq on a sample of the alignment's columns, the ones
+ * with the most canonical residues, in the same bit planes as
+ * <esl_dst_bits_Create()> uses. The sample is <64*fd->skw> columns:
+ * at least <eslMSAWEIGHT_FILT_SKETCHW> words per plane, and a quarter
+ * of the full planes' width, so sketches stay cheap to compare but
+ * have room for enough mismatches to rule out a pair. If two seqs
+ * have <nid> identities in the sampled columns, they have at most
+ * <nid> plus the smaller of their numbers of canonical residues
+ * outside the sample in all; when that's < maxid of the identity
+ * denominator, they can't be redundant, and we don't need to compare
+ * them. That's what usually happens for unrelated seqs, or for
+ * fragments that don't overlap, because the sampled columns are the
+ * ones both seqs are most likely to have residues in.
+ *
+ * Alignments less than twice as wide as the sample aren't sketched:
+ * <fd->sk> stays NULL.
+ */
+static int
+idfilter_sketch(const ESL_MSA *msa, IDFILTER_DATA *fd)
+{
+  int       nsamp;
+  double   *occ    = NULL;   // occ[apos-1]: # of canonical residues in column apos
+  int      *by_occ = NULL;   // column indices 0..alen-1, sorted by decreasing <occ>
+  uint64_t *x;
+  uint64_t  bit;
+  int       idx, apos, j, p;
+  int       status;
+
+  fd->skw = (int) ESL_MAX(eslMSAWEIGHT_FILT_SKETCHW, fd->db->nw / 4);
+  nsamp   = 64 * fd->skw;
+  if (msa->alen < 2 * nsamp) return eslOK;
+
+  ESL_ALLOC(occ,       sizeof(double)   * msa->alen);
+  ESL_ALLOC(by_occ,    sizeof(int)      * msa->alen);
+  ESL_ALLOC(fd->sk,    sizeof(uint64_t) * msa->nseq * fd->np * fd->skw);
+  ESL_ALLOC(fd->skcan, sizeof(int)      * msa->nseq);
+  memset(fd->sk, 0,    sizeof(uint64_t) * msa->nseq * fd->np * fd->skw);
+  esl_vec_ISet(fd->skcan, msa->nseq, 0);
+
+  esl_vec_DSet(occ, msa->alen, 0.);
+  for (idx = 0; idx < msa->nseq; idx++)
+    for (apos = 1; apos <= msa->alen; apos++)
+      if (esl_abc_XIsCanonical(msa->abc, msa->ax[idx][apos])) occ[apos-1] += 1.;
+  esl_quicksort(occ, msa->alen, sort_doubles_decreasing, by_occ);
+
+  for (idx = 0; idx < msa->nseq; idx++)
+    {
+      x = fd->sk + (int64_t) idx * fd->np * fd->skw;
+      for (j = 0; j < nsamp; j++)
+	{
+	  apos = by_occ[j] + 1;
+	  if (! esl_abc_XIsCanonical(msa->abc, msa->ax[idx][apos])) continue;
+
+	  bit = (uint64_t) 1 << (j % 64);
+	  x[j / 64] |= bit;
+	  for (p = 1; p < fd->np; p++)
+	    if (msa->ax[idx][apos] & (1 << (p-1))) x[p * fd->skw + j/64] |= bit;
+	  fd->skcan[idx]++;
+	}
+    }
+
+  free(occ);
+  free(by_occ);
+  return eslOK;
+
+ ERROR:
+  free(occ);
+  free(by_occ);
+  return status;
+}
+
+
+/* idfilter_popcount()
+ * Number of set bits in <v>.
+ */
+static int
+idfilter_popcount(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(v);
+#else
+  v = v - ((v >> 1) & 0x5555555555555555ULL);
+  v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+  v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+
+/* idfilter_redundant()
+ * Return TRUE if seq <r> is >= maxid identical to any seq in
+ * <list[0..nlist-1]>, else FALSE. Identities are exactly those of
+ * <esl_dst_XPairId()>; pairs whose sketches show they can't reach
+ * maxid are skipped without computing them.
+ */
+static int
+idfilter_redundant(const IDFILTER_DATA *fd, int r, const int *list, int nlist)
+{
+  const int       W  = fd->skw;
+  const uint64_t *xr = (fd->sk ? fd->sk + (int64_t) r * fd->np * W : NULL);
+  const uint64_t *xk;
+  uint64_t        eq, diff;
+  int             i, k, n, w, p, ub, nid;
+
+  for (i = 0; i < nlist; i++)
+    {
+      k = list[i];
+      n = ESL_MIN(fd->db->ncanon[r], fd->db->ncanon[k]);
+      if (xr && n > 0)
+	{
+	  xk = fd->sk + (int64_t) k * fd->np * W;
+	  for (ub = 0, w = 0; w < W; w++)
+	    {
+	      for (diff = 0, p = 1; p < fd->np; p++) diff |= xr[p*W+w] ^ xk[p*W+w];
+	      eq  = xr[w] & xk[w] & ~diff;
+	      ub += idfilter_popcount(eq);
+	    }
+	  ub += ESL_MIN(fd->db->ncanon[r] - fd->skcan[r], fd->db->ncanon[k] - fd->skcan[k]);
+	  if (ub < fd->need[n]) continue;
+	}
+
+      esl_dst_bits_PairId(fd->db, r, k, NULL, &nid, NULL);
+      if (nid >= fd->need[n]) return TRUE;
+    }
+  return FALSE;
+}
+
+
+/* idfilter_job()
+ * Test one job's share of a batch of candidates against the seqs
+ * kept so far. The kept seqs are taken in blocks of
+ * <eslDST_BITS_TILE>, each compared to all the job's candidates
+ * before going on to the next, so their packed planes stay in
+ * cache. Runs in its own thread, or in the caller.
+ */
+static void *
+idfilter_job(void *arg)
+{
+  IDFILTER_JOB *job = (IDFILTER_JOB *) arg;
+  int           k0, nk, c;
+
+  for (c = job->t0; c < job->ncand; c += job->tstep)
+    job->redundant[c] = FALSE;
+
+  for (k0 = 0; k0 < job->nlist; k0 += eslDST_BITS_TILE)
+    {
+      nk = ESL_MIN(eslDST_BITS_TILE, job->nlist - k0);
+      for (c = job->t0; c < job->ncand; c += job->tstep)
+	if (! job->redundant[c])
+	  job->redundant[c] = idfilter_redundant(job->fd, job->cand[c], job->list + k0, nk);
+    }
+  return NULL;
+}
+
+
 
 /*****************************************************************
  * 5. Benchmark
@@ -1439,6 +1896,7 @@ main(int argc, char **argv)
 #ifdef eslMSAWEIGHT_TESTDRIVE
 
 #include "esl_msafile.h"
+#include "esl_random.h"
 
 /* GSC weighting test on text-mode alignment <msa>, where we expect
  * the weights to be <expect[0]..expect[nseq-1]>. 
@@ -1600,6 +2058,29 @@ utest_gerstein4(void)
   esl_msa_Destroy(msa);
 }
 
+/* gsc_ties test
+ * An alignment of duplicate and near-duplicate seqs, with many tied
+ * distances, where the UPGMA tree (and so the weights) depends on how
+ * ties are broken. Expected weights are from the original O(N^3)
+ * UPGMA, which takes the first tied pair in its matrix.
+ */
+static void
+utest_gsc_ties(void)
+{
+  char          msg[]   = "gsc_ties test failed";
+  ESL_MSA      *msa     = esl_msa_CreateFromString("# STOCKHOLM 1.0\n\nseq1 ATTACTTG\nseq2 TCGTTGGC\nseq3 CATGACGA\nseq4 ATTACTTG\nseq5 ATTAGTTG\nseq6 ATTACTTT\nseq7 CATGACGA\nseq8 ATTACTTG\n//\n", eslMSAFILE_STOCKHOLM);
+  ESL_ALPHABET *aa_abc  = esl_alphabet_Create(eslAMINO);
+  ESL_ALPHABET *nt_abc  = esl_alphabet_Create(eslDNA);
+  double        egsc[8] = { 0.343454, 2.397213, 1.198606, 0.343454, 1.144848, 1.030363, 1.198606, 0.343454 };
+
+  do_GSC(aa_abc, msa, egsc, msg);
+  do_GSC(nt_abc, msa, egsc, msg);
+
+  esl_alphabet_Destroy(nt_abc);
+  esl_alphabet_Destroy(aa_abc);
+  esl_msa_Destroy(msa);
+}
+
 /* pathologs test
  * A gappy alignment where no seqs overlap, and weighting methods
  * have to resort to uniform weights.
@@ -1675,6 +2156,181 @@ utest_idfilter(void)
   esl_msa_Destroy(msa);
 }
   
+
+/* utest_idfilter_greedy()
+ * On random alignments of families of related seqs, with fragments,
+ * gaps and degenerate residues, check that the %id filter keeps
+ * exactly the seqs that the simple one-at-a-time greedy algorithm
+ * keeps, using <esl_dst_XPairId()>, for each preference rule and with
+ * or without threads.
+ */
+static void
+utest_idfilter_greedy(ESL_RANDOMNESS *rng)
+{
+  char               msg[]     = "idfilter greedy test failed";
+  ESL_ALPHABET      *abc       = esl_alphabet_Create(eslAMINO);
+  ESL_MSAWEIGHT_CFG *cfg       = esl_msaweight_cfg_Create();
+  int                nseq      = 1 + esl_rnd_Roll(rng, 600);
+  int                alen      = 1 + esl_rnd_Roll(rng, 300);
+  int                nfam      = 1 + esl_rnd_Roll(rng, 8);
+  double             maxids[]  = { 0.0, 0.5, 0.8, 0.95, 1.0 };
+  int                prefs[]   = { eslMSAWEIGHT_FILT_CONSCOVER, eslMSAWEIGHT_FILT_RANDOM, eslMSAWEIGHT_FILT_ORIGORDER };
+  int                nthreads[]= { 0, 3 };
+  ESL_MSA           *msa       = esl_msa_CreateDigital(abc, nseq, alen);
+  ESL_MSA           *msa2      = NULL;
+  ESL_DSQ          **anc       = NULL;
+  double            *sortwgt   = NULL;
+  int               *ranked_at = NULL;
+  int               *list      = NULL;
+  int               *conscols  = NULL;
+  char               name[32];
+  double             pmut, ident;
+  int                f, i, apos, lpos, rpos, m, p, t, r, k, nkept, nnew;
+  int                status;
+
+  ESL_ALLOC(anc,       sizeof(ESL_DSQ *) * nfam);
+  ESL_ALLOC(sortwgt,   sizeof(double)    * nseq);
+  ESL_ALLOC(ranked_at, sizeof(int)       * nseq);
+  ESL_ALLOC(list,      sizeof(int)       * nseq);
+  ESL_ALLOC(conscols,  sizeof(int)       * alen);
+  for (f = 0; f < nfam; f++)
+    {
+      ESL_ALLOC(anc[f], sizeof(ESL_DSQ) * (alen+2));
+      for (apos = 1; apos <= alen; apos++) anc[f][apos] = esl_rnd_Roll(rng, abc->K);
+    }
+  for (apos = 1; apos <= alen; apos++) conscols[apos-1] = apos;
+
+  /* Each seq is a mutated copy of a family ancestor; some are fragments, some have gaps, degeneracies. */
+  for (i = 0; i < nseq; i++)
+    {
+      f    = esl_rnd_Roll(rng, nfam);
+      pmut = 0.3 * esl_random(rng) * esl_random(rng);
+      lpos = 1;
+      rpos = alen;
+      if (esl_rnd_Roll(rng, 4) == 0) { lpos = 1 + esl_rnd_Roll(rng, alen); rpos = lpos + esl_rnd_Roll(rng, alen - lpos + 1); }
+      for (apos = 1; apos <= alen; apos++)
+	{
+	  if      (apos < lpos || apos > rpos)   msa->ax[i][apos] = esl_abc_XGetGap(abc);
+	  else if (esl_random(rng) < 0.05)       msa->ax[i][apos] = esl_abc_XGetGap(abc);
+	  else if (esl_random(rng) < 0.01)       msa->ax[i][apos] = esl_abc_XGetUnknown(abc);
+	  else if (esl_random(rng) < pmut)       msa->ax[i][apos] = esl_rnd_Roll(rng, abc->K);
+	  else                                   msa->ax[i][apos] = anc[f][apos];
+	}
+      snprintf(name, 32, "seq%d", i);
+      if (esl_msa_SetSeqName(msa, i, name, -1) != eslOK) esl_fatal(msg);
+    }
+  msa->nseq = nseq;
+  esl_msa_SetDefaultWeights(msa);
+  if (esl_msa_Validate(msa, NULL) != eslOK) esl_fatal(msg);
+
+  cfg->ignore_rf  = TRUE;
+  cfg->allow_samp = FALSE;
+  cfg->symfrac    = 0.0;   // all columns are consensus, so the reference can use <conscols> as is
+  for (p = 0; p < 3; p++)
+    {
+      if      (prefs[p] == eslMSAWEIGHT_FILT_CONSCOVER) set_preference_conscover(msa, conscols, alen, sortwgt);
+      else if (prefs[p] == eslMSAWEIGHT_FILT_RANDOM)    set_preference_randomly (cfg, nseq, sortwgt);
+      else                                              set_preference_origorder(nseq, sortwgt);
+      esl_quicksort(sortwgt, nseq, sort_doubles_decreasing, ranked_at);
+
+      for (m = 0; m < 5; m++)
+	{
+	  /* reference: the greedy algorithm, one seq and one comparison at a time */
+	  for (nkept = 0, r = 0; r < nseq; r++)
+	    {
+	      for (k = 0; k < nkept; k++)
+		{
+		  if (esl_dst_XPairId(abc, msa->ax[ranked_at[r]], msa->ax[list[k]], &ident, NULL, NULL) != eslOK) esl_fatal(msg);
+		  if (ident >= maxids[m]) break;
+		}
+	      if (k == nkept) list[nkept++] = ranked_at[r];
+	    }
+	  esl_vec_ISortIncreasing(list, nkept);
+
+	  for (t = 0; t < 2; t++)
+	    {
+	      cfg->filterpref = prefs[p];
+	      cfg->nthreads   = nthreads[t];
+	      if (esl_msaweight_IDFilter_adv(cfg, msa, maxids[m], &msa2) != eslOK) esl_fatal(msg);
+	      if (msa2->nseq != nkept) esl_fatal(msg);
+	      for (nnew = 0; nnew < nkept; nnew++)
+		{
+		  snprintf(name, 32, "seq%d", list[nnew]);
+		  if (strcmp(msa2->sqname[nnew], name) != 0) esl_fatal(msg);
+		}
+	      esl_msa_Destroy(msa2);
+	    }
+	}
+    }
+
+  for (f = 0; f < nfam; f++) free(anc[f]);
+  free(anc);
+  free(sortwgt);
+  free(ranked_at);
+  free(list);
+  free(conscols);
+  esl_msa_Destroy(msa);
+  esl_msaweight_cfg_Destroy(cfg);
+  esl_alphabet_Destroy(abc);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+
+/* utest_pb_threads()
+ * PB weights of a random MSA with fragments are the same (exactly)
+ * whatever the number of threads, with consensus columns from RF,
+ * from a subsample, or from all seqs.
+ */
+static void
+utest_pb_threads(ESL_RANDOMNESS *rng)
+{
+  char               msg[]      = "PB threads test failed";
+  ESL_ALPHABET      *abc        = esl_alphabet_Create(eslAMINO);
+  ESL_MSAWEIGHT_CFG *cfg        = esl_msaweight_cfg_Create();
+  ESL_MSA           *msa        = NULL;
+  double            *wgt0       = NULL;
+  int                nthreads[] = { 0, 1, 3, 5 };
+  int                i, apos, lpos, rpos, m, t;
+  int                status;
+
+  if (esl_msa_Sample(rng, abc, 400, 80, &msa) != eslOK) esl_fatal(msg);
+  for (i = 0; i < msa->nseq; i++)
+    if (esl_rnd_Roll(rng, 4) == 0)
+      {
+	lpos = 1 + esl_rnd_Roll(rng, msa->alen);
+	rpos = lpos + esl_rnd_Roll(rng, msa->alen - lpos + 1);
+	for (apos = 1; apos <= msa->alen; apos++)
+	  if (apos < lpos || apos > rpos) msa->ax[i][apos] = esl_abc_XGetGap(abc);
+      }
+  ESL_ALLOC(wgt0, sizeof(double) * msa->nseq);
+
+  for (m = 0; m < 3; m++)
+    {
+      cfg->ignore_rf  = (m > 0);                    // m=0: RF;  m=1: subsample;  m=2: all seqs
+      cfg->allow_samp = (m == 1);
+      cfg->sampthresh = 50;
+      cfg->nsamp      = 40;
+      for (t = 0; t < 4; t++)
+	{
+	  cfg->nthreads = nthreads[t];
+	  if (esl_msaweight_PB_adv(cfg, msa, NULL) != eslOK) esl_fatal(msg);
+	  if (t == 0) esl_vec_DCopy(msa->wgt, msa->nseq, wgt0);
+	  else if (esl_vec_DCompare(msa->wgt, wgt0, msa->nseq, 0.0) != eslOK) esl_fatal(msg);
+	}
+    }
+
+  free(wgt0);
+  esl_msa_Destroy(msa);
+  esl_msaweight_cfg_Destroy(cfg);
+  esl_alphabet_Destroy(abc);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
 #endif /*eslMSAWEIGHT_TESTDRIVE*/
 /*-------------------- end, unit tests  -------------------------*/
 
@@ -1694,6 +2350,7 @@ utest_idfilter(void)
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
   { "-h",        eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,      "0",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options]";
@@ -1702,20 +2359,26 @@ static char banner[] = "test driver for msaweight module";
 int
 main(int argc, char **argv)
 {
-  ESL_GETOPTS  *go   = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_GETOPTS    *go  = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
   
   fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
 
   utest_identical_seqs();
   utest_henikoff_contrived();
   utest_nitrogenase();
   utest_gerstein4();
+  utest_gsc_ties();
   utest_pathologs();
+  utest_pb_threads(rng);
 
   utest_idfilter();
+  utest_idfilter_greedy(rng);
 
   fprintf(stderr, "#  status = ok\n");
 
+  esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
   exit(0);
 }
@@ -10,7 +10,7 @@
 #include "esl_rand64.h"
 
 /* ESL_MSAWEIGHT_CFG
- * optional configuration/customization of PB weighting and %id filtering.
+ * optional configuration/customization of PB weighting, %id filtering, and BLOSUM weighting.
  */
 typedef struct {
   float fragthresh;     // seq is a fragment if (length from 1st to last aligned residue)/alen < fragthresh (i.e. span < minspan)
@@ -22,6 +22,9 @@ typedef struct {
   int   maxfrag;        // if sample has > maxfrag fragments in it, abort determining consensus by sample; use all nseq instead
   uint64_t seed;        // RNG seed 
 
+  /* Threads, for PB weighting, %id filtering and BLOSUM weighting: */
+  int   nthreads;       // number of threads for pairwise comparisons and PB column passes; 0 = serial
+
   /* Only affects %id filtering: */
   int   filterpref;     // eslMSAWEIGHT_FILT_CONSCOVER | eslMSAWEIGHT_FILT_RANDOM | eslMSAWEIGHT_FILT_ORIGORDER
 } ESL_MSAWEIGHT_CFG;
@@ -35,12 +38,17 @@ typedef struct {
 #define  eslMSAWEIGHT_NSAMP       10000
 #define  eslMSAWEIGHT_MAXFRAG     5000
 #define  eslMSAWEIGHT_RNGSEED     42
+#define  eslMSAWEIGHT_NTHREADS    0
 
 /* Exclusive settings for seq preference rule in %id filter */
 #define  eslMSAWEIGHT_FILT_CONSCOVER 1
 #define  eslMSAWEIGHT_FILT_RANDOM    2
 #define  eslMSAWEIGHT_FILT_ORIGORDER 3
 
+/* %id filter internals: identity upper bounds and parallel batches */
+#define  eslMSAWEIGHT_FILT_SKETCHW 2   // each seq's sketch samples at least 64*this many columns, and at least 1/4 of the packed width
+#define  eslMSAWEIGHT_FILT_BATCH  256  // ranked seqs tested per batch, per thread
+
 
 /* ESL_MSAWEIGHT_DAT
  * optional data collected from PB weighting
@@ -73,6 +81,7 @@ extern void               esl_msaweight_dat_Destroy(ESL_MSAWEIGHT_DAT *dat);
 
 extern int esl_msaweight_GSC(ESL_MSA *msa);
 extern int esl_msaweight_BLOSUM(ESL_MSA *msa, double maxid);
+extern int esl_msaweight_BLOSUM_adv(const ESL_MSAWEIGHT_CFG *cfg, ESL_MSA *msa, double maxid);
 
 extern int esl_msaweight_IDFilter(const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa);
 extern int esl_msaweight_IDFilter_adv(const ESL_MSAWEIGHT_CFG *cfg, const ESL_MSA *msa, double maxid, ESL_MSA **ret_newmsa);
@@ -224,6 +224,33 @@ esl_neon_hsum_float(esl_neon_128f_t a, float *ret_sum)
  *****************************************************************/
 
 
+/* Function:  esl_neon_rightshift_int8()
+ * Synopsis:  Shift int8 vector elements to the right, shifting -inf on.
+ * See:       esl_sse.h::esl_sse_rightshift_int8()
+ *
+ * Purpose:   Returns <{ 0 a[0] a[1] ... a[14] }>, OR'ed with
+ *            <neginfmask>: i.e. shift the values in <a> to the
+ *            right, shifting on whatever <neginfmask> has in its
+ *            first slot (and zeros elsewhere).
+ */
+static inline esl_neon_128i_t
+esl_neon_rightshift_int8(esl_neon_128i_t a, esl_neon_128i_t neginfmask)
+{
+  a.u8x16 = vorrq_u8(vextq_u8(vdupq_n_u8(0), a.u8x16, 15), neginfmask.u8x16);
+  return a;
+}
+
+/* Function:  esl_neon_rightshift_int16()
+ * Synopsis:  Shift int16 vector elements to the right, shifting -inf on.
+ * See:       esl_neon_rightshift_int8()
+ */
+static inline esl_neon_128i_t
+esl_neon_rightshift_int16(esl_neon_128i_t a, esl_neon_128i_t neginfmask)
+{
+  a.u16x8 = vorrq_u16(vextq_u16(vdupq_n_u16(0), a.u16x8, 7), neginfmask.u16x8);
+  return a;
+}
+
 /* Function:  esl_neon_rightshift_float()
  * Synopsis:  Shift vector elements to the right.
  *
@@ -266,6 +293,24 @@ esl_neon_leftshift_float(esl_neon_128f_t a, esl_neon_128f_t b)
  * 5. Inlined functions: any_gt
  *****************************************************************/
 
+/* Function:  esl_neon_any_gt_u8()
+ * Synopsis:  Returns TRUE if any a[z] > b[z].
+ *
+ * Purpose:   Return TRUE if any <a[z] > b[z]> for <z=0..15>
+ *            in two <u8> vectors.
+ */
+static inline int 
+esl_neon_any_gt_u8(esl_neon_128i_t a, esl_neon_128i_t b)
+{
+  esl_neon_128i_t mask;
+  int64_t         l0, l1;
+
+  mask.u8x16 = vcgtq_u8(a.u8x16, b.u8x16);
+  l0         = vgetq_lane_u64(mask.u64x2, 0);
+  l1         = vgetq_lane_u64(mask.u64x2, 1);
+  return (l0 | l1) != 0;
+}
+
 /* Function:  esl_neon_any_gt_s16()
  * Synopsis:  Returns TRUE if any a[z] > b[z].
  *
@@ -134,6 +134,7 @@ sqfile_open(const char *filename, int format, const char *env, ESL_SQFILE **ret_
   sqfp->abc          = NULL;
 
   sqfp->format       = format;
+  sqfp->nthreads     = 0;
 
   /* initialize the function pointers to NULL */
   sqfp->position          = NULL;
@@ -847,6 +848,45 @@ esl_sqio_AcceptAs(ESL_SQFILE *sqfp, char *xchars, char readas)
   return eslOK;
 
 }
+
+/* Function:  esl_sqfile_SetBlockThreads()
+ * Synopsis:  Parse FASTA blocks with more than one thread.
+ *
+ * Purpose:   Have <esl_sqio_ReadBlock()> parse the FASTA records of
+ *            a block in parallel, using up to <nthreads> threads
+ *            (including the caller's). One thread reads the input in
+ *            large buffers and finds record boundaries; the records
+ *            are then parsed and digitized by the worker threads,
+ *            each into its own <ESL_SQ> in the block.
+ *
+ *            The blocks are the same as those read serially: the
+ *            same sequences in the same order, with the same
+ *            residue and sequence limits, offsets, and line numbers
+ *            for error messages. Only FASTA format (and the HMMPGMD
+ *            variant) is parsed this way, and only when
+ *            <long_target> is <FALSE>; long target windows, and
+ *            other formats, are still read serially.
+ *
+ *            If <sqfp> is a BGZF-compressed file read with zlib,
+ *            its blocks are also decompressed with <nthreads>
+ *            threads.
+ *
+ *            <nthreads> of 0 (the default) turns this off.
+ *            Without POSIX threads, a nonzero <nthreads> still
+ *            parses each block in large buffers, but in the
+ *            caller's thread.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <nthreads> is negative.
+ */
+int
+esl_sqfile_SetBlockThreads(ESL_SQFILE *sqfp, int nthreads)
+{
+  if (nthreads < 0) ESL_EXCEPTION(eslEINVAL, "nthreads can't be negative");
+  sqfp->nthreads = nthreads;
+  return eslOK;
+}
 /*--------------- end, miscellaneous routines -------------------*/
 
 
@@ -1698,6 +1738,9 @@ benchmark_mmap(char *filename, int bufsize, int64_t *ret_magic)
 #include "esl_random.h"
 #include "esl_randomseq.h"
 #include "esl_vectorops.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 static void
 synthesize_testseqs(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int maxL, int N, ESL_SQ ***ret_sqarr)
@@ -1835,6 +1878,87 @@ write_spaced_fasta(FILE *fp, ESL_SQ *sq)
 }
 
 
+#ifdef HAVE_ZLIB
+/* Gzip a copy of <tmpfile> to <gzfile>, with zlib. */
+static void
+gzip_testfile(const char *tmpfile, const char *gzfile)
+{
+  char   *msg  = "sqio unit testing: failed to gzip test file";
+  char    buf[4096];
+  FILE   *fp;
+  gzFile  gzfp;
+  size_t  n;
+
+  if ((fp   = fopen(tmpfile, "rb")) == NULL) esl_fatal(msg);
+  if ((gzfp = gzopen(gzfile, "wb")) == NULL) esl_fatal(msg);
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    if (gzwrite(gzfp, buf, n) != (int) n) esl_fatal(msg);
+  if (gzclose(gzfp) != Z_OK) esl_fatal(msg);
+  fclose(fp);
+}
+
+/* utest_read_truncated_gzip()
+ * A truncated .gz file is a bad input file, like any other: Read(),
+ * ReadWindow() and ReadBlock() (serial and threaded) return
+ * <eslEFORMAT> with a message, through the usual parse failure path,
+ * instead of throwing an exception.
+ */
+static void
+utest_read_truncated_gzip(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, char *gzfile)
+{
+  char          *msg   = "sqio truncated gzip unit test failed";
+  char           trfile[64];
+  char           buf[4096];
+  FILE          *ifp   = NULL;
+  FILE          *ofp   = NULL;
+  ESL_SQFILE    *sqfp  = NULL;
+  ESL_SQ        *sq    = esl_sq_CreateDigital(abc);
+  ESL_SQ_BLOCK  *block = esl_sq_CreateDigitalBlock(100, abc);
+  int64_t        size;
+  int64_t        n;
+  int            pass;
+  int            status;
+
+  /* Copy the first half of <gzfile> */
+  if (strlen(gzfile) + 2 > sizeof(trfile)) esl_fatal(msg);
+  sprintf(trfile, "%.*st.gz", (int) strlen(gzfile) - 3, gzfile);
+  if ((ifp = fopen(gzfile, "rb")) == NULL) esl_fatal(msg);
+  if ((ofp = fopen(trfile, "wb")) == NULL) esl_fatal(msg);
+  if (fseek(ifp, 0, SEEK_END) != 0)        esl_fatal(msg);
+  size = ftell(ifp) / 2;
+  rewind(ifp);
+  while (size > 0 && (n = fread(buf, 1, ESL_MIN(size, (int64_t) sizeof(buf)), ifp)) > 0)
+    {
+      if (fwrite(buf, 1, n, ofp) != n) esl_fatal(msg);
+      size -= n;
+    }
+  fclose(ifp);
+  fclose(ofp);
+
+  /* The default exception handler is fatal, so any exception fails the test */
+  for (pass = 0; pass < 4; pass++)
+    {
+      if (esl_sqfile_OpenDigital(abc, trfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+      switch (pass) {
+      case 0:  while ((status = esl_sqio_Read(sqfp, sq))               == eslOK) esl_sq_Reuse(sq);  break;
+      case 1:  while ((status = esl_sqio_ReadWindow(sqfp, 0, 1000, sq)) == eslOK || status == eslEOD) if (status == eslEOD) esl_sq_Reuse(sq); break;
+      default:
+	if (pass == 3 && esl_sqfile_SetBlockThreads(sqfp, 1 + esl_rnd_Roll(r, 4)) != eslOK) esl_fatal(msg);
+	while ((status = esl_sqio_ReadBlock(sqfp, block, -1, -1, FALSE)) == eslOK) ;
+	break;
+      }
+      if (status != eslEFORMAT)                      esl_fatal(msg);
+      if (*(esl_sqfile_GetErrorBuf(sqfp)) == '\0')   esl_fatal(msg);
+      esl_sqfile_Close(sqfp);
+      esl_sq_Reuse(sq);
+    }
+
+  remove(trfile);
+  esl_sq_Destroy(sq);
+  esl_sq_DestroyBlock(block);
+}
+#endif /*HAVE_ZLIB*/
+
 static void
 make_ssi_index(ESL_ALPHABET *abc, const char *tmpfile, int format, char *ssifile, int mode)
 { 
@@ -2128,6 +2252,144 @@ utest_write(ESL_ALPHABET *abc, ESL_SQ **sqarr, int N, int format)
 }
 
 
+/* write_quirky_fasta()
+ * Write <N> random records of up to <maxL> residues, with the
+ * oddities that FASTA parsers have to agree about: leading
+ * whitespace, spaces and blank lines, DOS line ends, ragged lines,
+ * '>' and ctrl-A in descriptions, a '>' in mid-line starting the
+ * next record, empty sequences, and no newline at EOF. If
+ * <do_badchar> is TRUE, plant one illegal character somewhere.
+ */
+static void
+write_quirky_fasta(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, FILE *fp, int N, int maxL, int do_badchar)
+{
+  int  bad = (do_badchar ? esl_rnd_Roll(r, N) : -1);
+  int  rpl = 1 + esl_rnd_Roll(r, 80);
+  int  i, L, pos;
+  char c;
+
+  if (esl_rnd_Roll(r, 2)) fputs("\n  \n", fp);
+  for (i = 0; i < N; i++)
+    {
+      fprintf(fp, ">%sseq%d", esl_rnd_Roll(r, 5) ? "" : " \t", i);
+      switch (esl_rnd_Roll(r, 5)) {
+      case 0:                                                 break;
+      case 1: fprintf(fp, " desc of seq %d", i);              break;
+      case 2: fprintf(fp, "\t>with >gts> %d", i);             break;
+      case 3: fprintf(fp, " nr-style\001second>desc %d", i);  break;
+      case 4: fprintf(fp, " ");                               break;
+      }
+      fputs(esl_rnd_Roll(r, 4) ? "\n" : "\r\n", fp);
+      while (esl_rnd_Roll(r, 10) == 0) fputc('\n', fp);
+
+      L = (esl_rnd_Roll(r, 10) == 0 ? 0 : esl_rnd_Roll(r, maxL+1));
+      for (pos = 0; pos < L; pos++)
+        {
+          do { c = abc->sym[esl_rnd_Roll(r, abc->Kp-2)]; } while (c == abc->sym[abc->K]);  // no gaps, no missing data
+          if (esl_rnd_Roll(r, 4) == 0) c = tolower(c);
+          if (i == bad && pos == L/2)   c = '9';
+          fputc(c, fp);
+          if (esl_rnd_Roll(r, 200) == 0) fputc(' ', fp);
+          if ((pos+1) % rpl == 0 && pos < L-1)
+            fputs(esl_rnd_Roll(r, 20) ? "\n" : "\r\n", fp);
+        }
+      if (i == bad && L == 0) fputs("9", fp);
+      if      (i == N-1 && esl_rnd_Roll(r, 2)) ;                  // no newline at EOF
+      else if (i <  N-1 && esl_rnd_Roll(r, 50) == 0) ;            // next '>' in mid-line
+      else    fputc('\n', fp);
+      while (esl_rnd_Roll(r, 20) == 0) fputc('\n', fp);
+      if (esl_rnd_Roll(r, 100) == 0) rpl = 1 + esl_rnd_Roll(r, 80); // an occasional change of line length
+    }
+}
+
+static void
+compare_read_blocks(ESL_SQ_BLOCK *b1, ESL_SQ_BLOCK *b2)
+{
+  char   *msg = "sqio read_block unit test failed: blocks differ";
+  ESL_SQ *s1, *s2;
+  int     i;
+
+  if (b1->count != b2->count || b1->complete != b2->complete) esl_fatal(msg);
+  for (i = 0; i < b1->count; i++)
+    {
+      s1 = b1->list + i;
+      s2 = b2->list + i;
+      if (strcmp(s1->name, s2->name) != 0 || strcmp(s1->desc, s2->desc) != 0) esl_fatal(msg);
+      if (s1->n     != s2->n     || s1->L    != s2->L    || s1->W    != s2->W    ||
+          s1->start != s2->start || s1->end  != s2->end  || s1->C    != s2->C)    esl_fatal(msg);
+      if (s1->roff  != s2->roff  || s1->hoff != s2->hoff || s1->doff != s2->doff || s1->eoff != s2->eoff) esl_fatal(msg);
+      if (s1->dsq != NULL && memcmp(s1->dsq, s2->dsq, s1->n+2) != 0) esl_fatal(msg);
+      if (s1->seq != NULL && memcmp(s1->seq, s2->seq, s1->n+1) != 0) esl_fatal(msg);
+    }
+}
+
+/* utest_read_block()
+ * Read <seqfile> in blocks, serially and with threads in parallel,
+ * and check that we get the same blocks, the same state in the
+ * <sqfp>s, and the same errors. Block sizes vary, and sometimes a
+ * single sequence is read in between blocks.
+ */
+static void
+utest_read_block(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, char *seqfile, int expect_status)
+{
+  char         *msg    = "sqio read_block unit test failed";
+  ESL_SQFILE   *sqfp1  = NULL;
+  ESL_SQFILE   *sqfp2  = NULL;
+  ESL_SQ_BLOCK *b1     = (abc ? esl_sq_CreateDigitalBlock(2000, abc) : esl_sq_CreateBlock(2000));
+  ESL_SQ_BLOCK *b2     = (abc ? esl_sq_CreateDigitalBlock(2000, abc) : esl_sq_CreateBlock(2000));
+  ESL_SQ       *sq1    = (abc ? esl_sq_CreateDigital(abc)            : esl_sq_Create());
+  ESL_SQ       *sq2    = (abc ? esl_sq_CreateDigital(abc)            : esl_sq_Create());
+  int           nseq   = 0;
+  int           maxseq;
+  int           s1, s2;
+  int           i;
+
+  if (abc) {
+    if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_FASTA, NULL, &sqfp1) != eslOK) esl_fatal(msg);
+    if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_FASTA, NULL, &sqfp2) != eslOK) esl_fatal(msg);
+  } else {
+    if (esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp1) != eslOK) esl_fatal(msg);
+    if (esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp2) != eslOK) esl_fatal(msg);
+  }
+  if (esl_sqfile_SetBlockThreads(sqfp2, 1 + esl_rnd_Roll(r, 4)) != eslOK) esl_fatal(msg);
+
+  do {
+    maxseq = (esl_rnd_Roll(r, 2) ? -1 : 1 + esl_rnd_Roll(r, 300));
+    s1 = esl_sqio_ReadBlock(sqfp1, b1, -1, maxseq, FALSE);
+    s2 = esl_sqio_ReadBlock(sqfp2, b2, -1, maxseq, FALSE);
+    if (s1 != s2) esl_fatal(msg);
+    if (s1 == eslOK) compare_read_blocks(b1, b2);
+    if (b1->count != b2->count) esl_fatal(msg);
+    if (sqfp1->data.ascii.linenumber != sqfp2->data.ascii.linenumber) esl_fatal(msg);
+    if (sqfp1->data.ascii.rpl != sqfp2->data.ascii.rpl || sqfp1->data.ascii.bpl != sqfp2->data.ascii.bpl) esl_fatal(msg);
+    if (s1 == eslEFORMAT && strcmp(esl_sqfile_GetErrorBuf(sqfp1), esl_sqfile_GetErrorBuf(sqfp2)) != 0) esl_fatal(msg);
+    nseq += b1->count;
+    for (i = 0; i < b1->listSize; i++) { esl_sq_Reuse(b1->list + i); esl_sq_Reuse(b2->list + i); }
+
+    if (s1 == eslOK && esl_rnd_Roll(r, 5) == 0)
+      {
+        s1 = esl_sqio_Read(sqfp1, sq1);
+        s2 = esl_sqio_Read(sqfp2, sq2);
+        if (s1 != s2) esl_fatal(msg);
+        if (s1 == eslOK && (strcmp(sq1->name, sq2->name) != 0 || sq1->n != sq2->n || sq1->roff != sq2->roff || sq1->eoff != sq2->eoff)) esl_fatal(msg);
+        if (s1 == eslOK) nseq++;
+        if (s1 == eslEOF) s1 = eslOK;  // next ReadBlock sees the EOF too
+        esl_sq_Reuse(sq1);
+        esl_sq_Reuse(sq2);
+      }
+  } while (s1 == eslOK);
+  if (s1 != expect_status)                  esl_fatal(msg);
+  if (expect_status == eslEOF && nseq == 0) esl_fatal(msg);
+
+  esl_sqfile_Close(sqfp1);
+  esl_sqfile_Close(sqfp2);
+  esl_sq_DestroyBlock(b1);
+  esl_sq_DestroyBlock(b2);
+  esl_sq_Destroy(sq1);
+  esl_sq_Destroy(sq2);
+}
+
+
 /* utest_guess_mechanics()
  * SRE H3/70, 8 Apr 17
  *
@@ -2220,6 +2482,10 @@ main(int argc, char **argv)
   int             mode;
   char            tmpfile[32];
   char            ssifile[32];
+#ifdef HAVE_ZLIB
+  char            gzfile[48];
+  char            gzssifile[64];
+#endif
   FILE           *fp       = NULL;
   char            c;
 
@@ -2253,11 +2519,36 @@ main(int argc, char **argv)
       utest_read_info   (abc, sqarr, N, tmpfile, eslSQFILE_FASTA, mode);
       utest_read_window (abc, sqarr, N, tmpfile, eslSQFILE_FASTA, mode);
       utest_fetch_subseq(r, abc, sqarr, N, tmpfile, ssifile, eslSQFILE_FASTA);
+      utest_read_block  (r, abc, tmpfile, eslEOF);
+
+#ifdef HAVE_ZLIB  /* the same file, gzip'ed: read in-process, so it can be SSI indexed */
+      sprintf(gzfile, "%s.gz", tmpfile);
+      gzip_testfile(tmpfile, gzfile);
+      make_ssi_index(abc, gzfile, eslSQFILE_FASTA, gzssifile, mode);
+
+      utest_read        (abc, sqarr, N, gzfile, eslSQFILE_FASTA, mode);
+      utest_fetch_subseq(r, abc, sqarr, N, gzfile, gzssifile, eslSQFILE_FASTA);
+      utest_read_block  (r, abc, gzfile, eslEOF);
+      utest_read_truncated_gzip(r, abc, gzfile);
+
+      remove(gzfile);
+      remove(gzssifile);
+#endif
 
       remove(tmpfile);
       remove(ssifile);
     }  
 
+  for (i = 0; i < 4; i++)  /* quirky FASTA, enough for several full blocks: digital and text mode, then with an error */
+    {
+      strcpy(tmpfile, "esltmpXXXXXX");
+      if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal("failed to make tmpfile");
+      write_quirky_fasta(r, abc, fp, 2000, 2000, i/2);
+      fclose(fp);
+      utest_read_block(r, (i%2 ? NULL : abc), tmpfile, (i/2 ? eslEFORMAT : eslEOF));
+      remove(tmpfile);
+    }
+
   utest_guess_mechanics(abc, sqarr, N);
   utest_write          (abc, sqarr, N, eslMSAFILE_STOCKHOLM);
 
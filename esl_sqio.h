@@ -44,6 +44,7 @@ typedef struct esl_sqio_s {
   /* Format-specific configuration                                        */
   int     format;	      /* Format code of this file                 */
   ESL_DSQ inmap[128];	      /* an input map, 0..127                     */
+  int     nthreads;	      /* threads for ReadBlock() parsing; 0=serial*/
 
   /* function pointers to format specific routines                        */
   int   (*position)        (struct esl_sqio_s *sqfp, off_t offset);
@@ -146,6 +147,7 @@ extern char *esl_sqio_DecodeFormat(int fmt);
 extern int   esl_sqfile_Position(ESL_SQFILE *sqfp, off_t offset);
 extern int   esl_sqio_Ignore(ESL_SQFILE *sqfp, const char *ignoredchars);
 extern int   esl_sqio_AcceptAs(ESL_SQFILE *sqfp, char *xchars, char readas);
+extern int   esl_sqfile_SetBlockThreads(ESL_SQFILE *sqfp, int nthreads);
 
 extern int   esl_sqfile_OpenSSI         (ESL_SQFILE *sqfp, const char *ssifile_hint);
 extern int   esl_sqfile_PositionByKey   (ESL_SQFILE *sqfp, const char *key);
@@ -26,9 +26,13 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
+#include "esl_gzfile.h"
 #include "esl_msa.h"
 #include "esl_msafile.h"
 #include "esl_sqio.h"
@@ -59,6 +63,9 @@ static int   sqascii_FetchInfo       (ESL_SQFILE *sqfp, const char *key, ESL_SQ
 static int   sqascii_FetchSubseq     (ESL_SQFILE *sqfp, const char *source, int64_t start, int64_t end, ESL_SQ *sq);
 
 /* Internal routines shared by parsers. */
+static int   sqascii_fread (ESL_SQASCII_DATA *ascii, char *buf, int n, int *ret_n);
+static off_t sqascii_ftello(ESL_SQASCII_DATA *ascii);
+static int   sqascii_fseeko(ESL_SQASCII_DATA *ascii, off_t offset);
 static int  loadmem  (ESL_SQFILE *sqfp);
 static int  loadbuf  (ESL_SQFILE *sqfp);
 static int  nextchar (ESL_SQFILE *sqfp, char *ret_c);
@@ -88,6 +95,7 @@ static void inmap_fasta (ESL_SQFILE *sqfp, const ESL_DSQ *abc_inmap);
 static int  header_fasta(ESL_SQFILE *sqfp, ESL_SQ *sq);
 static int  skip_fasta  (ESL_SQFILE *sqfp, ESL_SQ *sq);
 static int  end_fasta   (ESL_SQFILE *sqfp, ESL_SQ *sq);
+static int  fasta_block_read(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_sequences, int *ret_count, int *ret_size);
 
 /* daemon format */
 static void config_daemon(ESL_SQFILE *sqfp);
@@ -116,10 +124,13 @@ static int  fileheader_hmmpgmd(ESL_SQFILE *sqfp);
  *            There are two special cases for <filename>. If
  *            <filename> is "-", the sequence data are read from a
  *            <STDIN> pipe. If <filename> ends in ".gz", the file is
- *            assumed to be compressed with <gzip>, and it is opened
- *            by a pipe from <gzip -dc>. Reading gzip files only works
- *            on POSIX-compliant systems that have pipes
- *            (specifically, the POSIX.2 popen() call). 
+ *            assumed to be compressed with <gzip>. If Easel was built
+ *            with zlib, it is decompressed in-process (see
+ *            esl_gzfile.c), and it can be repositioned and SSI
+ *            indexed like an uncompressed file, using uncompressed
+ *            offsets. Otherwise it is opened by a pipe from <gzip
+ *            -dc>, which only works on POSIX-compliant systems that
+ *            have pipes (specifically, the POSIX.2 popen() call).
  *
  * Returns:   <eslOK> on success, and <*ret_sqfp> points to a new
  *            open <ESL_SQFILE>. Caller deallocates this object with
@@ -147,6 +158,7 @@ esl_sqascii_Open(char *filename, int format, ESL_SQFILE *sqfp)
   /* Default initializations */
   ascii->fp           = NULL;
   ascii->do_gzip      = FALSE;
+  ascii->gz           = NULL;
   ascii->do_stdin     = FALSE;
   ascii->do_buffer    = FALSE;
 
@@ -205,13 +217,23 @@ esl_sqascii_Open(char *filename, int format, ESL_SQFILE *sqfp)
       }
     }
 
-      /* Deal with the .gz special case: to popen(), "success" only means
+      /* Deal with the .gz special case. With zlib, we read it in-process. 
+       * Else, to popen(), "success" only means
        * it found and executed gzip -dc.  If gzip -dc doesn't find our
        * file, popen() still blithely returns success, so we have to be
        * sure the file exists. That's why we fopen()'ed it above, only to
        * close it and popen() it here.
        */                           
-#ifdef HAVE_POPEN
+#if defined (HAVE_ZLIB)
+      n = strlen(filename);
+      if (n > 3 && strcmp(filename+n-3, ".gz") == 0) 
+      {
+        fclose(ascii->fp);
+        ascii->fp = NULL;
+        status = esl_gzfile_Open(filename, &(ascii->gz));
+        if (status != eslOK) goto ERROR;   /* eslENOTFOUND, or eslEFORMAT if it isn't gzip */
+      }
+#elif defined (HAVE_POPEN)
       n = strlen(filename);
       if (n > 3 && strcmp(filename+n-3, ".gz") == 0) 
       {
@@ -224,7 +246,7 @@ esl_sqascii_Open(char *filename, int format, ESL_SQFILE *sqfp)
         ascii->do_gzip  = TRUE;
         free(cmd);
       }
-#endif /*HAVE_POPEN*/
+#endif /*HAVE_ZLIB, HAVE_POPEN*/
 
       /* If we don't know the format yet, try to autodetect it now. */
       if (format == eslSQFILE_UNKNOWN)
@@ -404,7 +426,8 @@ sqascii_GuessFileFormat(ESL_SQFILE *sqfp, int *ret_fmt)
   if (ascii->is_recording == -1) ESL_EXCEPTION(eslEINVAL, "sq file already too advanced");
   ascii->is_recording = TRUE;
   ascii->is_linebased = TRUE;
-  loadbuf(sqfp);/* now ascii->buf is a line of the file */
+  status = loadbuf(sqfp);/* now ascii->buf is a line of the file */
+  if (status != eslOK && status != eslEOF) goto ERROR;
 
   /* get first nonblank line */
   while (esl_str_IsBlank(ascii->buf)) {
@@ -443,7 +466,8 @@ sqascii_GuessFileFormat(ESL_SQFILE *sqfp, int *ret_fmt)
  *            <offset> would usually be the first byte of a
  *            desired sequence record.
  *            
- *            Only normal sequence files can be positioned to a
+ *            Only normal sequence files (or gzip files, with zlib)
+ *            can be positioned to a
  *            nonzero offset. If <sqfp> corresponds to a standard
  *            input stream or gzip -dc stream, it may not be
  *            repositioned. If <sqfp> corresponds to a multiple
@@ -502,7 +526,17 @@ sqascii_Position(ESL_SQFILE *sqfp, off_t offset)
     }
   else/* normal case: unaligned sequence file */
     {
-      if (fseeko(ascii->fp, offset, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed");
+      /* If <offset> is still in the input we have in <mem>, we don't need to seek and reread it.
+       * Fetching records in offset order (e.g. from an SSI index) often stays in the window.
+       */
+      if (! ascii->is_linebased && ! ascii->do_buffer && ascii->is_recording == -1 && ascii->balloc == 0 &&
+	  ascii->mem != NULL && offset >= ascii->moff && offset < ascii->moff + ascii->mn)
+	ascii->mpos = offset - ascii->moff;
+      else
+	{
+	  if ((status = sqascii_fseeko(ascii, offset)) != eslOK) return status;
+	  ascii->mpos = ascii->mn;/* this forces loadbuf to load new data */
+	}
 
       ascii->currpl     = -1;
       ascii->curbpl     = -1;
@@ -510,7 +544,6 @@ sqascii_Position(ESL_SQFILE *sqfp, off_t offset)
       ascii->prvbpl     = -1;
       ascii->linenumber = (offset == 0) ? 1 : -1; /* -1 is "unknown" */
       ascii->L          = -1;
-      ascii->mpos       = ascii->mn;/* this forces loadbuf to load new data */
       if ((status = loadbuf(sqfp)) != eslOK) return status;
     }
   return eslOK;
@@ -535,6 +568,9 @@ sqascii_Close(ESL_SQFILE *sqfp)
   else 
 #endif
   if (! ascii->do_stdin && ascii->fp != NULL) fclose(ascii->fp);
+#ifdef HAVE_ZLIB
+  if (ascii->gz       != NULL) esl_gzfile_Close(ascii->gz);
+#endif
 
   if (ascii->ssifile  != NULL) free(ascii->ssifile);
   if (ascii->mem      != NULL) free(ascii->mem);
@@ -548,6 +584,7 @@ sqascii_Close(ESL_SQFILE *sqfp)
   ascii->do_stdin = FALSE;
 
   ascii->fp       = NULL;
+  ascii->gz       = NULL;
 
   ascii->ssifile  = NULL;
   ascii->mem      = NULL;
@@ -1413,7 +1450,8 @@ sqascii_ReadWindow(ESL_SQFILE *sqfp, int C, int W, ESL_SQ *sq)
  *            expected to be protein - individual sequences won't be long
  *            so read them in one-whole-sequence at a time. If <max_sequences> is set
  *            to a number > 0 read <max_sequences> sequences, up to at most
- *            MAX_RESIDUE_COUNT residues.
+ *            MAX_RESIDUE_COUNT residues. FASTA records are parsed in
+ *            parallel if <esl_sqfile_SetBlockThreads()> asked for it.
  *
  *            If <long_target> is true, the sequences are expected to be DNA.
  *            Because sequences in a DNA database can exceed MAX_RESIDUE_COUNT,
@@ -1443,6 +1481,8 @@ sqascii_ReadBlock(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_residues, int
   int     status = eslOK;
   ESL_SQ *tmpsq = NULL;
 
+  ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
+
   sqBlock->count = 0;
   if (max_sequences < 1 || max_sequences > sqBlock->listSize)
     max_sequences = sqBlock->listSize;
@@ -1452,7 +1492,16 @@ sqascii_ReadBlock(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_residues, int
   {  /* in these cases, an individual sequence won't ever be really long,
       so just read in a sequence at a time  */
 
-    for (i = 0; i < max_sequences && size < MAX_RESIDUE_COUNT; ++i)
+    /* FASTA records can be parsed in parallel, whole, if the caller asked for threads.
+     * Whatever that leaves (usually nothing; or a record with a format error) is read below.
+     */
+    if (sqfp->nthreads > 0 && ascii->parse_header == &header_fasta && ascii->eof_is_ok)
+    {
+      if ((status = fasta_block_read(sqfp, sqBlock, max_sequences, &i, &size)) != eslOK) return status;
+      sqBlock->count = i;
+    }
+
+    for ( ; i < max_sequences && size < MAX_RESIDUE_COUNT; ++i)
     {
       status = sqascii_Read(sqfp, sqBlock->list + i);
 
@@ -1484,6 +1533,7 @@ sqascii_ReadBlock(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_residues, int
 
           sqBlock->complete = FALSE; // default value, unless overridden below
           status = skip_whitespace(sqfp);
+          if ( status == eslEFORMAT || status == eslEMEM) { esl_sq_Destroy(tmpsq); return status; }
           if ( status != eslOK ) { // either EOD or end of buffer (EOF) was reached before the next character was seen
             sqBlock->complete = TRUE;
             status = eslOK;
@@ -1542,6 +1592,7 @@ sqascii_ReadBlock(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_residues, int
         sqBlock->complete = FALSE; // default value, unless overridden below
 
         status = skip_whitespace(sqfp);
+        if ( status == eslEFORMAT || status == eslEMEM) { esl_sq_Destroy(tmpsq); return status; }
         if ( status != eslOK ) { // either EOD or end of buffer (EOF) was reached before the next character was seen
           sqBlock->complete = TRUE;
           status = eslOK;
@@ -2003,6 +2054,68 @@ sqascii_FetchSubseq(ESL_SQFILE *sqfp, const char *source, int64_t start, int64_t
  *****************************************************************/
 
 
+/* sqascii_fread(), sqascii_ftello(), sqascii_fseeko()
+ *
+ * Read, tell, and seek on the input: the stream <ascii->fp>, or
+ * an in-process gzip file <ascii->gz>, whose offsets are
+ * uncompressed offsets. 
+ *
+ * sqascii_fread() returns <eslOK>, with the number of bytes read (0
+ * at EOF) in <*ret_n>. It returns <eslEFORMAT> if gzip data are
+ * corrupt or truncated, with the gzip error in <ascii->errbuf>; that's
+ * a bad input file, not a bug, so it's a normal parse failure.
+ * sqascii_fseeko() returns <eslOK>, or <eslEFORMAT> likewise, or
+ * throws <eslESYS>; seeking past the end isn't an error here, as with
+ * fseeko(), and the next read just returns nothing.
+ */
+static int
+sqascii_fread(ESL_SQASCII_DATA *ascii, char *buf, int n, int *ret_n)
+{
+#ifdef HAVE_ZLIB
+  int64_t nread;
+  int     status;
+
+  if (ascii->gz)
+    {
+      status = esl_gzfile_Read(ascii->gz, buf, n, &nread);
+      *ret_n = (int) nread;
+      if      (status == eslEOF)     return eslOK;
+      else if (status == eslEFORMAT) ESL_FAIL(eslEFORMAT, ascii->errbuf, "%s", ascii->gz->errmsg);
+      return status;
+    }
+#endif
+  *ret_n = fread(buf, sizeof(char), n, ascii->fp);
+  return eslOK;
+}
+
+static off_t
+sqascii_ftello(ESL_SQASCII_DATA *ascii)
+{
+#ifdef HAVE_ZLIB
+  if (ascii->gz) return (off_t) esl_gzfile_Tell(ascii->gz);
+#endif
+  return ftello(ascii->fp);
+}
+
+static int
+sqascii_fseeko(ESL_SQASCII_DATA *ascii, off_t offset)
+{
+#ifdef HAVE_ZLIB
+  int status;
+
+  if (ascii->gz)
+    {
+      status = esl_gzfile_Seek(ascii->gz, (int64_t) offset);
+      if      (status == eslEOF)     return eslOK;
+      else if (status == eslEFORMAT) ESL_FAIL(eslEFORMAT, ascii->errbuf, "%s", ascii->gz->errmsg);
+      return status;
+    }
+#endif
+  if (fseeko(ascii->fp, offset, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed");
+  return eslOK;
+}
+
+
 /* loadmem() 
  *
  * Load the next block of data from stream into mem buffer,
@@ -2019,6 +2132,7 @@ sqascii_FetchSubseq(ESL_SQFILE *sqfp, const char *source, int64_t start, int64_t
  * 
  * Returns <eslEOF> (and mpos == mn) if no new data can be read;
  * Returns <eslOK>  (and mpos < mn) if new data is read. 
+ * Returns <eslEFORMAT> if gzip'ed input is corrupt, with <ascii->errbuf> set.
  * Throws <eslEMEM> on allocation error.
  */
 static int
@@ -2037,10 +2151,10 @@ loadmem(ESL_SQFILE *sqfp)
   }
   else if (ascii->is_recording == TRUE)
   {
-      if (ascii->mem == NULL) ascii->moff = ftello(ascii->fp);        /* first time init of the offset */
+      if (ascii->mem == NULL) ascii->moff = sqascii_ftello(ascii);    /* first time init of the offset */
       ESL_RALLOC(ascii->mem, tmp, sizeof(char) * (ascii->allocm + eslREADBUFSIZE));
       ascii->allocm += eslREADBUFSIZE;
-      n = fread(ascii->mem + ascii->mpos, sizeof(char), eslREADBUFSIZE, ascii->fp);
+      if ((status = sqascii_fread(ascii, ascii->mem + ascii->mpos, eslREADBUFSIZE, &n)) != eslOK) return status;
       ascii->mn += n;
   }
   else
@@ -2051,8 +2165,8 @@ loadmem(ESL_SQFILE *sqfp)
       }
       ascii->is_recording = -1;/* no more recording is possible now */
       ascii->mpos = 0;
-      ascii->moff = ftello(ascii->fp);
-      n = fread(ascii->mem, sizeof(char), eslREADBUFSIZE, ascii->fp); /* see note [1] below */
+      ascii->moff = sqascii_ftello(ascii);
+      if ((status = sqascii_fread(ascii, ascii->mem, eslREADBUFSIZE, &n)) != eslOK) return status; /* see note [1] below */
       ascii->mn   = n;
   }
   return (n == 0 ? eslEOF : eslOK);
@@ -2094,6 +2208,7 @@ loadmem(ESL_SQFILE *sqfp)
  * Reset sqfp->nc to the number of chars (bytes) in the new block/line.
  * Returns eslOK on success; eslEOF if there's no more data in the file.
  * (sqfp->nc == 0 is the same as eslEOF: no data in the new buffer.)
+ * Returns eslEFORMAT if gzip'ed input is corrupt, with <ascii->errbuf> set.
  * Can throw an <eslEMEM> error.
  */
 static int
@@ -2109,7 +2224,7 @@ loadbuf(ESL_SQFILE *sqfp)
   if (! ascii->is_linebased)
   {
       if (ascii->mpos >= ascii->mn) {
-        if ((status = loadmem(sqfp)) == eslEMEM) return status;
+        if ((status = loadmem(sqfp)) != eslOK && status != eslEOF) return status;
       }
       ascii->buf    = ascii->mem  + ascii->mpos;
       ascii->boff   = ascii->moff + ascii->mpos;
@@ -2121,7 +2236,7 @@ loadbuf(ESL_SQFILE *sqfp)
   else
   { /* Copy next line from <mem> into <buf>. Might require new load(s) into <mem>. */
       if (ascii->mpos >= ascii->mn) {
-        if ((status = loadmem(sqfp)) == eslEMEM) return status;
+        if ((status = loadmem(sqfp)) != eslOK && status != eslEOF) return status;
       }
       ascii->boff = ascii->moff + ascii->mpos;      
       ascii->nc   = 0;
@@ -2235,6 +2350,7 @@ seebuf(ESL_SQFILE *sqfp, int64_t maxn, int64_t *opt_nres, int64_t *opt_endpos)
   int     bpos;
   int64_t nres  = 0;
   int64_t nres2 = 0;/* an optimization for determining lastrpl from nres, without incrementing lastrpl on every char */
+  int64_t nrun;
   int     sym;
   ESL_DSQ x;
   int     lasteol;
@@ -2247,6 +2363,12 @@ seebuf(ESL_SQFILE *sqfp, int64_t maxn, int64_t *opt_nres, int64_t *opt_endpos)
 
   for (bpos = ascii->bpos; nres < maxn && bpos < ascii->nc; bpos++)
   {
+      /* Runs of residues go fast; everything else is dealt with one byte at a time below. */
+      nrun  = esl_abc_DigitizeRun(sqfp->inmap, ascii->buf + bpos, ESL_MIN(ascii->nc - bpos, maxn - nres), NULL);
+      nres += nrun;
+      bpos += nrun;
+      if (nres == maxn || bpos == ascii->nc) break;
+
       sym = ascii->buf[bpos];
       //printf ("nres: %d, bpos: %d  (%d)\n", nres, bpos, sym);
       if (!isascii(sym)) ESL_FAIL(eslEFORMAT, ascii->errbuf, "Line %" PRId64 ": non-ASCII character %c in sequence", ascii->linenumber, sym); 
@@ -2317,11 +2439,18 @@ static void
 addbuf(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nres)
 {
   ESL_DSQ x;
+  int64_t nrun;
   ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
 
+  /* There are at least <nres> bytes left in the buffer, and room for <nres> residues in <sq>. */
   if (sq->dsq != NULL) 
     {
       while (nres) {
+        nrun         = esl_abc_DigitizeRun(sq->abc->inmap, ascii->buf + ascii->bpos, nres, sq->dsq + sq->n + 1);
+        ascii->bpos += nrun;
+        sq->n       += nrun;
+        if ((nres -= nrun) == 0) break;
+
         x  = sq->abc->inmap[(int) ascii->buf[ascii->bpos++]];
         if (x <= 127) { nres--; sq->dsq[++sq->n] = x; }
       } /* we skipped IGNORED, EOL. EOD, ILLEGAL don't occur; seebuf() already checked  */
@@ -2329,6 +2458,11 @@ addbuf(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nres)
   else
     {
       while (nres) {
+        nrun         = esl_abc_DigitizeRun(sqfp->inmap, ascii->buf + ascii->bpos, nres, (ESL_DSQ *) sq->seq + sq->n);
+        ascii->bpos += nrun;
+        sq->n       += nrun;
+        if ((nres -= nrun) == 0) break;
+
         x   = sqfp->inmap[(int) ascii->buf[ascii->bpos++]];
         if (x <= 127) { nres--; sq->seq[sq->n++] = x; }
       }
@@ -2343,9 +2477,14 @@ static void
 skipbuf(ESL_SQFILE *sqfp, int64_t nskip)
 {
   ESL_DSQ x;
+  int64_t nrun;
   ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
 
   while (nskip) {
+    nrun         = esl_abc_DigitizeRun(sqfp->inmap, ascii->buf + ascii->bpos, nskip, NULL);
+    ascii->bpos += nrun;
+    if ((nskip -= nrun) == 0) break;
+
     x  = sqfp->inmap[(int) ascii->buf[ascii->bpos++]];
     if (x <= 127) nskip--;/* skip IGNORED, EOL. */
   }
@@ -2385,8 +2524,8 @@ skip_whitespace(ESL_SQFILE *sqfp)
     ascii->bpos++;
 
     if (ascii->bpos == ascii->nc)
-      if ((status = loadbuf(sqfp)) == eslEOF)
-        return eslEOF;
+      if ((status = loadbuf(sqfp)) != eslOK)
+        return status;
 
     c = (int) ascii->buf[ascii->bpos];
     x  = sqfp->inmap[c];
@@ -2442,7 +2581,7 @@ read_nres(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nskip, int64_t nres, int64_t *op
   status = seebuf(sqfp, nskip+nres, &n, &epos);
   while (status == eslOK && nskip - n > 0) {
     nskip   -= n;
-    if ((status = loadbuf(sqfp)) == eslEOF) break;
+    if ((status = loadbuf(sqfp)) != eslOK) break;
     status = seebuf(sqfp, nskip+nres, &n, &epos);
   }
   
@@ -2463,7 +2602,7 @@ read_nres(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nskip, int64_t nres, int64_t *op
       addbuf(sqfp, sq, n);
       actual_nres += n;
       nres        -= n;
-      if ((status = loadbuf(sqfp)) == eslEOF) break;
+      if ((status = loadbuf(sqfp)) != eslOK) break;
       status = seebuf(sqfp, nres, &n, &epos);
     }
 
@@ -2471,7 +2610,7 @@ read_nres(ESL_SQFILE *sqfp, ESL_SQ *sq, int64_t nskip, int64_t nres, int64_t *op
   if        (status == eslEOF) { 
     if (! ascii->eof_is_ok) ESL_FAIL(eslEFORMAT, ascii->errbuf, "Premature EOF before end of seq record");
     n = 0;
-  } else if  (status == eslEFORMAT) {
+  } else if  (status != eslOK && status != eslEOD) {
     return status;
   }
 
@@ -3117,6 +3256,451 @@ end_fasta(ESL_SQFILE *sqfp, ESL_SQ *sq)
 }
 
 
+/* Parallel parsing of FASTA blocks, for sqascii_ReadBlock().
+ *
+ * fasta_block_read() reads ahead in large buffers, appending to
+ * <ascii->mem>, and finds record boundaries: the end of each header
+ * line, and the next '>' after it. Record k is <mem[rs[k]..rs[k+1]-1]>.
+ * Then threads parse whole records, each into its own <ESL_SQ> in the
+ * block. Afterwards, the <sqfp> is left positioned at the first
+ * record it didn't parse, with the rest of the data still buffered,
+ * so any of the serial parsers can carry on from there.
+ *
+ * A block ends after the first sequence that brings its residue count
+ * to MAX_RESIDUE_COUNT. We can't know residue counts until records are
+ * parsed, but a record's data length in bytes is an upper bound, so
+ * records are parsed in rounds: each round takes only records that
+ * are certain to be in the block, given the residues counted so far.
+ * The first round usually gets all but the last few records.
+ *
+ * Anything the parallel parser doesn't like (a format error, say) stops
+ * it at the start of that record. The serial parser then reads the
+ * record again and reports the error, with the same message and line
+ * number it always would.
+ */
+typedef struct {
+  int64_t *rs;                  /* rs[k] = offset in <mem> of record k's '>'; rs[nrec] = end of last complete record */
+  int64_t *he;                  /* he[k] = offset in <mem> of the end of record k's header line                    */
+  int      nalloc;              /* rs, he allocated for this many records                                          */
+  int      nstart;              /* number of records whose start we've seen                                        */
+  int      nrec;                /* number of complete records                                                      */
+  int64_t  scan;                /* offset in <mem> where the scan picks up                                         */
+  int      in_hdr;              /* TRUE if the scan is in the header line of record <nstart-1>                     */
+  int      eof;                 /* TRUE once input is exhausted                                                    */
+} FASTA_BLOCKSCAN;
+
+typedef struct {
+  int      status;              /* eslOK, or eslEFORMAT for anything that the serial parser should look at */
+  int64_t  nres;                /* residues in the record                                                 */
+  int64_t  nlines;              /* newlines in its sequence data                                          */
+  int      rpl;                 /* residues per line over the record's lines, as seebuf() does it: -1,0,n */
+  int      bpl;                 /* bytes per line, ditto                                                  */
+} FASTA_BLOCKREC;
+
+typedef struct {
+  const ESL_SQFILE *sqfp;
+  const int64_t    *rs;
+  ESL_SQ           *sqlist;     /* sqBlock->list                          */
+  FASTA_BLOCKREC   *rec;        /* results for each record                */
+  int               lo, hi;     /* this job parses records lo..hi-1       */
+  int               status;     /* eslOK, or eslEMEM                      */
+} FASTA_BLOCKJOB;
+
+/* fasta_block_fill()
+ * Append up to <eslREADBUFSIZE * 64> more bytes of input to <ascii->mem>.
+ * Sets <sc->eof> if there's no more input.
+ */
+static int
+fasta_block_fill(ESL_SQFILE *sqfp, FASTA_BLOCKSCAN *sc)
+{
+  ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
+  int               chunk = eslREADBUFSIZE * 64;
+  void             *tmp;
+  int               n;
+  int               status;
+
+  if (ascii->mn + chunk > ascii->allocm)
+    {
+      ESL_RALLOC(ascii->mem, tmp, sizeof(char) * (ascii->mn + chunk));
+      ascii->allocm = ascii->mn + chunk;
+    }
+  if ((status = sqascii_fread(ascii, ascii->mem + ascii->mn, chunk, &n)) != eslOK) return status;
+  ascii->mn += n;
+  if (n == 0) sc->eof = TRUE;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* fasta_block_scan()
+ * Advance the boundary scan by one step: find the end of the current
+ * header line, or the start of the next record, or else read more
+ * input. At EOF, the last record is complete.
+ */
+static int
+fasta_block_scan(ESL_SQFILE *sqfp, FASTA_BLOCKSCAN *sc)
+{
+  ESL_SQASCII_DATA *ascii = &sqfp->data.ascii;
+  const char       *mem   = ascii->mem;
+  char             *q;
+  int64_t           pos;
+  void             *tmp;
+  int               status;
+
+  if (sc->in_hdr)
+    {
+      for (pos = sc->scan; pos < ascii->mn && mem[pos] != '\n' && mem[pos] != '\r'; pos++) ;
+      if (pos < ascii->mn) { sc->he[sc->nstart-1] = pos; sc->scan = pos; sc->in_hdr = FALSE; return eslOK; }
+    }
+  else if ((q = memchr(mem + sc->scan, '>', ascii->mn - sc->scan)) != NULL)
+    {
+      if (sc->nstart == sc->nalloc)
+        {
+          ESL_RALLOC(sc->rs, tmp, sizeof(int64_t) * (sc->nalloc * 2 + 1));
+          ESL_RALLOC(sc->he, tmp, sizeof(int64_t) * (sc->nalloc * 2));
+          sc->nalloc *= 2;
+        }
+      sc->rs[sc->nstart] = q - mem;
+      sc->nrec           = sc->nstart;
+      sc->nstart++;
+      sc->scan           = sc->rs[sc->nrec] + 1;
+      sc->in_hdr         = TRUE;
+      return eslOK;
+    }
+  sc->scan = ascii->mn;
+
+  if ((status = fasta_block_fill(sqfp, sc)) != eslOK) return status;
+  if (sc->eof)
+    {
+      if (sc->in_hdr) sc->he[sc->nstart-1] = ascii->mn;
+      sc->rs[sc->nstart] = ascii->mn;
+      sc->nrec           = sc->nstart;
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* fasta_block_parse()
+ * Parse one complete FASTA record <p[0..n-1]> into <sq>, exactly as
+ * header_fasta(), seebuf() and addbuf() would. <p[0]> is the '>', and
+ * <off> is its disk offset. Newline and line length bookkeeping go
+ * into <rec>, for the caller to fold into the <sqfp> in order.
+ *
+ * Returns <eslOK> on success. Returns <eslEFORMAT> if anything's
+ * wrong with the record, leaving <sq->n> as it was; the serial
+ * parser will read it again and say what. Throws <eslEMEM> on
+ * allocation failure.
+ */
+static int
+fasta_block_parse(const ESL_SQFILE *sqfp, const char *p, int64_t n, off_t off, ESL_SQ *sq, FASTA_BLOCKREC *rec)
+{
+  ESL_DSQ  *dsq    = sq->dsq;
+  int64_t   n0     = sq->n;
+  int64_t   nres   = 0;
+  int64_t   nres0  = 0;     /* nres at the last newline */
+  int64_t   lasteol;
+  int64_t   pos, s;
+  int64_t   nrun, k;
+  int       prvrpl = -1;
+  int       prvbpl = -1;
+  int       sym;
+  ESL_DSQ   x;
+  void     *tmp;
+  int       status;
+
+  /* Header: name, then description, then end of line. */
+  for (pos = 1; pos < n && (p[pos] == '\t' || p[pos] == ' '); pos++) ;
+  for (s = pos; pos < n && ! isspace(p[pos]); pos++) ;
+  if (pos == s) return eslEFORMAT;
+  if (pos - s > sq->nalloc - 2) {
+    while (pos - s > sq->nalloc - 2) sq->nalloc *= 2;
+    ESL_RALLOC(sq->name, tmp, sizeof(char) * sq->nalloc);
+  }
+  memcpy(sq->name, p + s, pos - s);
+  sq->name[pos - s] = '\0';
+
+  for ( ; pos < n && (p[pos] == '\t' || p[pos] == ' '); pos++) ;
+  for (s = pos; pos < n && p[pos] != '\n' && p[pos] != '\r' && p[pos] != 1; pos++) ;
+  if (pos - s > sq->dalloc - 2) {
+    while (pos - s > sq->dalloc - 2) sq->dalloc *= 2;
+    ESL_RALLOC(sq->desc, tmp, sizeof(char) * sq->dalloc);
+  }
+  memcpy(sq->desc, p + s, pos - s);
+  sq->desc[pos - s] = '\0';
+
+  for ( ; pos < n && p[pos] != '\n' && p[pos] != '\r'; pos++) ;
+  sq->roff = off;
+  sq->hoff = off + pos;
+  for ( ; pos < n && (p[pos] == '\n' || p[pos] == '\r'); pos++) ;
+  sq->doff = off + pos;
+
+  /* Sequence data. The data length bounds the residue count. */
+  if ((status = esl_sq_GrowTo(sq, n0 + (n - pos))) != eslOK) return status;
+  dsq = sq->dsq;
+
+  rec->nlines = 0;
+  rec->rpl    = -1;
+  rec->bpl    = -1;
+  for (lasteol = pos - 1; pos < n; pos++)
+    {
+      if (dsq)
+        {
+          nrun = esl_abc_DigitizeRun(sqfp->inmap, p + pos, n - pos, NULL);
+          for (k = esl_abc_DigitizeRun(sq->abc->inmap, p + pos, nrun, dsq + n0 + nres + 1); k < nrun; k++)
+            dsq[n0 + nres + 1 + k] = sq->abc->inmap[(int) p[pos + k]];
+        }
+      else nrun = esl_abc_DigitizeRun(sqfp->inmap, p + pos, n - pos, (ESL_DSQ *) sq->seq + n0 + nres);
+      nres += nrun;
+      pos  += nrun;
+      if (pos == n) break;
+
+      sym = p[pos];
+      if (! isascii(sym)) goto FORMAT;
+      x = sqfp->inmap[sym];
+      if (x <= 127)
+        {
+          if (dsq) dsq[n0 + (++nres)]   = sq->abc->inmap[sym];
+          else     sq->seq[n0 + nres++] = x;
+        }
+      else if (x == eslDSQ_EOL)
+        {
+          /* seebuf() checks each line's length when the next one ends, so a record's last line isn't checked */
+          if (rec->rpl != 0 && prvrpl != -1) {
+            if      (rec->rpl == -1)     rec->rpl = prvrpl;
+            else if (prvrpl != rec->rpl) rec->rpl = 0;
+          }
+          if (rec->bpl != 0 && prvbpl != -1) {
+            if      (rec->bpl == -1)     rec->bpl = prvbpl;
+            else if (prvbpl != rec->bpl) rec->bpl = 0;
+          }
+          prvrpl  = nres - nres0;
+          prvbpl  = pos  - lasteol;
+          nres0   = nres;
+          lasteol = pos;
+          rec->nlines++;
+        }
+      else if (x != eslDSQ_IGNORED) goto FORMAT;
+    }
+
+  sq->n    = n0 + nres;
+  sq->eoff = off + n - 1;
+  if (dsq) dsq[sq->n+1]   = eslDSQ_SENTINEL;
+  else     sq->seq[sq->n] = '\0';
+  sq->start = 1;
+  sq->end   = sq->n;
+  sq->C     = 0;
+  sq->W     = sq->n;
+  sq->L     = sq->n;
+  rec->nres = nres;
+  return eslOK;
+
+ FORMAT:
+  return eslEFORMAT;
+ ERROR:
+  return status;
+}
+
+/* fasta_block_job()
+ * Parse records <job->lo..hi-1>. Can run as a thread.
+ */
+static void *
+fasta_block_job(void *arg)
+{
+  FASTA_BLOCKJOB         *job   = (FASTA_BLOCKJOB *) arg;
+  const ESL_SQASCII_DATA *ascii = &job->sqfp->data.ascii;
+  int                     k;
+
+  job->status = eslOK;
+  for (k = job->lo; k < job->hi; k++)
+    {
+      job->rec[k].status = fasta_block_parse(job->sqfp, ascii->mem + job->rs[k], job->rs[k+1] - job->rs[k],
+                                             ascii->moff + job->rs[k], job->sqlist + k, job->rec + k);
+      if (job->rec[k].status == eslEMEM) { job->status = eslEMEM; break; }
+    }
+  return NULL;
+}
+
+/* fasta_block_read()
+ * 
+ * Read and parse as many FASTA records as possible into <sqBlock>,
+ * in parallel, stopping at <max_sequences> records or once the block
+ * has MAX_RESIDUE_COUNT residues, just as the serial loop in
+ * sqascii_ReadBlock() does. Leave <sqfp> positioned at the next
+ * record. Return the number of records read in <*ret_count>, and
+ * the residues in them in <*ret_size>.
+ *
+ * Stops early, possibly with no records read at all, when it's
+ * better left to the serial parser: at the end of the input, at a
+ * format error, or if the input isn't buffered the way we expect.
+ *
+ * Returns <eslOK> on success. Throws <eslEMEM> on allocation failure.
+ */
+static int
+fasta_block_read(ESL_SQFILE *sqfp, ESL_SQ_BLOCK *sqBlock, int max_sequences, int *ret_count, int *ret_size)
+{
+  ESL_SQASCII_DATA *ascii   = &sqfp->data.ascii;
+  FASTA_BLOCKSCAN   sc;
+  FASTA_BLOCKREC   *rec     = NULL;
+  FASTA_BLOCKJOB   *job     = NULL;
+  int               recalloc = 0;
+  int               ndone   = 0;
+  int               size    = 0;
+  int               r, k, t, nt, f;
+  int64_t           dsum, bytes;
+  int64_t           off;
+  void             *tmp;
+  int               status;
+#ifdef HAVE_PTHREAD
+  pthread_t        *tid     = NULL;
+  int              *running = NULL;
+#endif
+
+  sc.rs = sc.he = NULL;
+  *ret_count = 0;
+  *ret_size  = 0;
+  if (ascii->nc == 0 || ascii->do_buffer || ascii->is_recording == TRUE || ascii->balloc > 0) return eslOK;
+
+  /* Shift unparsed input to the start of <mem>, so <buf> == <mem> and bpos = 0 */
+  off = (ascii->buf - ascii->mem) + ascii->bpos;
+  memmove(ascii->mem, ascii->mem + off, ascii->mn - off);
+  ascii->moff         += off;
+  ascii->mn           -= off;
+  ascii->is_recording  = -1;
+
+  ESL_ALLOC(sc.rs, sizeof(int64_t) * 257);
+  ESL_ALLOC(sc.he, sizeof(int64_t) * 256);
+  sc.nalloc = 256;
+  sc.nstart = 0;
+  sc.nrec   = 0;
+  sc.in_hdr = FALSE;
+  sc.eof    = FALSE;
+
+#ifdef HAVE_ZLIB
+  if (ascii->gz) esl_gzfile_SetThreads(ascii->gz, sqfp->nthreads);  /* BGZF: decompress in parallel too */
+#endif
+
+  /* The first record may be preceded by whitespace, which header_fasta() skips */
+  for (sc.scan = 0; ; )
+    {
+      while (sc.scan < ascii->mn && isspace(ascii->mem[sc.scan])) sc.scan++;
+      if    (sc.scan < ascii->mn || sc.eof) break;
+      if ((status = fasta_block_fill(sqfp, &sc)) != eslOK) goto ERROR;
+    }
+  sc.rs[0] = sc.scan;
+  if (sc.scan == ascii->mn || ascii->mem[sc.scan] != '>') goto DONE;
+  sc.nstart = 1;
+  sc.scan   = sc.rs[0] + 1;
+  sc.in_hdr = TRUE;
+
+  while (ndone < max_sequences && size < MAX_RESIDUE_COUNT)
+    {
+      /* This round: records ndone..r-1, all certain to be in the block */
+      for (r = ndone, dsum = 0; r < max_sequences && dsum < MAX_RESIDUE_COUNT - size; r++)
+        {
+          while (r >= sc.nrec && ! sc.eof)
+            if ((status = fasta_block_scan(sqfp, &sc)) != eslOK) goto ERROR;
+          if (r >= sc.nrec) break;
+          dsum += sc.rs[r+1] - sc.he[r];
+        }
+      if (r == ndone) break;
+
+      if (r > recalloc) {
+        recalloc = ESL_MAX(r, 2*recalloc);
+        ESL_RALLOC(rec, tmp, sizeof(FASTA_BLOCKREC) * recalloc);
+      }
+
+      /* Split the round into contiguous runs of records, about equal in bytes, one per thread */
+      bytes = sc.rs[r] - sc.rs[ndone];
+      nt    = ESL_MIN(r - ndone, 1 + bytes / (eslREADBUFSIZE * 16));
+      nt    = ESL_MAX(1, ESL_MIN(nt, sqfp->nthreads));
+      ESL_RALLOC(job, tmp, sizeof(FASTA_BLOCKJOB) * nt);
+      for (k = ndone, t = 0; t < nt; t++)
+        {
+          job[t].sqfp   = sqfp;
+          job[t].rs     = sc.rs;
+          job[t].sqlist = sqBlock->list;
+          job[t].rec    = rec;
+          job[t].lo     = k;
+          while (k < r && (t == nt-1 || sc.rs[k] - sc.rs[ndone] < (bytes * (t+1)) / nt)) k++;
+          job[t].hi     = k;
+        }
+
+#ifdef HAVE_PTHREAD
+      ESL_RALLOC(tid,     tmp, sizeof(pthread_t) * nt);
+      ESL_RALLOC(running, tmp, sizeof(int)       * nt);
+      for (t = 1; t < nt; t++)
+        running[t] = (pthread_create(&tid[t], NULL, fasta_block_job, &job[t]) == 0);
+      fasta_block_job(&job[0]);
+      for (t = 1; t < nt; t++)
+        {
+          if (running[t]) pthread_join(tid[t], NULL);
+          else            fasta_block_job(&job[t]);
+        }
+#else
+      for (t = 0; t < nt; t++) fasta_block_job(&job[t]);
+#endif
+      for (t = 0; t < nt; t++)
+        if (job[t].status != eslOK) { status = job[t].status; goto ERROR; }
+
+      /* Fold results into <sqfp> in order, up to the first record we couldn't parse */
+      for (f = ndone; f < r && rec[f].status == eslOK; f++)
+        {
+          size              += sqBlock->list[f].n;
+          ascii->L          += rec[f].nres;
+          ascii->linenumber += 1 + rec[f].nlines;
+          if (ascii->rpl != 0 && rec[f].rpl != -1) {
+            if      (ascii->rpl == -1)          ascii->rpl = rec[f].rpl;
+            else if (rec[f].rpl != ascii->rpl) ascii->rpl = 0;
+          }
+          if (ascii->bpl != 0 && rec[f].bpl != -1) {
+            if      (ascii->bpl == -1)          ascii->bpl = rec[f].bpl;
+            else if (rec[f].bpl != ascii->bpl) ascii->bpl = 0;
+          }
+        }
+      ndone = f;
+      if (f < r)
+        { /* records after a bad one were parsed for nothing; the serial parser won't get to them */
+          for (k = f+1; k < r; k++) esl_sq_Reuse(sqBlock->list + k);
+          break;
+        }
+    }
+
+ DONE:
+  /* Leave <sqfp> positioned at record <ndone>, with the rest of the input still buffered */
+  ascii->buf  = ascii->mem;
+  ascii->boff = ascii->moff;
+  ascii->nc   = ascii->mn;
+  ascii->mpos = ascii->mn;
+  ascii->bpos = sc.rs[ndone];
+
+  *ret_count = ndone;
+  *ret_size  = size;
+  status     = eslOK;
+  /* fallthrough */
+ ERROR:
+  if (status != eslOK)
+    { /* keep <buf> valid; <mem> may have moved */
+      ascii->buf  = ascii->mem;
+      ascii->boff = ascii->moff;
+      ascii->nc   = ascii->mn;
+      ascii->mpos = ascii->mn;
+      ascii->bpos = 0;
+    }
+#ifdef HAVE_PTHREAD
+  free(tid);
+  free(running);
+#endif
+  free(job);
+  free(rec);
+  free(sc.rs);
+  free(sc.he);
+  return status;
+}
+
+
 /* Function:  esl_sqascii_WriteFasta()
  * Synopsis:  Write a sequence in FASTA foramt
  *
@@ -3253,6 +3837,7 @@ esl_sqascii_Parse(char *buf, int size, ESL_SQ *sq, int format)
   /* fill in a dummy esl_sqfile structure used to parse buf */
   ascii->fp           = NULL;
   ascii->do_gzip      = FALSE;
+  ascii->gz           = NULL;
   ascii->do_stdin     = FALSE;
   ascii->do_buffer    = TRUE;
 
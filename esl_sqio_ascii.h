@@ -17,8 +17,9 @@
 /* set the max residue count to 1 meg when reading a block */
 #define MAX_RESIDUE_COUNT (1024 * 1024)
 
-/* forward declaration */
+/* forward declarations */
 struct esl_sqio_s;
+struct esl_gzfile_s;
 
 /* ESL_SQASCII:
  * An open sequence file for reading.
@@ -29,6 +30,7 @@ typedef struct esl_sqascii_s {
   char  errbuf[eslERRBUFSIZE];/* parse error mesg.  Size must match msa.h */
 
   int   do_gzip;	      /* TRUE if we're reading from gzip -dc pipe */
+  struct esl_gzfile_s *gz;    /* open .gz file read w/ zlib; else NULL    */
   int   do_stdin;	      /* TRUE if we're reading from stdin         */
   int   do_buffer;            /* TRUE if we're reading from a buffer      */
 
@@ -11,8 +11,20 @@
 #include "esl_config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef _POSIX_VERSION
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* _POSIX_VERSION */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include "easel.h"
 #include "esl_ssi.h"
 
@@ -24,8 +36,35 @@ static uint32_t v30swap  = 0xb3c9d3d3; /* byteswapped */
  *# 1. Using (reading) an SSI index.
  *****************************************************************/ 
 
+/* A sequential cursor over a sorted key table (primary or secondary
+ * keys), for batch lookups. If the index is mapped, records are read
+ * straight from memory; else they're read <eslSSI_WINDOW> at a time.
+ */
+struct ssi_cursor {
+  off_t     base;     /* disk offset of the table: poffset or soffset */
+  uint32_t  recsize;  /* bytes per record: precsize or srecsize       */
+  uint32_t  klen;     /* key length, inc '\0': plen or slen           */
+  uint64_t  n;        /* number of records: nprimary or nsecondary    */
+  char     *buf;      /* unmapped: window of records...               */
+  uint64_t  first;    /*   ... first..first+nbuf-1                    */
+  uint64_t  nbuf;
+};
+
+/* A query key in a batch lookup, remembering its place in the caller's list. */
+struct ssi_query {
+  const char *key;
+  int64_t     i;
+};
+
 static int  binary_search(ESL_SSI *ssi, const char *key, uint32_t klen, off_t base, 
-			  uint32_t recsize, uint64_t maxidx);
+			  uint32_t recsize, uint64_t maxidx, const char **ret_rec);
+static int  ssi_recsizes_ok(const ESL_SSI *ssi);
+static void ssi_map(ESL_SSI *ssi);
+static int  ssi_parse_precord(ESL_SSI *ssi, const char *rec, uint16_t *ret_fh, off_t *ret_roff, off_t *ret_doff, int64_t *ret_L);
+static int  ssi_cursor_init(struct ssi_cursor *c, off_t base, uint32_t recsize, uint32_t klen, uint64_t n);
+static int  ssi_cursor_get(ESL_SSI *ssi, struct ssi_cursor *c, uint64_t idx, const char **ret_rec);
+static int  ssi_cursor_seek(ESL_SSI *ssi, struct ssi_cursor *c, const char *key, uint64_t from, uint64_t *ret_idx, const char **ret_rec);
+static int  querysort(const void *q1, const void *q2);
 
 /* Function:  esl_ssi_Open()
  * Synopsis:  Open an SSI index as an <ESL_SSI>.
@@ -36,6 +75,12 @@ static int  binary_search(ESL_SSI *ssi, const char *key, uint32_t klen, off_t ba
  *            Caller is responsible for closing the SSI file with
  *            <esl_ssi_Close()>.
  *
+ *            If <mmap()> is available, the whole index is also
+ *            memory mapped (read-only), and key lookups read it
+ *            from memory instead of seeking and reading the
+ *            file. If the mapping fails, lookups quietly fall back
+ *            to reading the file.
+ *
  * Args:      <filename>   - name of SSI index file to open.       
  *            <ret_ssi>    - RETURN: the new <ESL_SSI>.
  *                        
@@ -65,6 +110,8 @@ esl_ssi_Open(const char *filename, ESL_SSI **ret_ssi)
   ssi->bpl        = NULL;
   ssi->rpl        = NULL;
   ssi->nfiles     = 0;          
+  ssi->mem        = NULL;
+  ssi->memsize    = 0;
 
   /* Open the file.
    */
@@ -132,6 +179,8 @@ esl_ssi_Open(const char *filename, ESL_SSI **ret_ssi)
       if (esl_fread_u32(ssi->fp, &(ssi->bpl[i])))                             goto ERROR;
       if (esl_fread_u32(ssi->fp, &(ssi->rpl[i])))                             goto ERROR;
     }
+
+  ssi_map(ssi);
   *ret_ssi = ssi;
   return eslOK;
   
@@ -175,13 +224,18 @@ esl_ssi_FindName(ESL_SSI *ssi, const char *key, uint16_t *ret_fh, off_t *ret_rof
   off_t     doff;
   int64_t   L;
   char     *pkey   = NULL;
+  const char *rec  = NULL;
 
   /* Look in the primary keys.
    */
   status = binary_search(ssi, key, ssi->plen, ssi->poffset, ssi->precsize,
-			 ssi->nprimary);
+			 ssi->nprimary, &rec);
 
-  if (status == eslOK) 
+  if (status == eslOK && rec != NULL)
+    { /* Found it as a primary key in the mapped index. */
+      if ((status = ssi_parse_precord(ssi, rec, ret_fh, ret_roff, &doff, &L)) != eslOK) goto ERROR;
+    }
+  else if (status == eslOK) 
     { /* We found it as a primary key; get our data & return. */
       status = eslEFORMAT;
       if (esl_fread_u16(ssi->fp, ret_fh)                  != eslOK) goto ERROR;
@@ -192,12 +246,13 @@ esl_ssi_FindName(ESL_SSI *ssi, const char *key, uint16_t *ret_fh, off_t *ret_rof
   else if (status == eslENOTFOUND) 
     { /* Not in the primary keys? OK, try the secondary keys. */
       if (ssi->nsecondary > 0) {
-	if ((status = binary_search(ssi, key, ssi->slen, ssi->soffset, ssi->srecsize, ssi->nsecondary)) != eslOK) goto ERROR;
+	if ((status = binary_search(ssi, key, ssi->slen, ssi->soffset, ssi->srecsize, ssi->nsecondary, &rec)) != eslOK) goto ERROR;
 
 	/* We have the secondary key; flip to its primary key, then look that up. */
 	ESL_ALLOC(pkey, sizeof(char) * ssi->plen);
 	status = eslEFORMAT;
-	if (fread(pkey, sizeof(char), ssi->plen, ssi->fp) != ssi->plen) goto ERROR;
+	if (rec != NULL) { memcpy(pkey, rec + ssi->slen, ssi->plen); pkey[ssi->plen-1] = '\0'; }
+	else if (fread(pkey, sizeof(char), ssi->plen, ssi->fp) != ssi->plen) goto ERROR;
 	if ((status = esl_ssi_FindName(ssi, pkey, ret_fh, ret_roff, &doff, &L)) != eslOK) goto ERROR;
       } else goto ERROR;	/* no secondary keys? pass along the ENOTFOUND error. */
     } else goto ERROR;	/* status from binary search was an error code. */
@@ -218,6 +273,144 @@ esl_ssi_FindName(ESL_SSI *ssi, const char *key, uint16_t *ret_fh, off_t *ret_rof
 
 
 
+/* Function:  esl_ssi_FindNames()
+ * Synopsis:  Look up many primary or secondary keys at once.
+ *
+ * Purpose:   Look up each of the <nkeys> strings <keys[0..nkeys-1]>
+ *            in index <ssi>, as <esl_ssi_FindName()> would, and
+ *            return their results in caller-provided arrays: for
+ *            key <i>, <ret_fh[i]> is the handle on the file it's
+ *            in, <ret_roff[i]> is the offset of its record,
+ *            <opt_doff[i]> its data offset, and <opt_L[i]> its
+ *            length. A key that isn't in the index gets
+ *            <ret_roff[i] = -1>, with <ret_fh[i]>, <opt_doff[i]>,
+ *            and <opt_L[i]> set to 0. <*opt_nfound> is the number
+ *            of keys that were found.
+ *
+ *            Instead of a binary search per key, the keys are
+ *            sorted and merged against the sorted key table in a
+ *            single forward pass, galloping over stretches of the
+ *            table that no key falls in. Keys that aren't primary
+ *            keys are merged against the secondary keys the same
+ *            way, and the primary keys they're aliases for are then
+ *            merged again. If the index isn't memory mapped, the
+ *            tables are read <eslSSI_WINDOW> records at a time, so
+ *            a large batch reads the index sequentially. Duplicate
+ *            keys in <keys> are allowed.
+ *
+ * Args:      <ssi>        - open index file
+ *            <keys>       - names to search for, [0..nkeys-1]
+ *            <nkeys>      - number of keys
+ *            <ret_fh>     - RETURN: file handles, [0..nkeys-1]
+ *            <ret_roff>   - RETURN: record offsets, or -1 if not found, [0..nkeys-1]
+ *            <opt_doff>   - optRETURN: data offsets (may be 0 if unset), [0..nkeys-1]
+ *            <opt_L>      - optRETURN: lengths (may be 0 if unset), [0..nkeys-1]
+ *            <opt_nfound> - optRETURN: number of keys found
+ *
+ * Returns:   <eslOK> on success, whether or not every key was found.
+ *            <eslEFORMAT> if a read or seek fails, probably
+ *            indicating some kind of misformatting of the index;
+ *            now the contents of the result arrays are undefined.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+esl_ssi_FindNames(ESL_SSI *ssi, char **keys, int64_t nkeys,
+		  uint16_t *ret_fh, off_t *ret_roff, off_t *opt_doff, int64_t *opt_L, int64_t *opt_nfound)
+{
+  struct ssi_query  *q     = NULL;
+  char              *pkeys = NULL;
+  struct ssi_cursor  pc, sc;
+  const char        *rec;
+  uint64_t           pos;
+  int64_t            nmiss, nalias, nfound;
+  int64_t            i, k;
+  off_t              doff;
+  int64_t            L;
+  int                pass;
+  int                status;
+
+  ssi_cursor_init(&pc, ssi->poffset, ssi->precsize, ssi->plen, ssi->nprimary);
+  ssi_cursor_init(&sc, ssi->soffset, ssi->srecsize, ssi->slen, ssi->nsecondary);
+
+  for (i = 0; i < nkeys; i++)
+    {
+      ret_fh[i]   = 0;
+      ret_roff[i] = -1;
+      if (opt_doff) opt_doff[i] = 0;
+      if (opt_L)    opt_L[i]    = 0;
+    }
+  nfound = 0;
+  if (nkeys == 0) goto DONE;
+  if (! ssi_recsizes_ok(ssi)) { status = eslEFORMAT; goto ERROR; }
+
+  ESL_ALLOC(q, sizeof(struct ssi_query) * nkeys);
+  for (i = 0; i < nkeys; i++) { q[i].key = keys[i]; q[i].i = i; }
+  qsort(q, nkeys, sizeof(struct ssi_query), querysort);
+
+  /* Pass 0 merges the keys against the primary keys; pass 1 merges
+   * the primary keys of any aliases found in the secondary keys.
+   * Keys not found are compacted to the front of <q>, still sorted.
+   */
+  for (pass = 0; pass < 2 && nkeys > 0; pass++)
+    {
+      pos   = 0;
+      nmiss = 0;
+      for (k = 0; k < nkeys; k++)
+	{
+	  if ((status = ssi_cursor_seek(ssi, &pc, q[k].key, pos, &pos, &rec)) != eslOK) goto ERROR;
+	  if (pos < pc.n && strncmp(rec, q[k].key, pc.klen) == 0)
+	    {
+	      i = q[k].i;
+	      if ((status = ssi_parse_precord(ssi, rec, &(ret_fh[i]), &(ret_roff[i]), &doff, &L)) != eslOK) goto ERROR;
+	      if (opt_doff) opt_doff[i] = doff;
+	      if (opt_L)    opt_L[i]    = L;
+	      nfound++;
+	    }
+	  else q[nmiss++] = q[k];
+	}
+      if (pass == 1 || nmiss == 0 || sc.n == 0) break;
+
+      /* Merge the misses against the secondary keys, collecting
+       * copies of their primary keys, then sort those for pass 1.
+       */
+      ESL_ALLOC(pkeys, sizeof(char) * ssi->plen * nmiss);
+      pos    = 0;
+      nalias = 0;
+      for (k = 0; k < nmiss; k++)
+	{
+	  if ((status = ssi_cursor_seek(ssi, &sc, q[k].key, pos, &pos, &rec)) != eslOK) goto ERROR;
+	  if (pos < sc.n && strncmp(rec, q[k].key, sc.klen) == 0)
+	    {
+	      memcpy(pkeys + nalias*ssi->plen, rec + ssi->slen, ssi->plen);
+	      pkeys[(nalias+1)*ssi->plen - 1] = '\0';
+	      q[nalias].key = pkeys + nalias*ssi->plen;
+	      q[nalias].i   = q[k].i;
+	      nalias++;
+	    }
+	}
+      qsort(q, nalias, sizeof(struct ssi_query), querysort);
+      nkeys = nalias;
+    }
+
+ DONE:
+  if (opt_nfound) *opt_nfound = nfound;
+  free(q);
+  free(pkeys);
+  free(pc.buf);
+  free(sc.buf);
+  return eslOK;
+
+ ERROR:
+  if (opt_nfound) *opt_nfound = 0;
+  free(q);
+  free(pkeys);
+  free(pc.buf);
+  free(sc.buf);
+  return status;
+}
+
+
 /* Function:  esl_ssi_FindNumber()
  * Synopsis:  Look up the n'th primary key.
  *
@@ -256,18 +449,31 @@ esl_ssi_FindNumber(ESL_SSI *ssi, int64_t nkey, uint16_t *opt_fh, off_t *opt_roff
   uint16_t fh;
   off_t    doff, roff;
   uint64_t L;
+  int64_t  sL;
   char    *pkey = NULL;
+  const char *rec;
 
   if (nkey >= ssi->nprimary) { status = eslENOTFOUND; goto ERROR; }
   ESL_ALLOC(pkey, sizeof(char) * ssi->plen);
 
-  status = eslEFORMAT;
-  if (fseeko(ssi->fp, ssi->poffset+ssi->precsize*nkey, SEEK_SET)!= 0) goto ERROR;
-  if (fread(pkey, sizeof(char), ssi->plen, ssi->fp)   != ssi->plen)   goto ERROR;
-  if (esl_fread_u16(ssi->fp, &fh)                     != eslOK)       goto ERROR;
-  if (esl_fread_offset(ssi->fp, ssi->offsz, &roff)    != eslOK)       goto ERROR;
-  if (esl_fread_offset(ssi->fp, ssi->offsz, &doff)    != eslOK)       goto ERROR;
-  if (esl_fread_u64   (ssi->fp, &L)                   != eslOK)       goto ERROR;
+  if (ssi->mem != NULL)
+    {
+      rec = ssi->mem + ssi->poffset + ssi->precsize*nkey;
+      memcpy(pkey, rec, ssi->plen);
+      pkey[ssi->plen-1] = '\0';
+      if ((status = ssi_parse_precord(ssi, rec, &fh, &roff, &doff, &sL)) != eslOK) goto ERROR;
+      L = (uint64_t) sL;
+    }
+  else
+    {
+      status = eslEFORMAT;
+      if (fseeko(ssi->fp, ssi->poffset+ssi->precsize*nkey, SEEK_SET)!= 0) goto ERROR;
+      if (fread(pkey, sizeof(char), ssi->plen, ssi->fp)   != ssi->plen)   goto ERROR;
+      if (esl_fread_u16(ssi->fp, &fh)                     != eslOK)       goto ERROR;
+      if (esl_fread_offset(ssi->fp, ssi->offsz, &roff)    != eslOK)       goto ERROR;
+      if (esl_fread_offset(ssi->fp, ssi->offsz, &doff)    != eslOK)       goto ERROR;
+      if (esl_fread_u64   (ssi->fp, &L)                   != eslOK)       goto ERROR;
+    }
 
   if (opt_fh   != NULL) *opt_fh   = fh;
   if (opt_roff != NULL) *opt_roff = roff;
@@ -513,6 +719,9 @@ esl_ssi_Close(ESL_SSI *ssi)
 
   if (ssi == NULL) return;
 
+#ifdef _POSIX_VERSION
+  if (ssi->mem != NULL) munmap(ssi->mem, ssi->memsize);
+#endif
   if (ssi->fp != NULL) fclose(ssi->fp);
   if (ssi->filename != NULL) {
     for (i = 0; i < ssi->nfiles; i++) 
@@ -537,12 +746,18 @@ esl_ssi_Close(ESL_SSI *ssi)
  *           return <eslFAIL>, and the positioning of the index file
  *           is left in an undefined state.
  *
+ *           If the index is memory mapped, the search is done in
+ *           memory instead, the file isn't positioned, and
+ *           <*ret_rec> points to the key's record in the mapped
+ *           index; else <*ret_rec> is <NULL>.
+ *
  * Args:     <ssi>     - an open ESL_SSI
  *           <key>     - key to find
  *           <klen>    - key length to allocate (plen or slen from ssi)
  *           <base>    - base offset (poffset or soffset)
  *           <recsize> - size of each key record in bytes (precsize or srecsize)
  *           <maxidx>  - # of keys (nprimary or nsecondary)
+ *           <ret_rec> - RETURN: ptr to the record in mapped index, or NULL
  *
  * Returns:  <eslOK> on success, and leaves file positioned for reading remaining
  *           data for the key. 
@@ -556,28 +771,38 @@ esl_ssi_Close(ESL_SSI *ssi)
  */
 static int
 binary_search(ESL_SSI *ssi, const char *key, uint32_t klen, off_t base, 
-	      uint32_t recsize, uint64_t maxidx)
+	      uint32_t recsize, uint64_t maxidx, const char **ret_rec)
 {
-  char        *name;
+  char        *name = NULL;
   uint64_t     left, right, mid;
   int          cmp;
   int          status;
   
+  *ret_rec = NULL;
   if (maxidx == 0) return eslENOTFOUND; /* special case: empty index */
 
-  ESL_ALLOC(name, (sizeof(char)*klen));
+  if (ssi->mem == NULL) ESL_ALLOC(name, (sizeof(char)*klen));
 
   left  = 0;
   right = maxidx-1;
   while (1) {			/* A binary search: */
     mid   = (left+right) / 2;	/* careful here. left+right potentially overflows if
 				   we didn't limit unsigned vars to signed ranges. */
-    status = eslEFORMAT;
-    if (fseeko(ssi->fp, base + recsize*mid, SEEK_SET) != 0)    goto ERROR;
-    if (fread(name, sizeof(char), klen, ssi->fp)      != klen) goto ERROR;
-
     status = eslENOTFOUND;
-    cmp = strcmp(name, key);
+    if (ssi->mem != NULL) 
+      {
+	*ret_rec = ssi->mem + base + recsize*mid;
+	cmp      = strncmp(*ret_rec, key, klen);
+      }
+    else
+      {
+	status = eslEFORMAT;
+	if (fseeko(ssi->fp, base + recsize*mid, SEEK_SET) != 0)    goto ERROR;
+	if (fread(name, sizeof(char), klen, ssi->fp)      != klen) goto ERROR;
+	status = eslENOTFOUND;
+	cmp = strcmp(name, key);
+      }
+
     if      (cmp == 0) break;	             /* found it!               */
     else if (left >= right) goto ERROR;      /* no such key             */
     else if (cmp < 0)       left  = mid+1;   /* it's still right of mid */
@@ -592,19 +817,286 @@ binary_search(ESL_SSI *ssi, const char *key, uint32_t klen, off_t base,
 
  ERROR:
   if (name != NULL) free(name);
+  *ret_rec = NULL;
   return status; 
 }
 
 
+/* ssi_recsizes_ok()
+ *
+ * Purpose:  Return <TRUE> if the index's key records are big enough
+ *           to hold the fields we read from them in memory:
+ *           a primary key record holds the key, a 16-bit file
+ *           handle, two offsets, and a 64-bit length; a secondary
+ *           key record holds the key and its primary key.
+ */
+static int
+ssi_recsizes_ok(const ESL_SSI *ssi)
+{
+  if (ssi->plen == 0 || (uint64_t) ssi->precsize < (uint64_t) ssi->plen + 2 + 2*ssi->offsz + 8) return FALSE;
+  if (ssi->nsecondary > 0 && (ssi->slen == 0 || (uint64_t) ssi->srecsize < (uint64_t) ssi->slen + ssi->plen)) return FALSE;
+  return TRUE;
+}
+
+
+/* ssi_map()
+ *
+ * Purpose:  Memory map the whole open index <ssi> read-only, if
+ *           <mmap()> is available, setting <ssi->mem> and
+ *           <ssi->memsize>. Only maps the index if its key tables
+ *           lie entirely within the file, so lookups in memory
+ *           can't run off the end of it. If anything fails, leaves
+ *           <ssi->mem> <NULL>, and lookups read the file instead.
+ */
+static void
+ssi_map(ESL_SSI *ssi)
+{
+#ifdef _POSIX_VERSION
+  struct stat st;
+  uint64_t    pend, send;
+  void       *mem;
+
+  if (fstat(fileno(ssi->fp), &st) != 0 || st.st_size <= 0) return;
+  if ((uint64_t) st.st_size > SIZE_MAX)                     return;
+  if (! ssi_recsizes_ok(ssi))                               return;
+  if (ssi->poffset < 0 || ssi->soffset < 0)                 return;
+
+  pend = (uint64_t) ssi->poffset + (uint64_t) ssi->precsize * ssi->nprimary;
+  send = (uint64_t) ssi->soffset + (uint64_t) ssi->srecsize * ssi->nsecondary;
+  if (ssi->nprimary   > 0 && pend > (uint64_t) st.st_size) return;
+  if (ssi->nsecondary > 0 && send > (uint64_t) st.st_size) return;
+
+  mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fileno(ssi->fp), 0);
+  if (mem == MAP_FAILED) return;
+  ssi->mem     = (char *) mem;
+  ssi->memsize = st.st_size;
+#endif
+}
+
+
+/* ssi_parse_precord()
+ *
+ * Purpose:  Given a pointer <rec> to a primary key record in memory
+ *           (in the mapped index, or read into a buffer), decode
+ *           its file handle, record offset, data offset, and length
+ *           from network byte order.
+ *
+ * Returns:  <eslOK> on success.
+ *
+ * Throws:   <eslEINCOMPAT> if an offset is too large for this host's
+ *           <off_t>, as <esl_fread_offset()>.
+ */
+static int
+ssi_parse_precord(ESL_SSI *ssi, const char *rec, uint16_t *ret_fh, off_t *ret_roff, off_t *ret_doff, int64_t *ret_L)
+{
+  const char *p = rec + ssi->plen;
+  uint16_t    x16;
+  uint32_t    x32;
+  uint64_t    x64;
+  off_t      *off[2];
+  int         k;
+
+  memcpy(&x16, p, 2);  p += 2;
+  *ret_fh = esl_ntoh16(x16);
+
+  off[0] = ret_roff;
+  off[1] = ret_doff;
+  for (k = 0; k < 2; k++)
+    {
+      if (ssi->offsz == 8) 
+	{
+	  memcpy(&x64, p, 8); p += 8;
+	  x64 = esl_ntoh64(x64);
+	  if (sizeof(off_t) == 4 && x64 > INT32_MAX) ESL_EXCEPTION(eslEINCOMPAT, "can't read 64-bit off_t on this 32-bit host");
+	  *(off[k]) = (off_t) x64;
+	}
+      else
+	{
+	  memcpy(&x32, p, 4); p += 4;
+	  *(off[k]) = (off_t) esl_ntoh32(x32);
+	}
+    }
+
+  memcpy(&x64, p, 8);
+  *ret_L = (int64_t) esl_ntoh64(x64);
+  return eslOK;
+}
+
+
+/* ssi_cursor_init()
+ *
+ * Purpose:  Initialize cursor <c> over a key table at disk offset
+ *           <base>, with <n> records of <recsize> bytes, keys of
+ *           length <klen> (including '\0').
+ */
+static int
+ssi_cursor_init(struct ssi_cursor *c, off_t base, uint32_t recsize, uint32_t klen, uint64_t n)
+{
+  c->base    = base;
+  c->recsize = recsize;
+  c->klen    = klen;
+  c->n       = n;
+  c->buf     = NULL;
+  c->first   = 0;
+  c->nbuf    = 0;
+  return eslOK;
+}
+
+
+/* ssi_cursor_get()
+ *
+ * Purpose:  Set <*ret_rec> to point at record <idx> (<0..c->n-1>) in
+ *           the key table of cursor <c>. In a mapped index, that's in
+ *           the mapping. Otherwise, if <idx> isn't in the current
+ *           window of records, read the next <eslSSI_WINDOW> records
+ *           starting at <idx>. The pointer is valid until the next call.
+ *
+ * Returns:  <eslOK> on success.
+ *           <eslEFORMAT> if a seek or read fails.
+ *
+ * Throws:   <eslEMEM> on allocation failure.
+ */
+static int
+ssi_cursor_get(ESL_SSI *ssi, struct ssi_cursor *c, uint64_t idx, const char **ret_rec)
+{
+  uint64_t nread;
+  int      status;
+
+  if (ssi->mem != NULL) { *ret_rec = ssi->mem + c->base + c->recsize*idx; return eslOK; }
+
+  if (idx < c->first || idx >= c->first + c->nbuf)
+    {
+      if (c->buf == NULL) ESL_ALLOC(c->buf, sizeof(char) * c->recsize * eslSSI_WINDOW);
+      nread = ESL_MIN(eslSSI_WINDOW, c->n - idx);
+
+      status = eslEFORMAT;
+      c->nbuf = 0;
+      if (fseeko(ssi->fp, c->base + c->recsize*idx, SEEK_SET) != 0)             goto ERROR;
+      if (fread(c->buf, c->recsize, nread, ssi->fp)           != (size_t) nread) goto ERROR;
+      c->first = idx;
+      c->nbuf  = nread;
+    }
+  *ret_rec = c->buf + c->recsize * (idx - c->first);
+  return eslOK;
+
+ ERROR:
+  *ret_rec = NULL;
+  return status;
+}
+
+
+/* ssi_cursor_seek()
+ *
+ * Purpose:  Find the first record at or after <from> in the key table
+ *           of cursor <c> whose key is >= <key>, by galloping forward
+ *           from <from> (probing <from>, <from+1>, <from+3>,
+ *           <from+7>...) until we pass <key>, then binary searching
+ *           the last stride. Return its index in <*ret_idx>, and a
+ *           pointer to it in <*ret_rec>; or if there's no such
+ *           record, <*ret_idx> is <c->n>.
+ *
+ *           Seeking through the table with sorted keys costs
+ *           O(log d) for a distance <d> forward, so a merge of
+ *           <m> keys against <n> records is O(m log(n/m)): 
+ *           never worse than a binary search per key, and
+ *           sequential when keys are dense.
+ *
+ * Returns:  <eslOK> on success.
+ *           <eslEFORMAT> if a seek or read fails.
+ *
+ * Throws:   <eslEMEM> on allocation failure.
+ */
+static int
+ssi_cursor_seek(ESL_SSI *ssi, struct ssi_cursor *c, const char *key, uint64_t from, uint64_t *ret_idx, const char **ret_rec)
+{
+  uint64_t lo   = from;
+  uint64_t hi   = from;
+  uint64_t step = 1;
+  uint64_t mid;
+  int      status;
+
+  *ret_rec = NULL;
+
+  /* Gallop: find <lo..hi> such that records <lo-1> < key <= record <hi>. */
+  while (hi < c->n)
+    {
+      if ((status = ssi_cursor_get(ssi, c, hi, ret_rec)) != eslOK) goto ERROR;
+      if (strncmp(*ret_rec, key, c->klen) >= 0) break;
+      lo    = hi + 1;
+      hi   += step;
+      step *= 2;
+    }
+  if (hi > c->n) hi = c->n;
+
+  /* Binary search <lo..hi-1> for the first record >= key; <hi> is the fallback. */
+  if (lo < hi && ssi->mem == NULL && (lo < c->first || lo >= c->first + c->nbuf))
+    if ((status = ssi_cursor_get(ssi, c, lo, ret_rec)) != eslOK) goto ERROR;  // pull the stride into the window
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if ((status = ssi_cursor_get(ssi, c, mid, ret_rec)) != eslOK) goto ERROR;
+      if (strncmp(*ret_rec, key, c->klen) >= 0) hi = mid;
+      else                                      lo = mid + 1;
+    }
+
+  if (lo < c->n && (status = ssi_cursor_get(ssi, c, lo, ret_rec)) != eslOK) goto ERROR;
+  *ret_idx = lo;
+  return eslOK;
+
+ ERROR:
+  *ret_idx = c->n;
+  *ret_rec = NULL;
+  return status;
+}
+
+
+/* querysort()
+ * qsort() comparison of two query keys, by the key.
+ */
+static int
+querysort(const void *q1, const void *q2)
+{
+  return strcmp( ((const struct ssi_query *) q1)->key, ((const struct ssi_query *) q2)->key);
+}
+
+
 /*****************************************************************
  *# 2. Creating (writing) new SSI files.
  *****************************************************************/ 
-static int current_newssi_size(const ESL_NEWSSI *ns);
-static int activate_external_sort(ESL_NEWSSI *ns);
-static int parse_pkey(char *buf, ESL_PKEY *pkey);
-static int parse_skey(char *buf, ESL_SKEY *skey);
-static int pkeysort(const void *k1, const void *k2);
-static int skeysort(const void *k1, const void *k2);
+/* One run of an external merge, as it's read back from its tmpfile:
+ * a window of its records at a time.
+ */
+struct newssi_mergesrc {
+  const ESL_SSIRUN *run;
+  uint32_t  recsize;  /* bytes per record in the run                    */
+  char     *buf;      /* window of records, buf[0..nbuf-1]...           */
+  uint64_t  nbuf;
+  uint64_t  pos;      /*   ... of which buf[pos] is the next one        */
+  uint64_t  nread;    /* records read from the run so far               */
+  uint64_t  maxbuf;   /* allocated size of <buf>, in records            */
+};
+
+/* A slice of the in-memory keys, sorted by one thread in newssi_spill(). */
+struct newssi_sortjob {
+  ESL_PKEY *pkeys;
+  uint64_t  np;
+  ESL_SKEY *skeys;
+  uint64_t  ns;
+};
+
+static int   current_newssi_size(const ESL_NEWSSI *ns);
+static int   current_ram_size(const ESL_NEWSSI *ns);
+static int   activate_external_sort(ESL_NEWSSI *ns);
+static int   newssi_spill(ESL_NEWSSI *ns);
+static void *newssi_sort_job(void *arg);
+static int   newssi_write_prun(ESL_NEWSSI *ns, const ESL_PKEY *pkeys, uint64_t n);
+static int   newssi_write_srun(ESL_NEWSSI *ns, const ESL_SKEY *skeys, uint64_t n);
+static int   newssi_add_run(ESL_SSIRUN **runs, int *nrun, int *nralloc, ESL_SSIRUN **ret_run);
+static int   newssi_merge(ESL_NEWSSI *ns, int do_primary, char *pk, char *sk);
+static int   newssi_merge_fill(ESL_NEWSSI *ns, FILE *fp, struct newssi_mergesrc *src);
+static void  newssi_merge_siftdown(struct newssi_mergesrc *src, int *heap, int nheap, int i);
+static int   pkeysort(const void *k1, const void *k2);
+static int   skeysort(const void *k1, const void *k2);
 
 /* Function:  esl_newssi_Open()
  * Synopsis:  Create a new <ESL_NEWSSI>.
@@ -635,6 +1127,7 @@ esl_newssi_Open(const char *ssifile, int allow_overwrite, ESL_NEWSSI **ret_newss
   ns->ssifp      = NULL;
   ns->external   = FALSE;	    /* we'll switch to external sort if...       */
   ns->max_ram    = eslSSI_MAXRAM;   /* ... if we exceed this memory limit in MB. */
+  ns->nthreads   = 0;
   ns->filenames  = NULL;
   ns->fileformat = NULL;
   ns->bpl        = NULL;
@@ -642,15 +1135,25 @@ esl_newssi_Open(const char *ssifile, int allow_overwrite, ESL_NEWSSI **ret_newss
   ns->flen       = 0;
   ns->nfiles     = 0;
   ns->pkeys      = NULL;
+  ns->npbuf      = 0;
+  ns->npalloc    = 0;
   ns->plen       = 0;
   ns->nprimary   = 0;
   ns->ptmpfile   = NULL;
   ns->ptmp       = NULL;
+  ns->pruns      = NULL;
+  ns->nprun      = 0;
+  ns->npralloc   = 0;
   ns->skeys      = NULL;
+  ns->nsbuf      = 0;
+  ns->nsalloc    = 0;
   ns->slen       = 0;
   ns->nsecondary = 0;
   ns->stmpfile   = NULL;
   ns->stmp       = NULL;
+  ns->sruns      = NULL;
+  ns->nsrun      = 0;
+  ns->nsralloc   = 0;
   ns->errbuf[0]  = '\0';    
 
   if ((status = esl_strdup(ssifile, -1, &(ns->ssifile)))    != eslOK) goto ERROR;
@@ -676,13 +1179,9 @@ esl_newssi_Open(const char *ssifile, int allow_overwrite, ESL_NEWSSI **ret_newss
   ESL_ALLOC(ns->bpl,        sizeof(uint32_t) * eslSSI_FCHUNK);
   ESL_ALLOC(ns->rpl,        sizeof(uint32_t) * eslSSI_FCHUNK);
   ESL_ALLOC(ns->pkeys,      sizeof(ESL_PKEY) * eslSSI_KCHUNK);
-  for (i = 0; i < eslSSI_KCHUNK; i++) 
-    ns->pkeys[i].key = NULL;
+  ns->npalloc = eslSSI_KCHUNK;
   ESL_ALLOC(ns->skeys,      sizeof(ESL_SKEY) * eslSSI_KCHUNK);
-  for (i = 0; i < eslSSI_KCHUNK; i++) {
-    ns->skeys[i].key  = NULL;
-    ns->skeys[i].pkey = NULL;
-  }
+  ns->nsalloc = eslSSI_KCHUNK;
   *ret_newssi = ns;
   return eslOK;
 
@@ -790,6 +1289,32 @@ esl_newssi_SetSubseq(ESL_NEWSSI *ns, uint16_t fh, uint32_t bpl, uint32_t rpl)
 }
 
 
+/* Function:  esl_newssi_SetThreads()
+ * Synopsis:  Sort the runs of a large index with more than one thread.
+ *
+ * Purpose:   When an index under construction outgrows
+ *            <ns->max_ram>, its keys are sorted and moved to disk in
+ *            sorted runs, to be merged by <esl_newssi_Write()>.  Have
+ *            each batch of keys sorted by up to <nthreads> threads,
+ *            each sorting its own slice into its own run.
+ *
+ *            The index written is the same regardless of <nthreads>.
+ *            <nthreads> of 0 (the default) sorts in the caller's
+ *            thread, as does any <nthreads> without POSIX threads.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <nthreads> is negative.
+ */
+int
+esl_newssi_SetThreads(ESL_NEWSSI *ns, int nthreads)
+{
+  if (nthreads < 0) ESL_EXCEPTION(eslEINVAL, "nthreads can't be negative");
+  ns->nthreads = nthreads;
+  return eslOK;
+}
+
+
 /* Function: esl_newssi_AddKey()
  * Synopsis: Add a primary key to a growing index.
  * Date:     SRE, Tue Jan  2 11:50:54 2001 [St. Louis]
@@ -844,56 +1369,37 @@ esl_newssi_AddKey(ESL_NEWSSI *ns, const char *key, uint16_t fh,
 		  off_t r_off, off_t d_off, int64_t L)
 {
   int status;
-  int i;
   int n;			/* a string length */
   
   if (fh >= eslSSI_MAXFILES)           ESL_XEXCEPTION(eslEINVAL, "invalid fh");
   if (ns->nprimary >= eslSSI_MAXKEYS)  ESL_XFAIL(eslERANGE, ns->errbuf, "exceeded maximum number of primary keys allowed");
 
-  /* Before adding the key: check how big our index is.
-   * If it's getting too large, switch to external mode.
+  /* Before adding the key: check how much memory our keys take.
+   * If it's getting too large, switch to external mode, and move
+   * them to disk as sorted runs.
    */
-  if (!ns->external && current_newssi_size(ns) >= ns->max_ram) 
-    if ((status = activate_external_sort(ns)) != eslOK) goto ERROR;
+  if (current_ram_size(ns) >= ns->max_ram)
+    {
+      if ((status = activate_external_sort(ns)) != eslOK) goto ERROR;
+      if ((status = newssi_spill(ns))           != eslOK) goto ERROR;
+    }
 
   /* Update maximum pkey length, if needed. (Inclusive of '\0').
    */
   n = strlen(key)+1;
   if (n > ns->plen) ns->plen = n;
 
-  /* External mode? Simply append to disk... 
-   */
-  if (ns->external) 
-    {
-      if (sizeof(off_t) == 4) {
-	if (fprintf(ns->ptmp, "%s\t%d\t%" PRIu32 "\t%" PRIu32 "\t%" PRIi64 "\n", 
-		    key, fh, (uint32_t) r_off, (uint32_t) d_off, L) <= 0) 
-	  ESL_XEXCEPTION_SYS(eslEWRITE, "ssi key tmp file write failed");
-      } else {
-	if (fprintf(ns->ptmp, "%s\t%d\t%" PRIu64 "\t%" PRIu64 "\t%" PRIi64 "\n", 
-		    key, fh, (uint64_t) r_off, (uint64_t) d_off, L) <= 0)
-	  ESL_XEXCEPTION_SYS(eslEWRITE, "ssi key tmp file write failed");
-      }
-      ns->nprimary++;
-    }
-  else
-    {
-      /* Else: internal mode, keep keys in memory...
-       */
-      if ((status = esl_strdup(key, n, &(ns->pkeys[ns->nprimary].key))) != eslOK) goto ERROR;
-      ns->pkeys[ns->nprimary].fnum  = fh;
-      ns->pkeys[ns->nprimary].r_off = r_off;
-      ns->pkeys[ns->nprimary].d_off = d_off;
-      ns->pkeys[ns->nprimary].len   = L;
-      ns->nprimary++;
-
-      /* Reallocate as needed. */
-      if (ns->nprimary % eslSSI_KCHUNK == 0) {
-	ESL_REALLOC(ns->pkeys, sizeof(ESL_PKEY) * (ns->nprimary+eslSSI_KCHUNK));
-	for (i = ns->nprimary; i < ns->nprimary + eslSSI_KCHUNK; i++)
-	  ns->pkeys[i].key = NULL;
-      }
-    }
+  if (ns->npbuf == ns->npalloc) {
+    ESL_REALLOC(ns->pkeys, sizeof(ESL_PKEY) * ns->npalloc * 2);
+    ns->npalloc *= 2;
+  }
+  if ((status = esl_strdup(key, n, &(ns->pkeys[ns->npbuf].key))) != eslOK) goto ERROR;
+  ns->pkeys[ns->npbuf].fnum  = fh;
+  ns->pkeys[ns->npbuf].r_off = r_off;
+  ns->pkeys[ns->npbuf].d_off = d_off;
+  ns->pkeys[ns->npbuf].len   = L;
+  ns->npbuf++;
+  ns->nprimary++;
   return eslOK;
 
  ERROR:
@@ -925,41 +1431,33 @@ int
 esl_newssi_AddAlias(ESL_NEWSSI *ns, const char *alias, const char *key)
 {
   int status;
-  int i;
   int n;			/* a string length */
   
   if (ns->nsecondary >= eslSSI_MAXKEYS) ESL_XFAIL(eslERANGE, ns->errbuf, "exceeded maximum number of secondary keys allowed");
 
-  /* Before adding the key: check how big our index is.
-   * If it's getting too large, switch to external mode.
+  /* Before adding the key: check how much memory our keys take.
+   * If it's getting too large, switch to external mode, and move
+   * them to disk as sorted runs.
    */
-  if (!ns->external && current_newssi_size(ns) >= ns->max_ram) 
-    if ((status = activate_external_sort(ns)) != eslOK) goto ERROR;
+  if (current_ram_size(ns) >= ns->max_ram)
+    {
+      if ((status = activate_external_sort(ns)) != eslOK) goto ERROR;
+      if ((status = newssi_spill(ns))           != eslOK) goto ERROR;
+    }
 
   /* Update maximum secondary key length, if necessary. */
   n = strlen(alias)+1;
   if (n > ns->slen) ns->slen = n;
 
-  /* if external mode: write info to disk. */
-  if (ns->external) 
-    {
-      if (fprintf(ns->stmp, "%s\t%s\n", alias, key) <= 0) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi alias tmp file write failed");
-      ns->nsecondary++;
-    }
-  else
-    { /* else, internal mode... store info in memory. */
-      if ((status = esl_strdup(alias, n, &(ns->skeys[ns->nsecondary].key))) != eslOK) goto ERROR;
-      if ((status = esl_strdup(key, -1, &(ns->skeys[ns->nsecondary].pkey))) != eslOK) goto ERROR;
-      ns->nsecondary++;
-
-      if (ns->nsecondary % eslSSI_KCHUNK == 0) {
-	ESL_REALLOC(ns->skeys, sizeof(ESL_SKEY) * (ns->nsecondary+eslSSI_KCHUNK));
-	for (i = ns->nsecondary; i < ns->nsecondary+eslSSI_KCHUNK; i++) {
-	  ns->skeys[i].key  = NULL;
-	  ns->skeys[i].pkey = NULL;
-	}
-      }
-    }
+  if (ns->nsbuf == ns->nsalloc) {
+    ESL_REALLOC(ns->skeys, sizeof(ESL_SKEY) * ns->nsalloc * 2);
+    ns->nsalloc *= 2;
+  }
+  ns->skeys[ns->nsbuf].pkey = NULL;
+  if ((status = esl_strdup(alias, n, &(ns->skeys[ns->nsbuf].key)))  != eslOK) goto ERROR;
+  if ((status = esl_strdup(key,  -1, &(ns->skeys[ns->nsbuf].pkey))) != eslOK) { free(ns->skeys[ns->nsbuf].key); goto ERROR; }
+  ns->nsbuf++;
+  ns->nsecondary++;
   return eslOK;
 
  ERROR:
@@ -1018,11 +1516,7 @@ esl_newssi_Write(ESL_NEWSSI *ns)
            soffset;		/* offset to secondary key section          */
   char    *fk       = NULL,     /* fixed-width (flen) file name             */
           *pk       = NULL, 	/* fixed-width (plen) primary key string    */
-          *sk       = NULL,	/* fixed-width (slen) secondary key string  */
-          *buf      = NULL;	/* esl_fgets() growable buffer              */
-  int      n        = 0;	/* esl_fgets() buffer size                  */
-  ESL_PKEY pkey;		/* primary key info from external tmpfile   */
-  ESL_SKEY skey;		/* secondary key info from external tmpfile */
+          *sk       = NULL;	/* fixed-width (slen) secondary key string  */
 
   if (ns->nsecondary > 0 && ns->slen == 0)
     ESL_EXCEPTION(eslEINVAL, "zero secondary key length: shouldn't happen");
@@ -1066,39 +1560,14 @@ esl_newssi_Write(ESL_NEWSSI *ns)
   soffset = poffset + precsize*ns->nprimary;
   
   /* Sort the keys.
-   * If external mode, make system calls to UNIX/POSIX "sort" in place, then
-   * open new sorted files for reading thru ptmp and stmp handles.
+   * If external mode, sort what's left in memory into the last runs;
+   * the runs are merged below, as the key sections are written.
    * If internal mode, call qsort. 
-   * 
-   * Note that you'd better force a POSIX locale for the sort; else,
-   * some silly distro (e.g. Mandrake Linux >=8.1) may have specified
-   * LC_COLLATE=en_US, and this'll give a sort "bug" in which it doesn't
-   * sort by byte order.
    */
   if (ns->external) 
     {
-      char cmd[1024];
-
-      /* A last minute security check: make sure we won't overflow
-       * sprintf() with the tmpfile names. They're hardcoded now, so
-       * we know they don't overflow, but they might be configurable 
-       * in the future, and we wouldn't want a security hole to open
-       * up.
-       */
-      if (strlen(ns->ptmpfile) > 256 || strlen(ns->ptmpfile) > 256) 
-	ESL_XEXCEPTION(eslEINVAL, "tmpfile name too long"); 
-
-      fclose(ns->ptmp);
-      ns->ptmp = NULL;	
-      sprintf(cmd, "env LC_ALL=POSIX sort -o %s %s\n", ns->ptmpfile, ns->ptmpfile);
-      if (system(cmd) != 0)                              ESL_XFAIL(eslESYS, ns->errbuf, "external sort of primary keys failed");
-      if ((ns->ptmp = fopen(ns->ptmpfile, "r")) == NULL) ESL_XFAIL(eslESYS, ns->errbuf, "failed to reopen primary key tmp file after sort");
-
-      fclose(ns->stmp);
-      ns->stmp = NULL;
-      sprintf(cmd, "env LC_ALL=POSIX sort -o %s %s\n", ns->stmpfile, ns->stmpfile);
-      if (system(cmd) != 0)                              ESL_XFAIL(eslESYS, ns->errbuf, "external sort of secondary keys failed");
-      if ((ns->stmp = fopen(ns->stmpfile, "r")) == NULL) ESL_XFAIL(eslESYS, ns->errbuf, "failed to reopen secondary key tmp file after sort");
+      if ((status = newssi_spill(ns)) != eslOK) goto ERROR;
+      if (fflush(ns->ptmp) != 0 || fflush(ns->stmp) != 0) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi key tmp file write failed");
     }
   else 
     {
@@ -1146,20 +1615,7 @@ esl_newssi_Write(ESL_NEWSSI *ns)
   if (ns->external) 
     {
       if (ns->nprimary) strncpy(pk, "", ns->plen);
-      for (i = 0; i < ns->nprimary; i++) 
-	{
-	  if (esl_fgets(&buf, &n, ns->ptmp)  != eslOK)    ESL_XFAIL(eslESYS, ns->errbuf, "read from sorted primary key tmpfile failed");
-	  if (parse_pkey(buf, &pkey)         != eslOK)    ESL_XFAIL(eslESYS, ns->errbuf, "parse failed for a line of sorted primary key tmpfile failed");
-          if (strcmp(pk, pkey.key)           == 0)        ESL_XFAIL(eslEDUP, ns->errbuf, "primary keys not unique: '%s' occurs more than once", pkey.key);
-	  strncpy(pk, pkey.key, ns->plen);   // strncpy() pads w/ nulls, and we count on that behavior.
-
-	  if (fwrite(pk,sizeof(char),ns->plen,ns->ssifp) != ns->plen ||
-	      esl_fwrite_u16(   ns->ssifp, pkey.fnum)    != eslOK    ||
-	      esl_fwrite_offset(ns->ssifp, pkey.r_off)   != eslOK    ||
-	      esl_fwrite_offset(ns->ssifp, pkey.d_off)   != eslOK    ||
-	      esl_fwrite_i64(   ns->ssifp, pkey.len)     != eslOK)
-	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
-	}
+      if ((status = newssi_merge(ns, TRUE, pk, sk)) != eslOK) goto ERROR;
     } 
   else 
     {
@@ -1184,18 +1640,7 @@ esl_newssi_Write(ESL_NEWSSI *ns)
   if (ns->external) 
     {
       if (ns->nsecondary) strncpy(sk, "", ns->slen);
-      for (i = 0; i < ns->nsecondary; i++)
-	{
-	  if (esl_fgets(&buf, &n, ns->stmp) != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "read from sorted secondary key tmpfile failed");
-	  if (parse_skey(buf, &skey)        != eslOK) ESL_XFAIL(eslESYS, ns->errbuf, "parse failed for a line of sorted secondary key tmpfile failed");
-          if (strcmp(sk, skey.key)          == 0)     ESL_XFAIL(eslEDUP, ns->errbuf, "secondary keys not unique: '%s' occurs more than once", skey.key);
-	  strncpy(sk, skey.key,  ns->slen);  // slen > 0 if there are any secondary keys.
-	  strncpy(pk, skey.pkey, ns->plen);
-
-	  if (fwrite(sk, sizeof(char), ns->slen, ns->ssifp) != ns->slen ||
-	      fwrite(pk, sizeof(char), ns->plen, ns->ssifp) != ns->plen) 
-	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
-	}
+      if ((status = newssi_merge(ns, FALSE, pk, sk)) != eslOK) goto ERROR;
     } 
   else 
     {
@@ -1218,7 +1663,6 @@ esl_newssi_Write(ESL_NEWSSI *ns)
   if (fk)       free(fk);
   if (pk)       free(pk);
   if (sk)       free(sk);
-  if (buf)      free(buf);
   if (ns->ptmp) { fclose(ns->ptmp); ns->ptmp = NULL; }
   if (ns->stmp) { fclose(ns->stmp); ns->stmp = NULL; }
   return eslOK;
@@ -1229,7 +1673,6 @@ esl_newssi_Write(ESL_NEWSSI *ns)
   if (fk)        free(fk);
   if (pk)        free(pk);
   if (sk)        free(sk);
-  if (buf)       free(buf);
   if (ns->ptmp)  { fclose(ns->ptmp); ns->ptmp = NULL; }
   if (ns->stmp)  { fclose(ns->stmp); ns->stmp = NULL; }
   return status;
@@ -1243,29 +1686,27 @@ esl_newssi_Write(ESL_NEWSSI *ns)
 void
 esl_newssi_Close(ESL_NEWSSI *ns)
 {
-  int i;
+  uint64_t i;
   if (ns == NULL) return;
 
-  if (ns->external == FALSE) 
+  if (ns->pkeys != NULL) 
     {
-      if (ns->pkeys != NULL) 
-	{
-	  for (i = 0; i < ns->nprimary; i++) 
-	    if (ns->pkeys[i].key != NULL) free(ns->pkeys[i].key);
-	  free(ns->pkeys);       	
-	}
-      if (ns->skeys != NULL) 
+      for (i = 0; i < ns->npbuf; i++) free(ns->pkeys[i].key);
+      free(ns->pkeys);       	
+    }
+  if (ns->skeys != NULL) 
+    {
+      for (i = 0; i < ns->nsbuf; i++) 
 	{
-	  for (i = 0; i < ns->nsecondary; i++) 
-	    {
-	      if (ns->skeys[i].key  != NULL) free(ns->skeys[i].key);
-	      if (ns->skeys[i].pkey != NULL) free(ns->skeys[i].pkey);
-	    }
-	  free(ns->skeys);       
+	  free(ns->skeys[i].key);
+	  free(ns->skeys[i].pkey);
 	}
+      free(ns->skeys);       
     }
-  else 
+  if (ns->external) 
     {
+      if (ns->ptmp) { fclose(ns->ptmp); ns->ptmp = NULL; }
+      if (ns->stmp) { fclose(ns->stmp); ns->stmp = NULL; }
       remove(ns->ptmpfile);
       remove(ns->stmpfile);
     }
@@ -1279,8 +1720,10 @@ esl_newssi_Close(ESL_NEWSSI *ns)
 
   if (ns->stmp)       fclose(ns->stmp);
   if (ns->stmpfile)   free(ns->stmpfile);
+  if (ns->sruns)      free(ns->sruns);
   if (ns->ptmp)       fclose(ns->ptmp);
   if (ns->ptmpfile)   free(ns->ptmpfile);
+  if (ns->pruns)      free(ns->pruns);
   if (ns->fileformat) free(ns->fileformat);
   if (ns->bpl)        free(ns->bpl);       
   if (ns->rpl)        free(ns->rpl);       
@@ -1324,131 +1767,403 @@ current_newssi_size(const ESL_NEWSSI *ns)
   return (int) total;
 }
 
+/* current_ram_size()
+ *
+ * Like current_newssi_size(), but only for the keys we're holding
+ * in memory, not counting any that have already been moved to
+ * disk in external mode. Returns their size in megabytes.
+ */
+static int
+current_ram_size(const ESL_NEWSSI *ns)
+{
+  uint64_t precsize, srecsize;
+
+  precsize = 2*sizeof(off_t) + sizeof(uint16_t) + sizeof(uint64_t) + ns->plen;
+  srecsize = ns->slen + ns->plen;
+  return (int) ((precsize * ns->npbuf + srecsize * ns->nsbuf) / 1048576L);
+}
+
 /* activate_external_sort()
  * 
  * Switch to external sort mode.
- * Open file handles for external index files (ptmp, stmp).
- * Flush current index information to these files.
- * Free current memory, turn over control to the tmpfiles.
+ * Open file handles for external index files (ptmp, stmp),
+ * which <newssi_spill()> writes sorted runs of keys to, and
+ * <esl_newssi_Write()> merges. The keys we have so far stay in
+ * memory until the next spill.
  *           
  * Return <eslOK>        on success; 
  *        <eslENOTFOUND> if we can't open a tmpfile for writing.
- * 
- * Throw  <eslEWRITE>    if a write fails.
  */
 static int
 activate_external_sort(ESL_NEWSSI *ns)
 {
   int status;
-  int i;
 
   if (ns->external)                   return eslOK; /* we already are external, fool */
   
-  if ((ns->ptmp = fopen(ns->ptmpfile, "w")) == NULL) ESL_XFAIL(eslENOTFOUND, ns->errbuf, "Failed to open primary key tmpfile for external sort");
-  if ((ns->stmp = fopen(ns->stmpfile, "w")) == NULL) ESL_XFAIL(eslENOTFOUND, ns->errbuf, "Failed to open secondary key tmpfile for external sort");
-
-  /* Flush the current indices. */
-  for (i = 0; i < ns->nprimary; i++) {
-    if (sizeof(off_t) == 4) {
-      if (fprintf(ns->ptmp, "%s\t%u\t%lu\t%lu\t%lu\n", 
-		  ns->pkeys[i].key, 
-		  (unsigned int)  ns->pkeys[i].fnum,
-		  (unsigned long) ns->pkeys[i].r_off, 
-		  (unsigned long) ns->pkeys[i].d_off, 
-		  (unsigned long) ns->pkeys[i].len) <= 0)
-	ESL_XEXCEPTION_SYS(eslEWRITE, "ssi key tmp file write failed");
-    } else {
-      if (fprintf(ns->ptmp, "%s\t%u\t%llu\t%llu\t%lu\n", 
-		  ns->pkeys[i].key, 
-		  (unsigned int)       ns->pkeys[i].fnum,
-		  (unsigned long long) ns->pkeys[i].r_off, 
-		  (unsigned long long) ns->pkeys[i].d_off, 
-		  (unsigned long)      ns->pkeys[i].len) <= 0)
-	ESL_XEXCEPTION_SYS(eslEWRITE, "ssi key tmp file write failed");
-    }
-  }
-  for (i = 0; i < ns->nsecondary; i++)
-    if (fprintf(ns->stmp, "%s\t%s\n", ns->skeys[i].key, ns->skeys[i].pkey) <= 0)
-      ESL_XEXCEPTION_SYS(eslEWRITE, "ssi alias tmp file write failed");
-  
-  /* Free the memory now that we've flushed our lists to disk
-   */
-  for (i = 0; i < ns->nprimary;   i++) free(ns->pkeys[i].key);
-  for (i = 0; i < ns->nsecondary; i++) free(ns->skeys[i].key);
-  for (i = 0; i < ns->nsecondary; i++) free(ns->skeys[i].pkey);
-  if (ns->pkeys != NULL) free(ns->pkeys);       	
-  if (ns->skeys != NULL) free(ns->skeys);       
-  ns->pkeys    = NULL;
-  ns->skeys    = NULL;
+  if ((ns->ptmp = fopen(ns->ptmpfile, "w+b")) == NULL) ESL_XFAIL(eslENOTFOUND, ns->errbuf, "Failed to open primary key tmpfile for external sort");
+  if ((ns->stmp = fopen(ns->stmpfile, "w+b")) == NULL) ESL_XFAIL(eslENOTFOUND, ns->errbuf, "Failed to open secondary key tmpfile for external sort");
   ns->external = TRUE;
   return eslOK;
 
  ERROR:
-  if (ns->ptmp != NULL) { fclose(ns->ptmp); ns->ptmp = NULL; }
-  if (ns->stmp != NULL) { fclose(ns->stmp); ns->stmp = NULL; }
+  if (ns->ptmp != NULL) { fclose(ns->ptmp); ns->ptmp = NULL; remove(ns->ptmpfile); }
+  if (ns->stmp != NULL) { fclose(ns->stmp); ns->stmp = NULL; remove(ns->stmpfile); }
   return status;
 }
 
-/* parse_pkey(), parse_skey()
- * 
- * Given a <buf> containing a line read from the external
- * primary-key or secondary-key tmpfile; parse it, and fill in the fields of
- * <pkey> or <skey>
- * 
- * <?key> is a ptr to a structure on the stack. It is assumed
- * to be in use only transiently.
- * <?key>'s strings become ptrs into <buf>'s space, so we don't have to
- * allocate new space for them. This means that the transient <?key> structure
- * is only usable until <buf> is modified or free'd.
- * 
+/* newssi_spill()
+ *
+ * In external mode: sort the keys held in memory, append them to
+ * the tmpfiles as sorted runs, and free them.
+ *
+ * A run is a block of fixed-width binary records in host byte
+ * order, with the key field as wide as the run's longest key, so
+ * a run is written and read back without any parsing. A primary
+ * key record is <key>, <fnum>, <r_off>, <d_off>, <len>; a
+ * secondary key record is <key>, <pkey>.
+ *
+ * With <ns->nthreads> > 1, the keys are cut into that many slices,
+ * each sorted by its own thread and written as its own run. The
+ * runs are written in slice order, so the index doesn't depend on
+ * thread timing.
+ *
  * Returns <eslOK> on success.
- * 
- * Throws  <eslEFORMAT>        on parse error (shouldn't happen; we created it!)
- *         <eslEINCONCEIVABLE> if we can't deal with off_t's size.     
+ * Throws  <eslEMEM> on allocation failure; <eslEWRITE> on a write
+ *         failure.
  */
 static int
-parse_pkey(char *buf, ESL_PKEY *pkey)
+newssi_spill(ESL_NEWSSI *ns)
 {
-  int   status;
-  char *s, *tok;
-  
-  s = buf;
-  if (esl_strtok(&s, "\t\n", &(pkey->key)) != eslOK) ESL_XEXCEPTION(eslEFORMAT, "parse failed");
-  if (esl_strtok(&s, "\t\n", &tok)         != eslOK) ESL_XEXCEPTION(eslEFORMAT, "parse failed");
-
-  pkey->fnum = (uint16_t) atoi(tok);
-  if (esl_strtok(&s, "\t\n", &tok)         != eslOK) ESL_XEXCEPTION(eslEFORMAT, "parse failed");
-  if      (sizeof(off_t) == 4) pkey->r_off  = (off_t) strtoul (tok, NULL, 10);
-  else if (sizeof(off_t) == 8) pkey->r_off  = (off_t) strtoull(tok, NULL, 10);
-  else                         ESL_XEXCEPTION(eslEINCONCEIVABLE, "whoa - weird off_t");
-
-  if (esl_strtok(&s, "\t\n", &tok)         != eslOK) ESL_XEXCEPTION(eslEFORMAT, "parse failed");
-  if      (sizeof(off_t) == 4) pkey->d_off  = (off_t) strtoul (tok, NULL, 10);
-  else if (sizeof(off_t) == 8) pkey->d_off  = (off_t) strtoull(tok, NULL, 10);
-  else                         ESL_XEXCEPTION(eslEINCONCEIVABLE, "whoa - weird off_t");
-
-  if (esl_strtok(&s, "\t\n", &tok)         != eslOK) ESL_XEXCEPTION(eslEFORMAT, "parse failed");
-  pkey->len = (uint64_t) strtoull(tok, NULL, 10);
+  struct newssi_sortjob *job = NULL;
+  uint64_t               i;
+  int                    nt  = ESL_MAX(1, ns->nthreads);
+  int                    t;
+  int                    status;
+#ifdef HAVE_PTHREAD
+  pthread_t             *tid     = NULL;
+  int                   *running = NULL;
+#endif
+
+  if (ns->npbuf == 0 && ns->nsbuf == 0) return eslOK;
+  if (nt > ESL_MAX(ns->npbuf, ns->nsbuf)) nt = ESL_MAX(ns->npbuf, ns->nsbuf);
+
+  ESL_ALLOC(job, sizeof(struct newssi_sortjob) * nt);
+  for (t = 0; t < nt; t++)
+    {
+      job[t].pkeys = ns->pkeys + (ns->npbuf * t) / nt;
+      job[t].np    = (ns->npbuf * (t+1)) / nt - (ns->npbuf * t) / nt;
+      job[t].skeys = ns->skeys + (ns->nsbuf * t) / nt;
+      job[t].ns    = (ns->nsbuf * (t+1)) / nt - (ns->nsbuf * t) / nt;
+    }
+
+#ifdef HAVE_PTHREAD
+  ESL_ALLOC(tid,     sizeof(pthread_t) * nt);
+  ESL_ALLOC(running, sizeof(int)       * nt);
+  for (t = 1; t < nt; t++)
+    running[t] = (pthread_create(&tid[t], NULL, newssi_sort_job, &job[t]) == 0);
+  newssi_sort_job(&job[0]);
+  for (t = 1; t < nt; t++)
+    {
+      if (running[t]) pthread_join(tid[t], NULL);
+      else            newssi_sort_job(&job[t]);
+    }
+#else
+  for (t = 0; t < nt; t++) newssi_sort_job(&job[t]);
+#endif
+
+  for (t = 0; t < nt; t++)
+    {
+      if (job[t].np && (status = newssi_write_prun(ns, job[t].pkeys, job[t].np)) != eslOK) goto ERROR;
+      if (job[t].ns && (status = newssi_write_srun(ns, job[t].skeys, job[t].ns)) != eslOK) goto ERROR;
+    }
+
+  for (i = 0; i < ns->npbuf; i++)   free(ns->pkeys[i].key);
+  for (i = 0; i < ns->nsbuf; i++) { free(ns->skeys[i].key); free(ns->skeys[i].pkey); }
+  ns->npbuf = 0;
+  ns->nsbuf = 0;
+  status    = eslOK;
+  /* fallthrough */
+ ERROR:
+#ifdef HAVE_PTHREAD
+  free(tid);
+  free(running);
+#endif
+  free(job);
+  return status;
+}
+
+/* newssi_sort_job()
+ * Sort one slice of keys for newssi_spill(). Can run as a thread.
+ */
+static void *
+newssi_sort_job(void *arg)
+{
+  struct newssi_sortjob *job = (struct newssi_sortjob *) arg;
+
+  qsort((void *) job->pkeys, job->np, sizeof(ESL_PKEY), pkeysort);
+  qsort((void *) job->skeys, job->ns, sizeof(ESL_SKEY), skeysort);
+  return NULL;
+}
+
+/* newssi_write_prun(), newssi_write_srun()
+ *
+ * Append sorted keys <pkeys> (or <skeys>) <0..n-1> to the primary
+ * (or secondary) key tmpfile as a new run.
+ *
+ * Returns <eslOK> on success.
+ * Throws  <eslEMEM> on allocation failure; <eslEWRITE> on a write
+ *         failure.
+ */
+static int
+newssi_write_prun(ESL_NEWSSI *ns, const ESL_PKEY *pkeys, uint64_t n)
+{
+  ESL_SSIRUN *run     = NULL;
+  char       *rec     = NULL;
+  uint32_t    klen    = 1;
+  uint32_t    recsize;
+  uint64_t    i;
+  int         status;
+
+  for (i = 0; i < n; i++) klen = ESL_MAX(klen, strlen(pkeys[i].key) + 1);
+  recsize = klen + sizeof(uint16_t) + 2*sizeof(off_t) + sizeof(int64_t);
+
+  if ((status = newssi_add_run(&(ns->pruns), &(ns->nprun), &(ns->npralloc), &run)) != eslOK) goto ERROR;
+  if ((run->offset = ftello(ns->ptmp)) == -1) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi key tmp file write failed");
+  run->n    = n;
+  run->klen = klen;
+  run->plen = 0;
+
+  ESL_ALLOC(rec, sizeof(char) * recsize);
+  for (i = 0; i < n; i++)
+    {
+      strncpy(rec, pkeys[i].key, klen);   // pads w/ nulls, so we never write uninitialized bytes
+      memcpy(rec + klen,                                       &(pkeys[i].fnum),  sizeof(uint16_t));
+      memcpy(rec + klen + sizeof(uint16_t),                    &(pkeys[i].r_off), sizeof(off_t));
+      memcpy(rec + klen + sizeof(uint16_t) + sizeof(off_t),    &(pkeys[i].d_off), sizeof(off_t));
+      memcpy(rec + klen + sizeof(uint16_t) + 2*sizeof(off_t),  &(pkeys[i].len),   sizeof(int64_t));
+      if (fwrite(rec, recsize, 1, ns->ptmp) != 1) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi key tmp file write failed");
+    }
+  free(rec);
   return eslOK;
 
  ERROR:
+  free(rec);
   return status;
 }
 static int
-parse_skey(char *buf, ESL_SKEY *skey)
+newssi_write_srun(ESL_NEWSSI *ns, const ESL_SKEY *skeys, uint64_t n)
 {
-  int   status;
-  char *s;
-  
-  s = buf;
-  if (esl_strtok(&s, "\t\n", &(skey->key))  != eslOK) ESL_XEXCEPTION(eslEFORMAT, "parse failed");
-  if (esl_strtok(&s, "\t\n", &(skey->pkey)) != eslOK) ESL_XEXCEPTION(eslEFORMAT, "parse failed");
+  ESL_SSIRUN *run     = NULL;
+  char       *rec     = NULL;
+  uint32_t    klen    = 1;
+  uint32_t    plen    = 1;
+  uint64_t    i;
+  int         status;
+
+  for (i = 0; i < n; i++) 
+    {
+      klen = ESL_MAX(klen, strlen(skeys[i].key)  + 1);
+      plen = ESL_MAX(plen, strlen(skeys[i].pkey) + 1);
+    }
+
+  if ((status = newssi_add_run(&(ns->sruns), &(ns->nsrun), &(ns->nsralloc), &run)) != eslOK) goto ERROR;
+  if ((run->offset = ftello(ns->stmp)) == -1) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi alias tmp file write failed");
+  run->n    = n;
+  run->klen = klen;
+  run->plen = plen;
+
+  ESL_ALLOC(rec, sizeof(char) * (klen + plen));
+  for (i = 0; i < n; i++)
+    {
+      strncpy(rec,        skeys[i].key,  klen);
+      strncpy(rec + klen, skeys[i].pkey, plen);
+      if (fwrite(rec, klen + plen, 1, ns->stmp) != 1) ESL_XEXCEPTION_SYS(eslEWRITE, "ssi alias tmp file write failed");
+    }
+  free(rec);
+  return eslOK;
+
+ ERROR:
+  free(rec);
+  return status;
+}
+
+/* newssi_add_run()
+ * Add a new, uninitialized run to the list <*runs>, reallocating
+ * as needed, and return a pointer to it in <*ret_run>.
+ */
+static int
+newssi_add_run(ESL_SSIRUN **runs, int *nrun, int *nralloc, ESL_SSIRUN **ret_run)
+{
+  int status;
+
+  if (*nrun == *nralloc)
+    {
+      ESL_REALLOC(*runs, sizeof(ESL_SSIRUN) * (*nralloc + eslSSI_FCHUNK));
+      *nralloc += eslSSI_FCHUNK;
+    }
+  *ret_run = (*runs) + *nrun;
+  (*nrun)++;
+  return eslOK;
+
+ ERROR:
+  *ret_run = NULL;
+  return status;
+}
+
+/* newssi_merge()
+ *
+ * In external mode, in esl_newssi_Write(): merge the sorted runs
+ * of primary keys (if <do_primary> is TRUE) or secondary keys (if
+ * FALSE) from their tmpfile, and write them to the SSI file as its
+ * primary or secondary key section.
+ *
+ * The merge is k-way, with a heap over the runs. Each run is read
+ * back a window at a time; the windows together take about
+ * <ns->max_ram>. <pk> and <sk> are the fixed-width key buffers of
+ * esl_newssi_Write(), initialized to "" for the duplicate key
+ * check.
+ *
+ * Returns <eslOK> on success;
+ *         <eslEDUP> if keys aren't unique;
+ *         <eslESYS> if a read of a tmpfile fails. 
+ *         On errors, <ns->errbuf> contains an informative message.
+ *
+ * Throws  <eslEMEM> on allocation failure; <eslEWRITE> on a write
+ *         failure.
+ */
+static int
+newssi_merge(ESL_NEWSSI *ns, int do_primary, char *pk, char *sk)
+{
+  FILE                   *fp    = (do_primary ? ns->ptmp  : ns->stmp);
+  ESL_SSIRUN             *runs  = (do_primary ? ns->pruns : ns->sruns);
+  int                     nrun  = (do_primary ? ns->nprun : ns->nsrun);
+  struct newssi_mergesrc *src   = NULL;
+  int                    *heap  = NULL;
+  int                     nheap = 0;
+  uint64_t                budget;
+  char                   *rec;
+  const char             *key;
+  uint16_t                fnum;
+  off_t                   r_off, d_off;
+  int64_t                 len;
+  int                     r;
+  int                     status;
+
+  if (nrun == 0) return eslOK;
+  ESL_ALLOC(src,  sizeof(struct newssi_mergesrc) * nrun);
+  ESL_ALLOC(heap, sizeof(int)                    * nrun);
+  for (r = 0; r < nrun; r++) src[r].buf = NULL;
+
+  budget = ((uint64_t) ESL_MAX(1, ns->max_ram) * 1048576L) / nrun;
+  for (r = 0; r < nrun; r++)
+    {
+      src[r].run     = runs + r;
+      src[r].recsize = runs[r].klen + (do_primary ? sizeof(uint16_t) + 2*sizeof(off_t) + sizeof(int64_t) : runs[r].plen);
+      src[r].maxbuf  = ESL_MIN(runs[r].n, ESL_MAX(1, budget / src[r].recsize));
+      src[r].nbuf    = 0;
+      src[r].pos     = 0;
+      src[r].nread   = 0;
+      ESL_ALLOC(src[r].buf, sizeof(char) * src[r].maxbuf * src[r].recsize);
+      if ((status = newssi_merge_fill(ns, fp, &src[r])) != eslOK) goto ERROR;
+      heap[nheap++] = r;
+    }
+  for (r = nheap/2 - 1; r >= 0; r--) newssi_merge_siftdown(src, heap, nheap, r);
+
+  while (nheap)
+    {
+      r   = heap[0];
+      rec = src[r].buf + src[r].pos * src[r].recsize;
+      key = rec;
+
+      if (do_primary)
+	{
+	  if (strcmp(pk, key) == 0) ESL_XFAIL(eslEDUP, ns->errbuf, "primary keys not unique: '%s' occurs more than once", key);
+	  strncpy(pk, key, ns->plen);
+	  memcpy(&fnum,  rec + src[r].run->klen,                                      sizeof(uint16_t));
+	  memcpy(&r_off, rec + src[r].run->klen + sizeof(uint16_t),                   sizeof(off_t));
+	  memcpy(&d_off, rec + src[r].run->klen + sizeof(uint16_t) + sizeof(off_t),   sizeof(off_t));
+	  memcpy(&len,   rec + src[r].run->klen + sizeof(uint16_t) + 2*sizeof(off_t), sizeof(int64_t));
+
+	  if (fwrite(pk,sizeof(char),ns->plen,ns->ssifp) != ns->plen ||
+	      esl_fwrite_u16(   ns->ssifp, fnum)         != eslOK    ||
+	      esl_fwrite_offset(ns->ssifp, r_off)        != eslOK    ||
+	      esl_fwrite_offset(ns->ssifp, d_off)        != eslOK    ||
+	      esl_fwrite_i64(   ns->ssifp, len)          != eslOK)
+	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
+	}
+      else
+	{
+	  if (strcmp(sk, key) == 0) ESL_XFAIL(eslEDUP, ns->errbuf, "secondary keys not unique: '%s' occurs more than once", key);
+	  strncpy(sk, key,                       ns->slen);
+	  strncpy(pk, rec + src[r].run->klen,    ns->plen);
+
+	  if (fwrite(sk, sizeof(char), ns->slen, ns->ssifp) != ns->slen ||
+	      fwrite(pk, sizeof(char), ns->plen, ns->ssifp) != ns->plen)
+	    ESL_XEXCEPTION_SYS(eslEWRITE, "ssi write failed");
+	}
+
+      /* Advance run <r>; drop it from the heap when it's done */
+      if (++src[r].pos == src[r].nbuf)
+	{
+	  if (src[r].nread < src[r].run->n) 
+	    { if ((status = newssi_merge_fill(ns, fp, &src[r])) != eslOK) goto ERROR; }
+	  else
+	    heap[0] = heap[--nheap];
+	}
+      if (nheap) newssi_merge_siftdown(src, heap, nheap, 0);
+    }
+
+  status = eslOK;
+  /* fallthrough */
+ ERROR:
+  if (src) { for (r = 0; r < nrun; r++) free(src[r].buf); }
+  free(src);
+  free(heap);
+  return status;
+}
+
+/* newssi_merge_fill()
+ * Read the next window of records of a run being merged.
+ */
+static int
+newssi_merge_fill(ESL_NEWSSI *ns, FILE *fp, struct newssi_mergesrc *src)
+{
+  int status;
+
+  src->nbuf = ESL_MIN(src->maxbuf, src->run->n - src->nread);
+  src->pos  = 0;
+  if (fseeko(fp, src->run->offset + (off_t) (src->nread * src->recsize), SEEK_SET) != 0 ||
+      fread(src->buf, src->recsize, src->nbuf, fp) != src->nbuf)
+    ESL_XFAIL(eslESYS, ns->errbuf, "read from sorted key tmpfile failed");
+  src->nread += src->nbuf;
   return eslOK;
 
  ERROR:
   return status;
 }
 
+/* newssi_merge_siftdown()
+ * Restore the heap order of <heap[0..nheap-1]> below position <i>:
+ * the run with the smallest current key goes on top.
+ */
+static void
+newssi_merge_siftdown(struct newssi_mergesrc *src, int *heap, int nheap, int i)
+{
+  int         c, r;
+  const char *ckey;
+
+  for (r = heap[i]; (c = 2*i+1) < nheap; i = c)
+    {
+      ckey = src[heap[c]].buf + src[heap[c]].pos * src[heap[c]].recsize;
+      if (c+1 < nheap && strcmp(src[heap[c+1]].buf + src[heap[c+1]].pos * src[heap[c+1]].recsize, ckey) < 0) 
+	{ c++; ckey = src[heap[c]].buf + src[heap[c]].pos * src[heap[c]].recsize; }
+      if (strcmp(src[r].buf + src[r].pos * src[r].recsize, ckey) <= 0) break;
+      heap[i] = heap[c];
+    }
+  heap[i] = r;
+}
+
 /* ordering functions needed for qsort() */
 static int 
 pkeysort(const void *k1, const void *k2)
@@ -1876,6 +2591,46 @@ ssi_testdata_destroy(struct ssi_testdata *td)
   free(td);
 }
 
+/* ssi_testdata_index()
+ * Index all the FASTA files in <td>, names as primary keys and
+ * descriptions as secondary keys, and save the index to <ssifile>.
+ * Returns the status of <esl_newssi_Write()>.
+ */
+static int
+ssi_testdata_index(struct ssi_testdata *td, const char *ssifile, int do_external)
+{
+  char         msg[]      = "esl_ssi test index creation failed";
+  ESL_NEWSSI  *ns         = NULL;
+  ESL_SQFILE  *sqfp       = NULL;
+  ESL_SQ      *sq         = NULL;
+  uint16_t     fh;
+  int          j;
+  int          status;
+
+  if (esl_newssi_Open(ssifile, TRUE, &ns)     != eslOK) esl_fatal(msg);
+  if ((sq = esl_sq_Create())                  == NULL)  esl_fatal(msg);
+  if (do_external)
+    if (activate_external_sort(ns)            != eslOK) esl_fatal(msg);
+  for (j = 0; j < td->nfiles; j++)
+    {
+      if (esl_sqfile_Open(td->sqfile[j], eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) esl_fatal(msg);
+      if (esl_newssi_AddFile(ns, td->sqfile[j], sqfp->format, &fh)       != eslOK) esl_fatal(msg);
+      while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+	{
+	  if (esl_newssi_AddKey  (ns, sq->name, fh, sq->roff, sq->doff, sq->L) != eslOK) esl_fatal(msg);
+	  if (esl_newssi_AddAlias(ns, sq->desc, sq->name)                      != eslOK) esl_fatal(msg);
+	  esl_sq_Reuse(sq);
+	}
+      if (status != eslEOF) esl_fatal(msg);
+      esl_sqfile_Close(sqfp);
+    }
+  esl_sq_Destroy(sq);
+
+  status = esl_newssi_Write(ns);
+  esl_newssi_Close(ns);
+  return status;
+}
+
 static void
 utest_enchilada(ESL_GETOPTS *go, ESL_RANDOMNESS *rng, int do_external, int do_dupkeys)
 {
@@ -1883,10 +2638,9 @@ utest_enchilada(ESL_GETOPTS *go, ESL_RANDOMNESS *rng, int do_external, int do_du
   struct ssi_testdata *td = NULL;
   int          nq         = 10;      // number of SSI-based retrievals to test
   char        *ssifile    = NULL;    // Index creation: ssifile to create.
-  ESL_NEWSSI  *ns         = NULL;    //   new SSI index data
-  ESL_SQFILE  *sqfp       = NULL;    //   open FASTA file that we're indexing
+  ESL_SQFILE  *sqfp       = NULL;    //   open FASTA file that we're retrieving from
   ESL_SQ      *sq         = NULL;    //   a sequence from <sqfp>
-  uint16_t     fh;                   //   handle on an indexed fasta file, from _AddFile, for _AddKey
+  uint16_t     fh;                   //   handle on the indexed fasta file that a key is in
   ESL_SSI     *ssi        = NULL;    // Retrieval testing: open SSI index to use
   char         query[32];            //   name of sequence to retrieve
   char        *qfile;                //   retrieved name of file it's in
@@ -1901,33 +2655,12 @@ utest_enchilada(ESL_GETOPTS *go, ESL_RANDOMNESS *rng, int do_external, int do_du
                            esl_opt_GetInteger(go, "-L"),  // max seq length
                            do_dupkeys);                   // if you poison w/ dup keys, _Write should fail.
 
-  /* Create an ssi index of all the FASTA files. */
+  /* Create an ssi index of all the FASTA files, and save it. */
   if (esl_strdup(td->sqfile[0], -1, &ssifile) != eslOK) esl_fatal(msg);
   if (esl_strcat(&ssifile,  -1, ".ssi", 4)    != eslOK) esl_fatal(msg);
-  if (esl_newssi_Open(ssifile, TRUE, &ns)     != eslOK) esl_fatal(msg);
-  if ((sq = esl_sq_Create())                  == NULL)  esl_fatal(msg);
-  if (do_external)
-    if (activate_external_sort(ns)            != eslOK) esl_fatal(msg);
-  for (j = 0; j < td->nfiles; j++)
-    {
-      if (esl_sqfile_Open(td->sqfile[j], eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) esl_fatal(msg);
-      if (esl_newssi_AddFile(ns, td->sqfile[j], sqfp->format, &fh)       != eslOK) esl_fatal(msg);
-      while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
-	{
-	  if (esl_newssi_AddKey  (ns, sq->name, fh, sq->roff, sq->doff, sq->L) != eslOK) esl_fatal(msg);
-	  if (esl_newssi_AddAlias(ns, sq->desc, sq->name)                      != eslOK) esl_fatal(msg);
-	  esl_sq_Reuse(sq);
-	}
-      if (status != eslEOF) esl_fatal(msg);
-      esl_sqfile_Close(sqfp);
-    }
-  esl_sq_Destroy(sq);
-
-  /* Save the SSI index to a file. */
-  status = esl_newssi_Write(ns);
+  status = ssi_testdata_index(td, ssifile, do_external);
   if (  do_dupkeys && status != eslEDUP) esl_fatal(msg);
   if (! do_dupkeys && status != eslOK)   esl_fatal(msg);
-  esl_newssi_Close(ns);
   
   /* Open the SSI index - now we'll use it to retrieve <nq> random sequences. */
   if (! do_dupkeys)
@@ -1966,6 +2699,178 @@ utest_enchilada(ESL_GETOPTS *go, ESL_RANDOMNESS *rng, int do_external, int do_du
   ssi_testdata_destroy(td);
   free(ssifile);
 }
+/* utest_findnames()
+ * Batch lookup with esl_ssi_FindNames() must agree with one
+ * esl_ssi_FindName() per key: for primary keys, secondary keys,
+ * missing keys, and duplicates, in random order. With <do_unmap>,
+ * drop the memory mapping to test the windowed reads; a big
+ * index, with more keys than <eslSSI_WINDOW>, makes them refill.
+ */
+static void
+utest_findnames(ESL_RANDOMNESS *rng, int max_nseq, int do_unmap)
+{
+  char         msg[]   = "esl_ssi FindNames test failed";
+  struct ssi_testdata *td = ssi_testdata_create(rng, 3, max_nseq, 10, FALSE);
+  int64_t      ntot    = (int64_t) td->nseq * td->nfiles;
+  int64_t      nq      = 1 + esl_rnd_Roll(rng, 2*ntot);
+  char        *ssifile = NULL;
+  ESL_SSI     *ssi     = NULL;
+  char       **keys    = NULL;
+  uint16_t    *fh      = NULL;
+  off_t       *roff    = NULL;
+  off_t       *doff    = NULL;
+  int64_t     *L       = NULL;
+  uint16_t     fh1;
+  off_t        roff1, doff1;
+  int64_t      L1;
+  int64_t      nfound, nexpect;
+  int64_t      i, r;
+  int          status;
+
+  if (esl_sprintf(&ssifile, "%s.ssi", td->sqfile[0])    != eslOK) esl_fatal(msg);
+  if (ssi_testdata_index(td, ssifile, FALSE)              != eslOK) esl_fatal(msg);
+  if (esl_ssi_Open(ssifile, &ssi)                         != eslOK) esl_fatal(msg);
+#ifdef _POSIX_VERSION
+  if (ssi->mem == NULL) esl_fatal(msg);
+  if (do_unmap) { munmap(ssi->mem, ssi->memsize); ssi->mem = NULL; ssi->memsize = 0; }
+#endif
+
+  if ((keys = malloc(sizeof(char *)  * nq)) == NULL) esl_fatal(msg);
+  if ((fh   = malloc(sizeof(uint16_t)* nq)) == NULL) esl_fatal(msg);
+  if ((roff = malloc(sizeof(off_t)   * nq)) == NULL) esl_fatal(msg);
+  if ((doff = malloc(sizeof(off_t)   * nq)) == NULL) esl_fatal(msg);
+  if ((L    = malloc(sizeof(int64_t) * nq)) == NULL) esl_fatal(msg);
+
+  nexpect = 0;
+  for (i = 0; i < nq; i++)
+    {
+      r = esl_rnd_Roll(rng, ntot);
+      switch (esl_rnd_Roll(rng, 4)) {
+      case 0:  status = esl_sprintf(&(keys[i]), "%s",  td->seqname[r]); nexpect++; break;
+      case 1:  status = esl_sprintf(&(keys[i]), "%s",  td->seqdesc[r]); nexpect++; break;
+      case 2:  status = esl_sprintf(&(keys[i]), "%sx", td->seqname[r]);            break; // not in the index
+      default: status = esl_sprintf(&(keys[i]), "%s",  (r % 2) ? "" : "zzz");      break; // nor these, at the ends of the table
+      }
+      if (status != eslOK) esl_fatal(msg);
+    }
+
+  if (esl_ssi_FindNames(ssi, keys, nq, fh, roff, doff, L, &nfound) != eslOK) esl_fatal(msg);
+  if (nfound != nexpect) esl_fatal(msg);
+
+  for (i = 0; i < nq; i++)
+    {
+      status = esl_ssi_FindName(ssi, keys[i], &fh1, &roff1, &doff1, &L1);
+      if      (status == eslENOTFOUND) { if (roff[i] != -1 || fh[i] != 0 || doff[i] != 0 || L[i] != 0) esl_fatal(msg); }
+      else if (status == eslOK)        { if (roff[i] != roff1 || fh[i] != fh1 || doff[i] != doff1 || L[i] != L1) esl_fatal(msg); }
+      else esl_fatal(msg);
+    }
+
+  /* Optional args may be NULL; and an empty batch is fine. */
+  if (esl_ssi_FindNames(ssi, keys, nq, fh, roff, NULL, NULL, NULL) != eslOK) esl_fatal(msg);
+  if (esl_ssi_FindNames(ssi, keys, 0,  fh, roff, NULL, NULL, &nfound) != eslOK || nfound != 0) esl_fatal(msg);
+
+  remove(ssifile);
+  esl_ssi_Close(ssi);
+  esl_arr2_Destroy((void **) keys, nq);
+  free(fh);
+  free(roff);
+  free(doff);
+  free(L);
+  free(ssifile);
+  ssi_testdata_destroy(td);
+}
+
+
+/* utest_external()
+ * An index built by external sort, spilling sorted runs at random
+ * points with <nthreads> sorting threads, must be byte-identical
+ * to the same index built in memory; and with <do_dupkeys>, a
+ * duplicate key is caught even when the two copies land in
+ * different runs.
+ */
+static void
+utest_external(ESL_RANDOMNESS *rng, int nthreads, int do_dupkeys)
+{
+  char         msg[]    = "esl_ssi external sort test failed";
+  char         ssifile1[32] = "esltmpXXXXXX";
+  char         ssifile2[32] = "esltmpXXXXXX";
+  int          nkeys    = 1 + esl_rnd_Roll(rng, 3000);
+  char       **key      = NULL;
+  char       **alias    = NULL;
+  ESL_NEWSSI  *ns       = NULL;
+  FILE        *fp1, *fp2;
+  uint16_t     fh;
+  int          c1, c2;
+  char        *tmpfile  = NULL;
+  int          i, k, n, pass;
+  int          dupi     = -1;
+  int          dupj     = -1;
+  int          status;
+
+  if ((key   = malloc(sizeof(char *) * nkeys)) == NULL) esl_fatal(msg);
+  if ((alias = malloc(sizeof(char *) * nkeys)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nkeys; i++)
+    {
+      n = esl_rnd_Roll(rng, 20);
+      if ((key[i]   = malloc(sizeof(char) * 32)) == NULL) esl_fatal(msg);
+      if ((alias[i] = malloc(sizeof(char) * 32)) == NULL) esl_fatal(msg);
+      for (k = 0; k < n; k++) key[i][k] = 'a' + esl_rnd_Roll(rng, 26);
+      sprintf(key[i]+n, "-%d", i);
+      sprintf(alias[i], "acc%d.%d", i, n);
+    }
+  if (do_dupkeys && nkeys > 1)
+    {
+      dupi = esl_rnd_Roll(rng, nkeys - 1);
+      dupj = dupi + 1 + esl_rnd_Roll(rng, nkeys - dupi - 1);
+      if (esl_rnd_Roll(rng, 2) == 0) strcpy(key[dupj],   key[dupi]);
+      else                           strcpy(alias[dupj], alias[dupi]);
+    }
+
+  /* pass 0: in memory. pass 1: external, with random spills. */
+  for (pass = 0; pass < 2; pass++)
+    {
+      if (esl_tmpfile_named(pass ? ssifile2 : ssifile1, &fp1) != eslOK) esl_fatal(msg);
+      fclose(fp1);
+      if (esl_newssi_Open(pass ? ssifile2 : ssifile1, TRUE, &ns) != eslOK) esl_fatal(msg);
+      if (esl_newssi_AddFile(ns, "foo.fa", 1, &fh)               != eslOK) esl_fatal(msg);
+      if (pass && esl_newssi_SetThreads(ns, nthreads)            != eslOK) esl_fatal(msg);
+      if (pass && activate_external_sort(ns)                     != eslOK) esl_fatal(msg);
+      for (i = 0; i < nkeys; i++)
+	{
+	  if (esl_newssi_AddKey(ns, key[i], fh, 1000*i, 1000*i + 10 + i%7, i % 1000) != eslOK) esl_fatal(msg);
+	  if ((i % 3 || i == dupi || i == dupj) && 
+	      esl_newssi_AddAlias(ns, alias[i], key[i])                              != eslOK) esl_fatal(msg);
+	  if (pass && esl_rnd_Roll(rng, 200) == 0 && newssi_spill(ns)                != eslOK) esl_fatal(msg);
+	}
+      status = esl_newssi_Write(ns);
+      if ( do_dupkeys && nkeys > 1 && status != eslEDUP) esl_fatal(msg);
+      if ((! do_dupkeys || nkeys == 1) && status != eslOK) esl_fatal(msg);
+      esl_newssi_Close(ns);
+    }
+
+  /* The external sort's tmpfiles are gone */
+  if (esl_sprintf(&tmpfile, "%s.1", ssifile2) != eslOK) esl_fatal(msg);
+  if (esl_FileExists(tmpfile))                          esl_fatal(msg);
+
+  if (! do_dupkeys || nkeys == 1)
+    {
+      if ((fp1 = fopen(ssifile1, "rb")) == NULL) esl_fatal(msg);
+      if ((fp2 = fopen(ssifile2, "rb")) == NULL) esl_fatal(msg);
+      do {
+	c1 = fgetc(fp1);
+	c2 = fgetc(fp2);
+	if (c1 != c2) esl_fatal(msg);
+      } while (c1 != EOF);
+      fclose(fp1);
+      fclose(fp2);
+    }
+
+  remove(ssifile1);
+  remove(ssifile2);
+  free(tmpfile);
+  esl_arr2_Destroy((void **) key,   nkeys);
+  esl_arr2_Destroy((void **) alias, nkeys);
+}
 #endif /*eslSSI_TESTDRIVE*/
 
 
@@ -2015,6 +2920,17 @@ main(int argc, char **argv)
   utest_enchilada(go, rng, FALSE,       TRUE);
   utest_enchilada(go, rng, TRUE,        TRUE);
 
+  /*                   nthreads do_dupkeys */
+  utest_external(rng,  0,       FALSE);
+  utest_external(rng,  4,       FALSE);
+  utest_external(rng,  4,       TRUE);
+
+  /*                    max_nseq  do_unmap */
+  utest_findnames(rng,  10,       FALSE);
+  utest_findnames(rng,  10,       TRUE);
+  utest_findnames(rng,  5000,     FALSE);
+  utest_findnames(rng,  5000,     TRUE);
+
   esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
 
@@ -19,6 +19,7 @@
 #define eslSSI_MAXFILES 32767	     /* 2^15-1 */
 #define eslSSI_MAXKEYS  2147483647L  /* 2^31-1 */
 #define eslSSI_MAXRAM   256	     /* >256MB indices trigger external sort */
+#define eslSSI_WINDOW   4096         /* key records per read, in batch lookup of an unmapped index */
 
 #ifndef HAVE_FSEEKO
 #define fseeko fseek
@@ -45,6 +46,9 @@ typedef struct {
   off_t      poffset;         /* disk offset, start of pri key recs  */
   off_t      soffset;         /* disk offset, start of sec key recs  */
 
+  /* Memory-mapped index, when mmap() is available:  */
+  char      *mem;             /* whole SSI file, read-only; or NULL  */
+  off_t      memsize;         /* size of <mem> in bytes              */
 
   /* File information:  */
   char     **filename;        /* list of file names [0..nfiles-1]    */
@@ -74,11 +78,19 @@ typedef struct {		/* Secondary key data: */
   char        *pkey;            /* primary key name    */ 
 } ESL_SKEY;
 
+typedef struct {		/* A sorted run of keys in an external sort tmpfile: */
+  off_t        offset;          /* where the run starts in the tmpfile               */
+  uint64_t     n;		/* number of key records in the run                  */
+  uint32_t     klen;		/* width of the run's key field, including '\0'      */
+  uint32_t     plen;		/* secondary key runs: width of the primary key field */
+} ESL_SSIRUN;
+
 typedef struct {
   char       *ssifile;		/* name of the SSI file we're creating    */
   FILE       *ssifp;		/* open SSI file being created            */
   int         external;	        /* TRUE if pkeys and skeys are on disk    */
   int         max_ram;	        /* threshold in MB to trigger extern sort */
+  int         nthreads;		/* threads for sorting runs; 0 = serial   */
 
   char      **filenames;
   uint32_t   *fileformat;
@@ -87,17 +99,27 @@ typedef struct {
   uint32_t    flen;		/* length of longest filename, inc '\0' */
   uint16_t    nfiles;		/* can store up to 2^15-1 (32767) files */
   
-  ESL_PKEY   *pkeys;
+  ESL_PKEY   *pkeys;		/* pkeys held in memory, [0..npbuf-1]        */
+  uint64_t    npbuf;		/* # of them (== nprimary, unless external)  */
+  uint64_t    npalloc;		/* current allocation of <pkeys>             */
   uint32_t    plen;	        /* length of longest pkey, including '\0'    */
   uint64_t    nprimary;		/* can store up to 2^63-1 = 9.2e18 keys      */
   char       *ptmpfile;		/* primary key tmpfile name, for extern sort */
   FILE       *ptmp;	        /* handle on open ptmpfile */
+  ESL_SSIRUN *pruns;		/* sorted runs of pkeys in <ptmp>            */
+  int         nprun;
+  int         npralloc;
 
-  ESL_SKEY   *skeys;
+  ESL_SKEY   *skeys;		/* skeys held in memory, [0..nsbuf-1]     */
+  uint64_t    nsbuf;
+  uint64_t    nsalloc;
   uint32_t    slen;        	/* length of longest skey, including '\0' */
   uint64_t    nsecondary;
   char       *stmpfile;		/* secondary key tmpfile name, for extern sort */
   FILE       *stmp;	        /* handle on open ptmpfile */
+  ESL_SSIRUN *sruns;		/* sorted runs of skeys in <stmp>            */
+  int         nsrun;
+  int         nsralloc;
 
   char        errbuf[eslERRBUFSIZE];
 } ESL_NEWSSI;
@@ -112,6 +134,8 @@ extern int  esl_ssi_Open(const char *filename, ESL_SSI **ret_ssi);
 extern void esl_ssi_Close(ESL_SSI *ssi);
 extern int  esl_ssi_FindName(ESL_SSI *ssi, const char *key,
 			     uint16_t *ret_fh, off_t *ret_roff, off_t *opt_doff, int64_t *opt_L);
+extern int  esl_ssi_FindNames(ESL_SSI *ssi, char **keys, int64_t nkeys,
+			      uint16_t *ret_fh, off_t *ret_roff, off_t *opt_doff, int64_t *opt_L, int64_t *opt_nfound);
 extern int  esl_ssi_FindNumber(ESL_SSI *ssi, int64_t nkey,
 			       uint16_t *opt_fh, off_t *opt_roff, off_t *opt_doff, int64_t *opt_L, char **opt_pkey);
 extern int  esl_ssi_FindSubseq(ESL_SSI *ssi, const char *key, int64_t requested_start,
@@ -124,6 +148,7 @@ extern int  esl_ssi_FileInfo(ESL_SSI *ssi, uint16_t fh, char **ret_filename, int
 extern int  esl_newssi_Open(const char *ssifile, int allow_overwrite, ESL_NEWSSI **ret_newssi);
 extern int  esl_newssi_AddFile  (ESL_NEWSSI *ns, const char *filename, int fmt, uint16_t *ret_fh);
 extern int  esl_newssi_SetSubseq(ESL_NEWSSI *ns, uint16_t fh, uint32_t bpl, uint32_t rpl);
+extern int  esl_newssi_SetThreads(ESL_NEWSSI *ns, int nthreads);
 extern int  esl_newssi_AddKey   (ESL_NEWSSI *ns, const char *key, uint16_t fh, off_t r_off, off_t d_off, int64_t L);
 extern int  esl_newssi_AddAlias (ESL_NEWSSI *ns, const char *alias, const char *key);
 extern int  esl_newssi_Write    (ESL_NEWSSI *ns);
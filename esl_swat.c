@@ -1,19 +1,111 @@
-/* This module is unfinished; don't try to use it for anything! */
-
-
 /* Standard Smith/Waterman sequence alignment
- * 
+ *
  * Contents:
- *   
- * 
+ *    1. Reference implementation.
+ *    2. Striped SIMD implementation: ESL_SWAT_PROFILE.
+ *    3. Alignment.
+ *    4. One query against a block of targets.
+ *    5. Internal functions.
+ *    6. Stats driver.
+ *    7. Benchmark driver.
+ *    8. Unit tests.
+ *    9. Test driver.
+ *
+ * The striped implementation is score-identical to the reference.
+ * The reference recurrence is
+ *     M(i,j) = max(0, M(i-1,j-1), X(i-1,j-1), Y(i-1,j-1)) + s(x_j, y_i)
+ *     X(i,j) = max(M(i,j-1) + gop, X(i,j-1) + gex)
+ *     Y(i,j) = max(M(i-1,j) + gop, Y(i-1,j) + gex)
+ * and the score is the max over M, or 0. A negative cell value can
+ * never contribute to the score: it's either thrown away by the
+ * max(0, ...) in M, or only made more negative by gap scores <= 0.
+ * So we can keep max(0, M), max(0, X), max(0, Y) instead, which lets
+ * SIMD kernels use unsigned saturating arithmetic with 0 as the
+ * floor, and no -infinity (Farrar's "biased" 8-bit trick). Each
+ * kernel reports when its precision may have saturated, and then we
+ * redo the target with more bits: 8, then 16, then the plain <int>
+ * reference DP.
+ *
+ * Alignments (traceback) use the same recurrence in linear memory:
+ * find the end of the best alignment (the argmax of M), then find its
+ * start with a DP backwards from the end, then recover the path
+ * between them by divide and conquer. Each subproblem is a global
+ * path from one (cell, state) to another. Split it at its middle row
+ * im: a forward pass gives the best score of reaching each (im, j,
+ * state), a backward pass the best score from there to the end, and
+ * their best sum is a (cell, state) on an optimal path. Recurse on
+ * the two halves; solve small ones with a full traceback matrix.
  */
 #include "esl_config.h"
 
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "easel.h"
+#include "esl_alloc.h"
 #include "esl_composition.h"
+#include "esl_cpu.h"
 #include "esl_scorematrix.h"
+#include "esl_sq.h"
+#include "esl_swat.h"
+#include "esl_threadpool.h"
+
+#define eslSWAT_PROHIBIT    -999999999
+#define eslSWAT_NEG         (INT_MIN/4)  /* -infinity for the alignment DPs: room to add scores to it    */
+#define eslSWAT_DC_MINCELLS 4096         /* divide and conquer subproblems this small get a full matrix */
+
+/* Alignment DP states */
+enum swat_state_e { swat_M = 0, swat_X = 1, swat_Y = 2 };
+
+/* swat_dc_s
+ * Workspace for the linear-memory alignment DPs. Rows are indexed
+ * by absolute query position j, 0..L+1, so 0 and L+1 are always
+ * available as -infinity sentinels around any column range.
+ */
+struct swat_dc_s {
+  const ESL_DSQ         *x;	/* query 1..L           */
+  const ESL_DSQ         *y;	/* target 1..M          */
+  const ESL_SCOREMATRIX *S;
+  int                    L;
+  int                    gop;
+  int                    gex;
+  int                    dlo;	/* band: only cells with dlo <= j-i <= dhi */
+  int                    dhi;
+  int                   *f[2][3];  /* two forward rows, [row][state][0..L+1]  */
+  int                   *b[2][3];  /* two backward rows                        */
+  int                   *rowmem;   /* allocation for <f>, <b>                  */
+  int                   *mx;	   /* full matrix for small subproblems        */
+  int64_t                mxalloc;  /* current allocation of <mx>, in ints     */
+  char                  *ops;	   /* traceback under construction             */
+  int                    n;	   /* number of <ops> so far                   */
+};
+
+/* swat_block_s
+ * Shared arguments of the threaded block functions.
+ */
+struct swat_block_s {
+  ESL_SWAT_PROFILE   *sp;
+  const ESL_SQ_BLOCK *block;
+  int                *sc;	/* ScoreBlock: scores [0..count-1]; or NULL        */
+  int                 minsc;	/* AlignBlock: align targets scoring at least this */
+  ESL_SWAT_ALI      **ali;	/* AlignBlock: alignments [0..count-1]; or NULL    */
+};
+
+static int swat_dp(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, int *rowmem, int *ret_sc);
+static int swat_profile_dispatch(ESL_SWAT_PROFILE *sp);
+static int swat_profile_Layout(ESL_SWAT_PROFILE *sp, int W,
+			       int (*score8) (const ESL_SWAT_PROFILE *, void *, const ESL_DSQ *, int, int *),
+			       int (*score16)(const ESL_SWAT_PROFILE *, void *, const ESL_DSQ *, int, int *));
+static int swat_profile_score(const ESL_SWAT_PROFILE *sp, void *dp, int *rowmem, const ESL_DSQ *y, int M, int *ret_sc);
+static int swat_align(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, int dlo, int dhi, ESL_SWAT_ALI **ret_ali);
+static int swat_block_run(struct swat_block_s *b, ESL_THREADPOOL *pool);
+
 
-#define eslSWAT_PROHIBIT -999999999
+/*****************************************************************
+ *# 1. Reference implementation.
+ *****************************************************************/
 
 /* Function:  esl_swat_Score()
  * Incept:    SRE, Fri Apr 13 16:40:15 2007 [Janelia]
@@ -23,57 +115,399 @@
  *            is aligned to subject sequence <y> of length <M>, using
  *            a scoring system composed of residue alignment scores in matrix
  *            <S>, a gap-open score <gop>, and a gap-extend score <gex>.
- *            
+ *
  *            A gap of $k$ residues is scored as <gop> $\times (k-1)$
  *            <gex>.  That is, the gap-open score is applied to the
  *            first residue in the gap, and the gap-extend penalty is
  *            applied to each remaining residue. Additionally, both
  *            <gop> and <gex> should be negative numbers.
  *
+ *            This is the straightforward reference implementation.
+ *            To score one query against many targets, use an
+ *            <ESL_SWAT_PROFILE> instead, which is faster and gives
+ *            identical scores.
+ *
  * Returns:   <eslOK> on success, and the raw alignment score is returned in
- *            <ret_sc>. 
+ *            <ret_sc>.
  *
- * Throws:    (no abnormal error conditions)
+ * Throws:    <eslEMEM> on allocation failure.
  */
 int
 esl_swat_Score(ESL_DSQ *x, int L, ESL_DSQ *y, int M, ESL_SCOREMATRIX *S, int gop, int gex, int *ret_sc)
 {
-  int    status;
+  int  *rowmem = NULL;
+  int   status;
+
+  /* we need two rows of length (L+1) for each of three matrices, M, IX, IY. */
+  ESL_ALLOC(rowmem, sizeof(int) * 6 * (L+1));
+  status = swat_dp(x, L, y, M, S, gop, gex, rowmem, ret_sc);
+  free(rowmem);
+  return status;
+
+ ERROR:
+  *ret_sc = 0;
+  return status;
+}
+
+
+
+/*****************************************************************
+ *# 2. Striped SIMD implementation: ESL_SWAT_PROFILE.
+ *****************************************************************/
+
+/* Function:  esl_swat_profile_Create()
+ * Synopsis:  Set up a query for fast Smith/Waterman scoring.
+ *
+ * Purpose:   Create a striped profile of query sequence <x> of length
+ *            <L> (digital, 1..L), with residue scores <S>, gap-open
+ *            score <gop> and gap-extend score <gex>, defined as for
+ *            <esl_swat_Score()>; and the DP workspace to score it
+ *            against targets with <esl_swat_profile_Score()>.
+ *
+ *            The profile keeps its own copy of <x>, but only a
+ *            reference to <S>, which the caller must keep unchanged
+ *            while the profile is in use.
+ *
+ *            The fastest kernels that are compiled in and that the
+ *            processor supports are chosen here (AVX-512, AVX2,
+ *            SSE4.1, or NEON). Scores that don't fit in 8 or 16 bits,
+ *            or gap scores $> 0$, fall back to the reference
+ *            implementation.
+ *
+ * Returns:   ptr to the new profile.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+ESL_SWAT_PROFILE *
+esl_swat_profile_Create(const ESL_DSQ *x, int L, const ESL_SCOREMATRIX *S, int gop, int gex)
+{
+  ESL_SWAT_PROFILE *sp = NULL;
+  int               status;
+
+  ESL_ALLOC(sp, sizeof(ESL_SWAT_PROFILE));
+  sp->x       = NULL;
+  sp->L       = L;
+  sp->S       = S;
+  sp->gop     = gop;
+  sp->gex     = gex;
+  sp->W       = 0;
+  sp->Q8      = 0;
+  sp->Q16     = 0;
+  sp->bias    = 0;
+  sp->prof8   = NULL;
+  sp->prof16  = NULL;
+  sp->dp      = NULL;
+  sp->rowmem  = NULL;
+  sp->score8  = NULL;
+  sp->score16 = NULL;
+
+  ESL_ALLOC(sp->x,      sizeof(ESL_DSQ) * (L+2));
+  ESL_ALLOC(sp->rowmem, sizeof(int)     * 6 * (L+1));
+  memcpy(sp->x+1, x+1, sizeof(ESL_DSQ) * L);
+  sp->x[0] = sp->x[L+1] = eslDSQ_SENTINEL;
+
+  if ((status = swat_profile_dispatch(sp)) != eslOK) goto ERROR;
+  return sp;
+
+ ERROR:
+  esl_swat_profile_Destroy(sp);
+  return NULL;
+}
+
+
+/* Function:  esl_swat_profile_Score()
+ * Synopsis:  Smith/Waterman score of a query profile against a target.
+ *
+ * Purpose:   Score target sequence <y> of length <M> (digital, 1..M)
+ *            against query profile <sp>, and return the raw score in
+ *            <*ret_sc>. The score is identical to what
+ *            <esl_swat_Score()> gives for the same query, target, and
+ *            scoring system.
+ *
+ *            Tries an 8-bit striped kernel first, then 16-bit if the
+ *            score overflows that, then the reference DP.
+ *
+ *            Uses the DP workspace in <sp>, so one profile can't be
+ *            used by two threads at once; see
+ *            <esl_swat_profile_ScoreBlock()> for that.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+esl_swat_profile_Score(ESL_SWAT_PROFILE *sp, const ESL_DSQ *y, int M, int *ret_sc)
+{
+  return swat_profile_score(sp, sp->dp, sp->rowmem, y, M, ret_sc);
+}
+
+
+/* Function:  esl_swat_profile_Destroy()
+ * Synopsis:  Free an <ESL_SWAT_PROFILE>.
+ */
+void
+esl_swat_profile_Destroy(ESL_SWAT_PROFILE *sp)
+{
+  if (sp)
+    {
+      free(sp->x);
+      free(sp->rowmem);
+      esl_alloc_free(sp->prof8);
+      esl_alloc_free(sp->prof16);
+      esl_alloc_free(sp->dp);
+      free(sp);
+    }
+}
+
+
+
+/*****************************************************************
+ *# 3. Alignment.
+ *****************************************************************/
+
+/* Function:  esl_swat_Align()
+ * Synopsis:  Optimal Smith/Waterman alignment, in linear memory.
+ *
+ * Purpose:   Find an optimal local alignment of query <x> (digital,
+ *            1..L) to target <y> (digital, 1..M), with the same
+ *            scoring system and score as <esl_swat_Score()>, and
+ *            return it in <*ret_ali>: its score, its start/end
+ *            coordinates in both sequences, and its traceback (see
+ *            <ESL_SWAT_ALI>; <esl_swat_ali_Cigar()> converts it to a
+ *            CIGAR string). If the score is 0, the alignment is empty.
+ *
+ *            One DP pass finds the end of the alignment, a second one
+ *            backwards from there finds its start, and then the
+ *            traceback between them is recovered by divide and
+ *            conquer (Myers and Miller, CABIOS 4:11, 1988), in memory
+ *            linear in the lengths, for about three times the time of
+ *            scoring alone.
+ *
+ *            Gap scores <gop> and <gex> must be $\leq 0$.
+ *
+ *            Caller frees the alignment with <esl_swat_ali_Destroy()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if a gap score is positive; <eslEMEM> on
+ *            allocation failure. Now <*ret_ali> is <NULL>.
+ */
+int
+esl_swat_Align(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, ESL_SWAT_ALI **ret_ali)
+{
+  return swat_align(x, L, y, M, S, gop, gex, -M, L, ret_ali);
+}
+
+
+/* Function:  esl_swat_AlignBanded()
+ * Synopsis:  Optimal Smith/Waterman alignment within a diagonal band.
+ *
+ * Purpose:   Same as <esl_swat_Align()>, but only allow the alignment
+ *            to use DP cells $(i,j)$ (aligning or passing target
+ *            residue $y_i$ and query residue $x_j$) on diagonals
+ *            <dlo> $\leq j-i \leq$ <dhi>. Time is proportional to
+ *            <M> times the band width, instead of <M> times <L>. For
+ *            pairs already known to align near the main diagonal,
+ *            <dlo = -w>, <dhi = w> for some small <w>.
+ *
+ *            The result is optimal among banded alignments; if the
+ *            optimal unbanded alignment leaves the band, the banded
+ *            score is lower.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <dlo> $>$ <dhi>, or a gap score is
+ *            positive; <eslEMEM> on allocation failure. Now <*ret_ali>
+ *            is <NULL>.
+ */
+int
+esl_swat_AlignBanded(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, int dlo, int dhi, ESL_SWAT_ALI **ret_ali)
+{
+  *ret_ali = NULL;
+  if (dlo > dhi) ESL_EXCEPTION(eslEINVAL, "empty band: dlo > dhi");
+
+  /* Diagonals j-i outside -M..L can't have cells; clip so the DP's index arithmetic stays sane */
+  return swat_align(x, L, y, M, S, gop, gex, ESL_MAX(dlo, -M), ESL_MIN(dhi, L), ret_ali);
+}
+
+
+/* Function:  esl_swat_ali_Cigar()
+ * Synopsis:  Convert an alignment's traceback to a CIGAR string.
+ *
+ * Purpose:   Return the traceback of <ali> as a CIGAR string in
+ *            <*ret_cigar>, run-length encoding its 'M', 'I', and 'D'
+ *            columns: for example, "12M2I30M". The target is the
+ *            reference, so 'I' columns are query residues and 'D'
+ *            columns are target residues. An empty alignment gives an
+ *            empty string. Caller frees the string.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <*ret_cigar> is <NULL>.
+ */
+int
+esl_swat_ali_Cigar(const ESL_SWAT_ALI *ali, char **ret_cigar)
+{
+  char *cigar = NULL;
+  int   nruns = 0;
+  int   pos   = 0;
+  int   k, run;
+  int   status;
+
+  for (k = 0; k < ali->n; k++)
+    if (k == 0 || ali->ops[k] != ali->ops[k-1]) nruns++;
+
+  ESL_ALLOC(cigar, sizeof(char) * (nruns * 11 + 1));  /* each run is at most 10 digits + op */
+  for (k = 0; k < ali->n; k += run)
+    {
+      for (run = 1; k + run < ali->n && ali->ops[k+run] == ali->ops[k]; run++) ;
+      pos += sprintf(cigar + pos, "%d%c", run, ali->ops[k]);
+    }
+  cigar[pos] = '\0';
+  *ret_cigar = cigar;
+  return eslOK;
+
+ ERROR:
+  *ret_cigar = NULL;
+  return status;
+}
+
+
+/* Function:  esl_swat_ali_Destroy()
+ * Synopsis:  Free an <ESL_SWAT_ALI>.
+ */
+void
+esl_swat_ali_Destroy(ESL_SWAT_ALI *ali)
+{
+  if (ali)
+    {
+      free(ali->ops);
+      free(ali);
+    }
+}
+
+
+
+/*****************************************************************
+ *# 4. One query against a block of targets.
+ *****************************************************************/
+
+/* Function:  esl_swat_profile_ScoreBlock()
+ * Synopsis:  Score a query profile against a block of targets, in parallel.
+ *
+ * Purpose:   Score each digital target sequence in <block> against
+ *            query profile <sp>, as <esl_swat_profile_Score()> does,
+ *            and put the raw scores in <sc[0..block->count-1]>, which
+ *            the caller provides.
+ *
+ *            Targets are spread over the threads of <pool>, if it's
+ *            non-<NULL>; each thread gets its own DP workspace, and
+ *            shares the profile. With <pool> <NULL>, the caller's
+ *            thread scores them all.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <block> isn't digital; <eslEMEM> on
+ *            allocation failure; <eslESYS> on thread failure.
+ */
+int
+esl_swat_profile_ScoreBlock(ESL_SWAT_PROFILE *sp, const ESL_SQ_BLOCK *block, ESL_THREADPOOL *pool, int *sc)
+{
+  struct swat_block_s b;
+
+  b.sp    = sp;
+  b.block = block;
+  b.sc    = sc;
+  b.minsc = 0;
+  b.ali   = NULL;
+  return swat_block_run(&b, pool);
+}
+
+
+/* Function:  esl_swat_profile_AlignBlock()
+ * Synopsis:  Align a query profile to a block of targets, in parallel.
+ *
+ * Purpose:   Score each digital target sequence in <block> against
+ *            query profile <sp>, as <esl_swat_profile_Score()> does;
+ *            for each one that scores at least <minsc>, find its
+ *            optimal alignment to the query, as <esl_swat_Align()>
+ *            does, and put it in <ali[t]> for target <t>. The other
+ *            <ali[t]> are <NULL>. The caller provides the array
+ *            <ali[0..block->count-1]>, and frees the alignments in it.
+ *
+ *            The fast striped score screens the targets, so only the
+ *            ones that pass <minsc> pay for an alignment. With <minsc>
+ *            $\leq 0$, every target is aligned (scores of 0 giving empty
+ *            alignments).
+ *
+ *            Threading is as in <esl_swat_profile_ScoreBlock()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <block> isn't digital; <eslEMEM> on
+ *            allocation failure; <eslESYS> on thread failure. Now all
+ *            <ali[t]> are <NULL>.
+ */
+int
+esl_swat_profile_AlignBlock(ESL_SWAT_PROFILE *sp, const ESL_SQ_BLOCK *block, ESL_THREADPOOL *pool, int minsc, ESL_SWAT_ALI **ali)
+{
+  struct swat_block_s b;
+  int                 t;
+  int                 status;
+
+  for (t = 0; t < block->count; t++) ali[t] = NULL;
+
+  b.sp    = sp;
+  b.block = block;
+  b.sc    = NULL;
+  b.minsc = minsc;
+  b.ali   = ali;
+  if ((status = swat_block_run(&b, pool)) != eslOK)
+    {
+      for (t = 0; t < block->count; t++) { esl_swat_ali_Destroy(ali[t]); ali[t] = NULL; }
+    }
+  return status;
+}
+
+
+
+/*****************************************************************
+ * 5. Internal functions.
+ *****************************************************************/
+
+/* swat_dp()
+ * The reference DP of <esl_swat_Score()>, in caller-provided
+ * <rowmem> of 6*(L+1) ints.
+ */
+static int
+swat_dp(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, int *rowmem, int *ret_sc)
+{
+  int   *row[6];
   int    i,j;
-  int  **rowmem = NULL;
   int   *mc, *mp, *ixc, *ixp, *iyc, *iyp;
   int    maxsc;
 
   /* DP lattice is organized in rows (0) 1..i..M with target running vertically;
    * columns (0) 1..j..L with query running horizontally.
+   * Two rows of length (L+1) for each of three matrices, M, IX, IY.
    */
-
-  /* Allocation; 
-   * we need two rows of length (L+1) for each of three matrices, M, IX, IY. 
-   * in the future, optimize by providing this from the caller. 
-   */
-  ESL_ALLOC(rowmem,    sizeof(int *) * 6); 
-  rowmem[0] = NULL;
-  ESL_ALLOC(rowmem[0], sizeof(int) * 6 * (L+1));
-  for (i = 1; i < 6; i++) rowmem[i] = rowmem[0] + i*(L+1);
+  for (i = 0; i < 6; i++) row[i] = rowmem + i*(L+1);
 
   /* Initializations.
    */
-  rowmem[1][0] = 0;
-  rowmem[3][0] = eslSWAT_PROHIBIT;
-  rowmem[5][0] = eslSWAT_PROHIBIT;
-  for (j = 0; j <= L; j++) { 
-    rowmem[0][j] = 0;
-    rowmem[2][j] = eslSWAT_PROHIBIT;
-    rowmem[4][j] = eslSWAT_PROHIBIT;
+  row[1][0] = 0;
+  row[3][0] = eslSWAT_PROHIBIT;
+  row[5][0] = eslSWAT_PROHIBIT;
+  for (j = 0; j <= L; j++) {
+    row[0][j] = 0;
+    row[2][j] = eslSWAT_PROHIBIT;
+    row[4][j] = eslSWAT_PROHIBIT;
   }
 
   maxsc = 0;
   for (i = 1; i <= M; i++)	/* for each position in target... */
     {
-      if (i%2) { mp = rowmem[0]; mc = rowmem[1]; ixp = rowmem[2]; ixc = rowmem[3]; iyp = rowmem[4]; iyc = rowmem[5]; }
-      else     { mc = rowmem[0]; mp = rowmem[1]; ixc = rowmem[2]; ixp = rowmem[3]; iyc = rowmem[4]; iyp = rowmem[5]; }
-      
+      if (i%2) { mp = row[0]; mc = row[1]; ixp = row[2]; ixc = row[3]; iyp = row[4]; iyc = row[5]; }
+      else     { mc = row[0]; mp = row[1]; ixc = row[2]; ixp = row[3]; iyc = row[4]; iyp = row[5]; }
+
       for (j = 1; j <= L; j++)	/* for each position in query... */
 	{
 	  /* Match score at mc[j] aligns xj,yi. We can reach here from M (mp[j-1]), IX (ixp[j-1]), or IY (iyp[j-1]) */
@@ -81,16 +515,16 @@ esl_swat_Score(ESL_DSQ *x, int L, ESL_DSQ *y, int M, ESL_SCOREMATRIX *S, int gop
 	  if (mp[j-1]  > mc[j]) mc[j] = mp[j-1];
 	  if (ixp[j-1] > mc[j]) mc[j] = ixp[j-1];
 	  if (iyp[j-1] > mc[j]) mc[j] = iyp[j-1];
-	  mc[j] += S->s[x[j]][y[i]]; 	 
+	  mc[j] += S->s[x[j]][y[i]];
 
 	  if (mc[j] > maxsc) maxsc = mc[j];
 
-	  /* IX score at ixc[j] aligns xj to gap (horizontal move). 
+	  /* IX score at ixc[j] aligns xj to gap (horizontal move).
 	   * We reach here from mc[j-1] (gap-open) or ixc[j-1] (gap-extend).
 	   */
 	  ixc[j] = mc[j-1] + gop;
 	  if (ixc[j-1] + gex > ixc[j]) ixc[j] = ixc[j-1] + gex;
-	  
+
 	  /* analogously for vertical move to iyc. */
 	  iyc[j] = mp[j] + gop;
 	  if (iyp[j] + gex > iyc[j]) iyc[j] = iyp[j] + gex;
@@ -98,26 +532,536 @@ esl_swat_Score(ESL_DSQ *x, int L, ESL_DSQ *y, int M, ESL_SCOREMATRIX *S, int gop
     }
 
   *ret_sc = maxsc;
-  free(rowmem[0]);
+  return eslOK;
+}
+
+
+/* swat_profile_score()
+ * <esl_swat_profile_Score()>, with DP workspaces <dp> (the size of
+ * <sp->dp>) and <rowmem> (6*(L+1) ints) provided by the caller, so
+ * threads can share <sp>.
+ */
+static int
+swat_profile_score(const ESL_SWAT_PROFILE *sp, void *dp, int *rowmem, const ESL_DSQ *y, int M, int *ret_sc)
+{
+  int status;
+
+  if (sp->prof8)
+    {
+      status = (*sp->score8)(sp, dp, y, M, ret_sc);
+      if (status != eslERANGE) return status;
+    }
+  if (sp->prof16)
+    {
+      status = (*sp->score16)(sp, dp, y, M, ret_sc);
+      if (status != eslERANGE) return status;
+    }
+  return swat_dp(sp->x, sp->L, y, M, sp->S, sp->gop, sp->gex, rowmem, ret_sc);
+}
+
+
+/* swat_profile_dispatch()
+ * Choose the fastest striped kernels that are compiled in and that
+ * the processor supports, following our standard runtime dispatch
+ * pattern, and lay out <sp> for them. Without any, <sp> only uses the
+ * reference DP.
+ */
+static int
+swat_profile_dispatch(ESL_SWAT_PROFILE *sp)
+{
+#ifdef eslENABLE_AVX512
+  if (esl_cpu_has_avx512()) return swat_profile_Layout(sp, 64, esl_swat_score8_avx512, esl_swat_score16_avx512);
+#endif
+#ifdef eslENABLE_AVX
+  if (esl_cpu_has_avx())    return swat_profile_Layout(sp, 32, esl_swat_score8_avx,    esl_swat_score16_avx);
+#endif
+#ifdef eslENABLE_SSE4
+  if (esl_cpu_has_sse4())   return swat_profile_Layout(sp, 16, esl_swat_score8_sse,    esl_swat_score16_sse);
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  return swat_profile_Layout(sp, 16, esl_swat_score8_neon, esl_swat_score16_neon);
+#endif
+  return swat_profile_Layout(sp, 0, NULL, NULL);
+}
+
+
+/* swat_profile_Layout()
+ * (Re)build the striped profiles and SIMD workspace of <sp> for
+ * kernels <score8> and <score16> with <W>-byte vectors; or with <W>
+ * of 0, none. The 8-bit profile is only made if the query's scores
+ * span no more than 255 (score + bias fits in a byte), the 16-bit one
+ * if they fit in an int16_t; and neither if a gap score is positive,
+ * which the kernels' max(0, ...) floor doesn't allow.
+ */
+static int
+swat_profile_Layout(ESL_SWAT_PROFILE *sp, int W,
+		    int (*score8) (const ESL_SWAT_PROFILE *, void *, const ESL_DSQ *, int, int *),
+		    int (*score16)(const ESL_SWAT_PROFILE *, void *, const ESL_DSQ *, int, int *))
+{
+  const ESL_SCOREMATRIX *S  = sp->S;
+  int                    Kp = S->Kp;
+  int                    smin = 0;	/* padding scores 0 */
+  int                    smax = 0;
+  int                    a, j, q, t, sc;
+  int                    status;
+
+  esl_alloc_free(sp->prof8);  sp->prof8  = NULL;
+  esl_alloc_free(sp->prof16); sp->prof16 = NULL;
+  esl_alloc_free(sp->dp);     sp->dp     = NULL;
+  sp->W       = W;
+  sp->score8  = score8;
+  sp->score16 = score16;
+  sp->Q8      = (W ? ESL_MAX(1, (sp->L + W - 1)     / W)     : 0);
+  sp->Q16     = (W ? ESL_MAX(1, (sp->L + W/2 - 1) / (W/2)) : 0);
+  sp->bias    = 0;
+  if (W == 0 || sp->gop > 0 || sp->gex > 0) return eslOK;
+
+  for (j = 1; j <= sp->L; j++)
+    for (a = 0; a < Kp; a++)
+      {
+	smin = ESL_MIN(smin, S->s[sp->x[j]][a]);
+	smax = ESL_MAX(smax, S->s[sp->x[j]][a]);
+      }
+
+  if ((sp->dp = esl_alloc_aligned((size_t) 7 * sp->Q16 * W, 64)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  if (smax - smin <= 255)
+    {
+      if ((sp->prof8 = esl_alloc_aligned((size_t) Kp * sp->Q8 * W, 64)) == NULL) { status = eslEMEM; goto ERROR; }
+      sp->bias = (uint8_t) (-smin);
+      for (a = 0; a < Kp; a++)
+	for (q = 0; q < sp->Q8; q++)
+	  for (t = 0; t < W; t++)
+	    {
+	      j  = t * sp->Q8 + q + 1;
+	      sc = (j <= sp->L ? S->s[sp->x[j]][a] : 0);
+	      sp->prof8[((size_t) a * sp->Q8 + q) * W + t] = (uint8_t) (sc + sp->bias);
+	    }
+    }
+
+  if (smin >= -32768 && smax <= 32767)
+    {
+      if ((sp->prof16 = esl_alloc_aligned(sizeof(int16_t) * Kp * sp->Q16 * (W/2), 64)) == NULL) { status = eslEMEM; goto ERROR; }
+      for (a = 0; a < Kp; a++)
+	for (q = 0; q < sp->Q16; q++)
+	  for (t = 0; t < W/2; t++)
+	    {
+	      j  = t * sp->Q16 + q + 1;
+	      sp->prof16[((size_t) a * sp->Q16 + q) * (W/2) + t] = (int16_t) (j <= sp->L ? S->s[sp->x[j]][a] : 0);
+	    }
+    }
+  return eslOK;
+
+ ERROR:
+  esl_alloc_free(sp->prof8);  sp->prof8  = NULL;
+  esl_alloc_free(sp->prof16); sp->prof16 = NULL;
+  esl_alloc_free(sp->dp);     sp->dp     = NULL;
+  ESL_EXCEPTION(status, "allocation failed");
+}
+
+
+/* swat_max()
+ * Max of two DP values, floored at -infinity so that adding scores
+ * to -infinity can't drift toward overflow.
+ */
+static inline int
+swat_max(int a, int b)
+{
+  int v = ESL_MAX(a, b);
+  return ESL_MAX(v, eslSWAT_NEG);
+}
+
+/* swat_dc_fwd_init()
+ * Start a forward pass at query position <ja> of target row <ia>, in
+ * state <ss> (that cell's own score already counted, so it's 0): in
+ * <cur>, the rest of row <ia> up to <jb> can only be reached by X.
+ */
+static void
+swat_dc_fwd_init(const struct swat_dc_s *dc, int ia, int ja, int ss, int jb, int **cur)
+{
+  int *cM  = cur[swat_M], *cX = cur[swat_X], *cY = cur[swat_Y];
+  int  jhi = ESL_MIN(jb, ia + dc->dhi);
+  int  j;
+
+  cM[ja-1] = cX[ja-1] = cY[ja-1] = eslSWAT_NEG;
+  cM[ja]   = cX[ja]   = cY[ja]   = eslSWAT_NEG;
+  cur[ss][ja] = 0;
+  for (j = ja+1; j <= jhi; j++) cM[j] = cY[j] = eslSWAT_NEG;   /* two loops, not one: gcc 12 -O3 loop distribution miscompiles the fused one */
+  for (j = ja+1; j <= jhi; j++) cX[j] = swat_max(cM[j-1] + dc->gop, cX[j-1] + dc->gex);
+  if (jhi < jb) cM[jhi+1] = cX[jhi+1] = cY[jhi+1] = eslSWAT_NEG;
+}
+
+/* swat_dc_fwd_row()
+ * Forward DP for target row <i>, query positions <ja..jb> (within
+ * the band), from the previous row <prv> into <cur>. Leaves
+ * -infinity on both sides of the computed cells, which is all the
+ * next row reads outside them. If <local>, M may start anywhere (the
+ * max(0, ...) of Smith/Waterman).
+ */
+static void
+swat_dc_fwd_row(const struct swat_dc_s *dc, int i, int ja, int jb, int local, int **prv, int **cur)
+{
+  const int *pM  = prv[swat_M], *pX = prv[swat_X], *pY = prv[swat_Y];
+  int       *cM  = cur[swat_M], *cX = cur[swat_X], *cY = cur[swat_Y];
+  int        yi  = dc->y[i];
+  int        jlo = ESL_MAX(ja, i + dc->dlo);
+  int        jhi = ESL_MIN(jb, i + dc->dhi);
+  int        j, v;
+
+  if (jlo > jhi) return;
+  cM[jlo-1] = cX[jlo-1] = cY[jlo-1] = eslSWAT_NEG;
+  for (j = jlo; j <= jhi; j++)
+    {
+      v = ESL_MAX(pM[j-1], ESL_MAX(pX[j-1], pY[j-1]));
+      if (local && v < 0) v = 0;
+      cM[j] = swat_max(v + dc->S->s[dc->x[j]][yi], eslSWAT_NEG);
+      cX[j] = swat_max(cM[j-1] + dc->gop, cX[j-1] + dc->gex);
+      cY[j] = swat_max(pM[j]   + dc->gop, pY[j]   + dc->gex);
+    }
+  if (jhi < jb) cM[jhi+1] = cX[jhi+1] = cY[jhi+1] = eslSWAT_NEG;
+}
+
+/* swat_dc_bck_init()
+ * Start a backward pass at query position <jb> of target row <ib>,
+ * which must be reached in state <se>. Backward values are the best
+ * score from a (cell, state) to the end, not counting that cell's
+ * own score. Row <ib> back to <ja> can only get there by X.
+ */
+static void
+swat_dc_bck_init(const struct swat_dc_s *dc, int ib, int ja, int jb, int se, int **cur)
+{
+  int jlo = ESL_MAX(ja, ib + dc->dlo);
+  int j, s;
+
+  for (s = 0; s < 3; s++) cur[s][jb+1] = cur[s][jb] = eslSWAT_NEG;
+  cur[se][jb] = 0;
+  for (j = jb-1; j >= jlo; j--)
+    {
+      cur[swat_Y][j] = eslSWAT_NEG;
+      cur[swat_X][j] = swat_max(cur[swat_X][j+1] + dc->gex, eslSWAT_NEG);
+      cur[swat_M][j] = swat_max(cur[swat_X][j+1] + dc->gop, eslSWAT_NEG);
+    }
+  if (jlo > ja) for (s = 0; s < 3; s++) cur[s][jlo-1] = eslSWAT_NEG;
+}
+
+/* swat_dc_bck_row()
+ * Backward DP for target row <i> (< the end row), query positions
+ * <ja..jb> (within the band), from the next row <nxt> into <cur>.
+ */
+static void
+swat_dc_bck_row(const struct swat_dc_s *dc, int i, int ja, int jb, int **nxt, int **cur)
+{
+  int        yi  = dc->y[i+1];
+  int        jlo = ESL_MAX(ja, i + dc->dlo);
+  int        jhi = ESL_MIN(jb, i + dc->dhi);
+  int        j, s, e;
+
+  if (jlo > jhi) return;
+  for (s = 0; s < 3; s++) cur[s][jhi+1] = eslSWAT_NEG;
+  for (j = jhi; j >= jlo; j--)
+    {
+      e = (j < jb ? swat_max(nxt[swat_M][j+1] + dc->S->s[dc->x[j+1]][yi], eslSWAT_NEG) : eslSWAT_NEG);  /* to M(i+1,j+1) */
+      cur[swat_X][j] = swat_max(e, cur[swat_X][j+1] + dc->gex);
+      cur[swat_Y][j] = swat_max(e, nxt[swat_Y][j]   + dc->gex);
+      cur[swat_M][j] = swat_max(e, ESL_MAX(cur[swat_X][j+1], nxt[swat_Y][j]) + dc->gop);
+    }
+  if (jlo > ja) for (s = 0; s < 3; s++) cur[s][jlo-1] = eslSWAT_NEG;
+}
+
+/* swat_dc_full()
+ * Solve a small subproblem, from (ia,ja) in state <ss> to (ib,jb) in
+ * state <se>, with a full DP matrix and traceback; append its
+ * traceback (not including the start cell) to <dc->ops>.
+ */
+static int
+swat_dc_full(struct swat_dc_s *dc, int ia, int ja, int ss, int ib, int jb, int se)
+{
+  int      R   = ib - ia + 1;
+  int      W   = jb - ja + 2;	/* column 0 is a -infinity sentinel for ja-1 */
+  int     *mx[3];
+  int      i, j, s, v, sc, n0, k;
+  char     c;
+  int      status;
+
+  if ((int64_t) 3 * R * W > dc->mxalloc)
+    {
+      ESL_REALLOC(dc->mx, sizeof(int) * 3 * R * W);
+      dc->mxalloc = (int64_t) 3 * R * W;
+    }
+  for (s = 0; s < 3; s++) mx[s] = dc->mx + (int64_t) s * R * W;
+
+#define MX(s,i,j) (mx[(s)][(int64_t) ((i)-ia) * W + (j) - ja + 1])
+  for (i = ia; i <= ib; i++)
+    for (s = 0; s < 3; s++) MX(s,i,ja-1) = eslSWAT_NEG;
+  for (j = ja; j <= jb; j++)
+    for (s = 0; s < 3; s++) MX(s,ia,j) = eslSWAT_NEG;
+  MX(ss,ia,ja) = 0;
+  for (j = ja+1; j <= jb && j - ia <= dc->dhi; j++)
+    MX(swat_X,ia,j) = swat_max(MX(swat_M,ia,j-1) + dc->gop, MX(swat_X,ia,j-1) + dc->gex);
+
+  for (i = ia+1; i <= ib; i++)
+    for (j = ja; j <= jb; j++)
+      {
+	if (j - i < dc->dlo || j - i > dc->dhi) { for (s = 0; s < 3; s++) MX(s,i,j) = eslSWAT_NEG; continue; }
+	v = ESL_MAX(MX(swat_M,i-1,j-1), ESL_MAX(MX(swat_X,i-1,j-1), MX(swat_Y,i-1,j-1)));
+	MX(swat_M,i,j) = swat_max(v + dc->S->s[dc->x[j]][dc->y[i]], eslSWAT_NEG);
+	MX(swat_X,i,j) = swat_max(MX(swat_M,i,j-1) + dc->gop, MX(swat_X,i,j-1) + dc->gex);
+	MX(swat_Y,i,j) = swat_max(MX(swat_M,i-1,j) + dc->gop, MX(swat_Y,i-1,j) + dc->gex);
+      }
+
+  /* Traceback, end to start; ops come out reversed. */
+  i  = ib;
+  j  = jb;
+  s  = se;
+  n0 = dc->n;
+  while (i != ia || j != ja || s != ss)
+    {
+      v = MX(s,i,j);
+      if (v == eslSWAT_NEG) ESL_EXCEPTION(eslEINCONCEIVABLE, "swat traceback lost");
+      switch (s) {
+      case swat_M:
+	dc->ops[dc->n++] = 'M';
+	sc = dc->S->s[dc->x[j]][dc->y[i]];
+	i--; j--;
+	if      (MX(swat_M,i,j) + sc == v) s = swat_M;
+	else if (MX(swat_X,i,j) + sc == v) s = swat_X;
+	else                               s = swat_Y;
+	break;
+      case swat_X:
+	dc->ops[dc->n++] = 'I';
+	j--;
+	s = (MX(swat_M,i,j) + dc->gop == v ? swat_M : swat_X);
+	break;
+      case swat_Y:
+	dc->ops[dc->n++] = 'D';
+	i--;
+	s = (MX(swat_M,i,j) + dc->gop == v ? swat_M : swat_Y);
+	break;
+      }
+    }
+#undef MX
+  for (k = 0; k < (dc->n - n0) / 2; k++)
+    { c = dc->ops[n0+k]; dc->ops[n0+k] = dc->ops[dc->n-1-k]; dc->ops[dc->n-1-k] = c; }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* swat_dc()
+ * Divide and conquer traceback from (ia,ja) in state <ss> to (ib,jb)
+ * in state <se>, both in the band; append it (not including the
+ * start cell) to <dc->ops>.
+ */
+static int
+swat_dc(struct swat_dc_s *dc, int ia, int ja, int ss, int ib, int jb, int se)
+{
+  int **fp = dc->f[0], **fc = dc->f[1];
+  int **bn = dc->b[0], **bc = dc->b[1];
+  int **tmp;
+  int   im, jm, sm, jlo, jhi;
+  int   i, j, s, best;
+  int   status;
+
+  if (ib - ia <= 1 || (int64_t) (ib - ia + 1) * (jb - ja + 2) <= eslSWAT_DC_MINCELLS)
+    return swat_dc_full(dc, ia, ja, ss, ib, jb, se);
+
+  im = (ia + ib) / 2;
+  swat_dc_fwd_init(dc, ia, ja, ss, jb, fc);
+  for (i = ia+1; i <= im; i++)
+    {
+      tmp = fp; fp = fc; fc = tmp;
+      swat_dc_fwd_row(dc, i, ja, jb, FALSE, fp, fc);
+    }
+  swat_dc_bck_init(dc, ib, ja, jb, se, bc);
+  for (i = ib-1; i >= im; i--)
+    {
+      tmp = bn; bn = bc; bc = tmp;
+      swat_dc_bck_row(dc, i, ja, jb, bn, bc);
+    }
+
+  /* The best (cell, state) in row im is on an optimal path */
+  jlo  = ESL_MAX(ja, im + dc->dlo);
+  jhi  = ESL_MIN(jb, im + dc->dhi);
+  best = eslSWAT_NEG;
+  jm   = jlo;
+  sm   = swat_M;
+  for (j = jlo; j <= jhi; j++)
+    for (s = 0; s < 3; s++)
+      if (fc[s][j] + bc[s][j] > best) { best = fc[s][j] + bc[s][j]; jm = j; sm = s; }
+  if (best <= eslSWAT_NEG) ESL_EXCEPTION(eslEINCONCEIVABLE, "swat divide and conquer found no path");
+
+  if ((status = swat_dc(dc, ia, ja, ss, im, jm, sm)) != eslOK) return status;
+  return        swat_dc(dc, im, jm, sm, ib, jb, se);
+}
+
+/* swat_align()
+ * Implements <esl_swat_Align()> and <esl_swat_AlignBanded()>, with
+ * band <dlo..dhi> (-M..L for no band).
+ */
+static int
+swat_align(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, int dlo, int dhi, ESL_SWAT_ALI **ret_ali)
+{
+  struct swat_dc_s dc;
+  ESL_SWAT_ALI    *ali = NULL;
+  int            **prv, **cur, **tmp;
+  int              i1 = 0, j1 = 0, i2 = 0, j2 = 0;
+  int              i, j, r, s, sc, jlo, jhi;
+  int              status;
+
+  *ret_ali = NULL;
+  if (gop > 0 || gex > 0) ESL_EXCEPTION(eslEINVAL, "swat alignment needs gap scores <= 0");
+
+  dc.x       = x;
+  dc.y       = y;
+  dc.S       = S;
+  dc.L       = L;
+  dc.gop     = gop;
+  dc.gex     = gex;
+  dc.dlo     = dlo;
+  dc.dhi     = dhi;
+  dc.rowmem  = NULL;
+  dc.mx      = NULL;
+  dc.mxalloc = 0;
+  dc.ops     = NULL;
+  dc.n       = 0;
+
+  ESL_ALLOC(ali, sizeof(ESL_SWAT_ALI));
+  ali->ops = NULL;
+  ESL_ALLOC(dc.rowmem, sizeof(int) * 12 * (L+2));
+  for (r = 0; r < 2; r++)
+    for (s = 0; s < 3; s++)
+      {
+	dc.f[r][s] = dc.rowmem + (    r*3 + s) * (L+2);
+	dc.b[r][s] = dc.rowmem + (6 + r*3 + s) * (L+2);
+      }
+  for (i = 0; i < 12 * (L+2); i++) dc.rowmem[i] = eslSWAT_NEG;
+
+  /* Find the end: the first cell with the best M score. */
+  sc  = 0;
+  prv = dc.f[0];
+  cur = dc.f[1];
+  for (i = 1; i <= M; i++)
+    {
+      swat_dc_fwd_row(&dc, i, 1, L, TRUE, prv, cur);
+      jlo = ESL_MAX(1, i + dlo);
+      jhi = ESL_MIN(L, i + dhi);
+      for (j = jlo; j <= jhi; j++)
+	if (cur[swat_M][j] > sc) { sc = cur[swat_M][j]; i2 = i; j2 = j; }
+      tmp = prv; prv = cur; cur = tmp;
+    }
+
+  ESL_ALLOC(dc.ops, sizeof(char) * (L + M + 1));
+  if (sc > 0)
+    {
+      /* Find the start: backwards from M(i2,j2), the last cell in
+       * the last row where a path from M there scores <sc>. */
+      prv = dc.b[0];
+      cur = dc.b[1];
+      swat_dc_bck_init(&dc, i2, 1, j2, swat_M, cur);
+      if (S->s[x[j2]][y[i2]] == sc) { i1 = i2; j1 = j2; }
+      for (i = i2-1; i >= 1 && i1 == 0; i--)
+	{
+	  tmp = prv; prv = cur; cur = tmp;
+	  swat_dc_bck_row(&dc, i, 1, j2, prv, cur);
+	  jlo = ESL_MAX(1,  i + dlo);
+	  jhi = ESL_MIN(j2, i + dhi);
+	  for (j = jhi; j >= jlo; j--)
+	    if (cur[swat_M][j] + S->s[x[j]][y[i]] == sc) { i1 = i; j1 = j; break; }
+	}
+      if (i1 == 0) ESL_XEXCEPTION(eslEINCONCEIVABLE, "swat alignment start not found");
+
+      dc.ops[dc.n++] = 'M';
+      if (i1 != i2 || j1 != j2)
+	if ((status = swat_dc(&dc, i1, j1, swat_M, i2, j2, swat_M)) != eslOK) goto ERROR;
+    }
+  dc.ops[dc.n] = '\0';
+
+  ali->sc  = sc;
+  ali->i1  = i1;
+  ali->i2  = i2;
+  ali->j1  = j1;
+  ali->j2  = j2;
+  ali->n   = dc.n;
+  ali->ops = dc.ops;
+  free(dc.rowmem);
+  free(dc.mx);
+  *ret_ali = ali;
+  return eslOK;
+
+ ERROR:
+  free(dc.rowmem);
+  free(dc.mx);
+  free(dc.ops);
+  if (ali) free(ali);
+  *ret_ali = NULL;
+  return status;
+}
+
+
+/* swat_block_range()
+ * Work on targets <lo..hi-1> of a block, for one thread of
+ * <esl_swat_profile_{Score,Align}Block()>: with its own DP workspace.
+ */
+static int
+swat_block_range(void *arg, int64_t lo, int64_t hi)
+{
+  struct swat_block_s *b      = (struct swat_block_s *) arg;
+  ESL_SWAT_PROFILE    *sp     = b->sp;
+  void                *dp     = NULL;
+  int                 *rowmem = NULL;
+  const ESL_SQ        *sq;
+  int64_t              t;
+  int                  sc;
+  int                  status;
+
+  if (sp->dp && (dp = esl_alloc_aligned((size_t) 7 * sp->Q16 * sp->W, 64)) == NULL) { status = eslEMEM; goto ERROR; }
+  ESL_ALLOC(rowmem, sizeof(int) * 6 * (sp->L+1));
+
+  for (t = lo; t < hi; t++)
+    {
+      sq = &(b->block->list[t]);
+      if ((status = swat_profile_score(sp, dp, rowmem, sq->dsq, (int) sq->n, &sc)) != eslOK) goto ERROR;
+      if (b->sc) b->sc[t] = sc;
+      if (b->ali && sc >= b->minsc)
+	if ((status = esl_swat_Align(sp->x, sp->L, sq->dsq, (int) sq->n, sp->S, sp->gop, sp->gex, &(b->ali[t]))) != eslOK) goto ERROR;
+    }
+
+  esl_alloc_free(dp);
   free(rowmem);
   return eslOK;
 
  ERROR:
-  *ret_sc = 0;
-  if (rowmem != NULL) {
-    if (rowmem[0] != NULL) free(rowmem[0]);
-    free(rowmem);
-  }
+  esl_alloc_free(dp);
+  free(rowmem);
   return status;
 }
 
+/* swat_block_run()
+ * Run <swat_block_range()> over the whole block, on <pool> if it's
+ * non-<NULL>.
+ */
+static int
+swat_block_run(struct swat_block_s *b, ESL_THREADPOOL *pool)
+{
+  int t;
+
+  for (t = 0; t < b->block->count; t++)
+    if (b->block->list[t].dsq == NULL) ESL_EXCEPTION(eslEINVAL, "target block must be digital");
+
+  if (pool) return esl_threadpool_ParallelFor(pool, b->block->count, 0, swat_block_range, b);
+  else      return swat_block_range(b, 0, b->block->count);
+}
+
+
+
 
 /*****************************************************************
- * Stats driver.
+ * 6. Stats driver.
  *****************************************************************/
 
-/* 
-    gcc -I. -L. -g -Wall -DeslSWAT_STATS -o stats esl_swat.c -leasel -lm 
+/*
+    gcc -I. -L. -g -Wall -DeslSWAT_STATS -o stats esl_swat.c -leasel -lm
     ./stats
 */
 #ifdef eslSWAT_STATS
@@ -145,12 +1089,12 @@ main(int argc, char **argv)
   int       M;			/* target length */
   int       nseq;		/* number of target seqs to simulate */
   int       i;
-  int       gop; 
+  int       gop;
   int       gex;
   char     *mxfile     = "PMX";
   int       raw_sc;
 
-  /* Configuration 
+  /* Configuration
    */
   L = 400;			/* query length */
   M = 400;			/* target length */
@@ -175,14 +1119,14 @@ main(int argc, char **argv)
   esl_composition_BL62(bg);
 
   esl_rsq_xIID(r, bg, 20, L, x);
-  
+
   for (i = 0; i < nseq; i++)
     {
       esl_rsq_xIID(r, bg, 20, M, y);
       esl_swat_Score(x, L, y, M, S, gop, gex, &raw_sc);
       printf("%d\n", raw_sc);
     }
-  
+
   free(x);
   free(y);
   esl_scorematrix_Destroy(S);
@@ -193,27 +1137,590 @@ main(int argc, char **argv)
  ERROR:
   exit(status);
 }
-  
-  
+#endif /*eslSWAT_STATS*/
 
 
 
+/*****************************************************************
+ * 7. Benchmark driver.
+ *****************************************************************/
+#ifdef eslSWAT_BENCHMARK
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",     eslARG_NONE,     FALSE,  NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",     eslARG_INT,        "0",  NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",     eslARG_INT,      "400",  NULL, "n>0", NULL,  NULL, NULL, "query length",                                     0 },
+  { "-M",     eslARG_INT,      "400",  NULL, "n>0", NULL,  NULL, NULL, "target length",                                    0 },
+  { "-N",     eslARG_INT,    "10000",  NULL, "n>0", NULL,  NULL, NULL, "number of targets",                                0 },
+  { "-R",     eslARG_NONE,     FALSE,  NULL, NULL,  NULL,  NULL, NULL, "also time the reference implementation",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for striped Smith/Waterman";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS      *go  = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS   *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET     *abc = esl_alphabet_Create(eslAMINO);
+  ESL_SCOREMATRIX  *S   = esl_scorematrix_Create(abc);
+  ESL_STOPWATCH    *w   = esl_stopwatch_Create();
+  int               L   = esl_opt_GetInteger(go, "-L");
+  int               M   = esl_opt_GetInteger(go, "-M");
+  int               N   = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ          *x   = malloc(sizeof(ESL_DSQ) * (L+2));
+  ESL_DSQ          *y   = malloc(sizeof(ESL_DSQ) * (M+2));
+  ESL_SWAT_PROFILE *sp  = NULL;
+  double            bg[20];
+  int               sc;
+  int64_t           tot = 0;
+  int               n;
+
+  esl_scorematrix_Set("BLOSUM62", S);
+  esl_composition_BL62(bg);
+  esl_rsq_xIID(rng, bg, 20, L, x);
+  sp = esl_swat_profile_Create(x, L, S, -11, -1);
+
+  esl_stopwatch_Start(w);
+  for (n = 0; n < N; n++)
+    {
+      esl_rsq_xIID(rng, bg, 20, M, y);
+      esl_swat_profile_Score(sp, y, M, &sc);
+      tot += sc;
+    }
+  esl_stopwatch_Stop(w);
+  printf("# striped, %d-byte vectors: total score %" PRId64 "; %.1f Mcells/s\n", sp->W, tot, (double) L * M * N / w->user / 1e6);
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+
+  if (esl_opt_GetBoolean(go, "-R"))
+    {
+      esl_randomness_Init(rng, esl_randomness_GetSeed(rng));
+      esl_rsq_xIID(rng, bg, 20, L, x);
+      tot = 0;
+      esl_stopwatch_Start(w);
+      for (n = 0; n < N; n++)
+	{
+	  esl_rsq_xIID(rng, bg, 20, M, y);
+	  esl_swat_Score(x, L, y, M, S, -11, -1, &sc);
+	  tot += sc;
+	}
+      esl_stopwatch_Stop(w);
+      printf("# reference: total score %" PRId64 "; %.1f Mcells/s\n", tot, (double) L * M * N / w->user / 1e6);
+      esl_stopwatch_Display(stdout, w, "# CPU time: ");
+    }
+
+  free(x);
+  free(y);
+  esl_swat_profile_Destroy(sp);
+  esl_stopwatch_Destroy(w);
+  esl_scorematrix_Destroy(S);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslSWAT_BENCHMARK*/
 
-#endif /*eslSWAT_STATS*/
 
 
 /*****************************************************************
- * Unit tests
+ * 8. Unit tests.
  *****************************************************************/
+#ifdef eslSWAT_TESTDRIVE
 
-void
-utest_Score(char *s1, char *s2, ESL_SCOREMATRIX *S, int gop, int gex, int expect_score)
+#include "esl_random.h"
+
+/* swat_utest_kernels()
+ * Lay <sp> out, in turn, for each set of striped kernels compiled in
+ * and supported here; call <check(sp, data)> for each. Last, restore
+ * the standard dispatch.
+ */
+static void
+swat_utest_kernels(ESL_SWAT_PROFILE *sp, void (*check)(ESL_SWAT_PROFILE *sp, void *data), void *data)
 {
+#ifdef eslENABLE_AVX512
+  if (esl_cpu_has_avx512()) { if (swat_profile_Layout(sp, 64, esl_swat_score8_avx512, esl_swat_score16_avx512) != eslOK) esl_fatal("layout failed"); (*check)(sp, data); }
+#endif
+#ifdef eslENABLE_AVX
+  if (esl_cpu_has_avx())    { if (swat_profile_Layout(sp, 32, esl_swat_score8_avx,    esl_swat_score16_avx)    != eslOK) esl_fatal("layout failed"); (*check)(sp, data); }
+#endif
+#ifdef eslENABLE_SSE4
+  if (esl_cpu_has_sse4())   { if (swat_profile_Layout(sp, 16, esl_swat_score8_sse,    esl_swat_score16_sse)    != eslOK) esl_fatal("layout failed"); (*check)(sp, data); }
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+  if (swat_profile_Layout(sp, 16, esl_swat_score8_neon, esl_swat_score16_neon) != eslOK) esl_fatal("layout failed");
+  (*check)(sp, data);
+#endif
+  if (swat_profile_Layout(sp, 0, NULL, NULL) != eslOK) esl_fatal("layout failed");
+  (*check)(sp, data);
+  if (swat_profile_dispatch(sp) != eslOK) esl_fatal("dispatch failed");
+}
 
+struct swat_utest_s {
+  ESL_DSQ *x;  int L;
+  ESL_DSQ *y;  int M;
+  int      expect;		/* reference score */
+  int      need8;		/* TRUE if the 8-bit kernel must not overflow */
+};
+
+/* swat_utest_check()
+ * Each kernel that doesn't report overflow gets the reference score,
+ * and so does the full cascade.
+ */
+static void
+swat_utest_check(ESL_SWAT_PROFILE *sp, void *data)
+{
+  char                 msg[] = "swat kernel check failed";
+  struct swat_utest_s *d     = (struct swat_utest_s *) data;
+  int                  sc;
+  int                  status;
+
+  if (sp->prof8)
+    {
+      status = (*sp->score8)(sp, sp->dp, d->y, d->M, &sc);
+      if      (status == eslOK)    { if (sc != d->expect) esl_fatal("%s: 8-bit score %d, expected %d (W=%d)", msg, sc, d->expect, sp->W); }
+      else if (status == eslERANGE) { if (d->need8) esl_fatal("%s: unexpected 8-bit overflow", msg); }
+      else esl_fatal(msg);
+    }
+  if (sp->prof16)
+    {
+      status = (*sp->score16)(sp, sp->dp, d->y, d->M, &sc);
+      if      (status == eslOK)    { if (sc != d->expect) esl_fatal("%s: 16-bit score %d, expected %d (W=%d)", msg, sc, d->expect, sp->W); }
+      else if (status != eslERANGE) esl_fatal(msg);
+    }
+  if (esl_swat_profile_Score(sp, d->y, d->M, &sc) != eslOK || sc != d->expect)
+    esl_fatal("%s: profile score %d, expected %d (W=%d)", msg, sc, d->expect, sp->W);
+}
+
+/* utest_random()
+ * Random queries and targets of random lengths, including zero and
+ * lengths that don't fill a vector, with degenerate residues mixed in
+ * and random gap scores: every kernel matches the reference.
+ */
+static void
+utest_random(ESL_RANDOMNESS *rng, ESL_SCOREMATRIX *S, int ntrials)
+{
+  char                 msg[] = "swat random unit test failed";
+  const ESL_ALPHABET  *abc   = S->abc_r;
+  struct swat_utest_s  d;
+  ESL_SWAT_PROFILE    *sp    = NULL;
+  int                  gop, gex;
+  int                  n, j;
+  int                  status;
+
+  ESL_ALLOC(d.x, sizeof(ESL_DSQ) * 302);
+  ESL_ALLOC(d.y, sizeof(ESL_DSQ) * 302);
+  for (n = 0; n < ntrials; n++)
+    {
+      d.L = esl_rnd_Roll(rng, 300);
+      d.M = esl_rnd_Roll(rng, 300);
+      gop = -esl_rnd_Roll(rng, 15);
+      gex = -esl_rnd_Roll(rng, 4);
+      d.x[0] = d.x[d.L+1] = d.y[0] = d.y[d.M+1] = eslDSQ_SENTINEL;
+      for (j = 1; j <= d.L; j++) d.x[j] = (esl_rnd_Roll(rng, 20) ? esl_rnd_Roll(rng, abc->K) : abc->K + 1 + esl_rnd_Roll(rng, abc->Kp - abc->K - 3));
+      for (j = 1; j <= d.M; j++) d.y[j] = (esl_rnd_Roll(rng, 20) ? esl_rnd_Roll(rng, abc->K) : abc->K + 1 + esl_rnd_Roll(rng, abc->Kp - abc->K - 3));
+      if (n % 4 == 0 && d.L > 10 && d.M > 10)	/* plant a homology */
+	for (j = 1; j <= ESL_MIN(d.L, d.M) / 2; j++) d.y[j + d.M/4] = d.x[j + d.L/4];
+
+      if (esl_swat_Score(d.x, d.L, d.y, d.M, S, gop, gex, &d.expect) != eslOK) esl_fatal(msg);
+      d.need8 = FALSE;
+      if ((sp = esl_swat_profile_Create(d.x, d.L, S, gop, gex)) == NULL) esl_fatal(msg);
+      swat_utest_kernels(sp, swat_utest_check, &d);
+      esl_swat_profile_Destroy(sp);
+    }
+  free(d.x);
+  free(d.y);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* utest_overflow()
+ * A long query against itself scores too high for 8 bits; with every
+ * score scaled up 10x, too high for 16 bits. The cascade still gets
+ * the reference score. With gaps scoring 0, a short random pair must
+ * not overflow in 8 bits.
+ */
+static void
+utest_overflow(ESL_RANDOMNESS *rng, ESL_SCOREMATRIX *S)
+{
+  char                 msg[] = "swat overflow unit test failed";
+  const ESL_ALPHABET  *abc   = S->abc_r;
+  ESL_SCOREMATRIX     *S10   = esl_scorematrix_Clone(S);
+  struct swat_utest_s  d;
+  ESL_SWAT_PROFILE    *sp    = NULL;
+  int                  a, b, j;
+  int                  status;
+
+  d.L = d.M = 1000;
+  ESL_ALLOC(d.x, sizeof(ESL_DSQ) * (d.L+2));
+  d.y = d.x;
+  d.x[0] = d.x[d.L+1] = eslDSQ_SENTINEL;
+  for (j = 1; j <= d.L; j++) d.x[j] = esl_rnd_Roll(rng, abc->K);
+
+  if (esl_swat_Score(d.x, d.L, d.y, d.M, S, -11, -1, &d.expect) != eslOK) esl_fatal(msg);
+  if (d.expect < 255) esl_fatal(msg);
+  d.need8 = FALSE;
+  if ((sp = esl_swat_profile_Create(d.x, d.L, S, -11, -1)) == NULL) esl_fatal(msg);
+  swat_utest_kernels(sp, swat_utest_check, &d);
+  esl_swat_profile_Destroy(sp);
+
+  for (a = 0; a < S10->Kp; a++)
+    for (b = 0; b < S10->Kp; b++) S10->s[a][b] *= 10;
+  if (esl_swat_Score(d.x, d.L, d.y, d.M, S10, -110, -10, &d.expect) != eslOK) esl_fatal(msg);
+  if (d.expect < 32767) esl_fatal(msg);
+  if ((sp = esl_swat_profile_Create(d.x, d.L, S10, -110, -10)) == NULL) esl_fatal(msg);
+  swat_utest_kernels(sp, swat_utest_check, &d);
+  esl_swat_profile_Destroy(sp);
+
+  d.L = d.M = 20;
+  d.x[d.L+1] = eslDSQ_SENTINEL;
+  if (esl_swat_Score(d.x, d.L, d.y, d.M, S, 0, 0, &d.expect) != eslOK) esl_fatal(msg);
+  d.need8 = TRUE;
+  if ((sp = esl_swat_profile_Create(d.x, d.L, S, 0, 0)) == NULL) esl_fatal(msg);
+  swat_utest_kernels(sp, swat_utest_check, &d);
+  esl_swat_profile_Destroy(sp);
+
+  free(d.x);
+  esl_scorematrix_Destroy(S10);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* swat_utest_rescore()
+ * Check that <ali> is a valid local alignment of <x> to <y>, and
+ * return its score, recomputed from its traceback.
+ */
+static int
+swat_utest_rescore(const ESL_DSQ *x, const ESL_DSQ *y, const ESL_SCOREMATRIX *S, int gop, int gex, const ESL_SWAT_ALI *ali)
+{
+  char  msg[] = "swat alignment is invalid";
+  char *cigar = NULL;
+  int   i     = ali->i1;
+  int   j     = ali->j1;
+  int   sc    = 0;
+  int   k, n, pos, len;
+
+  if (ali->n == 0) { if (ali->sc != 0 || ali->i1 || ali->j1) esl_fatal(msg); return 0; }
+  if (ali->ops[0] != 'M' || ali->ops[ali->n-1] != 'M' || strlen(ali->ops) != ali->n) esl_fatal(msg);
+  for (k = 0; k < ali->n; k++)
+    switch (ali->ops[k]) {
+    case 'M': sc += S->s[x[j]][y[i]];                       i++; j++; break;
+    case 'I': sc += (ali->ops[k-1] == 'I' ? gex : gop);     j++;      break;
+    case 'D': sc += (ali->ops[k-1] == 'D' ? gex : gop);     i++;      break;
+    default:  esl_fatal(msg);
+    }
+  if (i != ali->i2 + 1 || j != ali->j2 + 1)         esl_fatal(msg);
+  if (strstr(ali->ops, "ID") || strstr(ali->ops, "DI")) esl_fatal(msg);
+
+  /* the CIGAR string encodes the same ops */
+  if (esl_swat_ali_Cigar(ali, &cigar) != eslOK) esl_fatal(msg);
+  for (pos = 0, k = 0; cigar[pos] != '\0'; pos += len + 1)
+    {
+      if (sscanf(cigar + pos, "%d%n", &n, &len) != 1 || n <= 0) esl_fatal(msg);
+      for (; n > 0; n--, k++)
+	if (k >= ali->n || ali->ops[k] != cigar[pos+len]) esl_fatal(msg);
+    }
+  if (k != ali->n) esl_fatal(msg);
+  free(cigar);
+  return sc;
+}
+
+/* swat_utest_banded_score()
+ * Brute force banded Smith/Waterman score: the reference DP with
+ * cells outside diagonals dlo..dhi prohibited.
+ */
+static int
+swat_utest_banded_score(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, int dlo, int dhi)
+{
+  int *mx  = malloc(sizeof(int) * 3 * (L+1) * (M+1));
+  int *mm  = mx;
+  int *xx  = mx +     (L+1) * (M+1);
+  int *yy  = mx + 2 * (L+1) * (M+1);
+  int  sc  = 0;
+  int  i, j, c, v;
+
+  if (mx == NULL) esl_fatal("malloc failed");
+  for (c = 0; c < (L+1) * (M+1); c++) mm[c] = xx[c] = yy[c] = eslSWAT_NEG;
+  for (i = 1; i <= M; i++)
+    for (j = 1; j <= L; j++)
+      {
+	if (j - i < dlo || j - i > dhi) continue;
+	c     = i * (L+1) + j;
+	v     = ESL_MAX(0, ESL_MAX(mm[c-L-2], ESL_MAX(xx[c-L-2], yy[c-L-2])));
+	mm[c] = v + S->s[x[j]][y[i]];
+	xx[c] = ESL_MAX(ESL_MAX(mm[c-1]     + gop, xx[c-1]     + gex), eslSWAT_NEG);
+	yy[c] = ESL_MAX(ESL_MAX(mm[c-L-1]   + gop, yy[c-L-1]   + gex), eslSWAT_NEG);
+	sc    = ESL_MAX(sc, mm[c]);
+      }
+  free(mx);
+  return sc;
+}
+
+/* swat_utest_sample()
+ * Sample a random digital sequence of length <n> into <dsq>, with a
+ * few degenerate residues.
+ */
+static void
+swat_utest_sample(ESL_RANDOMNESS *rng, const ESL_ALPHABET *abc, ESL_DSQ *dsq, int n)
+{
+  int j;
+
+  dsq[0] = dsq[n+1] = eslDSQ_SENTINEL;
+  for (j = 1; j <= n; j++)
+    dsq[j] = (esl_rnd_Roll(rng, 20) ? esl_rnd_Roll(rng, abc->K) : abc->K + 1 + esl_rnd_Roll(rng, abc->Kp - abc->K - 3));
 }
 
+/* swat_utest_homolog()
+ * Make <y> (length <M>) share a mutated copy of a piece of <x>
+ * (length <L>), with some indels, so alignments are long and gappy.
+ */
+static void
+swat_utest_homolog(ESL_RANDOMNESS *rng, const ESL_ALPHABET *abc, const ESL_DSQ *x, int L, ESL_DSQ *y, int M)
+{
+  int i = 1 + esl_rnd_Roll(rng, ESL_MAX(1, M/4));
+  int j = 1 + esl_rnd_Roll(rng, ESL_MAX(1, L/4));
 
+  while (i <= M && j <= L)
+    {
+      switch (esl_rnd_Roll(rng, 40)) {
+      case 0:  i++;                                  break;   /* target insertion */
+      case 1:  j++;                                  break;   /* target deletion  */
+      case 2:  y[i++] = esl_rnd_Roll(rng, abc->K); j++; break;   /* substitution     */
+      default: y[i++] = x[j++];                      break;
+      }
+    }
+}
 
+/* utest_align()
+ * Alignments of random pairs, some with planted homologies, have the
+ * reference score, and their tracebacks are valid alignments that
+ * score the same.
+ */
+static void
+utest_align(ESL_RANDOMNESS *rng, ESL_SCOREMATRIX *S, int ntrials)
+{
+  char                msg[] = "swat align unit test failed";
+  const ESL_ALPHABET *abc   = S->abc_r;
+  ESL_DSQ            *x     = NULL;
+  ESL_DSQ            *y     = NULL;
+  ESL_SWAT_ALI       *ali   = NULL;
+  int                 maxlen = 1200;
+  int                 L, M, gop, gex, sc, n;
+  int                 status;
 
+  ESL_ALLOC(x, sizeof(ESL_DSQ) * (maxlen+2));
+  ESL_ALLOC(y, sizeof(ESL_DSQ) * (maxlen+2));
+  for (n = 0; n < ntrials; n++)
+    {
+      L   = esl_rnd_Roll(rng, (n % 10 == 0 ? maxlen : 200));
+      M   = esl_rnd_Roll(rng, (n % 10 == 0 ? maxlen : 200));
+      gop = -esl_rnd_Roll(rng, 15);
+      gex = -esl_rnd_Roll(rng, 4);
+      swat_utest_sample(rng, abc, x, L);
+      swat_utest_sample(rng, abc, y, M);
+      if (n % 2) swat_utest_homolog(rng, abc, x, L, y, M);
 
+      if (esl_swat_Score(x, L, y, M, S, gop, gex, &sc) != eslOK) esl_fatal(msg);
+      if (esl_swat_Align(x, L, y, M, S, gop, gex, &ali) != eslOK) esl_fatal(msg);
+      if (ali->sc != sc)                                           esl_fatal("%s: score %d, expected %d", msg, ali->sc, sc);
+      if (swat_utest_rescore(x, y, S, gop, gex, ali) != sc)        esl_fatal("%s: traceback doesn't score %d", msg, sc);
+      esl_swat_ali_Destroy(ali);
+    }
+  free(x);
+  free(y);
+  return;
 
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* utest_banded()
+ * Banded alignments have the brute force banded score, stay in their
+ * band, and with a band that covers everything, are the same as
+ * unbanded ones.
+ */
+static void
+utest_banded(ESL_RANDOMNESS *rng, ESL_SCOREMATRIX *S, int ntrials)
+{
+  char                msg[] = "swat banded unit test failed";
+  const ESL_ALPHABET *abc   = S->abc_r;
+  ESL_DSQ            *x     = NULL;
+  ESL_DSQ            *y     = NULL;
+  ESL_SWAT_ALI       *ali   = NULL;
+  ESL_SWAT_ALI       *ali2  = NULL;
+  int                 L, M, gop, gex, dlo, dhi, sc, n, k, i, j;
+  int                 status;
+
+  ESL_ALLOC(x, sizeof(ESL_DSQ) * 402);
+  ESL_ALLOC(y, sizeof(ESL_DSQ) * 402);
+  for (n = 0; n < ntrials; n++)
+    {
+      L   = esl_rnd_Roll(rng, 400);
+      M   = esl_rnd_Roll(rng, 400);
+      gop = -esl_rnd_Roll(rng, 15);
+      gex = -esl_rnd_Roll(rng, 4);
+      dlo = esl_rnd_Roll(rng, 60) - 40;
+      dhi = dlo + esl_rnd_Roll(rng, 40);
+      swat_utest_sample(rng, abc, x, L);
+      swat_utest_sample(rng, abc, y, M);
+      swat_utest_homolog(rng, abc, x, L, y, M);
+
+      sc = swat_utest_banded_score(x, L, y, M, S, gop, gex, dlo, dhi);
+      if (esl_swat_AlignBanded(x, L, y, M, S, gop, gex, dlo, dhi, &ali) != eslOK) esl_fatal(msg);
+      if (ali->sc != sc)                                                            esl_fatal("%s: score %d, expected %d", msg, ali->sc, sc);
+      if (swat_utest_rescore(x, y, S, gop, gex, ali) != sc)                         esl_fatal(msg);
+      for (i = ali->i1, j = ali->j1, k = 0; k < ali->n; k++)
+	{
+	  if (k > 0 && ali->ops[k] != 'I') i++;
+	  if (k > 0 && ali->ops[k] != 'D') j++;
+	  if (j - i < dlo || j - i > dhi) esl_fatal("%s: alignment leaves the band", msg);
+	}
+      esl_swat_ali_Destroy(ali);
+
+      if (esl_swat_AlignBanded(x, L, y, M, S, gop, gex, -M, L, &ali)  != eslOK) esl_fatal(msg);
+      if (esl_swat_Align      (x, L, y, M, S, gop, gex,         &ali2) != eslOK) esl_fatal(msg);
+      if (ali->sc != ali2->sc || ali->i1 != ali2->i1 || ali->j2 != ali2->j2 || strcmp(ali->ops, ali2->ops) != 0) esl_fatal(msg);
+      esl_swat_ali_Destroy(ali);
+      esl_swat_ali_Destroy(ali2);
+    }
+  esl_exception_SetHandler(&esl_nonfatal_handler);
+  if (esl_swat_AlignBanded(x, 10, y, 10, S, -11, -1, 1, 0, &ali) != eslEINVAL || ali != NULL) esl_fatal(msg);  /* empty band */
+  esl_exception_ResetDefaultHandler();
+
+  free(x);
+  free(y);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* utest_block()
+ * Scores and alignments of a query against a block of targets, with
+ * and without threads, are the same as one at a time.
+ */
+static void
+utest_block(ESL_RANDOMNESS *rng, ESL_SCOREMATRIX *S, int nthreads)
+{
+  char                msg[] = "swat block unit test failed";
+  const ESL_ALPHABET *abc   = S->abc_r;
+  int                 L     = 1 + esl_rnd_Roll(rng, 300);
+  int                 N     = 100;
+  ESL_SQ_BLOCK       *block = esl_sq_CreateDigitalBlock(N, abc);
+  ESL_THREADPOOL     *pool  = esl_threadpool_Create(nthreads);
+  ESL_DSQ            *x     = NULL;
+  ESL_SWAT_PROFILE   *sp    = NULL;
+  ESL_SWAT_ALI      **ali   = NULL;
+  ESL_SWAT_ALI       *ali1  = NULL;
+  int                *sc    = NULL;
+  int                 minsc = 40;
+  int                 t, p, M, sc1;
+  int                 status;
+
+  if (block == NULL || pool == NULL) esl_fatal(msg);
+  ESL_ALLOC(x,   sizeof(ESL_DSQ)        * (L+2));
+  ESL_ALLOC(sc,  sizeof(int)            * N);
+  ESL_ALLOC(ali, sizeof(ESL_SWAT_ALI *) * N);
+  swat_utest_sample(rng, abc, x, L);
+  for (t = 0; t < N; t++)
+    {
+      M = esl_rnd_Roll(rng, 400);
+      if (esl_sq_GrowTo(&(block->list[t]), M) != eslOK) esl_fatal(msg);
+      swat_utest_sample(rng, abc, block->list[t].dsq, M);
+      if (t % 3 == 0) swat_utest_homolog(rng, abc, x, L, block->list[t].dsq, M);
+      block->list[t].n = M;
+    }
+  block->count = N;
+  if ((sp = esl_swat_profile_Create(x, L, S, -11, -1)) == NULL) esl_fatal(msg);
+
+  for (p = 0; p < 2; p++)	/* p=0: on the pool; p=1: no pool */
+    {
+      if (esl_swat_profile_ScoreBlock(sp, block, (p == 0 ? pool : NULL), sc)        != eslOK) esl_fatal(msg);
+      if (esl_swat_profile_AlignBlock(sp, block, (p == 0 ? pool : NULL), minsc, ali) != eslOK) esl_fatal(msg);
+      for (t = 0; t < N; t++)
+	{
+	  if (esl_swat_Score(x, L, block->list[t].dsq, block->list[t].n, S, -11, -1, &sc1) != eslOK) esl_fatal(msg);
+	  if (sc[t] != sc1) esl_fatal("%s: target %d scores %d, expected %d", msg, t, sc[t], sc1);
+	  if (sc1 < minsc) { if (ali[t] != NULL) esl_fatal(msg); continue; }
+
+	  if (esl_swat_Align(x, L, block->list[t].dsq, block->list[t].n, S, -11, -1, &ali1) != eslOK) esl_fatal(msg);
+	  if (ali[t] == NULL || ali[t]->sc != sc1 || strcmp(ali[t]->ops, ali1->ops) != 0 || ali[t]->i1 != ali1->i1 || ali[t]->j1 != ali1->j1) esl_fatal(msg);
+	  esl_swat_ali_Destroy(ali1);
+	  esl_swat_ali_Destroy(ali[t]);
+	}
+    }
+
+  free(x);
+  free(sc);
+  free(ali);
+  esl_swat_profile_Destroy(sp);
+  esl_threadpool_Destroy(pool);
+  esl_sq_DestroyBlock(block);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*eslSWAT_TESTDRIVE*/
+
+
+
+/*****************************************************************
+ * 9. Test driver.
+ *****************************************************************/
+#ifdef eslSWAT_TESTDRIVE
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+static ESL_OPTIONS options[] = {
+   /* name  type         default  env   range togs  reqs  incomp  help                              docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                     0},
+  {"-s",  eslARG_INT,       "0", NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",           0},
+  {"-N",  eslARG_INT,     "200", NULL, "n>0",NULL, NULL, NULL, "number of random trials",                 0},
+  {"--cpu", eslARG_INT,     "3", NULL, "n>=0",NULL, NULL, NULL, "number of worker threads for block tests", 0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for swat: Smith/Waterman scores";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS     *go  = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS  *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET    *abc = esl_alphabet_Create(eslAMINO);
+  ESL_SCOREMATRIX *S   = esl_scorematrix_Create(abc);
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  esl_scorematrix_Set("BLOSUM62", S);
+  utest_random  (rng, S, esl_opt_GetInteger(go, "-N"));
+  utest_overflow(rng, S);
+  utest_align   (rng, S, esl_opt_GetInteger(go, "-N"));
+  utest_banded  (rng, S, esl_opt_GetInteger(go, "-N"));
+  utest_block   (rng, S, esl_opt_GetInteger(go, "--cpu"));
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_scorematrix_Destroy(S);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslSWAT_TESTDRIVE*/
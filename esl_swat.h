@@ -0,0 +1,94 @@
+/* Smith/Waterman local sequence alignment scores.
+ */
+#ifndef eslSWAT_INCLUDED
+#define eslSWAT_INCLUDED
+#include "esl_config.h"
+
+#include "easel.h"
+#include "esl_scorematrix.h"
+#include "esl_sq.h"
+#include "esl_threadpool.h"
+
+/* ESL_SWAT_PROFILE
+ * A query, scoring system, and DP workspace, set up once and reused to
+ * score the query against many targets with striped SIMD kernels
+ * (Farrar, Bioinformatics 23:156, 2007).
+ *
+ * The query profile is striped: for a vector of <n> elements and
+ * <Q = ceil(L/n)> vectors per row, element <t> of vector <q> is query
+ * position <j = t*Q + q + 1>. Striped rows are padded out with score 0.
+ */
+typedef struct esl_swat_profile_s {
+  ESL_DSQ               *x;	    /* copy of query, 1..L (digital, with sentinels)            */
+  int                    L;	    /* query length                                               */
+  const ESL_SCOREMATRIX *S;	    /* residue scores; a reference, caller keeps it alive         */
+  int                    gop;	    /* gap-open score (first residue of a gap), <= 0              */
+  int                    gex;	    /* gap-extend score (each further residue), <= 0              */
+
+  int                    W;	    /* vector width in bytes; 0 if no SIMD kernel is in use       */
+  int                    Q8;	    /* # of vectors per striped row, 8-bit  (W lanes)             */
+  int                    Q16;	    /* # of vectors per striped row, 16-bit (W/2 lanes)           */
+  uint8_t                bias;	    /* 8-bit profile holds score + bias, so it's unsigned         */
+  uint8_t               *prof8;	    /* 8-bit profile [0..Kp-1][0..Q8*W-1]; or NULL if scores don't fit */
+  int16_t               *prof16;    /* 16-bit profile [0..Kp-1][0..Q16*W/2-1]; or NULL            */
+  void                  *dp;	    /* SIMD DP rows, 7 * Q16 * W bytes, aligned                   */
+  int                   *rowmem;    /* scalar DP rows, 6 * (L+1)                                   */
+
+  /* striped kernels for the 8- and 16-bit passes; eslERANGE when they'd overflow */
+  int (*score8) (const struct esl_swat_profile_s *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+  int (*score16)(const struct esl_swat_profile_s *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+} ESL_SWAT_PROFILE;
+
+/* ESL_SWAT_ALI
+ * An optimal local alignment of query <x> (1..L) to target <y> (1..M).
+ *
+ * <ops> has one character per alignment column: 'M' aligns x_j to y_i;
+ * 'I' is a query residue x_j against a gap; 'D' is a target residue y_i
+ * against a gap. (So, as in a SAM CIGAR, the target is the reference.)
+ * Local alignments always begin and end with an 'M'.
+ */
+typedef struct {
+  int   sc;			/* raw score; 0 if there's no alignment (then n = 0, coords 0) */
+  int   i1, i2;			/* alignment starts, ends at y_i1..y_i2 in the target           */
+  int   j1, j2;			/* ... and x_j1..x_j2 in the query                               */
+  int   n;			/* number of alignment columns                                   */
+  char *ops;			/* column operations [0..n-1], \0-terminated                    */
+} ESL_SWAT_ALI;
+
+/* 1. Reference implementation */
+extern int esl_swat_Score(ESL_DSQ *x, int L, ESL_DSQ *y, int M, ESL_SCOREMATRIX *S, int gop, int gex, int *ret_sc);
+
+/* 2. Striped SIMD implementation */
+extern ESL_SWAT_PROFILE *esl_swat_profile_Create(const ESL_DSQ *x, int L, const ESL_SCOREMATRIX *S, int gop, int gex);
+extern int               esl_swat_profile_Score(ESL_SWAT_PROFILE *sp, const ESL_DSQ *y, int M, int *ret_sc);
+extern void              esl_swat_profile_Destroy(ESL_SWAT_PROFILE *sp);
+
+/* 3. Alignment */
+extern int  esl_swat_Align      (const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, ESL_SWAT_ALI **ret_ali);
+extern int  esl_swat_AlignBanded(const ESL_DSQ *x, int L, const ESL_DSQ *y, int M, const ESL_SCOREMATRIX *S, int gop, int gex, int dlo, int dhi, ESL_SWAT_ALI **ret_ali);
+extern int  esl_swat_ali_Cigar  (const ESL_SWAT_ALI *ali, char **ret_cigar);
+extern void esl_swat_ali_Destroy(ESL_SWAT_ALI *ali);
+
+/* 4. One query against a block of targets */
+extern int  esl_swat_profile_ScoreBlock(ESL_SWAT_PROFILE *sp, const ESL_SQ_BLOCK *block, ESL_THREADPOOL *pool, int *sc);
+extern int  esl_swat_profile_AlignBlock(ESL_SWAT_PROFILE *sp, const ESL_SQ_BLOCK *block, ESL_THREADPOOL *pool, int minsc, ESL_SWAT_ALI **ali);
+
+/* Striped kernels, in esl_swat_{sse,avx,avx512,neon}.c */
+#ifdef eslENABLE_SSE4
+extern int esl_swat_score8_sse    (const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+extern int esl_swat_score16_sse   (const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+#endif
+#ifdef eslENABLE_AVX
+extern int esl_swat_score8_avx    (const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+extern int esl_swat_score16_avx   (const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+#endif
+#ifdef eslENABLE_AVX512
+extern int esl_swat_score8_avx512 (const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+extern int esl_swat_score16_avx512(const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+#endif
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+extern int esl_swat_score8_neon   (const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+extern int esl_swat_score16_neon  (const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc);
+#endif
+
+#endif /*eslSWAT_INCLUDED*/
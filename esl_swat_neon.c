@@ -0,0 +1,170 @@
+/* Striped Smith/Waterman: ARM NEON implementation.
+ *
+ * Same as the SSE4 kernels in esl_swat_sse.c (see there for notes),
+ * 16 bytes at a time. NEON has no byte shifts across a whole vector,
+ * so the lane shifts are vext's with zero; see esl_neon.h.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_NEON>
+ * and <eslHAVE_NEON_AARCH64> were set in <esl_config.h> by the
+ * configure script. Otherwise we include some dummy code to silence
+ * compiler and ranlib warnings about empty translation units and no
+ * symbols.
+ */
+#include "esl_config.h"
+#if defined(eslENABLE_NEON) && defined(eslHAVE_NEON_AARCH64)
+
+#include <stdint.h>
+#include <arm_neon.h>
+
+#include "easel.h"
+#include "esl_neon.h"
+#include "esl_swat.h"
+
+
+/* Function:  esl_swat_score8_neon()
+ * Synopsis:  Striped Smith/Waterman score, 8-bit NEON version.
+ *
+ * Purpose:   As <esl_swat_score8_sse()>.
+ *
+ * Returns:   <eslOK> on success, and the score is in <*ret_sc>.
+ *            <eslERANGE> if the score may have saturated; redo it in
+ *            16 bits.
+ */
+int
+esl_swat_score8_neon(const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc)
+{
+  int              Q     = sp->Q8;
+  esl_neon_128i_t *Mp    = (esl_neon_128i_t *) dp;
+  esl_neon_128i_t *Yp    = Mp + Q;
+  esl_neon_128i_t *Vp    = Yp + Q;
+  esl_neon_128i_t *Mc    = Vp + Q;
+  esl_neon_128i_t *Yc    = Mc + Q;
+  esl_neon_128i_t *Vc    = Yc + Q;
+  esl_neon_128i_t *Xc    = Vc + Q;
+  esl_neon_128i_t *tmp;
+  esl_neon_128i_t  zero, vmax, vdiag, vm, vx;
+  uint8x16_t       vbias = vdupq_n_u8(sp->bias);
+  uint8x16_t       vgo   = vdupq_n_u8((uint8_t) ESL_MIN(-sp->gop, 255));
+  uint8x16_t       vge   = vdupq_n_u8((uint8_t) ESL_MIN(-sp->gex, 255));
+  const uint8x16_t *P;
+  int              i, q;
+  int              sc;
+
+  zero.u8x16 = vdupq_n_u8(0);
+  vmax       = zero;
+  for (q = 0; q < Q; q++) Mp[q] = Yp[q] = Vp[q] = zero;
+
+  for (i = 1; i <= M; i++)
+    {
+      P     = (const uint8x16_t *) (sp->prof8 + (size_t) y[i] * Q * 16);
+      vdiag = esl_neon_rightshift_int8(Vp[Q-1], zero);
+      vx    = zero;
+      for (q = 0; q < Q; q++)
+	{
+	  vm.u8x16    = vqsubq_u8(vqaddq_u8(vdiag.u8x16, P[q]), vbias);
+	  vdiag       = Vp[q];
+	  vmax.u8x16  = vmaxq_u8(vmax.u8x16, vm.u8x16);
+	  Mc[q]       = vm;
+	  Xc[q]       = vx;
+	  Yc[q].u8x16 = vmaxq_u8(vqsubq_u8(Mp[q].u8x16, vgo), vqsubq_u8(Yp[q].u8x16, vge));
+	  vx.u8x16    = vmaxq_u8(vqsubq_u8(vm.u8x16,    vgo), vqsubq_u8(vx.u8x16,    vge));
+	}
+
+      vx = esl_neon_rightshift_int8(vx, zero);
+      q  = 0;
+      while (esl_neon_any_gt_u8(vx, Xc[q]))
+	{
+	  Xc[q].u8x16 = vmaxq_u8(Xc[q].u8x16, vx.u8x16);
+	  vx.u8x16    = vqsubq_u8(vx.u8x16, vge);
+	  if (++q == Q) { q = 0; vx = esl_neon_rightshift_int8(vx, zero); }
+	}
+
+      for (q = 0; q < Q; q++)
+	Vc[q].u8x16 = vmaxq_u8(vmaxq_u8(Mc[q].u8x16, Xc[q].u8x16), Yc[q].u8x16);
+
+      tmp = Mp; Mp = Mc; Mc = tmp;
+      tmp = Yp; Yp = Yc; Yc = tmp;
+      tmp = Vp; Vp = Vc; Vc = tmp;
+    }
+
+  sc = esl_neon_hmax_u8(vmax);
+  if (sc + sp->bias >= 255) return eslERANGE;
+  *ret_sc = sc;
+  return eslOK;
+}
+
+
+/* Function:  esl_swat_score16_neon()
+ * Synopsis:  Striped Smith/Waterman score, 16-bit NEON version.
+ *
+ * Purpose:   As <esl_swat_score16_sse()>.
+ *
+ * Returns:   <eslOK> on success, and the score is in <*ret_sc>.
+ *            <eslERANGE> if the score may have saturated; redo it in
+ *            full precision.
+ */
+int
+esl_swat_score16_neon(const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc)
+{
+  int              Q     = sp->Q16;
+  esl_neon_128i_t *Mp    = (esl_neon_128i_t *) dp;
+  esl_neon_128i_t *Yp    = Mp + Q;
+  esl_neon_128i_t *Vp    = Yp + Q;
+  esl_neon_128i_t *Mc    = Vp + Q;
+  esl_neon_128i_t *Yc    = Mc + Q;
+  esl_neon_128i_t *Vc    = Yc + Q;
+  esl_neon_128i_t *Xc    = Vc + Q;
+  esl_neon_128i_t *tmp;
+  esl_neon_128i_t  zero, vmax, vdiag, vm, vx;
+  uint16x8_t       vgo   = vdupq_n_u16((uint16_t) ESL_MIN(-sp->gop, 32767));
+  uint16x8_t       vge   = vdupq_n_u16((uint16_t) ESL_MIN(-sp->gex, 32767));
+  const int16x8_t *P;
+  int              i, q;
+  int              sc;
+
+  zero.u16x8 = vdupq_n_u16(0);
+  vmax       = zero;
+  for (q = 0; q < Q; q++) Mp[q] = Yp[q] = Vp[q] = zero;
+
+  for (i = 1; i <= M; i++)
+    {
+      P     = (const int16x8_t *) (sp->prof16 + (size_t) y[i] * Q * 8);
+      vdiag = esl_neon_rightshift_int16(Vp[Q-1], zero);
+      vx    = zero;
+      for (q = 0; q < Q; q++)
+	{
+	  vm.s16x8    = vmaxq_s16(vqaddq_s16(vdiag.s16x8, P[q]), zero.s16x8);
+	  vdiag       = Vp[q];
+	  vmax.s16x8  = vmaxq_s16(vmax.s16x8, vm.s16x8);
+	  Mc[q]       = vm;
+	  Xc[q]       = vx;
+	  Yc[q].u16x8 = vmaxq_u16(vqsubq_u16(Mp[q].u16x8, vgo), vqsubq_u16(Yp[q].u16x8, vge));
+	  vx.u16x8    = vmaxq_u16(vqsubq_u16(vm.u16x8,    vgo), vqsubq_u16(vx.u16x8,    vge));
+	}
+
+      vx = esl_neon_rightshift_int16(vx, zero);
+      q  = 0;
+      while (esl_neon_any_gt_s16(vx, Xc[q]))
+	{
+	  Xc[q].s16x8 = vmaxq_s16(Xc[q].s16x8, vx.s16x8);
+	  vx.u16x8    = vqsubq_u16(vx.u16x8, vge);
+	  if (++q == Q) { q = 0; vx = esl_neon_rightshift_int16(vx, zero); }
+	}
+
+      for (q = 0; q < Q; q++)
+	Vc[q].s16x8 = vmaxq_s16(vmaxq_s16(Mc[q].s16x8, Xc[q].s16x8), Yc[q].s16x8);
+
+      tmp = Mp; Mp = Mc; Mc = tmp;
+      tmp = Yp; Yp = Yc; Yc = tmp;
+      tmp = Vp; Vp = Vc; Vc = tmp;
+    }
+
+  sc = esl_neon_hmax_s16(vmax);
+  if (sc >= 32767) return eslERANGE;
+  *ret_sc = sc;
+  return eslOK;
+}
+
+#else // ! (eslENABLE_NEON && eslHAVE_NEON_AARCH64)
+void esl_swat_neon_silence_hack(void) { return; }
+#endif // eslENABLE_NEON && eslHAVE_NEON_AARCH64
@@ -0,0 +1,182 @@
+/* Striped Smith/Waterman: x86 SSE4 implementation.
+ *
+ * esl_swat.c documents the striped query profile (<ESL_SWAT_PROFILE>)
+ * that these kernels work on, the recurrence, and why it can be
+ * computed exactly in saturating unsigned arithmetic; it calls them
+ * through a runtime dispatcher.
+ *
+ * Each DP row (one target residue) is a pass over the Q striped
+ * vectors of the query. M and Y depend only on the previous row.
+ * X runs along the row, so within one pass it only propagates within
+ * each lane; then the "lazy" loop carries it across lane boundaries
+ * until it stops changing anything.
+ *
+ * This code is conditionally compiled, only when <eslENABLE_SSE4> was
+ * set in <esl_config.h> by the configure script. When it is not set,
+ * we include some dummy code to silence compiler and ranlib warnings
+ * about empty translation units and no symbols.
+ */
+#include "esl_config.h"
+#ifdef eslENABLE_SSE4
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "easel.h"
+#include "esl_sse.h"
+#include "esl_swat.h"
+
+
+/* Function:  esl_swat_score8_sse()
+ * Synopsis:  Striped Smith/Waterman score, 8-bit SSE4 version.
+ *
+ * Purpose:   Score target <y> (digital, 1..M) against striped query
+ *            profile <sp>, in 16 unsigned 8-bit lanes, using DP
+ *            workspace <dp> (<sp->dp>, or another of the same size).
+ *            The score is identical to <esl_swat_Score()>'s, unless
+ *            it's too big for 8 bits.
+ *
+ * Returns:   <eslOK> on success, and the score is in <*ret_sc>.
+ *            <eslERANGE> if the score may have saturated; redo it in
+ *            16 bits.
+ */
+int
+esl_swat_score8_sse(const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc)
+{
+  int      Q     = sp->Q8;
+  __m128i *Mp    = (__m128i *) dp;
+  __m128i *Yp    = Mp + Q;
+  __m128i *Vp    = Yp + Q;
+  __m128i *Mc    = Vp + Q;
+  __m128i *Yc    = Mc + Q;
+  __m128i *Vc    = Yc + Q;
+  __m128i *Xc    = Vc + Q;
+  __m128i *tmp;
+  __m128i  zero  = _mm_setzero_si128();
+  __m128i  vbias = _mm_set1_epi8((int8_t) sp->bias);
+  __m128i  vgo   = _mm_set1_epi8((int8_t) ESL_MIN(-sp->gop, 255));
+  __m128i  vge   = _mm_set1_epi8((int8_t) ESL_MIN(-sp->gex, 255));
+  __m128i  vmax  = zero;
+  __m128i  vdiag, vm, vx;
+  const __m128i *P;
+  int      i, q;
+  int      sc;
+
+  for (q = 0; q < Q; q++) Mp[q] = Yp[q] = Vp[q] = zero;
+
+  for (i = 1; i <= M; i++)
+    {
+      P     = (const __m128i *) (sp->prof8 + (size_t) y[i] * Q * 16);
+      vdiag = esl_sse_rightshift_int8(Vp[Q-1], zero);
+      vx    = zero;
+      for (q = 0; q < Q; q++)
+	{
+	  vm    = _mm_subs_epu8(_mm_adds_epu8(vdiag, P[q]), vbias);
+	  vdiag = Vp[q];
+	  vmax  = _mm_max_epu8(vmax, vm);
+	  Mc[q] = vm;
+	  Xc[q] = vx;
+	  Yc[q] = _mm_max_epu8(_mm_subs_epu8(Mp[q], vgo), _mm_subs_epu8(Yp[q], vge));
+	  vx    = _mm_max_epu8(_mm_subs_epu8(vm,    vgo), _mm_subs_epu8(vx,    vge));
+	}
+
+      /* lazy X: carry across lanes 'til nothing changes */
+      vx = esl_sse_rightshift_int8(vx, zero);
+      q  = 0;
+      while (esl_sse_any_gt_epu8(vx, Xc[q]))
+	{
+	  Xc[q] = _mm_max_epu8(Xc[q], vx);
+	  vx    = _mm_subs_epu8(vx, vge);
+	  if (++q == Q) { q = 0; vx = esl_sse_rightshift_int8(vx, zero); }
+	}
+
+      for (q = 0; q < Q; q++)
+	Vc[q] = _mm_max_epu8(_mm_max_epu8(Mc[q], Xc[q]), Yc[q]);
+
+      tmp = Mp; Mp = Mc; Mc = tmp;
+      tmp = Yp; Yp = Yc; Yc = tmp;
+      tmp = Vp; Vp = Vc; Vc = tmp;
+    }
+
+  sc = esl_sse_hmax_epu8(vmax);
+  if (sc + sp->bias >= 255) return eslERANGE;
+  *ret_sc = sc;
+  return eslOK;
+}
+
+
+/* Function:  esl_swat_score16_sse()
+ * Synopsis:  Striped Smith/Waterman score, 16-bit SSE4 version.
+ *
+ * Purpose:   Same as <esl_swat_score8_sse()>, in 8 16-bit lanes. Scores
+ *            are nonnegative, so they're kept in 0..32767.
+ *
+ * Returns:   <eslOK> on success, and the score is in <*ret_sc>.
+ *            <eslERANGE> if the score may have saturated; redo it in
+ *            full precision.
+ */
+int
+esl_swat_score16_sse(const ESL_SWAT_PROFILE *sp, void *dp, const ESL_DSQ *y, int M, int *ret_sc)
+{
+  int      Q     = sp->Q16;
+  __m128i *Mp    = (__m128i *) dp;
+  __m128i *Yp    = Mp + Q;
+  __m128i *Vp    = Yp + Q;
+  __m128i *Mc    = Vp + Q;
+  __m128i *Yc    = Mc + Q;
+  __m128i *Vc    = Yc + Q;
+  __m128i *Xc    = Vc + Q;
+  __m128i *tmp;
+  __m128i  zero  = _mm_setzero_si128();
+  __m128i  vgo   = _mm_set1_epi16((int16_t) ESL_MIN(-sp->gop, 32767));
+  __m128i  vge   = _mm_set1_epi16((int16_t) ESL_MIN(-sp->gex, 32767));
+  __m128i  vmax  = zero;
+  __m128i  vdiag, vm, vx;
+  const __m128i *P;
+  int      i, q;
+  int      sc;
+
+  for (q = 0; q < Q; q++) Mp[q] = Yp[q] = Vp[q] = zero;
+
+  for (i = 1; i <= M; i++)
+    {
+      P     = (const __m128i *) (sp->prof16 + (size_t) y[i] * Q * 8);
+      vdiag = esl_sse_rightshift_int16(Vp[Q-1], zero);
+      vx    = zero;
+      for (q = 0; q < Q; q++)
+	{
+	  vm    = _mm_max_epi16(_mm_adds_epi16(vdiag, P[q]), zero);
+	  vdiag = Vp[q];
+	  vmax  = _mm_max_epi16(vmax, vm);
+	  Mc[q] = vm;
+	  Xc[q] = vx;
+	  Yc[q] = _mm_max_epi16(_mm_subs_epu16(Mp[q], vgo), _mm_subs_epu16(Yp[q], vge));
+	  vx    = _mm_max_epi16(_mm_subs_epu16(vm,    vgo), _mm_subs_epu16(vx,    vge));
+	}
+
+      vx = esl_sse_rightshift_int16(vx, zero);
+      q  = 0;
+      while (esl_sse_any_gt_epi16(vx, Xc[q]))
+	{
+	  Xc[q] = _mm_max_epi16(Xc[q], vx);
+	  vx    = _mm_subs_epu16(vx, vge);
+	  if (++q == Q) { q = 0; vx = esl_sse_rightshift_int16(vx, zero); }
+	}
+
+      for (q = 0; q < Q; q++)
+	Vc[q] = _mm_max_epi16(_mm_max_epi16(Mc[q], Xc[q]), Yc[q]);
+
+      tmp = Mp; Mp = Mc; Mc = tmp;
+      tmp = Yp; Yp = Yc; Yc = tmp;
+      tmp = Vp; Vp = Vc; Vc = tmp;
+    }
+
+  sc = esl_sse_hmax_epi16(vmax);
+  if (sc >= 32767) return eslERANGE;
+  *ret_sc = sc;
+  return eslOK;
+}
+
+#else // ! eslENABLE_SSE4
+void esl_swat_sse_silence_hack(void) { return; }
+#endif // eslENABLE_SSE4
@@ -0,0 +1,1011 @@
+/* A work-stealing thread pool: tasks, futures, and parallel-for.
+ *
+ * Each worker thread has its own deque of tasks. A worker pushes and
+ * pops its own tasks at the bottom of its deque, and when that runs
+ * dry, it steals the oldest task from the top of someone else's. A
+ * parallel-for is one task for the whole index range; whoever runs it
+ * keeps splitting off the upper half onto its own deque, so idle
+ * workers steal big pieces and the splitting stays local. Threads
+ * that aren't workers (the caller's main thread, say) share one more
+ * deque, and while they wait on a result, they run tasks too.
+ *
+ * Compared to <ESL_WORK_QUEUE>, there's no single lock that every
+ * thread takes for every item: deques have their own locks, and the
+ * pool-wide <sleepMutex> is only for going to sleep, waking up, and
+ * reporting finished work.
+ *
+ * Built without POSIX threads, a pool has no workers, and everything
+ * runs in the caller, so code can use the pool unconditionally.
+ *
+ * Contents:
+ *    1. The <ESL_THREADPOOL> object.
+ *    2. Tasks, futures, and parallel-for.
+ *    3. Internal functions: deques, scheduling, CPU ordering.
+ *    4. Unit tests.
+ *    5. Test driver.
+ *    6. Example.
+ */
+#include "esl_config.h"
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP) && ! defined(_GNU_SOURCE)
+#define _GNU_SOURCE		/* for CPU_SET(), sched_getaffinity(), pthread_setaffinity_np() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#include <sched.h>
+#endif
+
+#include "easel.h"
+#include "esl_threads.h"
+#include "esl_threadpool.h"
+
+static int  deque_init(ESL_TPDEQUE *dq, ESL_THREADPOOL *pool);
+static void deque_destroy(ESL_TPDEQUE *dq);
+#ifdef HAVE_PTHREAD
+static int  deque_push (ESL_TPDEQUE *dq, const ESL_TPTASK *task);
+static int  deque_pop  (ESL_TPDEQUE *dq, ESL_TPTASK *ret_task);
+static int  deque_steal(ESL_TPDEQUE *dq, ESL_TPTASK *ret_task);
+
+static void *threadpool_worker(void *arg);
+static int   threadpool_find (ESL_THREADPOOL *pool, int me, ESL_TPTASK *ret_task);
+static int   threadpool_wake (ESL_THREADPOOL *pool);
+static int   threadpool_wait (ESL_THREADPOOL *pool, int me, ESL_TPFUTURE *fut);
+#endif
+static int   threadpool_run     (ESL_THREADPOOL *pool, int me, ESL_TPTASK *task);
+static int   threadpool_complete(ESL_THREADPOOL *pool, ESL_TPFUTURE *fut, int64_t ndone, int taskstatus);
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+static int   threadpool_cpu_order(const cpu_set_t *allowed, int **ret_cpu, int *ret_ncpu);
+#endif
+
+
+/*****************************************************************
+ *# 1. The <ESL_THREADPOOL> object.
+ *****************************************************************/
+
+/* Function:  esl_threadpool_Create()
+ * Synopsis:  Create a pool of worker threads.
+ *
+ * Purpose:   Create a thread pool with <nworkers> worker threads,
+ *            and start them. They sleep until there's work.
+ *
+ *            With <nworkers> of 0, or if Easel was built without
+ *            POSIX threads, the pool has no workers, and submitted
+ *            work runs immediately in the submitting thread.
+ *
+ * Returns:   ptr to the new <ESL_THREADPOOL>.
+ *
+ * Throws:    <NULL> on allocation failure, or if thread
+ *            initialization or creation fails.
+ */
+ESL_THREADPOOL *
+esl_threadpool_Create(int nworkers)
+{
+  ESL_THREADPOOL *pool = NULL;
+  int             i;
+  int             status;
+
+  ESL_ALLOC(pool, sizeof(ESL_THREADPOOL));
+#ifdef HAVE_PTHREAD
+  pool->nworkers = ESL_MAX(0, nworkers);
+#else
+  pool->nworkers = 0;
+#endif
+  pool->dq       = NULL;
+#ifdef HAVE_PTHREAD
+  pool->threadId = NULL;
+  pool->epoch    = 0;
+  pool->nsleep   = 0;
+  pool->shutdown = FALSE;
+  if (pthread_mutex_init(&pool->sleepMutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+  if (pthread_cond_init (&pool->sleepCond,  NULL) != 0) ESL_XEXCEPTION(eslESYS, "cond init failed");
+  if (pthread_key_create(&pool->self,       NULL) != 0) ESL_XEXCEPTION(eslESYS, "thread-specific key creation failed");
+#endif
+
+  ESL_ALLOC(pool->dq, sizeof(ESL_TPDEQUE) * (pool->nworkers+1));
+  for (i = 0; i <= pool->nworkers; i++) pool->dq[i].task = NULL;
+  for (i = 0; i <= pool->nworkers; i++)
+    if ((status = deque_init(&pool->dq[i], pool)) != eslOK) goto ERROR;
+
+#ifdef HAVE_PTHREAD
+  if (pool->nworkers)
+    {
+      ESL_ALLOC(pool->threadId, sizeof(pthread_t) * pool->nworkers);
+      for (i = 0; i < pool->nworkers; i++)
+	if (pthread_create(&pool->threadId[i], NULL, threadpool_worker, &pool->dq[i]) != 0)
+	  {	/* stop the ones we started, then fail */
+	    pthread_mutex_lock(&pool->sleepMutex);
+	    pool->shutdown = TRUE;
+	    pthread_cond_broadcast(&pool->sleepCond);
+	    pthread_mutex_unlock(&pool->sleepMutex);
+	    while (i--) pthread_join(pool->threadId[i], NULL);
+	    free(pool->threadId);
+	    pool->threadId = NULL;
+	    ESL_XEXCEPTION(eslESYS, "failed to create worker thread");
+	  }
+    }
+#endif
+  return pool;
+
+ ERROR:
+  esl_threadpool_Destroy(pool);
+  return NULL;
+}
+
+
+/* Function:  esl_threadpool_Pin()
+ * Synopsis:  Pin each worker thread to its own CPU.
+ *
+ * Purpose:   Bind each worker thread in <pool> to one CPU, among the
+ *            CPUs this process is allowed to run on. CPUs are handed
+ *            out NUMA node by node, so workers with neighboring
+ *            indices share a node. Because a worker looks for work to
+ *            steal in neighboring workers' deques first, stealing
+ *            tends to stay on the node, near the thief's memory. If
+ *            there are more workers than CPUs, CPUs are reused,
+ *            round robin.
+ *
+ *            NUMA nodes are read from
+ *            </sys/devices/system/node/node<n>/cpulist>; without
+ *            that (non-Linux, or no NUMA), CPUs are used in numerical
+ *            order.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEUNIMPLEMENTED> if this platform can't set thread
+ *            affinity; the pool still works, unpinned.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslESYS> if a system call fails.
+ */
+int
+esl_threadpool_Pin(ESL_THREADPOOL *pool)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t  allowed;
+  cpu_set_t  one;
+  int       *cpu  = NULL;
+  int        ncpu = 0;
+  int        i;
+  int        status;
+
+  if (pool->nworkers == 0) return eslOK;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) ESL_XEXCEPTION(eslESYS, "sched_getaffinity() failed");
+  if ((status = threadpool_cpu_order(&allowed, &cpu, &ncpu)) != eslOK) goto ERROR;
+
+  for (i = 0; i < pool->nworkers; i++)
+    {
+      CPU_ZERO(&one);
+      CPU_SET(cpu[i % ncpu], &one);
+      if (pthread_setaffinity_np(pool->threadId[i], sizeof(cpu_set_t), &one) != 0) ESL_XEXCEPTION(eslESYS, "pthread_setaffinity_np() failed");
+    }
+  free(cpu);
+  return eslOK;
+
+ ERROR:
+  free(cpu);
+  return status;
+#else
+  return (pool->nworkers ? eslEUNIMPLEMENTED : eslOK);
+#endif
+}
+
+
+/* Function:  esl_threadpool_Destroy()
+ * Synopsis:  Stop the workers and free a thread pool.
+ *
+ * Purpose:   Let the workers of <pool> finish any work still queued,
+ *            stop them, and free the pool. Nothing may submit work to
+ *            <pool> once this is called.
+ */
+void
+esl_threadpool_Destroy(ESL_THREADPOOL *pool)
+{
+  int i;
+
+  if (pool == NULL) return;
+
+#ifdef HAVE_PTHREAD
+  if (pool->threadId)
+    {
+      pthread_mutex_lock(&pool->sleepMutex);
+      pool->shutdown = TRUE;
+      pool->epoch++;
+      pthread_cond_broadcast(&pool->sleepCond);
+      pthread_mutex_unlock(&pool->sleepMutex);
+      for (i = 0; i < pool->nworkers; i++) pthread_join(pool->threadId[i], NULL);
+      free(pool->threadId);
+    }
+#endif
+  if (pool->dq)
+    {
+      for (i = 0; i <= pool->nworkers; i++) deque_destroy(&pool->dq[i]);
+      free(pool->dq);
+    }
+#ifdef HAVE_PTHREAD
+  pthread_key_delete    (pool->self);
+  pthread_cond_destroy  (&pool->sleepCond);
+  pthread_mutex_destroy (&pool->sleepMutex);
+#endif
+  free(pool);
+}
+
+
+/* Function:  esl_threadpool_GetWorkerCount()
+ * Synopsis:  Returns the number of worker threads in a pool.
+ */
+int
+esl_threadpool_GetWorkerCount(const ESL_THREADPOOL *pool)
+{
+  return pool->nworkers;
+}
+
+
+/* Function:  esl_threadpool_WorkerIndex()
+ * Synopsis:  Which worker is the calling thread?
+ *
+ * Purpose:   Returns the index <0..nworkers-1> of the calling thread,
+ *            if it's one of <pool>'s workers, or <nworkers> if it
+ *            isn't. Useful for indexing per-thread workspaces from
+ *            inside a task: allocate <nworkers+1> of them.
+ */
+int
+esl_threadpool_WorkerIndex(ESL_THREADPOOL *pool)
+{
+#ifdef HAVE_PTHREAD
+  void *v = (pool->nworkers ? pthread_getspecific(pool->self) : NULL);
+  return (v ? (int) ((intptr_t) v - 1) : pool->nworkers);
+#else
+  return pool->nworkers;
+#endif
+}
+
+
+
+/*****************************************************************
+ *# 2. Tasks, futures, and parallel-for.
+ *****************************************************************/
+
+/* Function:  esl_threadpool_Submit()
+ * Synopsis:  Queue one task to run on the pool.
+ *
+ * Purpose:   Queue a task that calls <func(arg)>. A worker, or a
+ *            thread waiting on the pool, will run it.
+ *
+ *            If <opt_fut> is non-<NULL>, return a future for the task
+ *            in <*opt_fut>; the caller must eventually call
+ *            <esl_threadpool_Wait()> on it, which returns the
+ *            task's return status and frees the future. If
+ *            <opt_fut> is <NULL>, the task's return status is lost.
+ *
+ *            Tasks may themselves submit tasks and wait on them.
+ *
+ *            With no workers, <func(arg)> runs right away, before
+ *            this returns.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslESYS> if thread synchronization fails.
+ *            In either case, the task isn't queued and <*opt_fut> is
+ *            <NULL>.
+ */
+int
+esl_threadpool_Submit(ESL_THREADPOOL *pool, int (*func)(void *arg), void *arg, ESL_TPFUTURE **opt_fut)
+{
+  ESL_TPFUTURE *fut = NULL;
+  ESL_TPTASK    task;
+  int           status;
+
+  if (opt_fut)
+    {
+      ESL_ALLOC(fut, sizeof(ESL_TPFUTURE));
+      fut->pending = 1;
+      fut->status  = eslOK;
+    }
+
+  task.func  = func;
+  task.rfunc = NULL;
+  task.arg   = arg;
+  task.lo    = task.hi = task.grain = 0;
+  task.fut   = fut;
+
+  if (pool->nworkers == 0)
+    {
+      if ((status = threadpool_run(pool, 0, &task)) != eslOK) goto ERROR;
+    }
+#ifdef HAVE_PTHREAD
+  else
+    {
+      if ((status = deque_push(&pool->dq[esl_threadpool_WorkerIndex(pool)], &task)) != eslOK) goto ERROR;
+      if ((status = threadpool_wake(pool))                                          != eslOK) goto ERROR;
+    }
+#endif
+
+  if (opt_fut) *opt_fut = fut;
+  return eslOK;
+
+ ERROR:
+  free(fut);
+  if (opt_fut) *opt_fut = NULL;
+  return status;
+}
+
+
+/* Function:  esl_threadpool_Wait()
+ * Synopsis:  Wait for a submitted task to finish.
+ *
+ * Purpose:   Wait for the task with future <fut> to finish; free
+ *            <fut>, and return the task's return status. While it
+ *            waits, the calling thread runs queued tasks itself, so
+ *            it's fine to call this from inside a task.
+ *
+ * Returns:   the task's return status: <eslOK>, or whatever error
+ *            code the task returned.
+ *
+ * Throws:    <eslESYS> if thread synchronization fails.
+ */
+int
+esl_threadpool_Wait(ESL_THREADPOOL *pool, ESL_TPFUTURE *fut)
+{
+  int status;
+
+#ifdef HAVE_PTHREAD
+  if (pool->nworkers) status = threadpool_wait(pool, esl_threadpool_WorkerIndex(pool), fut);
+  else                status = fut->status;
+#else
+  status = fut->status;
+#endif
+  free(fut);
+  return status;
+}
+
+
+/* Function:  esl_threadpool_ParallelFor()
+ * Synopsis:  Run a function over index range 0..n-1 on the pool.
+ *
+ * Purpose:   Call <func(arg, lo, hi)> on disjoint ranges <[lo,hi)>
+ *            that together cover <0..n-1>, in parallel on <pool>, and
+ *            wait for all of them to finish. Ranges are halved until
+ *            they're no bigger than <grain> indices; the calling
+ *            thread works on them too. With <grain> $\leq 0$, a
+ *            default makes about eight ranges per thread.
+ *
+ *            <func> must be safe to run on different ranges at the
+ *            same time; <esl_threadpool_WorkerIndex()> tells it
+ *            which thread it's running in, for per-thread
+ *            workspaces. It may use the pool itself (nested
+ *            parallel-for, or submitting tasks).
+ *
+ *            With no workers, this is just <func(arg, 0, n)>.
+ *
+ * Returns:   <eslOK> if every call to <func> returned <eslOK>; else
+ *            the first error code any of them returned. (All ranges
+ *            still run.)
+ *
+ * Throws:    <eslESYS> if thread synchronization fails.
+ */
+int
+esl_threadpool_ParallelFor(ESL_THREADPOOL *pool, int64_t n, int64_t grain,
+			   int (*func)(void *arg, int64_t lo, int64_t hi), void *arg)
+{
+  ESL_TPFUTURE fut;
+  ESL_TPTASK   task;
+  int          me;
+  int          status;
+
+  if (n <= 0)             return eslOK;
+  if (pool->nworkers == 0) return (*func)(arg, 0, n);
+
+  if (grain <= 0) grain = ESL_MAX(1, n / (8 * (pool->nworkers+1)));
+  fut.pending = n;
+  fut.status  = eslOK;
+  task.func   = NULL;
+  task.rfunc  = func;
+  task.arg    = arg;
+  task.lo     = 0;
+  task.hi     = n;
+  task.grain  = grain;
+  task.fut    = &fut;
+
+  me = esl_threadpool_WorkerIndex(pool);
+  if ((status = threadpool_run(pool, me, &task)) != eslOK) return status;
+#ifdef HAVE_PTHREAD
+  return threadpool_wait(pool, me, &fut);
+#else
+  return fut.status;
+#endif
+}
+
+
+
+/*****************************************************************
+ * 3. Internal functions: deques, scheduling, CPU ordering.
+ *****************************************************************/
+
+static int
+deque_init(ESL_TPDEQUE *dq, ESL_THREADPOOL *pool)
+{
+  int status;
+
+  dq->pool   = pool;
+  dq->top    = 0;
+  dq->n      = 0;
+  dq->nalloc = 16;
+  ESL_ALLOC(dq->task, sizeof(ESL_TPTASK) * dq->nalloc);
+#ifdef HAVE_PTHREAD
+  if (pthread_mutex_init(&dq->mutex, NULL) != 0) ESL_EXCEPTION(eslESYS, "mutex init failed");
+#endif
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+static void
+deque_destroy(ESL_TPDEQUE *dq)
+{
+  if (! dq->task) return;
+  free(dq->task);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy(&dq->mutex);
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+/* deque_push()
+ * Push a copy of <task> onto the bottom of <dq>, growing it if needed.
+ * Throws <eslEMEM> (leaving <dq> unchanged), or <eslESYS>.
+ */
+static int
+deque_push(ESL_TPDEQUE *dq, const ESL_TPTASK *task)
+{
+  ESL_TPTASK *newtask;
+  int         i;
+  int         status;
+
+  if (pthread_mutex_lock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  if (dq->n == dq->nalloc)
+    {	/* unwrap the ring into a buffer twice the size */
+      if ((newtask = malloc(sizeof(ESL_TPTASK) * dq->nalloc * 2)) == NULL) ESL_XEXCEPTION(eslEMEM, "malloc failed");
+      for (i = 0; i < dq->n; i++) newtask[i] = dq->task[(dq->top + i) % dq->nalloc];
+      free(dq->task);
+      dq->task    = newtask;
+      dq->top     = 0;
+      dq->nalloc *= 2;
+    }
+  dq->task[(dq->top + dq->n) % dq->nalloc] = *task;
+  dq->n++;
+  if (pthread_mutex_unlock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  return eslOK;
+
+ ERROR:
+  pthread_mutex_unlock(&dq->mutex);
+  return status;
+}
+
+/* deque_pop()
+ * The owner takes the newest task off the bottom of <dq>.
+ * Returns TRUE and the task in <*ret_task>, or FALSE if <dq> is empty.
+ */
+static int
+deque_pop(ESL_TPDEQUE *dq, ESL_TPTASK *ret_task)
+{
+  int found = FALSE;
+
+  pthread_mutex_lock(&dq->mutex);
+  if (dq->n > 0)
+    {
+      dq->n--;
+      *ret_task = dq->task[(dq->top + dq->n) % dq->nalloc];
+      found     = TRUE;
+    }
+  pthread_mutex_unlock(&dq->mutex);
+  return found;
+}
+
+/* deque_steal()
+ * A thief takes the oldest task off the top of <dq>.
+ * Returns TRUE and the task in <*ret_task>, or FALSE if <dq> is empty.
+ */
+static int
+deque_steal(ESL_TPDEQUE *dq, ESL_TPTASK *ret_task)
+{
+  int found = FALSE;
+
+  pthread_mutex_lock(&dq->mutex);
+  if (dq->n > 0)
+    {
+      *ret_task = dq->task[dq->top];
+      dq->top   = (dq->top + 1) % dq->nalloc;
+      dq->n--;
+      found     = TRUE;
+    }
+  pthread_mutex_unlock(&dq->mutex);
+  return found;
+}
+
+
+/* threadpool_worker()
+ * The worker thread: run tasks, from our own deque or stolen, until
+ * the pool shuts down. When there's nothing to do, sleep until the
+ * <epoch> moves on; reading the epoch before looking for work means
+ * we can't miss a wakeup for a task pushed after we looked.
+ */
+static void *
+threadpool_worker(void *arg)
+{
+  ESL_TPDEQUE    *dq   = (ESL_TPDEQUE *) arg;
+  ESL_THREADPOOL *pool = dq->pool;
+  int             me   = dq - pool->dq;
+  ESL_TPTASK      task;
+  uint64_t        epoch;
+
+  pthread_setspecific(pool->self, (void *) (intptr_t) (me+1));
+  for (;;)
+    {
+      if (pthread_mutex_lock(&pool->sleepMutex) != 0) break;
+      epoch = pool->epoch;
+      pthread_mutex_unlock(&pool->sleepMutex);
+
+      if (threadpool_find(pool, me, &task))
+	{
+	  if (threadpool_run(pool, me, &task) != eslOK) break;
+	  continue;
+	}
+
+      if (pthread_mutex_lock(&pool->sleepMutex) != 0) break;
+      if (pool->shutdown) { pthread_mutex_unlock(&pool->sleepMutex); break; }
+      if (pool->epoch == epoch)
+	{
+	  pool->nsleep++;
+	  pthread_cond_wait(&pool->sleepCond, &pool->sleepMutex);
+	  pool->nsleep--;
+	}
+      pthread_mutex_unlock(&pool->sleepMutex);
+    }
+  return NULL;
+}
+
+/* threadpool_find()
+ * Find a task for thread <me> to run: the newest one on its own
+ * deque, or else the oldest one on the nearest nonempty deque after
+ * it. Returns TRUE and the task in <*ret_task>, or FALSE if all
+ * deques are empty.
+ */
+static int
+threadpool_find(ESL_THREADPOOL *pool, int me, ESL_TPTASK *ret_task)
+{
+  int ndq = pool->nworkers + 1;
+  int k;
+
+  if (deque_pop(&pool->dq[me], ret_task)) return TRUE;
+  for (k = 1; k < ndq; k++)
+    if (deque_steal(&pool->dq[(me + k) % ndq], ret_task)) return TRUE;
+  return FALSE;
+}
+
+/* threadpool_wake()
+ * There's new work: move the epoch on, and wake one sleeper if any.
+ */
+static int
+threadpool_wake(ESL_THREADPOOL *pool)
+{
+  if (pthread_mutex_lock(&pool->sleepMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  pool->epoch++;
+  if (pool->nsleep > 0 && pthread_cond_signal(&pool->sleepCond) != 0)
+    { pthread_mutex_unlock(&pool->sleepMutex); ESL_EXCEPTION(eslESYS, "cond signal failed"); }
+  if (pthread_mutex_unlock(&pool->sleepMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  return eslOK;
+}
+
+/* threadpool_wait()
+ * Thread <me> waits for <fut> to finish, running tasks meanwhile.
+ * Returns the future's status.
+ */
+static int
+threadpool_wait(ESL_THREADPOOL *pool, int me, ESL_TPFUTURE *fut)
+{
+  ESL_TPTASK task;
+  uint64_t   epoch;
+  int        status;
+
+  for (;;)
+    {
+      if (pthread_mutex_lock(&pool->sleepMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+      if (fut->pending == 0)
+	{
+	  status = fut->status;
+	  pthread_mutex_unlock(&pool->sleepMutex);
+	  return status;
+	}
+      epoch = pool->epoch;
+      pthread_mutex_unlock(&pool->sleepMutex);
+
+      if (threadpool_find(pool, me, &task))
+	{
+	  if ((status = threadpool_run(pool, me, &task)) != eslOK) return status;
+	  continue;
+	}
+
+      if (pthread_mutex_lock(&pool->sleepMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+      if (fut->pending > 0 && pool->epoch == epoch)
+	{
+	  pool->nsleep++;
+	  if (pthread_cond_wait(&pool->sleepCond, &pool->sleepMutex) != 0)
+	    { pthread_mutex_unlock(&pool->sleepMutex); ESL_EXCEPTION(eslESYS, "cond wait failed"); }
+	  pool->nsleep--;
+	}
+      pthread_mutex_unlock(&pool->sleepMutex);
+    }
+  /*NOTREACHED*/
+  return eslOK;
+}
+#endif /*HAVE_PTHREAD*/
+
+
+/* threadpool_run()
+ * Thread <me> runs <task>. A parallel-for range bigger than its grain
+ * size gets split: the upper half goes on our own deque (where a thief
+ * can take it), and we carry on with the lower half, until what's
+ * left is small enough to run.
+ *
+ * Returns <eslOK>; the task's own status goes to its future.
+ * Throws <eslESYS> if thread synchronization fails.
+ */
+static int
+threadpool_run(ESL_THREADPOOL *pool, int me, ESL_TPTASK *task)
+{
+#ifdef HAVE_PTHREAD
+  ESL_TPTASK half;
+#endif
+  int64_t    lo, hi;
+
+  if (task->func)
+    return threadpool_complete(pool, task->fut, 1, (*task->func)(task->arg));
+
+  lo = task->lo;
+  hi = task->hi;
+#ifdef HAVE_PTHREAD
+  while (pool->nworkers && hi - lo > task->grain)
+    {
+      half    = *task;
+      half.lo = lo + (hi - lo) / 2;
+      half.hi = hi;
+      if (deque_push(&pool->dq[me], &half) != eslOK) break; /* out of memory: just do the rest ourselves */
+      if (threadpool_wake(pool) != eslOK) return eslESYS;
+      hi = half.lo;
+    }
+#endif
+  return threadpool_complete(pool, task->fut, hi - lo, (*task->rfunc)(task->arg, lo, hi));
+}
+
+/* threadpool_complete()
+ * <ndone> units of work toward <fut> finished with <taskstatus>.
+ * If that's the last of it, wake everyone, so whoever's waiting on
+ * <fut> notices.
+ */
+static int
+threadpool_complete(ESL_THREADPOOL *pool, ESL_TPFUTURE *fut, int64_t ndone, int taskstatus)
+{
+  if (! fut) return eslOK;
+
+#ifdef HAVE_PTHREAD
+  if (pool->nworkers && pthread_mutex_lock(&pool->sleepMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+#endif
+  if (taskstatus != eslOK && fut->status == eslOK) fut->status = taskstatus;
+  fut->pending -= ndone;
+#ifdef HAVE_PTHREAD
+  if (pool->nworkers)
+    {
+      if (fut->pending == 0)
+	{
+	  pool->epoch++;
+	  if (pool->nsleep > 0) pthread_cond_broadcast(&pool->sleepCond);
+	}
+      if (pthread_mutex_unlock(&pool->sleepMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+    }
+#endif
+  return eslOK;
+}
+
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+/* threadpool_cpu_order()
+ * List the CPUs in <allowed> NUMA node by node, as given by
+ * /sys/devices/system/node/node<n>/cpulist ("0-3,8-11"), followed by
+ * any allowed CPUs that weren't in a node list, in numerical order.
+ * Returns the list in <*ret_cpu> (caller frees), and its length in
+ * <*ret_ncpu>, which is at least 1.
+ */
+static int
+threadpool_cpu_order(const cpu_set_t *allowed, int **ret_cpu, int *ret_ncpu)
+{
+  char       path[64];
+  char       line[4096];
+  cpu_set_t  seen;
+  FILE      *fp;
+  char      *s, *end;
+  long       a, b, c;
+  int       *cpu  = NULL;
+  int        ncpu = 0;
+  int        node;
+  int        status;
+
+  ESL_ALLOC(cpu, sizeof(int) * CPU_SETSIZE);
+  CPU_ZERO(&seen);
+  for (node = 0; ; node++)
+    {
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+      if ((fp = fopen(path, "r")) == NULL) break;
+      if (fgets(line, sizeof(line), fp) == NULL) line[0] = '\0';
+      fclose(fp);
+
+      for (s = line; *s; s = end)
+	{
+	  a = strtol(s, &end, 10);
+	  if (end == s) break;
+	  b = a;
+	  if (*end == '-') { s = end+1; b = strtol(s, &end, 10); if (end == s) break; }
+	  for (c = a; c <= b && c < CPU_SETSIZE; c++)
+	    if (c >= 0 && CPU_ISSET(c, allowed) && ! CPU_ISSET(c, &seen)) { CPU_SET(c, &seen); cpu[ncpu++] = c; }
+	  if (*end == ',') end++;
+	}
+    }
+  for (c = 0; c < CPU_SETSIZE; c++)
+    if (CPU_ISSET(c, allowed) && ! CPU_ISSET(c, &seen)) cpu[ncpu++] = c;
+  if (ncpu == 0) ESL_XEXCEPTION(eslESYS, "no CPUs in this process's affinity mask");
+
+  *ret_cpu  = cpu;
+  *ret_ncpu = ncpu;
+  return eslOK;
+
+ ERROR:
+  free(cpu);
+  *ret_cpu  = NULL;
+  *ret_ncpu = 0;
+  return status;
+}
+#endif /*HAVE_PTHREAD_SETAFFINITY_NP*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests.
+ *****************************************************************/
+#ifdef eslTHREADPOOL_TESTDRIVE
+
+struct utest_range_s {
+  int64_t *x;			/* x[i] = i*i, filled in by ranges          */
+  int     *nvisit;		/* how many times each index was visited     */
+  int64_t  failidx;		/* range containing this index fails; or -1 */
+};
+
+static int
+utest_range_func(void *arg, int64_t lo, int64_t hi)
+{
+  struct utest_range_s *d = (struct utest_range_s *) arg;
+  int64_t i;
+
+  for (i = lo; i < hi; i++) { d->x[i] = i*i; d->nvisit[i]++; }
+  return ((d->failidx >= lo && d->failidx < hi) ? eslFAIL : eslOK);
+}
+
+/* utest_parallelfor()
+ * Every index in 0..n-1 is visited exactly once, whatever the grain,
+ * and a failing range makes the whole parallel-for fail.
+ */
+static void
+utest_parallelfor(ESL_THREADPOOL *pool, int64_t n)
+{
+  char    msg[] = "threadpool parallel-for unit test failed";
+  struct utest_range_s d;
+  int64_t grain[4] = { 0, 1, 7, n+1 };
+  int64_t i;
+  int     g;
+  int     status;
+
+  ESL_ALLOC(d.x,      sizeof(int64_t) * n);
+  ESL_ALLOC(d.nvisit, sizeof(int)     * n);
+
+  for (g = 0; g < 4; g++)
+    {
+      for (i = 0; i < n; i++) { d.x[i] = -1; d.nvisit[i] = 0; }
+      d.failidx = -1;
+      if (esl_threadpool_ParallelFor(pool, n, grain[g], utest_range_func, &d) != eslOK) esl_fatal(msg);
+      for (i = 0; i < n; i++)
+	if (d.x[i] != i*i || d.nvisit[i] != 1) esl_fatal(msg);
+    }
+
+  d.failidx = n/3;
+  if (esl_threadpool_ParallelFor(pool, n, 5, utest_range_func, &d) != eslFAIL) esl_fatal(msg);
+  if (esl_threadpool_ParallelFor(pool, 0, 5, utest_range_func, &d) != eslOK)   esl_fatal(msg);
+
+  free(d.x);
+  free(d.nvisit);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+
+struct utest_task_s {
+  ESL_THREADPOOL *pool;
+  int64_t         n;		/* each task does a nested parallel-for of this size */
+  int64_t        *x;
+  int            *nvisit;
+  int64_t         sum;		/* result: sum of x[] */
+  int             fail;		/* TRUE: this task returns eslFAIL */
+};
+
+static int
+utest_task_func(void *arg)
+{
+  struct utest_task_s  *t = (struct utest_task_s *) arg;
+  struct utest_range_s  d;
+  int64_t               i;
+  int                   status;
+
+  d.x       = t->x;
+  d.nvisit  = t->nvisit;
+  d.failidx = -1;
+  if ((status = esl_threadpool_ParallelFor(t->pool, t->n, 3, utest_range_func, &d)) != eslOK) return status;
+  for (t->sum = 0, i = 0; i < t->n; i++) t->sum += t->x[i];
+  return (t->fail ? eslFAIL : eslOK);
+}
+
+/* utest_tasks()
+ * Submit <ntasks> tasks, each of which runs a nested parallel-for on
+ * the same pool and waits on it from inside a worker. All the futures
+ * come back with the right status and results, and nothing deadlocks.
+ */
+static void
+utest_tasks(ESL_THREADPOOL *pool, int ntasks)
+{
+  char                 msg[] = "threadpool task unit test failed";
+  struct utest_task_s *t     = NULL;
+  ESL_TPFUTURE       **fut   = NULL;
+  int64_t              i;
+  int                  k;
+  int                  status;
+
+  ESL_ALLOC(t,   sizeof(struct utest_task_s) * ntasks);
+  ESL_ALLOC(fut, sizeof(ESL_TPFUTURE *)      * ntasks);
+  for (k = 0; k < ntasks; k++)
+    {
+      t[k].pool = pool;
+      t[k].n    = 10 + k;
+      t[k].sum  = -1;
+      t[k].fail = (k % 5 == 3);
+      ESL_ALLOC(t[k].x,      sizeof(int64_t) * t[k].n);
+      ESL_ALLOC(t[k].nvisit, sizeof(int)     * t[k].n);
+      for (i = 0; i < t[k].n; i++) t[k].nvisit[i] = 0;
+    }
+
+  for (k = 0; k < ntasks; k++)
+    if (esl_threadpool_Submit(pool, utest_task_func, &t[k], &fut[k]) != eslOK) esl_fatal(msg);
+
+  for (k = 0; k < ntasks; k++)
+    {
+      status = esl_threadpool_Wait(pool, fut[k]);
+      if (status != (t[k].fail ? eslFAIL : eslOK))            esl_fatal(msg);
+      if (t[k].sum != (t[k].n-1) * t[k].n * (2*t[k].n-1) / 6) esl_fatal(msg);
+      for (i = 0; i < t[k].n; i++)
+	if (t[k].nvisit[i] != 1) esl_fatal(msg);
+    }
+
+  for (k = 0; k < ntasks; k++) { free(t[k].x); free(t[k].nvisit); }
+  free(t);
+  free(fut);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*eslTHREADPOOL_TESTDRIVE*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef eslTHREADPOOL_TESTDRIVE
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+   /* name  type         default  env   range togs  reqs  incomp  help                                docgrp */
+  {"-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                        0},
+  {"-n",  eslARG_INT,     "100000", NULL, "n>0", NULL, NULL, NULL, "size of parallel-for index range",      0},
+  {"-t",  eslARG_INT,       "4", NULL, "n>=0", NULL, NULL, NULL, "number of worker threads",                 0},
+  {"-P",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "also test with workers pinned to CPUs",       0},
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for ESL_THREADPOOL: work-stealing thread pool";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go       = esl_getopts_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  int64_t         n        = esl_opt_GetInteger(go, "-n");
+  int             nworkers = esl_opt_GetInteger(go, "-t");
+  ESL_THREADPOOL *pool     = NULL;
+  int             w;
+  int             status;
+
+  fprintf(stderr, "## %s\n", argv[0]);
+
+  for (w = 0; w <= nworkers; w += ESL_MAX(1, nworkers))
+    {
+      if ((pool = esl_threadpool_Create(w)) == NULL) esl_fatal("thread pool creation failed");
+      if (esl_opt_GetBoolean(go, "-P"))
+	{
+	  status = esl_threadpool_Pin(pool);
+	  if (status != eslOK && status != eslEUNIMPLEMENTED) esl_fatal("thread pool pinning failed");
+	}
+
+      utest_parallelfor(pool, n);
+      utest_tasks      (pool, 40);
+
+      esl_threadpool_Destroy(pool);
+    }
+
+  fprintf(stderr, "#  status = ok\n");
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*eslTHREADPOOL_TESTDRIVE*/
+
+
+
+/*****************************************************************
+ * 6. Example.
+ *****************************************************************/
+#ifdef eslTHREADPOOL_EXAMPLE
+#include "easel.h"
+#include "esl_threads.h"
+#include "esl_threadpool.h"
+
+/* Sum of squares of 0..n-1, with one partial sum per thread. */
+struct sumsq_s {
+  ESL_THREADPOOL *pool;
+  int64_t        *partial;	/* [0..nworkers]; indexed by esl_threadpool_WorkerIndex() */
+};
+
+static int
+sumsq(void *arg, int64_t lo, int64_t hi)
+{
+  struct sumsq_s *d = (struct sumsq_s *) arg;
+  int             w = esl_threadpool_WorkerIndex(d->pool);
+  int64_t         i;
+
+  for (i = lo; i < hi; i++) d->partial[w] += i * i;
+  return eslOK;
+}
+
+int
+main(int argc, char **argv)
+{
+  int             nworkers = (argc > 1 ? atoi(argv[1]) : esl_threads_GetCPUCount());
+  ESL_THREADPOOL *pool     = esl_threadpool_Create(nworkers);
+  struct sumsq_s  d;
+  int64_t         total    = 0;
+  int             w;
+
+  d.pool    = pool;
+  d.partial = calloc(nworkers+1, sizeof(int64_t));
+  esl_threadpool_ParallelFor(pool, 1000000, 0, sumsq, &d);
+  for (w = 0; w <= nworkers; w++) total += d.partial[w];
+  printf("sum of squares: %" PRId64 " on %d workers\n", total, esl_threadpool_GetWorkerCount(pool));
+
+  free(d.partial);
+  esl_threadpool_Destroy(pool);
+  return 0;
+}
+#endif /*eslTHREADPOOL_EXAMPLE*/
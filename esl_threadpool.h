@@ -0,0 +1,83 @@
+/* A work-stealing thread pool: tasks, futures, and parallel-for.
+ */
+#ifndef eslTHREADPOOL_INCLUDED
+#define eslTHREADPOOL_INCLUDED
+#include "esl_config.h"
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* ESL_TPFUTURE
+ * Completion state of a submitted task (or of all the pieces of a
+ * parallel-for). Protected by the pool's <sleepMutex>.
+ */
+typedef struct {
+  int64_t  pending;		/* work still outstanding: 1 for a task; # of indices for a parallel-for */
+  int      status;		/* eslOK, or the first failure code returned by a piece of the work      */
+} ESL_TPFUTURE;
+
+/* ESL_TPTASK
+ * One queued unit of work. Either <func> (a single task) or <rfunc>
+ * (a range [lo,hi) of a parallel-for, split in halves down to <grain>
+ * as it runs) is set.
+ */
+typedef struct {
+  int          (*func) (void *arg);
+  int          (*rfunc)(void *arg, int64_t lo, int64_t hi);
+  void          *arg;
+  int64_t        lo;
+  int64_t        hi;
+  int64_t        grain;
+  ESL_TPFUTURE  *fut;		/* where to report completion; or NULL */
+} ESL_TPTASK;
+
+/* ESL_TPDEQUE
+ * One worker's deque of tasks, a ring buffer with its own lock. The
+ * owner pushes and pops at the bottom (newest); thieves steal from
+ * the top (oldest, and for parallel-for, the largest ranges).
+ */
+typedef struct {
+  struct esl_threadpool_s *pool; /* the pool this deque belongs to */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t  mutex;
+#endif
+  ESL_TPTASK      *task;	/* ring buffer, [0..nalloc-1]            */
+  int              top;		/* index of the oldest task              */
+  int              n;		/* number of tasks in the deque          */
+  int              nalloc;	/* current allocation of <task>          */
+} ESL_TPDEQUE;
+
+typedef struct esl_threadpool_s {
+  int              nworkers;	/* number of worker threads; 0 = run everything in the caller  */
+  ESL_TPDEQUE     *dq;		/* deques [0..nworkers]: one per worker, and <dq[nworkers]>     */
+				/*   is shared by all threads that aren't workers              */
+#ifdef HAVE_PTHREAD
+  pthread_t       *threadId;	/* worker threads [0..nworkers-1]                               */
+  pthread_key_t    self;	/* thread-specific: 1 + worker index; unset in other threads  */
+
+  pthread_mutex_t  sleepMutex;	/* protects everything below, and the pool's ESL_TPFUTUREs     */
+  pthread_cond_t   sleepCond;	/* idle threads wait here for new work or finished futures     */
+  uint64_t         epoch;	/* bumped whenever there's new work or a future finishes       */
+  int              nsleep;	/* number of threads waiting on <sleepCond>                    */
+  int              shutdown;	/* TRUE when workers should exit, once the deques are empty    */
+#endif
+} ESL_THREADPOOL;
+
+
+extern ESL_THREADPOOL *esl_threadpool_Create(int nworkers);
+extern int             esl_threadpool_Pin(ESL_THREADPOOL *pool);
+extern void            esl_threadpool_Destroy(ESL_THREADPOOL *pool);
+
+extern int esl_threadpool_GetWorkerCount(const ESL_THREADPOOL *pool);
+extern int esl_threadpool_WorkerIndex   (ESL_THREADPOOL *pool);
+
+extern int esl_threadpool_Submit     (ESL_THREADPOOL *pool, int (*func)(void *arg), void *arg, ESL_TPFUTURE **opt_fut);
+extern int esl_threadpool_Wait       (ESL_THREADPOOL *pool, ESL_TPFUTURE *fut);
+extern int esl_threadpool_ParallelFor(ESL_THREADPOOL *pool, int64_t n, int64_t grain,
+				      int (*func)(void *arg, int64_t lo, int64_t hi), void *arg);
+
+#endif /*eslTHREADPOOL_INCLUDED*/
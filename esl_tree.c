@@ -1541,6 +1541,74 @@ esl_tree_Compare(ESL_TREE *T1, ESL_TREE *T2)
  * 4. Clustering algorithms for tree construction.
  *****************************************************************/
 
+/* The packed distance matrix that the engine works on. */
+typedef struct {
+  double *d;
+  int     N;
+} CLUSTER_MX;
+
+/* Get, set the distance between two active clusters. */
+static inline double
+cluster_get(const CLUSTER_MX *M, int i, int j)
+{
+  return (i < j ? M->d[esl_dmx_PackedIdx(M->N, i, j)] : M->d[esl_dmx_PackedIdx(M->N, j, i)]);
+}
+
+static inline void
+cluster_set(CLUSTER_MX *M, int i, int j, double v)
+{
+  if (i < j) M->d[esl_dmx_PackedIdx(M->N, i, j)] = v; else M->d[esl_dmx_PackedIdx(M->N, j, i)] = v;
+}
+
+/* The first pair of clusters that one row of the matrix is in, in the
+ * order the engine joins them: its partner <t>, and its key for that
+ * order, distance <d> and the pair's row and column <lo>,<hi> in the
+ * original algorithm's shuffled matrix. If <t> is -1, the row's first
+ * pair is no longer known, and the key is only a lower bound on it.
+ */
+typedef struct {
+  double d;
+  int    t, lo, hi;
+} CLUSTER_NBR;
+
+/* TRUE if key <d>,<lo>,<hi> comes before <d2>,<lo2>,<hi2>: smaller
+ * distance first, then row by row, as the original algorithm scans.
+ */
+static inline int
+cluster_key_precedes(double d, int lo, int hi, double d2, int lo2, int hi2)
+{
+  if (d < d2) return TRUE;
+  if (d > d2) return FALSE;
+  return (lo < lo2 || (lo == lo2 && hi < hi2));
+}
+
+/* If the pair of rows s,t comes before row s's first pair <nbr[s]>,
+ * make it the first pair. <pos> is where each row is in the original
+ * algorithm's matrix.
+ */
+static inline void
+cluster_try_nbr(const CLUSTER_MX *D, const int *pos, CLUSTER_NBR *nbr, int s, int t)
+{
+  double d  = cluster_get(D, s, t);
+  int    lo = ESL_MIN(pos[s], pos[t]);
+  int    hi = ESL_MAX(pos[s], pos[t]);
+
+  if (nbr[s].t == s || cluster_key_precedes(d, lo, hi, nbr[s].d, nbr[s].lo, nbr[s].hi))
+    { nbr[s].t = t; nbr[s].d = d; nbr[s].lo = lo; nbr[s].hi = hi; }
+}
+
+/* Find row <s>'s first pair, among the active rows. */
+static void
+cluster_find_nbr(const CLUSTER_MX *D, const int *next, const int *pos, CLUSTER_NBR *nbr, int s)
+{
+  int t;
+
+  nbr[s].t = s;
+  for (t = next[D->N]; t < D->N; t = next[t])
+    if (t != s) cluster_try_nbr(D, pos, nbr, s, t);
+}
+
+
 /* cluster_engine()
  * 
  * Implements four clustering algorithms for tree construction:
@@ -1548,9 +1616,11 @@ esl_tree_Compare(ESL_TREE *T1, ESL_TREE *T2)
  * only by the rule used to construct new distances after joining
  * two clusters i,j.
  * 
- * Input <D_original> is a symmetric distance matrix, for <D->n> taxa.
- * The diagonal is all 0's, and off-diagonals are $\geq 0$. <D->n>
- * must be at least two.
+ * Input <D> is the strict upper triangle of a symmetric distance
+ * matrix for <D->N> taxa, packed as described for
+ * <esl_dmx_PackedIdx()>, with off-diagonals $\geq 0$. <D->N> must
+ * be at least two. The matrix is used as
+ * workspace and is overwritten.
  * 
  * <mode> is one of <eslUPGMA>, <eslWPGMA>, <eslSINGLE_LINKAGE>, or
  * <eslCOMPLETE_LINKAGE>: a flag specifying which algorithm to use.
@@ -1561,58 +1631,66 @@ esl_tree_Compare(ESL_TREE *T1, ESL_TREE *T2)
  * 
  * Throws <eslEMEM> on allocation failure.
  * 
- * Complexity: O(N^2) in memory, O(N^3) in time.
+ * Complexity: no memory beyond <D> other than O(N). Typically
+ * O(N^2) in time; O(N^3) in the worst case, when many distances are
+ * tied.
  * 
- * This function can be optimized. Memory usage is at least
- * 4x more than necessary. First, we don't need to make a copy of D
- * if the caller doesn't mind it being consumed. Second, D only
- * needs to be lower- or upper-triangular, because it's symmetric,
- * but that requires changing dmatrix module. In time,
- * O(N^2 log N) if not O(N^2) should be possible, by being more
- * sophisticated about identifying the minimum element; 
- * see Gronau and Moran (2006).
+ * The original algorithm finds the minimum of an NxN matrix at each
+ * step, joins that pair, swaps the pair to the last two rows/cols,
+ * and shrinks the matrix by one. On ties it takes the first minimum in
+ * a row-major scan of its (by now shuffled) matrix. Trees depend on
+ * that choice when distances are tied, as they are for identical
+ * sequences, so we make exactly the same joins: <pos[s]> tracks
+ * where row <s> of our packed matrix would be in the original one,
+ * and pairs are ordered by <cluster_key_precedes()>. Instead of
+ * scanning the matrix for each join, we keep each row's first pair,
+ * <nbr[s]>. After a join, only pairs with the new cluster and with the
+ * rows that moved have changed. Rows that moved are rescanned. A row
+ * whose first pair was with one of the two joined clusters keeps the
+ * old key as a lower bound (its other pairs didn't come before it
+ * then, and haven't changed), and is only rescanned if that bound
+ * comes first among all the rows.
  * 
+ * Active clusters are kept on a doubly linked list in increasing
+ * order of their rows, so scans walk each row of <D> sequentially. A
+ * join is stored in the row of the cluster that was first in the
+ * original matrix.
  */
 static int
-cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
+cluster_engine(CLUSTER_MX *D, int mode, ESL_TREE **ret_T)
 {
-  ESL_DMATRIX *D = NULL;
-  ESL_TREE    *T = NULL;
-  double      *height = NULL;	/* height of internal nodes  [0..N-2]          */
-  int         *idx    = NULL;	/* taxa or node index of row/col in D [0..N-1] */
-  int         *nin    = NULL;	/* # of taxa in clade in row/col in D [0..N-1] */
-  int          N;
-  int          i = 0, j = 0;
-  int          row,col;
-  double       minD;
-  int          status;
-
-  /* Contract checks.
-   */
-  ESL_DASSERT1((D_original != NULL));               /* matrix exists      */
-  ESL_DASSERT1((D_original->n == D_original->m));   /* D is NxN square    */
-  ESL_DASSERT1((D_original->n >= 2));               /* >= 2 taxa          */
-
-#if (eslDEBUGLEVEL >=1)
-  for (i = 0; i < D_original->n; i++) {
-    assert(D_original->mx[i][i] == 0.);	           /* self-self d = 0    */
-    for (j = i+1; j < D_original->n; j++)	   /* D symmetric        */
-      assert(D_original->mx[i][j] == D_original->mx[j][i]);
-  }
-#endif
+  int        N      = D->N;
+  ESL_TREE  *T      = NULL;
+  double    *height = NULL;  /* height of internal nodes  [0..N-2]                      */
+  CLUSTER_NBR *nbr  = NULL;  /* first pair that row s is in  [0..N-1]                  */
+  int       *idx    = NULL;  /* taxon (<= 0) or node index (> 0) of cluster in row  [0..N-1] */
+  int       *nin    = NULL;  /* # of taxa in cluster in row  [0..N-1]                    */
+  int       *pos    = NULL;  /* row's position in the original algorithm's matrix  [0..N-1] */
+  int       *at     = NULL;  /* inverse of pos: row at each position  [0..N-1]           */
+  int       *next   = NULL;  /* list of active rows, in increasing order: [0..N], N=end  */
+  int       *prev   = NULL;  /*   ... and backwards; prev[N] is the last active row      */
+  int        n;              /* number of active clusters                                */
+  int        a, b, s, u, w, t;
+  double     d, da, db;
+  int        status;
 
-  /* Allocations.
-   * NxN copy of the distance matrix, which we'll iteratively whittle down to 2x2;
-   * tree for N taxa;
-   */
-  if ((D = esl_dmatrix_Clone(D_original)) == NULL) return eslEMEM;
-  if ((T = esl_tree_Create(D->n))         == NULL) return eslEMEM;
-  ESL_ALLOC(idx,    sizeof(int)    *  D->n);
-  ESL_ALLOC(nin,    sizeof(int)    *  D->n);
-  ESL_ALLOC(height, sizeof(double) * (D->n-1));
-  for (i = 0; i < D->n;   i++) idx[i]    = -i; /* assign taxa indices to row/col coords */
-  for (i = 0; i < D->n;   i++) nin[i ]   = 1;  /* each cluster starts as 1  */
-  for (i = 0; i < D->n-1; i++) height[i] = 0.; 
+  ESL_DASSERT1(( D->d != NULL ));
+  ESL_DASSERT1(( N >= 2 ));
+
+  if ((T = esl_tree_Create(N)) == NULL) { status = eslEMEM; goto ERROR; }
+  ESL_ALLOC(height, sizeof(double) * (N-1));
+  ESL_ALLOC(nbr,    sizeof(CLUSTER_NBR) * N);
+  ESL_ALLOC(idx,    sizeof(int)    * N);
+  ESL_ALLOC(nin,    sizeof(int)    * N);
+  ESL_ALLOC(pos,    sizeof(int)    * N);
+  ESL_ALLOC(at,     sizeof(int)    * N);
+  ESL_ALLOC(next,   sizeof(int)    * (N+1));
+  ESL_ALLOC(prev,   sizeof(int)    * (N+1));
+  for (s = 0; s < N;   s++) { idx[s] = -s; nin[s] = 1; pos[s] = at[s] = s; next[s] = s+1; prev[s+1] = s; }
+  for (s = 0; s < N-1; s++) height[s] = 0.;
+  next[N] = 0;
+  prev[0] = N;
+  for (s = 0; s < N; s++) cluster_find_nbr(D, next, pos, nbr, s);
 
   /* If we're doing either single linkage or complete linkage clustering,
    * we will construct a "linkage tree", where ld[v], rd[v] "branch lengths"
@@ -1624,107 +1702,155 @@ cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
   if (mode == eslSINGLE_LINKAGE || mode == eslCOMPLETE_LINKAGE)
     T->is_linkage_tree = TRUE;
 
-  for (N = D->n; N >= 2; N--)
+  for (n = N; n >= 2; n--)
     {
-      /* Find minimum in our current N x N matrix.
-       * (Don't init minD to -infinity; linkage trees use sparse distance matrices 
-       * with -infinity representing unlinked.)
+      /* Find the first pair: the best of the rows' first pairs, once
+       * it's known exactly.
+       * a is the cluster that comes first in the original matrix.
        */
-      minD = D->mx[0][1]; i = 0; j = 1;	/* init with: if nothing else, try to link 0-1 */
-      for (row = 0; row < N; row++)
-	for (col = row+1; col < N; col++)
-	  if (D->mx[row][col] < minD)
-	    {
-	      minD = D->mx[row][col];
-	      i    = row;
-	      j    = col;
-	    }
+      while (1)
+	{
+	  a = next[N];
+	  for (s = next[a]; s < N; s = next[s])
+	    if (cluster_key_precedes(nbr[s].d, nbr[s].lo, nbr[s].hi, nbr[a].d, nbr[a].lo, nbr[a].hi)) a = s;
+	  if (nbr[a].t != -1) break;
+	  cluster_find_nbr(D, next, pos, nbr, a);
+	}
+      b = nbr[a].t;
+      d = nbr[a].d;
+      if (pos[b] < pos[a]) ESL_SWAP(a, b, int);
 
-      /* We're joining node at row/col i with node at row/col j.
-       * Add node (index = N-2) to the tree at height minD/2.
+      /* We're joining cluster a with cluster b.
+       * Add node (index = n-2) to the tree at height d/2.
        */
-      T->left[N-2]  = idx[i];
-      T->right[N-2] = idx[j];
-      if (T->is_linkage_tree)        height[N-2]   = minD;
-      else                           height[N-2]   = minD / 2.;
+      T->left[n-2]  = idx[a];
+      T->right[n-2] = idx[b];
+      if (T->is_linkage_tree)        height[n-2]   = d;
+      else                           height[n-2]   = d / 2.;
 
       /* Set the branch lengths (additive trees) or heights (linkage trees)
        */
-      T->ld[N-2] = T->rd[N-2] = height[N-2];
+      T->ld[n-2] = T->rd[n-2] = height[n-2];
       if (! T->is_linkage_tree) {
-	if (idx[i] > 0) T->ld[N-2] = ESL_MAX(0., T->ld[N-2] - height[idx[i]]);  // max to 0, to avoid fp roundoff giving us negative length
-	if (idx[j] > 0) T->rd[N-2] = ESL_MAX(0., T->rd[N-2] - height[idx[j]]);      
+	if (idx[a] > 0) T->ld[n-2] = ESL_MAX(0., T->ld[n-2] - height[idx[a]]);  // max to 0, to avoid fp roundoff giving us negative length
+	if (idx[b] > 0) T->rd[n-2] = ESL_MAX(0., T->rd[n-2] - height[idx[b]]);      
       }
       
       /* If either node was an internal node, record parent in it.
        */
-      if (idx[i] > 0)  T->parent[idx[i]] = N-2;
-      if (idx[j] > 0)  T->parent[idx[j]] = N-2;
+      if (idx[a] > 0)  T->parent[idx[a]] = n-2;
+      if (idx[b] > 0)  T->parent[idx[b]] = n-2;
 
-      /* Now, build a new matrix by merging row i+j and col i+j.
-       *  1. move j to N-1 (unless it's already there)
-       *  2. move i to N-2 (unless it's already there)
+      /* Follow the original algorithm's shuffle: b moves to position
+       * n-1, trading places with u; then a moves to n-2, trading with w.
        */
-      if (j != N-1)
-	{
-	  for (row = 0; row < N; row++)
-	    ESL_SWAP(D->mx[row][N-1], D->mx[row][j], double);
-	  for (col = 0; col < N; col++)
-	    ESL_SWAP(D->mx[N-1][col], D->mx[j][col], double);
-	  ESL_SWAP(idx[j],  idx[N-1],  int);
-	  ESL_SWAP(nin[j], nin[N-1], int);
-	}
-      if (i != N-2)
-	{
-	  for (row = 0; row < N; row++)
-	    ESL_SWAP(D->mx[row][N-2], D->mx[row][i], double);
-	  for (col = 0; col < N; col++)
-	    ESL_SWAP(D->mx[N-2][col], D->mx[i][col], double);
-	  ESL_SWAP(idx[i], idx[N-2], int);
-	  ESL_SWAP(nin[i], nin[N-2], int);
-	}
-      i = N-2;
-      j = N-1;
+      u = w = -1;
+      if (pos[b] != n-1) { u = at[n-1]; at[pos[b]] = u; pos[u] = pos[b]; at[n-1] = b; pos[b] = n-1; }
+      if (pos[a] != n-2) { w = at[n-2]; at[pos[a]] = w; pos[w] = pos[a]; at[n-2] = a; pos[a] = n-2; }
 
-      /* 3. merge i (now at N-2) with j (now at N-1) 
-       *    according to the desired clustering rule.
+      /* Merge b into a's row, according to the desired clustering rule;
+       * b's row drops out of the active list.
        */
-      for (col = 0; col < N; col++)
+      for (t = next[N]; t < N; t = next[t])
 	{
+	  if (t == a || t == b) continue;
+	  da = cluster_get(D, a, t);
+	  db = cluster_get(D, b, t);
 	  switch (mode) {
-	  case eslUPGMA: 
-	    D->mx[i][col] = (nin[i] * D->mx[i][col] + nin[j] * D->mx[j][col]) / (double) (nin[i] + nin[j]);
-	    break;
-	  case eslWPGMA:            D->mx[i][col] = (D->mx[i][col] + D->mx[j][col]) / 2.;    break;
-	  case eslSINGLE_LINKAGE:   D->mx[i][col] = ESL_MIN(D->mx[i][col], D->mx[j][col]);   break;
-	  case eslCOMPLETE_LINKAGE: D->mx[i][col] = ESL_MAX(D->mx[i][col], D->mx[j][col]);   break;
+	  case eslUPGMA:            d = (nin[a] * da + nin[b] * db) / (double) (nin[a] + nin[b]); break;
+	  case eslWPGMA:            d = (da + db) / 2.;      break;
+	  case eslSINGLE_LINKAGE:   d = ESL_MIN(da, db);     break;
+	  case eslCOMPLETE_LINKAGE: d = ESL_MAX(da, db);     break;
 	  default:                  ESL_XEXCEPTION(eslEINCONCEIVABLE, "no such strategy");
 	  }
-	  D->mx[col][i] = D->mx[i][col];
+	  cluster_set(D, a, t, d);
 	}
-
-      /* row/col i is now the new cluster, and it corresponds to node N-2
-       * in the tree (remember, N is decrementing at each iteration).
-       * row/col j (N-1) falls away when we go back to the start of the loop 
-       * and decrement N. 
+      nin[a] += nin[b];
+      idx[a]  = n-2;
+      next[prev[b]] = next[b];
+      prev[next[b]] = prev[b];
+      if (n == 2) break;
+
+      /* Update the rows' first pairs. Only pairs with a, u, or w changed.
+       * A pair with u or w only moved up in the order, but a pair with a 
+       * may have moved down, and b is gone: a row whose first pair was
+       * with either one keeps its old key only as a lower bound, unless
+       * a changed pair now comes before it.
        */
-      nin[i] += nin[j];
-      idx[i]  = N-2;
-    }  
+      for (s = next[N]; s < N; s = next[s])
+	{
+	  if (s == a || s == u || s == w)
+	    cluster_find_nbr(D, next, pos, nbr, s);
+	  else
+	    {
+	      if      (nbr[s].t == a || nbr[s].t == b)  nbr[s].t = -1;
+	      else if (nbr[s].t != -1 && (nbr[s].t == u || nbr[s].t == w)) { nbr[s].lo = ESL_MIN(pos[s], pos[nbr[s].t]); nbr[s].hi = ESL_MAX(pos[s], pos[nbr[s].t]); }
+	      cluster_try_nbr(D, pos, nbr, s, a);
+	      if (u != -1) cluster_try_nbr(D, pos, nbr, s, u);
+	      if (w != -1) cluster_try_nbr(D, pos, nbr, s, w);
+	    }
+	}
+    }
 
-  esl_dmatrix_Destroy(D);
   free(height);
+  free(nbr);
   free(idx);
   free(nin);
-  if (ret_T != NULL) *ret_T = T;
+  free(pos);
+  free(at);
+  free(next);
+  free(prev);
+  if (ret_T != NULL) *ret_T = T; else esl_tree_Destroy(T);
   return eslOK;
 
  ERROR:
-  if (D      != NULL) esl_dmatrix_Destroy(D);
-  if (T      != NULL) esl_tree_Destroy(T);
-  if (height != NULL) free(height);
-  if (idx    != NULL) free(idx);
-  if (nin    != NULL) free(nin);
+  if (T != NULL) esl_tree_Destroy(T);
+  free(height);
+  free(nbr);
+  free(idx);
+  free(nin);
+  free(pos);
+  free(at);
+  free(next);
+  free(prev);
+  if (ret_T != NULL) *ret_T = NULL;
+  return status;
+}
+
+/* cluster_dmatrix()
+ *
+ * Pack the upper triangle of square symmetric distance matrix <D>
+ * (which is left untouched) and cluster it with <cluster_engine()>.
+ */
+static int
+cluster_dmatrix(ESL_DMATRIX *D, int mode, ESL_TREE **ret_T)
+{
+  CLUSTER_MX M = { NULL, D->n };
+  int        i, j;
+  int        status;
+
+  ESL_DASSERT1(( D != NULL ));              /* matrix exists      */
+  ESL_DASSERT1(( D->n == D->m ));           /* D is NxN square    */
+  ESL_DASSERT1(( D->n >= 2 ));              /* >= 2 taxa          */
+
+#if (eslDEBUGLEVEL >=1)
+  for (i = 0; i < D->n; i++) {
+    assert(D->mx[i][i] == 0.);	           /* self-self d = 0    */
+    for (j = i+1; j < D->n; j++)	   /* D symmetric        */
+      assert(D->mx[i][j] == D->mx[j][i]);
+  }
+#endif
+
+  ESL_ALLOC(M.d, sizeof(double) * ESL_MAX(1, (int64_t) D->n * (D->n-1) / 2));
+  for (i = 0; i < D->n; i++)
+    for (j = i+1; j < D->n; j++)
+      M.d[esl_dmx_PackedIdx(D->n, i, j)] = D->mx[i][j];
+
+  status = cluster_engine(&M, mode, ret_T);
+  free(M.d);
+  return status;
+
+ ERROR:
   if (ret_T != NULL) *ret_T = NULL;
   return status;
 }
@@ -1735,6 +1861,9 @@ cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
  * Purpose:   Given distance matrix <D>, use the UPGMA algorithm
  *            to construct a tree <T>.
  *
+ *            Typically runs in $O(N^2)$ time; $O(N^3)$ at worst, when
+ *            many distances are tied.
+ *
  * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
  *            and must be freed by the caller with <esl_tree_Destroy()>.
  *
@@ -1743,7 +1872,7 @@ cluster_engine(ESL_DMATRIX *D_original, int mode, ESL_TREE **ret_T)
 int
 esl_tree_UPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T)
 {
-  return cluster_engine(D, eslUPGMA, ret_T);
+  return cluster_dmatrix(D, eslUPGMA, ret_T);
 }
 
 /* Function:  esl_tree_WPGMA()
@@ -1759,7 +1888,7 @@ esl_tree_UPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T)
 int
 esl_tree_WPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T)
 {
-  return cluster_engine(D, eslWPGMA, ret_T);
+  return cluster_dmatrix(D, eslWPGMA, ret_T);
 }
 
 /* Function:  esl_tree_SingleLinkage()
@@ -1775,7 +1904,7 @@ esl_tree_WPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T)
 int
 esl_tree_SingleLinkage(ESL_DMATRIX *D, ESL_TREE **ret_T)
 {
-  return cluster_engine(D, eslSINGLE_LINKAGE, ret_T);
+  return cluster_dmatrix(D, eslSINGLE_LINKAGE, ret_T);
 }
 
 /* Function:  esl_tree_CompleteLinkage()
@@ -1791,7 +1920,37 @@ esl_tree_SingleLinkage(ESL_DMATRIX *D, ESL_TREE **ret_T)
 int
 esl_tree_CompleteLinkage(ESL_DMATRIX *D, ESL_TREE **ret_T)
 {
-  return cluster_engine(D, eslCOMPLETE_LINKAGE, ret_T);
+  return cluster_dmatrix(D, eslCOMPLETE_LINKAGE, ret_T);
+}
+
+/* Function:  esl_tree_ClusterPacked()
+ * Synopsis:  Clustering tree from a packed distance matrix.
+ *
+ * Purpose:   Construct a tree <T> for <N> taxa by clustering algorithm
+ *            <mode> (<eslUPGMA>, <eslWPGMA>, <eslSINGLE_LINKAGE>, or
+ *            <eslCOMPLETE_LINKAGE>), as <esl_tree_UPGMA()> and its
+ *            siblings do, from distance matrix <D> given as a packed
+ *            strict upper triangle: <N(N-1)/2> doubles, distance
+ *            $i<j$ at <D[esl_dmx_PackedIdx(N,i,j)]>, as made by
+ *            <esl_dst_XDiffPacked()> for example. The tree is the
+ *            same one <esl_tree_UPGMA()> and its siblings make from
+ *            the square matrix.
+ *
+ *            <D> is consumed as workspace: its contents are
+ *            undefined when this returns. That lets deep alignments
+ *            be clustered in half the memory of a square matrix,
+ *            without a copy.
+ *
+ * Returns:   <eslOK> on success; the tree is returned in <ret_T>,
+ *            and must be freed by the caller with <esl_tree_Destroy()>.
+ *
+ * Throws:    <eslEMEM> on allocation problem, and <ret_T> is set <NULL>.
+ */
+int
+esl_tree_ClusterPacked(double *D, int N, int mode, ESL_TREE **ret_T)
+{
+  CLUSTER_MX M = { D, N };
+  return cluster_engine(&M, mode, ret_T);
 }
 /*----------------- end, clustering algorithms  ----------------*/
 
@@ -2074,6 +2233,213 @@ utest_UPGMA(ESL_RANDOMNESS *r, int ntaxa)
   return;
 }
 
+/* Reference implementation for the clustering unit tests: the
+ * original O(N^3) engine, verbatim but for consuming <D> instead of
+ * a copy. It searches the whole matrix for its minimum at each step,
+ * taking the first one in a row-major scan, then swaps the joined pair
+ * to the last two rows/cols and shrinks the matrix by one.
+ */
+static ESL_TREE *
+reference_cluster(ESL_DMATRIX *D, int mode)
+{
+  ESL_TREE *T      = esl_tree_Create(D->n);
+  int      *idx    = malloc(sizeof(int)    * D->n);  /* tree node (or -taxon) of each row/col */
+  int      *nin    = malloc(sizeof(int)    * D->n);
+  double   *height = malloc(sizeof(double) * D->n);
+  double    minD;
+  int       N, i, j, row, col;
+
+  for (i = 0; i < D->n; i++) { idx[i] = -i; nin[i] = 1; height[i] = 0.; }
+  T->is_linkage_tree = (mode == eslSINGLE_LINKAGE || mode == eslCOMPLETE_LINKAGE);
+
+  for (N = D->n; N >= 2; N--)
+    {
+      minD = D->mx[0][1]; i = 0; j = 1;
+      for (row = 0; row < N; row++)
+	for (col = row+1; col < N; col++)
+	  if (D->mx[row][col] < minD) { minD = D->mx[row][col]; i = row; j = col; }
+
+      T->left[N-2]  = idx[i];
+      T->right[N-2] = idx[j];
+      height[N-2]   = (T->is_linkage_tree ? minD : minD / 2.);
+      T->ld[N-2] = T->rd[N-2] = height[N-2];
+      if (! T->is_linkage_tree) {
+	if (idx[i] > 0) T->ld[N-2] = ESL_MAX(0., T->ld[N-2] - height[idx[i]]);
+	if (idx[j] > 0) T->rd[N-2] = ESL_MAX(0., T->rd[N-2] - height[idx[j]]);
+      }
+      if (idx[i] > 0)  T->parent[idx[i]] = N-2;
+      if (idx[j] > 0)  T->parent[idx[j]] = N-2;
+
+      if (j != N-1)
+	{
+	  for (row = 0; row < N; row++) ESL_SWAP(D->mx[row][N-1], D->mx[row][j], double);
+	  for (col = 0; col < N; col++) ESL_SWAP(D->mx[N-1][col], D->mx[j][col], double);
+	  ESL_SWAP(idx[j], idx[N-1], int);
+	  ESL_SWAP(nin[j], nin[N-1], int);
+	}
+      if (i != N-2)
+	{
+	  for (row = 0; row < N; row++) ESL_SWAP(D->mx[row][N-2], D->mx[row][i], double);
+	  for (col = 0; col < N; col++) ESL_SWAP(D->mx[N-2][col], D->mx[i][col], double);
+	  ESL_SWAP(idx[i], idx[N-2], int);
+	  ESL_SWAP(nin[i], nin[N-2], int);
+	}
+      i = N-2;
+      j = N-1;
+
+      for (col = 0; col < N; col++)
+	{
+	  switch (mode) {
+	  case eslUPGMA:            D->mx[i][col] = (nin[i] * D->mx[i][col] + nin[j] * D->mx[j][col]) / (double) (nin[i] + nin[j]); break;
+	  case eslWPGMA:            D->mx[i][col] = (D->mx[i][col] + D->mx[j][col]) / 2.;    break;
+	  case eslSINGLE_LINKAGE:   D->mx[i][col] = ESL_MIN(D->mx[i][col], D->mx[j][col]);   break;
+	  case eslCOMPLETE_LINKAGE: D->mx[i][col] = ESL_MAX(D->mx[i][col], D->mx[j][col]);   break;
+	  }
+	  D->mx[col][i] = D->mx[i][col];
+	}
+      nin[i] += nin[j];
+      idx[i]  = N-2;
+    }
+
+  free(idx); free(nin); free(height);
+  return T;
+}
+
+/* Cluster <D> by rule <mode> with the ESL_DMATRIX function for it. */
+static int
+dmatrix_cluster(ESL_DMATRIX *D, int mode, ESL_TREE **ret_T)
+{
+  switch (mode) {
+  case eslUPGMA:            return esl_tree_UPGMA(D, ret_T);
+  case eslWPGMA:            return esl_tree_WPGMA(D, ret_T);
+  case eslSINGLE_LINKAGE:   return esl_tree_SingleLinkage(D, ret_T);
+  case eslCOMPLETE_LINKAGE: return esl_tree_CompleteLinkage(D, ret_T);
+  }
+  return eslEINVAL;
+}
+
+/* TRUE if trees <T1>, <T2> are identical, node for node, down to the
+ * last bit of their branch lengths.
+ */
+static int
+trees_identical(ESL_TREE *T1, ESL_TREE *T2)
+{
+  int v;
+
+  if (T1->N != T2->N || T1->is_linkage_tree != T2->is_linkage_tree) return FALSE;
+  for (v = 0; v < T1->N-1; v++)
+    if (T1->left[v] != T2->left[v] || T1->right[v] != T2->right[v] || T1->parent[v] != T2->parent[v] ||
+	T1->ld[v]   != T2->ld[v]   || T1->rd[v]    != T2->rd[v])
+      return FALSE;
+  return TRUE;
+}
+
+/* cluster_check()
+ * Cluster <D> by rule <mode> by both the ESL_DMATRIX function and
+ * esl_tree_ClusterPacked(), and check that both make exactly the
+ * reference's tree. Consumes <D>.
+ */
+static void
+cluster_check(ESL_DMATRIX *D, int mode)
+{
+  char      msg[] = "esl_tree clustering unit test failed";
+  int       N     = D->n;
+  double   *P     = malloc(sizeof(double) * N * (N-1) / 2);
+  ESL_TREE *T1    = NULL;
+  ESL_TREE *T2    = NULL;
+  ESL_TREE *T3    = NULL;
+  int       i, j;
+
+  for (i = 0; i < N; i++)
+    for (j = i+1; j < N; j++)
+      P[esl_dmx_PackedIdx(N, i, j)] = D->mx[i][j];
+
+  if (dmatrix_cluster(D, mode, &T1)                 != eslOK) esl_fatal(msg);
+  if (esl_tree_ClusterPacked(P, N, mode, &T2)       != eslOK) esl_fatal(msg);
+  T3 = reference_cluster(D, mode);
+
+  if (esl_tree_Validate(T1, NULL) != eslOK) esl_fatal(msg);
+  if (! trees_identical(T1, T3))            esl_fatal(msg);
+  if (! trees_identical(T2, T3))            esl_fatal(msg);
+  if (mode == eslUPGMA && esl_tree_VerifyUltrametric(T1) != eslOK) esl_fatal(msg);
+
+  esl_tree_Destroy(T1);
+  esl_tree_Destroy(T2);
+  esl_tree_Destroy(T3);
+  free(P);
+}
+
+/* utest_cluster()
+ * The engine gives exactly the reference's tree, for each clustering
+ * rule, on random distances, where ties are improbable.
+ */
+static void
+utest_cluster(ESL_RANDOMNESS *r, int ntaxa)
+{
+  int          mode[4] = { eslUPGMA, eslWPGMA, eslSINGLE_LINKAGE, eslCOMPLETE_LINKAGE };
+  ESL_DMATRIX *D   = esl_dmatrix_Create(ntaxa, ntaxa);
+  int          i, j, m;
+
+  for (m = 0; m < 4; m++)
+    {
+      for (i = 0; i < ntaxa; i++)
+        {
+          D->mx[i][i] = 0.;
+          for (j = i+1; j < ntaxa; j++)
+            D->mx[i][j] = D->mx[j][i] = esl_random(r);
+        }
+      cluster_check(D, mode[m]);
+    }
+  esl_dmatrix_Destroy(D);
+}
+
+/* utest_cluster_ties()
+ * On distances with many ties, the engine makes the same joins in the
+ * same order as the reference, breaking ties the same way, so the
+ * trees are identical: node numbering, branch lengths and all. Three
+ * kinds of ties: one distance for every pair; groups of identical
+ * taxa (like duplicate sequences), at distance 0 within a group and one
+ * distance between each pair of groups; and small integer distances.
+ */
+static void
+utest_cluster_ties(ESL_RANDOMNESS *r, int ntaxa)
+{
+  int          mode[4] = { eslUPGMA, eslWPGMA, eslSINGLE_LINKAGE, eslCOMPLETE_LINKAGE };
+  ESL_DMATRIX *D   = esl_dmatrix_Create(ntaxa, ntaxa);
+  ESL_DMATRIX *G   = esl_dmatrix_Create(ntaxa, ntaxa);
+  int         *grp = malloc(sizeof(int) * ntaxa);
+  int          ngrp = 1 + ntaxa / 4;
+  int          i, j, m, x;
+
+  for (x = 0; x < 3; x++)
+    for (m = 0; m < 4; m++)
+      {
+	for (i = 0; i < ngrp; i++)
+	  for (j = i; j < ngrp; j++)
+	    G->mx[i][j] = G->mx[j][i] = (i == j ? 0. : (double) esl_rnd_Roll(r, 4));
+	for (i = 0; i < ntaxa; i++) grp[i] = esl_rnd_Roll(r, ngrp);
+
+	for (i = 0; i < ntaxa; i++)
+	  {
+	    D->mx[i][i] = 0.;
+	    for (j = i+1; j < ntaxa; j++)
+	      {
+		switch (x) {
+		case 0: D->mx[i][j] = 0.5;                         break;
+		case 1: D->mx[i][j] = G->mx[grp[i]][grp[j]];       break;
+		case 2: D->mx[i][j] = (double) esl_rnd_Roll(r, 4); break;
+		}
+		D->mx[j][i] = D->mx[i][j];
+	      }
+	  }
+	cluster_check(D, mode[m]);
+      }
+
+  esl_dmatrix_Destroy(D);
+  esl_dmatrix_Destroy(G);
+  free(grp);
+}
+
 #endif /*eslTREE_TESTDRIVE*/
 /*-------------------- end, unit tests  -------------------------*/
 
@@ -2104,6 +2470,10 @@ main(int argc, char **argv)
   utest_OptionalInformation(r, ntaxa); /* SetTaxaparents(), SetCladesizes() */
   utest_WriteNewick(r, ntaxa);
   utest_UPGMA(r, ntaxa);
+  utest_cluster(r, ntaxa);
+  utest_cluster(r, 200);
+  utest_cluster_ties(r, ntaxa);
+  utest_cluster_ties(r, 200);
 
   esl_randomness_Destroy(r);
   return eslOK;
@@ -68,9 +68,9 @@ typedef struct {
 
 /* UPGMA, average-link, minimum-link, and maximum-link clustering are
  * all implemented by one algorithm, cluster_engine(), in esl_tree.c.
- * We define some flags (within the scope of the tree module) to
- * control the behavior, as we call the algorithm engine from four
- * different API functions.
+ * We define some flags to control the behavior, as we call the
+ * algorithm engine from four different API functions, or from
+ * esl_tree_ClusterPacked(), which takes one of them as an argument.
  */
 #define eslUPGMA            0
 #define eslWPGMA            1
@@ -108,6 +108,7 @@ extern int esl_tree_UPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T);
 extern int esl_tree_WPGMA(ESL_DMATRIX *D, ESL_TREE **ret_T);
 extern int esl_tree_SingleLinkage(ESL_DMATRIX *D, ESL_TREE **ret_T);
 extern int esl_tree_CompleteLinkage(ESL_DMATRIX *D, ESL_TREE **ret_T);
+extern int esl_tree_ClusterPacked(double *D, int N, int mode, ESL_TREE **ret_T);
 
 /* 5. Generating simulated trees.
  */
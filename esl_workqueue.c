@@ -53,7 +53,8 @@ esl_workqueue_Create(int size)
   queue->queueSize       = size;
   queue->pendingWorkers  = 0;
 
-  if (pthread_mutex_init(&queue->queueMutex, NULL) != 0)     ESL_XEXCEPTION(eslESYS, "mutex init failed");
+  if (pthread_mutex_init(&queue->readerMutex, NULL) != 0)    ESL_XEXCEPTION(eslESYS, "reader mutex init failed");
+  if (pthread_mutex_init(&queue->workerMutex, NULL) != 0)    ESL_XEXCEPTION(eslESYS, "worker mutex init failed");
 
   if (pthread_cond_init(&queue->readerQueueCond, NULL) != 0) ESL_XEXCEPTION(eslESYS, "cond reader init failed");
   if (pthread_cond_init(&queue->workerQueueCond, NULL) != 0) ESL_XEXCEPTION(eslESYS, "cond worker init failed");
@@ -90,7 +91,8 @@ esl_workqueue_Destroy(ESL_WORK_QUEUE *queue)
 {
   if (queue == NULL) return;
 
-  pthread_mutex_destroy (&queue->queueMutex);
+  pthread_mutex_destroy (&queue->readerMutex);
+  pthread_mutex_destroy (&queue->workerMutex);
   pthread_cond_destroy  (&queue->readerQueueCond);
   pthread_cond_destroy  (&queue->workerQueueCond);
 
@@ -122,7 +124,7 @@ int esl_workqueue_Init(ESL_WORK_QUEUE *queue, void *ptr)
   if (queue == NULL) ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
   if (ptr == NULL)   ESL_EXCEPTION(eslEINVAL, "Invalid reader object");
 
-  if (pthread_mutex_lock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  if (pthread_mutex_lock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
 
   queueSize = queue->queueSize;
 
@@ -139,7 +141,7 @@ int esl_workqueue_Init(ESL_WORK_QUEUE *queue, void *ptr)
       if (pthread_cond_signal (&queue->readerQueueCond) != 0) ESL_EXCEPTION(eslESYS, "cond signal failed");
     }
 
-  if (pthread_mutex_unlock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  if (pthread_mutex_unlock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
 
   return eslOK;
 }
@@ -171,7 +173,7 @@ esl_workqueue_Remove(ESL_WORK_QUEUE *queue, void **obj)
   if (obj == NULL)   ESL_EXCEPTION(eslEINVAL, "Invalid object pointer");
   if (queue == NULL) ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
 
-  if (pthread_mutex_lock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+  if (pthread_mutex_lock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
 
   /* check if there are any items on the readers list */
   *obj = NULL;
@@ -184,7 +186,7 @@ esl_workqueue_Remove(ESL_WORK_QUEUE *queue, void **obj)
       status = eslOK;
     }
 
-  if (pthread_mutex_unlock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  if (pthread_mutex_unlock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
 
   return status;
 }
@@ -205,15 +207,15 @@ esl_workqueue_Remove(ESL_WORK_QUEUE *queue, void **obj)
 int 
 esl_workqueue_Complete(ESL_WORK_QUEUE *queue)
 {
-  if (queue == NULL)                                ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
-  if (pthread_mutex_lock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
+  if (queue == NULL)                                 ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
+  if (pthread_mutex_lock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
 
   if (queue->pendingWorkers != 0)
     {
       if (pthread_cond_broadcast (&queue->workerQueueCond) != 0) ESL_EXCEPTION(eslESYS, "broadcast failed");
     }
 
-  if (pthread_mutex_unlock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  if (pthread_mutex_unlock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
 
   return eslOK;
 }
@@ -236,8 +238,9 @@ esl_workqueue_Reset(ESL_WORK_QUEUE *queue)
   int inx;
   int queueSize;
 
-  if (queue == NULL)                                ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
-  if (pthread_mutex_lock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
+  if (queue == NULL)                                 ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
+  if (pthread_mutex_lock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
+  if (pthread_mutex_lock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
 
   queueSize = queue->queueSize;
 
@@ -255,7 +258,8 @@ esl_workqueue_Reset(ESL_WORK_QUEUE *queue)
 
   queue->pendingWorkers = 0;
 
-  if (pthread_mutex_unlock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  if (pthread_mutex_unlock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  if (pthread_mutex_unlock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
 
   return eslOK;
 }
@@ -287,14 +291,14 @@ int esl_workqueue_ReaderUpdate(ESL_WORK_QUEUE *queue, void *in, void **out)
   int inx;
   int queueSize;
 
-  if (queue == NULL)                                ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
-  if (pthread_mutex_lock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
+  if (queue == NULL) ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
 
   queueSize = queue->queueSize;
 
   /* check if the caller is queuing up an item */
   if (in != NULL)
     {
+      if (pthread_mutex_lock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
 
       /* check to make sure we don't overflow */
       if (queue->workerQueueCnt >= queueSize) ESL_EXCEPTION(eslEINVAL, "Work queue overflow");
@@ -303,20 +307,24 @@ int esl_workqueue_ReaderUpdate(ESL_WORK_QUEUE *queue, void *in, void **out)
       queue->workerQueue[inx] = in;
       ++queue->workerQueueCnt;
 
+      /* one new item needs one worker; waking them all just has them fight over the lock */
       if (queue->pendingWorkers != 0)
 	{
-	  if (pthread_cond_broadcast (&queue->workerQueueCond) != 0) ESL_EXCEPTION(eslESYS, "broadcast failed");
+	  if (pthread_cond_signal (&queue->workerQueueCond) != 0) ESL_EXCEPTION(eslESYS, "cond signal failed");
 	}
+
+      if (pthread_mutex_unlock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
     }
 
   /* check if the caller is waiting for a queued item */
   if (out != NULL)
     {
+      if (pthread_mutex_lock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
 
       /* wait for a processed buffers to be returned */
       while (queue->readerQueueCnt == 0) 
 	{
-	  if (pthread_cond_wait (&queue->readerQueueCond, &queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "cond wait failed");
+	  if (pthread_cond_wait (&queue->readerQueueCond, &queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "cond wait failed");
 	}
 
       inx = queue->readerQueueHead;
@@ -324,9 +332,9 @@ int esl_workqueue_ReaderUpdate(ESL_WORK_QUEUE *queue, void *in, void **out)
       queue->readerQueue[inx] = NULL;
       queue->readerQueueHead = (queue->readerQueueHead + 1) % queueSize;
       --queue->readerQueueCnt;
-    }
 
-  if (pthread_mutex_unlock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+      if (pthread_mutex_unlock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+    }
 
   return eslOK;
 }
@@ -358,14 +366,14 @@ int esl_workqueue_WorkerUpdate(ESL_WORK_QUEUE *queue, void *in, void **out)
   int queueSize;
   int status;
 
-  if (queue == NULL)                                ESL_XEXCEPTION(eslEINVAL, "Invalid queue object");
-  if (pthread_mutex_lock (&queue->queueMutex) != 0) ESL_XEXCEPTION(eslESYS,   "mutex lock failed");
+  if (queue == NULL) ESL_XEXCEPTION(eslEINVAL, "Invalid queue object");
 
   queueSize = queue->queueSize;
 
   /* check if the caller is queuing up an item */
   if (in != NULL)
     {
+      if (pthread_mutex_lock (&queue->readerMutex) != 0) ESL_XEXCEPTION(eslESYS, "mutex lock failed");
 
       /* check to make sure we don't overflow */
       if (queue->readerQueueCnt >= queueSize) ESL_XEXCEPTION(eslEINVAL, "Reader queue overflow");
@@ -377,11 +385,14 @@ int esl_workqueue_WorkerUpdate(ESL_WORK_QUEUE *queue, void *in, void **out)
 	{
 	  if (pthread_cond_signal (&queue->readerQueueCond) != 0) ESL_XEXCEPTION(eslESYS, "cond signal failed");
 	}
+
+      if (pthread_mutex_unlock (&queue->readerMutex) != 0) ESL_XEXCEPTION(eslESYS, "mutex unlock failed");
     }
 
   /* check if the caller is waiting for a queued item */
   if (out != NULL)
     {
+      if (pthread_mutex_lock (&queue->workerMutex) != 0) ESL_XEXCEPTION(eslESYS, "mutex lock failed");
 
       if (queue->workerQueueCnt == 0)
 	{
@@ -389,7 +400,7 @@ int esl_workqueue_WorkerUpdate(ESL_WORK_QUEUE *queue, void *in, void **out)
 	  ++queue->pendingWorkers;
 	  while (queue->workerQueueCnt == 0)
 	    {
-	      if (pthread_cond_wait (&queue->workerQueueCond, &queue->queueMutex) != 0) ESL_XEXCEPTION(eslESYS, "cond wait failed");
+	      if (pthread_cond_wait (&queue->workerQueueCond, &queue->workerMutex) != 0) ESL_XEXCEPTION(eslESYS, "cond wait failed");
 	    }
 	  --queue->pendingWorkers;
 	}
@@ -399,9 +410,10 @@ int esl_workqueue_WorkerUpdate(ESL_WORK_QUEUE *queue, void *in, void **out)
       queue->workerQueue[inx] = NULL;
       queue->workerQueueHead = (queue->workerQueueHead + 1) % queueSize;
       --queue->workerQueueCnt;
+
+      if (pthread_mutex_unlock (&queue->workerMutex) != 0) ESL_XEXCEPTION(eslESYS, "mutex unlock failed");
     }
 
-  if (pthread_mutex_unlock (&queue->queueMutex) != 0) ESL_XEXCEPTION(eslESYS, "mutex unlock failed");
   return eslOK;
 
  ERROR:
@@ -421,8 +433,9 @@ int esl_workqueue_Dump(ESL_WORK_QUEUE *queue)
 {
   int i;
 
-  if (queue == NULL)                                ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
-  if (pthread_mutex_lock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
+  if (queue == NULL)                                 ESL_EXCEPTION(eslEINVAL, "Invalid queue object");
+  if (pthread_mutex_lock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
+  if (pthread_mutex_lock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS,   "mutex lock failed");
 
   printf ("Reader head: %2d  count: %2d\n", queue->readerQueueHead, queue->readerQueueCnt);
   printf ("Worker head: %2d  count: %2d\n", queue->workerQueueHead, queue->workerQueueCnt);
@@ -432,7 +445,8 @@ int esl_workqueue_Dump(ESL_WORK_QUEUE *queue)
     }
   printf ("Pending: %2d\n\n", queue->pendingWorkers);
 
-  if (pthread_mutex_unlock (&queue->queueMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  if (pthread_mutex_unlock (&queue->readerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+  if (pthread_mutex_unlock (&queue->workerMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
 
   return eslOK;
 }
@@ -4,8 +4,15 @@
 #define eslWORKQUEUE_INCLUDED
 #include "esl_config.h"
 
+/* The reader and worker queues have separate locks, so a producer
+ * recycling a buffer doesn't contend with consumers taking work.
+ * When both are needed, take <workerMutex> first.
+ * For new code, see ESL_THREADPOOL (esl_threadpool.h), a
+ * work-stealing pool with per-worker deques.
+ */
 typedef struct {
-  pthread_mutex_t  queueMutex;          /* mutex for queue serialization                           */
+  pthread_mutex_t  readerMutex;         /* protects the reader queue                               */
+  pthread_mutex_t  workerMutex;         /* protects the worker queue and <pendingWorkers>          */
   pthread_cond_t   readerQueueCond;     /* condition variable used to wake up the producer         */
   pthread_cond_t   workerQueueCond;     /* condition variable used to wake up the consumers        */
 
@@ -18,12 +18,13 @@ static ESL_OPTIONS cmd_options[] = {
   { "--dna",       eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL,  "use DNA alphabet (don't autodetect)",                  0 },
   { "--rna",       eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL,  "use RNA alphabet (don't autodetect)",                  0 },
   { "--amino",     eslARG_NONE,   FALSE,  NULL, NULL,  NULL,  NULL, NULL,  "use protein alphabet (don't autodetect)",              0 },
+  { "--cpu",       eslARG_INT,      "0",  NULL,"n>=0", NULL,  NULL, NULL,  "number of threads for parsing alignments; 0 = serial", 0 },
 
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
-static void alistat_default(const char *msafile, ESL_MSAFILE *afp);
-static void alistat_oneline(const char *msafile, ESL_MSAFILE *afp);
+static void alistat_default(const char *msafile, ESL_MSAFILE *afp, ESL_MSAFILE_READER *rdr);
+static void alistat_oneline(const char *msafile, ESL_MSAFILE *afp, ESL_MSAFILE_READER *rdr);
 
 int
 esl_cmd_alistat(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv)
@@ -32,6 +33,7 @@ esl_cmd_alistat(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv
   ESL_ALPHABET   *abc     = NULL;
   char           *msafile = esl_opt_GetArg(go, 1);
   ESL_MSAFILE    *afp     = NULL;
+  ESL_MSAFILE_READER *rdr = NULL;
   int             fmt     = eslMSAFILE_UNKNOWN;
   int             status;
   
@@ -41,10 +43,13 @@ esl_cmd_alistat(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv
 
   if (( status = esl_msafile_Open(&abc, msafile, /*env=*/NULL, fmt, /*fmtd=*/NULL, &afp)) != eslOK)
     esl_msafile_OpenFailure(afp, status);
+  if (( status = esl_msafile_ReaderCreate(afp, esl_opt_GetInteger(go, "--cpu"), &rdr)) != eslOK)
+    esl_fatal("failed to create MSA reader, error code %d", status);
 
-  if (esl_opt_GetBoolean(go, "-1")) alistat_oneline(msafile, afp);
-  else                              alistat_default(msafile, afp);
+  if (esl_opt_GetBoolean(go, "-1")) alistat_oneline(msafile, afp, rdr);
+  else                              alistat_default(msafile, afp, rdr);
   
+  esl_msafile_ReaderDestroy(rdr);
   esl_msafile_Close(afp);
   esl_alphabet_Destroy(abc);
   esl_getopts_Destroy(go);
@@ -53,7 +58,7 @@ esl_cmd_alistat(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv
 
 
 static void
-alistat_oneline(const char *msafile, ESL_MSAFILE *afp)
+alistat_oneline(const char *msafile, ESL_MSAFILE *afp, ESL_MSAFILE_READER *rdr)
 {
   ESL_MSA    *msa         = NULL;
   FILE       *fp          = NULL;
@@ -90,7 +95,7 @@ alistat_oneline(const char *msafile, ESL_MSAFILE *afp)
 		 10,  "size/nres",
 		 0);  // 0 is needed to signal arglist termination
 
-  while ((status = esl_msafile_Read(afp, &msa)) == eslOK)
+  while ((status = esl_msafile_ReaderNext(rdr, &msa)) == eslOK)
     {
       nali++;
 
@@ -144,7 +149,7 @@ alistat_oneline(const char *msafile, ESL_MSAFILE *afp)
 
 
 static void
-alistat_default(const char *msafile, ESL_MSAFILE *afp)
+alistat_default(const char *msafile, ESL_MSAFILE *afp, ESL_MSAFILE_READER *rdr)
 {
   ESL_MSA    *msa             = NULL;
   int         nali            = 0;
@@ -154,7 +159,7 @@ alistat_default(const char *msafile, ESL_MSAFILE *afp)
   int         i;
   int         status;
 
-  while ((status = esl_msafile_Read(afp, &msa)) == eslOK)
+  while ((status = esl_msafile_ReaderNext(rdr, &msa)) == eslOK)
     {
       /* raw seq length stats */
       nres = 0;
@@ -20,6 +20,7 @@ static ESL_OPTIONS cmd_options[] = {
   { "--dna",         eslARG_NONE,   FALSE,                            NULL, NULL,       NULL,  NULL, NULL,            "specify that input MSA is DNA (don't autodetect)",          1 },
   { "--rna",         eslARG_NONE,   FALSE,                            NULL, NULL,       NULL,  NULL, NULL,            " ... that input MSA is RNA",                                1 },
   { "--amino",       eslARG_NONE,   FALSE,                            NULL, NULL,       NULL,  NULL, NULL,            " ... that input MSA is protein",                            1 },
+  { "--cpu",         eslARG_INT,    ESL_STR(eslMSAWEIGHT_NTHREADS),   NULL, "n>=0",     NULL,  NULL, NULL,            "number of threads for parsing, pairwise comparisons",      1 },
 
   { "--ignore-rf",   eslARG_NONE,   eslMSAWEIGHT_IGNORE_RF,           NULL, NULL,       NULL,  NULL, NULL,            "ignore any RF line; always determine our own consensus",    2 },
   { "--fragthresh",  eslARG_REAL,   ESL_STR(eslMSAWEIGHT_FRAGTHRESH), NULL, "0<=x<=1",  NULL,  NULL, NULL,            "seq is fragment if aspan/alen < fragthresh",                2 },	// 0.0 = no fragments; 1.0 = everything is a frag except 100% full-span aseq 
@@ -53,6 +54,7 @@ esl_cmd_filter(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv)
   FILE           *ofp     = NULL;
   ESL_MSAWEIGHT_CFG *cfg  = esl_msaweight_cfg_Create();
   ESL_MSAFILE    *afp     = NULL;
+  ESL_MSAFILE_READER *rdr = NULL;
   ESL_MSA        *msa     = NULL;
   ESL_MSA        *msa2    = NULL;
   int             nali    = 0;
@@ -77,6 +79,7 @@ esl_cmd_filter(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv)
   cfg->nsamp      =  esl_opt_GetInteger(go, "--nsamp");
   cfg->maxfrag    =  esl_opt_GetInteger(go, "--maxfrag");
   cfg->seed       =  esl_opt_GetInteger(go, "-s");
+  cfg->nthreads   =  esl_opt_GetInteger(go, "--cpu");
 
   if      (esl_opt_GetBoolean(go, "--conscover")) cfg->filterpref = eslMSAWEIGHT_FILT_CONSCOVER;
   else if (esl_opt_GetBoolean(go, "--randorder")) cfg->filterpref = eslMSAWEIGHT_FILT_RANDOM;
@@ -93,7 +96,10 @@ esl_cmd_filter(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv)
   ofp = (esl_opt_GetString (go, "-o") == NULL ? stdout : fopen(esl_opt_GetString(go, "-o"), "w"));
   if (! ofp)  esl_fatal("Failed to open output file %s\n", esl_opt_GetString(go, "-o"));
 
-  while ((status = esl_msafile_Read(afp, &msa)) == eslOK)
+  if (( status = esl_msafile_ReaderCreate(afp, cfg->nthreads, &rdr)) != eslOK)
+    esl_fatal("failed to create MSA reader, error code %d", status);
+
+  while ((status = esl_msafile_ReaderNext(rdr, &msa)) == eslOK)
     {
       nali++;
 
@@ -109,6 +115,7 @@ esl_cmd_filter(const char *topcmd, const ESL_SUBCMD *sub, int argc, char **argv)
   if (nali == 0 || status != eslEOF) esl_msafile_ReadFailure(afp, status); /* a convenience, like esl_msafile_OpenFailure() */
 
   if (ofp != stdout) fclose(ofp);
+  esl_msafile_ReaderDestroy(rdr);
   esl_msaweight_cfg_Destroy(cfg);
   esl_alphabet_Destroy(abc);
   esl_msafile_Close(afp);
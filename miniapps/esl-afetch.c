@@ -11,6 +11,7 @@
 #include "esl_fileparser.h"
 #include "esl_keyhash.h"
 #include "esl_mem.h"
+#include "esl_quicksort.h"
 #include "esl_ssi.h"
 #include "esl_msa.h"
 #include "esl_msafile.h"
@@ -57,12 +58,21 @@ static ESL_OPTIONS options[] = {
   { "--informat", eslARG_STRING,      FALSE, NULL, NULL, NULL, NULL, NULL,          "specify that <msafile> is in format <s>",           0 },
   { "--outformat",eslARG_STRING,"Stockholm", NULL, NULL, NULL, NULL, "--index",     "output fetched alignment(s) in format <s>",         0 },
   { "--index",    eslARG_NONE,        FALSE, NULL, NULL, NULL, NULL, NULL,          "index the <msafile>, creating <msafile>.ssi",       0 },
+  { "--unordered",eslARG_NONE,        FALSE, NULL, NULL, NULL, "-f", NULL,          "with -f and SSI index: output MSAs in file order",  0 },
   { 0,0,0,0,0,0,0,0,0,0 },
 };
 
+/* Where the alignments in a multifetch are, for sorting them into file order. */
+struct fetch_where {
+  uint16_t *fh;
+  off_t    *offset;
+};
+
 static void create_ssi_index(ESL_GETOPTS *go, ESL_MSAFILE *afp);
 static void multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESL_MSAFILE *afp);
-static void onefetch  (ESL_GETOPTS *go, FILE *ofp, int outfmt, char *key,     ESL_MSAFILE *afp);
+static int  file_order(const void *data, int o1, int o2);
+static void copy_records(FILE *ofp, FILE *tmpfp, const off_t *toff, const int *order, int n);
+static void onefetch  (ESL_GETOPTS *go, FILE *ofp, int outfmt, char *key, off_t offset, ESL_MSAFILE *afp);
 static void regurgitate_one_stockholm_entry(FILE *ofp,                        ESL_MSAFILE *afp);
 
 int
@@ -105,7 +115,8 @@ main(int argc, char **argv)
     {
       if (afp->bf->mode_is == eslBUFFER_FILE    ||
 	  afp->bf->mode_is == eslBUFFER_ALLFILE ||
-	  afp->bf->mode_is == eslBUFFER_MMAP)
+	  afp->bf->mode_is == eslBUFFER_MMAP    ||
+	  afp->bf->mode_is == eslBUFFER_GZIP)
 	{
 	  char *ssifile = NULL;
 	  esl_sprintf(&ssifile, "%s.ssi", afp->bf->filename);
@@ -148,7 +159,7 @@ main(int argc, char **argv)
   else 
     {
       if (esl_opt_ArgNumber(go) != 2) cmdline_failure(argv[0], "Incorrect number of command line arguments.\n");        
-      onefetch(go, ofp, outfmt, esl_opt_GetArg(go, 2), afp);
+      onefetch(go, ofp, outfmt, esl_opt_GetArg(go, 2), -1, afp);
       if (ofp != stdout) printf("\n\nRetrieved alignment %s.\n",  esl_opt_GetArg(go, 2));
     }
 
@@ -173,7 +184,8 @@ create_ssi_index(ESL_GETOPTS *go, ESL_MSAFILE *afp)
 
   if (afp->bf->mode_is != eslBUFFER_FILE &&
       afp->bf->mode_is != eslBUFFER_ALLFILE &&
-      afp->bf->mode_is != eslBUFFER_MMAP)
+      afp->bf->mode_is != eslBUFFER_MMAP &&
+      afp->bf->mode_is != eslBUFFER_GZIP)
     esl_fatal("<msafile> must be a regular file to be SSI indexed");
 
   esl_sprintf(&ssifile, "%s.ssi", afp->bf->filename);
@@ -224,16 +236,17 @@ create_ssi_index(ESL_GETOPTS *go, ESL_MSAFILE *afp)
 
 /* multifetch:
  * given a file containing lines with one name or key per line;
- * parse the file line-by-line;
- * if we have an SSI index available, retrieve the MSAs by key
- * as we see each line;
- * else, without an SSI index, store the keys in a hash, then
- * read the entire MSA file in a single pass, outputting MSAs
- * that are in our keylist. 
+ * parse the file line-by-line, storing the keys in a hash;
+ * if we have an SSI index available, look them all up in the
+ * index at once, and retrieve the MSAs by offset, in one forward
+ * sweep through the file in offset order;
+ * else, without an SSI index, read the entire MSA file in a single
+ * pass, outputting MSAs that are in our keylist. 
  * 
  * Note that with an SSI index, you get the MSAs in the order they
- * appear in the <keyfile>, but without an SSI index, you get MSAs in
- * the order they occur in the MSA file.
+ * appear in the <keyfile> (the sweep's output is staged in a tmpfile,
+ * then put back in order), unless --unordered is set; without an SSI
+ * index, you get MSAs in the order they occur in the MSA file.
  */
 static void
 multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESL_MSAFILE *afp)
@@ -242,6 +255,7 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESL_MSAFILE *a
   ESL_FILEPARSER *efp    = NULL;
   ESL_MSA        *msa    = NULL;
   int             nali   = 0;
+  int             nkeys  = 0;
   char           *key;
   int             keylen;
   int             keyidx;
@@ -258,9 +272,56 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESL_MSAFILE *a
       
       status = esl_keyhash_Store(keys, key, keylen, &keyidx);
       if (status == eslEDUP) esl_fatal("MSA key %s occurs more than once in file %s\n", key, keyfile);
-	
-      if (afp->ssi) { onefetch(go, ofp, outfmt, key, afp);  nali++; }
+      nkeys++;
+    }
 
+  if (afp->ssi && nkeys > 0)
+    {
+      char              **keylist;
+      off_t              *toff;
+      int                *order;
+      FILE               *tmpfp = NULL;
+      char                tmpfile[16] = "esltmpXXXXXX";
+      int                 i;
+      struct fetch_where  where;
+
+      ESL_ALLOC(keylist,      sizeof(char *)   * nkeys);
+      ESL_ALLOC(where.fh,     sizeof(uint16_t) * nkeys);
+      ESL_ALLOC(where.offset, sizeof(off_t)    * nkeys);
+      ESL_ALLOC(toff,         sizeof(off_t)    * (nkeys+1));
+      ESL_ALLOC(order,        sizeof(int)      * nkeys);
+      for (keyidx = 0; keyidx < nkeys; keyidx++) keylist[keyidx] = esl_keyhash_Get(keys, keyidx);
+
+      status = esl_ssi_FindNames(afp->ssi, keylist, nkeys, where.fh, where.offset, NULL, NULL, NULL);
+      if      (status == eslEFORMAT) esl_fatal("Failed to parse SSI index for %s\n", afp->bf->filename);
+      else if (status != eslOK)      esl_fatal("Failed to look up keys in SSI index of file %s\n", afp->bf->filename);
+
+      for (keyidx = 0; keyidx < nkeys; keyidx++)
+	if (where.offset[keyidx] == -1) esl_fatal("MSA %s not found in SSI index for file %s\n", keylist[keyidx], afp->bf->filename);
+
+      esl_quicksort(&where, nkeys, file_order, order);
+
+      if (! esl_opt_GetBoolean(go, "--unordered") && esl_tmpfile(tmpfile, &tmpfp) != eslOK)
+	esl_fatal("Failed to open a tmpfile for staging fetched alignments");
+
+      for (i = 0; i < nkeys; i++)
+	{
+	  keyidx = order[i];
+	  if (tmpfp) toff[keyidx] = ftello(tmpfp);
+	  onefetch(go, (tmpfp ? tmpfp : ofp), outfmt, keylist[keyidx], where.offset[keyidx], afp);
+	  nali++;
+	}
+      if (tmpfp)
+	{
+	  toff[nkeys] = ftello(tmpfp);
+	  copy_records(ofp, tmpfp, toff, order, nkeys);
+	  fclose(tmpfp);
+	}
+      free(keylist);
+      free(where.fh);
+      free(where.offset);
+      free(toff);
+      free(order);
     }
 
   if (! afp->ssi)
@@ -285,6 +346,60 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESL_MSAFILE *a
   esl_keyhash_Destroy(keys);
   esl_fileparser_Close(efp);
   return;
+
+ ERROR:
+  esl_fatal("allocation failed");
+}
+
+/* file_order():
+ * esl_quicksort() comparison for multifetch(): put alignments in
+ * order of file handle, then offset. Ties (the same alignment, asked
+ * for by both name and accession) keep <namefile> order.
+ */
+static int
+file_order(const void *data, int o1, int o2)
+{
+  const struct fetch_where *where = data;
+
+  if (where->fh[o1]     != where->fh[o2])     return (where->fh[o1]     < where->fh[o2]     ? -1 : 1);
+  if (where->offset[o1] != where->offset[o2]) return (where->offset[o1] < where->offset[o2] ? -1 : 1);
+  return (o1 < o2 ? -1 : (o1 > o2 ? 1 : 0));
+}
+
+/* copy_records():
+ * Alignments <0..n-1> were written to <tmpfp> in the order <order[]>,
+ * starting at offsets <toff[]>, with <toff[n]> the end of the last
+ * one. Copy them to <ofp> in order <0..n-1>.
+ */
+static void
+copy_records(FILE *ofp, FILE *tmpfp, const off_t *toff, const int *order, int n)
+{
+  char   buf[65536];
+  off_t *end = NULL;
+  off_t  left;
+  size_t nb;
+  int    i;
+  int    status;
+
+  /* alignment order[i] ends where order[i+1] starts */
+  ESL_ALLOC(end, sizeof(off_t) * n);
+  for (i = 0; i < n; i++) end[order[i]] = (i+1 < n ? toff[order[i+1]] : toff[n]);
+
+  for (i = 0; i < n; i++)
+    {
+      if (fseeko(tmpfp, toff[i], SEEK_SET) != 0) esl_fatal("Failed to reposition tmpfile of fetched alignments");
+      for (left = end[i] - toff[i]; left > 0; left -= nb)
+	{
+	  nb = (left < sizeof(buf) ? left : sizeof(buf));
+	  if (fread (buf, 1, nb, tmpfp) != nb) esl_fatal("Failed to read tmpfile of fetched alignments");
+	  if (fwrite(buf, 1, nb, ofp)   != nb) esl_fatal("Failed to write fetched alignments");
+	}
+    }
+  free(end);
+  return;
+
+ ERROR:
+  esl_fatal("allocation failed");
 }
 
   
@@ -292,11 +407,13 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *keyfile, ESL_MSAFILE *a
  * Given one <key> (an MSA name or accession), retrieve the corresponding MSA.
  * In SSI mode, we can do this quickly by positioning the file, then regurgitating
  * every line until the end-of-alignment marker; we don't even have to parse.
+ * If the caller already looked up the alignment's <offset> in the index, we
+ * position there; else pass <offset> as -1, and we look up <key>.
  * Without an SSI index, we have to parse the MSAs sequentially 'til we find
  * the one we're after.
  */
 static void
-onefetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *key, ESL_MSAFILE *afp)
+onefetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *key, off_t offset, ESL_MSAFILE *afp)
 {
   ESL_MSA *msa  = NULL;
   int      nali = 1;
@@ -304,7 +421,8 @@ onefetch(ESL_GETOPTS *go, FILE *ofp, int outfmt, char *key, ESL_MSAFILE *afp)
 
   if (afp->ssi)
     {
-      status = esl_msafile_PositionByKey(afp, key);
+      if (offset >= 0) { status = esl_buffer_SetOffset(afp->bf, offset); afp->linenumber = -1; }
+      else               status = esl_msafile_PositionByKey(afp, key);
       if      (status == eslENOTFOUND) esl_fatal("MSA %s not found in SSI index for file %s\n", key, afp->bf->filename);
       else if (status == eslEFORMAT)   esl_fatal("Failed to parse SSI index for %s\n", afp->bf->filename);
       else if (status != eslOK)        esl_fatal("Failed to look up location of MSA %s in SSI index of file %s\n", key, afp->bf->filename);
@@ -4,6 +4,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -12,7 +13,7 @@
 #include "esl_getopts.h"
 #include "esl_msa.h"
 #include "esl_msafile.h"
-#include "esl_msafile2.h"
+#include "esl_msafile_stockholm.h"
 #include "esl_distance.h"
 #include "esl_vectorops.h"
 #include "esl_wuss.h"
@@ -31,6 +32,8 @@ static int  map_rfpos_to_apos(ESL_MSA *msa, ESL_ALPHABET *abc, char *errbuf, int
 static int  get_pp_idx(ESL_ALPHABET *abc, char ppchar);
 static int  count_msa(ESL_MSA *msa, char *errbuf, int nali, int no_ambig, int use_weights, double ***ret_abc_ct, double ****ret_bp_ct, double ***ret_pp_ct);
 static int  check_msa_weights(ESL_MSA *msa);
+static int  read_small(ESL_STOCKHOLM_STREAM *sst, ESL_ALPHABET *abc, FILE *listfp, int do_pp, ESL_MSA **ret_msa, int64_t *ret_alen, double ***ret_abc_ct, double ***ret_pp_ct);
+static int  grow_counts(double ***ct, int64_t *nct, int64_t newn, int ncol);
 
 static ESL_OPTIONS options[] = {
   /* name       type        default env   range togs  reqs  incomp      help                                                   docgroup */
@@ -40,6 +43,7 @@ static ESL_OPTIONS options[] = {
   { "--amino",    eslARG_NONE,    FALSE, NULL, NULL, NULL,NULL,"--dna,--rna",    "<msafile> contains protein alignments",                   1 },
   { "--dna",      eslARG_NONE,    FALSE, NULL, NULL, NULL,NULL,"--amino,--rna",  "<msafile> contains DNA alignments",                       1 },
   { "--rna",      eslARG_NONE,    FALSE, NULL, NULL, NULL,NULL,"--amino,--dna",  "<msafile> contains RNA alignments",                       1 },
+  { "--cpu",      eslARG_INT,       "0", NULL,"n>=0",NULL,NULL, "--small",       "number of threads for parsing alignments; 0 = serial",    1 },
   { "--small",    eslARG_NONE,    FALSE, NULL, NULL, NULL,NULL, NULL,            "use minimal RAM (RAM usage will be independent of aln size)", 2 },
   /* options for optional output files */
   { "--list",      eslARG_OUTFILE,NULL, NULL, NULL,      NULL,NULL, NULL,        "output list of sequence names in alignment(s) to file <f>",      3 },
@@ -64,14 +68,15 @@ main(int argc, char **argv)
   char         *alifile = NULL;	               /* alignment file name             */
   int           fmt     = eslMSAFILE_UNKNOWN;  /* format code for alifile         */
   ESL_MSAFILE  *afp     = NULL;		       /* open msa file                   */
-  ESL_MSAFILE2 *old_afp = NULL;	               /* open msa file, legacy (--small) */
+  ESL_STOCKHOLM_STREAM *sst = NULL;            /* line-by-line Stockholm reader (--small) */
+  ESL_MSAFILE_READER   *rdr = NULL;            /* parallel reader (without --small)        */
   ESL_MSA      *msa     = NULL;	               /* one multiple sequence alignment */
   int           nali;		               /* number of alignments read       */
   int           i;		               /* counter over seqs               */
-  int64_t       alen;		               /* alignment length                */
+  int64_t       alen    = 0;		       /* alignment length                */
   int           nseq;                          /* number of sequences in the msa */
   int64_t       rlen;		               /* a raw (unaligned) seq length    */
-  int64_t       small, large;	               /* smallest, largest sequence      */
+  int64_t       small   = -1, large = -1;      /* smallest, largest sequence      */
   int64_t       nres;		               /* total # of residues in msa      */
   double        avgid;		               /* average fractional pair id      */
   int           max_comparisons;               /* maximum # comparisons for avg id */
@@ -121,7 +126,7 @@ main(int argc, char **argv)
       esl_usage (stdout, argv[0], usage);
       puts("\n where options are:");
       esl_opt_DisplayHelp(stdout, go, 1, 2, 80);
-      puts("\n small memory mode, requires --amino,--dna, or --rna and --informat pfam:");
+      puts("\n small memory mode, for Stockholm or Pfam format:");
       esl_opt_DisplayHelp(stdout, go, 2, 2, 80);
       puts("\n optional output files:");
       esl_opt_DisplayHelp(stdout, go, 3, 2, 80);
@@ -142,7 +147,6 @@ main(int argc, char **argv)
       (fmt = esl_msafile_EncodeFormat(esl_opt_GetString(go, "--informat"))) == eslMSAFILE_UNKNOWN)
     esl_fatal("%s is not a valid input sequence file format for --informat", esl_opt_GetString(go, "--informat")); 
     
-  if (esl_opt_GetBoolean(go, "--small") && fmt != eslMSAFILE_PFAM) esl_fatal("--small requires --informat pfam\n"); 
 
   max_comparisons = 1000;
 
@@ -157,26 +161,23 @@ main(int argc, char **argv)
   else if (esl_opt_GetBoolean(go, "--dna"))     abc = esl_alphabet_Create(eslDNA);
   else if (esl_opt_GetBoolean(go, "--rna"))     abc = esl_alphabet_Create(eslRNA);
 
-  /* We'd like to get rid of the legacy msafile interface, but it
-   * includes small memory functionality for Pfam format which we have
-   * to replace first. For now, use both interfaces, new and legacy
+  if ( (status = esl_msafile_Open(&abc, alifile, NULL, fmt, NULL, &afp)) != eslOK)
+    esl_msafile_OpenFailure(afp, status);
+
+  /* In small memory mode, Stockholm alignments are read one line at a
+   * time, keeping only #=GC annotation (for RF), and #=GR PP lines if
+   * we need PP counts.
    */
   if ( esl_opt_GetBoolean(go, "--small") )
     {
-      if (! abc) esl_fatal("--small requires one of --amino, --dna, --rna be specified.");
-
-      status = esl_msafile2_OpenDigital(abc, alifile, NULL, &old_afp);
-      if      (status == eslENOTFOUND) esl_fatal("Alignment file %s doesn't exist or is not readable\n", alifile);
-      else if (status == eslEFORMAT)   esl_fatal("Couldn't determine format of alignment %s\n", alifile);
-      else if (status != eslOK)        esl_fatal("Alignment file open failed with error %d\n", status);
-    }
-  else
-    {
-      if ( (status = esl_msafile_Open(&abc, alifile, NULL, fmt, NULL, &afp)) != eslOK)
-	esl_msafile_OpenFailure(afp, status);
+      if (afp->format != eslMSAFILE_STOCKHOLM && afp->format != eslMSAFILE_PFAM)
+	esl_fatal("--small requires Stockholm or Pfam format alignment input\n");
+      if ((status = esl_msafile_stockholm_StreamCreate(afp, eslSTOCKHOLM_KEEP_GC | (esl_opt_IsOn(go, "--pcinfo") ? eslSTOCKHOLM_KEEP_GR : 0), &sst)) != eslOK)
+	esl_fatal("Failed to create Stockholm stream, error code %d\n", status);
     }
+  else if ((status = esl_msafile_ReaderCreate(afp, esl_opt_GetInteger(go, "--cpu"), &rdr)) != eslOK)
+    esl_fatal("Failed to create MSA reader, error code %d\n", status);
 
-  
 
   /**************************************
    * Open optional output files, as nec *
@@ -233,11 +234,11 @@ main(int argc, char **argv)
 
   nali = 0;
   
-  fmt = (esl_opt_GetBoolean(go, "--small") ? old_afp->format : afp->format);
+  fmt = afp->format;
 
   while ( (status = ( esl_opt_GetBoolean(go, "--small") ? 
-		      esl_msafile2_ReadInfoPfam(old_afp, listfp, abc, -1, NULL, NULL, &msa, &nseq, &alen, NULL, NULL, NULL, NULL, NULL, &abc_ct, &pp_ct, NULL, NULL, NULL) :
-		      esl_msafile_Read        (afp, &msa))) == eslOK)
+		      read_small(sst, abc, listfp, esl_opt_IsOn(go, "--pcinfo"), &msa, &alen, &abc_ct, &pp_ct) :
+		      esl_msafile_ReaderNext(rdr, &msa))) == eslOK)
     { 
       nali++;
       nres = 0;
@@ -257,6 +258,7 @@ main(int argc, char **argv)
 	esl_dst_XAverageId(abc, msa->ax, msa->nseq, max_comparisons, &avgid);
       }
       else { /* --small invoked */
+	nseq = msa->nseq;
 	for(i = 0; i < alen; i++) nres += (int) esl_vec_DSum(abc_ct[i], abc->K);
       }
 
@@ -303,7 +305,7 @@ main(int argc, char **argv)
       /* Dump data to optional output files, if nec */
       if(esl_opt_IsOn(go, "--list")) {
 	if(! esl_opt_GetBoolean(go, "--small")) { 
-	    /* only print sequence name to list file if ! --small, else we already have in esl_msafile2_ReadInfoPfam() */
+	    /* only print sequence name to list file if ! --small, else we already have in read_small() */
 	    for(i = 0; i < msa->nseq; i++) fprintf(listfp, "%s\n", msa->sqname[i]);
 	}
       }
@@ -367,19 +369,8 @@ main(int argc, char **argv)
       esl_free(rf2a_map);                                           rf2a_map = NULL; 
     }
   
-  /* If an msa read failed, we've dropped out to here with an informative status code. 
-   * we have to handle failures from new vs. legacy msa parsing differently 
-   */
-  if (esl_opt_GetBoolean(go, "--small")) 
-    {
-      if      (status == eslEFORMAT)  esl_fatal("Alignment file parse error, line %d of file %s:\n%s\nOffending line is:\n%s\n", old_afp->linenumber, old_afp->fname, old_afp->errbuf, old_afp->buf);	
-      else if (status != eslEOF)      esl_fatal("Alignment file read failed with error code %d\n", status);
-      else if (nali   == 0)           esl_fatal("No alignments found in file %s\n", alifile);
-    }
-  else
-    {
-      if (nali == 0 || status != eslEOF) esl_msafile_ReadFailure(afp, status);
-    }
+  /* If an msa read failed, we've dropped out to here with an informative status code. */
+  if (nali == 0 || status != eslEOF) esl_msafile_ReadFailure(afp, status);
 
   /* Cleanup, normal return
    */
@@ -417,8 +408,9 @@ main(int argc, char **argv)
   }
 
 
+  esl_msafile_stockholm_StreamDestroy(sst);
+  esl_msafile_ReaderDestroy(rdr);
   if (afp)     esl_msafile_Close(afp);
-  if (old_afp) esl_msafile2_Close(old_afp);
   esl_alphabet_Destroy(abc);
   esl_getopts_Destroy(go);
   return 0;
@@ -1153,3 +1145,94 @@ static int check_msa_weights(ESL_MSA *msa)
 }
 
 
+/* read_small()
+ *
+ * Small memory mode: read the next alignment from Stockholm stream
+ * <sst>, in digital alphabet <abc>, one line at a time, counting residues (and, if <do_pp>, #=GR PP
+ * codes) per column as we go, without storing the aligned sequences.
+ * Names of sequences go to <listfp>, if it's non-NULL.
+ *
+ * <ret_msa> holds the alignment's names, GF and GC annotation, but
+ * no sequences. <ret_abc_ct> and <ret_pp_ct> are as for count_msa(),
+ * with unweighted counts; <ret_pp_ct> is NULL if the alignment has no
+ * #=GR PP lines.
+ *
+ * Returns eslOK on success; eslEOF if there are no more alignments;
+ * eslEFORMAT on a parse error, with a message in sst->afp->errmsg.
+ */
+static int read_small(ESL_STOCKHOLM_STREAM *sst, ESL_ALPHABET *abc, FILE *listfp, int do_pp, ESL_MSA **ret_msa, int64_t *ret_alen, double ***ret_abc_ct, double ***ret_pp_ct)
+{
+  double      **abc_ct  = NULL;
+  double      **pp_ct   = NULL;
+  int64_t       nabc    = 0;      /* number of columns allocated in abc_ct */
+  int64_t       npp     = 0;      /* ... and in pp_ct */
+  int           nppvals = 12;     /* '0'-'9' = 0-9, '*' = 10, gap = '11' */
+  int           ppidx;
+  int64_t       i;
+  int           status;
+
+  while ((status = esl_msafile_stockholm_StreamNext(sst)) == eslOK)
+    {
+      if (sst->linetype == eslSTOCKHOLM_STREAM_SQ)
+	{
+	  if (listfp && sst->block == 0) fprintf(listfp, "%s\n", sst->msa->sqname[sst->idx]);
+	  if ((status = grow_counts(&abc_ct, &nabc, sst->apos + sst->n - 1, abc->K+1)) != eslOK) goto ERROR;
+	  for (i = 0; i < sst->n; i++)
+	    esl_abc_DCount(abc, abc_ct[sst->apos-1+i], sst->dsq[i+1], 1.0);
+	}
+      else if (do_pp && strcmp(sst->tag, "PP") == 0)
+	{
+	  if ((status = grow_counts(&pp_ct, &npp, sst->apos + sst->n - 1, nppvals)) != eslOK) goto ERROR;
+	  for (i = 0; i < sst->n; i++)
+	    {
+	      if ((ppidx = get_pp_idx(abc, sst->text[i])) == -1) ESL_XFAIL(eslEFORMAT, sst->afp->errmsg, "bad #=GR PP char: %c", sst->text[i]);
+	      pp_ct[sst->apos-1+i][ppidx] += 1.;
+	    }
+	}
+    }
+  if (status != eslEOD) goto ERROR;
+
+  /* the arrays are freed as [0..alen-1], so must be exactly that size */
+  if ((status = grow_counts(&abc_ct, &nabc, sst->msa->alen, abc->K+1)) != eslOK) goto ERROR;
+  if (pp_ct && (status = grow_counts(&pp_ct, &npp, sst->msa->alen, nppvals)) != eslOK) goto ERROR;
+
+  *ret_msa    = sst->msa;
+  *ret_alen   = sst->msa->alen;
+  *ret_abc_ct = abc_ct;
+  *ret_pp_ct  = pp_ct;
+  sst->msa    = NULL;	/* caller owns the msa now */
+  return eslOK;
+
+ ERROR:
+  esl_arr2_Destroy((void **) abc_ct, nabc);
+  esl_arr2_Destroy((void **) pp_ct,  npp);
+  *ret_msa    = NULL;
+  *ret_alen   = 0;
+  *ret_abc_ct = NULL;
+  *ret_pp_ct  = NULL;
+  return status;
+}
+
+/* grow_counts()
+ *
+ * Make sure count array <*ct>, currently [0..*nct-1][0..ncol-1], has
+ * at least <newn> columns; new ones are zeroed.
+ */
+static int grow_counts(double ***ct, int64_t *nct, int64_t newn, int ncol)
+{
+  int64_t apos;
+  int     status;
+
+  if (newn <= *nct) return eslOK;
+  ESL_REALLOC(*ct, sizeof(double *) * newn);
+  for (apos = *nct; apos < newn; apos++) (*ct)[apos] = NULL;
+  for (apos = *nct; apos < newn; apos++) {
+    ESL_ALLOC((*ct)[apos], sizeof(double) * ncol);
+    esl_vec_DSet((*ct)[apos], ncol, 0.);
+    *nct = apos+1;
+  }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
@@ -13,6 +13,7 @@
 #include "esl_getopts.h"
 #include "esl_fileparser.h"
 #include "esl_keyhash.h"
+#include "esl_quicksort.h"
 #include "esl_regexp.h"
 #include "esl_ssi.h"
 #include "esl_sq.h"
@@ -76,6 +77,8 @@ static ESL_OPTIONS options[] = {
   { "-C",          eslARG_NONE,   FALSE,  NULL, NULL, NULL, "-f",              "--index",            "<namefile> in <f> contains subseq coords too",      2 },
 
   { "--informat",  eslARG_STRING, FALSE,  NULL, NULL, NULL, NULL,              NULL,                 "specify that input file is in format <s>",          3 },
+  { "--unordered", eslARG_NONE,   FALSE,  NULL, NULL, NULL, "-f",              "-C",                 "with -f and SSI index: output seqs in file order",  3 },
+  { "--cpu",       eslARG_INT,    "0",    NULL, "n>=0",NULL, "--index",         NULL,                 "with --index: number of threads to use",            3 },
 
   /* undocumented as options, because they're documented as alternative invocations: */
   { "-f",          eslARG_NONE,  FALSE,   NULL, NULL, NULL, NULL,              "--index",           "second cmdline arg is a file of names to retrieve", 99 },
@@ -85,8 +88,17 @@ static ESL_OPTIONS options[] = {
 };
 
 static void create_ssi_index(ESL_GETOPTS *go, ESL_SQFILE *sqfp);
+static void add_ssi_keys(ESL_NEWSSI *ns, ESL_SQ *sq, uint16_t fh, int nseq);
+/* Where the records in a multifetch are, for sorting them into file order. */
+struct fetch_where {
+  uint16_t *fh;
+  off_t    *roff;
+};
+
 static void multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp);
-static void onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, ESL_SQFILE *sqfp);
+static int  file_order(const void *data, int o1, int o2);
+static void copy_records(FILE *ofp, FILE *tmpfp, const off_t *toff, const int *order, int n);
+static void onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, off_t roff, ESL_SQFILE *sqfp);
 static void multifetch_subseq(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp);
 static void onefetch_subseq(ESL_GETOPTS *go, FILE *ofp, ESL_SQFILE *sqfp, char *newname, 
 			    char *key, uint32_t given_start, uint32_t given_end);
@@ -195,7 +207,7 @@ main(int argc, char **argv)
 	}
       else 
 	{
-	  onefetch(go, ofp, esl_opt_GetArg(go, 2), sqfp);
+	  onefetch(go, ofp, esl_opt_GetArg(go, 2), -1, sqfp);
 	  if (ofp != stdout) printf("\n\nRetrieved sequence %s.\n",  esl_opt_GetArg(go, 2));
 	}
     }
@@ -208,16 +220,23 @@ main(int argc, char **argv)
 
 /* Create an SSI index file for open sequence file <sqfp>.
  * Both name and accession of sequences are stored as keys.
+ * 
+ * With --cpu, a FASTA file is scanned for key offsets in blocks,
+ * parsed in parallel; and a large index sorts its keys in
+ * parallel too.
  */
 static void
 create_ssi_index(ESL_GETOPTS *go, ESL_SQFILE *sqfp)
 {
-  ESL_NEWSSI *ns      = NULL;
-  ESL_SQ     *sq      = esl_sq_Create();
-  int         nseq    = 0;
-  char       *ssifile = NULL;
-  uint16_t    fh;
-  int         status;
+  ESL_NEWSSI   *ns       = NULL;
+  ESL_SQ       *sq       = esl_sq_Create();
+  ESL_SQ_BLOCK *block    = NULL;
+  int           nthreads = esl_opt_GetInteger(go, "--cpu");
+  int           nseq     = 0;
+  char         *ssifile  = NULL;
+  uint16_t      fh;
+  int           i;
+  int           status;
 
   esl_strdup(sqfp->filename, -1, &ssifile);
   esl_strcat(&ssifile, -1, ".ssi", 4);
@@ -228,23 +247,30 @@ create_ssi_index(ESL_GETOPTS *go, ESL_SQFILE *sqfp)
 
   if (esl_newssi_AddFile(ns, sqfp->filename, sqfp->format, &fh) != eslOK)
     esl_fatal("Failed to add sequence file %s to new SSI index\n", sqfp->filename);
+  if (esl_newssi_SetThreads(ns, nthreads) != eslOK)
+    esl_fatal("Failed to set threads for new SSI index");
 
   printf("Creating SSI index for %s...    ", sqfp->filename); 
   fflush(stdout);
   
-  while ((status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
+  if (nthreads > 0 && sqfp->format == eslSQFILE_FASTA)
     {
-      nseq++;
-      if (sq->name == NULL) esl_fatal("Every sequence must have a name to be indexed. Failed to find name of seq #%d\n", nseq);
-
-      if (esl_newssi_AddKey(ns, sq->name, fh, sq->roff, sq->doff, sq->L) != eslOK)
-	esl_fatal("Failed to add key %s to SSI index", sq->name);
-
-      if (sq->acc[0] != '\0') {
-	if (esl_newssi_AddAlias(ns, sq->acc, sq->name) != eslOK)
-	  esl_fatal("Failed to add secondary key %s to SSI index", sq->acc);
-      }
-      esl_sq_Reuse(sq);
+      if ((block = esl_sq_CreateBlock(4096))               == NULL)  esl_fatal("Failed to allocate a sequence block");
+      if (esl_sqfile_SetBlockThreads(sqfp, nthreads)       != eslOK) esl_fatal("Failed to set threads for reading %s", sqfp->filename);
+      while ((status = esl_sqio_ReadBlock(sqfp, block, -1, -1, FALSE)) == eslOK)
+	for (i = 0; i < block->count; i++)
+	  {
+	    add_ssi_keys(ns, block->list + i, fh, ++nseq);
+	    esl_sq_Reuse(block->list + i);
+	  }
+    }
+  else
+    {
+      while ((status = esl_sqio_ReadInfo(sqfp, sq)) == eslOK)
+	{
+	  add_ssi_keys(ns, sq, fh, ++nseq);
+	  esl_sq_Reuse(sq);
+	}
     }
   if      (status == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n",
 					   sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
@@ -271,22 +297,43 @@ create_ssi_index(ESL_GETOPTS *go, ESL_SQFILE *sqfp)
 
   free(ssifile);
   esl_sq_Destroy(sq);
+  esl_sq_DestroyBlock(block);
   esl_newssi_Close(ns);
   return;
 }
 
+/* Add the name of sequence <sq>, the <nseq>'th in file <fh>, to
+ * index <ns> as a primary key, and its accession (if any) as a 
+ * secondary key.
+ */
+static void
+add_ssi_keys(ESL_NEWSSI *ns, ESL_SQ *sq, uint16_t fh, int nseq)
+{
+  if (sq->name == NULL) esl_fatal("Every sequence must have a name to be indexed. Failed to find name of seq #%d\n", nseq);
+
+  if (esl_newssi_AddKey(ns, sq->name, fh, sq->roff, sq->doff, sq->L) != eslOK)
+    esl_fatal("Failed to add key %s to SSI index", sq->name);
+
+  if (sq->acc[0] != '\0') {
+    if (esl_newssi_AddAlias(ns, sq->acc, sq->name) != eslOK)
+      esl_fatal("Failed to add secondary key %s to SSI index", sq->acc);
+  }
+}
+
 /* multifetch:
  * given a file containing lines with one name or key per line;
  * parse the file line-by-line;
- * if we have an SSI index available, retrieve the seqs by key
- * as we see each line;
+ * if we have an SSI index available, store the keys, look them
+ * all up in the index at once, and retrieve the seqs by offset,
+ * in one forward sweep through the file in offset order;
  * else, without an SSI index, store the keys in a hash, then
  * read the entire seq file in a single pass, outputting seqs
  * that are in our keylist. 
  * 
  * Note that with an SSI index, you get the seqs in the order they
- * appear in the <keyfile>, but without an SSI index, you get seqs in
- * the order they occur in the seq file.
+ * appear in the <keyfile> (the sweep's output is staged in a tmpfile,
+ * then put back in order), unless --unordered is set; without an SSI
+ * index, you get seqs in the order they occur in the seq file.
  */
 static void
 multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp)
@@ -311,12 +358,65 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp)
       
       status = esl_keyhash_Store(keys, key, keylen, &keyidx);
       if (status == eslEDUP) esl_fatal("seq key %s occurs more than once in file %s\n", key, keyfile);
-	
-      /* if we have an SSI index, just fetch them as we go. */
-      if (sqfp->data.ascii.ssi != NULL) { onefetch(go, ofp, key, sqfp);  nseq++; }
       nkeys++;
     }
 
+  /* If we have an SSI index, a batch lookup of all the keys is one
+   * pass over the index, instead of a binary search per key. Then 
+   * the records are fetched in file order, so reading the seq file
+   * is one forward sweep, instead of a random seek per key.
+   */
+  if (sqfp->data.ascii.ssi != NULL && nkeys > 0)
+    {
+      char    **keylist;
+      off_t    *roff;
+      off_t    *toff;
+      int      *order;
+      FILE     *tmpfp = NULL;
+      char      tmpfile[16] = "esltmpXXXXXX";
+      int       i;
+      struct fetch_where where;
+
+      ESL_ALLOC(keylist,  sizeof(char *)   * nkeys);
+      ESL_ALLOC(where.fh, sizeof(uint16_t) * nkeys);
+      ESL_ALLOC(roff,     sizeof(off_t)    * nkeys);
+      ESL_ALLOC(toff,     sizeof(off_t)    * (nkeys+1));
+      ESL_ALLOC(order,    sizeof(int)      * nkeys);
+      for (keyidx = 0; keyidx < nkeys; keyidx++) keylist[keyidx] = esl_keyhash_Get(keys, keyidx);
+
+      status = esl_ssi_FindNames(sqfp->data.ascii.ssi, keylist, nkeys, where.fh, roff, NULL, NULL, NULL);
+      if      (status == eslEFORMAT) esl_fatal("Failed to parse SSI index for %s\n", sqfp->filename);
+      else if (status != eslOK)      esl_fatal("Failed to look up keys in SSI index of file %s\n", sqfp->filename);
+
+      for (keyidx = 0; keyidx < nkeys; keyidx++)
+	if (roff[keyidx] == -1) esl_fatal("seq %s not found in SSI index for file %s\n", keylist[keyidx], sqfp->filename);
+
+      where.roff = roff;
+      esl_quicksort(&where, nkeys, file_order, order);
+
+      if (! esl_opt_GetBoolean(go, "--unordered") && esl_tmpfile(tmpfile, &tmpfp) != eslOK)
+	esl_fatal("Failed to open a tmpfile for staging fetched seqs");
+
+      for (i = 0; i < nkeys; i++)
+	{
+	  keyidx = order[i];
+	  if (tmpfp) toff[keyidx] = ftello(tmpfp);
+	  onefetch(go, (tmpfp ? tmpfp : ofp), keylist[keyidx], roff[keyidx], sqfp);
+	  nseq++;
+	}
+      if (tmpfp)
+	{
+	  toff[nkeys] = ftello(tmpfp);
+	  copy_records(ofp, tmpfp, toff, order, nkeys);
+	  fclose(tmpfp);
+	}
+      free(keylist);
+      free(where.fh);
+      free(roff);
+      free(toff);
+      free(order);
+    }
+
   /* If we don't have an SSI index, we haven't fetched anything yet; do it now. */
   if (sqfp->data.ascii.ssi == NULL) 
     {
@@ -349,19 +449,75 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, ESL_SQFILE *sqfp)
   esl_keyhash_Destroy(keys);
   esl_fileparser_Close(efp);
   return;
+
+ ERROR:
+  esl_fatal("allocation failed");
 }
   
 
 
+/* file_order():
+ * esl_quicksort() comparison for multifetch(): put records in order
+ * of file handle, then offset. Ties (the same record, asked for by
+ * both name and accession) keep <namefile> order.
+ */
+static int
+file_order(const void *data, int o1, int o2)
+{
+  const struct fetch_where *where = data;
+
+  if (where->fh[o1]   != where->fh[o2])   return (where->fh[o1]   < where->fh[o2]   ? -1 : 1);
+  if (where->roff[o1] != where->roff[o2]) return (where->roff[o1] < where->roff[o2] ? -1 : 1);
+  return (o1 < o2 ? -1 : (o1 > o2 ? 1 : 0));
+}
+
+/* copy_records():
+ * Records <0..n-1> were written to <tmpfp> in the order <order[]>,
+ * starting at offsets <toff[]>, with <toff[n]> the end of the last
+ * one. Copy them to <ofp> in order <0..n-1>.
+ */
+static void
+copy_records(FILE *ofp, FILE *tmpfp, const off_t *toff, const int *order, int n)
+{
+  char   buf[65536];
+  off_t *end = NULL;
+  off_t  left;
+  size_t nb;
+  int    i;
+  int    status;
+
+  /* record order[i] ends where order[i+1] starts */
+  ESL_ALLOC(end, sizeof(off_t) * n);
+  for (i = 0; i < n; i++) end[order[i]] = (i+1 < n ? toff[order[i+1]] : toff[n]);
+
+  for (i = 0; i < n; i++)
+    {
+      if (fseeko(tmpfp, toff[i], SEEK_SET) != 0) esl_fatal("Failed to reposition tmpfile of fetched seqs");
+      for (left = end[i] - toff[i]; left > 0; left -= nb)
+	{
+	  nb = (left < sizeof(buf) ? left : sizeof(buf));
+	  if (fread (buf, 1, nb, tmpfp) != nb) esl_fatal("Failed to read tmpfile of fetched seqs");
+	  if (fwrite(buf, 1, nb, ofp)   != nb) esl_fatal("Failed to write fetched seqs");
+	}
+    }
+  free(end);
+  return;
+
+ ERROR:
+  esl_fatal("allocation failed");
+}
+
 /* onefetch():
  * Given one <key> (a seq name or accession), retrieve the corresponding sequence.
  * In SSI mode, we can do this quickly by positioning the file, then regurgitating
  * every line until the end-of-record marker; we don't even have to parse.
+ * If the caller already looked up the record offset <roff> in the index, we
+ * position there; else pass <roff> as -1, and we look up <key>.
  * Without an SSI index, we have to parse the file sequentially 'til we find
  * the one we're after.
  */
 static void
-onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, ESL_SQFILE *sqfp)
+onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, off_t roff, ESL_SQFILE *sqfp)
 {
   ESL_SQ  *sq            = esl_sq_Create();
   int      do_revcomp    = esl_opt_GetBoolean(go, "-r");
@@ -371,7 +527,8 @@ onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, ESL_SQFILE *sqfp)
   /* Try to position the file at the desired sequence with SSI. */
   if (sqfp->data.ascii.ssi != NULL)	
     {
-      status = esl_sqfile_PositionByKey(sqfp, key);
+      if (roff >= 0) status = esl_sqfile_Position(sqfp, roff);
+      else           status = esl_sqfile_PositionByKey(sqfp, key);
       if      (status == eslENOTFOUND) esl_fatal("seq %s not found in SSI index for file %s\n", key, sqfp->filename);
       else if (status == eslEFORMAT)   esl_fatal("Failed to parse SSI index for %s\n", sqfp->filename);
       else if (status != eslOK)        esl_fatal("Failed to look up location of seq %s in SSI index of file %s\n", key, sqfp->filename);
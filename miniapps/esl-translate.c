@@ -21,21 +21,7 @@ do_by_sequences(ESL_GENCODE *gcode, ESL_GENCODE_WORKSTATE *wrk, ESL_SQFILE *sqfp
 
   while (( status = esl_sqio_Read(sqfp, sq )) == eslOK)
     {
-      if (sq->n < 3) continue;
-
-      if (wrk->do_watson) {
-        esl_gencode_ProcessStart(gcode, wrk, sq);
-        esl_gencode_ProcessPiece(gcode, wrk, sq);
-        esl_gencode_ProcessEnd(wrk, sq);
-      }
-
-      if (wrk->do_crick) {
-        esl_sq_ReverseComplement(sq);
-        esl_gencode_ProcessStart(gcode, wrk, sq);
-        esl_gencode_ProcessPiece(gcode, wrk, sq);
-        esl_gencode_ProcessEnd(wrk, sq);
-      }
-
+      if (esl_gencode_ProcessSequence(gcode, wrk, sq) != eslOK) esl_fatal("Failed to translate sequence %s", sq->name);
       esl_sq_Reuse(sq);
     }
   if      (status == eslEFORMAT) esl_fatal("Parse failed (sequence file %s)\n%s\n",
@@ -25,6 +25,7 @@ static ESL_OPTIONS options[] = {
   { "-o",         eslARG_OUTFILE, NULL, NULL,     NULL,   NULL,NULL,   NULL,          "send output to file <f>, not stdout",         1 },
   { "--id",       eslARG_REAL,  "0.62", NULL,"0<=x<=1",   NULL,"-b",   NULL,          "for -b: set identity cutoff",                 1 },
   { "--idf",      eslARG_REAL,  "0.80", NULL,"0<=x<=1",   NULL,"-f",   NULL,          "for -f: set identity cutoff",                 1 },
+  { "--cpu",      eslARG_INT,      "0", NULL,   "n>=0",   NULL,NULL,   NULL,          "for -b, -f, -p: number of threads to use",    1 },
   { "--informat", eslARG_STRING, FALSE, NULL,     NULL,   NULL,NULL,   NULL,          "specify that input file is in format <s>",    1 },
   { "--amino",    eslARG_NONE,   FALSE, NULL,     NULL,   NULL,NULL,"--dna,--rna",    "<msa file> contains protein alignments",      1 },
   { "--dna",      eslARG_NONE,   FALSE, NULL,     NULL,   NULL,NULL,"--amino,--rna",  "<msa file> contains DNA alignments",          1 },
@@ -68,6 +69,7 @@ main(int argc, char **argv)
   ESL_ALPHABET   *abc      = NULL;
   ESL_MSAFILE    *afp      = NULL;
   ESL_MSA        *msa      = NULL;
+  ESL_MSAWEIGHT_CFG *cfg   = esl_msaweight_cfg_Create();
   int             status;
   FILE           *ofp;	   /* output stream       */
 
@@ -78,6 +80,7 @@ main(int argc, char **argv)
   if (esl_opt_GetBoolean(go, "-h") )                   cmdline_help   (argv[0], go);
   if (esl_opt_ArgNumber(go) != 1)                      cmdline_failure(argv[0], go, "Incorrect number of command line arguments.\n");
   msafile = esl_opt_GetArg(go, 1);
+  cfg->nthreads = esl_opt_GetInteger(go, "--cpu");
 
   if (esl_opt_IsOn(go, "--informat")) {
     fmt = esl_msafile_EncodeFormat(esl_opt_GetString(go, "--informat"));
@@ -102,7 +105,8 @@ main(int argc, char **argv)
       if       (esl_opt_GetBoolean(go, "-f")) 
 	{
 	  ESL_MSA *fmsa;
-	  status = esl_msaweight_IDFilter(msa, esl_opt_GetReal(go, "--idf"), &fmsa);
+	  if (msa->flags & eslMSA_DIGITAL) status = esl_msaweight_IDFilter_adv(cfg, msa, esl_opt_GetReal(go, "--idf"), &fmsa);
+	  else                             status = esl_msaweight_IDFilter    (     msa, esl_opt_GetReal(go, "--idf"), &fmsa);
 	  esl_msafile_Write(ofp, fmsa, eslMSAFILE_STOCKHOLM); 
 	  if (fmsa != NULL) esl_msa_Destroy(fmsa);
 	}
@@ -113,12 +117,13 @@ main(int argc, char **argv)
 	} 
       else if  (esl_opt_GetBoolean(go, "-p")) 
 	{
-	  status = esl_msaweight_PB(msa);                                  
+	  if (msa->flags & eslMSA_DIGITAL) status = esl_msaweight_PB_adv(cfg, msa, NULL);
+	  else                             status = esl_msaweight_PB    (     msa);
 	  esl_msafile_Write(ofp, msa, eslMSAFILE_STOCKHOLM);
 	} 
       else if  (esl_opt_GetBoolean(go, "-b"))
 	{ 
-	  status = esl_msaweight_BLOSUM(msa, esl_opt_GetReal(go, "--id")); 
+	  status = esl_msaweight_BLOSUM_adv(cfg, msa, esl_opt_GetReal(go, "--id")); 
  	  esl_msafile_Write(ofp, msa, eslMSAFILE_STOCKHOLM);
 	} 
      else     esl_fatal("internal error: no weighting algorithm selected");
@@ -127,6 +132,7 @@ main(int argc, char **argv)
       esl_msa_Destroy(msa);
     }
 
+  esl_msaweight_cfg_Destroy(cfg);
   esl_alphabet_Destroy(abc);
   esl_msafile_Close(afp);
   if (ofp != stdout) fclose(ofp); 